@@ -28,9 +28,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 #include "mainwidget.h"
 #include "history/history_widget.h"
+#include "history/history_export.h"
 #include "storage/localstorage.h"
 #include "auth_session.h"
 #include "boxes/confirm_box.h"
+#include "ui/toast/toast.h"
 #include "window/themes/window_theme.h"
 #include "window/notifications_manager.h"
 #include "chat_helpers/message_field.h"
@@ -42,6 +44,7 @@ constexpr auto kReloadChannelMembersTimeout = 1000; // 1 second wait before relo
 constexpr auto kSaveCloudDraftTimeout = 1000; // save draft to the cloud with 1 sec extra delay
 constexpr auto kSaveDraftBeforeQuitTimeout = 1500; // give the app 1.5 secs to save drafts to cloud when quitting
 constexpr auto kSmallDelayMs = 5;
+constexpr auto kMissingMessagesLimit = 256;
 constexpr auto kStickersUpdateTimeout = 3600000; // update not more than once in an hour
 constexpr auto kUnreadMentionsPreloadIfLess = 5;
 constexpr auto kUnreadMentionsFirstRequestLimit = 10;
@@ -52,6 +55,7 @@ constexpr auto kUnreadMentionsNextRequestLimit = 100;
 ApiWrap::ApiWrap(not_null<AuthSession*> session)
 : _session(session)
 , _messageDataResolveDelayed([this] { resolveMessageDatas(); })
+, _peersRequestDelayed([this] { sendPeersRequests(); })
 , _webPagesTimer([this] { resolveWebPages(); })
 , _draftsSaveTimer([this] { saveDraftsToCloud(); }) {
 }
@@ -155,9 +159,35 @@ ApiWrap::MessageDataRequests *ApiWrap::messageDataRequests(ChannelData *channel,
 	return &_messageDataRequests;
 }
 
+void ApiWrap::resolveMissingMessageDatas(ChannelData *channel, MessageDataRequests &requests) {
+	if (_missingMessages.empty()) {
+		return;
+	}
+	auto channelId = channel ? peerToChannel(channel->id) : NoChannel;
+	auto resolved = std::vector<std::pair<MsgId, MessageDataRequest::Callbacks>>();
+	for (auto i = requests.begin(); i != requests.end();) {
+		if (!i.value().requestId && _missingMessages.contains(FullMsgId(channelId, i.key()))) {
+			resolved.push_back(std::make_pair(i.key(), std::move(i.value().callbacks)));
+			i = requests.erase(i);
+		} else {
+			++i;
+		}
+	}
+	for (auto &entry : resolved) {
+		for_const (auto &callback, entry.second) {
+			callback(channel, entry.first);
+		}
+	}
+}
+
 void ApiWrap::resolveMessageDatas() {
 	if (_messageDataRequests.isEmpty() && _channelMessageDataRequests.isEmpty()) return;
 
+	resolveMissingMessageDatas(nullptr, _messageDataRequests);
+	for (auto i = _channelMessageDataRequests.begin(); i != _channelMessageDataRequests.end(); ++i) {
+		resolveMissingMessageDatas(i.key(), i.value());
+	}
+
 	auto ids = collectMessageIds(_messageDataRequests);
 	if (!ids.isEmpty()) {
 		auto requestId = request(MTPmessages_GetMessages(MTP_vector<MTPint>(ids))).done([this](const MTPmessages_Messages &result, mtpRequestId requestId) {
@@ -218,8 +248,12 @@ void ApiWrap::gotMessageDatas(ChannelData *channel, const MTPmessages_Messages &
 	}
 	auto requests = messageDataRequests(channel, true);
 	if (requests) {
+		auto channelId = channel ? peerToChannel(channel->id) : NoChannel;
 		for (auto i = requests->begin(); i != requests->cend();) {
 			if (i.value().requestId == requestId) {
+				if (!App::histItemById(channelId, i.key())) {
+					rememberMissingMessage(FullMsgId(channelId, i.key()));
+				}
 				for_const (auto &callback, i.value().callbacks) {
 					callback(channel, i.key());
 				}
@@ -234,6 +268,18 @@ void ApiWrap::gotMessageDatas(ChannelData *channel, const MTPmessages_Messages &
 	}
 }
 
+void ApiWrap::rememberMissingMessage(FullMsgId id) {
+	if (_missingMessages.contains(id)) {
+		return;
+	}
+	_missingMessages.insert(id);
+	_missingMessagesOrder.push_back(id);
+	if (int(_missingMessagesOrder.size()) > kMissingMessagesLimit) {
+		_missingMessages.remove(_missingMessagesOrder.front());
+		_missingMessagesOrder.pop_front();
+	}
+}
+
 void ApiWrap::requestFullPeer(PeerData *peer) {
 	if (!peer || _fullPeerRequests.contains(peer)) return;
 
@@ -462,51 +508,123 @@ void ApiWrap::gotUserFull(UserData *user, const MTPUserFull &result, mtpRequestI
 void ApiWrap::requestPeer(PeerData *peer) {
 	if (!peer || _fullPeerRequests.contains(peer) || _peerRequests.contains(peer)) return;
 
-	auto sendRequest = [this, peer] {
-		auto failHandler = [this, peer](const RPCError &error) {
+	// Peers requested while handling one event are sent in one request per type.
+	_peerRequests.insert(peer, 0);
+	_peersToRequest.push_back(peer);
+	_peersRequestDelayed.call();
+}
+
+void ApiWrap::sendPeersRequests() {
+	auto userPeers = QVector<PeerData*>();
+	auto chatPeers = QVector<PeerData*>();
+	auto channelPeers = QVector<PeerData*>();
+	for (auto peer : base::take(_peersToRequest)) {
+		if (peer->isUser()) {
+			userPeers.push_back(peer);
+		} else if (peer->isChat()) {
+			chatPeers.push_back(peer);
+		} else if (peer->isChannel()) {
+			channelPeers.push_back(peer);
+		} else {
 			_peerRequests.remove(peer);
-		};
-		auto chatHandler = [this, peer](const MTPmessages_Chats &result) {
+		}
+	}
+	sendPeersRequest(userPeers);
+	sendPeersRequest(chatPeers);
+	sendPeersRequest(channelPeers);
+}
+
+void ApiWrap::sendPeersRequest(const QVector<PeerData*> &peers) {
+	if (peers.isEmpty()) {
+		return;
+	}
+	auto failHandler = [this, peers](const RPCError &error) {
+		for_const (auto peer, peers) {
 			_peerRequests.remove(peer);
+		}
 
-			if (auto chats = Api::getChatsFromMessagesChats(result)) {
-				auto &v = chats->v;
-				bool badVersion = false;
-				if (auto chat = peer->asChat()) {
-					badVersion = (!v.isEmpty() && v[0].type() == mtpc_chat && v[0].c_chat().vversion.v < chat->version);
-				} else if (auto channel = peer->asChannel()) {
-					badVersion = (!v.isEmpty() && v[0].type() == mtpc_channel && v[0].c_channel().vversion.v < channel->version);
-				}
-				auto chat = App::feedChats(*chats);
-				if (chat == peer) {
-					if (badVersion) {
-						if (auto chat = peer->asChat()) {
-							chat->version = v[0].c_chat().vversion.v;
-						} else if (auto channel = peer->asChannel()) {
-							channel->version = v[0].c_channel().vversion.v;
-						}
-						requestPeer(peer);
-					}
-				}
+		// One bad peer fails the whole batch, request the others one by one.
+		if (peers.size() > 1) {
+			for_const (auto peer, peers) {
+				sendPeersRequest(QVector<PeerData*>(1, peer));
 			}
-		};
-		if (auto user = peer->asUser()) {
-			return request(MTPusers_GetUsers(MTP_vector<MTPInputUser>(1, user->inputUser))).done([this, user](const MTPVector<MTPUser> &result) {
-				_peerRequests.remove(user);
-				App::feedUsers(result);
-			}).fail(failHandler).send();
-		} else if (auto chat = peer->asChat()) {
-			return request(MTPmessages_GetChats(MTP_vector<MTPint>(1, chat->inputChat))).done(chatHandler).fail(failHandler).send();
-		} else if (auto channel = peer->asChannel()) {
-			return request(MTPchannels_GetChannels(MTP_vector<MTPInputChannel>(1, channel->inputChannel))).done(chatHandler).fail(failHandler).send();
 		}
-		return 0;
 	};
-	if (auto requestId = sendRequest()) {
+	auto requestId = mtpRequestId(0);
+	if (peers.front()->isUser()) {
+		auto users = QVector<MTPInputUser>();
+		users.reserve(peers.size());
+		for_const (auto peer, peers) {
+			users.push_back(peer->asUser()->inputUser);
+		}
+		requestId = request(MTPusers_GetUsers(MTP_vector<MTPInputUser>(users))).done([this, peers](const MTPVector<MTPUser> &result) {
+			for_const (auto peer, peers) {
+				_peerRequests.remove(peer);
+			}
+			App::feedUsers(result);
+		}).fail(failHandler).send();
+	} else if (peers.front()->isChat()) {
+		auto chats = QVector<MTPint>();
+		chats.reserve(peers.size());
+		for_const (auto peer, peers) {
+			chats.push_back(peer->asChat()->inputChat);
+		}
+		requestId = request(MTPmessages_GetChats(MTP_vector<MTPint>(chats))).done([this, peers](const MTPmessages_Chats &result) {
+			gotChats(peers, result);
+		}).fail(failHandler).send();
+	} else {
+		auto channels = QVector<MTPInputChannel>();
+		channels.reserve(peers.size());
+		for_const (auto peer, peers) {
+			channels.push_back(peer->asChannel()->inputChannel);
+		}
+		requestId = request(MTPchannels_GetChannels(MTP_vector<MTPInputChannel>(channels))).done([this, peers](const MTPmessages_Chats &result) {
+			gotChats(peers, result);
+		}).fail(failHandler).send();
+	}
+	for_const (auto peer, peers) {
 		_peerRequests.insert(peer, requestId);
 	}
 }
 
+void ApiWrap::gotChats(const QVector<PeerData*> &peers, const MTPmessages_Chats &result) {
+	for_const (auto peer, peers) {
+		_peerRequests.remove(peer);
+	}
+	auto chats = Api::getChatsFromMessagesChats(result);
+	if (!chats) {
+		return;
+	}
+
+	// The received versions can be older than the known ones, request again.
+	auto badVersions = QVector<QPair<PeerData*, int>>();
+	for_const (auto &data, chats->v) {
+		if (data.type() == mtpc_chat) {
+			auto &d = data.c_chat();
+			auto chat = App::chatLoaded(d.vid.v);
+			if (chat && peers.contains(chat) && d.vversion.v < chat->version) {
+				badVersions.push_back(qMakePair(static_cast<PeerData*>(chat), d.vversion.v));
+			}
+		} else if (data.type() == mtpc_channel) {
+			auto &d = data.c_channel();
+			auto channel = App::channelLoaded(d.vid.v);
+			if (channel && peers.contains(channel) && d.vversion.v < channel->version) {
+				badVersions.push_back(qMakePair(static_cast<PeerData*>(channel), d.vversion.v));
+			}
+		}
+	}
+	App::feedChats(*chats);
+	for_const (auto &badVersion, badVersions) {
+		auto peer = badVersion.first;
+		if (auto chat = peer->asChat()) {
+			chat->version = badVersion.second;
+		} else if (auto channel = peer->asChannel()) {
+			channel->version = badVersion.second;
+		}
+		requestPeer(peer);
+	}
+}
+
 void ApiWrap::requestPeers(const QList<PeerData*> &peers) {
 	QVector<MTPint> chats;
 	QVector<MTPInputChannel> channels;
@@ -567,7 +685,7 @@ void ApiWrap::requestLastParticipants(ChannelData *channel, bool fromStart) {
 		if (_participantsRequests.value(channel) == requestId || _participantsRequests.value(channel) == -requestId) {
 			_participantsRequests.remove(channel);
 		}
-	}).send();
+	}).inBackground().send();
 
 	_participantsRequests.insert(channel, fromStart ? requestId : -requestId);
 }
@@ -583,7 +701,7 @@ void ApiWrap::requestBots(ChannelData *channel) {
 		if (_botsRequests.value(channel) == requestId) {
 			_botsRequests.remove(channel);
 		}
-	}).send();
+	}).inBackground().send();
 
 	_botsRequests.insert(channel, requestId);
 }
@@ -1459,6 +1577,10 @@ void ApiWrap::stickersSaveOrder() {
 }
 
 void ApiWrap::updateStickers() {
+	// Apply the local cache before the requests, so that it won't
+	// overwrite the fresh data received from the server.
+	Local::readDeferredStickers();
+
 	auto now = getms(true);
 	requestStickers(now);
 	requestRecentStickers(now);
@@ -1730,6 +1852,13 @@ void ApiWrap::jumpToDate(not_null<PeerData*> peer, const QDate &date) {
 	// So we request a message with offset_date = desired_date - 1 and add_offset = -1.
 	// This should give us the first message with date >= desired_date.
 	auto offset_date = static_cast<int>(QDateTime(date).toTime_t()) - 1;
+	if (auto history = App::historyLoaded(peer)) {
+		// Jump right away if some loaded slices contain the date.
+		if (auto msgId = history->findMessageAtDate(offset_date + 1)) {
+			Ui::showPeerHistory(peer, msgId);
+			return;
+		}
+	}
 	auto add_offset = -1;
 	auto limit = 1;
 	request(MTPmessages_GetHistory(peer->input, MTP_int(0), MTP_int(offset_date), MTP_int(add_offset), MTP_int(limit), MTP_int(0), MTP_int(0))).done([peer](const MTPmessages_Messages &result) {
@@ -1911,4 +2040,19 @@ void ApiWrap::sendSaveChatAdminsRequests(not_null<ChatData*> chat) {
 	requestSendDelayed();
 }
 
+void ApiWrap::exportHistory(not_null<PeerData*> peer, const QString &path) {
+	if (_historyExports.contains(peer)) {
+		return;
+	}
+	auto exporter = std::make_unique<HistoryExport::Exporter>(peer, path, [this, peer](bool success, int count) {
+		Ui::Toast::Show(success
+			? lng_export_history_done(lt_count, count)
+			: lang(lng_export_history_failed));
+		_historyExports.remove(peer);
+	});
+	auto raw = exporter.get();
+	_historyExports.emplace(peer, std::move(exporter));
+	raw->start();
+}
+
 ApiWrap::~ApiWrap() = default;
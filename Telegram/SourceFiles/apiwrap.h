@@ -28,6 +28,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 class AuthSession;
 
+namespace HistoryExport {
+class Exporter;
+} // namespace HistoryExport
+
 namespace Api {
 
 inline const MTPVector<MTPChat> *getChatsFromMessagesChats(const MTPmessages_Chats &chats) {
@@ -108,6 +112,8 @@ public:
 		bool adminsEnabled,
 		base::flat_set<not_null<UserData*>> &&admins);
 
+	void exportHistory(not_null<PeerData*> peer, const QString &path);
+
 	~ApiWrap();
 
 private:
@@ -126,7 +132,9 @@ private:
 	void saveDraftsToCloud();
 
 	void resolveMessageDatas();
+	void resolveMissingMessageDatas(ChannelData *channel, MessageDataRequests &requests);
 	void gotMessageDatas(ChannelData *channel, const MTPmessages_Messages &result, mtpRequestId requestId);
+	void rememberMissingMessage(FullMsgId id);
 
 	QVector<MTPint> collectMessageIds(const MessageDataRequests &requests);
 	MessageDataRequests *messageDataRequests(ChannelData *channel, bool onlyExisting = false);
@@ -135,6 +143,9 @@ private:
 	void gotUserFull(UserData *user, const MTPUserFull &result, mtpRequestId req);
 	void lastParticipantsDone(ChannelData *peer, const MTPchannels_ChannelParticipants &result, mtpRequestId req);
 	void resolveWebPages();
+	void sendPeersRequests();
+	void sendPeersRequest(const QVector<PeerData*> &peers);
+	void gotChats(const QVector<PeerData*> &peers, const MTPmessages_Chats &result);
 	void gotWebPages(ChannelData *channel, const MTPmessages_Messages &result, mtpRequestId req);
 	void gotStickerSet(uint64 setId, const MTPmessages_StickerSet &result);
 
@@ -160,9 +171,16 @@ private:
 	QMap<ChannelData*, MessageDataRequests> _channelMessageDataRequests;
 	SingleQueuedInvokation _messageDataResolveDelayed;
 
+	// Recently requested messages that were not found, so that replies to
+	// them in the reloaded history slices don't request them again.
+	base::flat_set<FullMsgId> _missingMessages;
+	std::deque<FullMsgId> _missingMessagesOrder;
+
 	using PeerRequests = QMap<PeerData*, mtpRequestId>;
 	PeerRequests _fullPeerRequests;
-	PeerRequests _peerRequests;
+	PeerRequests _peerRequests; // zero request id for the peers waiting in _peersToRequest
+	QVector<PeerData*> _peersToRequest;
+	SingleQueuedInvokation _peersRequestDelayed;
 
 	PeerRequests _participantsRequests;
 	PeerRequests _botsRequests;
@@ -209,6 +227,8 @@ private:
 	base::flat_map<not_null<ChatData*>, base::flat_set<not_null<UserData*>>> _chatAdminsToSave;
 	base::flat_map<not_null<ChatData*>, base::flat_set<mtpRequestId>> _chatAdminsSaveRequests;
 
+	base::flat_map<not_null<PeerData*>, std::unique_ptr<HistoryExport::Exporter>> _historyExports;
+
 	base::Observable<PeerData*> _fullPeerUpdated;
 
 };
@@ -49,6 +49,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "window/themes/window_theme.h"
 #include "window/notifications_manager.h"
 #include "platform/platform_notifications_manager.h"
+#include "base/task_queue.h"
 
 namespace {
 	App::LaunchState _launchState = App::Launched;
@@ -81,20 +82,26 @@ namespace {
 	GifItems gifItems;
 
 	using DependentItemsSet = OrderedSet<HistoryItem*>;
-	using DependentItems = QMap<HistoryItem*, DependentItemsSet>;
+	using DependentItems = QHash<HistoryItem*, DependentItemsSet>;
 	DependentItems dependentItems;
+	bool itemsBulkDestroying = false;
 
 	Histories histories;
 
 	using MsgsData = QHash<MsgId, HistoryItem*>;
 	MsgsData msgsData;
-	using ChannelMsgsData = QMap<ChannelId, MsgsData>;
+	using ChannelMsgsData = QHash<ChannelId, MsgsData>;
 	ChannelMsgsData channelMsgsData;
 
-	using RandomData = QMap<uint64, FullMsgId>;
+	// Consecutive lookups usually go to the same channel. QHash nodes
+	// are not moved on rehash, so the pointer stays valid until clear.
+	ChannelId lastChannelMsgsId = NoChannel;
+	MsgsData *lastChannelMsgsData = nullptr;
+
+	using RandomData = QHash<uint64, FullMsgId>;
 	RandomData randomData;
 
-	using SentData = QMap<uint64, QPair<PeerId, QString>>;
+	using SentData = QHash<uint64, QPair<PeerId, QString>>;
 	SentData sentData;
 
 	HistoryItem *hoveredItem = nullptr,
@@ -117,7 +124,46 @@ namespace {
 
 	using EmojiImagesMap = QMap<int, QPixmap>;
 	EmojiImagesMap MainEmojiMap;
-	QMap<int, EmojiImagesMap> OtherEmojiMap;
+	struct OtherEmojiImages {
+		EmojiImagesMap map;
+		TimeMs lastUsed = 0;
+	};
+	QMap<int, OtherEmojiImages> OtherEmojiMap;
+
+	// Emoji images drawn recently are kept when the image cache is cleared.
+	constexpr auto kEmojiKeepUsedTimeout = TimeMs(60000);
+	TimeMs EmojiLargeLastUsed = 0;
+	bool EmojiLargeLoading = false;
+	int EmojiLargeGeneration = 0;
+
+	QPixmap *loadEmojiSprite(int index) {
+		auto result = new QPixmap(Ui::Emoji::Filename(index));
+		if (cRetina()) result->setDevicePixelRatio(cRetinaFactor());
+		return result;
+	}
+
+	// The large sprite is used only by the emoji panel and a few boxes,
+	// it is decoded in the background on the first draw.
+	void loadEmojiLargeAsync() {
+		if (EmojiLargeLoading) {
+			return;
+		}
+		EmojiLargeLoading = true;
+		base::TaskQueue::Normal().Put([generation = EmojiLargeGeneration, filename = Ui::Emoji::Filename(Ui::Emoji::Index() + 1)] {
+			auto image = QImage(filename);
+			base::TaskQueue::Main().Put([generation, image = std::move(image)]() mutable {
+				if (generation != EmojiLargeGeneration) {
+					return;
+				}
+				EmojiLargeLoading = false;
+				::emojiLarge = new QPixmap(App::pixmapFromImageInPlace(std::move(image)));
+				if (cRetina()) ::emojiLarge->setDevicePixelRatio(cRetinaFactor());
+				if (Global::started()) {
+					Global::RefEmojiLargeLoaded().notify();
+				}
+			});
+		});
+	}
 
 	int32 serviceImageCacheSize = 0;
 
@@ -1184,6 +1230,9 @@ namespace {
 
 	inline MsgsData *fetchMsgsData(ChannelId channelId, bool insert = true) {
 		if (channelId == NoChannel) return &msgsData;
+		if (lastChannelMsgsData && lastChannelMsgsId == channelId) {
+			return lastChannelMsgsData;
+		}
 		ChannelMsgsData::iterator i = channelMsgsData.find(channelId);
 		if (i == channelMsgsData.cend()) {
 			if (insert) {
@@ -1192,7 +1241,9 @@ namespace {
 				return 0;
 			}
 		}
-		return &(*i);
+		lastChannelMsgsId = channelId;
+		lastChannelMsgsData = &(*i);
+		return lastChannelMsgsData;
 	}
 
 	void feedWereDeleted(ChannelId channelId, const QVector<MTPint> &msgsIds) {
@@ -1480,6 +1531,46 @@ namespace {
 		}
 	}
 
+	QString peersMemoryReport() {
+		struct Stats {
+			int count = 0;
+			int nameLayouts = 0;
+			int userpics = 0;
+			int64 bytes = 0;
+		};
+		auto users = Stats(), chats = Stats(), channels = Stats();
+		auto stringBytes = [](const QString &value) {
+			return int64(value.size()) * sizeof(QChar);
+		};
+		for_const (auto peer, peersData) {
+			auto &stats = peer->isUser() ? users : (peer->isChat() ? chats : channels);
+			++stats.count;
+			if (peer->nameTextBuilt()) {
+				++stats.nameLayouts;
+			}
+			if (!peer->photoLoc.isNull()) {
+				++stats.userpics;
+			}
+			stats.bytes += stringBytes(peer->name);
+			for_const (auto &name, peer->names) {
+				stats.bytes += stringBytes(name);
+			}
+			stats.bytes += peer->chars.size() * sizeof(QChar);
+			if (auto user = peer->asUser()) {
+				stats.bytes += sizeof(UserData);
+				stats.bytes += stringBytes(user->firstName) + stringBytes(user->lastName) + stringBytes(user->username) + stringBytes(user->nameOrPhone);
+			} else if (peer->isChat()) {
+				stats.bytes += sizeof(ChatData);
+			} else {
+				stats.bytes += sizeof(ChannelData) + stringBytes(peer->asChannel()->username);
+			}
+		}
+		auto line = [](const QString &type, const Stats &stats) {
+			return qsl("%1: %2, name layouts: %3, userpics: %4, ~%5 KB").arg(type).arg(stats.count).arg(stats.nameLayouts).arg(stats.userpics).arg(stats.bytes / 1024);
+		};
+		return line(qsl("Users"), users) + '\n' + line(qsl("Chats"), chats) + '\n' + line(qsl("Channels"), channels);
+	}
+
 	UserData *self() {
 		return ::self;
 	}
@@ -1917,6 +2008,9 @@ namespace {
 	}
 
 	void historyUnregItem(HistoryItem *item) {
+		if (::itemsBulkDestroying) {
+			return;
+		}
 		auto data = fetchMsgsData(item->channelId(), false);
 		if (!data) return;
 
@@ -1973,6 +2067,8 @@ namespace {
 		}
 		msgsData.clear();
 		channelMsgsData.clear();
+		lastChannelMsgsId = NoChannel;
+		lastChannelMsgsData = nullptr;
 		for_const (auto item, toDelete) {
 			delete item;
 		}
@@ -1980,6 +2076,10 @@ namespace {
 		clearMousedItems();
 	}
 
+	void historySetBulkDestroying(bool destroying) {
+		::itemsBulkDestroying = destroying;
+	}
+
 	void historyClearItems() {
 		randomData.clear();
 		sentData.clear();
@@ -2047,6 +2147,9 @@ namespace {
 	}
 
 	void historyUnregDependency(HistoryItem *dependent, HistoryItem *dependency) {
+		if (::itemsBulkDestroying) {
+			return;
+		}
 		auto i = ::dependentItems.find(dependency);
 		if (i != ::dependentItems.cend()) {
 			i.value().remove(dependent);
@@ -2056,6 +2159,10 @@ namespace {
 		}
 	}
 
+	bool historyHasDependentItems(HistoryItem *dependency) {
+		return ::dependentItems.contains(dependency);
+	}
+
 	void historyRegRandom(uint64 randomId, const FullMsgId &itemId) {
 		randomData.insert(randomId, itemId);
 	}
@@ -2201,14 +2308,6 @@ namespace {
 			::monofont = style::font(st::normalFont->f.pixelSize(), 0, family);
 		}
 		Ui::Emoji::Init();
-		if (!::emoji) {
-			::emoji = new QPixmap(Ui::Emoji::Filename(Ui::Emoji::Index()));
-            if (cRetina()) ::emoji->setDevicePixelRatio(cRetinaFactor());
-		}
-		if (!::emojiLarge) {
-			::emojiLarge = new QPixmap(Ui::Emoji::Filename(Ui::Emoji::Index() + 1));
-			if (cRetina()) ::emojiLarge->setDevicePixelRatio(cRetinaFactor());
-		}
 
 		createCorners();
 
@@ -2255,6 +2354,8 @@ namespace {
 		::emoji = nullptr;
 		delete ::emojiLarge;
 		::emojiLarge = nullptr;
+		EmojiLargeLoading = false;
+		++EmojiLargeGeneration;
 
 		clearCorners();
 
@@ -2328,15 +2429,29 @@ namespace {
 	}
 
 	const QPixmap &emoji() {
+		if (!::emoji) {
+			::emoji = loadEmojiSprite(Ui::Emoji::Index());
+		}
 		return *::emoji;
 	}
 
 	const QPixmap &emojiLarge() {
+		EmojiLargeLastUsed = getms();
+		if (!::emojiLarge) {
+			// Nothing is drawn until the sprite is decoded.
+			static const auto empty = QPixmap();
+			loadEmojiLargeAsync();
+			return empty;
+		}
 		return *::emojiLarge;
 	}
 
 	const QPixmap &emojiSingle(EmojiPtr emoji, int32 fontHeight) {
-		auto &map = (fontHeight == st::msgFont->height) ? MainEmojiMap : OtherEmojiMap[fontHeight];
+		auto other = (fontHeight == st::msgFont->height) ? nullptr : &OtherEmojiMap[fontHeight];
+		if (other) {
+			other->lastUsed = getms();
+		}
+		auto &map = other ? other->map : MainEmojiMap;
 		auto i = map.constFind(emoji->index());
 		if (i == map.cend()) {
 			auto image = QImage(Ui::Emoji::Size() + st::emojiPadding * cIntRetinaFactor() * 2, fontHeight * cIntRetinaFactor(), QImage::Format_ARGB32_Premultiplied);
@@ -2354,8 +2469,27 @@ namespace {
 	void checkImageCacheSize() {
 		int64 nowImageCacheSize = imageCacheSize();
 		if (nowImageCacheSize > serviceImageCacheSize + MemoryForImageCache) {
-			App::forgetMedia();
-			serviceImageCacheSize = imageCacheSize();
+			// Leave some free space so that we don't evict on every check.
+			auto limit = serviceImageCacheSize + (MemoryForImageCache * 3) / 4;
+
+			// Emoji images are cheap to recreate, drop the ones that are
+			// not used by the messages font and were not drawn recently.
+			auto keepUsedAfter = getms() - kEmojiKeepUsedTimeout;
+			for (auto i = OtherEmojiMap.begin(); i != OtherEmojiMap.end();) {
+				if (i.value().lastUsed < keepUsedAfter) {
+					i = OtherEmojiMap.erase(i);
+				} else {
+					++i;
+				}
+			}
+			if (EmojiLargeLastUsed < keepUsedAfter) {
+				delete base::take(::emojiLarge);
+			}
+
+			if (!forgetImagesUntil(limit)) {
+				// The rest can't be forgotten, count it as service images.
+				serviceImageCacheSize = imageCacheSize();
+			}
 		}
 	}
 
@@ -2481,6 +2615,7 @@ namespace {
 	}
 
 	void unregPhotoItem(PhotoData *data, HistoryItem *item) {
+		if (::itemsBulkDestroying) return;
 		::photoItems[data].remove(item);
 	}
 
@@ -2497,6 +2632,7 @@ namespace {
 	}
 
 	void unregDocumentItem(DocumentData *data, HistoryItem *item) {
+		if (::itemsBulkDestroying) return;
 		::documentItems[data].remove(item);
 	}
 
@@ -2513,6 +2649,7 @@ namespace {
 	}
 
 	void unregWebPageItem(WebPageData *data, HistoryItem *item) {
+		if (::itemsBulkDestroying) return;
 		::webPageItems[data].remove(item);
 	}
 
@@ -2525,6 +2662,7 @@ namespace {
 	}
 
 	void unregGameItem(GameData *data, HistoryItem *item) {
+		if (::itemsBulkDestroying) return;
 		::gameItems[data].remove(item);
 	}
 
@@ -2542,6 +2680,7 @@ namespace {
 	}
 
 	void unregSharedContactItem(int32 userId, HistoryItem *item) {
+		if (::itemsBulkDestroying) return;
 		auto user = App::userLoaded(userId);
 		auto canShareThisContact = user ? user->canShareThisContact() : false;
 		::sharedContactItems[userId].remove(item);
@@ -2559,6 +2698,7 @@ namespace {
 	}
 
 	void unregGifItem(Media::Clip::Reader *reader) {
+		if (::itemsBulkDestroying) return;
 		::gifItems.remove(reader);
 	}
 
@@ -139,6 +139,9 @@ namespace App {
 	}
 	void enumerateUsers(base::lambda<void(UserData*)> action);
 
+	// Approximate memory taken by the known peers of each type.
+	QString peersMemoryReport();
+
 	UserData *self();
 	PeerData *peerByName(const QString &username);
 	QString peerName(const PeerData *peer, bool forDialogs = false);
@@ -179,8 +182,13 @@ namespace App {
 	void historyUpdateDependent(HistoryItem *item);
 	void historyClearMsgs();
 	void historyClearItems();
+
+	// While all the histories are destroyed at once every item map is
+	// cleared anyway, so items skip unregistering themselves one by one.
+	void historySetBulkDestroying(bool destroying);
 	void historyRegDependency(HistoryItem *dependent, HistoryItem *dependency);
 	void historyUnregDependency(HistoryItem *dependent, HistoryItem *dependency);
+	bool historyHasDependentItems(HistoryItem *dependency);
 
 	void historyRegRandom(uint64 randomId, const FullMsgId &itemId);
 	void historyUnregRandom(uint64 randomId);
@@ -27,6 +27,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "autoupdater.h"
 #include "window/notifications_manager.h"
 #include "messenger.h"
+#include "core/stall_detector.h"
+#include "core/paint_profiler.h"
 #include "base/timer.h"
 
 namespace {
@@ -117,6 +119,12 @@ bool Application::event(QEvent *e) {
 	return QApplication::event(e);
 }
 
+bool Application::notify(QObject *receiver, QEvent *e) {
+	Core::StallDetector::EventGuard guard(receiver, e);
+	Core::PaintProfiler::Scope profile(receiver, e);
+	return QApplication::notify(receiver, e);
+}
+
 void Application::socketConnected() {
 	LOG(("Socket connected, this is not the first application instance, sending show command..."));
 	_secondInstance = true;
@@ -313,6 +321,9 @@ void Application::startApplication() {
 
 void Application::createMessenger() {
 	Expects(!App::quitting());
+	if (cDebug()) {
+		_stallDetector = std::make_unique<Core::StallDetector>();
+	}
 	_messengerInstance = std::make_unique<Messenger>();
 }
 
@@ -321,6 +332,7 @@ void Application::closeApplication() {
 	App::setLaunchState(App::QuitProcessed);
 
 	_messengerInstance.reset();
+	_stallDetector.reset();
 
 	Sandbox::finish();
 
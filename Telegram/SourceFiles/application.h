@@ -20,6 +20,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
+namespace Core {
+class StallDetector;
+} // namespace Core
+
 class UpdateChecker;
 class Application : public QApplication {
 	Q_OBJECT
@@ -28,6 +32,7 @@ public:
 	Application(int &argc, char **argv);
 
 	bool event(QEvent *e) override;
+	bool notify(QObject *receiver, QEvent *e) override;
 
 	void createMessenger();
 
@@ -55,6 +60,7 @@ private:
 	typedef QPair<QLocalSocket*, QByteArray> LocalClient;
 	typedef QList<LocalClient> LocalClients;
 
+	std::unique_ptr<Core::StallDetector> _stallDetector;
 	std::unique_ptr<Messenger> _messengerInstance;
 
 	QString _localServerName, _localSocketReadData;
@@ -197,7 +197,7 @@ UserData *AuthSession::user() const {
 	return App::user(userId());
 }
 
-base::Observable<void> &AuthSession::downloaderTaskFinished() {
+base::BatchedObservable<void> &AuthSession::downloaderTaskFinished() {
 	return downloader().taskFinished();
 }
 
@@ -200,7 +200,7 @@ public:
 		return *_uploader;
 	}
 
-	base::Observable<void> &downloaderTaskFinished();
+	base::BatchedObservable<void> &downloaderTaskFinished();
 
 	Window::Notifications::System &notifications() {
 		return *_notifications;
@@ -37,6 +37,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #ifndef TDESKTOP_DISABLE_AUTOUPDATE
 
+namespace {
+
+constexpr auto kUpdateParallelParts = 4;
+constexpr auto kUpdateParallelMinSize = 4 * 1024 * 1024;
+
+} // namespace
+
 #ifdef Q_OS_WIN
 typedef DWORD VerInt;
 typedef WCHAR VerChar;
@@ -45,7 +52,7 @@ typedef int VerInt;
 typedef wchar_t VerChar;
 #endif // Q_OS_WIN
 
-UpdateChecker::UpdateChecker(QThread *thread, const QString &url) : reply(0), already(0), full(0) {
+UpdateChecker::UpdateChecker(QThread *thread, const QString &url) : already(0), full(0) {
 	updateUrl = url;
 	moveToThread(thread);
 	manager.moveToThread(thread);
@@ -115,20 +122,56 @@ void UpdateChecker::start() {
 }
 
 void UpdateChecker::sendRequest() {
+	clearParts();
+	_parts.push_back({ requestRange(already, 0), already, 0 });
+}
+
+QNetworkReply *UpdateChecker::requestRange(int32 from, int32 till) {
 	QNetworkRequest req(updateUrl);
-	QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(already) + "-";
+	QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(from) + "-";
+	if (till > 0) {
+		rangeHeaderValue += QByteArray::number(till - 1);
+	}
 	req.setRawHeader("Range", rangeHeaderValue);
 	req.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
-	if (reply) reply->deleteLater();
-	reply = manager.get(req);
-	connect(reply, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(partFinished(qint64,qint64)));
-	connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(partFailed(QNetworkReply::NetworkError)));
-	connect(reply, SIGNAL(metaDataChanged()), this, SLOT(partMetaGot()));
+	auto result = manager.get(req);
+	connect(result, SIGNAL(downloadProgress(qint64,qint64)), this, SLOT(partFinished(qint64,qint64)));
+	connect(result, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(partFailed(QNetworkReply::NetworkError)));
+	connect(result, SIGNAL(metaDataChanged()), this, SLOT(partMetaGot()));
+	return result;
+}
+
+UpdateChecker::Part *UpdateChecker::findPart(QObject *reply) {
+	if (!reply) return nullptr;
+	for (auto &part : _parts) {
+		if (part.reply == reply) {
+			return &part;
+		}
+	}
+	return nullptr;
+}
+
+void UpdateChecker::finishPartReply(Part &part) {
+	if (auto reply = base::take(part.reply)) {
+		disconnect(reply, nullptr, this, nullptr);
+		reply->abort();
+		reply->deleteLater();
+	}
+}
+
+void UpdateChecker::clearParts() {
+	for (auto &part : _parts) {
+		finishPartReply(part);
+	}
+	_parts.clear();
 }
 
 void UpdateChecker::partMetaGot() {
+	auto part = findPart(sender());
+	if (!part) return;
+
 	typedef QList<QNetworkReply::RawHeaderPair> Pairs;
-	Pairs pairs = reply->rawHeaderPairs();
+	Pairs pairs = part->reply->rawHeaderPairs();
 	for (Pairs::iterator i = pairs.begin(), e = pairs.end(); i != e; ++i) {
 		if (QString::fromUtf8(i->first).toLower() == "content-range") {
 			QRegularExpressionMatch m = QRegularExpression(qsl("/(\\d+)([^\\d]|$)")).match(QString::fromUtf8(i->second));
@@ -139,11 +182,32 @@ void UpdateChecker::partMetaGot() {
 				}
 
 				Sandbox::updateProgress(already, full);
+				splitParts();
 			}
 		}
 	}
 }
 
+void UpdateChecker::splitParts() {
+	// The server supports ranges, download the tail in parallel parts.
+	// Only the contiguous prefix is written to the file, so resuming
+	// after a failure or a restart still works from the "already" offset.
+	if (_parts.size() != 1 || _parts.front().till > 0) {
+		return;
+	}
+	auto left = full - already;
+	if (left < kUpdateParallelMinSize) {
+		return;
+	}
+	auto partSize = (left / kUpdateParallelParts / UpdateChunk + 1) * UpdateChunk;
+	_parts.front().till = already + partSize;
+	for (auto from = already + partSize; from < full; from += partSize) {
+		auto till = qMin(from + partSize, full);
+		_parts.push_back({ requestRange(from, till), from, till });
+	}
+	DEBUG_LOG(("Update Info: downloading %1 bytes in %2 parts").arg(left).arg(_parts.size()));
+}
+
 int32 UpdateChecker::ready() {
 	QMutexLocker lock(&mutex);
 	return already;
@@ -154,10 +218,19 @@ int32 UpdateChecker::size() {
 	return full;
 }
 
+int32 UpdateChecker::downloaded() const {
+	auto result = already;
+	for (auto &part : _parts) {
+		result += part.data.size();
+	}
+	return result;
+}
+
 void UpdateChecker::partFinished(qint64 got, qint64 total) {
-	if (!reply) return;
+	auto part = findPart(sender());
+	if (!part) return;
 
-	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	QVariant statusCode = part->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
 	if (statusCode.isValid()) {
 		int status = statusCode.toInt();
 		if (status != 200 && status != 206 && status != 416) {
@@ -172,36 +245,71 @@ void UpdateChecker::partFinished(qint64 got, qint64 total) {
 	}
 	DEBUG_LOG(("Update Info: part %1 of %2").arg(got).arg(total));
 
-	if (!outputFile.isOpen()) {
-		if (!outputFile.open(QIODevice::Append)) {
-			LOG(("Update Error: Could not open output file '%1' for appending").arg(outputFile.fileName()));
-			return fatalFail();
+	QByteArray r = part->reply->readAll();
+	if (part->till > 0) {
+		auto left = part->till - (part->from + part->data.size());
+		if (r.size() > left) {
+			r.resize(left); // The first part was requested without the end.
 		}
 	}
-	QByteArray r = reply->readAll();
-	if (!r.isEmpty()) {
-		outputFile.write(r);
+	part->data.append(r);
+	if (part->till > 0 && part->from + part->data.size() == part->till) {
+		finishPartReply(*part);
+	} else if (got >= total) {
+		if (part->till > 0) {
+			LOG(("Update Error: part %1-%2 ended at %3").arg(part->from).arg(part->till).arg(part->from + part->data.size()));
+			clearParts();
+			return Sandbox::updateFailed();
+		}
+		finishPartReply(*part);
+	}
 
-		QMutexLocker lock(&mutex);
-		already += r.size();
+	if (!flushParts()) {
+		return fatalFail();
 	}
-	if (got >= total) {
-		reply->deleteLater();
-		reply = 0;
+	if (_parts.empty()) {
 		outputFile.close();
 		unpackUpdate();
 	} else {
-		Sandbox::updateProgress(already, full);
+		Sandbox::updateProgress(downloaded(), full);
 	}
 }
 
-void UpdateChecker::partFailed(QNetworkReply::NetworkError e) {
-	if (!reply) return;
+bool UpdateChecker::flushParts() {
+	while (!_parts.empty()) {
+		auto &part = _parts.front();
+		Assert(part.from == already);
+		if (!part.data.isEmpty()) {
+			if (!outputFile.isOpen()) {
+				if (!outputFile.open(QIODevice::Append)) {
+					LOG(("Update Error: Could not open output file '%1' for appending").arg(outputFile.fileName()));
+					return false;
+				}
+			}
+			outputFile.write(part.data);
+			part.from += part.data.size();
 
-	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
-	reply->deleteLater();
-	reply = 0;
-	if (statusCode.isValid()) {
+			QMutexLocker lock(&mutex);
+			already += part.data.size();
+			part.data = QByteArray();
+		}
+		if (part.reply) {
+			break;
+		}
+		_parts.erase(_parts.begin());
+	}
+	return true;
+}
+
+void UpdateChecker::partFailed(QNetworkReply::NetworkError e) {
+	auto part = findPart(sender());
+	if (!part) return;
+
+	QVariant statusCode = part->reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	auto from = part->from + part->data.size();
+	auto single = (_parts.size() == 1);
+	clearParts();
+	if (statusCode.isValid() && single) {
 		int status = statusCode.toInt();
 		if (status == 416) { // Requested range not satisfiable
 			outputFile.close();
@@ -209,11 +317,12 @@ void UpdateChecker::partFailed(QNetworkReply::NetworkError e) {
 			return;
 		}
 	}
-	LOG(("Update Error: failed to download part starting from %1, error %2").arg(already).arg(e));
+	LOG(("Update Error: failed to download part starting from %1, error %2").arg(from).arg(e));
 	Sandbox::updateFailed();
 }
 
 void UpdateChecker::fatalFail() {
+	clearParts();
 	clearAll();
 	Sandbox::updateFailed();
 }
@@ -480,8 +589,9 @@ void UpdateChecker::unpackUpdate() {
 }
 
 UpdateChecker::~UpdateChecker() {
-	delete reply;
-	reply = 0;
+	for (auto &part : _parts) {
+		delete base::take(part.reply);
+	}
 }
 
 bool checkReadyUpdate() {
@@ -50,13 +50,27 @@ public slots:
 	void sendRequest();
 
 private:
+	struct Part {
+		QNetworkReply *reply = nullptr;
+		int32 from = 0; // offset of the first byte in data
+		int32 till = 0; // 0 if requested till the end of file
+		QByteArray data;
+	};
+
 	void initOutput();
+	QNetworkReply *requestRange(int32 from, int32 till);
+	Part *findPart(QObject *reply);
+	void finishPartReply(Part &part);
+	void clearParts();
+	void splitParts();
+	bool flushParts();
+	int32 downloaded() const;
 
 	void fatalFail();
 
 	QString updateUrl;
 	QNetworkAccessManager manager;
-	QNetworkReply *reply;
+	std::vector<Part> _parts;
 	int32 already, full;
 	QFile outputFile;
 
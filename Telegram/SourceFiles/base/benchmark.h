@@ -0,0 +1,42 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <chrono>
+#include <iostream>
+
+// Benchmarks are separate executables that print the time of each case.
+// They are not a part of the tests run.
+
+namespace base {
+namespace benchmark {
+
+template <typename Callback>
+void Measure(const char *name, Callback callback) {
+	const auto start = std::chrono::steady_clock::now();
+	const auto result = callback();
+	const auto finish = std::chrono::steady_clock::now();
+	const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+	std::cout << name << ": " << ms << " ms (" << result << ")" << std::endl;
+}
+
+} // namespace benchmark
+} // namespace base
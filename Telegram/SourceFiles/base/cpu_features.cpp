@@ -0,0 +1,92 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/cpu_features.h"
+
+#ifdef COMPILER_MSVC
+#include <intrin.h>
+#else // COMPILER_MSVC
+#include <cpuid.h>
+#endif // COMPILER_MSVC
+
+namespace base {
+namespace {
+
+struct CpuFeatures {
+	bool sse2 = false;
+	bool ssse3 = false;
+	bool avx2 = false;
+};
+
+void ReadCpuId(int leaf, int subleaf, unsigned int registers[4]) {
+#ifdef COMPILER_MSVC
+	__cpuidex(reinterpret_cast<int*>(registers), leaf, subleaf);
+#else // COMPILER_MSVC
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif // COMPILER_MSVC
+}
+
+// The OS must save the ymm registers on context switches to allow AVX.
+bool OsSavesYmmRegisters() {
+#ifdef COMPILER_MSVC
+	auto xcr0 = _xgetbv(0);
+#else // COMPILER_MSVC
+	auto eax = 0U, edx = 0U;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	auto xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif // COMPILER_MSVC
+	return (xcr0 & 0x06) == 0x06;
+}
+
+CpuFeatures DetectCpuFeatures() {
+	auto result = CpuFeatures();
+	unsigned int registers[4] = { 0 }; // eax, ebx, ecx, edx
+	ReadCpuId(0, 0, registers);
+	auto maxLeaf = registers[0];
+	if (maxLeaf < 1) {
+		return result;
+	}
+	ReadCpuId(1, 0, registers);
+	auto ecx = registers[2], edx = registers[3];
+	result.sse2 = (edx & (1U << 26)) != 0;
+	result.ssse3 = result.sse2 && (ecx & (1U << 9)) != 0;
+
+	auto osxsave = (ecx & (1U << 27)) != 0;
+	auto avx = (ecx & (1U << 28)) != 0;
+	if (maxLeaf >= 7 && result.ssse3 && osxsave && avx && OsSavesYmmRegisters()) {
+		ReadCpuId(7, 0, registers);
+		result.avx2 = (registers[1] & (1U << 5)) != 0;
+	}
+	return result;
+}
+
+} // namespace
+
+bool CpuHas(CpuFeature feature) {
+	static const auto Features = DetectCpuFeatures();
+	switch (feature) {
+	case CpuFeature::SSE2: return Features.sse2;
+	case CpuFeature::SSSE3: return Features.ssse3;
+	case CpuFeature::AVX2: return Features.avx2;
+	}
+	return false;
+}
+
+} // namespace base
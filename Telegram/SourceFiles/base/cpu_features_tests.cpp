@@ -0,0 +1,75 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/cpu_features.h"
+#include "media/media_audio_peak_avx2.h"
+
+#include <vector>
+
+TEST_CASE("cpu features are detected consistently", "[cpu_features]") {
+	using base::CpuFeature;
+
+	SECTION("repeated queries give the same answer") {
+		auto avx2 = base::CpuHas(CpuFeature::AVX2);
+		REQUIRE(base::CpuHas(CpuFeature::AVX2) == avx2);
+	}
+	SECTION("wider instruction sets imply the narrower ones") {
+		if (base::CpuHas(CpuFeature::AVX2)) {
+			REQUIRE(base::CpuHas(CpuFeature::SSSE3));
+		}
+		if (base::CpuHas(CpuFeature::SSSE3)) {
+			REQUIRE(base::CpuHas(CpuFeature::SSE2));
+		}
+	}
+#ifdef ARCH_CPU_X86_64
+	SECTION("sse2 is always present on x86_64") {
+		REQUIRE(base::CpuHas(CpuFeature::SSE2));
+	}
+#endif // ARCH_CPU_X86_64
+}
+
+TEST_CASE("avx2 sample peak matches the scalar loop", "[cpu_features]") {
+	if (!base::CpuHas(base::CpuFeature::AVX2)) {
+		return;
+	}
+	auto samples = std::vector<int16_t>(100);
+	auto seed = 12345u;
+	for (auto &sample : samples) {
+		seed = seed * 1103515245u + 12345u;
+		sample = int16_t(seed >> 16);
+	}
+	samples[37] = 32767;
+	samples[71] = -32768;
+
+	for (auto count = 0; count != int(samples.size()); ++count) {
+		auto maximum = int16_t(0), minimum = int16_t(0);
+		auto expectedMaximum = int16_t(0), expectedMinimum = int16_t(0);
+		for (auto i = 0; i != count; ++i) {
+			if (expectedMaximum < samples[i]) expectedMaximum = samples[i];
+			if (expectedMinimum > samples[i]) expectedMinimum = samples[i];
+		}
+		Media::Audio::internal::SamplePeakAVX2(samples.data(), count, &maximum, &minimum);
+		INFO("count: " << count);
+		REQUIRE(maximum == expectedMaximum);
+		REQUIRE(minimum == expectedMinimum);
+	}
+}
@@ -0,0 +1,104 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <set>
+#include <map>
+#include <utility>
+
+namespace base {
+
+// Keys ordered by their deadlines, so that one timer armed for next()
+// serves all of them and only the expired keys are visited on timeout.
+// Scheduling, cancelling and taking an expired key are O(log(n)).
+template <typename Key, typename Time = long long>
+class deadline_queue {
+public:
+	using key_type = Key;
+	using time_type = Time;
+	using size_type = std::size_t;
+
+	bool empty() const {
+		return _deadlines.empty();
+	}
+	size_type size() const {
+		return _deadlines.size();
+	}
+	void clear() {
+		_queue.clear();
+		_deadlines.clear();
+	}
+
+	bool contains(const Key &key) const {
+		return (_deadlines.find(key) != _deadlines.end());
+	}
+
+	// Replaces the deadline if the key is already scheduled.
+	void schedule(const Key &key, Time when) {
+		auto i = _deadlines.find(key);
+		if (i != _deadlines.end()) {
+			if (i->second == when) {
+				return;
+			}
+			_queue.erase(std::make_pair(i->second, key));
+			i->second = when;
+		} else {
+			_deadlines.emplace(key, when);
+		}
+		_queue.emplace(when, key);
+	}
+
+	// Returns false if the key was not scheduled.
+	bool cancel(const Key &key) {
+		auto i = _deadlines.find(key);
+		if (i == _deadlines.end()) {
+			return false;
+		}
+		_queue.erase(std::make_pair(i->second, key));
+		_deadlines.erase(i);
+		return true;
+	}
+
+	// The earliest deadline, the queue should not be empty.
+	Time next() const {
+		return _queue.begin()->first;
+	}
+
+	// Removes the keys with deadlines up to now and calls the method for
+	// each of them in the deadline order. The method may schedule keys
+	// again, the ones scheduled not later than now are taken right away.
+	template <typename Method>
+	void process(Time now, Method method) {
+		while (!_queue.empty() && !(now < _queue.begin()->first)) {
+			auto key = _queue.begin()->second;
+			_queue.erase(_queue.begin());
+			_deadlines.erase(key);
+			method(key);
+		}
+	}
+
+private:
+	std::set<std::pair<Time, Key>> _queue;
+	std::map<Key, Time> _deadlines;
+
+};
+
+} // namespace base
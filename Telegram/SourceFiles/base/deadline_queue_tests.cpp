@@ -0,0 +1,93 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/deadline_queue.h"
+
+#include <vector>
+
+TEST_CASE("deadline_queues should give keys in the deadline order", "[deadline_queue]") {
+	base::deadline_queue<int> v;
+	v.schedule(1, 30);
+	v.schedule(2, 10);
+	v.schedule(3, 20);
+	REQUIRE(v.size() == 3);
+	REQUIRE(v.next() == 10);
+
+	SECTION("only expired keys are taken") {
+		auto taken = std::vector<int>();
+		v.process(20, [&](int key) { taken.push_back(key); });
+		REQUIRE(taken == std::vector<int>({ 2, 3 }));
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.contains(1));
+		REQUIRE(v.next() == 30);
+	}
+	SECTION("nothing is taken before the first deadline") {
+		auto count = 0;
+		v.process(9, [&](int) { ++count; });
+		REQUIRE(count == 0);
+		REQUIRE(v.size() == 3);
+	}
+	SECTION("scheduling a key again moves its deadline") {
+		v.schedule(2, 40);
+		REQUIRE(v.size() == 3);
+		REQUIRE(v.next() == 20);
+		auto taken = std::vector<int>();
+		v.process(40, [&](int key) { taken.push_back(key); });
+		REQUIRE(taken == std::vector<int>({ 3, 1, 2 }));
+		REQUIRE(v.empty());
+	}
+	SECTION("cancelled keys are not taken") {
+		REQUIRE(v.cancel(2));
+		REQUIRE(!v.cancel(2));
+		REQUIRE(!v.contains(2));
+		REQUIRE(v.next() == 20);
+		auto taken = std::vector<int>();
+		v.process(100, [&](int key) { taken.push_back(key); });
+		REQUIRE(taken == std::vector<int>({ 3, 1 }));
+	}
+	SECTION("keys with equal deadlines are all kept") {
+		v.schedule(4, 10);
+		REQUIRE(v.size() == 4);
+		auto taken = std::vector<int>();
+		v.process(10, [&](int key) { taken.push_back(key); });
+		REQUIRE(taken == std::vector<int>({ 2, 4 }));
+	}
+}
+
+TEST_CASE("deadline_queues should allow rescheduling while processing", "[deadline_queue]") {
+	base::deadline_queue<int> v;
+	v.schedule(1, 10);
+	v.schedule(2, 20);
+
+	auto taken = std::vector<int>();
+	v.process(15, [&](int key) {
+		taken.push_back(key);
+		if (taken.size() == 1) {
+			v.schedule(key, 30);
+			v.schedule(3, 12);
+		}
+	});
+	REQUIRE(taken == std::vector<int>({ 1, 3 }));
+	REQUIRE(v.size() == 2);
+	REQUIRE(v.next() == 20);
+	REQUIRE(v.contains(1));
+}
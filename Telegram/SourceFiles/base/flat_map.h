@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <deque>
+#include <algorithm>
 #include "base/optional.h"
 
 namespace base {
@@ -284,6 +285,19 @@ public:
 		return insert(value_type(std::forward<Args>(args)...));
 	}
 
+	// Appends the range, sorts it and merges with the existing items,
+	// instead of shifting the storage for each inserted element.
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		const auto was = _impl.size();
+		for (; first != last; ++first) {
+			_impl.emplace_back(*first);
+		}
+		const auto middle = _impl.begin() + was;
+		std::stable_sort(middle, _impl.end(), Comparator());
+		std::inplace_merge(_impl.begin(), middle, _impl.end(), Comparator());
+	}
+
 	bool removeOne(const Key &key) {
 		if (empty() || (key < front().first) || (back().first < key)) {
 			return false;
@@ -314,6 +328,14 @@ public:
 		return _impl.erase(from._impl, till._impl);
 	}
 
+	template <typename Predicate>
+	int removeIf(Predicate predicate) {
+		const auto from = std::remove_if(_impl.begin(), _impl.end(), predicate);
+		const auto result = int(_impl.end() - from);
+		_impl.erase(from, _impl.end());
+		return result;
+	}
+
 	iterator findFirst(const Key &key) {
 		if (empty() || (key < front().first) || (back().first < key)) {
 			return end();
@@ -352,6 +374,9 @@ private:
 		inline bool operator()(const Key &a, const pair_type &b) {
 			return a < b.first;
 		}
+		inline bool operator()(const pair_type &a, const pair_type &b) {
+			return a.first < b.first;
+		}
 	};
 	typename impl::iterator getLowerBound(const Key &key) {
 		return std::lower_bound(_impl.begin(), _impl.end(), key, Comparator());
@@ -418,6 +443,16 @@ public:
 		return this->insert(value_type(std::forward<Args>(args)...));
 	}
 
+	// Like the single insert() a key that is already in the map keeps
+	// its value, of the equal keys in the range the first one is used.
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		parent::insert(first, last);
+		this->_impl.erase(std::unique(this->_impl.begin(), this->_impl.end(), [](auto &&a, auto &&b) {
+			return !(a.first < b.first);
+		}), this->_impl.end());
+	}
+
 	bool remove(const Key &key) {
 		return this->removeOne(key);
 	}
@@ -0,0 +1,108 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/flat_map.h"
+#include "base/benchmark.h"
+
+#include <QtCore/QMap>
+#include <map>
+#include <vector>
+
+// Compares base::flat_map with std::map and QMap on the sizes it is used
+// with in the app: small maps filled once and then mostly looked up.
+
+namespace {
+
+constexpr auto kMapSize = 64;
+constexpr auto kRepeatCount = 20000;
+constexpr auto kBulkSize = 50000;
+
+using base::benchmark::Measure;
+
+int Key(int index) {
+	// Keys are inserted in a shuffled order.
+	return (index * 37) % kMapSize;
+}
+
+template <typename Map, typename Insert, typename Contains>
+int FillAndLookup(Insert insert, Contains contains) {
+	auto found = 0;
+	for (auto repeat = 0; repeat != kRepeatCount; ++repeat) {
+		auto map = Map();
+		for (auto i = 0; i != kMapSize; ++i) {
+			insert(map, Key(i), i);
+		}
+		for (auto i = 0; i != 4 * kMapSize; ++i) {
+			if (contains(map, i)) {
+				++found;
+			}
+		}
+	}
+	return found;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	Measure("std::map", [] {
+		using Map = std::map<int, int>;
+		return FillAndLookup<Map>([](Map &map, int key, int value) {
+			map.emplace(key, value);
+		}, [](const Map &map, int key) {
+			return map.find(key) != map.end();
+		});
+	});
+	Measure("QMap", [] {
+		using Map = QMap<int, int>;
+		return FillAndLookup<Map>([](Map &map, int key, int value) {
+			map.insert(key, value);
+		}, [](const Map &map, int key) {
+			return map.constFind(key) != map.cend();
+		});
+	});
+	Measure("flat_map", [] {
+		using Map = base::flat_map<int, int>;
+		return FillAndLookup<Map>([](Map &map, int key, int value) {
+			map.emplace(key, value);
+		}, [](const Map &map, int key) {
+			return map.find(key) != map.end();
+		});
+	});
+
+	// Many keys added to a large map at once, like the unread mentions
+	// ids received in one slice.
+	auto bulk = std::vector<std::pair<int, int>>();
+	for (auto i = 0; i != kBulkSize; ++i) {
+		bulk.emplace_back((i * 7919) % kBulkSize, i);
+	}
+	Measure("flat_map bulk one by one", [&] {
+		auto map = base::flat_map<int, int>();
+		for (const auto &item : bulk) {
+			map.insert(item);
+		}
+		return int(map.size());
+	});
+	Measure("flat_map bulk range", [&] {
+		auto map = base::flat_map<int, int>();
+		map.insert(bulk.begin(), bulk.end());
+		return int(map.size());
+	});
+	return 0;
+}
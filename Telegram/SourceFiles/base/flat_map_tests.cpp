@@ -48,4 +48,29 @@ TEST_CASE("flat_maps should keep items sorted by key", "[flat_map]") {
 		REQUIRE(v.find(3) != v.end());
 		checkSorted();
 	}
+
+	SECTION("adding a range keeps existing values and sorts by key") {
+		std::pair<int, string> values[] = {
+			{ 7, "x" },
+			{ 4, "y" },
+			{ 1, "z" },
+			{ 7, "w" },
+		};
+		v.insert(std::begin(values), std::end(values));
+		REQUIRE(v.size() == 6);
+		REQUIRE(v.find(4)->second == "d");
+		REQUIRE(v.find(7)->second == "x");
+		REQUIRE(v.find(1)->second == "z");
+		checkSorted();
+	}
+
+	SECTION("removing by predicate keeps other items sorted") {
+		auto removed = v.removeIf([](const auto &item) {
+			return (item.second == "b") || (item.second == "e");
+		});
+		REQUIRE(removed == 2);
+		REQUIRE(v.size() == 2);
+		REQUIRE(v.find(5) == v.end());
+		checkSorted();
+	}
 }
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <deque>
+#include <algorithm>
 
 namespace base {
 
@@ -270,6 +271,19 @@ public:
 		return insert(Type(std::forward<Args>(args)...));
 	}
 
+	// Appends the range, sorts it and merges with the existing items,
+	// instead of shifting the storage for each inserted element.
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		const auto was = _impl.size();
+		for (; first != last; ++first) {
+			_impl.emplace_back(*first);
+		}
+		const auto middle = _impl.begin() + was;
+		std::stable_sort(middle, _impl.end());
+		std::inplace_merge(_impl.begin(), middle, _impl.end());
+	}
+
 	bool removeOne(const Type &value) {
 		if (empty() || (value < front()) || (back() < value)) {
 			return false;
@@ -300,6 +314,16 @@ public:
 		return _impl.erase(from._impl, till._impl);
 	}
 
+	template <typename Predicate>
+	int removeIf(Predicate predicate) {
+		const auto from = std::remove_if(_impl.begin(), _impl.end(), [&](const Type &value) {
+			return predicate(value);
+		});
+		const auto result = int(_impl.end() - from);
+		_impl.erase(from, _impl.end());
+		return result;
+	}
+
 	iterator findFirst(const Type &value) {
 		if (empty() || (value < front()) || (back() < value)) {
 			return end();
@@ -403,6 +427,14 @@ public:
 		return this->insert(Type(std::forward<Args>(args)...));
 	}
 
+	template <typename Iterator, typename = typename std::iterator_traits<Iterator>::iterator_category>
+	void insert(Iterator first, Iterator last) {
+		parent::insert(first, last);
+		this->_impl.erase(std::unique(this->_impl.begin(), this->_impl.end(), [](auto &&a, auto &&b) {
+			return !(a < b);
+		}), this->_impl.end());
+	}
+
 	bool remove(const Type &value) {
 		return this->removeOne(value);
 	}
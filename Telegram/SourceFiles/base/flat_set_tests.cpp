@@ -45,4 +45,34 @@ TEST_CASE("flat_sets should keep items sorted", "[flat_set]") {
 		REQUIRE(v.find(3) != v.end());
 		checkSorted();
 	}
+
+	SECTION("adding a range keeps items sorted and unique") {
+		int values[] = { 7, 3, 5, 1, 3, 6 };
+		v.insert(std::begin(values), std::end(values));
+		REQUIRE(v.size() == 8);
+		REQUIRE(v.find(1) != v.end());
+		REQUIRE(v.find(3) != v.end());
+		REQUIRE(v.find(7) != v.end());
+		checkSorted();
+	}
+
+	SECTION("removing by predicate keeps other items sorted") {
+		REQUIRE(v.removeIf([](int value) { return (value % 2) == 0; }) == 3);
+		REQUIRE(v.size() == 1);
+		REQUIRE(v.find(5) != v.end());
+	}
+}
+
+TEST_CASE("flat_multi_sets should keep equal items from a range", "[flat_set]") {
+	base::flat_multi_set<int> v;
+	v.insert(2);
+	v.insert(4);
+
+	int values[] = { 4, 1, 2, 2 };
+	v.insert(std::begin(values), std::end(values));
+	REQUIRE(v.size() == 6);
+	REQUIRE(v.count(2) == 3);
+	REQUIRE(v.count(4) == 2);
+	REQUIRE(v.front() == 1);
+	REQUIRE(v.back() == 4);
 }
@@ -0,0 +1,84 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/lambda.h"
+#include <array>
+#include <string>
+
+namespace {
+
+using Capture = std::array<char, 48>;
+
+} // namespace
+
+TEST_CASE("lambda storage size", "[lambda]") {
+	REQUIRE(sizeof(base::lambda_once<void()>) == 32);
+	REQUIRE(sizeof(base::lambda_once<void(), 96>) == 96);
+	REQUIRE(sizeof(base::lambda<int(int), 64>) == 64);
+}
+
+TEST_CASE("sized lambda keeps large captures inline", "[lambda]") {
+	auto capture = Capture();
+	capture[0] = 'a';
+	capture[47] = 'z';
+	auto text = std::string("text");
+#ifdef _DEBUG
+	auto allocations = base::lambda_heap_allocations().load();
+#endif // _DEBUG
+
+	auto once = base::lambda_once<std::string(), 96>([capture, text] {
+		return text + capture[0] + capture[47];
+	});
+	auto moved = std::move(once);
+	REQUIRE(moved() == "textaz");
+
+	auto copyable = base::lambda<std::string(), 96>([capture, text] {
+		return text + capture[47];
+	});
+	auto copy = copyable;
+	REQUIRE(copy() == "textz");
+	REQUIRE(copyable() == "textz");
+
+	base::lambda_once<std::string(), 96> converted = std::move(copyable);
+	REQUIRE(converted() == "textz");
+#ifdef _DEBUG
+	REQUIRE(base::lambda_heap_allocations().load() == allocations);
+#endif // _DEBUG
+}
+
+TEST_CASE("default lambda moves large captures to heap", "[lambda]") {
+	auto capture = Capture();
+	capture[1] = 'b';
+#ifdef _DEBUG
+	auto allocations = base::lambda_heap_allocations().load();
+#endif // _DEBUG
+
+	auto small = base::lambda<int()>([] { return 1; });
+	auto large = base::lambda<char()>([capture] { return capture[1]; });
+	auto copy = large;
+	REQUIRE(small() == 1);
+	REQUIRE(large() == 'b');
+	REQUIRE(copy() == 'b');
+#ifdef _DEBUG
+	REQUIRE(base::lambda_heap_allocations().load() == allocations + 2);
+#endif // _DEBUG
+}
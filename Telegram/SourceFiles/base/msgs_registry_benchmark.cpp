@@ -0,0 +1,123 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/benchmark.h"
+
+#include <QtCore/QMap>
+#include <QtCore/QHash>
+#include <random>
+#include <vector>
+
+// Compares the messages registry layouts in app.cpp: items by channel
+// and by message id. Lookups follow the updates flow where most of the
+// consecutive requests are for the same channel.
+
+namespace {
+
+constexpr auto kChannelsCount = 500;
+constexpr auto kMessagesPerChannel = 400;
+constexpr auto kLookupsCount = 20000000;
+constexpr auto kSameChannelRun = 16; // lookups in a row for one channel
+
+using base::benchmark::Measure;
+
+struct Lookup {
+	qint32 channel = 0;
+	qint32 msg = 0;
+};
+
+std::vector<Lookup> PrepareLookups() {
+	auto generator = std::mt19937(42);
+	auto channels = std::uniform_int_distribution<int>(1, kChannelsCount);
+	auto messages = std::uniform_int_distribution<int>(1, kMessagesPerChannel);
+	auto result = std::vector<Lookup>();
+	result.reserve(kLookupsCount);
+	auto channel = channels(generator);
+	for (auto i = 0; i != kLookupsCount; ++i) {
+		if (!(i % kSameChannelRun)) {
+			channel = channels(generator);
+		}
+		result.push_back({ channel * 7919, messages(generator) });
+	}
+	return result;
+}
+
+template <typename Channels>
+void Fill(Channels &channels, quintptr *items) {
+	for (auto channel = 1; channel <= kChannelsCount; ++channel) {
+		auto &messages = channels[channel * 7919];
+		for (auto msg = 1; msg <= kMessagesPerChannel; ++msg) {
+			messages.insert(msg, items + msg);
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	using Messages = QHash<qint32, quintptr*>;
+	static quintptr items[kMessagesPerChannel + 1];
+	const auto lookups = PrepareLookups();
+
+	Measure("QMap channels", [&] {
+		auto channels = QMap<qint32, Messages>();
+		Fill(channels, items);
+		auto found = quintptr(0);
+		for (const auto &lookup : lookups) {
+			auto i = channels.find(lookup.channel);
+			if (i != channels.end()) {
+				found += quintptr(i->value(lookup.msg) - items);
+			}
+		}
+		return found;
+	});
+	Measure("QHash channels", [&] {
+		auto channels = QHash<qint32, Messages>();
+		Fill(channels, items);
+		auto found = quintptr(0);
+		for (const auto &lookup : lookups) {
+			auto i = channels.find(lookup.channel);
+			if (i != channels.end()) {
+				found += quintptr(i->value(lookup.msg) - items);
+			}
+		}
+		return found;
+	});
+	Measure("QHash channels with last channel", [&] {
+		auto channels = QHash<qint32, Messages>();
+		Fill(channels, items);
+		auto found = quintptr(0);
+		auto lastChannel = 0;
+		Messages *lastMessages = nullptr;
+		for (const auto &lookup : lookups) {
+			if (!lastMessages || lastChannel != lookup.channel) {
+				auto i = channels.find(lookup.channel);
+				if (i == channels.end()) {
+					continue;
+				}
+				lastChannel = lookup.channel;
+				lastMessages = &*i;
+			}
+			found += quintptr(lastMessages->value(lookup.msg) - items);
+		}
+		return found;
+	});
+	return 0;
+}
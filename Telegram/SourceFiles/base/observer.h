@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include <vector>
 #include <deque>
 #include "base/type_traits.h"
+#include "base/observer_handlers.h"
 
 namespace base {
 namespace internal {
@@ -55,6 +56,9 @@ class CommonObservableData;
 template <typename EventType, typename Handler>
 class ObservableData;
 
+template <typename EventType>
+class BatchedObservableData;
+
 } // namespace internal
 
 class Subscription {
@@ -102,6 +106,9 @@ private:
 	template <typename EventType, typename Handler>
 	friend class internal::ObservableData;
 
+	template <typename EventType>
+	friend class internal::BatchedObservableData;
+
 };
 
 namespace internal {
@@ -372,6 +379,155 @@ public:
 
 };
 
+namespace internal {
+
+template <typename EventType>
+class BatchedObservableEvent {
+public:
+	void set(EventType &&event) {
+		_event = std::move(event);
+	}
+
+	template <typename Handlers>
+	void deliver(Handlers &handlers) {
+		auto event = base::take(_event);
+		handlers.enumerate([&event](auto &handler) {
+			handler(event);
+		});
+	}
+
+private:
+	EventType _event = EventType();
+
+};
+
+template <>
+class BatchedObservableEvent<void> {
+public:
+	template <typename Handlers>
+	void deliver(Handlers &handlers) {
+		handlers.enumerate([](auto &handler) {
+			handler();
+		});
+	}
+
+};
+
+template <typename EventType>
+class BatchedObservableData : public BaseObservableData {
+public:
+	using Handler = SubscriptionHandler<EventType>;
+
+	Subscription append(const QSharedPointer<BaseObservableData> &self, Handler &&handler) {
+		auto node = new Node(self, _handlers.add(std::move(handler)));
+		return { node, &BatchedObservableData::removeAndDestroyNode };
+	}
+
+	BatchedObservableEvent<EventType> &event() {
+		return _event;
+	}
+
+	void schedule(bool sync) {
+		if (_handling) {
+			sync = false;
+		}
+		if (sync) {
+			if (base::take(_pending)) {
+				UnregisterObservable(&_callHandlers);
+			}
+			callHandlers();
+		} else if (!_pending) {
+			if (!_callHandlers) {
+				_callHandlers = [this] {
+					callHandlers();
+				};
+			}
+			_pending = true;
+			RegisterPendingObservable(&_callHandlers);
+		}
+	}
+
+	~BatchedObservableData() {
+		UnregisterObservable(&_callHandlers);
+	}
+
+private:
+	struct Node : public Subscription::Node {
+		Node(const QSharedPointer<BaseObservableData> &observable, int id) : Subscription::Node(observable), id(id) {
+		}
+		int id = 0;
+	};
+
+	static void removeAndDestroyNode(Subscription::Node *node) {
+		if (auto that = node->observable.toStrongRef()) {
+			static_cast<BatchedObservableData*>(that.data())->_handlers.remove(static_cast<Node*>(node)->id);
+		}
+		delete static_cast<Node*>(node);
+	}
+
+	void callHandlers() {
+		_pending = false;
+		_handling = true;
+		_event.deliver(_handlers);
+		_handling = false;
+		UnregisterActiveObservable(&_callHandlers);
+	}
+
+	HandlersVector<Handler> _handlers;
+	BatchedObservableEvent<EventType> _event;
+	ObservableCallHandlers _callHandlers;
+	bool _pending = false;
+	bool _handling = false;
+
+};
+
+template <typename EventType>
+class BatchedObservableBase {
+public:
+	BatchedObservableBase() = default;
+	BatchedObservableBase(const BatchedObservableBase &other) = delete;
+	BatchedObservableBase &operator=(const BatchedObservableBase &other) = delete;
+
+	Subscription add_subscription(SubscriptionHandler<EventType> &&handler) {
+		if (!_data) {
+			_data = MakeShared<BatchedObservableData<EventType>>();
+		}
+		return _data->append(_data, std::move(handler));
+	}
+
+protected:
+	QSharedPointer<BatchedObservableData<EventType>> _data;
+
+};
+
+} // namespace internal
+
+// Cheaper Observable for high frequency events: subscribers are kept in
+// a contiguous vector and all notifications made during one event loop
+// iteration are delivered once, with the latest event value.
+template <typename EventType>
+class BatchedObservable : public internal::BatchedObservableBase<EventType> {
+public:
+	void notify(EventType event, bool sync = false) {
+		if (this->_data) {
+			this->_data->event().set(std::move(event));
+			this->_data->schedule(sync);
+		}
+	}
+
+};
+
+template <>
+class BatchedObservable<void> : public internal::BatchedObservableBase<void> {
+public:
+	void notify(bool sync = false) {
+		if (this->_data) {
+			this->_data->schedule(sync);
+		}
+	}
+
+};
+
 template <typename Type>
 class Variable {
 public:
@@ -424,6 +580,17 @@ protected:
 		return subscribe(*observable, std::forward<Lambda>(handler));
 	}
 
+	template <typename EventType, typename Lambda>
+	int subscribe(base::BatchedObservable<EventType> &observable, Lambda &&handler) {
+		_subscriptions.push_back(observable.add_subscription(std::forward<Lambda>(handler)));
+		return _subscriptions.size();
+	}
+
+	template <typename EventType, typename Lambda>
+	int subscribe(base::BatchedObservable<EventType> *observable, Lambda &&handler) {
+		return subscribe(*observable, std::forward<Lambda>(handler));
+	}
+
 	template <typename Type, typename Lambda>
 	int subscribe(const base::Variable<Type> &variable, Lambda &&handler) {
 		return subscribe(variable.changed(), std::forward<Lambda>(handler));
@@ -0,0 +1,131 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace base {
+namespace internal {
+
+// Subscribers of the BatchedObservable kept in one contiguous vector,
+// sorted by their ids. Handlers can add and remove subscriptions while
+// being enumerated: removed entries stay in the vector until the outer
+// enumeration is finished and added ones are not called until then.
+template <typename Handler>
+class HandlersVector {
+public:
+	int add(Handler &&handler) {
+		const auto id = ++_lastId;
+		auto &list = _enumerating ? _added : _entries;
+		list.push_back({ id, std::move(handler) });
+		return id;
+	}
+
+	void remove(int id) {
+		if (removeFrom(_added, id)) {
+			return;
+		}
+		const auto i = find(id);
+		if (i == _entries.end()) {
+			return;
+		} else if (_enumerating) {
+			i->alive = false;
+			_hasRemoved = true;
+		} else {
+			_entries.erase(i);
+		}
+	}
+
+	bool empty() const {
+		return (size() == 0);
+	}
+	int size() const {
+		const auto count = std::count_if(_entries.begin(), _entries.end(), [](const Entry &entry) {
+			return entry.alive;
+		});
+		return static_cast<int>(count + _added.size());
+	}
+
+	template <typename Callback>
+	void enumerate(Callback callback) {
+		++_enumerating;
+		const auto till = _entries.size();
+		for (auto i = decltype(till)(0); i != till; ++i) {
+			if (_entries[i].alive) {
+				callback(_entries[i].handler);
+			}
+		}
+		if (!--_enumerating) {
+			compact();
+		}
+	}
+
+private:
+	struct Entry {
+		Entry(int id, Handler &&handler) : id(id), handler(std::move(handler)) {
+		}
+		int id = 0;
+		Handler handler;
+		bool alive = true;
+	};
+
+	typename std::vector<Entry>::iterator find(int id) {
+		const auto i = std::lower_bound(_entries.begin(), _entries.end(), id, [](const Entry &entry, int id) {
+			return entry.id < id;
+		});
+		return (i != _entries.end() && i->id == id) ? i : _entries.end();
+	}
+
+	static bool removeFrom(std::vector<Entry> &list, int id) {
+		const auto i = std::find_if(list.begin(), list.end(), [id](const Entry &entry) {
+			return entry.id == id;
+		});
+		if (i == list.end()) {
+			return false;
+		}
+		list.erase(i);
+		return true;
+	}
+
+	void compact() {
+		if (_hasRemoved) {
+			_hasRemoved = false;
+			_entries.erase(std::remove_if(_entries.begin(), _entries.end(), [](const Entry &entry) {
+				return !entry.alive;
+			}), _entries.end());
+		}
+		for (auto &entry : _added) {
+			_entries.push_back(std::move(entry));
+		}
+		_added.clear();
+	}
+
+	std::vector<Entry> _entries;
+	std::vector<Entry> _added;
+	int _lastId = 0;
+	int _enumerating = 0;
+	bool _hasRemoved = false;
+
+};
+
+} // namespace internal
+} // namespace base
@@ -0,0 +1,89 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/observer_handlers.h"
+#include "base/benchmark.h"
+
+#include <functional>
+#include <list>
+
+// Compares delivering every downloader taskFinished() notification to
+// subscribers kept in a linked list with the BatchedObservable way of
+// keeping them in a vector and delivering once per event loop iteration.
+
+namespace {
+
+constexpr auto kSubscribersCount = 40;
+constexpr auto kFramesCount = 20000;
+constexpr auto kNotificationsPerFrame = 50;
+
+using base::benchmark::Measure;
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto calls = 0ULL;
+	Measure("Linked list, every notification", [&] {
+		auto handlers = std::list<std::function<void()>>();
+		for (auto i = 0; i != kSubscribersCount; ++i) {
+			handlers.push_back([&calls] { ++calls; });
+		}
+		calls = 0;
+		for (auto frame = 0; frame != kFramesCount; ++frame) {
+			for (auto i = 0; i != kNotificationsPerFrame; ++i) {
+				for (auto &handler : handlers) {
+					handler();
+				}
+			}
+		}
+		return calls;
+	});
+	Measure("Vector, every notification", [&] {
+		auto handlers = base::internal::HandlersVector<std::function<void()>>();
+		for (auto i = 0; i != kSubscribersCount; ++i) {
+			handlers.add([&calls] { ++calls; });
+		}
+		calls = 0;
+		for (auto frame = 0; frame != kFramesCount; ++frame) {
+			for (auto i = 0; i != kNotificationsPerFrame; ++i) {
+				handlers.enumerate([](auto &handler) { handler(); });
+			}
+		}
+		return calls;
+	});
+	Measure("Vector, once per frame", [&] {
+		auto handlers = base::internal::HandlersVector<std::function<void()>>();
+		for (auto i = 0; i != kSubscribersCount; ++i) {
+			handlers.add([&calls] { ++calls; });
+		}
+		calls = 0;
+		for (auto frame = 0; frame != kFramesCount; ++frame) {
+			auto pending = false;
+			for (auto i = 0; i != kNotificationsPerFrame; ++i) {
+				pending = true;
+			}
+			if (pending) {
+				handlers.enumerate([](auto &handler) { handler(); });
+			}
+		}
+		return calls;
+	});
+	return 0;
+}
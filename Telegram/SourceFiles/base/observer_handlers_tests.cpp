@@ -0,0 +1,112 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/observer_handlers.h"
+#include <functional>
+#include <vector>
+
+using Handlers = base::internal::HandlersVector<std::function<void(int)>>;
+
+TEST_CASE("handlers vector calls handlers in subscription order", "[observer_handlers]") {
+	Handlers handlers;
+	std::vector<int> calls;
+	handlers.add([&](int value) { calls.push_back(value * 10 + 1); });
+	handlers.add([&](int value) { calls.push_back(value * 10 + 2); });
+	auto third = handlers.add([&](int value) { calls.push_back(value * 10 + 3); });
+	REQUIRE(handlers.size() == 3);
+
+	handlers.enumerate([](auto &handler) { handler(1); });
+	REQUIRE(calls == std::vector<int>({ 11, 12, 13 }));
+
+	handlers.remove(third);
+	calls.clear();
+	handlers.enumerate([](auto &handler) { handler(2); });
+	REQUIRE(calls == std::vector<int>({ 21, 22 }));
+	REQUIRE(handlers.size() == 2);
+}
+
+TEST_CASE("handlers vector can be changed while enumerating", "[observer_handlers]") {
+	Handlers handlers;
+	std::vector<int> calls;
+	auto second = 0;
+	auto added = false;
+
+	SECTION("removing a following handler skips it") {
+		handlers.add([&](int) {
+			calls.push_back(1);
+			handlers.remove(second);
+		});
+		second = handlers.add([&](int) { calls.push_back(2); });
+		handlers.enumerate([](auto &handler) { handler(0); });
+		REQUIRE(calls == std::vector<int>({ 1 }));
+		REQUIRE(handlers.size() == 1);
+	}
+
+	SECTION("removing itself keeps the handler alive until the end") {
+		auto self = 0;
+		self = handlers.add([&](int value) {
+			handlers.remove(self);
+			calls.push_back(value);
+		});
+		handlers.add([&](int value) { calls.push_back(value + 1); });
+		handlers.enumerate([](auto &handler) { handler(5); });
+		REQUIRE(calls == std::vector<int>({ 5, 6 }));
+		REQUIRE(handlers.size() == 1);
+	}
+
+	SECTION("added handlers are called starting from the next enumeration") {
+		handlers.add([&](int value) {
+			calls.push_back(value);
+			if (!added) {
+				added = true;
+				handlers.add([&](int value) { calls.push_back(value + 100); });
+			}
+		});
+		handlers.enumerate([](auto &handler) { handler(1); });
+		REQUIRE(calls == std::vector<int>({ 1 }));
+		REQUIRE(handlers.size() == 2);
+
+		calls.clear();
+		handlers.enumerate([](auto &handler) { handler(2); });
+		REQUIRE(calls == std::vector<int>({ 2, 102 }));
+	}
+
+	SECTION("handlers added while enumerating can be removed at once") {
+		handlers.add([&](int) {
+			handlers.remove(handlers.add([&](int value) { calls.push_back(value); }));
+		});
+		handlers.enumerate([](auto &handler) { handler(1); });
+		handlers.enumerate([](auto &handler) { handler(2); });
+		REQUIRE(calls.empty());
+		REQUIRE(handlers.size() == 1);
+	}
+}
+
+TEST_CASE("handlers vector ignores unknown ids", "[observer_handlers]") {
+	Handlers handlers;
+	auto id = handlers.add([](int) {});
+	handlers.remove(id + 1);
+	REQUIRE(handlers.size() == 1);
+	handlers.remove(id);
+	handlers.remove(id);
+	REQUIRE(handlers.empty());
+}
@@ -0,0 +1,143 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <vector>
+#include <utility>
+
+namespace base {
+
+// Sorted map kept in a ring buffer. It is made for sliding windows of
+// keys that are inserted mostly in ascending order and are removed from
+// the front, so both usual operations don't move any other elements.
+template <typename Key, typename Type>
+class ring_map {
+public:
+	using key_type = Key;
+	using mapped_type = Type;
+	using value_type = std::pair<Key, Type>;
+	using size_type = std::size_t;
+
+	bool empty() const {
+		return !_size;
+	}
+	size_type size() const {
+		return _size;
+	}
+	void clear() {
+		_begin = _size = 0;
+	}
+
+	// Elements are accessed by index in the sorted order.
+	const value_type &operator[](size_type index) const {
+		return _data[physical(index)];
+	}
+	const value_type &front() const {
+		return (*this)[0];
+	}
+	const value_type &back() const {
+		return (*this)[_size - 1];
+	}
+
+	const Type *find(const Key &key) const {
+		auto index = lower_bound(key);
+		if (index == _size || key < (*this)[index].first) {
+			return nullptr;
+		}
+		return &(*this)[index].second;
+	}
+	bool contains(const Key &key) const {
+		return (find(key) != nullptr);
+	}
+
+	// Returns false if the key is already in the map.
+	bool insert(const Key &key, Type value) {
+		auto index = lower_bound(key);
+		if (index != _size && !(key < (*this)[index].first)) {
+			return false;
+		}
+		if (_size == _data.size()) {
+			grow();
+		}
+		if (index * 2 < _size) {
+			// Closer to the front, move the first elements one step back.
+			_begin = (_begin + _data.size() - 1) & mask();
+			for (auto i = size_type(0); i != index; ++i) {
+				at(i) = std::move(at(i + 1));
+			}
+		} else {
+			for (auto i = _size; i != index; --i) {
+				at(i) = std::move(at(i - 1));
+			}
+		}
+		at(index) = value_type(key, std::move(value));
+		++_size;
+		return true;
+	}
+
+	void pop_front() {
+		_begin = (_begin + 1) & mask();
+		--_size;
+	}
+
+private:
+	size_type mask() const {
+		return _data.size() - 1;
+	}
+	size_type physical(size_type index) const {
+		return (_begin + index) & mask();
+	}
+	value_type &at(size_type index) {
+		return _data[physical(index)];
+	}
+	size_type lower_bound(const Key &key) const {
+		// Most of the keys come in ascending order.
+		if (!_size || back().first < key) {
+			return _size;
+		}
+		auto from = size_type(0), till = _size;
+		while (from < till) {
+			auto middle = from + (till - from) / 2;
+			if ((*this)[middle].first < key) {
+				from = middle + 1;
+			} else {
+				till = middle;
+			}
+		}
+		return from;
+	}
+	void grow() {
+		// Capacity is always a power of two so that indices are masked.
+		auto data = std::vector<value_type>(_data.empty() ? 16 : _data.size() * 2);
+		for (auto i = size_type(0); i != _size; ++i) {
+			data[i] = std::move(at(i));
+		}
+		_data = std::move(data);
+		_begin = 0;
+	}
+
+	std::vector<value_type> _data;
+	size_type _begin = 0;
+	size_type _size = 0;
+
+};
+
+} // namespace base
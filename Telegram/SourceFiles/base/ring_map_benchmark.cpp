@@ -0,0 +1,79 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/ring_map.h"
+#include "base/benchmark.h"
+
+#include <QtCore/QMap>
+
+// Compares the received msg ids window used in MTP::internal::ReceivedMsgIds
+// with the QMap based one it replaced.
+
+namespace {
+
+constexpr auto kWindowSize = 400; // MTPIdsBufferSize
+constexpr auto kIdsCount = 2000000;
+
+using base::benchmark::Measure;
+
+quint64 MsgId(int index) {
+	// Every sixteenth id arrives a little late, out of order.
+	const auto shift = (index % 16) ? 0 : 24;
+	return (quint64(1500000000) << 32) + quint64(index) * 4 - shift + 1;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	Measure("QMap", [] {
+		auto ids = QMap<quint64, bool>();
+		auto handled = 0;
+		for (auto i = 0; i != kIdsCount; ++i) {
+			const auto msgId = MsgId(i);
+			if (ids.constFind(msgId) == ids.cend()
+				&& (ids.size() < kWindowSize || msgId > ids.cbegin().key())) {
+				ids.insert(msgId, (i % 2) != 0);
+				++handled;
+			}
+			auto size = ids.size();
+			while (size-- > kWindowSize) {
+				ids.erase(ids.begin());
+			}
+		}
+		return handled;
+	});
+	Measure("ring_map", [] {
+		auto ids = base::ring_map<quint64, bool>();
+		auto handled = 0;
+		for (auto i = 0; i != kIdsCount; ++i) {
+			const auto msgId = MsgId(i);
+			if (!ids.contains(msgId)
+				&& (int(ids.size()) < kWindowSize || msgId > ids.front().first)) {
+				ids.insert(msgId, (i % 2) != 0);
+				++handled;
+			}
+			while (int(ids.size()) > kWindowSize) {
+				ids.pop_front();
+			}
+		}
+		return handled;
+	});
+	return 0;
+}
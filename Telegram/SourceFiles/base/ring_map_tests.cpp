@@ -0,0 +1,81 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/ring_map.h"
+
+TEST_CASE("ring_maps should keep items sorted", "[ring_map]") {
+	base::ring_map<int, int> v;
+	v.insert(0, 0);
+	v.insert(5, 5);
+	v.insert(4, 4);
+	v.insert(2, 2);
+
+	auto checkSorted = [&] {
+		REQUIRE(!v.empty());
+		for (auto i = 1; i != int(v.size()); ++i) {
+			REQUIRE(v[i - 1].first < v[i].first);
+		}
+	};
+	REQUIRE(v.size() == 4);
+	checkSorted();
+
+	SECTION("adding item puts it in the right position") {
+		v.insert(3, 3);
+		REQUIRE(v.size() == 5);
+		REQUIRE(v.find(3) != nullptr);
+		REQUIRE(*v.find(3) == 3);
+		checkSorted();
+	}
+	SECTION("adding existing item does nothing") {
+		REQUIRE(!v.insert(4, 8));
+		REQUIRE(v.size() == 4);
+		REQUIRE(*v.find(4) == 4);
+	}
+	SECTION("removing from front keeps the rest") {
+		v.pop_front();
+		REQUIRE(v.size() == 3);
+		REQUIRE(v.front().first == 2);
+		REQUIRE(v.back().first == 5);
+		REQUIRE(v.find(0) == nullptr);
+		checkSorted();
+	}
+}
+
+TEST_CASE("ring_maps should work as a sliding window", "[ring_map]") {
+	constexpr auto kWindow = 100;
+	base::ring_map<int, bool> v;
+	for (auto i = 0; i != 1000; ++i) {
+		// Mostly ascending keys with some of them coming a bit later.
+		auto key = (i % 7) ? (i * 10) : (i * 10 - 35);
+		v.insert(key, (i % 2) != 0);
+		while (v.size() > kWindow) {
+			v.pop_front();
+		}
+	}
+	REQUIRE(v.size() == kWindow);
+	for (auto i = 1; i != kWindow; ++i) {
+		REQUIRE(v[i - 1].first < v[i].first);
+	}
+	REQUIRE(v.back().first == 9990);
+	REQUIRE(v.contains(9980));
+	REQUIRE(!v.contains(9985));
+}
@@ -20,6 +20,59 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "base/runtime_composer.h"
 
+namespace {
+
+constexpr auto kFreeDataSizeLimit = std::size_t(256 * 1024); // per components mask
+constexpr auto kMetadataCacheSize = 16;
+
+// Metadatas are never destroyed before the exit, so each thread can keep
+// the recently used ones and skip the global map lock for them.
+struct MetadataCacheEntry {
+	uint64 mask = 0;
+	const RuntimeComposerMetadata *meta = nullptr;
+};
+
+struct MetadataCacheEntries {
+	MetadataCacheEntry entries[kMetadataCacheSize];
+};
+QThreadStorage<MetadataCacheEntries> MetadataCache;
+
+MetadataCacheEntry &MetadataCacheEntryFor(uint64 mask) {
+	auto hash = mask ^ (mask >> 16) ^ (mask >> 32);
+	return MetadataCache.localData().entries[hash % kMetadataCacheSize];
+}
+
+} // namespace
+
+void *RuntimeComposerMetadata::allocate() const {
+	{
+		QMutexLocker lock(&_freeDataMutex);
+		if (!_freeData.empty()) {
+			auto result = _freeData.back();
+			_freeData.pop_back();
+			return result;
+		}
+	}
+	return operator new(size);
+}
+
+void RuntimeComposerMetadata::free(void *data) const {
+	{
+		QMutexLocker lock(&_freeDataMutex);
+		if ((_freeData.size() + 1) * size <= kFreeDataSizeLimit) {
+			_freeData.push_back(data);
+			return;
+		}
+	}
+	operator delete(data);
+}
+
+RuntimeComposerMetadata::~RuntimeComposerMetadata() {
+	for (auto data : _freeData) {
+		operator delete(data);
+	}
+}
+
 struct RuntimeComposerMetadatasMap {
 	QMap<uint64, RuntimeComposerMetadata*> data;
 	~RuntimeComposerMetadatasMap() {
@@ -30,6 +83,11 @@ struct RuntimeComposerMetadatasMap {
 };
 
 const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
+	auto &cached = MetadataCacheEntryFor(mask);
+	if (cached.meta && cached.mask == mask) {
+		return cached.meta;
+	}
+
 	static RuntimeComposerMetadatasMap RuntimeComposerMetadatas;
 	static QMutex RuntimeComposerMetadatasMutex;
 
@@ -41,7 +99,9 @@ const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask) {
 
 		i = RuntimeComposerMetadatas.data.insert(mask, meta);
 	}
-	return i.value();
+	cached.mask = mask;
+	cached.meta = i.value();
+	return cached.meta;
 }
 
 const RuntimeComposerMetadata *RuntimeComposer::ZeroRuntimeComposerMetadata = GetRuntimeComposerMetadata(0);
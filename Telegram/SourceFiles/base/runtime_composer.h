@@ -140,9 +140,19 @@ public:
 		return _mask & (~mask);
 	}
 
+	// Data blocks of the freed composers are kept for the next ones
+	// with the same components, up to a small total size per mask.
+	void *allocate() const;
+	void free(void *data) const;
+
+	~RuntimeComposerMetadata();
+
 private:
 	uint64 _mask;
 
+	mutable QMutex _freeDataMutex;
+	mutable std::vector<void*> _freeData;
+
 };
 
 const RuntimeComposerMetadata *GetRuntimeComposerMetadata(uint64 mask);
@@ -153,7 +163,7 @@ public:
 		if (mask) {
 			auto meta = GetRuntimeComposerMetadata(mask);
 
-			auto data = operator new(meta->size);
+			auto data = meta->allocate();
 			Assert(data != nullptr);
 
 			_data = data;
@@ -193,7 +203,7 @@ public:
 					RuntimeComponentWraps[i].Destruct(_dataptrunsafe(offset));
 				}
 			}
-			operator delete(_data);
+			meta->free(_data);
 		}
 	}
 
@@ -0,0 +1,182 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <vector>
+#include <map>
+#include <type_traits>
+
+namespace base {
+
+// Map for keys that are taken from an increasing counter, like request ids.
+// Live keys are kept in a ring of slots indexed by their distance from the
+// oldest live key, so lookup, insert and erase don't search anything.
+// Keys that fall out of the window (long living ones and keys that are
+// inserted after newer keys were already removed) go to a usual std::map.
+template <typename Key, typename Type, std::size_t MaxWindow = 4096>
+class sequence_map {
+	static_assert(std::is_integral<Key>::value, "sequence_map needs integral keys.");
+	static_assert(MaxWindow > 0 && !(MaxWindow & (MaxWindow - 1)), "MaxWindow should be a power of two.");
+
+public:
+	using key_type = Key;
+	using mapped_type = Type;
+	using size_type = std::size_t;
+
+	bool empty() const {
+		return !size();
+	}
+	size_type size() const {
+		return _size + _overflow.size();
+	}
+	void clear() {
+		_slots.clear();
+		_overflow.clear();
+		_begin = _span = _size = 0;
+	}
+
+	Type *find(const Key &key) {
+		if (inWindow(key)) {
+			auto &slot = at(offset(key));
+			return slot.filled ? &slot.value : nullptr;
+		}
+		auto i = _overflow.find(key);
+		return (i != _overflow.end()) ? &i->second : nullptr;
+	}
+	const Type *find(const Key &key) const {
+		return const_cast<sequence_map*>(this)->find(key);
+	}
+	bool contains(const Key &key) const {
+		return (find(key) != nullptr);
+	}
+
+	// Returns false if the key is already in the map.
+	bool insert(const Key &key, Type value) {
+		if (!_span) {
+			if (!_overflow.empty() && !(_overflow.rbegin()->first < key)) {
+				return _overflow.emplace(key, std::move(value)).second;
+			}
+			_first = key;
+		} else if (key < _first) {
+			return _overflow.emplace(key, std::move(value)).second;
+		}
+		while (_span && offset(key) >= MaxWindow) {
+			evictFront();
+		}
+		if (!_span) {
+			_first = key;
+		}
+		auto index = offset(key);
+		if (index >= _slots.size()) {
+			grow(index + 1);
+		}
+		auto &slot = at(index);
+		if (slot.filled) {
+			return false;
+		}
+		slot.filled = true;
+		slot.value = std::move(value);
+		++_size;
+		if (_span <= index) {
+			_span = index + 1;
+		}
+		return true;
+	}
+
+	// Returns false if there was no such key.
+	bool erase(const Key &key) {
+		if (!inWindow(key)) {
+			return (_overflow.erase(key) > 0);
+		}
+		auto index = offset(key);
+		auto &slot = at(index);
+		if (!slot.filled) {
+			return false;
+		}
+		slot = Slot();
+		--_size;
+		if (!index) {
+			trimFront();
+		} else if (index + 1 == _span) {
+			while (!at(_span - 1).filled) {
+				--_span;
+			}
+		}
+		return true;
+	}
+
+private:
+	struct Slot {
+		bool filled = false;
+		Type value = Type();
+	};
+
+	size_type mask() const {
+		return _slots.size() - 1;
+	}
+	size_type offset(const Key &key) const {
+		return size_type(key - _first);
+	}
+	bool inWindow(const Key &key) const {
+		return _span && !(key < _first) && offset(key) < _span;
+	}
+	Slot &at(size_type index) {
+		return _slots[(_begin + index) & mask()];
+	}
+	void trimFront() {
+		// The front slot is always filled while the ring is not empty.
+		while (_span && !at(0).filled) {
+			_begin = (_begin + 1) & mask();
+			++_first;
+			--_span;
+		}
+	}
+	void evictFront() {
+		auto &slot = at(0);
+		_overflow.emplace(_first, std::move(slot.value));
+		slot = Slot();
+		--_size;
+		trimFront();
+	}
+	void grow(size_type required) {
+		// Capacity is always a power of two so that indices are masked.
+		auto capacity = _slots.empty() ? size_type(16) : _slots.size();
+		while (capacity < required) {
+			capacity *= 2;
+		}
+		auto slots = std::vector<Slot>(capacity);
+		for (auto i = size_type(0); i != _span; ++i) {
+			slots[i] = std::move(at(i));
+		}
+		_slots = std::move(slots);
+		_begin = 0;
+	}
+
+	std::vector<Slot> _slots;
+	std::map<Key, Type> _overflow;
+	Key _first = Key();
+	size_type _begin = 0;
+	size_type _span = 0;
+	size_type _size = 0;
+
+};
+
+} // namespace base
@@ -0,0 +1,92 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "base/sequence_map.h"
+#include "base/benchmark.h"
+
+#include <map>
+
+// Compares the request bookkeeping used in MTP::Instance::Private
+// with the std::map based one it replaced.
+
+namespace {
+
+constexpr auto kRequestsCount = 100000;
+constexpr auto kInFlight = 64;
+constexpr auto kLongLivingEach = 1000;
+constexpr auto kRounds = 20;
+
+using base::benchmark::Measure;
+
+int Answered(int index) {
+	// Responses come a little out of order and some requests are not
+	// answered until the very end, like the long polling ones.
+	const auto result = index - kInFlight + (index % 5) * 3;
+	return (result > 0 && (result % kLongLivingEach)) ? result : 0;
+}
+
+template <typename Map, typename Insert, typename Find, typename Erase>
+long long Simulate(Insert insert, Find find, Erase erase) {
+	auto result = 0LL;
+	for (auto round = 0; round != kRounds; ++round) {
+		auto requests = Map();
+		for (auto i = 1; i <= kRequestsCount; ++i) {
+			// Send: remember the dc the request was sent to.
+			insert(requests, i, i % 5 + 1);
+
+			// Receive: find the request dc and forget the request.
+			if (const auto answered = Answered(i)) {
+				if (const auto dcId = find(requests, answered)) {
+					result += *dcId;
+					erase(requests, answered);
+				}
+			}
+		}
+		result += requests.size();
+	}
+	return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	Measure("std::map", [] {
+		using Map = std::map<int, int>;
+		return Simulate<Map>([](Map &map, int key, int value) {
+			map.emplace(key, value);
+		}, [](Map &map, int key) {
+			auto i = map.find(key);
+			return (i != map.end()) ? &i->second : nullptr;
+		}, [](Map &map, int key) {
+			map.erase(key);
+		});
+	});
+	Measure("sequence_map", [] {
+		using Map = base::sequence_map<int, int>;
+		return Simulate<Map>([](Map &map, int key, int value) {
+			map.insert(key, value);
+		}, [](Map &map, int key) {
+			return map.find(key);
+		}, [](Map &map, int key) {
+			map.erase(key);
+		});
+	});
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "catch.hpp"
+
+#include "base/sequence_map.h"
+
+TEST_CASE("sequence_maps should find inserted items", "[sequence_map]") {
+	base::sequence_map<int, int> v;
+	for (auto i = 1; i != 11; ++i) {
+		REQUIRE(v.insert(i, i * 10));
+	}
+	REQUIRE(v.size() == 10);
+
+	SECTION("all items are found") {
+		for (auto i = 1; i != 11; ++i) {
+			REQUIRE(v.find(i) != nullptr);
+			REQUIRE(*v.find(i) == i * 10);
+		}
+		REQUIRE(v.find(0) == nullptr);
+		REQUIRE(v.find(11) == nullptr);
+	}
+	SECTION("adding existing item does nothing") {
+		REQUIRE(!v.insert(4, 8));
+		REQUIRE(v.size() == 10);
+		REQUIRE(*v.find(4) == 40);
+	}
+	SECTION("found item can be changed") {
+		*v.find(5) = 55;
+		REQUIRE(*v.find(5) == 55);
+	}
+	SECTION("removing items in any order keeps the rest") {
+		REQUIRE(v.erase(1));
+		REQUIRE(v.erase(10));
+		REQUIRE(v.erase(5));
+		REQUIRE(!v.erase(5));
+		REQUIRE(v.size() == 7);
+		REQUIRE(!v.contains(1));
+		REQUIRE(!v.contains(5));
+		REQUIRE(!v.contains(10));
+		REQUIRE(*v.find(2) == 20);
+		REQUIRE(*v.find(9) == 90);
+	}
+	SECTION("removed item can be inserted back") {
+		REQUIRE(v.erase(1));
+		REQUIRE(v.erase(2));
+		REQUIRE(v.insert(1, 11));
+		REQUIRE(v.size() == 9);
+		REQUIRE(*v.find(1) == 11);
+		REQUIRE(!v.contains(2));
+		REQUIRE(*v.find(3) == 30);
+	}
+	SECTION("clearing removes everything") {
+		v.clear();
+		REQUIRE(v.empty());
+		REQUIRE(!v.contains(1));
+		REQUIRE(v.insert(1, 1));
+	}
+}
+
+TEST_CASE("sequence_maps should keep long living items", "[sequence_map]") {
+	constexpr auto kWindow = 64;
+	constexpr auto kInFlight = 20;
+	base::sequence_map<int, int, kWindow> v;
+	REQUIRE(v.insert(1, 1));
+	for (auto i = 2; i != 1000; ++i) {
+		REQUIRE(v.insert(i, i));
+		if (i - kInFlight > 1) {
+			REQUIRE(v.erase(i - kInFlight));
+		}
+	}
+	REQUIRE(v.size() == kInFlight + 1);
+	REQUIRE(*v.find(1) == 1);
+	for (auto i = 1000 - kInFlight; i != 1000; ++i) {
+		REQUIRE(*v.find(i) == i);
+	}
+	REQUIRE(!v.contains(500));
+	REQUIRE(v.erase(1));
+	REQUIRE(!v.contains(1));
+	REQUIRE(v.size() == kInFlight);
+
+	SECTION("old items can be inserted after the window moved") {
+		REQUIRE(v.insert(500, 5));
+		REQUIRE(!v.insert(500, 6));
+		REQUIRE(*v.find(500) == 5);
+		REQUIRE(v.erase(500));
+		REQUIRE(!v.contains(500));
+	}
+	SECTION("the window can start over after it was emptied") {
+		for (auto i = 1000 - kInFlight; i != 1000; ++i) {
+			REQUIRE(v.erase(i));
+		}
+		REQUIRE(v.empty());
+		REQUIRE(v.insert(5000, 1));
+		REQUIRE(v.insert(3, 2));
+		REQUIRE(*v.find(5000) == 1);
+		REQUIRE(*v.find(3) == 2);
+	}
+}
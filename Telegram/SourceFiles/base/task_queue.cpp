@@ -64,6 +64,7 @@ public:
 
 	void AddQueueTask(TaskQueue *queue, Task &&task);
 	void RemoveQueue(TaskQueue *queue);
+	LatencyHistogram TasksLatency();
 
 	~TaskThreadPool();
 
@@ -81,6 +82,9 @@ private:
 	int tasks_in_process_ = 0;
 	int background_tasks_in_process_ = 0;
 
+	// queues_mutex_ must be locked when working with the histogram.
+	LatencyHistogram latency_;
+
 };
 
 TaskQueue::TaskQueueList::TaskQueueList() {
@@ -175,30 +179,43 @@ TaskQueue *TaskQueue::TaskQueueList::TakeFirst(int list_index_) {
 }
 
 void TaskQueue::TaskThreadPool::AddQueueTask(TaskQueue *queue, Task &&task) {
-	QMutexLocker lock(&queues_mutex_);
+	auto some_threads_are_vacant = false;
+	{
+		QMutexLocker lock(&queues_mutex_);
 
-	queue->tasks_.push_back(std::move(task));
-	auto list_was_empty = queue_list_.Empty(kAllQueuesList);
-	auto threads_count = threads_.size();
-	auto all_threads_processing = (threads_count == tasks_in_process_);
-	auto some_threads_are_vacant = !all_threads_processing && list_was_empty;
-	auto will_create_thread = !some_threads_are_vacant && (threads_count < MaxThreadsCount);
+		queue->tasks_.push_back(std::move(task));
+		queue->tasks_put_time_.push_back(getms());
+		auto list_was_empty = queue_list_.Empty(kAllQueuesList);
+		auto threads_count = threads_.size();
+		auto all_threads_processing = (threads_count == tasks_in_process_);
+		some_threads_are_vacant = !all_threads_processing && list_was_empty;
+		auto will_create_thread = !some_threads_are_vacant && (threads_count < MaxThreadsCount);
 
-	if (!queue->SerialTaskInProcess()) {
-		if (!queue_list_.IsInList(queue)) {
-			queue_list_.Register(queue);
+		if (!queue->SerialTaskInProcess()) {
+			if (!queue_list_.IsInList(queue)) {
+				queue_list_.Register(queue);
+			}
+		}
+		if (will_create_thread) {
+			threads_.emplace_back([this]() {
+				ThreadFunction();
+			});
+		} else if (some_threads_are_vacant) {
+			Assert(threads_count > tasks_in_process_);
 		}
 	}
-	if (will_create_thread) {
-		threads_.emplace_back([this]() {
-			ThreadFunction();
-		});
-	} else if (some_threads_are_vacant) {
-		Assert(threads_count > tasks_in_process_);
+
+	// Wake the thread after unlocking, so that it doesn't block on the mutex right away.
+	if (some_threads_are_vacant) {
 		thread_condition_.wakeOne();
 	}
 }
 
+TaskQueue::LatencyHistogram TaskQueue::TaskThreadPool::TasksLatency() {
+	QMutexLocker lock(&queues_mutex_);
+	return latency_;
+}
+
 void TaskQueue::TaskThreadPool::RemoveQueue(TaskQueue *queue) {
 	QMutexLocker lock(&queues_mutex_);
 	if (queue_list_.IsInList(queue)) {
@@ -281,6 +298,15 @@ void TaskQueue::TaskThreadPool::ThreadFunction() {
 			task = std::move(queue->tasks_.front());
 			queue->tasks_.pop_front();
 
+			auto latency = getms() - queue->tasks_put_time_.front();
+			queue->tasks_put_time_.pop_front();
+			auto bucket = 0;
+			while (bucket + 1 < kLatencyBucketsCount && latency >= (1LL << bucket)) {
+				++bucket;
+			}
+			auto &buckets = (queue->priority_ == Priority::Background) ? latency_.background : latency_.normal;
+			++buckets[bucket];
+
 			if (queue->type_ == Type::Serial) {
 				// Serial queues are returned in the list for processing
 				// only after the task is finished.
@@ -331,6 +357,10 @@ void TaskQueue::Put(Task &&task) {
 	}
 }
 
+TaskQueue::LatencyHistogram TaskQueue::TasksLatency() { // static
+	return TaskThreadPool::Instance()->TasksLatency();
+}
+
 void TaskQueue::ProcessMainTasks() { // static
 	Assert(std::this_thread::get_id() == MainThreadId);
 
@@ -21,10 +21,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include <memory>
+#include <array>
 
 namespace base {
 
-using Task = lambda_once<void()>;
+// Tasks usually capture a few strings, byte arrays and a callback,
+// so they get a larger inline storage to avoid a heap allocation.
+constexpr auto kTaskStorageSize = 96U;
+using Task = lambda_once<void(), kTaskStorageSize>;
 
 // An attempt to create/use a TaskQueue or one of the default queues
 // after the main() has returned leads to an undefined behaviour.
@@ -53,6 +57,16 @@ public:
 
 	void Put(Task &&task);
 
+	// Time the thread pool tasks spent waiting before they were started.
+	// Bucket i counts waits below 2^i ms, the last one counts all the rest.
+	static constexpr int kLatencyBucketsCount = 8;
+	using LatencyBuckets = std::array<int64, kLatencyBucketsCount>;
+	struct LatencyHistogram {
+		LatencyBuckets normal = { { 0 } };
+		LatencyBuckets background = { { 0 } };
+	};
+	static LatencyHistogram TasksLatency();
+
 	static void ProcessMainTasks();
 	static void ProcessMainTasks(TimeMs max_time_spent);
 
@@ -73,6 +87,7 @@ private:
 
 	std::deque<Task> tasks_;
 	QMutex tasks_mutex_; // Only for the main queue.
+	std::deque<TimeMs> tasks_put_time_; // Only for the other queues, not main.
 
 	// Only for the other queues, not main.
 	class TaskThreadPool;
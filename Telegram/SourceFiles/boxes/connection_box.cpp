@@ -28,7 +28,6 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/checkbox.h"
 #include "ui/widgets/buttons.h"
 #include "ui/widgets/input_fields.h"
-#include "history/history_location_manager.h"
 #include "styles/style_boxes.h"
 
 void ConnectionBox::ShowApplyProxyConfirmation(const QMap<QString, QString> &fields) {
@@ -48,7 +47,6 @@ void ConnectionBox::ShowApplyProxyConfirmation(const QMap<QString, QString> &fie
 			Local::writeSettings();
 			Global::RefConnectionTypeChanged().notify();
 			MTP::restart();
-			reinitLocationManager();
 			reinitWebLoadManager();
 			if (*weakBox) (*weakBox)->closeBox();
 		}), KeepOtherLayers);
@@ -250,7 +248,6 @@ void ConnectionBox::onSave() {
 		Global::RefConnectionTypeChanged().notify();
 
 		MTP::restart();
-		reinitLocationManager();
 		reinitWebLoadManager();
 		closeBox();
 	}
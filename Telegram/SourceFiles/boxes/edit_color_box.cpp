@@ -151,39 +151,51 @@ void EditColorBox::Picker::preparePalette() {
 
 	auto size = _palette.width();
 	auto ints = reinterpret_cast<uint32*>(_palette.bits());
-	auto intsAddPerLine = (_palette.bytesPerLine() - size * sizeof(uint32)) / sizeof(uint32);
+	auto intsPerLine = _palette.bytesPerLine() / sizeof(uint32);
+	auto intsAddPerLine = intsPerLine - size;
 
 	constexpr auto Large = 1024 * 1024;
 	constexpr auto LargeBit = 20; // n / Large == (n >> LargeBit)
 	auto part = Large / size;
 
+	// The ratios are the same for all the lines.
+	auto x_ratios = std::vector<anim::ShiftedMultiplier>(size);
+	auto x_accumulated = 0;
+	for (auto &x_ratio : x_ratios) {
+		x_ratio = anim::ShiftedMultiplier(x_accumulated >> (LargeBit - 8)); // (x_accumulated * 256) / Large;
+		// 0 <= x_accumulated < Large
+		// 0 <= x_ratio < 256
+		x_accumulated += part;
+	}
+
 	auto topleft = anim::shifted(_topleft);
 	auto topright = anim::shifted(_topright);
 	auto bottomleft = anim::shifted(_bottomleft);
 	auto bottomright = anim::shifted(_bottomright);
 
 	auto y_accumulated = 0;
+	auto y_ratio_previous = -1;
 	for (auto y = 0; y != size; ++y, y_accumulated += part) {
 		auto y_ratio = y_accumulated >> (LargeBit - 8); // (y_accumulated * 256) / Large;
 		// 0 <= y_accumulated < Large
 		// 0 <= y_ratio < 256
 
+		if (y_ratio == y_ratio_previous) {
+			// With retina the palette is larger than 256, so the lines repeat.
+			memcpy(ints, ints - intsPerLine, size * sizeof(uint32));
+			ints += intsPerLine;
+			continue;
+		}
+		y_ratio_previous = y_ratio;
+
 		auto top_ratio = 255 - y_ratio;
 		auto bottom_ratio = y_ratio;
 
 		auto left = anim::reshifted(bottomleft * bottom_ratio + topleft * top_ratio);
 		auto right = anim::reshifted(bottomright * bottom_ratio + topright * top_ratio);
 
-		auto x_accumulated = 0;
-		for (auto x = 0; x != size; ++x, x_accumulated += part) {
-			auto x_ratio = x_accumulated >> (LargeBit - 8); // (x_accumulated * 256) / Large;
-			// 0 <= x_accumulated < Large
-			// 0 <= x_ratio < 256
-
-			auto left_ratio = 255 - x_ratio;
-			auto right_ratio = x_ratio;
-
-			*ints++ = anim::unshifted(left * left_ratio + right * right_ratio);
+		for (auto x_ratio : x_ratios) {
+			*ints++ = anim::unshifted(left * (255 - x_ratio) + right * x_ratio);
 		}
 		ints += intsAddPerLine;
 	}
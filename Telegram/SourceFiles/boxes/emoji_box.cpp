@@ -85,6 +85,7 @@ void EmojiBox::prepare() {
 	addButton(langFactory(lng_close), [this] { closeBox(); });
 
 	_blockHeight = st::emojiReplaceInnerHeight;
+	subscribe(Global::RefEmojiLargeLoaded(), [this] { update(); });
 
 	setDimensions(_blocks[0].size() * st::emojiReplaceWidth + 2 * st::emojiReplacePadding, st::emojiReplacePadding + _blocks.size() * st::emojiReplaceHeight + (st::emojiReplaceHeight - _blockHeight) + st::emojiReplacePadding);
 }
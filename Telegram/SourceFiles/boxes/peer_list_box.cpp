@@ -609,6 +609,9 @@ void PeerListBox::Inner::addToSearchIndex(not_null<PeerListRow*> row) {
 	for_const (auto ch, row->nameFirstChars()) {
 		_searchIndex[ch].push_back(row);
 	}
+	if (!_normalizedSearchQuery.isEmpty()) {
+		_searchIndexAdded.push_back(row);
+	}
 }
 
 void PeerListBox::Inner::removeFromSearchIndex(not_null<PeerListRow*> row) {
@@ -625,6 +628,7 @@ void PeerListBox::Inner::removeFromSearchIndex(not_null<PeerListRow*> row) {
 			}
 		}
 		row->setNameFirstChars(OrderedSet<QChar>());
+		_searchIndexAdded.erase(std::remove(_searchIndexAdded.begin(), _searchIndexAdded.end(), row), _searchIndexAdded.end());
 	}
 }
 
@@ -1094,18 +1098,48 @@ void PeerListBox::Inner::searchQueryChanged(QString query) {
 	auto searchWordsList = TextUtilities::PrepareSearchWords(query);
 	auto normalizedQuery = searchWordsList.isEmpty() ? QString() : searchWordsList.join(' ');
 	if (_normalizedSearchQuery != normalizedQuery) {
+		// When the query is only appended to (user types the next letter)
+		// all new results are contained in the previous results, so we can
+		// filter them instead of the (possibly huge) search index list.
+		auto narrowing = !_normalizedSearchQuery.isEmpty()
+			&& normalizedQuery.startsWith(_normalizedSearchQuery);
+		auto previousResults = std::vector<not_null<PeerListRow*>>();
+		if (narrowing) {
+			previousResults = std::move(_filterResults);
+			previousResults.erase(std::remove_if(previousResults.begin(), previousResults.end(), [](not_null<PeerListRow*> row) {
+				return row->isSearchResult();
+			}), previousResults.end());
+
+			// Rows added or renamed after the previous search were not checked yet.
+			if (!_searchIndexAdded.empty()) {
+				auto checked = std::set<PeerListRow*>();
+				for (auto row : previousResults) {
+					checked.insert(row);
+				}
+				for (auto row : _searchIndexAdded) {
+					if (checked.insert(row).second) {
+						previousResults.push_back(row);
+					}
+				}
+			}
+		}
+		_searchIndexAdded.clear();
 		setSearchQuery(query, normalizedQuery);
 		if (_controller->searchInLocal() && !searchWordsList.isEmpty()) {
 			auto minimalList = (const std::vector<not_null<PeerListRow*>>*)nullptr;
-			for_const (auto &searchWord, searchWordsList) {
-				auto searchWordStart = searchWord[0].toLower();
-				auto it = _searchIndex.find(searchWordStart);
-				if (it == _searchIndex.cend()) {
-					// Some word can't be found in any row.
-					minimalList = nullptr;
-					break;
-				} else if (!minimalList || minimalList->size() > it->second.size()) {
-					minimalList = &it->second;
+			if (narrowing) {
+				minimalList = &previousResults;
+			} else {
+				for_const (auto &searchWord, searchWordsList) {
+					auto searchWordStart = searchWord[0].toLower();
+					auto it = _searchIndex.find(searchWordStart);
+					if (it == _searchIndex.cend()) {
+						// Some word can't be found in any row.
+						minimalList = nullptr;
+						break;
+					} else if (!minimalList || minimalList->size() > it->second.size()) {
+						minimalList = &it->second;
+					}
 				}
 			}
 			if (minimalList) {
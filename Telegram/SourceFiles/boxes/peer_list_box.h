@@ -545,6 +545,7 @@ private:
 	std::map<PeerData*, std::vector<not_null<PeerListRow*>>> _rowsByPeer;
 
 	std::map<QChar, std::vector<not_null<PeerListRow*>>> _searchIndex;
+	std::vector<not_null<PeerListRow*>> _searchIndexAdded; // Since the last local search.
 	QString _searchQuery;
 	QString _normalizedSearchQuery;
 	QString _mentionHighlight;
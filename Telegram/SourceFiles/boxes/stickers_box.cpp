@@ -590,6 +590,7 @@ StickersBox::~StickersBox() = default;
 StickersBox::Inner::Row::Row(uint64 id, DocumentData *sticker, int32 count, const QString &title, int titleWidth, bool installed, bool official, bool unread, bool archived, bool removed, int32 pixw, int32 pixh) : id(id)
 , sticker(sticker)
 , count(count)
+, fullTitle(title)
 , title(title)
 , titleWidth(titleWidth)
 , installed(installed)
@@ -793,7 +794,9 @@ void StickersBox::Inner::paintRow(Painter &p, Row *set, int index, TimeMs ms) {
 	}
 
 	if (set->sticker) {
-		set->sticker->thumb->load();
+		// Covers are requested only for the rows being painted, without
+		// taking priority over the rest of the download queue.
+		set->sticker->thumb->load(false, false);
 		auto pix = set->sticker->thumb->pix(set->pixw, set->pixh);
 		p.drawPixmapLeft(stickerx + (st::contactsPhotoSize - set->pixw) / 2, st::contactsPadding.top() + (st::contactsPhotoSize - set->pixh) / 2, width(), pix);
 	}
@@ -804,6 +807,7 @@ void StickersBox::Inner::paintRow(Painter &p, Row *set, int index, TimeMs ms) {
 	int statusx = namex;
 	int statusy = st::contactsPadding.top() + st::contactsStatusTop;
 
+	ensureRowTitle(set);
 	p.setFont(st::contactsNameStyle.font);
 	p.setPen(st::contactsNameFg);
 	p.drawTextLeft(namex, namey, width(), set->title, set->titleWidth);
@@ -1166,7 +1170,7 @@ void StickersBox::Inner::step_shifting(TimeMs ms, bool timer) {
 	}
 	if (_aboveShadowFadeStart) {
 		if (updateMin < 0 || updateMin > _above) updateMin = _above;
-		if (updateMax < _above) updateMin = _above;
+		if (updateMax < _above) updateMax = _above;
 		if (_aboveShadowFadeStart + st::stickersRowDuration > ms && ms > _aboveShadowFadeStart) {
 			_aboveShadowFadeOpacity.update(float64(ms - _aboveShadowFadeStart) / st::stickersRowDuration, anim::sineInOut);
 			animating = true;
@@ -1299,8 +1303,6 @@ void StickersBox::Inner::rebuild() {
 		rebuildMegagroupSet();
 	}
 
-	auto maxNameWidth = countMaxNameWidth();
-
 	clear();
 	auto &order = ([this]() -> const Stickers::Order & {
 		if (_section == Section::Installed) {
@@ -1319,7 +1321,7 @@ void StickersBox::Inner::rebuild() {
 	if (!_megagroupSet && _section == Section::Installed) {
 		auto cloudIt = sets.constFind(Stickers::CloudRecentSetId);
 		if (cloudIt != sets.cend() && !cloudIt->stickers.isEmpty()) {
-			rebuildAppendSet(cloudIt.value(), maxNameWidth);
+			rebuildAppendSet(cloudIt.value());
 		}
 	}
 	for_const (auto setId, order) {
@@ -1328,7 +1330,7 @@ void StickersBox::Inner::rebuild() {
 			continue;
 		}
 
-		rebuildAppendSet(it.value(), maxNameWidth);
+		rebuildAppendSet(it.value());
 
 		if (it->stickers.isEmpty() || (it->flags & MTPDstickerSet_ClientFlag::f_not_loaded)) {
 			Auth().api().scheduleStickerSetRequest(it->id, it->access);
@@ -1357,7 +1359,6 @@ void StickersBox::Inner::updateSize(int newWidth) {
 }
 
 void StickersBox::Inner::updateRows() {
-	int maxNameWidth = countMaxNameWidth();
 	auto &sets = Global::StickerSets();
 	for_const (auto &row, _rows) {
 		auto it = sets.constFind(row->id);
@@ -1384,7 +1385,10 @@ void StickersBox::Inner::updateRows() {
 					row->ripple.reset();
 				}
 			}
-			row->title = fillSetTitle(set, maxNameWidth, &row->titleWidth);
+			if (row->titleWidth < 0 || row->fullTitle != set.title) {
+				row->fullTitle = row->title = set.title;
+				row->titleWidth = -1;
+			}
 			row->count = fillSetCount(set);
 		}
 	}
@@ -1397,7 +1401,7 @@ bool StickersBox::Inner::appendSet(const Stickers::Set &set) {
 			return false;
 		}
 	}
-	rebuildAppendSet(set, countMaxNameWidth());
+	rebuildAppendSet(set);
 	return true;
 }
 
@@ -1415,7 +1419,7 @@ int StickersBox::Inner::countMaxNameWidth() const {
 	return namew;
 }
 
-void StickersBox::Inner::rebuildAppendSet(const Stickers::Set &set, int maxNameWidth) {
+void StickersBox::Inner::rebuildAppendSet(const Stickers::Set &set) {
 	bool installed = true, official = true, unread = false, archived = false, removed = false;
 	if (set.id != Stickers::CloudRecentSetId) {
 		fillSetFlags(set, &installed, &official, &unread, &archived);
@@ -1428,11 +1432,10 @@ void StickersBox::Inner::rebuildAppendSet(const Stickers::Set &set, int maxNameW
 	int pixw = 0, pixh = 0;
 	fillSetCover(set, &sticker, &pixw, &pixh);
 
-	int titleWidth = 0;
-	QString title = fillSetTitle(set, maxNameWidth, &titleWidth);
+	// The title is elided when the row is painted for the first time.
 	int count = fillSetCount(set);
 
-	_rows.push_back(std::make_unique<Row>(set.id, sticker, count, title, titleWidth, installed, official, unread, archived, removed, pixw, pixh));
+	_rows.push_back(std::make_unique<Row>(set.id, sticker, count, set.title, -1, installed, official, unread, archived, removed, pixw, pixh));
 	_animStartTimes.push_back(0);
 }
 
@@ -1480,6 +1483,21 @@ int StickersBox::Inner::fillSetCount(const Stickers::Set &set) const {
 	return result + added;
 }
 
+void StickersBox::Inner::ensureRowTitle(Row *row) const {
+	if (row->titleWidth >= 0) {
+		return;
+	}
+	auto maxNameWidth = countMaxNameWidth();
+	auto titleWidth = st::contactsNameStyle.font->width(row->fullTitle);
+	if (titleWidth > maxNameWidth) {
+		row->title = st::contactsNameStyle.font->elided(row->fullTitle, maxNameWidth);
+		titleWidth = st::contactsNameStyle.font->width(row->title);
+	} else {
+		row->title = row->fullTitle;
+	}
+	row->titleWidth = titleWidth;
+}
+
 QString StickersBox::Inner::fillSetTitle(const Stickers::Set &set, int maxNameWidth, int *outTitleWidth) const {
 	auto result = set.title;
 	int titleWidth = st::contactsNameStyle.font->width(result);
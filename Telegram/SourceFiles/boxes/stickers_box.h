@@ -215,8 +215,9 @@ private:
 		uint64 id = 0;
 		DocumentData *sticker = nullptr;
 		int32 count = 0;
+		QString fullTitle;
 		QString title;
-		int titleWidth = 0;
+		int titleWidth = 0; // -1 until the title is elided.
 		bool installed = false;
 		bool official = false;
 		bool unread = false;
@@ -253,10 +254,11 @@ private:
 	void readVisibleSets();
 
 	void updateControlsGeometry();
-	void rebuildAppendSet(const Stickers::Set &set, int maxNameWidth);
+	void rebuildAppendSet(const Stickers::Set &set);
 	void fillSetCover(const Stickers::Set &set, DocumentData **outSticker, int *outWidth, int *outHeight) const;
 	int fillSetCount(const Stickers::Set &set) const;
 	QString fillSetTitle(const Stickers::Set &set, int maxNameWidth, int *outTitleWidth) const;
+	void ensureRowTitle(Row *row) const;
 	void fillSetFlags(const Stickers::Set &set, bool *outInstalled, bool *outOfficial, bool *outUnread, bool *outArchived);
 	void rebuildMegagroupSet();
 	void handleMegagroupSetAddressChange();
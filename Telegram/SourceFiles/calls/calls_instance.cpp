@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "mtproto/connection.h"
 #include "messenger.h"
+#include "mainwidget.h"
 #include "auth_session.h"
 #include "apiwrap.h"
 #include "lang/lang_keys.h"
@@ -101,6 +102,7 @@ void Instance::destroyCall(not_null<Call*> call) {
 		destroyCurrentPanel();
 		_currentCall.reset();
 		_currentCallChanged.notify(nullptr, true);
+		performanceModeChanged();
 
 		if (App::quitting()) {
 			LOG(("Calls::Instance doesn't prevent quit any more."));
@@ -128,10 +130,25 @@ void Instance::createCall(not_null<UserData*> user, Call::Type type) {
 		_currentCall = std::move(call);
 	}
 	_currentCallChanged.notify(_currentCall.get(), true);
+	performanceModeChanged();
 	refreshServerConfig();
 	refreshDhConfig();
 }
 
+void Instance::performanceModeChanged() {
+	auto enabled = performanceMode();
+	if (anim::ReducedFrameRate() == enabled) {
+		return;
+	}
+	anim::SetReducedFrameRate(enabled);
+	if (enabled) {
+		App::stopGifItems();
+	} else if (auto main = App::main()) {
+		// Repaint to start the automatic downloads skipped during the call.
+		main->update();
+	}
+}
+
 void Instance::refreshDhConfig() {
 	Expects(_currentCall != nullptr);
 	request(MTPmessages_GetDhConfig(MTP_int(_dhConfig.version), MTP_int(Call::kRandomPowerSize))).done([this, call = base::make_weak_unique(_currentCall)](const MTPmessages_DhConfig &result) {
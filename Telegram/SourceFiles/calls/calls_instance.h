@@ -51,6 +51,13 @@ public:
 
 	bool isQuitPrevent();
 
+	// While a call is active the UI does less work: animations are
+	// stepped less often, GIFs don't autoplay and media is not downloaded
+	// automatically, so that the audio processing has enough CPU time.
+	bool performanceMode() const {
+		return (_currentCall != nullptr);
+	}
+
 	~Instance();
 
 private:
@@ -68,6 +75,7 @@ private:
 	void createCall(not_null<UserData*> user, Call::Type type);
 	void destroyCall(not_null<Call*> call);
 	void destroyCurrentPanel();
+	void performanceModeChanged();
 
 	void refreshDhConfig();
 	void refreshServerConfig();
@@ -285,6 +285,7 @@ void Panel::hideDeactivated() {
 }
 
 void Panel::initControls() {
+	subscribe(Global::RefEmojiLargeLoaded(), [this] { update(); });
 	_hangupShown = (_call->type() == Type::Outgoing);
 	_mute->setClickedCallback([this] {
 		if (_call) {
@@ -321,6 +321,10 @@ EmojiListWidget::EmojiListWidget(QWidget *parent, not_null<Window::Controller*>
 	connect(&_showPickerTimer, SIGNAL(timeout()), this, SLOT(onShowPicker()));
 	connect(_picker, SIGNAL(emojiSelected(EmojiPtr)), this, SLOT(onColorSelected(EmojiPtr)));
 	connect(_picker, SIGNAL(hidden()), this, SLOT(onPickerHidden()));
+	subscribe(Global::RefEmojiLargeLoaded(), [this] {
+		update();
+		_picker->update();
+	});
 }
 
 void EmojiListWidget::setVisibleTopBottom(int visibleTop, int visibleBottom) {
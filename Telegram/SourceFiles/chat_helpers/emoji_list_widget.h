@@ -84,7 +84,7 @@ private:
 
 };
 
-class EmojiListWidget : public TabbedSelector::Inner {
+class EmojiListWidget : public TabbedSelector::Inner, private base::Subscriber {
 	Q_OBJECT
 
 public:
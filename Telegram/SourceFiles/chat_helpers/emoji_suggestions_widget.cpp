@@ -83,6 +83,7 @@ SuggestionsWidget::SuggestionsWidget(QWidget *parent, const style::Menu &st) : T
 , _st(&st)
 , _rowHeight(_st->itemPadding.top() + _st->itemFont->height + _st->itemPadding.bottom()) {
 	setMouseTracking(true);
+	subscribe(Global::RefEmojiLargeLoaded(), [this] { update(); });
 }
 
 void SuggestionsWidget::showWithQuery(const QString &query) {
@@ -29,7 +29,7 @@ class FlatTextarea;
 
 namespace Emoji {
 
-class SuggestionsWidget : public TWidget {
+class SuggestionsWidget : public TWidget, private base::Subscriber {
 public:
 	SuggestionsWidget(QWidget *parent, const style::Menu &st);
 
@@ -130,6 +130,9 @@ bool FieldAutocomplete::clearFilteredBotCommands() {
 }
 
 namespace {
+
+constexpr auto kMentionCandidatesTimeout = TimeMs(10000);
+
 template <typename T, typename U>
 inline int indexOfInFirstN(const T &v, const U &elem, int last) {
 	for (auto b = v.cbegin(), i = b, e = b + qMax(v.size(), last); i != e; ++i) {
@@ -139,6 +142,121 @@ inline int indexOfInFirstN(const T &v, const U &elem, int last) {
 	}
 	return -1;
 }
+
+bool MatchesByUsername(not_null<UserData*> user, const QString &filter) {
+	return user->username.startsWith(filter, Qt::CaseInsensitive);
+}
+
+bool MatchesByName(not_null<UserData*> user, const QString &filter) {
+	for_const (auto &namePart, user->names) {
+		if (namePart.startsWith(filter, Qt::CaseInsensitive)) {
+			return true;
+		}
+	}
+	return MatchesByUsername(user, filter);
+}
+
+} // namespace
+
+bool FieldAutocomplete::MentionsSource::operator==(
+		const MentionsSource &other) const {
+	return (peer == other.peer)
+		&& (addInlineBots == other.addInlineBots)
+		&& (inlineBots == other.inlineBots)
+		&& (participants == other.participants)
+		&& (lastAuthors == other.lastAuthors)
+		&& (lastParticipants == other.lastParticipants);
+}
+
+FieldAutocomplete::MentionsSource FieldAutocomplete::mentionsSource() const {
+	auto result = MentionsSource();
+	result.addInlineBots = _addInlineBots;
+	if (_addInlineBots) {
+		result.inlineBots = cRecentInlineBots().size();
+	}
+	if (_chat) {
+		result.peer = _chat;
+		result.participants = _chat->noParticipantInfo()
+			? -1
+			: _chat->participants.size();
+		result.lastAuthors = _chat->lastAuthors.size();
+	} else if (_channel && _channel->isMegagroup()) {
+		result.peer = _channel;
+		result.lastParticipants = _channel->lastParticipantsCountOutdated()
+			? -1
+			: _channel->mgInfo->lastParticipants.size();
+	}
+	return result;
+}
+
+void FieldAutocomplete::fillMentionCandidates(int32 now) {
+	auto &result = _mentionCandidates;
+	result.clear();
+	_mentionCandidatesFilter = _filter;
+	_mentionCandidatesInlineBots = 0;
+
+	int maxListSize = _addInlineBots ? cRecentInlineBots().size() : 0;
+	if (_chat) {
+		maxListSize += (_chat->participants.isEmpty() ? _chat->lastAuthors.size() : _chat->participants.size());
+	} else if (_channel && _channel->isMegagroup()) {
+		if (_channel->mgInfo->lastParticipants.isEmpty() || _channel->lastParticipantsCountOutdated()) {
+		} else {
+			maxListSize += _channel->mgInfo->lastParticipants.size();
+		}
+	}
+	if (maxListSize) {
+		result.reserve(maxListSize);
+	}
+
+	auto &recentInlineBots = _mentionCandidatesInlineBots;
+	if (_addInlineBots) {
+		for_const (auto user, cRecentInlineBots()) {
+			if (user->isInaccessible()) continue;
+			if (!MatchesByUsername(user, _filter)) continue;
+			result.push_back(user);
+			++recentInlineBots;
+		}
+	}
+	if (_chat) {
+		QMultiMap<int32, UserData*> ordered;
+		if (_chat->noParticipantInfo()) {
+			Auth().api().requestFullPeer(_chat);
+		} else if (!_chat->participants.isEmpty()) {
+			for (auto i = _chat->participants.cbegin(), e = _chat->participants.cend(); i != e; ++i) {
+				auto user = i.key();
+				if (user->isInaccessible()) continue;
+				if (!MatchesByName(user, _filter)) continue;
+				if (indexOfInFirstN(result, user, recentInlineBots) >= 0) continue;
+				ordered.insertMulti(App::onlineForSort(user, now), user);
+			}
+		}
+		for_const (auto user, _chat->lastAuthors) {
+			if (user->isInaccessible()) continue;
+			if (!MatchesByName(user, _filter)) continue;
+			if (indexOfInFirstN(result, user, recentInlineBots) >= 0) continue;
+			result.push_back(user);
+			if (!ordered.isEmpty()) {
+				ordered.remove(App::onlineForSort(user, now), user);
+			}
+		}
+		if (!ordered.isEmpty()) {
+			for (auto i = ordered.cend(), b = ordered.cbegin(); i != b;) {
+				--i;
+				result.push_back(i.value());
+			}
+		}
+	} else if (_channel && _channel->isMegagroup()) {
+		if (_channel->mgInfo->lastParticipants.isEmpty() || _channel->lastParticipantsCountOutdated()) {
+			Auth().api().requestLastParticipants(_channel);
+		} else {
+			for_const (auto user, _channel->mgInfo->lastParticipants) {
+				if (user->isInaccessible()) continue;
+				if (!MatchesByName(user, _filter)) continue;
+				if (indexOfInFirstN(result, user, recentInlineBots) >= 0) continue;
+				result.push_back(user);
+			}
+		}
+	}
 }
 
 void FieldAutocomplete::updateFiltered(bool resetScroll) {
@@ -150,86 +268,46 @@ void FieldAutocomplete::updateFiltered(bool resetScroll) {
 	if (_emoji) {
 		srows = Stickers::GetListByEmoji(_emoji);
 	} else if (_type == Type::Mentions) {
-		int maxListSize = _addInlineBots ? cRecentInlineBots().size() : 0;
-		if (_chat) {
-			maxListSize += (_chat->participants.isEmpty() ? _chat->lastAuthors.size() : _chat->participants.size());
-		} else if (_channel && _channel->isMegagroup()) {
-			if (_channel->mgInfo->lastParticipants.isEmpty() || _channel->lastParticipantsCountOutdated()) {
-			} else {
-				maxListSize += _channel->mgInfo->lastParticipants.size();
-			}
-		}
-		if (maxListSize) {
-			mrows.reserve(maxListSize);
-		}
-
-		auto filterNotPassedByUsername = [this](UserData *user) -> bool {
-			if (user->username.startsWith(_filter, Qt::CaseInsensitive)) {
-				bool exactUsername = (user->username.size() == _filter.size());
-				return exactUsername;
-			}
-			return true;
-		};
-		auto filterNotPassedByName = [this, &filterNotPassedByUsername](UserData *user) -> bool {
-			for_const (auto &namePart, user->names) {
-				if (namePart.startsWith(_filter, Qt::CaseInsensitive)) {
-					bool exactUsername = (user->username.compare(_filter, Qt::CaseInsensitive) == 0);
-					return exactUsername;
+		const auto ms = getms();
+		const auto source = mentionsSource();
+		const auto narrow = (source == _mentionCandidatesSource)
+			&& (ms < _mentionCandidatesTime + kMentionCandidatesTimeout)
+			&& _filter.startsWith(_mentionCandidatesFilter, Qt::CaseInsensitive);
+		if (!narrow) {
+			_mentionCandidatesSource = source;
+			fillMentionCandidates(now);
+		} else if (_filter.size() != _mentionCandidatesFilter.size()) {
+			auto bots = 0;
+			auto candidates = internal::MentionRows();
+			candidates.reserve(_mentionCandidates.size());
+			for (auto i = 0, count = _mentionCandidates.size(); i != count; ++i) {
+				const auto user = _mentionCandidates[i];
+				if (i < _mentionCandidatesInlineBots) {
+					if (!MatchesByUsername(user, _filter)) continue;
+					++bots;
+				} else if (!MatchesByName(user, _filter)) {
+					continue;
 				}
+				candidates.push_back(user);
 			}
-			return filterNotPassedByUsername(user);
-		};
-
-		bool listAllSuggestions = _filter.isEmpty();
-		if (_addInlineBots) {
-			for_const (auto user, cRecentInlineBots()) {
-				if (user->isInaccessible()) continue;
-				if (!listAllSuggestions && filterNotPassedByUsername(user)) continue;
-				mrows.push_back(user);
-				++recentInlineBots;
-			}
+			_mentionCandidates = std::move(candidates);
+			_mentionCandidatesInlineBots = bots;
+			_mentionCandidatesFilter = _filter;
 		}
-		if (_chat) {
-			QMultiMap<int32, UserData*> ordered;
-			mrows.reserve(mrows.size() + (_chat->participants.isEmpty() ? _chat->lastAuthors.size() : _chat->participants.size()));
-			if (_chat->noParticipantInfo()) {
-				Auth().api().requestFullPeer(_chat);
-			} else if (!_chat->participants.isEmpty()) {
-				for (auto i = _chat->participants.cbegin(), e = _chat->participants.cend(); i != e; ++i) {
-					auto user = i.key();
-					if (user->isInaccessible()) continue;
-					if (!listAllSuggestions && filterNotPassedByName(user)) continue;
-					if (indexOfInFirstN(mrows, user, recentInlineBots) >= 0) continue;
-					ordered.insertMulti(App::onlineForSort(user, now), user);
-				}
-			}
-			for_const (auto user, _chat->lastAuthors) {
-				if (user->isInaccessible()) continue;
-				if (!listAllSuggestions && filterNotPassedByName(user)) continue;
-				if (indexOfInFirstN(mrows, user, recentInlineBots) >= 0) continue;
-				mrows.push_back(user);
-				if (!ordered.isEmpty()) {
-					ordered.remove(App::onlineForSort(user, now), user);
-				}
-			}
-			if (!ordered.isEmpty()) {
-				for (auto i = ordered.cend(), b = ordered.cbegin(); i != b;) {
-					--i;
-					mrows.push_back(i.value());
-				}
+		_mentionCandidatesTime = ms;
+
+		// Don't suggest the username that is already typed in full.
+		const auto listAllSuggestions = _filter.isEmpty();
+		mrows.reserve(_mentionCandidates.size());
+		for (auto i = 0, count = _mentionCandidates.size(); i != count; ++i) {
+			const auto user = _mentionCandidates[i];
+			if (!listAllSuggestions
+				&& !user->username.compare(_filter, Qt::CaseInsensitive)) {
+				continue;
 			}
-		} else if (_channel && _channel->isMegagroup()) {
-			QMultiMap<int32, UserData*> ordered;
-			if (_channel->mgInfo->lastParticipants.isEmpty() || _channel->lastParticipantsCountOutdated()) {
-				Auth().api().requestLastParticipants(_channel);
-			} else {
-				mrows.reserve(mrows.size() + _channel->mgInfo->lastParticipants.size());
-				for_const (auto user, _channel->mgInfo->lastParticipants) {
-					if (user->isInaccessible()) continue;
-					if (!listAllSuggestions && filterNotPassedByName(user)) continue;
-					if (indexOfInFirstN(mrows, user, recentInlineBots) >= 0) continue;
-					mrows.push_back(user);
-				}
+			mrows.push_back(user);
+			if (i < _mentionCandidatesInlineBots) {
+				++recentInlineBots;
 			}
 		}
 	} else if (_type == Type::Hashtags) {
@@ -599,7 +677,7 @@ void FieldAutocompleteInner::paintEvent(QPaintEvent *e) {
 				UserData *user = _mrows->at(i);
 				QString first = (!filterIsEmpty && user->username.startsWith(filter, Qt::CaseInsensitive)) ? ('@' + user->username.mid(0, filterSize)) : QString();
 				QString second = first.isEmpty() ? (user->username.isEmpty() ? QString() : ('@' + user->username)) : user->username.mid(filterSize);
-				int32 firstwidth = st::mentionFont->width(first), secondwidth = st::mentionFont->width(second), unamewidth = firstwidth + secondwidth, namewidth = user->nameText.maxWidth();
+				int32 firstwidth = st::mentionFont->width(first), secondwidth = st::mentionFont->width(second), unamewidth = firstwidth + secondwidth, namewidth = user->nameText().maxWidth();
 				if (mentionwidth < unamewidth + namewidth) {
 					namewidth = (mentionwidth * namewidth) / (namewidth + unamewidth);
 					unamewidth = mentionwidth - namewidth;
@@ -618,7 +696,7 @@ void FieldAutocompleteInner::paintEvent(QPaintEvent *e) {
 				user->paintUserpicLeft(p, st::mentionPadding.left(), i * st::mentionHeight + st::mentionPadding.top(), width(), st::mentionPhotoSize);
 
 				p.setPen(selected ? st::mentionNameFgOver : st::mentionNameFg);
-				user->nameText.drawElided(p, 2 * st::mentionPadding.left() + st::mentionPhotoSize, i * st::mentionHeight + st::mentionTop, namewidth);
+				user->nameText().drawElided(p, 2 * st::mentionPadding.left() + st::mentionPhotoSize, i * st::mentionHeight + st::mentionTop, namewidth);
 
 				p.setFont(st::mentionFont);
 				p.setPen(selected ? st::mentionFgOverActive : st::mentionFgActive);
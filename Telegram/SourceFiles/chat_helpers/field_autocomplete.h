@@ -100,6 +100,28 @@ private:
 	void updateFiltered(bool resetScroll = false);
 	void recount(bool resetScroll = false);
 
+	struct MentionsSource {
+		PeerData *peer = nullptr;
+		bool addInlineBots = false;
+		int inlineBots = 0;
+		int participants = 0;
+		int lastAuthors = 0;
+		int lastParticipants = 0;
+
+		bool operator==(const MentionsSource &other) const;
+	};
+	MentionsSource mentionsSource() const;
+	void fillMentionCandidates(int32 now);
+
+	// Users matching _mentionCandidatesFilter by username or name
+	// prefix in the display order. A longer filter typed over the same
+	// source only narrows this list instead of scanning participants.
+	internal::MentionRows _mentionCandidates;
+	QString _mentionCandidatesFilter;
+	MentionsSource _mentionCandidatesSource;
+	int _mentionCandidatesInlineBots = 0;
+	TimeMs _mentionCandidatesTime = 0;
+
 	QPixmap _cache;
 	internal::MentionRows _mrows;
 	internal::HashtagRows _hrows;
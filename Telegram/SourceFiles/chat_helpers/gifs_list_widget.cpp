@@ -161,10 +161,29 @@ void GifsListWidget::setVisibleTopBottom(int visibleTop, int visibleBottom) {
 	Inner::setVisibleTopBottom(visibleTop, visibleBottom);
 	if (top != getVisibleTop()) {
 		_lastScrolled = getms();
+		unloadFarItems();
 	}
 	checkLoadMore();
 }
 
+void GifsListWidget::unloadFarItems() {
+	// Clips further than a screen from the visible area are stopped,
+	// so the playing clips count doesn't grow with the saved gifs count.
+	auto visibleHeight = getVisibleBottom() - getVisibleTop();
+	auto keepTop = getVisibleTop() - visibleHeight;
+	auto keepBottom = getVisibleBottom() + visibleHeight;
+	auto top = st::stickerPanPadding;
+	for (auto &row : _rows) {
+		auto bottom = top + row.height;
+		if (bottom <= keepTop || top >= keepBottom) {
+			for (auto item : row.items) {
+				item->unloadHeavyPart();
+			}
+		}
+		top = bottom;
+	}
+}
+
 void GifsListWidget::checkLoadMore() {
 	auto visibleHeight = (getVisibleBottom() - getVisibleTop());
 	if (getVisibleBottom() + visibleHeight > height()) {
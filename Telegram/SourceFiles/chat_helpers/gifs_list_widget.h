@@ -116,6 +116,7 @@ private:
 	void refreshSavedGifs();
 	int refreshInlineRows(const InlineCacheEntry *results, bool resultsDeleted);
 	void checkLoadMore();
+	void unloadFarItems();
 
 	int32 showInlineRows(bool newResults);
 	bool refreshInlineRows(int32 *added = 0);
@@ -395,8 +395,9 @@ void SetsReceived(const QVector<MTPStickerSet> &data, int32 hash) {
 	Local::writeInstalledStickers();
 	if (writeRecent) Local::writeUserSettings();
 
-	if (Local::countStickersHash() != hash) {
-		LOG(("API Error: received stickers hash %1 while counted hash is %2").arg(hash).arg(Local::countStickersHash()));
+	auto counted = Local::countStickersHash();
+	if (counted != hash) {
+		LOG(("API Error: received stickers hash %1 while counted hash is %2").arg(hash).arg(counted));
 	}
 
 	Auth().data().stickersUpdated().notify(true);
@@ -486,14 +487,16 @@ void SpecialSetReceived(uint64 setId, const QString &setTitle, const QVector<MTP
 
 	switch (setId) {
 	case CloudRecentSetId: {
-		if (Local::countRecentStickersHash() != hash) {
-			LOG(("API Error: received recent stickers hash %1 while counted hash is %2").arg(hash).arg(Local::countRecentStickersHash()));
+		auto counted = Local::countRecentStickersHash();
+		if (counted != hash) {
+			LOG(("API Error: received recent stickers hash %1 while counted hash is %2").arg(hash).arg(counted));
 		}
 		Local::writeRecentStickers();
 	} break;
 	case FavedSetId: {
-		if (Local::countFavedStickersHash() != hash) {
-			LOG(("API Error: received faved stickers hash %1 while counted hash is %2").arg(hash).arg(Local::countFavedStickersHash()));
+		auto counted = Local::countFavedStickersHash();
+		if (counted != hash) {
+			LOG(("API Error: received faved stickers hash %1 while counted hash is %2").arg(hash).arg(counted));
 		}
 		Local::writeFavedStickers();
 	} break;
@@ -589,8 +592,9 @@ void FeaturedSetsReceived(const QVector<MTPStickerSetCovered> &data, const QVect
 		Global::RefFeaturedStickerSetsUnreadCountChanged().notify();
 	}
 
-	if (Local::countFeaturedStickersHash() != hash) {
-		LOG(("API Error: received featured stickers hash %1 while counted hash is %2").arg(hash).arg(Local::countFeaturedStickersHash()));
+	auto counted = Local::countFeaturedStickersHash();
+	if (counted != hash) {
+		LOG(("API Error: received featured stickers hash %1 while counted hash is %2").arg(hash).arg(counted));
 	}
 
 	if (!setsToRequest.isEmpty()) {
@@ -620,8 +624,9 @@ void GifsReceived(const QVector<MTPDocument> &items, int32 hash) {
 
 		saved.push_back(document);
 	}
-	if (Local::countSavedGifsHash() != hash) {
-		LOG(("API Error: received saved gifs hash %1 while counted hash is %2").arg(hash).arg(Local::countSavedGifsHash()));
+	auto counted = Local::countSavedGifsHash();
+	if (counted != hash) {
+		LOG(("API Error: received saved gifs hash %1 while counted hash is %2").arg(hash).arg(counted));
 	}
 
 	Local::writeSavedGifs();
@@ -43,6 +43,11 @@ namespace {
 constexpr auto kStickersPanelPerRow = Stickers::kPanelPerRow;
 constexpr auto kInlineItemsMaxPerRow = 5;
 
+// When more sticker images are decoded by the panel the ones that are
+// further than a screen from the visible area are forgotten, because
+// each one takes up to 1 MB of memory and is easily restored from bytes.
+constexpr auto kDecodedStickersLimit = 64;
+
 } // namespace
 
 struct StickerIcon {
@@ -474,6 +479,9 @@ void StickersListWidget::setVisibleTopBottom(int visibleTop, int visibleBottom)
 	if (_section == Section::Featured) {
 		readVisibleSets();
 	}
+	if (_decodedStickers.size() > kDecodedStickersLimit) {
+		unloadFarStickers();
+	}
 	validateSelectedIcon(ValidateIconAnimations::Full);
 }
 
@@ -504,6 +512,49 @@ void StickersListWidget::readVisibleSets() {
 	}
 }
 
+void StickersListWidget::unloadFarStickers() {
+	auto screen = getVisibleBottom() - getVisibleTop();
+	auto keepTop = getVisibleTop() - screen;
+	auto keepBottom = getVisibleBottom() + screen;
+	auto keep = base::flat_set<not_null<DocumentData*>>();
+	auto keepPack = [&keep](const StickerPack &pack, int count) {
+		for (auto i = 0; i != count; ++i) {
+			keep.insert(pack[i]);
+		}
+	};
+	if (_section == Section::Featured) {
+		auto rowHeight = featuredRowHeight();
+		auto rowFrom = floorclamp(keepTop, rowHeight, 0, _featuredSets.size());
+		auto rowTo = ceilclamp(keepBottom, rowHeight, 0, _featuredSets.size());
+		for (auto i = rowFrom; i < rowTo; ++i) {
+			auto &pack = _featuredSets[i].pack;
+			keepPack(pack, qMin(pack.size(), static_cast<int>(kStickersPanelPerRow)));
+		}
+	} else {
+		enumerateSections([this, keepTop, keepBottom, &keepPack](const SectionInfo &info) {
+			if (info.rowsBottom <= keepTop) {
+				return true;
+			} else if (info.top >= keepBottom) {
+				return false;
+			}
+			auto &pack = _mySets[info.section].pack;
+			keepPack(pack, pack.size());
+			return true;
+		});
+	}
+	for (auto i = _decodedStickers.begin(); i != _decodedStickers.end();) {
+		auto sticker = *i;
+		if (keep.contains(sticker)) {
+			++i;
+			continue;
+		}
+		if (auto data = sticker->sticker()) {
+			data->img->forget();
+		}
+		i = _decodedStickers.erase(i);
+	}
+}
+
 int StickersListWidget::featuredRowHeight() const {
 	return st::stickersTrendingHeader + st::stickerPanSize.height() + st::stickersTrendingSkip;
 }
@@ -599,7 +650,7 @@ QRect StickersListWidget::stickerRect(int section, int sel) {
 	if (_section == Section::Featured) {
 		x = stickersLeft() + (sel * st::stickerPanSize.width());
 		y = st::stickerPanPadding + (section * featuredRowHeight()) + st::stickersTrendingHeader;
-	} else if (_section == Section::Stickers) {
+	} else {
 		auto info = sectionInfo(section);
 		if (sel >= _mySets[section].pack.size()) {
 			sel -= _mySets[section].pack.size();
@@ -836,6 +887,7 @@ void StickersListWidget::paintSticker(Painter &p, Set &set, int y, int index, bo
 		p.drawPixmapLeft(ppos, width(), sticker->thumb->pix(w, h));
 	} else if (!sticker->sticker()->img->isNull()) {
 		p.drawPixmapLeft(ppos, width(), sticker->sticker()->img->pix(w, h));
+		_decodedStickers.insert(sticker);
 	}
 
 	if (selected && stickerHasDeleteButton(set, index)) {
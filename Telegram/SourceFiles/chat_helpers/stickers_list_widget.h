@@ -184,6 +184,7 @@ private:
 	}
 	int featuredRowHeight() const;
 	void readVisibleSets();
+	void unloadFarStickers();
 
 	void paintFeaturedStickers(Painter &p, QRect clip);
 	void paintStickers(Painter &p, QRect clip);
@@ -220,6 +221,9 @@ private:
 	QList<bool> _custom;
 	base::flat_set<not_null<DocumentData*>> _favedStickersMap;
 
+	// Stickers with full images decoded for painting in the panel.
+	base::flat_set<not_null<DocumentData*>> _decodedStickers;
+
 	Section _section = Section::Stickers;
 
 	uint64 _displayingSetId = 0;
@@ -27,6 +27,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include <QtGui/QImage>
 #include <QtGui/QPainter>
 #include <QtCore/QDir>
+#include <array>
 
 #ifdef SUPPORT_IMAGE_GENERATION
 Q_IMPORT_PLUGIN(QWebpPlugin)
@@ -602,10 +603,14 @@ EmojiPack GetSection(Section section) {\n\
 }
 
 bool Generator::writeFindReplace() {
+	writeFirstCharsCheck(data_.replaces, "IsReplaceFirstChar");
 	source_->stream() << "\
 \n\
 int FindReplaceIndex(const QChar *start, const QChar *end, int *outLength) {\n\
 	auto ch = start;\n\
+	if (ch == end || !IsReplaceFirstChar(ch->unicode())) {\n\
+		return 0;\n\
+	}\n\
 \n";
 
 	if (!writeFindFromDictionary(data_.replaces)) {
@@ -619,10 +624,14 @@ int FindReplaceIndex(const QChar *start, const QChar *end, int *outLength) {\n\
 }
 
 bool Generator::writeFind() {
+	writeFirstCharsCheck(data_.map, "IsFindFirstChar");
 	source_->stream() << "\
 \n\
 int FindIndex(const QChar *start, const QChar *end, int *outLength) {\n\
 	auto ch = start;\n\
+	if (ch == end || !IsFindFirstChar(ch->unicode())) {\n\
+		return 0;\n\
+	}\n\
 \n";
 
 	if (!writeFindFromDictionary(data_.map, true)) {
@@ -636,6 +645,47 @@ int FindIndex(const QChar *start, const QChar *end, int *outLength) {\n\
 	return true;
 }
 
+// Most of the text doesn't start any emoji, so before walking the
+// generated switch we check the first char in a two level bit table:
+// one byte per high byte of the code and 256 bits per used high byte.
+void Generator::writeFirstCharsCheck(const std::map<QString, int, std::greater<QString>> &dictionary, const QString &name) {
+	auto blocks = std::map<int, std::array<uint32, 8>>();
+	for (auto &item : dictionary) {
+		auto ch = item.first[0].unicode();
+		auto &bits = blocks[ch >> 8];
+		bits[(ch & 0xFF) >> 5] |= (1U << (ch & 0x1F));
+	}
+
+	auto blockIndices = std::array<int, 256>();
+	blockIndices.fill(0);
+	source_->stream() << "\
+\n\
+const uint32 " << name << "Bits[][8] = {\n";
+	auto index = 0;
+	for (auto &block : blocks) {
+		blockIndices[block.first] = ++index;
+		source_->stream() << "\t{ ";
+		for (auto bits : block.second) {
+			source_->stream() << "0x" << QString::number(bits, 16) << "U, ";
+		}
+		source_->stream() << "},\n";
+	}
+	source_->stream() << "\
+};\n\
+\n\
+const uchar " << name << "Blocks[256] = {";
+	for (auto i = 0; i != 256; ++i) {
+		source_->stream() << ((i % 32) ? " " : "\n\t") << blockIndices[i] << ",";
+	}
+	source_->stream() << "\n\
+};\n\
+\n\
+inline bool " << name << "(ushort code) {\n\
+	auto block = " << name << "Blocks[code >> 8];\n\
+	return block && (" << name << "Bits[block - 1][(code & 0xFF) >> 5] & (1U << (code & 0x1F)));\n\
+}\n";
+}
+
 bool Generator::writeFindFromDictionary(const std::map<QString, int, std::greater<QString>> &dictionary, bool skipPostfixes) {
 	auto tabs = [](int size) {
 		return QString(size, '\t');
@@ -797,6 +847,7 @@ constexpr auto kReplacementMaxLength = " << maxLength << ";\n\
 \n\
 void InitReplacements();\n\
 const std::vector<const Replacement*> *GetReplacements(utf16char first);\n\
+const std::vector<const Replacement*> *GetReplacements(utf16char first, utf16char second);\n\
 utf16string GetReplacementEmoji(utf16string replacement);\n\
 \n";
 	return header->finalize();
@@ -804,6 +855,11 @@ utf16string GetReplacementEmoji(utf16string replacement);\n\
 
 bool Generator::writeReplacements() {
 	QMap<QChar, QVector<int>> byCharIndices;
+
+	// Any match of a query starting with "ab" takes "ab" from one word
+	// or "a" and "b" from the starts of two different words, so this
+	// index is a superset of the results for every longer query.
+	QMap<QPair<QChar, QChar>, QVector<int>> byPairIndices;
 	suggestionsSource_->stream() << "\
 struct ReplacementStruct {\n\
 	small emojiSize;\n\
@@ -830,6 +886,21 @@ const utf16char ReplacementData[] = {";
 				index.push_back(i);
 			}
 		}
+		auto pairs = QSet<QPair<QChar, QChar>>();
+		for (auto j = 0, count = replace.words.size(); j != count; ++j) {
+			auto &word = replace.words[j];
+			if (word.size() > 1) {
+				pairs.insert(qMakePair(word[0], word[1]));
+			}
+			for (auto k = 0; k != count; ++k) {
+				if (k != j) {
+					pairs.insert(qMakePair(word[0], replace.words[k][0]));
+				}
+			}
+		}
+		for (auto &pair : pairs) {
+			byPairIndices[pair].push_back(i);
+		}
 	}
 	suggestionsSource_->stream() << " };\n\
 \n\
@@ -864,6 +935,21 @@ struct ReplacementIndexStruct {\n\
 	medium count;\n\
 };\n\
 \n\
+const medium ReplacementPairIndices[] = {";
+	startBinary();
+	for (auto &byPairIndex : byPairIndices) {
+		for (auto index : byPairIndex) {
+			writeIntBinary(suggestionsSource_.get(), index);
+		}
+	}
+	suggestionsSource_->stream() << " };\n\
+\n\
+struct ReplacementPairIndexStruct {\n\
+	utf16char first;\n\
+	utf16char second;\n\
+	medium count;\n\
+};\n\
+\n\
 const internal::checksum ReplacementChecksums[] = {\n";
 	startBinary();
 	for (auto &replace : replaces_.list) {
@@ -879,8 +965,17 @@ const ReplacementIndexStruct ReplacementIndexData[] = {\n";
 	}
 	suggestionsSource_->stream() << "};\n\
 \n\
+const ReplacementPairIndexStruct ReplacementPairIndexData[] = {\n";
+	startBinary();
+	for (auto i = byPairIndices.cbegin(), e = byPairIndices.cend(); i != e; ++i) {
+		suggestionsSource_->stream() << "\
+	{ utf16char(" << i.key().first.unicode() << "), utf16char(" << i.key().second.unicode() << "), medium(" << i.value().size() << ") },\n";
+	}
+	suggestionsSource_->stream() << "};\n\
+\n\
 std::vector<Replacement> Replacements;\n\
 std::map<utf16char, std::vector<const Replacement*>> ReplacementsMap;\n\
+std::map<std::pair<utf16char, utf16char>, std::vector<const Replacement*>> ReplacementsPairMap;\n\
 std::map<internal::checksum, const Replacement*> ReplacementsHash;\n\
 \n";
 	return true;
@@ -922,6 +1017,16 @@ void InitReplacements() {\n\
 		}\n\
 		ReplacementsMap.emplace(item.ch, std::move(index));\n\
 	}\n\
+\n\
+	auto pairIndices = ReplacementPairIndices;\n\
+	for (auto item : ReplacementPairIndexData) {\n\
+		auto index = std::vector<const Replacement*>();\n\
+		index.reserve(item.count);\n\
+		for (auto i = 0; i != item.count; ++i) {\n\
+			index.push_back(items + (*pairIndices++));\n\
+		}\n\
+		ReplacementsPairMap.emplace(std::make_pair(item.first, item.second), std::move(index));\n\
+	}\n\
 \n\
 	for (auto checksum : ReplacementChecksums) {\n\
 		ReplacementsHash.emplace(checksum, items++);\n\
@@ -936,6 +1041,14 @@ const std::vector<const Replacement*> *GetReplacements(utf16char first) {\n\
 	return (it == ReplacementsMap.cend()) ? nullptr : &it->second;\n\
 }\n\
 \n\
+const std::vector<const Replacement*> *GetReplacements(utf16char first, utf16char second) {\n\
+	if (ReplacementsPairMap.empty()) {\n\
+		InitReplacements();\n\
+	}\n\
+	auto it = ReplacementsPairMap.find(std::make_pair(first, second));\n\
+	return (it == ReplacementsPairMap.cend()) ? nullptr : &it->second;\n\
+}\n\
+\n\
 utf16string GetReplacementEmoji(utf16string replacement) {\n\
 	auto code = internal::countChecksum(replacement.data(), replacement.size() * sizeof(utf16char));\n\
 	auto it = ReplacementsHash.find(code);\n\
@@ -62,6 +62,7 @@ private:
 	bool writeFindReplace();
 	bool writeFind();
 	bool writeFindFromDictionary(const std::map<QString, int, std::greater<QString>> &dictionary, bool skipPostfixes = false);
+	void writeFirstCharsCheck(const std::map<QString, int, std::greater<QString>> &dictionary, const QString &name);
 	bool writeGetReplacements();
 	void startBinary();
 	bool writeStringBinary(common::CppFile *source, const QString &string);
@@ -145,6 +145,8 @@ QString lang(LangKey key);\n\
 		auto genericParams = QStringList();
 		auto params = QStringList();
 		auto applyTags = QStringList();
+		auto tagIndices = QStringList();
+		auto tagReplacements = QStringList();
 		auto plural = QString();
 		auto nonPluralTagFound = false;
 		for (auto &tagData : entry.tags) {
@@ -154,11 +156,22 @@ QString lang(LangKey key);\n\
 			params.push_back("lngtag_" + tag + ", " + (isPluralTag ? "float64 " : "const QString &") + tag + "__val");
 			if (isPluralTag) {
 				plural = "\tauto plural = Lang::Plural(" + key + ", " + kPluralTag + "__val);\n";
-				applyTags.push_back("\tresult = Lang::ReplaceTag<ResultString>::Call(std::move(result), lt_" + tag + ", Lang::StartReplacements<ResultString>::Call(std::move(plural.replacement)));\n");
+				plural += "\tauto " + tag + "__replacement = Lang::StartReplacements<ResultString>::Call(std::move(plural.replacement));\n";
+				applyTags.push_back("\tresult = Lang::ReplaceTag<ResultString>::Call(std::move(result), lt_" + tag + ", " + tag + "__replacement);\n");
+				tagReplacements.push_back("&" + tag + "__replacement");
 			} else {
 				nonPluralTagFound = true;
 				applyTags.push_back("\tresult = Lang::ReplaceTag<ResultString>::Call(std::move(result), lt_" + tag + ", " + tag + "__val);\n");
+				tagReplacements.push_back("&" + tag + "__val");
 			}
+			tagIndices.push_back("lt_" + tag);
+		}
+		if (entry.tags.size() > 1) {
+			// Several tags are replaced in one pass over the string.
+			applyTags = QStringList() << ("\
+	const ushort tags[] = { " + tagIndices.join(QString(", ")) + " };\n\
+	const ResultString *replacements[] = { " + tagReplacements.join(QString(", ")) + " };\n\
+	result = Lang::ReplaceTags<ResultString>::Call(std::move(result), tags, replacements);\n");
 		}
 		if (!entry.tags.empty() && (!isPlural || key == ComputePluralKey(entry.keyBase, 0))) {
 			auto initialString = isPlural ? ("std::move(plural.string)") : ("lang(" + getFullKey(entry) + ")");
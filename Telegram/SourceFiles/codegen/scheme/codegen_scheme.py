@@ -706,7 +706,7 @@ for restype in typesList:
       reader += '\t\tcase mtpc_' + name + ': _type = cons; '; # read switch line
       if (len(prms) > len(trivialConditions)):
         reader += '{\n';
-        reader += '\t\t\tauto v = new MTPD' + name + '();\n';
+        reader += '\t\t\tauto v = new (MTP::internal::ReadAllocation()) MTPD' + name + '();\n';
         reader += '\t\t\tsetData(v);\n';
         reader += readText;
         reader += '\t\t} break;\n';
@@ -719,7 +719,7 @@ for restype in typesList:
         reader += 'break;\n';
     else:
       if (len(prms) > len(trivialConditions)):
-        reader += '\n\tauto v = new MTPD' + name + '();\n';
+        reader += '\n\tauto v = new (MTP::internal::ReadAllocation()) MTPD' + name + '();\n';
         reader += '\tsetData(v);\n';
         reader += readText;
 
@@ -1004,6 +1004,9 @@ QByteArray save() {\n\
 }\n\
 \n\
 bool load(const QByteArray &cache) {\n\
+	if (cache == _palette.save()) {\n\
+		return true;\n\
+	}\n\
 	if (_palette.load(cache)) {\n\
 		style::internal::resetIcons();\n\
 		return true;\n\
@@ -1020,8 +1023,11 @@ palette::SetResult setColor(QLatin1String name, QLatin1String from) {\n\
 }\n\
 \n\
 void apply(const palette &other) {\n\
+	auto changed = (other.save() != _palette.save());\n\
 	_palette = other;\n\
-	style::internal::resetIcons();\n\
+	if (changed) {\n\
+		style::internal::resetIcons();\n\
+	}\n\
 }\n\
 \n\
 void reset() {\n\
@@ -1102,6 +1108,10 @@ void init_" << baseName_ << "() {\n\
 		source_->newline();
 	}
 
+	if (!iconMasks_.isEmpty()) {
+		source_->stream() << "\tstyle::internal::registerIconMasks(iconMasksList, " << iconMasks_.size() << ");\n\n";
+	}
+
 	if (isPalette_) {
 		source_->stream() << "\t_palette.finalize();\n";
 	} else if (!module_.enumVariables([this](const Variable &variable) -> bool {
@@ -1265,6 +1275,13 @@ bool Generator::writeIconValues() {
 		source_->stream() << "const uchar iconMask" << i.value() << "Data[] = " << stringToBinaryArray(std::string(maskData.constData(), maskData.size())) << ";\n";
 		source_->stream() << "IconMask iconMask" << i.value() << "(iconMask" << i.value() << "Data);\n\n";
 	}
+
+	// List of all the masks of the module, so that they could be decoded in advance.
+	source_->stream() << "const IconMask *iconMasksList[] = {\n";
+	for (auto i = iconMasks_.cbegin(), e = iconMasks_.cend(); i != e; ++i) {
+		source_->stream() << "\t&iconMask" << i.value() << ",\n";
+	}
+	source_->stream() << "};\n\n";
 	return true;
 }
 
@@ -74,7 +74,6 @@ enum {
 
 	AnimationTimerDelta = 7,
 	ClipThreadsCount = 8,
-	AverageGifSize = 320 * 240,
 	WaitBeforeGifPause = 200, // wait 200ms for gif draw before pausing it
 	RecentInlineBotsLimit = 10,
 
@@ -329,11 +328,6 @@ enum {
 	ForwardOnAdd = 100, // how many messages from chat history server should forward to user, that was added to this chat
 };
 
-inline const QRegularExpression &cRussianLetters() {
-	static QRegularExpression regexp(QString::fromUtf8("[а-яА-ЯёЁ]"));
-	return regexp;
-}
-
 inline const QStringList &cImgExtensions() {
 	static QStringList result;
 	if (result.isEmpty()) {
@@ -0,0 +1,112 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/memory_stats.h"
+
+#include "history/history.h"
+#include "media/media_clip_reader.h"
+#include "base/task_queue.h"
+
+namespace Core {
+namespace MemoryStats {
+namespace internal {
+
+Counter Counters[static_cast<int>(Category::Count)];
+
+} // namespace internal
+namespace {
+
+internal::Counter &counter(Category category) {
+	return internal::Counters[static_cast<int>(category)];
+}
+
+QString kilobytes(int64 bytes) {
+	return QString::number(bytes / 1024) + qsl(" KB");
+}
+
+// Bucket i counts waits below 2^i ms, the last one counts all the rest.
+QString latencyBuckets(const base::TaskQueue::LatencyBuckets &buckets) {
+	auto result = QStringList();
+	for (auto i = 0; i != base::TaskQueue::kLatencyBucketsCount; ++i) {
+		auto last = (i + 1 == base::TaskQueue::kLatencyBucketsCount);
+		auto limit = (last ? qsl(">=") : qsl("<")) + QString::number(1LL << (last ? (i - 1) : i));
+		result.push_back(limit + qsl(" ms: ") + QString::number(buckets[i]));
+	}
+	return result.join(qsl(", "));
+}
+
+} // namespace
+
+QString Report() {
+	auto lines = QStringList();
+
+	auto images = imageCacheStats();
+	lines.push_back(qsl("Images: %1 decoded, %2").arg(images.images).arg(kilobytes(images.bytes)));
+
+	auto histories = 0, blocks = 0, loaded = 0;
+	for_const (auto history, App::histories().map) {
+		++histories;
+		blocks += history->blocks.size();
+		for_const (auto block, history->blocks) {
+			loaded += block->items.size();
+		}
+	}
+	auto &items = counter(Category::HistoryItems);
+	lines.push_back(qsl("Histories: %1, blocks: %2, loaded items: %3, items alive: %4").arg(histories).arg(blocks).arg(loaded).arg(items.count.load()));
+
+	auto &texts = counter(Category::TextLayouts);
+	lines.push_back(qsl("Text layouts: %1 allocations, %2").arg(texts.count.load()).arg(kilobytes(texts.bytes.load())));
+
+	auto &clips = counter(Category::ClipReaders);
+	lines.push_back(qsl("Clip readers: %1, frames ~%2, frames pool: %3").arg(clips.count.load()).arg(kilobytes(clips.bytes.load())).arg(kilobytes(Media::Clip::FramesPoolSize())));
+	auto threadsLoad = QStringList();
+	for (auto load : Media::Clip::ThreadsLoad()) {
+		threadsLoad.push_back(QString::number(load / 10000., 'f', 1) + '%');
+	}
+	if (!threadsLoad.isEmpty()) {
+		lines.push_back(qsl("Clip threads load: ") + threadsLoad.join(qsl(", ")));
+	}
+
+	auto latency = base::TaskQueue::TasksLatency();
+	lines.push_back(qsl("Normal tasks wait: ") + latencyBuckets(latency.normal));
+	lines.push_back(qsl("Background tasks wait: ") + latencyBuckets(latency.background));
+
+	auto sets = 0, stickers = 0, emoji = 0;
+	for_const (auto &set, Global::StickerSets()) {
+		++sets;
+		stickers += set.stickers.size();
+		emoji += set.emoji.size();
+	}
+	lines.push_back(qsl("Sticker sets: %1, stickers: %2, emoji packs: %3").arg(sets).arg(stickers).arg(emoji));
+
+	auto pool = mtpRequestData::poolStats();
+	lines.push_back(qsl("MTP request buffers: %1 pooled, %2 dropped").arg(kilobytes(pool.pooledBytes)).arg(pool.dropped));
+
+	lines.push_back(App::peersMemoryReport());
+
+	return lines.join('\n');
+}
+
+void LogReport() {
+	LOG(("Memory Stats:\n%1").arg(Report()));
+}
+
+} // namespace MemoryStats
+} // namespace Core
@@ -0,0 +1,96 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <atomic>
+
+namespace Core {
+namespace MemoryStats {
+
+// Live object counts and byte estimates of the heaviest subsystems.
+// Images, sticker sets and mtproto request buffers already keep their
+// own bookkeeping and are read from it when the report is built, the
+// categories below are counted where the objects are created.
+enum class Category {
+	HistoryItems,
+	TextLayouts,
+	ClipReaders,
+
+	Count,
+};
+
+namespace internal {
+
+struct Counter {
+	std::atomic<int64> count = { 0 };
+	std::atomic<int64> bytes = { 0 };
+};
+extern Counter Counters[static_cast<int>(Category::Count)];
+
+} // namespace internal
+
+inline void Add(Category category, int64 count, int64 bytes = 0) {
+	auto &counter = internal::Counters[static_cast<int>(category)];
+	counter.count.fetch_add(count, std::memory_order_relaxed);
+	counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// Counts the storage of std containers, one count per live allocation.
+template <typename Type, Category kCategory>
+class Allocator {
+public:
+	using value_type = Type;
+
+	template <typename Other>
+	struct rebind {
+		using other = Allocator<Other, kCategory>;
+	};
+
+	Allocator() = default;
+	template <typename Other>
+	Allocator(const Allocator<Other, kCategory> &other) {
+	}
+
+	Type *allocate(std::size_t n) {
+		Add(kCategory, 1, int64(n * sizeof(Type)));
+		return std::allocator<Type>().allocate(n);
+	}
+	void deallocate(Type *p, std::size_t n) {
+		Add(kCategory, -1, -int64(n * sizeof(Type)));
+		std::allocator<Type>().deallocate(p, n);
+	}
+
+	template <typename Other>
+	bool operator==(const Allocator<Other, kCategory> &other) const {
+		return true;
+	}
+	template <typename Other>
+	bool operator!=(const Allocator<Other, kCategory> &other) const {
+		return false;
+	}
+
+};
+
+QString Report();
+void LogReport();
+
+} // namespace MemoryStats
+} // namespace Core
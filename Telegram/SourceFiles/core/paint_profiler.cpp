@@ -0,0 +1,288 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/paint_profiler.h"
+
+#include "mainwindow.h"
+#include "base/timer.h"
+
+namespace Core {
+namespace PaintProfiler {
+namespace {
+
+constexpr auto kOverlayUpdateTimeout = TimeMs(1000);
+constexpr auto kOverlayFrameClasses = 6;
+constexpr auto kOverlayTotalClasses = 6;
+
+int64 NowMicroseconds() {
+	using namespace std::chrono;
+	return duration_cast<microseconds>(
+		steady_clock::now().time_since_epoch()).count();
+}
+
+struct ClassStats {
+	int count = 0;
+	int64 total = 0;
+	int64 self = 0;
+	int64 max = 0;
+	int64 area = 0;
+};
+
+class Overlay : public TWidget {
+public:
+	Overlay(QWidget *parent);
+
+	void setLines(QStringList &&lines);
+
+protected:
+	void paintEvent(QPaintEvent *e) override;
+
+private:
+	QStringList _lines;
+
+};
+
+struct Data {
+	Data();
+
+	std::map<const char*, ClassStats> totals;
+	std::map<const char*, int64> frame;
+	std::map<const char*, int64> heaviestFrame;
+	int64 heaviestFrameTime = 0;
+	int64 framesCount = 0;
+	int64 framesTime = 0;
+
+	QThread *mainThread = nullptr;
+	Scope *current = nullptr;
+	object_ptr<Overlay> overlay = { nullptr };
+	base::Timer overlayTimer;
+};
+
+std::unique_ptr<Data> ProfilerData;
+
+Overlay::Overlay(QWidget *parent) : TWidget(parent) {
+	setAttribute(Qt::WA_TransparentForMouseEvents);
+}
+
+void Overlay::setLines(QStringList &&lines) {
+	_lines = std::move(lines);
+	const auto width = [&] {
+		auto result = 0;
+		for (const auto &line : _lines) {
+			accumulate_max(result, st::normalFont->width(line));
+		}
+		return result;
+	}();
+	const auto skip = st::normalFont->height / 2;
+	resize(
+		width + 2 * skip,
+		_lines.size() * st::normalFont->height + 2 * skip);
+	raise();
+	update();
+}
+
+void Overlay::paintEvent(QPaintEvent *e) {
+	Painter p(this);
+	p.fillRect(rect(), QColor(0, 0, 0, 192));
+	p.setFont(st::normalFont);
+	p.setPen(QColor(255, 255, 255));
+	const auto skip = st::normalFont->height / 2;
+	auto top = skip;
+	for (const auto &line : _lines) {
+		p.drawTextLeft(skip, top, width(), line);
+		top += st::normalFont->height;
+	}
+}
+
+QString FormatTime(int64 microseconds) {
+	return QString::number(microseconds / 1000.,  'f', 2) + qsl(" ms");
+}
+
+template <typename Map, typename Value>
+std::vector<std::pair<const char*, int64>> Heaviest(
+		const Map &map,
+		Value value,
+		int limit) {
+	auto result = std::vector<std::pair<const char*, int64>>();
+	result.reserve(map.size());
+	for (const auto &entry : map) {
+		result.emplace_back(entry.first, value(entry.second));
+	}
+	const auto heavier = [](const auto &a, const auto &b) {
+		return (a.second > b.second);
+	};
+	if (int(result.size()) > limit) {
+		std::partial_sort(
+			result.begin(),
+			result.begin() + limit,
+			result.end(),
+			heavier);
+		result.resize(limit);
+	} else {
+		std::sort(result.begin(), result.end(), heavier);
+	}
+	return result;
+}
+
+void UpdateOverlay() {
+	const auto data = ProfilerData.get();
+	if (!data->overlay) {
+		const auto window = App::wnd();
+		if (!window) {
+			return;
+		}
+		data->overlay = object_ptr<Overlay>(window);
+		data->overlay->show();
+	}
+	auto lines = QStringList();
+	lines.push_back(qsl("Heaviest frame: %1"
+		).arg(FormatTime(data->heaviestFrameTime)));
+	const auto frame = Heaviest(
+		data->heaviestFrame,
+		[](int64 self) { return self; },
+		kOverlayFrameClasses);
+	for (const auto &entry : frame) {
+		lines.push_back(qsl("  %1: %2"
+			).arg(entry.first
+			).arg(FormatTime(entry.second)));
+	}
+	lines.push_back(qsl("Total (self): %1 frames"
+		).arg(data->framesCount));
+	const auto totals = Heaviest(
+		data->totals,
+		[](const ClassStats &stats) { return stats.self; },
+		kOverlayTotalClasses);
+	for (const auto &entry : totals) {
+		lines.push_back(qsl("  %1: %2"
+			).arg(entry.first
+			).arg(FormatTime(entry.second)));
+	}
+	data->overlay->setLines(std::move(lines));
+
+	data->heaviestFrame.clear();
+	data->heaviestFrameTime = 0;
+}
+
+Data::Data()
+: mainThread(QThread::currentThread())
+, overlayTimer([] { UpdateOverlay(); }) {
+}
+
+void WriteDump(const Data &data) {
+	const auto path = cWorkingDir() + qsl("paint_profile.txt");
+	QFile f(path);
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return;
+	}
+	QTextStream stream(&f);
+	stream << "frames\t" << data.framesCount
+		<< "\ttotal_us\t" << data.framesTime << "\n";
+	stream << "class\tcount\ttotal_us\tself_us\tmax_us\tarea_px\n";
+	const auto all = Heaviest(
+		data.totals,
+		[](const ClassStats &stats) { return stats.self; },
+		int(data.totals.size()));
+	for (const auto &entry : all) {
+		const auto &stats = data.totals.find(entry.first)->second;
+		stream << entry.first
+			<< '\t' << stats.count
+			<< '\t' << stats.total
+			<< '\t' << stats.self
+			<< '\t' << stats.max
+			<< '\t' << stats.area << '\n';
+	}
+	LOG(("Paint Profiler: written to %1").arg(path));
+}
+
+} // namespace
+
+bool Enabled() {
+	return (ProfilerData != nullptr);
+}
+
+void Toggle() {
+	if (ProfilerData) {
+		WriteDump(*ProfilerData);
+		ProfilerData.reset();
+	} else {
+		ProfilerData = std::make_unique<Data>();
+		ProfilerData->overlayTimer.callEach(kOverlayUpdateTimeout);
+		UpdateOverlay();
+	}
+}
+
+Scope::Scope(QObject *receiver, QEvent *event) {
+	// Events of the other threads' objects are not measured.
+	const auto data = ProfilerData.get();
+	if (!data || QThread::currentThread() != data->mainThread) {
+		return;
+	}
+	const auto type = event->type();
+	if (type == QEvent::UpdateRequest) {
+		// All child paint events of one window are sent while the
+		// window backing store is handling its update request.
+		_frame = true;
+	} else if (type != QEvent::Paint
+		|| (data->overlay && receiver == data->overlay.data())) {
+		return;
+	} else {
+		_className = receiver->metaObject()->className();
+		for (const auto &rect : static_cast<QPaintEvent*>(event)->region().rects()) {
+			_area += int64(rect.width()) * rect.height();
+		}
+	}
+	_parent = base::take(data->current);
+	data->current = this;
+	_started = NowMicroseconds();
+}
+
+Scope::~Scope() {
+	const auto data = ProfilerData.get();
+	if (!_started || !data || data->current != this) {
+		return;
+	}
+	const auto duration = NowMicroseconds() - _started;
+	const auto self = std::max(duration - _childrenTime, int64(0));
+	data->current = _parent;
+	if (_parent) {
+		_parent->_childrenTime += duration;
+	}
+	if (_className) {
+		auto &stats = data->totals[_className];
+		++stats.count;
+		stats.total += duration;
+		stats.self += self;
+		stats.area += _area;
+		accumulate_max(stats.max, duration);
+		data->frame[_className] += self;
+	}
+	if (_frame && !_parent) {
+		++data->framesCount;
+		data->framesTime += duration;
+		if (duration > data->heaviestFrameTime) {
+			data->heaviestFrameTime = duration;
+			data->heaviestFrame = base::take(data->frame);
+		}
+		data->frame.clear();
+	}
+}
+
+} // namespace PaintProfiler
+} // namespace Core
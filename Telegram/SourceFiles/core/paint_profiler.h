@@ -0,0 +1,50 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Core {
+namespace PaintProfiler {
+
+// Opt-in paint timing, toggled by the "toggle_paint_profiler" shortcut.
+// While enabled every QEvent::Paint going through Application::notify()
+// is timed per receiver class and the heaviest widgets of the last
+// frames are shown in an overlay over the main window. Disabling it
+// writes the collected totals to "paint_profile.txt" in the working dir.
+bool Enabled();
+void Toggle();
+
+class Scope {
+public:
+	Scope(QObject *receiver, QEvent *event);
+	~Scope();
+
+private:
+	const char *_className = nullptr;
+	Scope *_parent = nullptr;
+	int64 _started = 0; // microseconds
+	int64 _childrenTime = 0;
+	int64 _area = 0;
+	bool _frame = false;
+
+};
+
+} // namespace PaintProfiler
+} // namespace Core
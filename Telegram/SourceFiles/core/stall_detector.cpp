@@ -0,0 +1,241 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "core/stall_detector.h"
+
+#if defined Q_OS_MAC || defined Q_OS_LINUX32 || defined Q_OS_LINUX64
+#define TDESKTOP_STALL_BACKTRACE
+#include <execinfo.h>
+#include <signal.h>
+#include <pthread.h>
+#endif // Q_OS_MAC || Q_OS_LINUX32 || Q_OS_LINUX64
+
+namespace Core {
+namespace {
+
+constexpr auto kStallThreshold = TimeMs(2000);
+constexpr auto kWatchInterval = TimeMs(250);
+constexpr auto kHeartbeatInterval = 500;
+constexpr auto kStackWaitTimeout = TimeMs(100);
+constexpr auto kStackSignatureFrames = 8;
+constexpr auto kMaxStackFrames = 64;
+
+StallDetector *Instance = nullptr;
+
+#ifdef TDESKTOP_STALL_BACKTRACE
+
+pthread_t MainThread;
+void *StackFrames[kMaxStackFrames] = { nullptr };
+std::atomic<int> StackFramesCount = { -1 };
+struct sigaction PreviousAction;
+
+// Runs on the main thread. backtrace() is not async-signal-safe by the
+// standard: the first call may load libgcc and allocate. It is called
+// once when the handler is installed, so later calls only walk frames.
+void CaptureStackHandler(int signum) {
+	StackFramesCount = backtrace(StackFrames, kMaxStackFrames);
+}
+
+#endif // TDESKTOP_STALL_BACKTRACE
+
+} // namespace
+
+StallDetector::StallDetector()
+: _mainThread(QThread::currentThread())
+, _lastActivity(now())
+, _depth(0)
+, _eventType(0)
+, _eventClass(nullptr) {
+	Expects(Instance == nullptr);
+	Instance = this;
+
+#ifdef TDESKTOP_STALL_BACKTRACE
+	MainThread = pthread_self();
+
+	// Preload the unwinder before it can be reached from the handler.
+	backtrace(StackFrames, kMaxStackFrames);
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = CaptureStackHandler;
+	sigemptyset(&action.sa_mask);
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGUSR2, &action, &PreviousAction);
+#endif // TDESKTOP_STALL_BACKTRACE
+
+	// Timer events pass through notify(), so an idle loop still
+	// refreshes _lastActivity and is never reported as stalled.
+	_heartbeat.setInterval(kHeartbeatInterval);
+	_heartbeat.start();
+
+	_thread = std::thread([this] { watch(); });
+}
+
+StallDetector::~StallDetector() {
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_variable.notify_all();
+	_thread.join();
+
+#ifdef TDESKTOP_STALL_BACKTRACE
+	sigaction(SIGUSR2, &PreviousAction, nullptr);
+#endif // TDESKTOP_STALL_BACKTRACE
+
+	Instance = nullptr;
+}
+
+StallDetector::EventGuard::EventGuard(QObject *receiver, QEvent *event)
+: _detector((Instance && QThread::currentThread() == Instance->_mainThread)
+	? Instance
+	: nullptr) {
+	if (_detector) {
+		_previousType = _detector->_eventType;
+		_previousClass = _detector->_eventClass;
+		_detector->enter(
+			int(event->type()),
+			receiver->metaObject()->className());
+	}
+}
+
+StallDetector::EventGuard::~EventGuard() {
+	if (_detector) {
+		_detector->leave(_previousType, _previousClass);
+	}
+}
+
+TimeMs StallDetector::now() {
+	using namespace std::chrono;
+	return duration_cast<milliseconds>(
+		steady_clock::now().time_since_epoch()).count();
+}
+
+void StallDetector::enter(int type, const char *className) {
+	_eventType = type;
+	_eventClass = className;
+	_lastActivity = now();
+	++_depth;
+}
+
+void StallDetector::leave(int type, const char *className) {
+	--_depth;
+	_eventType = type;
+	_eventClass = className;
+	_lastActivity = now();
+}
+
+void StallDetector::watch() {
+	auto stallStart = TimeMs(0);
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_stopping) {
+		_variable.wait_for(
+			lock,
+			std::chrono::milliseconds(kWatchInterval));
+		if (_stopping) {
+			break;
+		}
+		const auto last = _lastActivity.load();
+		const auto stalled = (_depth > 0)
+			&& (now() - last > kStallThreshold);
+		if (stalled && !stallStart) {
+			stallStart = last;
+			stallStarted();
+		} else if (!stalled && stallStart) {
+			stallFinished(_lastActivity.load() - stallStart);
+			stallStart = 0;
+		}
+	}
+}
+
+void StallDetector::stallStarted() {
+	const auto className = _eventClass.load();
+	_currentSignature = qsl("event %1 to %2"
+	).arg(_eventType.load()
+	).arg(className ? className : "(none)");
+	const auto stack = captureMainStack();
+	if (!stack.isEmpty()) {
+		_currentSignature += '\n' + stack;
+	}
+	LOG(("Stall Info: main thread is not responding, dispatching %1."
+		).arg(_currentSignature.section('\n', 0, 0)));
+}
+
+void StallDetector::stallFinished(TimeMs duration) {
+	auto &stall = _stalls[_currentSignature];
+	++stall.count;
+	stall.total += duration;
+	accumulate_max(stall.max, duration);
+	LOG(("Stall Info: main thread was not responding for %1 ms."
+		).arg(duration));
+	writeReport();
+}
+
+QString StallDetector::captureMainStack() {
+#ifdef TDESKTOP_STALL_BACKTRACE
+	StackFramesCount = -1;
+	if (pthread_kill(MainThread, SIGUSR2) != 0) {
+		return QString();
+	}
+	const auto till = now() + kStackWaitTimeout;
+	while (StackFramesCount < 0 && now() < till) {
+		std::this_thread::yield();
+	}
+	const auto count = StackFramesCount.load();
+	if (count <= 0) {
+		return QString();
+	}
+
+	// Skip the signal handler frame and the signal trampoline.
+	const auto skip = std::min(count, 2);
+	const auto use = std::min(count - skip, kStackSignatureFrames);
+	const auto symbols = backtrace_symbols(StackFrames + skip, use);
+	if (!symbols) {
+		return QString();
+	}
+	auto result = QStringList();
+	for (auto i = 0; i != use; ++i) {
+		result.push_back(QString::fromLocal8Bit(symbols[i]));
+	}
+	free(symbols);
+	return result.join('\n');
+#else // TDESKTOP_STALL_BACKTRACE
+	// Only the current event is known, we can't sample another
+	// thread stack with psWriteStackTrace() on Windows.
+	return QString();
+#endif // else for TDESKTOP_STALL_BACKTRACE
+}
+
+void StallDetector::writeReport() {
+	QFile f(cWorkingDir() + qsl("stalls.txt"));
+	if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return;
+	}
+	QTextStream stream(&f);
+	stream.setCodec("UTF-8");
+	for (auto i = _stalls.cbegin(), e = _stalls.cend(); i != e; ++i) {
+		stream << "Stalls: " << i->count
+			<< ", total: " << i->total
+			<< " ms, max: " << i->max << " ms\n"
+			<< i.key() << "\n\n";
+	}
+}
+
+} // namespace Core
@@ -0,0 +1,88 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Core {
+
+// Watches the main thread from a separate thread and writes a report
+// to "stalls.txt" in the working dir when one event dispatch takes
+// longer than kStallThreshold. Application::notify() feeds it through
+// EventGuard, a heartbeat timer keeps idle nested event loops alive.
+// Events sent from other threads are not tracked. Created only when
+// the debug mode is enabled.
+class StallDetector {
+public:
+	StallDetector();
+	~StallDetector();
+
+	class EventGuard {
+	public:
+		EventGuard(QObject *receiver, QEvent *event);
+		~EventGuard();
+
+	private:
+		StallDetector *_detector = nullptr;
+		int _previousType = 0;
+		const char *_previousClass = nullptr;
+
+	};
+
+private:
+	struct Stall {
+		int count = 0;
+		TimeMs total = 0;
+		TimeMs max = 0;
+	};
+
+	static TimeMs now();
+
+	void enter(int type, const char *className);
+	void leave(int type, const char *className);
+
+	void watch();
+	void stallStarted();
+	void stallFinished(TimeMs duration);
+	QString captureMainStack();
+	void writeReport();
+
+	QThread *_mainThread = nullptr;
+	std::atomic<TimeMs> _lastActivity;
+	std::atomic<int> _depth;
+	std::atomic<int> _eventType;
+	std::atomic<const char*> _eventClass;
+
+	QTimer _heartbeat;
+
+	std::mutex _mutex;
+	std::condition_variable _variable;
+	bool _stopping = false;
+
+	QString _currentSignature;
+	QMap<QString, Stall> _stalls;
+	std::thread _thread;
+
+};
+
+} // namespace Core
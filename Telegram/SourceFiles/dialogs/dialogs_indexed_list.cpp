@@ -31,6 +31,7 @@ RowsByLetter IndexedList::addToEnd(History *history) {
 	RowsByLetter result;
 	if (!_list.contains(history->peer->id)) {
 		result.insert(0, _list.addToEnd(history));
+		indexNames(history->peer);
 		for_const (auto ch, history->peer->chars) {
 			auto j = _index.find(ch);
 			if (j == _index.cend()) {
@@ -48,6 +49,7 @@ Row *IndexedList::addByName(History *history) {
 	}
 
 	Row *result = _list.addByName(history);
+	indexNames(history->peer);
 	for_const (auto ch, history->peer->chars) {
 		auto j = _index.find(ch);
 		if (j == _index.cend()) {
@@ -117,6 +119,9 @@ void IndexedList::adjustByName(PeerData *peer, const PeerData::Names &oldNames,
 	Row *mainRow = _list.adjustByName(peer);
 	if (!mainRow) return;
 
+	unindexNames(peer, oldNames);
+	indexNames(peer);
+
 	History *history = mainRow->history();
 
 	PeerData::NameFirstChars toRemove = oldChars, toAdd;
@@ -151,6 +156,9 @@ void IndexedList::adjustNames(Mode list, PeerData *peer, const PeerData::Names &
 	auto mainRow = _list.getRow(peer->id);
 	if (!mainRow) return;
 
+	unindexNames(peer, oldNames);
+	indexNames(peer);
+
 	History *history = mainRow->history();
 
 	PeerData::NameFirstChars toRemove = oldChars, toAdd;
@@ -184,6 +192,7 @@ void IndexedList::adjustNames(Mode list, PeerData *peer, const PeerData::Names &
 
 void IndexedList::del(const PeerData *peer, Row *replacedBy) {
 	if (_list.del(peer->id, replacedBy)) {
+		unindexNames(peer, peer->names);
 		for_const (auto ch, peer->chars) {
 			if (auto list = _index.value(ch)) {
 				list->del(peer->id, replacedBy);
@@ -196,6 +205,66 @@ void IndexedList::clear() {
 	for_const (auto &list, _index) {
 		delete list;
 	}
+	_namesIndex.clear();
+}
+
+std::vector<Row*> IndexedList::filtered(const QStringList &words) const {
+	auto result = std::vector<Row*>();
+	if (words.isEmpty() || _list.isEmpty()) {
+		return result;
+	}
+
+	// The longest word usually has the fewest names starting with it.
+	auto longest = std::max_element(words.cbegin(), words.cend(), [](const QString &a, const QString &b) {
+		return a.size() < b.size();
+	});
+	auto candidates = std::vector<PeerData*>();
+	for (auto i = _namesIndex.lowerBound(*longest), e = _namesIndex.cend(); i != e && i.key().startsWith(*longest); ++i) {
+		candidates.push_back(i.value());
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	auto hasNameStartingWith = [](const PeerData *peer, const QString &word) {
+		for_const (auto &name, peer->names) {
+			if (name.startsWith(word)) {
+				return true;
+			}
+		}
+		return false;
+	};
+	for (auto peer : candidates) {
+		auto matches = std::all_of(words.cbegin(), words.cend(), [&](const QString &word) {
+			return hasNameStartingWith(peer, word);
+		});
+		if (matches) {
+			if (auto row = _list.getRow(peer->id)) {
+				result.push_back(row);
+			}
+		}
+	}
+	std::sort(result.begin(), result.end(), [](const Row *a, const Row *b) {
+		return a->pos() < b->pos();
+	});
+	return result;
+}
+
+void IndexedList::indexNames(PeerData *peer) {
+	for_const (auto &name, peer->names) {
+		_namesIndex.insert(name, peer);
+	}
+}
+
+void IndexedList::unindexNames(const PeerData *peer, const PeerData::Names &names) {
+	for_const (auto &name, names) {
+		for (auto i = _namesIndex.find(name); i != _namesIndex.end() && i.key() == name;) {
+			if (i.value() == peer) {
+				i = _namesIndex.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
 }
 
 IndexedList::~IndexedList() {
@@ -56,6 +56,9 @@ public:
 		return _index.value(ch, empty.data());
 	}
 
+	// Rows of all() with a name starting with each of the words, in all() order.
+	std::vector<Row*> filtered(const QStringList &words) const;
+
 	~IndexedList();
 
 	// Part of List interface is duplicated here for all() list.
@@ -83,12 +86,18 @@ public:
 private:
 	void adjustByName(PeerData *peer, const PeerData::Names &oldNames, const PeerData::NameFirstChars &oldChars);
 	void adjustNames(Mode list, PeerData *peer, const PeerData::Names &oldNames, const PeerData::NameFirstChars &oldChars);
+	void indexNames(PeerData *peer);
+	void unindexNames(const PeerData *peer, const PeerData::Names &names);
 
 	SortMode _sortMode;
 	List _list;
 	using Index = QMap<QChar, List*>;
 	Index _index;
 
+	// All the names of the peers in _list, sorted for the prefix lookups.
+	using NamesIndex = QMultiMap<QString, PeerData*>;
+	NamesIndex _namesIndex;
+
 };
 
 } // namespace Dialogs
@@ -103,6 +103,7 @@ DialogsInner::DialogsInner(QWidget *parent, not_null<Window::Controller*> contro
 	subscribe(Window::Theme::Background(), [this](const Window::Theme::BackgroundUpdate &data) {
 		if (data.paletteChanged()) {
 			Dialogs::Layout::clearUnreadBadgesCache();
+			Dialogs::Layout::clearRowsCache();
 		}
 	});
 
@@ -454,7 +455,7 @@ void DialogsInner::paintSearchInPeer(Painter &p, int fullWidth, bool onlyBackgro
 	if (onlyBackground) return;
 
 	p.setPen(st::dialogsNameFg);
-	paintSearchInFilter(p, _searchInPeer, top, fullWidth, _searchInPeer->nameText);
+	paintSearchInFilter(p, _searchInPeer, top, fullWidth, _searchInPeer->nameText());
 	if (_searchFromUser) {
 		top += st::dialogsSearchInHeight + st::lineWidth;
 		p.setPen(st::dialogsTextFg);
@@ -1004,6 +1005,14 @@ void DialogsInner::createDialog(History *history) {
 		history->addToChatList(Dialogs::Mode::Important, _dialogsImportant.get());
 	}
 
+	if (inUpdatesBatch()) {
+		if (creating) {
+			_updatesBatchRefresh = true;
+		}
+		_updatesBatchDialogs.insert(history->peer->id);
+		return;
+	}
+
 	auto changed = history->adjustByPosInChatList(Dialogs::Mode::All, _dialogs.get());
 
 	if (_dialogsImportant) {
@@ -1056,12 +1065,41 @@ void DialogsInner::removeDialog(History *history) {
 	}
 
 	Local::removeSavedPeer(history->peer);
+	Local::writeDialogsSnapshot();
 
 	emit App::main()->dialogsUpdated();
 
+	if (inUpdatesBatch()) {
+		_updatesBatchDialogs.remove(history->peer->id);
+		_updatesBatchRefresh = true;
+		return;
+	}
 	refresh();
 }
 
+void DialogsInner::startUpdatesBatch() {
+	++_updatesBatchLevel;
+}
+
+void DialogsInner::finishUpdatesBatch() {
+	Expects(_updatesBatchLevel > 0);
+
+	if (--_updatesBatchLevel > 0) {
+		return;
+	}
+	auto dialogs = base::take(_updatesBatchDialogs);
+	for (auto peerId : dialogs) {
+		if (auto history = App::historyLoaded(peerId)) {
+			if (history->inChatList(Dialogs::Mode::All)) {
+				createDialog(history);
+			}
+		}
+	}
+	if (base::take(_updatesBatchRefresh)) {
+		refresh();
+	}
+}
+
 void DialogsInner::dlgUpdated(Dialogs::Mode list, Dialogs::Row *row) {
 	if (_state == DefaultState) {
 		if (Global::DialogsMode() == list) {
@@ -1282,77 +1320,17 @@ void DialogsInner::onFilterUpdate(QString newFilter, bool force) {
 		if (_filter.isEmpty() && !_searchFromUser) {
 			clearFilter();
 		} else {
-			QStringList::const_iterator fb = words.cbegin(), fe = words.cend(), fi;
-
 			_state = FilteredState;
 			_filterResults.clear();
 			if (!_searchInPeer && !words.isEmpty()) {
-				const Dialogs::List *toFilter = nullptr;
-				if (!_dialogs->isEmpty()) {
-					for (fi = fb; fi != fe; ++fi) {
-						auto found = _dialogs->filtered(fi->at(0));
-						if (found->isEmpty()) {
-							toFilter = nullptr;
-							break;
-						}
-						if (!toFilter || toFilter->size() > found->size()) {
-							toFilter = found;
-						}
-					}
-				}
-				const Dialogs::List *toFilterContacts = nullptr;
-				if (!_contactsNoDialogs->isEmpty()) {
-					for (fi = fb; fi != fe; ++fi) {
-						auto found = _contactsNoDialogs->filtered(fi->at(0));
-						if (found->isEmpty()) {
-							toFilterContacts = nullptr;
-							break;
-						}
-						if (!toFilterContacts || toFilterContacts->size() > found->size()) {
-							toFilterContacts = found;
-						}
-					}
+				auto found = _dialogs->filtered(words);
+				auto foundContacts = _contactsNoDialogs->filtered(words);
+				_filterResults.reserve(found.size() + foundContacts.size());
+				for (auto row : found) {
+					_filterResults.push_back(row);
 				}
-				_filterResults.reserve((toFilter ? toFilter->size() : 0) + (toFilterContacts ? toFilterContacts->size() : 0));
-				if (toFilter) {
-					for_const (auto row, *toFilter) {
-						const PeerData::Names &names(row->history()->peer->names);
-						PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
-						for (fi = fb; fi != fe; ++fi) {
-							QString filterName(*fi);
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(*fi)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
-							_filterResults.push_back(row);
-						}
-					}
-				}
-				if (toFilterContacts) {
-					for_const (auto row, *toFilterContacts) {
-						const PeerData::Names &names(row->history()->peer->names);
-						PeerData::Names::const_iterator nb = names.cbegin(), ne = names.cend(), ni;
-						for (fi = fb; fi != fe; ++fi) {
-							QString filterName(*fi);
-							for (ni = nb; ni != ne; ++ni) {
-								if (ni->startsWith(*fi)) {
-									break;
-								}
-							}
-							if (ni == ne) {
-								break;
-							}
-						}
-						if (fi == fe) {
-							_filterResults.push_back(row);
-						}
-					}
+				for (auto row : foundContacts) {
+					_filterResults.push_back(row);
 				}
 			}
 			refresh(true);
@@ -1400,12 +1378,53 @@ DialogsInner::~DialogsInner() {
 void DialogsInner::clearSearchResults(bool clearPeerSearchResults) {
 	if (clearPeerSearchResults) _peerSearchResults.clear();
 	_searchResults.clear();
+	_localSearchResults.clear();
 	_searchedCount = _searchedMigratedCount = 0;
 	_lastSearchDate = 0;
 	_lastSearchPeer = 0;
 	_lastSearchId = _lastSearchMigratedId = 0;
 }
 
+bool DialogsInner::hasSearchResult(not_null<HistoryItem*> item) const {
+	return std::any_of(_searchResults.cbegin(), _searchResults.cend(), [item](const std::unique_ptr<Dialogs::FakeRow> &result) {
+		return (result->item() == item);
+	});
+}
+
+void DialogsInner::localSearchReceived(const std::vector<not_null<HistoryItem*>> &items) {
+	clearSearchResults(false);
+	for (auto item : items) {
+		_searchResults.push_back(std::make_unique<Dialogs::FakeRow>(_searchInPeer, item));
+		_localSearchResults.push_back(item->fullId());
+	}
+	_searchedCount = int(_searchResults.size());
+	if (_state == FilteredState && !_searchResults.empty()) {
+		_state = SearchedState;
+	}
+	refresh();
+}
+
+void DialogsInner::mergeLocalSearchResults(const std::vector<FullMsgId> &local, TimeId lastDateFound) {
+	// Keep only the local results which are not older than the last
+	// server result, the older ones will come with the next pages.
+	auto minimalDate = lastDateFound ? date(lastDateFound) : QDateTime();
+	auto merged = 0;
+	for (auto &id : local) {
+		auto item = App::histItemById(id);
+		if (!item || hasSearchResult(item) || (lastDateFound && item->date < minimalDate)) {
+			continue;
+		}
+		_searchResults.push_back(std::make_unique<Dialogs::FakeRow>(_searchInPeer, item));
+		++merged;
+	}
+	if (merged) {
+		std::stable_sort(_searchResults.begin(), _searchResults.end(), [](const std::unique_ptr<Dialogs::FakeRow> &a, const std::unique_ptr<Dialogs::FakeRow> &b) {
+			return (a->item()->date > b->item()->date);
+		});
+		_searchedCount = qMax(_searchedCount + merged, int(_searchResults.size()));
+	}
+}
+
 PeerData *DialogsInner::updateFromParentDrag(QPoint globalPos) {
 	_mouseSelection = true;
 	updateSelected(mapFromGlobal(globalPos));
@@ -1516,7 +1535,9 @@ void DialogsInner::addAllSavedPeers() {
 }
 
 bool DialogsInner::searchReceived(const QVector<MTPMessage> &messages, DialogsSearchRequestType type, int32 fullCount) {
+	auto localResults = std::vector<FullMsgId>();
 	if (type == DialogsSearchFromStart || type == DialogsSearchPeerFromStart) {
+		localResults = base::take(_localSearchResults);
 		clearSearchResults(false);
 	}
 	auto isGlobalSearch = (type == DialogsSearchFromStart || type == DialogsSearchFromOffset);
@@ -1530,7 +1551,9 @@ bool DialogsInner::searchReceived(const QVector<MTPMessage> &messages, DialogsSe
 		if (auto peer = App::peerLoaded(peerId)) {
 			if (lastDate) {
 				auto item = App::histories().addNewMessage(message, NewMessageExisting);
-				_searchResults.push_back(std::make_unique<Dialogs::FakeRow>(_searchInPeer, item));
+				if (!hasSearchResult(item)) {
+					_searchResults.push_back(std::make_unique<Dialogs::FakeRow>(_searchInPeer, item));
+				}
 				lastDateFound = lastDate;
 				if (isGlobalSearch) {
 					_lastSearchDate = lastDateFound;
@@ -1553,6 +1576,9 @@ bool DialogsInner::searchReceived(const QVector<MTPMessage> &messages, DialogsSe
 	} else {
 		_searchedCount = fullCount;
 	}
+	if (!localResults.empty()) {
+		mergeLocalSearchResults(localResults, lastDateFound);
+	}
 	if (_state == FilteredState && (!_searchResults.empty() || !_searchInMigrated || type == DialogsSearchMigratedFromStart || type == DialogsSearchMigratedFromOffset)) {
 		_state = SearchedState;
 	}
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "dialogs/dialogs_widget.h"
 #include "base/flags.h"
+#include "base/flat_set.h"
 
 namespace Dialogs {
 class Row;
@@ -49,6 +50,7 @@ public:
 	void addSavedPeersAfter(const QDateTime &date);
 	void addAllSavedPeers();
 	bool searchReceived(const QVector<MTPMessage> &result, DialogsSearchRequestType type, int32 fullCount);
+	void localSearchReceived(const std::vector<not_null<HistoryItem*>> &items);
 	void peerSearchReceived(const QString &query, const QVector<MTPPeer> &result);
 	void showMore(int32 pixels);
 
@@ -64,6 +66,14 @@ public:
 	void dlgUpdated(PeerData *peer, MsgId msgId);
 	void removeDialog(History *history);
 
+	// While a batch is open chat list moves are collected and applied
+	// once per history in finishUpdatesBatch() with a single refresh().
+	void startUpdatesBatch();
+	void finishUpdatesBatch();
+	bool inUpdatesBatch() const {
+		return (_updatesBatchLevel > 0);
+	}
+
 	void dragLeft();
 
 	void clearFilter();
@@ -199,6 +209,8 @@ private:
 
 	void clearSelection();
 	void clearSearchResults(bool clearPeerSearchResults = true);
+	bool hasSearchResult(not_null<HistoryItem*> item) const;
+	void mergeLocalSearchResults(const std::vector<FullMsgId> &local, TimeId lastDateFound);
 	void updateSelectedRow(PeerData *peer = 0);
 
 	Dialogs::IndexedList *shownDialogs() const {
@@ -273,6 +285,9 @@ private:
 	int _searchedSelected = -1;
 	int _searchedPressed = -1;
 
+	// Loaded messages found before the server results were received.
+	std::vector<FullMsgId> _localSearchResults;
+
 	int _lastSearchDate = 0;
 	PeerData *_lastSearchPeer = nullptr;
 	MsgId _lastSearchId = 0;
@@ -280,6 +295,10 @@ private:
 
 	State _state = DefaultState;
 
+	int _updatesBatchLevel = 0;
+	base::flat_set<PeerId> _updatesBatchDialogs;
+	bool _updatesBatchRefresh = false;
+
 	object_ptr<Ui::LinkButton> _addContactLnk;
 	object_ptr<Ui::IconButton> _cancelSearchInPeer;
 	object_ptr<Ui::IconButton> _cancelSearchFromUser;
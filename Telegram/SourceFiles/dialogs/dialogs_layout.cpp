@@ -34,6 +34,9 @@ namespace {
 // Show all dates that are in the last 20 hours in time format.
 constexpr int kRecentlyInSeconds = 20 * 3600;
 
+// Enough for all the rows visible in a tall window.
+constexpr auto kMaxCachedRows = 48;
+
 void paintRowDate(Painter &p, const QDateTime &date, QRect &rectForName, bool active, bool selected) {
 	auto now = QDateTime::currentDateTime();
 	auto lastTime = date;
@@ -64,7 +67,7 @@ void paintRow(Painter &p, const RippleRow *row, History *history, not_null<PeerD
 	row->paintRipple(p, 0, 0, fullWidth, ms, &(active ? st::dialogsRippleBgActive : st::dialogsRippleBg)->c);
 	if (onlyBackground) return;
 
-	from->paintUserpicLeft(p, st::dialogsPadding.x(), st::dialogsPadding.y(), fullWidth, st::dialogsPhotoSize);
+	from->paintDialogUserpicLeft(p, st::dialogsPadding.x(), st::dialogsPadding.y(), fullWidth, st::dialogsPhotoSize);
 
 	auto nameleft = st::dialogsPadding.x() + st::dialogsPhotoSize + st::dialogsPhotoPadding;
 	if (fullWidth <= nameleft) {
@@ -178,6 +181,91 @@ public:
 };
 Data::GlobalStructurePointer<UnreadBadgeStyleData> unreadBadgeStyle;
 
+// Everything a dialogs row painting depends on, except the ripple and
+// the send action animation: the rows that have them are not cached.
+struct RowCacheKey {
+	int fullWidth = 0;
+	bool active = false;
+	bool selected = false;
+	PeerData *from = nullptr;
+	int nameVersion = 0;
+	StorageKey userpicKey;
+	bool verified = false;
+	HistoryItem *item = nullptr;
+	MsgId itemId = 0;
+	bool itemUnread = false;
+	bool itemMentionUnread = false;
+	const HistoryItem *textCachedFor = nullptr;
+	Data::Draft *draft = nullptr;
+	mtpRequestId draftSaveRequestId = 0;
+	bool draftTextCached = false;
+	QDateTime date;
+	QDate today;
+	bool dateRecent = false;
+	int unreadCount = 0;
+	bool mute = false;
+	bool unreadMentions = false;
+	bool pinned = false;
+
+};
+
+bool operator==(const RowCacheKey &a, const RowCacheKey &b) {
+	return (a.fullWidth == b.fullWidth)
+		&& (a.active == b.active)
+		&& (a.selected == b.selected)
+		&& (a.from == b.from)
+		&& (a.nameVersion == b.nameVersion)
+		&& (a.userpicKey == b.userpicKey)
+		&& (a.verified == b.verified)
+		&& (a.item == b.item)
+		&& (a.itemId == b.itemId)
+		&& (a.itemUnread == b.itemUnread)
+		&& (a.itemMentionUnread == b.itemMentionUnread)
+		&& (a.textCachedFor == b.textCachedFor)
+		&& (a.draft == b.draft)
+		&& (a.draftSaveRequestId == b.draftSaveRequestId)
+		&& (a.draftTextCached == b.draftTextCached)
+		&& (a.date == b.date)
+		&& (a.today == b.today)
+		&& (a.dateRecent == b.dateRecent)
+		&& (a.unreadCount == b.unreadCount)
+		&& (a.mute == b.mute)
+		&& (a.unreadMentions == b.unreadMentions)
+		&& (a.pinned == b.pinned);
+}
+
+struct CachedRow {
+	RowCacheKey key;
+	QPixmap pixmap;
+	uint64 lastUsed = 0;
+};
+class RowsCacheData : public Data::AbstractStructure {
+public:
+	// Rows are never dereferenced from here, so a destroyed row is
+	// harmless: a new row at the same address won't match the key.
+	std::map<const Row*, CachedRow> rows;
+	uint64 counter = 0;
+
+};
+Data::GlobalStructurePointer<RowsCacheData> rowsCache;
+
+CachedRow &rowCache(const Row *row) {
+	rowsCache.createIfNull();
+	auto &rows = rowsCache->rows;
+	auto i = rows.find(row);
+	if (i == rows.end()) {
+		if (int(rows.size()) >= kMaxCachedRows) {
+			auto oldest = std::min_element(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+				return (a.second.lastUsed < b.second.lastUsed);
+			});
+			rows.erase(oldest);
+		}
+		i = rows.emplace(row, CachedRow()).first;
+	}
+	i->second.lastUsed = ++rowsCache->counter;
+	return i->second;
+}
+
 void createCircleMask(UnreadBadgeSizeData *data, int size) {
 	if (!data->circle.isNull()) return;
 
@@ -292,83 +380,136 @@ void RowPainter::paint(Painter &p, const Row *row, int fullWidth, bool active, b
 		cloudDraft = nullptr; // Draw item, if draft is older.
 	}
 	auto from = (history->peer->migrateTo() ? history->peer->migrateTo() : history->peer);
-	paintRow(p, row, history, from, item, cloudDraft, displayDate(), fullWidth, active, selected, onlyBackground, ms, [&p, fullWidth, active, selected, ms, history, unreadCount](int nameleft, int namewidth, HistoryItem *item) {
-		auto availableWidth = namewidth;
-		auto texttop = st::dialogsPadding.y() + st::msgNameFont->height + st::dialogsSkip;
-		auto hadOneBadge = false;
-		auto displayUnreadCounter = (unreadCount != 0);
-		auto displayMentionBadge = history->hasUnreadMentions();
-		auto displayPinnedIcon = !displayUnreadCounter && history->isPinnedDialog();
-		if (displayMentionBadge
-			&& unreadCount == 1
-			&& item
-			&& item->isMediaUnread()
-			&& item->mentionsMe()) {
-			displayUnreadCounter = false;
-		}
-		if (displayUnreadCounter) {
-			auto counter = QString::number(unreadCount);
-			auto mutedCounter = history->mute();
-			auto unreadRight = fullWidth - st::dialogsPadding.x();
-			auto unreadTop = texttop + st::dialogsTextFont->ascent - st::dialogsUnreadFont->ascent - (st::dialogsUnreadHeight - st::dialogsUnreadFont->height) / 2;
-			auto unreadWidth = 0;
-
-			UnreadBadgeStyle st;
-			st.active = active;
-			st.muted = history->mute();
-			paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
-			availableWidth -= unreadWidth + st.padding;
-
-			hadOneBadge = true;
-		} else if (displayPinnedIcon) {
-			auto &icon = (active ? st::dialogsPinnedIconActive : (selected ? st::dialogsPinnedIconOver : st::dialogsPinnedIcon));
-			icon.paint(p, fullWidth - st::dialogsPadding.x() - icon.width(), texttop, fullWidth);
-			availableWidth -= icon.width() + st::dialogsUnreadPadding;
-
-			hadOneBadge = true;
-		}
-		if (displayMentionBadge) {
-			auto counter = qsl("@");
-			auto unreadRight = fullWidth - st::dialogsPadding.x() - (namewidth - availableWidth);
-			auto unreadTop = texttop + st::dialogsTextFont->ascent - st::dialogsUnreadFont->ascent - (st::dialogsUnreadHeight - st::dialogsUnreadFont->height) / 2;
-			auto unreadWidth = 0;
+	auto paintContent = [&](Painter &p) {
+		paintRow(p, row, history, from, item, cloudDraft, displayDate(), fullWidth, active, selected, onlyBackground, ms, [&p, fullWidth, active, selected, ms, history, unreadCount](int nameleft, int namewidth, HistoryItem *item) {
+			auto availableWidth = namewidth;
+			auto texttop = st::dialogsPadding.y() + st::msgNameFont->height + st::dialogsSkip;
+			auto hadOneBadge = false;
+			auto displayUnreadCounter = (unreadCount != 0);
+			auto displayMentionBadge = history->hasUnreadMentions();
+			auto displayPinnedIcon = !displayUnreadCounter && history->isPinnedDialog();
+			if (displayMentionBadge
+				&& unreadCount == 1
+				&& item
+				&& item->isMediaUnread()
+				&& item->mentionsMe()) {
+				displayUnreadCounter = false;
+			}
+			if (displayUnreadCounter) {
+				auto counter = QString::number(unreadCount);
+				auto mutedCounter = history->mute();
+				auto unreadRight = fullWidth - st::dialogsPadding.x();
+				auto unreadTop = texttop + st::dialogsTextFont->ascent - st::dialogsUnreadFont->ascent - (st::dialogsUnreadHeight - st::dialogsUnreadFont->height) / 2;
+				auto unreadWidth = 0;
+
+				UnreadBadgeStyle st;
+				st.active = active;
+				st.muted = history->mute();
+				paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
+				availableWidth -= unreadWidth + st.padding;
+
+				hadOneBadge = true;
+			} else if (displayPinnedIcon) {
+				auto &icon = (active ? st::dialogsPinnedIconActive : (selected ? st::dialogsPinnedIconOver : st::dialogsPinnedIcon));
+				icon.paint(p, fullWidth - st::dialogsPadding.x() - icon.width(), texttop, fullWidth);
+				availableWidth -= icon.width() + st::dialogsUnreadPadding;
+
+				hadOneBadge = true;
+			}
+			if (displayMentionBadge) {
+				auto counter = qsl("@");
+				auto unreadRight = fullWidth - st::dialogsPadding.x() - (namewidth - availableWidth);
+				auto unreadTop = texttop + st::dialogsTextFont->ascent - st::dialogsUnreadFont->ascent - (st::dialogsUnreadHeight - st::dialogsUnreadFont->height) / 2;
+				auto unreadWidth = 0;
+
+				UnreadBadgeStyle st;
+				st.active = active;
+				st.muted = false;
+				st.padding = 0;
+				st.textTop = 0;
+				paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
+				availableWidth -= unreadWidth + st.padding + (hadOneBadge ? st::dialogsUnreadPadding : 0);
+			}
+			auto &color = active ? st::dialogsTextFgServiceActive : (selected ? st::dialogsTextFgServiceOver : st::dialogsTextFgService);
+			if (!history->paintSendAction(p, nameleft, texttop, availableWidth, fullWidth, color, ms)) {
+				item->drawInDialog(
+					p,
+					QRect(nameleft, texttop, availableWidth, st::dialogsTextFont->height),
+					active,
+					selected,
+					HistoryItem::DrawInDialog::Normal,
+					history->textCachedFor,
+					history->lastItemTextCache);
+			}
+		}, [&p, fullWidth, active, selected, ms, history, unreadCount] {
+			if (unreadCount) {
+				auto counter = QString::number(unreadCount);
+				if (counter.size() > 4) {
+					counter = qsl("..") + counter.mid(counter.size() - 3);
+				}
+				auto mutedCounter = history->mute();
+				auto unreadRight = st::dialogsPadding.x() + st::dialogsPhotoSize;
+				auto unreadTop = st::dialogsPadding.y() + st::dialogsPhotoSize - st::dialogsUnreadHeight;
+				auto unreadWidth = 0;
+
+				UnreadBadgeStyle st;
+				st.active = active;
+				st.muted = history->mute();
+				paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
+			}
+		});
+	};
+	if (onlyBackground || row->hasRipple() || history->hasSendAction()) {
+		paintContent(p);
+		return;
+	}
 
-			UnreadBadgeStyle st;
-			st.active = active;
-			st.muted = false;
-			st.padding = 0;
-			st.textTop = 0;
-			paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
-			availableWidth -= unreadWidth + st.padding + (hadOneBadge ? st::dialogsUnreadPadding : 0);
+	auto key = RowCacheKey();
+	key.fullWidth = fullWidth;
+	key.active = active;
+	key.selected = selected;
+	key.from = from;
+	key.nameVersion = from->nameVersion;
+	key.userpicKey = from->userpicUniqueKey();
+	key.verified = from->isVerified();
+	key.item = item;
+	if (item) {
+		key.itemId = item->id;
+		key.itemUnread = item->unread();
+		key.itemMentionUnread = item->isMediaUnread() && item->mentionsMe();
+	}
+	key.textCachedFor = history->textCachedFor;
+	key.draft = cloudDraft;
+	if (cloudDraft) {
+		key.draftSaveRequestId = cloudDraft->saveRequestId;
+		key.draftTextCached = !history->cloudDraftTextCache.isEmpty();
+	}
+	key.date = displayDate();
+	key.today = QDate::currentDate();
+	key.dateRecent = qAbs(key.date.secsTo(QDateTime::currentDateTime())) < kRecentlyInSeconds;
+	key.unreadCount = unreadCount;
+	key.mute = history->mute();
+	key.unreadMentions = history->hasUnreadMentions();
+	key.pinned = history->isPinnedDialog();
+
+	auto &cached = rowCache(row);
+	if (cached.pixmap.isNull() || !(cached.key == key)) {
+		auto size = QSize(fullWidth, st::dialogsRowHeight) * cIntRetinaFactor();
+		if (cached.pixmap.size() != size) {
+			cached.pixmap = QPixmap(size);
+			cached.pixmap.setDevicePixelRatio(cRetinaFactor());
 		}
-		auto &color = active ? st::dialogsTextFgServiceActive : (selected ? st::dialogsTextFgServiceOver : st::dialogsTextFgService);
-		if (!history->paintSendAction(p, nameleft, texttop, availableWidth, fullWidth, color, ms)) {
-			item->drawInDialog(
-				p,
-				QRect(nameleft, texttop, availableWidth, st::dialogsTextFont->height),
-				active,
-				selected,
-				HistoryItem::DrawInDialog::Normal,
-				history->textCachedFor,
-				history->lastItemTextCache);
+		{
+			Painter q(&cached.pixmap);
+			paintContent(q);
 		}
-	}, [&p, fullWidth, active, selected, ms, history, unreadCount] {
-		if (unreadCount) {
-			auto counter = QString::number(unreadCount);
-			if (counter.size() > 4) {
-				counter = qsl("..") + counter.mid(counter.size() - 3);
-			}
-			auto mutedCounter = history->mute();
-			auto unreadRight = st::dialogsPadding.x() + st::dialogsPhotoSize;
-			auto unreadTop = st::dialogsPadding.y() + st::dialogsPhotoSize - st::dialogsUnreadHeight;
-			auto unreadWidth = 0;
 
-			UnreadBadgeStyle st;
-			st.active = active;
-			st.muted = history->mute();
-			paintUnreadCount(p, counter, unreadRight, unreadTop, st, &unreadWidth);
-		}
-	});
+		// Painting fills the text caches, compare with them filled.
+		key.textCachedFor = history->textCachedFor;
+		key.draftTextCached = cloudDraft && !history->cloudDraftTextCache.isEmpty();
+		cached.key = key;
+	}
+	p.drawPixmap(0, 0, cached.pixmap);
 }
 
 void RowPainter::paint(Painter &p, const FakeRow *row, int fullWidth, bool active, bool selected, bool onlyBackground, TimeMs ms) {
@@ -428,6 +569,12 @@ void paintImportantSwitch(Painter &p, Mode current, int fullWidth, bool selected
 	}
 }
 
+void clearRowsCache() {
+	if (rowsCache) {
+		rowsCache->rows.clear();
+	}
+}
+
 void clearUnreadBadgesCache() {
 	if (unreadBadgeStyle) {
 		for (auto &data : unreadBadgeStyle->sizes) {
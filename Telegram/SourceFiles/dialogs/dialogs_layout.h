@@ -64,5 +64,8 @@ void paintUnreadCount(Painter &p, const QString &text, int x, int y, const Unrea
 
 void clearUnreadBadgesCache();
 
+// Painted dialogs rows are cached until anything they display changes.
+void clearRowsCache();
+
 } // namespace Layout
 } // namespace Dialogs
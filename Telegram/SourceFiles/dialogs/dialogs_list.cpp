@@ -37,13 +37,8 @@ List::List(SortMode sortMode)
 void List::adjustCurrent(int32 y, int32 h) const {
 	if (isEmpty()) return;
 
-	int32 pos = (y > 0) ? (y / h) : 0;
-	while (_current->_pos > pos && _current != _begin) {
-		_current = _current->_prev;
-	}
-	while (_current->_pos + 1 <= pos && _current->_next != _end) {
-		_current = _current->_next;
-	}
+	auto pos = (y > 0) ? (y / h) : 0;
+	_current = _rows[snap(pos, 0, _count - 1)];
 }
 
 Row *List::addToEnd(History *history) {
@@ -55,6 +50,7 @@ Row *List::addToEnd(History *history) {
 		_end->_prev->_next = result;
 	}
 	_rowByPeer.insert(history->peer->id, result);
+	_rows.push_back(result);
 	++_count;
 	_end->_prev = result;
 	if (_sortMode == SortMode::Date) {
@@ -70,6 +66,10 @@ bool List::insertBefore(Row *row, Row *before) {
 		_current = row->_prev;
 	}
 
+	// before is never after row, move row to its position
+	auto rowIndex = _rows.begin() + row->_pos;
+	std::rotate(_rows.begin() + before->_pos, rowIndex, rowIndex + 1);
+
 	Row *updateTill = row->_prev;
 	remove(row);
 
@@ -98,6 +98,10 @@ bool List::insertAfter(Row *row, Row *after) {
 		_current = row->_next;
 	}
 
+	// after is never before row, move row to its position
+	auto rowIndex = _rows.begin() + row->_pos;
+	std::rotate(rowIndex, rowIndex + 1, _rows.begin() + after->_pos + 1);
+
 	Row *updateFrom = row->_next;
 	remove(row);
 
@@ -122,11 +126,11 @@ Row *List::adjustByName(const PeerData *peer) {
 	if (i == _rowByPeer.cend()) return nullptr;
 
 	Row *row = i.value(), *change = row;
-	while (change->_prev && change->_prev->history()->peer->name > peer->name) {
+	while (change->_prev && change->_prev->history()->peer->name.compare(peer->name, Qt::CaseInsensitive) > 0) {
 		change = change->_prev;
 	}
 	if (!insertBefore(row, change)) {
-		while (change->_next != _end && change->_next->history()->peer->name < peer->name) {
+		while (change->_next != _end && change->_next->history()->peer->name.compare(peer->name, Qt::CaseInsensitive) < 0) {
 			change = change->_next;
 		}
 		insertAfter(row, change);
@@ -137,16 +141,16 @@ Row *List::adjustByName(const PeerData *peer) {
 Row *List::addByName(History *history) {
 	if (_sortMode != SortMode::Name) return nullptr;
 
-	Row *row = addToEnd(history), *change = row;
-	const QString &peerName(history->peer->name);
-	while (change->_prev && change->_prev->history()->peer->name.compare(peerName, Qt::CaseInsensitive) > 0) {
-		change = change->_prev;
-	}
-	if (!insertBefore(row, change)) {
-		while (change->_next != _end && change->_next->history()->peer->name.compare(peerName, Qt::CaseInsensitive) < 0) {
-			change = change->_next;
-		}
-		insertAfter(row, change);
+	// Rows are sorted by name, so find the place by a binary search
+	// instead of comparing names all the way from the end of the list.
+	const auto &peerName = history->peer->name;
+	auto before = std::upper_bound(_rows.cbegin(), _rows.cend(), peerName, [](const QString &name, Row *row) {
+		return row->history()->peer->name.compare(name, Qt::CaseInsensitive) > 0;
+	});
+	auto change = (before != _rows.cend()) ? *before : nullptr;
+	auto row = addToEnd(history);
+	if (change) {
+		insertBefore(row, change);
 	}
 	return row;
 }
@@ -194,6 +198,7 @@ bool List::del(PeerId peerId, Row *replacedBy) {
 	if (row == _current) {
 		_current = row->_next;
 	}
+	_rows.erase(_rows.begin() + row->_pos);
 	for (auto change = row->_next; change != _end; change = change->_next) {
 		--change->_pos;
 	}
@@ -223,6 +228,7 @@ void List::clear() {
 	}
 	_current = _begin;
 	_rowByPeer.clear();
+	_rows.clear();
 	_count = 0;
 }
 
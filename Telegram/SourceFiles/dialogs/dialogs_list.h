@@ -130,6 +130,9 @@ private:
 	typedef QHash<PeerId, Row*> RowByPeer;
 	RowByPeer _rowByPeer;
 
+	// Rows by their pos() for the lookups by y coordinate.
+	std::vector<Row*> _rows;
+
 	mutable Row *_current; // cache
 };
 
@@ -43,6 +43,9 @@ public:
 	void stopLastRipple();
 
 	void paintRipple(Painter &p, int x, int y, int outerWidth, TimeMs ms, const QColor *colorOverride = nullptr) const;
+	bool hasRipple() const {
+		return (_ripple != nullptr);
+	}
 
 private:
 	mutable std::unique_ptr<Ui::RippleAnimation> _ripple;
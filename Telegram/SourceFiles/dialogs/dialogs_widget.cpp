@@ -356,6 +356,7 @@ void DialogsWidget::dialogsReceived(const MTPmessages_Dialogs &dialogs, mtpReque
 			if (auto peer = peerFromMTP(dialogData.vpeer)) {
 				auto history = App::history(peer);
 				history->setPinnedDialog(dialogData.is_pinned());
+				_snapshotDialogs.remove(peer);
 
 				if (!lastDate) {
 					if (!lastPeer) lastPeer = peer;
@@ -393,6 +394,7 @@ void DialogsWidget::dialogsReceived(const MTPmessages_Dialogs &dialogs, mtpReque
 	}
 
 	_dialogsRequestId = 0;
+	removeOutdatedSnapshotDialogs();
 	loadDialogs();
 
 	Auth().data().moreChatsLoaded().notify();
@@ -421,6 +423,7 @@ void DialogsWidget::pinnedDialogsReceived(const MTPmessages_PeerDialogs &dialogs
 			if (auto peer = peerFromMTP(dialogData.vpeer)) {
 				auto history = App::history(peer);
 				history->setPinnedDialog(dialogData.is_pinned());
+				_snapshotDialogs.remove(peer);
 			}
 		}
 		App::feedMsgs(dialogsData.vmessages, NewMessageLast);
@@ -431,6 +434,7 @@ void DialogsWidget::pinnedDialogsReceived(const MTPmessages_PeerDialogs &dialogs
 
 	_pinnedDialogsRequestId = 0;
 	_pinnedDialogsReceived = true;
+	removeOutdatedSnapshotDialogs();
 
 	Auth().data().moreChatsLoaded().notify();
 }
@@ -480,6 +484,7 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 			_searchQueryFrom = _searchFromUser;
 			_searchFull = _searchFullMigrated = false;
 			MTP::cancel(base::take(_searchRequest));
+			searchLocal();
 			searchReceived(_searchInPeer ? DialogsSearchPeerFromStart : DialogsSearchFromStart, i.value(), 0);
 			return true;
 		}
@@ -488,6 +493,7 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 		_searchQueryFrom = _searchFromUser;
 		_searchFull = _searchFullMigrated = false;
 		MTP::cancel(base::take(_searchRequest));
+		searchLocal();
 		if (_searchInPeer) {
 			auto flags = _searchQueryFrom ? MTP_flags(MTPmessages_Search::Flag::f_from_id) : MTP_flags(0);
 			_searchRequest = MTP::send(MTPmessages_Search(flags, _searchInPeer->input, MTP_string(_searchQuery), _searchQueryFrom ? _searchQueryFrom->inputUser : MTP_inputUserEmpty(), MTP_inputMessagesFilterEmpty(), MTP_int(0), MTP_int(0), MTP_int(0), MTP_int(0), MTP_int(SearchPerPage), MTP_int(0), MTP_int(0)), rpcDone(&DialogsWidget::searchReceived, DialogsSearchPeerFromStart), rpcFail(&DialogsWidget::searchFailed, DialogsSearchPeerFromStart));
@@ -515,6 +521,14 @@ bool DialogsWidget::onSearchMessages(bool searchCache) {
 	return false;
 }
 
+void DialogsWidget::searchLocal() {
+	auto found = std::vector<not_null<HistoryItem*>>();
+	if (!_searchQuery.isEmpty()) {
+		found = App::histories().searchIndex().search(_searchQuery, _searchInPeer, _searchQueryFrom, SearchPerPage);
+	}
+	_inner->localSearchReceived(found);
+}
+
 void DialogsWidget::onNeedSearchMessages() {
 	if (!onSearchMessages(true)) {
 		_searchTimer.start(AutoSearchTimeout);
@@ -1100,6 +1114,28 @@ void DialogsWidget::paintEvent(QPaintEvent *e) {
 	}
 }
 
+void DialogsWidget::dialogsSnapshotRead(const QVector<History*> &histories) {
+	for_const (auto history, histories) {
+		_snapshotDialogs.insert(history->peer->id);
+	}
+}
+
+void DialogsWidget::removeOutdatedSnapshotDialogs() {
+	if (!_dialogsFull || !_pinnedDialogsReceived) {
+		return;
+	}
+	for (auto peerId : base::take(_snapshotDialogs)) {
+		if (auto history = App::historyLoaded(peerId)) {
+			if (history->lastMsg || cSavedPeers().contains(history->peer)) {
+				continue;
+			}
+			if (history->inChatList(Dialogs::Mode::All)) {
+				removeDialog(history);
+			}
+		}
+	}
+}
+
 void DialogsWidget::destroyData() {
 	_inner->destroyData();
 }
@@ -1118,7 +1154,22 @@ void DialogsWidget::scrollToPeer(const PeerId &peer, MsgId msgId) {
 
 void DialogsWidget::removeDialog(History *history) {
 	_inner->removeDialog(history);
-	onFilterUpdate();
+	if (_inner->inUpdatesBatch()) {
+		_filterUpdateInBatch = true;
+	} else {
+		onFilterUpdate();
+	}
+}
+
+void DialogsWidget::startUpdatesBatch() {
+	_inner->startUpdatesBatch();
+}
+
+void DialogsWidget::finishUpdatesBatch() {
+	_inner->finishUpdatesBatch();
+	if (!_inner->inUpdatesBatch() && base::take(_filterUpdateInBatch)) {
+		onFilterUpdate();
+	}
 }
 
 Dialogs::IndexedList *DialogsWidget::contactsList() {
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "window/section_widget.h"
 #include "ui/widgets/scroll_area.h"
+#include "base/flat_set.h"
 
 class DialogsInner;
 
@@ -90,6 +91,13 @@ public:
 
 	void removeDialog(History *history);
 
+	// Rows restored from the local snapshot are kept until the server
+	// dialogs list is fully loaded and removed if it didn't have them.
+	void dialogsSnapshotRead(const QVector<History*> &histories);
+
+	void startUpdatesBatch();
+	void finishUpdatesBatch();
+
 	Dialogs::IndexedList *contactsList();
 	Dialogs::IndexedList *dialogsList();
 	Dialogs::IndexedList *contactsNoDialogsList();
@@ -147,6 +155,7 @@ private:
 	void dialogsReceived(const MTPmessages_Dialogs &dialogs, mtpRequestId requestId);
 	void pinnedDialogsReceived(const MTPmessages_PeerDialogs &dialogs, mtpRequestId requestId);
 	void contactsReceived(const MTPcontacts_Contacts &result);
+	void searchLocal();
 	void searchReceived(DialogsSearchRequestType type, const MTPmessages_Messages &result, mtpRequestId requestId);
 	void peerSearchReceived(const MTPcontacts_Found &result, mtpRequestId requestId);
 
@@ -161,6 +170,7 @@ private:
 	void updateForwardBar();
 
 	void unreadCountsReceived(const QVector<MTPDialog> &dialogs);
+	void removeOutdatedSnapshotDialogs();
 	bool dialogsFailed(const RPCError &error, mtpRequestId req);
 	bool contactsFailed(const RPCError &error);
 	bool searchFailed(DialogsSearchRequestType type, const RPCError &error, mtpRequestId req);
@@ -171,6 +181,7 @@ private:
 	QTimer _chooseByDragTimer;
 
 	bool _dialogsFull = false;
+	base::flat_set<PeerId> _snapshotDialogs;
 	int32 _dialogsOffsetDate = 0;
 	MsgId _dialogsOffsetId = 0;
 	PeerData *_dialogsOffsetPeer = nullptr;
@@ -178,6 +189,7 @@ private:
 	mtpRequestId _pinnedDialogsRequestId = 0;
 	mtpRequestId _contactsRequestId = 0;
 	bool _pinnedDialogsReceived = false;
+	bool _filterUpdateInBatch = false;
 
 	object_ptr<Ui::IconButton> _forwardCancel = { nullptr };
 	object_ptr<Ui::IconButton> _mainMenuToggle;
@@ -247,6 +247,12 @@ void repaintHistoryItem(not_null<const HistoryItem*> item) {
 	}
 }
 
+void repaintHistoryItemMedia(not_null<const HistoryItem*> item) {
+	if (auto main = App::main()) {
+		main->ui_repaintHistoryItemMedia(item);
+	}
+}
+
 void autoplayMediaInlineAsync(const FullMsgId &msgId) {
 	if (auto main = App::main()) {
 		QMetaObject::invokeMethod(main, "ui_autoplayMediaInlineAsync", Qt::QueuedConnection, Q_ARG(qint32, msgId.channel), Q_ARG(qint32, msgId.msg));
@@ -612,6 +618,8 @@ struct Data {
 	bool TryIPv6 = (cPlatform() == dbipWindows) ? false : true;
 	ProxyData ConnectionProxy;
 	base::Observable<void> ConnectionTypeChanged;
+	int GzipRequestsThreshold = 1024; // in bytes, zero disables packing
+	bool BackgroundSessions = true; // false sends background requests with the usual ones
 
 	int AutoLock = 3600;
 	bool LocalPasscode = false;
@@ -622,6 +630,7 @@ struct Data {
 	base::Observable<HistoryItem*> ItemRemoved;
 	base::Observable<void> UnreadCounterUpdate;
 	base::Observable<void> PeerChooseCancel;
+	base::Observable<void> EmojiLargeLoaded;
 
 };
 
@@ -735,6 +744,8 @@ DefineVar(Global, DBIConnectionType, LastProxyType);
 DefineVar(Global, bool, TryIPv6);
 DefineVar(Global, ProxyData, ConnectionProxy);
 DefineRefVar(Global, base::Observable<void>, ConnectionTypeChanged);
+DefineVar(Global, int, GzipRequestsThreshold);
+DefineVar(Global, bool, BackgroundSessions);
 
 DefineVar(Global, int, AutoLock);
 DefineVar(Global, bool, LocalPasscode);
@@ -745,5 +756,6 @@ DefineRefVar(Global, base::Variable<DBIWorkMode>, WorkMode);
 DefineRefVar(Global, base::Observable<HistoryItem*>, ItemRemoved);
 DefineRefVar(Global, base::Observable<void>, UnreadCounterUpdate);
 DefineRefVar(Global, base::Observable<void>, PeerChooseCancel);
+DefineRefVar(Global, base::Observable<void>, EmojiLargeLoaded);
 
 } // namespace Global
@@ -105,6 +105,7 @@ void hideSettingsAndLayer(bool fast = false);
 bool isLayerShown();
 
 void repaintHistoryItem(not_null<const HistoryItem*> item);
+void repaintHistoryItemMedia(not_null<const HistoryItem*> item);
 void autoplayMediaInlineAsync(const FullMsgId &msgId);
 
 void showPeerProfile(const PeerId &peer);
@@ -354,7 +355,7 @@ DeclareRefVar(base::Observable<void>, FeaturedStickerSetsUnreadCountChanged);
 DeclareVar(TimeMs, LastFeaturedStickersUpdate);
 DeclareVar(Stickers::Order, ArchivedStickerSetsOrder);
 
-typedef QMap<uint64, QPixmap> CircleMasksMap;
+typedef QMap<uint64, QImage> CircleMasksMap;
 DeclareRefVar(CircleMasksMap, CircleMasks);
 
 DeclareRefVar(base::Observable<void>, SelfChanged);
@@ -379,6 +380,8 @@ DeclareVar(DBIConnectionType, LastProxyType);
 DeclareVar(bool, TryIPv6);
 DeclareVar(ProxyData, ConnectionProxy);
 DeclareRefVar(base::Observable<void>, ConnectionTypeChanged);
+DeclareVar(int, GzipRequestsThreshold);
+DeclareVar(bool, BackgroundSessions);
 
 DeclareVar(int, AutoLock);
 DeclareVar(bool, LocalPasscode);
@@ -390,6 +393,9 @@ DeclareRefVar(base::Observable<HistoryItem*>, ItemRemoved);
 DeclareRefVar(base::Observable<void>, UnreadCounterUpdate);
 DeclareRefVar(base::Observable<void>, PeerChooseCancel);
 
+// The large emoji sprite is decoded in the background, repaint when it is ready.
+DeclareRefVar(base::Observable<void>, EmojiLargeLoaded);
+
 } // namespace Global
 
 namespace Adaptive {
@@ -36,10 +36,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "window/notifications_manager.h"
 #include "calls/calls_instance.h"
+#include "media/player/media_player_instance.h"
+#include "messenger.h"
 
 namespace {
 
 constexpr auto kStatusShowClientsideTyping = 6000;
+constexpr auto kDateIndexLimit = 20000;
 constexpr auto kStatusShowClientsideRecordVideo = 6000;
 constexpr auto kStatusShowClientsideUploadVideo = 6000;
 constexpr auto kStatusShowClientsideRecordVoice = 6000;
@@ -54,6 +57,17 @@ constexpr auto kStatusShowClientsidePlayGame = 10000;
 constexpr auto kSetMyActionForMs = 10000;
 constexpr auto kNewBlockEachMessage = 50;
 
+// Histories not shown for some time are trimmed to their last messages
+// when all the loaded histories hold more than a budget of items.
+constexpr auto kUnloadInactiveCheckTimeout = TimeMs(60 * 1000);
+constexpr auto kUnloadInactiveNotShownFor = TimeMs(10 * 60 * 1000);
+constexpr auto kUnloadInactiveItemsBudget = 20000;
+constexpr auto kUnloadInactiveLeaveItems = 100;
+
+// Relayout only visible blocks on width change for large histories.
+constexpr auto kPartialResizeMinBlocks = 4;
+constexpr auto kPartialResizeMargin = 2048; // Pixels above and below the visible area.
+
 auto GlobalPinnedIndex = 0;
 
 HistoryItem *createUnsupportedMessage(History *history, MsgId msgId, MTPDmessage::Flags flags, MsgId replyTo, int32 viaBotId, QDateTime date, int32 from) {
@@ -584,6 +598,12 @@ ChannelHistory::~ChannelHistory() {
 	clearOnDestroy();
 }
 
+Histories::Histories() : _a_typings(animation(this, &Histories::step_typings)) {
+	_selfDestructTimer.setCallback([this] { checkSelfDestructItems(); });
+	_unloadInactiveTimer.setCallback([this] { checkInactiveHistories(); });
+	_unloadInactiveTimer.callEach(kUnloadInactiveCheckTimeout);
+}
+
 History *Histories::find(const PeerId &peerId) {
 	Map::const_iterator i = map.constFind(peerId);
 	return (i == map.cend()) ? 0 : i.value();
@@ -618,6 +638,11 @@ not_null<History*> Histories::findOrInsert(const PeerId &peerId, int32 unreadCou
 }
 
 void Histories::clear() {
+	if (AuthSession::Exists()) {
+		// Once for all the items instead of clearFromItem() for each of them.
+		Auth().notifications().clearAllFast();
+	}
+	App::historySetBulkDestroying(true);
 	App::historyClearMsgs();
 
 	_pinnedDialogs.clear();
@@ -626,10 +651,12 @@ void Histories::clear() {
 		delete history;
 	}
 
-	_unreadFull = _unreadMuted = 0;
+	_unreadFull = _unreadMuted = _unreadMentions = 0;
 	Notify::unreadCounterUpdated();
 	App::historyClearItems();
+	App::historySetBulkDestroying(false);
 	typing.clear();
+	_searchIndex.clear();
 }
 
 void Histories::regSendAction(History *history, UserData *user, const MTPSendMessageAction &action, TimeId when) {
@@ -710,6 +737,17 @@ bool Histories::unreadOnlyMuted() const {
 	return Global::IncludeMuted() ? (_unreadMuted >= _unreadFull) : false;
 }
 
+void Histories::unreadStateChanged(const UnreadState &was, const UnreadState &now) {
+	auto wasBadge = unreadBadge();
+	auto wasMuted = _unreadMuted;
+	_unreadFull += now.messages - was.messages;
+	_unreadMuted += (now.muted ? now.messages : 0) - (was.muted ? was.messages : 0);
+	_unreadMentions += now.mentions - was.mentions;
+	if (unreadBadge() != wasBadge || _unreadMuted != wasMuted) {
+		Notify::unreadCounterUpdated();
+	}
+}
+
 void Histories::setIsPinned(History *history, bool isPinned) {
 	if (isPinned) {
 		_pinnedDialogs.insert(history);
@@ -765,33 +803,81 @@ void Histories::savePinnedToServer() const {
 }
 
 void Histories::selfDestructIn(not_null<HistoryItem*> item, TimeMs delay) {
-	_selfDestructItems.push_back(item->fullId());
+	_selfDestructItems.schedule(item->fullId(), getms(true) + delay);
 	if (!_selfDestructTimer.isActive() || _selfDestructTimer.remainingTime() > delay) {
 		_selfDestructTimer.callOnce(delay);
 	}
 }
 
+void Histories::checkInactiveHistories() {
+	auto now = getms(true);
+	auto shown = std::vector<PeerData*>();
+	auto addShown = [&shown](PeerData *peer) {
+		if (!peer) return;
+		shown.push_back(peer);
+		if (auto from = peer->migrateFrom()) {
+			shown.push_back(from);
+		} else if (auto to = peer->migrateTo()) {
+			shown.push_back(to);
+		}
+	};
+	if (auto main = App::main()) {
+		for (auto peer : { main->historyPeer(), main->activePeer(), main->overviewPeer() }) {
+			addShown(peer);
+		}
+	}
+
+	// The player playlists and the media viewer navigate by the overviews,
+	// which are cleared when the history is trimmed.
+	for (auto type : { AudioMsgId::Type::Song, AudioMsgId::Type::Voice }) {
+		if (auto item = App::histItemById(Media::Player::instance()->current(type).contextId())) {
+			addShown(item->history()->peer);
+		}
+	}
+	addShown(Messenger::Instance().ui_getPeerForMouseAction());
+
+	auto total = 0;
+	auto inactive = std::vector<not_null<History*>>();
+	for_const (auto history, map) {
+		if (std::find(shown.cbegin(), shown.cend(), history->peer) != shown.cend()) {
+			history->setLastShownTime(now);
+			continue;
+		}
+		auto count = history->loadedItemsCount();
+		total += count;
+		if (count > kUnloadInactiveLeaveItems
+			&& history->lastShownTime() + kUnloadInactiveNotShownFor <= now) {
+			inactive.push_back(history);
+		}
+	}
+	if (total <= kUnloadInactiveItemsBudget) {
+		return;
+	}
+
+	// Trim the histories that were not shown for the longest time first.
+	std::sort(inactive.begin(), inactive.end(), [](not_null<History*> a, not_null<History*> b) {
+		return (a->lastShownTime() < b->lastShownTime());
+	});
+	for (auto history : inactive) {
+		total -= history->unloadOldItems(kUnloadInactiveLeaveItems);
+		if (total <= kUnloadInactiveItemsBudget) {
+			break;
+		}
+	}
+}
+
 void Histories::checkSelfDestructItems() {
+	// Only the items that should be destroyed by now are checked.
 	auto now = getms(true);
-	auto nextDestructIn = TimeMs(0);
-	for (auto i = _selfDestructItems.begin(); i != _selfDestructItems.cend();) {
-		if (auto item = App::histItemById(*i)) {
+	_selfDestructItems.process(now, [this, now](const FullMsgId &itemId) {
+		if (auto item = App::histItemById(itemId)) {
 			if (auto destructIn = item->getSelfDestructIn(now)) {
-				if (nextDestructIn > 0) {
-					accumulate_min(nextDestructIn, destructIn);
-				} else {
-					nextDestructIn = destructIn;
-				}
-				++i;
-			} else {
-				i = _selfDestructItems.erase(i);
+				_selfDestructItems.schedule(itemId, now + destructIn);
 			}
-		} else {
-			i = _selfDestructItems.erase(i);
 		}
-	}
-	if (nextDestructIn > 0) {
-		_selfDestructTimer.callOnce(nextDestructIn);
+	});
+	if (!_selfDestructItems.empty()) {
+		_selfDestructTimer.callOnce(qMax(_selfDestructItems.next() - now, TimeMs(1)));
 	}
 }
 
@@ -1171,6 +1257,7 @@ void History::setUnreadMentionsCount(int count) {
 		count = _unreadMentions.size();
 	}
 	_unreadMentionsCount = count;
+	refreshUnreadState();
 }
 
 bool History::addToUnreadMentions(MsgId msgId, AddToOverviewMethod method) {
@@ -1179,6 +1266,7 @@ bool History::addToUnreadMentions(MsgId msgId, AddToOverviewMethod method) {
 		if (method == AddToOverviewNew) {
 			++*_unreadMentionsCount;
 			_unreadMentions.insert(msgId);
+			refreshUnreadState();
 			return true;
 		}
 	} else if (!_unreadMentions.empty() && method != AddToOverviewNew) {
@@ -1195,6 +1283,7 @@ void History::eraseFromUnreadMentions(MsgId msgId) {
 			--*_unreadMentionsCount;
 		}
 	}
+	refreshUnreadState();
 	Notify::peerUpdatedDelayed(peer, Notify::PeerUpdate::Flag::UnreadMentionsChanged);
 }
 
@@ -1411,6 +1500,7 @@ void History::addItemToBlock(HistoryItem *item) {
 	item->attachToBlock(block, block->items.size());
 	block->items.push_back(item);
 	item->previousItemChanged();
+	App::histories().searchIndex().add(item);
 
 	if (isBuildingFrontBlock() && _buildingFrontBlock->expectedItemsCount > 0) {
 		--_buildingFrontBlock->expectedItemsCount;
@@ -1418,6 +1508,13 @@ void History::addItemToBlock(HistoryItem *item) {
 }
 
 void History::addOlderSlice(const QVector<MTPMessage> &slice) {
+	auto wasOldest = (blocks.isEmpty() || blocks.front()->items.isEmpty()) ? nullptr : blocks.front()->items.front();
+	if (wasOldest) {
+		// Either the slice continues before it or there is nothing before it.
+		setHasPreviousInDateIndex(wasOldest);
+	}
+	addSliceToDateIndex(slice, false);
+
 	if (slice.isEmpty()) {
 		oldLoaded = true;
 		if (isChannel()) {
@@ -1535,6 +1632,7 @@ void History::addOlderSlice(const QVector<MTPMessage> &slice) {
 
 void History::addNewerSlice(const QVector<MTPMessage> &slice) {
 	bool wasEmpty = isEmpty(), wasLoadedAtBottom = loadedAtBottom();
+	addSliceToDateIndex(slice, !wasEmpty);
 
 	if (slice.isEmpty()) {
 		newLoaded = true;
@@ -1569,6 +1667,49 @@ void History::addNewerSlice(const QVector<MTPMessage> &slice) {
 	checkLastMsg();
 }
 
+void History::addSliceToDateIndex(const QVector<MTPMessage> &slice, bool oldestHasPrevious) {
+	if (int(_dateIndex.size()) + slice.size() > kDateIndexLimit) {
+		_dateIndex.clear();
+		oldestHasPrevious = false;
+	}
+
+	// The slice is ordered from the newest message to the oldest one.
+	auto hasPrevious = oldestHasPrevious;
+	for (auto i = slice.size(); i != 0;) {
+		auto &message = slice[--i];
+		if (auto date = dateFromMessage(message)) {
+			_dateIndex[DateIndexKey(date, idFromMessage(message))] = hasPrevious;
+			hasPrevious = true;
+		}
+	}
+}
+
+void History::setHasPreviousInDateIndex(HistoryItem *item) {
+	auto i = _dateIndex.find(DateIndexKey(item->date.toTime_t(), item->id));
+	if (i != _dateIndex.end()) {
+		i->second = true;
+	}
+}
+
+void History::removeFromDateIndex(not_null<HistoryItem*> item) {
+	auto i = _dateIndex.find(DateIndexKey(item->date.toTime_t(), item->id));
+	if (i == _dateIndex.end()) {
+		return;
+	}
+	auto hadPrevious = i->second;
+	i = _dateIndex.erase(i);
+
+	// The next message now follows the one before the removed message.
+	if (i != _dateIndex.end() && !hadPrevious) {
+		i->second = false;
+	}
+}
+
+MsgId History::findMessageAtDate(TimeId date) const {
+	auto i = _dateIndex.lower_bound(DateIndexKey(date, 0));
+	return (i != _dateIndex.end() && i->second) ? i->first.second : 0;
+}
+
 void History::checkLastMsg() {
 	if (lastMsg) {
 		if (!newLoaded && !lastMsg->detached()) {
@@ -1687,13 +1828,8 @@ void History::setUnreadCount(int newUnreadCount) {
 		} else {
 			if (!showFrom && !unreadBar && loadedAtBottom()) updateShowFrom();
 		}
-		if (inChatList(Dialogs::Mode::All)) {
-			App::histories().unreadIncrement(newUnreadCount - _unreadCount, mute());
-			if (!mute() || Global::IncludeMuted()) {
-				Notify::unreadCounterUpdated();
-			}
-		}
 		_unreadCount = newUnreadCount;
+		refreshUnreadState();
 		if (auto main = App::main()) {
 			main->unreadCountChanged(this);
 		}
@@ -1717,16 +1853,28 @@ void History::setUnreadCount(int newUnreadCount) {
 	if (_mute != newMute) {
 		_mute = newMute;
 		if (inChatList(Dialogs::Mode::All)) {
-			if (_unreadCount) {
-				App::histories().unreadMuteChanged(_unreadCount, newMute);
-				Notify::unreadCounterUpdated();
-			}
+			refreshUnreadState();
 			Notify::historyMuteUpdated(this);
 		}
 		updateChatListEntry();
 	}
 }
 
+void History::refreshUnreadState() {
+	auto now = Histories::UnreadState();
+	if (inChatList(Dialogs::Mode::All)) {
+		now.messages = _unreadCount;
+		now.mentions = getUnreadMentionsCount(0);
+		now.muted = _mute;
+	}
+	if (now.messages != _unreadState.messages
+		|| now.mentions != _unreadState.mentions
+		|| now.muted != _unreadState.muted) {
+		App::histories().unreadStateChanged(_unreadState, now);
+		_unreadState = now;
+	}
+}
+
 void History::getNextShowFrom(HistoryBlock *block, int i) {
 	if (i >= 0) {
 		auto l = block->items.size();
@@ -2037,6 +2185,11 @@ void History::updateChatListSortPosition() {
 			}
 		}
 	}
+
+	// New rows, reorders and pin changes all get here.
+	if (inChatList(Dialogs::Mode::All)) {
+		Local::writeDialogsSnapshot();
+	}
 }
 
 void History::fixLastMessage(bool wasAtBottom) {
@@ -2076,16 +2229,48 @@ MsgId History::msgIdForRead() const {
 int History::resizeGetHeight(int newWidth) {
 	bool resizeAllItems = (_flags & Flag::f_pending_resize) || (width != newWidth);
 
-	if (!resizeAllItems && !hasPendingResizedItems()) {
+	if (!resizeAllItems && !hasPendingResizedItems() && !hasStaleBlocks()) {
 		return height;
 	}
-	_flags &= ~(Flag::f_pending_resize | Flag::f_has_pending_resized_items);
+	_flags &= ~(Flag::f_pending_resize | Flag::f_has_pending_resized_items | Flag::f_has_stale_blocks);
 
 	width = newWidth;
 	int y = 0;
 	for_const (auto block, blocks) {
 		block->setY(y);
-		y += block->resizeGetHeight(newWidth, resizeAllItems);
+		y += block->resizeGetHeight(newWidth, resizeAllItems || (block->width() != newWidth));
+	}
+	height = y;
+	return height;
+}
+
+int History::resizeGetHeight(int newWidth, int visibleTop, int visibleBottom) {
+	if ((_flags & Flag::f_pending_resize)
+		|| (width == newWidth)
+		|| (int(blocks.size()) < kPartialResizeMinBlocks)
+		|| (visibleBottom <= visibleTop)) {
+		return resizeGetHeight(newWidth);
+	}
+	_flags &= ~Flag::f_has_pending_resized_items;
+
+	width = newWidth;
+	auto from = visibleTop - kPartialResizeMargin;
+	auto till = visibleBottom + kPartialResizeMargin;
+	auto y = 0;
+	for_const (auto block, blocks) {
+		// Visibility is checked by the block position in the previous layout.
+		auto wasTop = block->y();
+		auto wasBottom = wasTop + block->height();
+		block->setY(y);
+		if (!block->width() || (wasBottom > from && wasTop < till)) {
+			y += block->resizeGetHeight(newWidth, true);
+		} else {
+			// Keep the previous layout, resize only new items at its width.
+			y += block->resizeGetHeight(block->width(), false);
+			if (block->width() != newWidth) {
+				_flags |= Flag::f_has_stale_blocks;
+			}
+		}
 	}
 	height = y;
 	return height;
@@ -2134,6 +2319,7 @@ void History::clear(bool leaveItems) {
 	if (!leaveItems) {
 		setLastMessage(nullptr);
 		notifies.clear();
+		_dateIndex.clear();
 		auto &pending = Global::RefPendingRepaintItems();
 		for (auto i = pending.begin(); i != pending.end();) {
 			if ((*i)->history() == this) {
@@ -2194,6 +2380,101 @@ void History::clearBlocks(bool leaveItems) {
 	}
 }
 
+int History::loadedItemsCount() const {
+	auto result = 0;
+	for_const (auto block, blocks) {
+		result += block->items.size();
+	}
+	return result;
+}
+
+int History::unloadOldItems(int leaveCount) {
+	// Only fully read histories at the bottom without a local state
+	// pointing inside the loaded items can be trimmed safely.
+	if (_buildingFrontBlock
+		|| !loadedAtBottom()
+		|| unreadCount() > 0
+		|| unreadBar
+		|| showFrom
+		|| editDraft()) {
+		return 0;
+	}
+
+	// Find whole blocks from the top which can be removed. Stop at the
+	// first item that is not sent yet, is a target of a reply, holds the
+	// bot keyboard or is the last message.
+	auto left = loadedItemsCount();
+	auto removeBlocks = 0;
+	for (auto block : blocks) {
+		auto count = block->items.size();
+		if (left - count < leaveCount) {
+			break;
+		}
+		auto canRemove = true;
+		for_const (auto item, block->items) {
+			if (item->id < 0
+				|| item == lastMsg
+				|| (lastKeyboardId && item->id == lastKeyboardId)
+				|| App::historyHasDependentItems(item)) {
+				canRemove = false;
+				break;
+			}
+		}
+		if (!canRemove) {
+			break;
+		}
+		left -= count;
+		++removeBlocks;
+	}
+	if (!removeBlocks) {
+		return 0;
+	}
+
+	auto removed = Blocks();
+	for (auto i = 0; i != removeBlocks; ++i) {
+		removed.push_back(blocks.takeFirst());
+	}
+	for (auto i = 0, count = blocks.size(); i != count; ++i) {
+		blocks[i]->setIndexInHistory(i);
+	}
+
+	auto result = 0;
+	auto &pending = Global::RefPendingRepaintItems();
+	for_const (auto block, removed) {
+		for_const (auto item, block->items) {
+			if (lastSentMsg == item) {
+				lastSentMsg = nullptr;
+			}
+			if (isChannel()) {
+				asChannelHistory()->messageDetached(item);
+			}
+			notifies.removeOne(item);
+			pending.remove(item);
+		}
+		result += block->items.size();
+		block->clear(false);
+		delete block;
+	}
+	if (!blocks.isEmpty()) {
+		blocks.front()->items.front()->previousItemChanged();
+	}
+
+	// The overview ids of the deleted items are dropped as well,
+	// they will be requested again when the shared media is shown.
+	for (auto i = 0; i != OverviewCount; ++i) {
+		if (!_overview[i].isEmpty()) {
+			_overviewCountData[i] = -1; // not loaded yet
+			_overview[i].clear();
+			Notify::mediaOverviewUpdated(peer, MediaOverviewType(i));
+		}
+	}
+
+	oldLoaded = false;
+	forgetScrollState();
+	setPendingResize();
+	return result;
+}
+
 void History::clearOnDestroy() {
 	clearBlocks(false);
 }
@@ -2215,9 +2496,8 @@ Dialogs::Row *History::addToChatList(Dialogs::Mode list, Dialogs::IndexedList *i
 	Assert(indexed != nullptr);
 	if (!inChatList(list)) {
 		chatListLinks(list) = indexed->addToEnd(this);
-		if (list == Dialogs::Mode::All && unreadCount()) {
-			App::histories().unreadIncrement(unreadCount(), mute());
-			Notify::unreadCounterUpdated();
+		if (list == Dialogs::Mode::All) {
+			refreshUnreadState();
 		}
 	}
 	return mainChatListLink(list);
@@ -2228,9 +2508,8 @@ void History::removeFromChatList(Dialogs::Mode list, Dialogs::IndexedList *index
 	if (inChatList(list)) {
 		indexed->del(peer);
 		chatListLinks(list).clear();
-		if (list == Dialogs::Mode::All && unreadCount()) {
-			App::histories().unreadIncrement(-unreadCount(), mute());
-			Notify::unreadCounterUpdated();
+		if (list == Dialogs::Mode::All) {
+			refreshUnreadState();
 		}
 	}
 }
@@ -2357,6 +2636,7 @@ History::~History() {
 }
 
 int HistoryBlock::resizeGetHeight(int newWidth, bool resizeAllItems) {
+	_width = newWidth;
 	auto y = 0;
 	for_const (auto item, items) {
 		item->setY(y);
@@ -28,6 +28,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "base/variant.h"
 #include "base/flat_set.h"
 #include "base/flags.h"
+#include "base/deadline_queue.h"
+#include "history/history_search_index.h"
 
 void HistoryInit();
 
@@ -46,9 +48,7 @@ public:
 	using Map = QHash<PeerId, History*>;
 	Map map;
 
-	Histories() : _a_typings(animation(this, &Histories::step_typings)) {
-		_selfDestructTimer.setCallback([this] { checkSelfDestructItems(); });
-	}
+	Histories();
 
 	void regSendAction(History *history, UserData *user, const MTPSendMessageAction &action, TimeId when);
 	void step_typings(TimeMs ms, bool timer);
@@ -62,28 +62,29 @@ public:
 
 	HistoryItem *addNewMessage(const MTPMessage &msg, NewMessageType type);
 
+	HistorySearchIndex &searchIndex() {
+		return _searchIndex;
+	}
+
 	typedef QMap<History*, TimeMs> TypingHistories; // when typing in this history started
 	TypingHistories typing;
 	BasicAnimation _a_typings;
 
+	// What a single history in the chat list adds to the unread totals.
+	struct UnreadState {
+		int messages = 0;
+		int mentions = 0;
+		bool muted = false;
+	};
 	int unreadBadge() const;
 	int unreadMutedCount() const {
 		return _unreadMuted;
 	}
-	bool unreadOnlyMuted() const;
-	void unreadIncrement(int32 count, bool muted) {
-		_unreadFull += count;
-		if (muted) {
-			_unreadMuted += count;
-		}
-	}
-	void unreadMuteChanged(int32 count, bool muted) {
-		if (muted) {
-			_unreadMuted += count;
-		} else {
-			_unreadMuted -= count;
-		}
+	int unreadMentionsCount() const {
+		return _unreadMentions;
 	}
+	bool unreadOnlyMuted() const;
+	void unreadStateChanged(const UnreadState &was, const UnreadState &now);
 
 	void setIsPinned(History *history, bool isPinned);
 	void clearPinned();
@@ -104,14 +105,20 @@ public:
 
 private:
 	void checkSelfDestructItems();
+	void checkInactiveHistories();
 
 	int _unreadFull = 0;
 	int _unreadMuted = 0;
+	int _unreadMentions = 0;
 	base::Observable<SendActionAnimationUpdate> _sendActionAnimationUpdated;
 	OrderedSet<History*> _pinnedDialogs;
 
 	base::Timer _selfDestructTimer;
-	std::vector<FullMsgId> _selfDestructItems;
+	base::deadline_queue<FullMsgId, TimeMs> _selfDestructItems;
+
+	base::Timer _unloadInactiveTimer;
+
+	HistorySearchIndex _searchIndex;
 
 };
 
@@ -221,6 +228,18 @@ public:
 
 	void clear(bool leaveItems = false);
 
+	// Deletes the oldest loaded blocks of a history that is not shown
+	// keeping at least leaveCount items, returns the deleted items count.
+	int unloadOldItems(int leaveCount);
+	int loadedItemsCount() const;
+
+	TimeMs lastShownTime() const {
+		return _lastShownTime;
+	}
+	void setLastShownTime(TimeMs ms) {
+		_lastShownTime = ms;
+	}
+
 	virtual ~History();
 
 	HistoryItem *addNewService(MsgId msgId, QDateTime date, const QString &text, MTPDmessage::Flags flags = 0, bool newMsg = true);
@@ -236,6 +255,10 @@ public:
 
 	void addOlderSlice(const QVector<MTPMessage> &slice);
 	void addNewerSlice(const QVector<MTPMessage> &slice);
+
+	// First message with date >= the given one, if the loaded slices prove it, or 0.
+	MsgId findMessageAtDate(TimeId date) const;
+	void removeFromDateIndex(not_null<HistoryItem*> item);
 	bool addToOverview(MediaOverviewType type, MsgId msgId, AddToOverviewMethod method);
 	void eraseFromOverview(MediaOverviewType type, MsgId msgId);
 
@@ -308,6 +331,14 @@ public:
 
 	int resizeGetHeight(int newWidth);
 
+	// Relayouts only the blocks near [visibleTop, visibleBottom) of the
+	// current layout, other blocks keep their heights for the previous
+	// width until the full resizeGetHeight() is called.
+	int resizeGetHeight(int newWidth, int visibleTop, int visibleBottom);
+	bool hasStaleBlocks() const {
+		return _flags & Flag::f_has_stale_blocks;
+	}
+
 	void removeNotification(HistoryItem *item) {
 		if (!notifies.isEmpty()) {
 			for (auto i = notifies.begin(), e = notifies.end(); i != e; ++i) {
@@ -348,6 +379,9 @@ public:
 	bool updateSendActionNeedsAnimating(UserData *user, const MTPSendMessageAction &action);
 	bool mySendActionUpdated(SendAction::Type type, bool doing);
 	bool paintSendAction(Painter &p, int x, int y, int availableWidth, int outerWidth, style::color color, TimeMs ms);
+	bool hasSendAction() const {
+		return static_cast<bool>(_sendActionAnimation);
+	}
 
 	void clearLastKeyboard();
 
@@ -545,9 +579,20 @@ private:
 	// Add all items to the media overview if we were not loaded at bottom and now are.
 	void checkAddAllToOverview();
 
+	// Applies the difference from the last counted state to the global unread totals.
+	void refreshUnreadState();
+
+	// Messages of the received slices by (date, id), the value tells that
+	// the message before it was received as well, it outlives unloading.
+	using DateIndexKey = std::pair<TimeId, MsgId>;
+	void addSliceToDateIndex(const QVector<MTPMessage> &slice, bool oldestHasPrevious);
+	void setHasPreviousInDateIndex(HistoryItem *item);
+	std::map<DateIndexKey, bool> _dateIndex;
+
 	enum class Flag {
 		f_has_pending_resized_items = (1 << 0),
 		f_pending_resize            = (1 << 1),
+		f_has_stale_blocks          = (1 << 2),
 	};
 	using Flags = base::flags<Flag>;
 	friend inline constexpr auto is_flag_type(Flag) { return true; };
@@ -555,6 +600,8 @@ private:
 	Flags _flags = 0;
 	bool _mute = false;
 	int _unreadCount = 0;
+	Histories::UnreadState _unreadState; // Counted in App::histories() totals.
+	TimeMs _lastShownTime = 0;
 
 	base::optional<int> _unreadMentionsCount;
 	base::flat_set<MsgId> _unreadMentions;
@@ -667,6 +714,11 @@ public:
 	int height() const {
 		return _height;
 	}
+
+	// Width of the last layout of the items in this block.
+	int width() const {
+		return _width;
+	}
 	not_null<History*> history() const {
 		return _history;
 	}
@@ -696,6 +748,7 @@ protected:
 	const not_null<History*> _history;
 
 	int _y = 0;
+	int _width = 0;
 	int _height = 0;
 	int _indexInHistory = -1;
 
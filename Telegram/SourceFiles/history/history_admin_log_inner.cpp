@@ -328,8 +328,8 @@ void InnerWidget::applyFilter(FilterValue &&value) {
 
 void InnerWidget::applySearch(const QString &query) {
 	auto clearQuery = query.trimmed();
-	if (_searchQuery != query) {
-		_searchQuery = query;
+	if (_searchQuery != clearQuery) {
+		_searchQuery = clearQuery;
 		clearAndRequestLog();
 	}
 }
@@ -575,7 +575,33 @@ void InnerWidget::itemsAdded(Direction direction, int addedCount) {
 			}
 		}
 	}
-	updateSize();
+
+	// Only the added items and their neighbours need a new layout,
+	// the rest of the already loaded items are just moved.
+	auto layoutFrom = (checkFrom > 0) ? (checkFrom - 1) : 0;
+	auto layoutTill = qMin(checkTo, _items.size());
+	for (auto i = layoutFrom; i != layoutTill; ++i) {
+		_items[i]->resizeGetHeight(width());
+	}
+	updateItemsGeometry();
+}
+
+void InnerWidget::updateItemsGeometry() {
+	auto newHeight = 0;
+	for (auto &item : base::reversed(_items)) {
+		item->setY(newHeight);
+		newHeight += item->height();
+	}
+	_itemsHeight = newHeight;
+	_itemsTop = (_minHeight > _itemsHeight + st::historyPaddingBottom) ? (_minHeight - _itemsHeight - st::historyPaddingBottom) : 0;
+	auto fullHeight = _itemsTop + _itemsHeight + st::historyPaddingBottom;
+	if (fullHeight != height()) {
+		resize(width(), fullHeight);
+	}
+	update();
+	restoreScrollPosition();
+	updateVisibleTopItem();
+	checkPreloadMore();
 }
 
 void InnerWidget::updateSize() {
@@ -138,6 +138,7 @@ private:
 	void updateVisibleTopItem();
 	void preloadMore(Direction direction);
 	void itemsAdded(Direction direction, int addedCount);
+	void updateItemsGeometry();
 	void updateSize();
 	void updateMinMaxIds();
 	void updateEmptyText();
@@ -0,0 +1,255 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "history/history_export.h"
+
+namespace HistoryExport {
+namespace {
+
+constexpr auto kMessagesPerPage = 100; // server limit for messages.getHistory
+
+QString mediaType(const MTPMessageMedia &media) {
+	switch (media.type()) {
+	case mtpc_messageMediaPhoto: return qsl("photo");
+	case mtpc_messageMediaGeo: return qsl("location");
+	case mtpc_messageMediaContact: return qsl("contact");
+	case mtpc_messageMediaDocument: return qsl("document");
+	case mtpc_messageMediaWebPage: return qsl("webpage");
+	case mtpc_messageMediaVenue: return qsl("venue");
+	case mtpc_messageMediaGame: return qsl("game");
+	case mtpc_messageMediaInvoice: return qsl("invoice");
+	}
+	return QString();
+}
+
+QString mediaCaption(const MTPMessageMedia &media) {
+	switch (media.type()) {
+	case mtpc_messageMediaPhoto: {
+		auto &data = media.c_messageMediaPhoto();
+		return data.has_caption() ? qs(data.vcaption) : QString();
+	} break;
+	case mtpc_messageMediaDocument: {
+		auto &data = media.c_messageMediaDocument();
+		return data.has_caption() ? qs(data.vcaption) : QString();
+	} break;
+	}
+	return QString();
+}
+
+QString actionType(const MTPMessageAction &action) {
+	switch (action.type()) {
+	case mtpc_messageActionChatCreate: return qsl("chat_create");
+	case mtpc_messageActionChatEditTitle: return qsl("edit_title");
+	case mtpc_messageActionChatEditPhoto: return qsl("edit_photo");
+	case mtpc_messageActionChatDeletePhoto: return qsl("delete_photo");
+	case mtpc_messageActionChatAddUser: return qsl("add_user");
+	case mtpc_messageActionChatDeleteUser: return qsl("delete_user");
+	case mtpc_messageActionChatJoinedByLink: return qsl("joined_by_link");
+	case mtpc_messageActionChannelCreate: return qsl("channel_create");
+	case mtpc_messageActionChatMigrateTo: return qsl("migrate_to");
+	case mtpc_messageActionChannelMigrateFrom: return qsl("migrate_from");
+	case mtpc_messageActionPinMessage: return qsl("pin_message");
+	case mtpc_messageActionHistoryClear: return qsl("history_clear");
+	case mtpc_messageActionGameScore: return qsl("game_score");
+	case mtpc_messageActionPaymentSent: return qsl("payment_sent");
+	case mtpc_messageActionPhoneCall: return qsl("phone_call");
+	case mtpc_messageActionScreenshotTaken: return qsl("screenshot_taken");
+	}
+	return qsl("other");
+}
+
+QString senderName(int32 fromId) {
+	if (auto peer = App::peerLoaded(peerFromUser(fromId))) {
+		return App::peerName(peer);
+	}
+	return QString();
+}
+
+} // namespace
+
+Exporter::Exporter(not_null<PeerData*> peer, const QString &path, DoneCallback done)
+: _peer(peer)
+, _path(path)
+, _done(std::move(done))
+, _file(path) {
+}
+
+void Exporter::start() {
+	auto resumed = readCheckpoint();
+	auto mode = resumed ? QIODevice::ReadWrite : (QIODevice::WriteOnly | QIODevice::Truncate);
+	if (!_file.open(mode)) {
+		finish(false);
+		return;
+	}
+	if (resumed) {
+		// Drop anything written after the last saved checkpoint.
+		_file.resize(_file.size() < _checkpointSize ? _file.size() : _checkpointSize);
+		_file.seek(_file.size());
+	}
+	requestNextPage();
+}
+
+QString Exporter::checkpointPath() const {
+	return _path + qsl(".checkpoint");
+}
+
+bool Exporter::readCheckpoint() {
+	QFile checkpoint(checkpointPath());
+	if (!checkpoint.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	auto values = QString::fromLatin1(checkpoint.readAll()).split(' ');
+	if (values.size() != 4 || values[0].toULongLong() != _peer->id) {
+		return false;
+	}
+	_offsetId = values[1].toInt();
+	_checkpointSize = values[2].toLongLong();
+	_count = values[3].toInt();
+	return (_offsetId > 0);
+}
+
+void Exporter::writeCheckpoint() {
+	_file.flush();
+	QFile checkpoint(checkpointPath());
+	if (checkpoint.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		checkpoint.write(qsl("%1 %2 %3 %4").arg(_peer->id).arg(_offsetId).arg(_file.size()).arg(_count).toLatin1());
+	}
+}
+
+void Exporter::requestNextPage() {
+	// Pages are requested one by one through the background session, so the
+	// export never competes with the history the user is looking at.
+	request(MTPmessages_GetHistory(_peer->input, MTP_int(_offsetId), MTP_int(0), MTP_int(0), MTP_int(kMessagesPerPage), MTP_int(0), MTP_int(0))).toDC(MTP::backgroundDcId(0)).done([this](const MTPmessages_Messages &result) {
+		pageReceived(result);
+	}).fail([this](const RPCError &error) {
+		pageFailed(error);
+	}).send();
+}
+
+void Exporter::pageReceived(const MTPmessages_Messages &result) {
+	auto handle = [this](const MTPVector<MTPMessage> &messages, const MTPVector<MTPChat> &chats, const MTPVector<MTPUser> &users) {
+		App::feedUsers(users);
+		App::feedChats(chats);
+		return &messages.v;
+	};
+	auto messages = [&]() -> const QVector<MTPMessage>* {
+		switch (result.type()) {
+		case mtpc_messages_messages: {
+			auto &d = result.c_messages_messages();
+			return handle(d.vmessages, d.vchats, d.vusers);
+		} break;
+		case mtpc_messages_messagesSlice: {
+			auto &d = result.c_messages_messagesSlice();
+			return handle(d.vmessages, d.vchats, d.vusers);
+		} break;
+		case mtpc_messages_channelMessages: {
+			auto &d = result.c_messages_channelMessages();
+			return handle(d.vmessages, d.vchats, d.vusers);
+		} break;
+		}
+		return nullptr;
+	}();
+	if (!messages) {
+		finish(false);
+		return;
+	}
+	if (messages->isEmpty()) {
+		finish(true);
+		return;
+	}
+	for (auto &message : *messages) {
+		writeMessage(message);
+	}
+	auto lastId = idFromMessage(messages->back());
+	if (lastId <= 1 || (_offsetId > 0 && lastId >= _offsetId)) {
+		finish(true);
+		return;
+	}
+	_offsetId = lastId;
+	writeCheckpoint();
+	requestNextPage();
+}
+
+void Exporter::pageFailed(const RPCError &error) {
+	// FLOOD_WAIT and server errors never get here, they are retried by
+	// MTP::Instance. Anything else keeps the checkpoint for a later resume.
+	finish(false);
+}
+
+void Exporter::writeMessage(const MTPMessage &message) {
+	auto object = QJsonObject();
+	switch (message.type()) {
+	case mtpc_message: {
+		auto &d = message.c_message();
+		object.insert(qsl("id"), d.vid.v);
+		object.insert(qsl("date"), d.vdate.v);
+		if (d.has_from_id()) {
+			object.insert(qsl("from_id"), d.vfrom_id.v);
+			object.insert(qsl("from"), senderName(d.vfrom_id.v));
+		}
+		if (d.has_reply_to_msg_id()) {
+			object.insert(qsl("reply_to"), d.vreply_to_msg_id.v);
+		}
+		if (d.has_edit_date()) {
+			object.insert(qsl("edit_date"), d.vedit_date.v);
+		}
+		object.insert(qsl("text"), qs(d.vmessage));
+		if (d.has_media()) {
+			auto type = mediaType(d.vmedia);
+			if (!type.isEmpty()) {
+				object.insert(qsl("media"), type);
+			}
+			auto caption = mediaCaption(d.vmedia);
+			if (!caption.isEmpty()) {
+				object.insert(qsl("caption"), caption);
+			}
+		}
+	} break;
+	case mtpc_messageService: {
+		auto &d = message.c_messageService();
+		object.insert(qsl("id"), d.vid.v);
+		object.insert(qsl("date"), d.vdate.v);
+		if (d.has_from_id()) {
+			object.insert(qsl("from_id"), d.vfrom_id.v);
+			object.insert(qsl("from"), senderName(d.vfrom_id.v));
+		}
+		object.insert(qsl("action"), actionType(d.vaction));
+	} break;
+	default: return;
+	}
+	_file.write(QJsonDocument(object).toJson(QJsonDocument::Compact));
+	_file.write("\n", 1);
+	++_count;
+}
+
+void Exporter::finish(bool success) {
+	if (_file.isOpen()) {
+		_file.close();
+	}
+	if (success) {
+		QFile::remove(checkpointPath());
+	}
+	// The callback may destroy the exporter, so don't touch members after it.
+	if (auto done = base::take(_done)) {
+		done(success, _count);
+	}
+}
+
+} // namespace HistoryExport
@@ -0,0 +1,62 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include "mtproto/sender.h"
+
+namespace HistoryExport {
+
+// Writes the whole cloud history of a peer to a file, one JSON object
+// per message per line. Messages are parsed straight from the MTP
+// responses without creating HistoryItems, so exporting a large chat
+// doesn't grow the in-memory history. Progress is kept in a checkpoint
+// file next to the output, so an interrupted export continues from the
+// last written page instead of starting over.
+class Exporter : private MTP::Sender {
+public:
+	using DoneCallback = base::lambda<void(bool success, int count)>;
+	Exporter(not_null<PeerData*> peer, const QString &path, DoneCallback done);
+
+	void start();
+
+private:
+	void requestNextPage();
+	void pageReceived(const MTPmessages_Messages &result);
+	void pageFailed(const RPCError &error);
+	void writeMessage(const MTPMessage &message);
+	void finish(bool success);
+
+	bool readCheckpoint();
+	void writeCheckpoint();
+	QString checkpointPath() const;
+
+	not_null<PeerData*> _peer;
+	QString _path;
+	DoneCallback _done;
+
+	QFile _file;
+	MsgId _offsetId = 0;
+	int _count = 0;
+	qint64 _checkpointSize = 0;
+
+};
+
+} // namespace HistoryExport
@@ -41,6 +41,14 @@ namespace {
 
 constexpr auto kScrollDateHideTimeout = 1000;
 
+// Hover hit testing runs at most once in this time, high polling rate
+// mice send many more moves than we can show the result of.
+constexpr auto kHoverUpdateDelay = TimeMs(8);
+
+// Media of the next screens in the scroll direction is requested behind the visible one.
+// Scrolling faster than that part of the screen per update prefetches two screens ahead.
+constexpr auto kPrefetchFastScrollPart = 4;
+
 class DateClickHandler : public ClickHandler {
 public:
 	DateClickHandler(PeerData *peer, QDate date) : _peer(peer), _date(date) {
@@ -91,6 +99,7 @@ HistoryInner::HistoryInner(HistoryWidget *historyWidget, not_null<Window::Contro
 , _history(history)
 , _widget(historyWidget)
 , _scroll(scroll)
+, _hoverUpdateTimer([this] { hoverUpdateDelayed(); })
 , _scrollDateCheck([this] { onScrollDateCheck(); }) {
 	_touchSelectTimer.setSingleShot(true);
 	connect(&_touchSelectTimer, SIGNAL(timeout()), this, SLOT(onTouchSelect()));
@@ -155,6 +164,19 @@ void HistoryInner::repaintItem(const HistoryItem *item) {
 	}
 }
 
+void HistoryInner::repaintItemMedia(const HistoryItem *item) {
+	if (!item || item->detached() || !_history) return;
+	auto media = item->countMediaGeometry();
+	if (media.isEmpty()) {
+		repaintItem(item);
+		return;
+	}
+	int32 msgy = itemTop(item);
+	if (msgy >= 0) {
+		update(media.translated(0, msgy));
+	}
+}
+
 template <bool TopToBottom, typename Method>
 void HistoryInner::enumerateItemsInHistory(History *history, int historytop, Method method) {
 	// No displayed messages in this history.
@@ -364,6 +386,13 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 	auto clip = e->rect();
 	auto ms = getms();
 
+	// Separate damaged items (like two playing GIFs) come as one region,
+	// don't draw the items between them that lie only in its bounding rect.
+	auto region = e->region();
+	auto itemDamaged = [&region, this](int top, int height) {
+		return region.intersects(QRect(0, top, width(), height));
+	};
+
 	bool historyDisplayedEmpty = (_history->isDisplayedEmpty() && (!_migrated || _migrated->isDisplayedEmpty()));
 	bool noHistoryDisplayed = _firstLoading || historyDisplayedEmpty;
 	if (!_firstLoading && _botAbout && !_botAbout->info->text.isEmpty() && _botAbout->height > 0) {
@@ -425,7 +454,9 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 						sel = i.value();
 					}
 				}
-				item->draw(p, clip.translated(0, -y), sel, ms);
+				if (itemDamaged(y, item->height())) {
+					item->draw(p, clip.translated(0, -y), sel, ms);
+				}
 
 				if (item->hasViews()) {
 					App::main()->scheduleViewIncrement(item);
@@ -476,7 +507,9 @@ void HistoryInner::paintEvent(QPaintEvent *e) {
 							sel = i.value();
 						}
 					}
-					item->draw(p, historyRect.translated(0, -y), sel, ms);
+					if (itemDamaged(y, h)) {
+						item->draw(p, historyRect.translated(0, -y), sel, ms);
+					}
 
 					if (item->hasViews()) {
 						App::main()->scheduleViewIncrement(item);
@@ -762,9 +795,25 @@ void HistoryInner::mouseMoveEvent(QMouseEvent *e) {
 			keepScrollDateForNow();
 		}
 	}
+	if (!buttonsPressed && _mouseAction == MouseAction::None) {
+		auto now = getms();
+		if (now < _hoverUpdateLast + kHoverUpdateDelay) {
+			_mousePosition = e->globalPos();
+			if (!_hoverUpdateTimer.isActive()) {
+				_hoverUpdateTimer.callOnce(_hoverUpdateLast + kHoverUpdateDelay - now);
+			}
+			return;
+		}
+		_hoverUpdateLast = now;
+	}
 	mouseActionUpdate(e->globalPos());
 }
 
+void HistoryInner::hoverUpdateDelayed() {
+	_hoverUpdateLast = getms();
+	mouseActionUpdate(_mousePosition);
+}
+
 void HistoryInner::mouseActionUpdate(const QPoint &screenPos) {
 	_mousePosition = screenPos;
 	onUpdateSelected();
@@ -1527,35 +1576,29 @@ TextWithEntities HistoryInner::getSelectedText() const {
 		return sel.cbegin().key()->selectedText(sel.cbegin().value());
 	}
 
-	int fullSize = 0;
-	QString timeFormat(qsl(", [dd.MM.yy hh:mm]\n"));
-	QMap<int, TextWithEntities> texts;
+	// Items are ordered by their position first, so that each item text
+	// is appended right to the result instead of keeping a copy of it.
+	QMap<int, HistoryItem*> items;
 	for (auto i = sel.cbegin(), e = sel.cend(); i != e; ++i) {
-		HistoryItem *item = i.key();
+		auto item = i.key();
 		if (item->detached()) continue;
 
-		QString time = item->date.toString(timeFormat);
-		TextWithEntities part, unwrapped = item->selectedText(FullSelection);
-		int size = item->author()->name.size() + time.size() + unwrapped.text.size();
-		part.text.reserve(size);
-
-		int y = itemTop(item);
+		auto y = itemTop(item);
 		if (y >= 0) {
-			part.text.append(item->author()->name).append(time);
-			TextUtilities::Append(part, std::move(unwrapped));
-			texts.insert(y, part);
-			fullSize += size;
+			items.insert(y, item);
 		}
 	}
 
 	TextWithEntities result;
+	QString timeFormat(qsl(", [dd.MM.yy hh:mm]\n"));
 	auto sep = qsl("\n\n");
-	result.text.reserve(fullSize + (texts.size() - 1) * sep.size());
-	for (auto i = texts.begin(), e = texts.end(); i != e; ++i) {
-		TextUtilities::Append(result, std::move(i.value()));
-		if (i + 1 != e) {
+	for (auto i = items.cbegin(), e = items.cend(); i != e; ++i) {
+		auto item = i.value();
+		if (i != items.cbegin()) {
 			result.text.append(sep);
 		}
+		result.text.append(item->author()->name).append(item->date.toString(timeFormat));
+		TextUtilities::Append(result, item->selectedText(FullSelection));
 	}
 	return result;
 }
@@ -1586,9 +1629,19 @@ void HistoryInner::recountHeight() {
 		accumulate_max(oldHistoryPaddingTop, st::msgMargin.top() + st::msgMargin.bottom() + st::msgPadding.top() + st::msgPadding.bottom() + st::msgNameFont->height + st::botDescSkip + _botAbout->height);
 	}
 
-	_history->resizeGetHeight(_scroll->width());
+	// Only the visible part is relayouted immediately on width change.
+	auto resizeHistory = [this](not_null<History*> history, int top) {
+		if (top >= 0) {
+			history->resizeGetHeight(_scroll->width(), _visibleAreaTop - top, _visibleAreaBottom - top);
+		} else {
+			history->resizeGetHeight(_scroll->width());
+		}
+	};
+	auto wasHistoryTop = historyTop();
+	auto wasMigratedTop = migratedTop();
+	resizeHistory(_history, wasHistoryTop);
 	if (_migrated) {
-		_migrated->resizeGetHeight(_scroll->width());
+		resizeHistory(_migrated, wasMigratedTop);
 	}
 
 	// with migrated history we perhaps do not need to display first _history message
@@ -1695,6 +1748,7 @@ void HistoryInner::setFirstLoading(bool loading) {
 
 void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	auto scrolledUp = (top < _visibleAreaTop);
+	auto scrolledBy = std::abs(top - _visibleAreaTop);
 	_visibleAreaTop = top;
 	_visibleAreaBottom = bottom;
 
@@ -1703,6 +1757,8 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 		return;
 	}
 
+	prefetchMedia(scrolledUp, scrolledBy);
+
 	if (bottom >= _historyPaddingTop + historyHeight() + st::historyPaddingBottom) {
 		_history->forgetScrollState();
 		if (_migrated) {
@@ -1732,6 +1788,51 @@ void HistoryInner::visibleAreaUpdated(int top, int bottom) {
 	}
 }
 
+void HistoryInner::prefetchMedia(bool scrolledUp, int scrolledBy) {
+	auto screen = _visibleAreaBottom - _visibleAreaTop;
+	if (screen <= 0 || !scrolledBy) {
+		return;
+	}
+	auto screens = (scrolledBy * kPrefetchFastScrollPart > screen) ? 2 : 1;
+	auto from = scrolledUp ? (_visibleAreaTop - screens * screen) : _visibleAreaBottom;
+	auto till = scrolledUp ? _visibleAreaTop : (_visibleAreaBottom + screens * screen);
+	if (_migrated) {
+		prefetchMediaInHistory(_migrated, migratedTop(), from, till);
+	}
+	prefetchMediaInHistory(_history, historyTop(), from, till);
+}
+
+void HistoryInner::prefetchMediaInHistory(History *history, int historytop, int from, int till) {
+	if (historytop < 0 || history->isEmpty()) {
+		return;
+	}
+	if (till <= historytop || historytop + history->height <= from) {
+		return;
+	}
+
+	auto blockIndex = BinarySearchBlocksOrItems<true>(history->blocks, from - historytop);
+	for (auto blocksCount = history->blocks.size(); blockIndex < blocksCount; ++blockIndex) {
+		auto block = history->blocks.at(blockIndex);
+		auto blocktop = historytop + block->y();
+		if (blocktop >= till) {
+			return;
+		}
+		auto itemIndex = BinarySearchBlocksOrItems<true>(block->items, from - blocktop);
+		for (auto itemsCount = block->items.size(); itemIndex < itemsCount; ++itemIndex) {
+			auto item = block->items.at(itemIndex);
+			auto itemtop = blocktop + item->y();
+			if (itemtop >= till) {
+				return;
+			}
+			if (itemtop + item->height() > from) {
+				if (auto media = item->getMedia()) {
+					media->automaticPrefetch();
+				}
+			}
+		}
+	}
+}
+
 bool HistoryInner::displayScrollDate() const {
 	return (_visibleAreaTop <= height() - 2 * (_visibleAreaBottom - _visibleAreaTop));
 }
@@ -1831,6 +1932,7 @@ void HistoryInner::enterEventHook(QEvent *e) {
 }
 
 void HistoryInner::leaveEventHook(QEvent *e) {
+	_hoverUpdateTimer.cancel();
 	if (auto item = App::hoveredItem()) {
 		repaintItem(item);
 		App::hoveredItem(nullptr);
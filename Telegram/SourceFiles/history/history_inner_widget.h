@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "ui/widgets/tooltip.h"
 #include "ui/widgets/scroll_area.h"
 #include "window/top_bar_widget.h"
+#include "base/timer.h"
 
 namespace Window {
 class Controller;
@@ -50,7 +51,14 @@ public:
 	void recountHeight();
 	void updateSize();
 
+	// Some blocks outside of the visible area were not relayouted
+	// for the new width yet, the next recountHeight() will do that.
+	bool hasStaleBlocks() const {
+		return (_history && _history->hasStaleBlocks()) || (_migrated && _migrated->hasStaleBlocks());
+	}
+
 	void repaintItem(const HistoryItem *item);
+	void repaintItemMedia(const HistoryItem *item);
 
 	bool canCopySelected() const;
 	bool canDeleteSelected() const;
@@ -135,6 +143,7 @@ private:
 
 	void mouseActionStart(const QPoint &screenPos, Qt::MouseButton button);
 	void mouseActionUpdate(const QPoint &screenPos);
+	void hoverUpdateDelayed();
 	void mouseActionFinish(const QPoint &screenPos, Qt::MouseButton button);
 	void mouseActionCancel();
 	void performDrag();
@@ -221,6 +230,8 @@ private:
 	TextSelectType _mouseSelectType = TextSelectType::Letters;
 	QPoint _dragStartPosition;
 	QPoint _mousePosition;
+	base::Timer _hoverUpdateTimer;
+	TimeMs _hoverUpdateLast = 0;
 	HistoryItem *_mouseActionItem = nullptr;
 	HistoryCursorState _mouseCursorState = HistoryDefaultCursorState;
 	uint16 _mouseTextSymbol = 0;
@@ -279,6 +290,10 @@ private:
 	template <bool TopToBottom, typename Method>
 	void enumerateItemsInHistory(History *history, int historytop, Method method);
 
+	// Requests the media of the items in [from, till) after all the visible ones.
+	void prefetchMedia(bool scrolledUp, int scrolledBy);
+	void prefetchMediaInHistory(History *history, int historytop, int from, int till);
+
 	template <EnumItemsDirection direction, typename Method>
 	void enumerateItems(Method method) {
 		constexpr auto TopToBottom = (direction == EnumItemsDirection::TopToBottom);
@@ -33,6 +33,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "media/media_audio.h"
 #include "messenger.h"
+#include "core/memory_stats.h"
 
 namespace {
 
@@ -614,6 +615,7 @@ HistoryItem::HistoryItem(
 , _from(from ? App::user(from) : history->peer)
 , _flags(flags | MTPDmessage_ClientFlag::f_pending_init_dimensions | MTPDmessage_ClientFlag::f_pending_resize)
 , _authorNameVersion(author()->nameVersion) {
+	Core::MemoryStats::Add(Core::MemoryStats::Category::HistoryItems, 1);
 }
 
 void HistoryItem::finishCreate() {
@@ -638,6 +640,9 @@ void HistoryItem::finishEdition(int oldKeyboardTop) {
 	}
 
 	App::historyUpdateDependent(this);
+	if (!detached()) {
+		App::histories().searchIndex().add(this);
+	}
 }
 
 void HistoryItem::finishEditionToEmpty() {
@@ -711,6 +716,7 @@ void HistoryItem::destroy() {
 
 		auto wasAtBottom = history()->loadedAtBottom();
 		_history->removeNotification(this);
+		_history->removeFromDateIndex(this);
 		detach();
 		if (history()->isChannel()) {
 			if (history()->peer->isMegagroup() && history()->peer->asChannel()->mgInfo->pinnedMsgId == id) {
@@ -1094,7 +1100,7 @@ void HistoryItem::clipCallback(Media::Clip::Notification notification) {
 
 	case NotificationRepaint: {
 		if (!reader->currentDisplayed()) {
-			Ui::repaintHistoryItem(this);
+			Ui::repaintHistoryItemMedia(this);
 		}
 	} break;
 	}
@@ -1207,6 +1213,7 @@ void HistoryItem::drawInDialog(
 }
 
 HistoryItem::~HistoryItem() {
+	Core::MemoryStats::Add(Core::MemoryStats::Category::HistoryItems, -1);
 	App::historyUnregItem(this);
 	if (id < 0 && !App::quitting()) {
 		Auth().uploader().cancel(fullId());
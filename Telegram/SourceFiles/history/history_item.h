@@ -674,6 +674,12 @@ public:
 		return false;
 	}
 
+	// Media rect inside the item, empty if the media can't be repainted
+	// without the rest of the item.
+	virtual QRect countMediaGeometry() const {
+		return QRect();
+	}
+
 	void previousItemChanged();
 	void nextItemChanged();
 
@@ -20,10 +20,6 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
-void initLocationManager();
-void reinitLocationManager();
-void deinitLocationManager();
-
 class LocationCoords {
 public:
 	LocationCoords() = default;
@@ -72,12 +68,11 @@ private:
 };
 
 struct LocationData {
-	LocationData(const LocationCoords &coords) : coords(coords), loading(false) {
+	LocationData(const LocationCoords &coords) : coords(coords) {
 	}
 
 	LocationCoords coords;
 	ImagePtr thumb;
-	bool loading;
 
 	void load();
 };
@@ -112,31 +107,3 @@ private:
 	QString _text;
 
 };
-
-class LocationManager : public QObject {
-	Q_OBJECT
-
-public:
-	void init();
-	void reinit();
-	void deinit();
-
-	void getData(LocationData *data);
-
-	~LocationManager() {
-		deinit();
-	}
-
-public slots:
-	void onFinished(QNetworkReply *reply);
-	void onFailed(QNetworkReply *reply);
-
-private:
-	void failed(LocationData *data);
-
-	QNetworkAccessManager *manager = nullptr;
-	QMap<QNetworkReply*, LocationData*> dataLoadings, imageLoadings;
-	QMap<LocationData*, int32> serverRedirects;
-	ImagePtr *notLoadedPlaceholder = nullptr;
-
-};
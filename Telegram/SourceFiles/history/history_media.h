@@ -74,6 +74,11 @@ public:
 	virtual void updatePressed(QPoint point) {
 	}
 
+	// Starts the automatic download of a not yet visible media
+	// behind the visible ones, if the settings allow it.
+	virtual void automaticPrefetch() const {
+	}
+
 	virtual int32 addToOverview(AddToOverviewMethod method) {
 		return 0;
 	}
@@ -174,7 +174,7 @@ void HistoryFileMedia::clickHandlerActiveChanged(const ClickHandlerPtr &p, bool
 }
 
 void HistoryFileMedia::thumbAnimationCallback() {
-	Ui::repaintHistoryItem(_parent);
+	Ui::repaintHistoryItemMedia(_parent);
 }
 
 void HistoryFileMedia::clickHandlerPressedChanged(const ClickHandlerPtr &p, bool pressed) {
@@ -204,7 +204,7 @@ void HistoryFileMedia::setStatusSize(int32 newSize, int32 fullSize, int32 durati
 
 void HistoryFileMedia::step_radial(TimeMs ms, bool timer) {
 	if (timer) {
-		Ui::repaintHistoryItem(_parent);
+		Ui::repaintHistoryItemMedia(_parent);
 	} else {
 		_animation->radial.update(dataProgress(), dataFinished(), ms);
 		if (!_animation->radial.animating()) {
@@ -399,8 +399,9 @@ void HistoryPhoto::draw(Painter &p, const QRect &r, TextSelection selection, Tim
 		auto roundCorners = inWebPage ? ImageRoundCorner::All : ((isBubbleTop() ? (ImageRoundCorner::TopLeft | ImageRoundCorner::TopRight) : ImageRoundCorner::None)
 			| ((isBubbleBottom() && _caption.isEmpty()) ? (ImageRoundCorner::BottomLeft | ImageRoundCorner::BottomRight) : ImageRoundCorner::None));
 		if (loaded) {
-			pix = _data->full->pixSingle(_pixw, _pixh, width, height, roundRadius, roundCorners);
-		} else {
+			pix = _data->full->pixSingleAsync(_parent, _pixw, _pixh, width, height, roundRadius, roundCorners);
+		}
+		if (pix.isNull()) {
 			pix = _data->thumb->pixBlurredSingle(_pixw, _pixh, width, height, roundRadius, roundCorners);
 		}
 		p.drawPixmap(rthumb.topLeft(), pix);
@@ -1975,7 +1976,8 @@ void HistoryGif::draw(Painter &p, const QRect &r, TextSelection selection, TimeM
 	auto selected = (selection == FullSelection);
 
 	auto videoFinished = _gif && (_gif->mode() == Media::Clip::Reader::Mode::Video) && (_gif->state() == Media::Clip::State::Finished);
-	if (loaded && cAutoPlayGif() && ((!_gif && !_gif.isBad()) || videoFinished)) {
+	auto autoplay = cAutoPlayGif() && !Calls::Current().performanceMode();
+	if (loaded && autoplay && ((!_gif && !_gif.isBad()) || videoFinished)) {
 		Ui::autoplayMediaInlineAsync(_parent->fullId());
 	}
 
@@ -2081,7 +2083,7 @@ void HistoryGif::draw(Painter &p, const QRect &r, TextSelection selection, TimeM
 		App::complexOverlayRect(p, rthumb, roundRadius, roundCorners);
 	}
 
-	if (radial || _gif.isBad() || (!_gif && ((!loaded && !_data->loading()) || !cAutoPlayGif()))) {
+	if (radial || _gif.isBad() || (!_gif && ((!loaded && !_data->loading()) || !autoplay))) {
 		auto radialOpacity = (radial && loaded && _parent->id > 0) ? _animation->radial.opacity() : 1.;
 		auto inner = QRect(rthumb.x() + (rthumb.width() - st::msgFileSize) / 2, rthumb.y() + (rthumb.height() - st::msgFileSize) / 2, st::msgFileSize, st::msgFileSize);
 		p.setPen(Qt::NoPen);
@@ -2573,7 +2575,7 @@ bool HistoryGif::playInline(bool autoplay) {
 		if (mode == Mode::Video) {
 			_roundPlayback = std::make_unique<Media::Clip::Playback>();
 			_roundPlayback->setValueChangedCallback([this](float64 value) {
-				Ui::repaintHistoryItem(_parent);
+				Ui::repaintHistoryItemMedia(_parent);
 			});
 			if (App::main()) {
 				App::main()->mediaMarkRead(_data);
@@ -2719,10 +2721,11 @@ void HistorySticker::draw(Painter &p, const QRect &r, TextSelection selection, T
 			p.drawPixmap(QPoint(usex + (usew - _pixw) / 2, (_minh - _pixh) / 2), sticker->img->pixColored(st::msgStickerOverlay, _pixw, _pixh));
 		}
 	} else {
-		if (sticker->img->isNull()) {
+		auto pixmap = sticker->img->isNull() ? QPixmap() : sticker->img->pixSingleAsync(_parent, _pixw, _pixh, _pixw, _pixh, ImageRoundRadius::None);
+		if (pixmap.isNull()) {
 			p.drawPixmap(QPoint(usex + (usew - _pixw) / 2, (_minh - _pixh) / 2), _data->thumb->pixBlurred(_pixw, _pixh));
 		} else {
-			p.drawPixmap(QPoint(usex + (usew - _pixw) / 2, (_minh - _pixh) / 2), sticker->img->pix(_pixw, _pixh));
+			p.drawPixmap(QPoint(usex + (usew - _pixw) / 2, (_minh - _pixh) / 2), pixmap);
 		}
 	}
 
@@ -3432,11 +3435,11 @@ int HistoryWebPage::resizeGetHeight(int width) {
 				_height += _titleLines * lineHeight;
 			}
 
-			auto descriptionHeight = _description.countHeight(wleft);
-			if (descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
+			_descriptionHeight = _description.countHeight(wleft);
+			if (_descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
 				// We have height for all the lines.
 				_descriptionLines = -1;
-				_height += descriptionHeight;
+				_height += _descriptionHeight;
 			} else {
 				_descriptionLines = (linesMax - siteNameLines - _titleLines);
 				_height += _descriptionLines * lineHeight;
@@ -3466,11 +3469,11 @@ int HistoryWebPage::resizeGetHeight(int width) {
 		if (_description.isEmpty()) {
 			_descriptionLines = 0;
 		} else {
-			auto descriptionHeight = _description.countHeight(width);
-			if (descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
+			_descriptionHeight = _description.countHeight(width);
+			if (_descriptionHeight < (linesMax - siteNameLines - _titleLines) * st::webPageDescriptionFont->height) {
 				// We have height for all the lines.
 				_descriptionLines = -1;
-				_height += descriptionHeight;
+				_height += _descriptionHeight;
 			} else {
 				_descriptionLines = (linesMax - siteNameLines - _titleLines);
 				_height += _descriptionLines * lineHeight;
@@ -3576,7 +3579,7 @@ void HistoryWebPage::draw(Painter &p, const QRect &r, TextSelection selection, T
 			tshift += _descriptionLines * lineHeight;
 		} else {
 			_description.drawLeft(p, padding.left(), tshift, width, _width, style::al_left, 0, -1, toDescriptionSelection(selection));
-			tshift += _description.countHeight(width);
+			tshift += _descriptionHeight;
 		}
 	}
 	if (_attach) {
@@ -3664,7 +3667,7 @@ HistoryTextState HistoryWebPage::getState(QPoint point, HistoryStateRequest requ
 		tshift += _titleLines * lineHeight;
 	}
 	if (_descriptionLines) {
-		auto descriptionHeight = (_descriptionLines > 0) ? _descriptionLines * lineHeight : _description.countHeight(width);
+		auto descriptionHeight = (_descriptionLines > 0) ? _descriptionLines * lineHeight : _descriptionHeight;
 		if (point.y() >= tshift && point.y() < tshift + descriptionHeight) {
 			if (_descriptionLines > 0) {
 				Text::StateRequestElided descriptionRequest = request.forText();
@@ -4702,7 +4705,7 @@ void HistoryLocation::draw(Painter &p, const QRect &r, TextSelection selection,
 	auto roundCorners = ((isBubbleTop() && _title.isEmpty() && _description.isEmpty()) ? (ImageRoundCorner::TopLeft | ImageRoundCorner::TopRight) : ImageRoundCorner::None)
 		| (isBubbleBottom() ? (ImageRoundCorner::BottomLeft | ImageRoundCorner::BottomRight) : ImageRoundCorner::None);
 	auto rthumb = QRect(skipx, skipy, width, height);
-	if (_data && !_data->thumb->isNull()) {
+	if (_data && _data->thumb->loaded()) {
 		int32 w = _data->thumb->width(), h = _data->thumb->height();
 		QPixmap pix;
 		if (width * h == height * w || (w == fullWidth() && h == fullHeight())) {
@@ -139,6 +139,9 @@ public:
 
 	void draw(Painter &p, const QRect &r, TextSelection selection, TimeMs ms) const override;
 	HistoryTextState getState(QPoint point, HistoryStateRequest request) const override;
+	void automaticPrefetch() const override {
+		_data->automaticLoad(_parent, false);
+	}
 
 	TextSelection adjustSelection(TextSelection selection, TextSelectType type) const override WARN_UNUSED_RESULT {
 		return _caption.adjustSelection(selection, type);
@@ -599,6 +602,9 @@ public:
 
 	void draw(Painter &p, const QRect &r, TextSelection selection, TimeMs ms) const override;
 	HistoryTextState getState(QPoint point, HistoryStateRequest request) const override;
+	void automaticPrefetch() const override {
+		_data->automaticLoad(_parent, false);
+	}
 
 	bool toggleSelectionByHandlerClick(const ClickHandlerPtr &p) const override {
 		return true;
@@ -865,6 +871,9 @@ private:
 	bool _asArticle = false;
 	int32 _titleLines, _descriptionLines;
 
+	// Full description height for the current width, counted in resizeGetHeight().
+	int _descriptionHeight = 0;
+
 	Text _title, _description;
 	int32 _siteNameWidth = 0;
 
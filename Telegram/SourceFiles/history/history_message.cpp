@@ -176,6 +176,7 @@ void FastShareMessage(not_null<HistoryItem*> item) {
 		}
 		FullMsgId msgId;
 		OrderedSet<mtpRequestId> requests;
+		bool failed = false;
 	};
 	auto data = MakeShared<ShareData>(item->fullId());
 	auto isGame = item->getMessageBot() && item->getMedia() && (item->getMedia()->type() == MediaTypeGame);
@@ -239,16 +240,32 @@ void FastShareMessage(not_null<HistoryItem*> item) {
 			return;
 		}
 
-		auto doneCallback = [data](const MTPUpdates &updates, mtpRequestId requestId) {
-			if (auto main = App::main()) {
-				main->sentUpdatesReceived(updates);
-			}
+		auto requestFinished = [data](mtpRequestId requestId) {
 			data->requests.remove(requestId);
 			if (data->requests.empty()) {
-				Ui::Toast::Show(lang(lng_share_done));
+				Ui::Toast::Show(lang(data->failed
+					? lng_share_failed_some
+					: lng_share_done));
 				Ui::hideLayer();
 			}
 		};
+		auto doneCallback = [=](const MTPUpdates &updates, mtpRequestId requestId) {
+			if (auto main = App::main()) {
+				main->sentUpdatesReceived(updates);
+			}
+			requestFinished(requestId);
+		};
+
+		// Flood waits are delayed and resent by MTP::Instance itself,
+		// any other error only drops this destination.
+		auto failCallback = [=](const RPCError &error, mtpRequestId requestId) {
+			if (MTP::isDefaultHandledError(error)) {
+				return false;
+			}
+			data->failed = true;
+			requestFinished(requestId);
+			return true;
+		};
 
 		auto sendFlags = MTPmessages_ForwardMessages::Flag::f_with_my_score;
 		MTPVector<MTPint> msgIds = MTP_vector<MTPint>(1, MTP_int(data->msgId.msg));
@@ -261,7 +278,8 @@ void FastShareMessage(not_null<HistoryItem*> item) {
 				MTPVector<MTPlong> random = MTP_vector<MTPlong>(1, rand_value<MTPlong>());
 				auto request = MTPmessages_ForwardMessages(MTP_flags(sendFlags), item->history()->peer->input, msgIds, random, peer->input);
 				auto callback = doneCallback;
-				auto requestId = MTP::send(request, rpcDone(std::move(callback)));
+				auto fail = failCallback;
+				auto requestId = MTP::send(request, rpcDone(std::move(callback)), rpcFail(std::move(fail)));
 				data->requests.insert(requestId);
 			}
 		}
@@ -1086,7 +1104,7 @@ void HistoryMessage::initDimensions() {
 			// Count parts in maxWidth(), don't count them in minHeight().
 			// They will be added in resizeGetHeight() anyway.
 			if (displayFromName()) {
-				auto namew = st::msgPadding.left() + author()->nameText.maxWidth() + st::msgPadding.right();
+				auto namew = st::msgPadding.left() + author()->nameText().maxWidth() + st::msgPadding.right();
 				if (via && !forwarded) {
 					namew += st::msgServiceFont->spacew + via->_maxWidth;
 				}
@@ -1166,11 +1184,50 @@ QRect HistoryMessage::countGeometry() const {
 	return QRect(contentLeft, contentTop, contentWidth, _height - contentTop - marginBottom());
 }
 
+QRect HistoryMessage::countMediaGeometry() const {
+	if (!_media || !_media->isDisplayed()) {
+		return QRect();
+	}
+	auto g = countGeometry();
+	if (g.width() < 1) {
+		return QRect();
+	}
+	if (auto keyboard = inlineReplyKeyboard()) {
+		g.setHeight(g.height() - (st::msgBotKbButton.margin + keyboard->naturalHeight()));
+	}
+	auto mediaHeight = _media->height();
+	if (!drawBubble()) {
+		return QRect(g.left(), g.top(), g.width(), mediaHeight);
+	}
+
+	// Same layout as in draw(), but only for the cases when the media
+	// position doesn't depend on the name, forwarded and reply headers.
+	auto entry = Get<HistoryMessageLogEntryOriginal>();
+	auto mediaOnBottom = _media->isBubbleBottom() || entry;
+	auto mediaOnTop = _media->isBubbleTop() || (entry && entry->_page->isBubbleTop());
+	auto trect = g.marginsRemoved(st::msgPadding);
+	if (mediaOnBottom) {
+		trect.setHeight(trect.height() + st::msgPadding.bottom());
+	}
+	if (mediaOnTop) {
+		trect.setY(trect.y() - st::msgPadding.top());
+	}
+	if (entry) {
+		trect.setHeight(trect.height() - entry->_page->height());
+	}
+	if (!_media->isAboveMessage()) {
+		return QRect(g.left(), trect.y() + trect.height() - mediaHeight, g.width(), mediaHeight);
+	} else if (mediaOnTop) {
+		return QRect(g.left(), trect.y(), g.width(), mediaHeight);
+	}
+	return QRect();
+}
+
 void HistoryMessage::fromNameUpdated(int32 width) const {
 	_authorNameVersion = author()->nameVersion;
 	if (!Has<HistoryMessageForwarded>()) {
 		if (auto via = Get<HistoryMessageVia>()) {
-			via->resize(width - st::msgPadding.left() - st::msgPadding.right() - author()->nameText.maxWidth() - st::msgServiceFont->spacew);
+			via->resize(width - st::msgPadding.left() - st::msgPadding.right() - author()->nameText().maxWidth() - st::msgServiceFont->spacew);
 		}
 	}
 }
@@ -1748,14 +1805,14 @@ void HistoryMessage::paintFromName(Painter &p, QRect &trect, bool selected) cons
 		} else {
 			p.setPen(selected ? fromNameFgSelected(author()->colorIndex()) : fromNameFg(author()->colorIndex()));
 		}
-		author()->nameText.drawElided(p, trect.left(), trect.top(), trect.width());
+		author()->nameText().drawElided(p, trect.left(), trect.top(), trect.width());
 
 		auto forwarded = Get<HistoryMessageForwarded>();
 		auto via = Get<HistoryMessageVia>();
-		if (via && !forwarded && trect.width() > author()->nameText.maxWidth() + st::msgServiceFont->spacew) {
+		if (via && !forwarded && trect.width() > author()->nameText().maxWidth() + st::msgServiceFont->spacew) {
 			bool outbg = out() && !isPost();
 			p.setPen(selected ? (outbg ? st::msgOutServiceFgSelected : st::msgInServiceFgSelected) : (outbg ? st::msgOutServiceFg : st::msgInServiceFg));
-			p.drawText(trect.left() + author()->nameText.maxWidth() + st::msgServiceFont->spacew, trect.top() + st::msgServiceFont->ascent, via->_text);
+			p.drawText(trect.left() + author()->nameText().maxWidth() + st::msgServiceFont->spacew, trect.top() + st::msgServiceFont->ascent, via->_text);
 		}
 		trect.setY(trect.y() + st::msgNameFont->height);
 	}
@@ -2130,13 +2187,13 @@ void HistoryMessage::updatePressed(QPoint point) {
 bool HistoryMessage::getStateFromName(QPoint point, QRect &trect, HistoryTextState *outResult) const {
 	if (displayFromName()) {
 		if (point.y() >= trect.top() && point.y() < trect.top() + st::msgNameFont->height) {
-			if (point.x() >= trect.left() && point.x() < trect.left() + trect.width() && point.x() < trect.left() + author()->nameText.maxWidth()) {
+			if (point.x() >= trect.left() && point.x() < trect.left() + trect.width() && point.x() < trect.left() + author()->nameText().maxWidth()) {
 				outResult->link = author()->openLink();
 				return true;
 			}
 			auto forwarded = Get<HistoryMessageForwarded>();
 			auto via = Get<HistoryMessageVia>();
-			if (via && !forwarded && point.x() >= trect.left() + author()->nameText.maxWidth() + st::msgServiceFont->spacew && point.x() < trect.left() + author()->nameText.maxWidth() + st::msgServiceFont->spacew + via->_width) {
+			if (via && !forwarded && point.x() >= trect.left() + author()->nameText().maxWidth() + st::msgServiceFont->spacew && point.x() < trect.left() + author()->nameText().maxWidth() + st::msgServiceFont->spacew + via->_width) {
 				outResult->link = via->_lnk;
 				return true;
 			}
@@ -62,6 +62,7 @@ public:
 	bool hasBubble() const override {
 		return drawBubble();
 	}
+	QRect countMediaGeometry() const override;
 	bool displayFromName() const {
 		if (!hasFromName()) return false;
 		if (isAttachedToPrevious()) return false;
@@ -0,0 +1,171 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "history/history_search_index.h"
+
+namespace {
+
+constexpr auto kIndexedItemsLimit = 20000;
+
+bool HasWordStartingWith(const QStringList &words, const QString &prefix) {
+	for_const (auto &word, words) {
+		if (word.startsWith(prefix)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+QStringList ItemSearchWords(not_null<HistoryItem*> item) {
+	return TextUtilities::PrepareSearchWords(item->originalText().text);
+}
+
+} // namespace
+
+void HistorySearchIndex::add(not_null<HistoryItem*> item) {
+	if (item->serviceMsg() || item->id <= 0) {
+		return;
+	}
+	auto id = item->fullId();
+	auto words = ItemSearchWords(item);
+	auto i = _items.find(id);
+	if (i != _items.end()) {
+		if (i->second.words == words) {
+			return;
+		}
+		removeWords(id, i->second.words);
+		if (words.isEmpty()) {
+			_items.erase(i);
+			return;
+		}
+	} else if (words.isEmpty()) {
+		return;
+	} else {
+		i = _items.emplace(id, Indexed()).first;
+	}
+	for_const (auto &word, words) {
+		_words[word].insert(id);
+	}
+	i->second.words = std::move(words);
+	i->second.order = ++_counter;
+	_order.emplace_back(id, _counter);
+
+	while (int(_items.size()) > kIndexedItemsLimit || _order.size() > 2 * _items.size()) {
+		auto oldest = _order.front();
+		_order.pop_front();
+		auto j = _items.find(oldest.first);
+		if (j != _items.end() && j->second.order == oldest.second) {
+			removeWords(oldest.first, j->second.words);
+			_items.erase(j);
+		}
+	}
+}
+
+void HistorySearchIndex::remove(const FullMsgId &id) {
+	auto i = _items.find(id);
+	if (i != _items.end()) {
+		removeWords(id, i->second.words);
+		_items.erase(i);
+	}
+}
+
+void HistorySearchIndex::removeWords(const FullMsgId &id, const QStringList &words) {
+	for_const (auto &word, words) {
+		auto i = _words.find(word);
+		if (i != _words.end()) {
+			i.value().removeOne(id);
+			if (i.value().empty()) {
+				_words.erase(i);
+			}
+		}
+	}
+}
+
+std::vector<not_null<HistoryItem*>> HistorySearchIndex::search(const QString &query, PeerData *inPeer, UserData *from, int limit) {
+	auto result = std::vector<not_null<HistoryItem*>>();
+	auto words = TextUtilities::PrepareSearchWords(query);
+	if (words.isEmpty() || limit <= 0) {
+		return result;
+	}
+
+	// The longest word usually has the fewest postings.
+	auto longest = *std::max_element(words.cbegin(), words.cend(), [](const QString &a, const QString &b) {
+		return a.size() < b.size();
+	});
+	auto migrateFrom = inPeer ? inPeer->migrateFrom() : nullptr;
+	auto checked = base::flat_set<FullMsgId>();
+	auto removed = std::vector<FullMsgId>();
+	for (auto i = _words.lowerBound(longest); i != _words.end() && i.key().startsWith(longest);) {
+		auto &postings = i.value();
+		for (auto j = postings.begin(); j != postings.end();) {
+			auto item = App::histItemById(*j);
+			if (!item) {
+				removed.push_back(*j);
+				j = postings.erase(j);
+				continue;
+			}
+			if (checked.contains(*j)) {
+				++j;
+				continue;
+			}
+			checked.insert(*j);
+			++j;
+
+			PeerData *peer = item->history()->peer;
+			if (inPeer && peer != inPeer && peer != migrateFrom) {
+				continue;
+			} else if (from && item->from() != from) {
+				continue;
+			}
+
+			// The text could be edited after the item was indexed.
+			auto itemWords = ItemSearchWords(item);
+			auto matches = std::all_of(words.cbegin(), words.cend(), [&](const QString &word) {
+				return HasWordStartingWith(itemWords, word);
+			});
+			if (matches) {
+				result.push_back(item);
+			}
+		}
+		if (postings.empty()) {
+			i = _words.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	for (auto &id : removed) {
+		remove(id);
+	}
+
+	std::sort(result.begin(), result.end(), [](not_null<HistoryItem*> a, not_null<HistoryItem*> b) {
+		return (a->date > b->date) || (a->date == b->date && a->id > b->id);
+	});
+	if (int(result.size()) > limit) {
+		result.erase(result.begin() + limit, result.end());
+	}
+	return result;
+}
+
+void HistorySearchIndex::clear() {
+	_words.clear();
+	_items.clear();
+	_order.clear();
+}
@@ -0,0 +1,62 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include "base/flat_set.h"
+
+class HistoryItem;
+
+// Word prefix index over the messages loaded in memory, it lets the
+// messages search show the matching loaded messages without waiting
+// for the server. The messages shown from the local history cache are
+// loaded the same way, so they are indexed as well. The postings keep
+// message ids, so the removed or unloaded messages are just skipped and
+// dropped in the lookups. Only the most recently indexed messages are kept.
+class HistorySearchIndex {
+public:
+	// Indexes a new message or indexes an edited one again.
+	void add(not_null<HistoryItem*> item);
+
+	// Loaded messages with a word starting with each of the query words,
+	// newest first. If inPeer is set only its messages are returned.
+	std::vector<not_null<HistoryItem*>> search(const QString &query, PeerData *inPeer, UserData *from, int limit);
+
+	void clear();
+
+private:
+	void remove(const FullMsgId &id);
+	void removeWords(const FullMsgId &id, const QStringList &words);
+
+	using Postings = base::flat_set<FullMsgId>;
+	QMap<QString, Postings> _words;
+
+	struct Indexed {
+		QStringList words;
+		uint64 order = 0;
+	};
+	std::map<FullMsgId, Indexed> _items;
+
+	// The oldest indexed messages are dropped first, the entries left by
+	// the messages indexed again are skipped by their order values.
+	std::deque<std::pair<FullMsgId, uint64>> _order;
+	uint64 _counter = 0;
+
+};
@@ -175,6 +175,7 @@ namespace {
 constexpr auto kSaveTabbedSelectorSectionTimeoutMs = 1000;
 constexpr auto kMessagesPerPageFirst = 30;
 constexpr auto kMessagesPerPage = 50;
+constexpr auto kMessagesPerPageMax = 100; // server limit for messages.getHistory
 constexpr auto kPreloadHeightsCount = 3; // when 3 screens to scroll left make a preload request
 constexpr auto kTabbedSelectorToggleTooltipTimeoutMs = 3000;
 constexpr auto kTabbedSelectorToggleTooltipCount = 3;
@@ -182,7 +183,17 @@ constexpr auto kScrollToVoiceAfterScrolledMs = 1000;
 constexpr auto kSkipRepaintWhileScrollMs = 100;
 constexpr auto kShowMembersDropdownTimeoutMs = 300;
 constexpr auto kDisplayEditTimeWarningMs = 300 * 1000;
+constexpr auto kScrollBenchmarkFrameDuration = TimeMs(16);
+constexpr auto kScrollBenchmarkStep = 120;
+constexpr auto kScrollBenchmarkFramesMax = 10000;
 constexpr auto kFullDayInMs = 86400 * 1000;
+constexpr auto kResizeStaleBlocksDelay = 300;
+constexpr auto kContentSnapshotTimeout = TimeMs(3000);
+constexpr auto kFileLoaderWorkersMax = 4; // prepare at most 4 sent files in parallel
+
+int FileLoaderWorkersCount() {
+	return qBound(1, QThread::idealThreadCount(), kFileLoaderWorkersMax);
+}
 
 ApiWrap::RequestMessageDataCallback replyEditMessageDataCallback() {
 	return [](ChannelData *channel, MsgId msgId) {
@@ -633,7 +644,7 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 , _tabbedSelector(_tabbedPanel->getSelector())
 , _attachDragDocument(this)
 , _attachDragPhoto(this)
-, _fileLoader(this, FileLoaderQueueStopTimeout)
+, _fileLoader(this, FileLoaderQueueStopTimeout, FileLoaderWorkersCount())
 , _topShadow(this, st::shadowFg) {
 	setAcceptDrops(true);
 
@@ -667,7 +678,8 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 	connect(&_previewTimer, SIGNAL(timeout()), this, SLOT(onPreviewTimeout()));
 	connect(Media::Capture::instance(), SIGNAL(error()), this, SLOT(onRecordError()));
 	connect(Media::Capture::instance(), SIGNAL(updated(quint16,qint32)), this, SLOT(onRecordUpdate(quint16,qint32)));
-	connect(Media::Capture::instance(), SIGNAL(done(QByteArray,VoiceWaveform,qint32)), this, SLOT(onRecordDone(QByteArray,VoiceWaveform,qint32)));
+	connect(Media::Capture::instance(), SIGNAL(done(QByteArray,VoiceWaveform,qint32,quint64)), this, SLOT(onRecordDone(QByteArray,VoiceWaveform,qint32,quint64)));
+	connect(Media::Capture::instance(), SIGNAL(partReady(quint64,QByteArray)), this, SLOT(onRecordPart(quint64,QByteArray)));
 
 	_attachToggle->setClickedCallback(App::LambdaDelayed(st::historyAttach.ripple.hideDuration, this, [this] {
 		chooseAttach();
@@ -681,6 +693,8 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 	_sendActionStopTimer.setSingleShot(true);
 
 	_highlightTimer.setCallback([this] { updateHighlightedMessage(); });
+	_resizeStaleBlocksTimer.setCallback([this] { resizeStaleBlocks(); });
+	_scrollBenchmarkTimer.setCallback([this] { scrollBenchmarkStep(); });
 
 	_membersDropdownShowTimer.setSingleShot(true);
 	connect(&_membersDropdownShowTimer, SIGNAL(timeout()), this, SLOT(onMembersDropdownShow()));
@@ -772,6 +786,25 @@ HistoryWidget::HistoryWidget(QWidget *parent, not_null<Window::Controller*> cont
 		}
 	});
 	using UpdateFlag = Notify::PeerUpdate::Flag;
+	auto visibleChanges = UpdateFlag::NameChanged
+		| UpdateFlag::PhotoChanged
+		| UpdateFlag::NotificationsEnabled
+		| UpdateFlag::PinnedChanged
+		| UpdateFlag::MigrationChanged
+		| UpdateFlag::RestrictionReasonChanged
+		| UpdateFlag::MembersChanged
+		| UpdateFlag::AdminsChanged
+		| UpdateFlag::UnreadMentionsChanged
+		| UpdateFlag::UserIsBlocked
+		| UpdateFlag::UserOnlineChanged
+		| UpdateFlag::ChannelRightsChanged
+		| UpdateFlag::ChannelPinnedChanged;
+	subscribe(Notify::PeerUpdated(), Notify::PeerUpdatedHandler(visibleChanges, [this](const Notify::PeerUpdate &update) {
+		invalidateContentSnapshot(update.peer);
+	}));
+	subscribe(Window::Theme::Background(), [this](const Window::Theme::BackgroundUpdate &update) {
+		invalidateContentSnapshot(nullptr);
+	});
 	auto changes = UpdateFlag::ChannelRightsChanged
 		| UpdateFlag::UnreadMentionsChanged
 		| UpdateFlag::MigrationChanged
@@ -1427,17 +1460,27 @@ void HistoryWidget::onRecordError() {
 	stopRecording(false);
 }
 
-void HistoryWidget::onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples) {
-	if (!canWriteMessage() || result.isEmpty()) return;
+void HistoryWidget::onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples, quint64 streamedId) {
+	if (_recordingUploadId == streamedId) {
+		_recordingUploadId = 0;
+	}
+	if (!canWriteMessage() || result.isEmpty()) {
+		Auth().uploader().cancelStreamed(streamedId);
+		return;
+	}
 
 	App::wnd()->activateWindow();
 	auto duration = samples / Media::Player::kDefaultFrequency;
 	auto to = FileLoadTo(_peer->id, _silent->checked(), replyToId());
 	auto caption = QString();
-	_fileLoader.addTask(MakeShared<FileLoadTask>(result, duration, waveform, to, caption));
+	_fileLoader.addTask(MakeShared<FileLoadTask>(result, duration, waveform, to, caption, streamedId));
 	cancelReplyAfterMediaSend(lastForceReplyReplied());
 }
 
+void HistoryWidget::onRecordPart(quint64 streamedId, QByteArray part) {
+	Auth().uploader().feedStreamed(streamedId, part);
+}
+
 void HistoryWidget::onRecordUpdate(quint16 level, qint32 samples) {
 	if (!_recording) {
 		return;
@@ -1860,7 +1903,7 @@ void HistoryWidget::showHistory(const PeerId &peerId, MsgId showAtMsgId, bool re
 	App::mousedItem(nullptr);
 
 	if (_peer) {
-		App::forgetMedia();
+		App::checkImageCacheSize();
 		_serviceImageCacheSize = imageCacheSize();
 		Auth().downloader().clearPriorities();
 
@@ -1952,9 +1995,10 @@ void HistoryWidget::clearDelayedShowAt() {
 void HistoryWidget::clearAllLoadRequests() {
 	clearDelayedShowAt();
 	if (_firstLoadRequest) MTP::cancel(_firstLoadRequest);
+	if (_cachedHistoryRefreshRequest) MTP::cancel(_cachedHistoryRefreshRequest);
 	if (_preloadRequest) MTP::cancel(_preloadRequest);
 	if (_preloadDownRequest) MTP::cancel(_preloadDownRequest);
-	_preloadRequest = _preloadDownRequest = _firstLoadRequest = 0;
+	_preloadRequest = _preloadDownRequest = _firstLoadRequest = _cachedHistoryRefreshRequest = 0;
 }
 
 void HistoryWidget::updateFieldSubmitSettings() {
@@ -2360,6 +2404,8 @@ bool HistoryWidget::messagesFailed(const RPCError &error, mtpRequestId requestId
 	} else if (_firstLoadRequest == requestId) {
 		_firstLoadRequest = 0;
 		App::main()->showBackFromStack();
+	} else if (_cachedHistoryRefreshRequest == requestId) {
+		_cachedHistoryRefreshRequest = 0; // keep showing the cached messages
 	} else if (_delayedShowAtRequest == requestId) {
 		_delayedShowAtRequest = 0;
 	}
@@ -2368,13 +2414,13 @@ bool HistoryWidget::messagesFailed(const RPCError &error, mtpRequestId requestId
 
 void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages &messages, mtpRequestId requestId) {
 	if (!_history) {
-		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _delayedShowAtRequest = 0;
+		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _cachedHistoryRefreshRequest = _delayedShowAtRequest = 0;
 		return;
 	}
 
 	bool toMigrated = (peer == _peer->migrateFrom());
 	if (peer != _peer && !toMigrated) {
-		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _delayedShowAtRequest = 0;
+		_preloadRequest = _preloadDownRequest = _firstLoadRequest = _cachedHistoryRefreshRequest = _delayedShowAtRequest = 0;
 		return;
 	}
 
@@ -2430,6 +2476,9 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 		}
 		addMessagesToFront(peer, *histList);
 		_firstLoadRequest = 0;
+		if (!toMigrated && _history->loadedAtBottom()) {
+			Local::writeHistoryCache(peer->id, messages);
+		}
 		if (_history->loadedAtTop()) {
 			if (_history->unreadCount() > count) {
 				_history->setUnreadCount(count);
@@ -2440,6 +2489,21 @@ void HistoryWidget::messagesReceived(PeerData *peer, const MTPmessages_Messages
 			}
 		}
 
+		historyLoaded();
+	} else if (_cachedHistoryRefreshRequest == requestId) {
+		_cachedHistoryRefreshRequest = 0;
+
+		// Replace the cached messages with the server slice, the same
+		// items are reused for the messages that are still there.
+		_history->clear(true);
+		_historyInited = false;
+		addMessagesToFront(peer, *histList);
+		if (_history->loadedAtBottom()) {
+			Local::writeHistoryCache(peer->id, messages);
+		}
+		if (_history->loadedAtTop() && _history->unreadCount() > count) {
+			_history->setUnreadCount(count);
+		}
 		historyLoaded();
 	} else if (_delayedShowAtRequest == requestId) {
 		if (toMigrated) {
@@ -2495,7 +2559,7 @@ void HistoryWidget::windowShown() {
 
 bool HistoryWidget::doWeReadServerHistory() const {
 	if (!_history || !_list) return true;
-	if (_firstLoadRequest || _a_show.animating()) return false;
+	if (_firstLoadRequest || _cachedHistoryRefreshRequest || _a_show.animating()) return false;
 	if (_history->loadedAtBottom()) {
 		int scrollTop = _scroll->scrollTop();
 		if (scrollTop + 1 > _scroll->scrollTopMax()) return true;
@@ -2517,7 +2581,7 @@ bool HistoryWidget::doWeReadServerHistory() const {
 
 bool HistoryWidget::doWeReadMentions() const {
 	if (!_history || !_list) return true;
-	if (_firstLoadRequest || _a_show.animating()) return false;
+	if (_firstLoadRequest || _cachedHistoryRefreshRequest || _a_show.animating()) return false;
 	return true;
 }
 
@@ -2530,13 +2594,30 @@ bool HistoryWidget::historyHasNotFreezedUnreadBar(History *history) const {
 	return false;
 }
 
+int HistoryWidget::countMessagesPerPage(int minimal, int screens) const {
+	// Request enough messages to fill the given count of screens,
+	// so that tall windows don't make many small slice requests.
+	auto itemHeight = st::msgPhotoSize + st::msgPadding.top() + st::msgPadding.bottom();
+	if (_history && _history->height > 0) {
+		auto count = 0;
+		for_const (auto block, _history->blocks) {
+			count += block->items.size();
+		}
+		if (count > 0) {
+			itemHeight = qMax(_history->height / count, 1);
+		}
+	}
+	auto wanted = (screens * _scroll->height() + itemHeight - 1) / itemHeight;
+	return snap(wanted, minimal, kMessagesPerPageMax);
+}
+
 void HistoryWidget::firstLoadMessages() {
 	if (!_history || _firstLoadRequest) return;
 
 	auto from = _peer;
 	auto offset_id = 0;
 	auto offset = 0;
-	auto loadCount = kMessagesPerPage;
+	auto loadCount = countMessagesPerPage(kMessagesPerPage, kPreloadHeightsCount);
 	if (_showAtMsgId == ShowAtUnreadMsgId) {
 		if (_migrated && _migrated->unreadCount()) {
 			_history->getReadyFor(_showAtMsgId);
@@ -2552,7 +2633,7 @@ void HistoryWidget::firstLoadMessages() {
 		}
 	} else if (_showAtMsgId == ShowAtTheEndMsgId) {
 		_history->getReadyFor(_showAtMsgId);
-		loadCount = kMessagesPerPageFirst;
+		loadCount = countMessagesPerPage(kMessagesPerPageFirst, 1);
 	} else if (_showAtMsgId > 0) {
 		_history->getReadyFor(_showAtMsgId);
 		offset = -loadCount / 2;
@@ -2568,7 +2649,79 @@ void HistoryWidget::firstLoadMessages() {
 		}
 	}
 
-	_firstLoadRequest = MTP::send(MTPmessages_GetHistory(from->input, MTP_int(offset_id), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from), rpcFail(&HistoryWidget::messagesFailed));
+	auto request = MTPmessages_GetHistory(from->input, MTP_int(offset_id), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0));
+	if (from == _peer && !offset_id && !offset && !_migrated && _history->isEmpty() && showCachedHistory()) {
+		_cachedHistoryRefreshRequest = MTP::send(request, rpcDone(&HistoryWidget::messagesReceived, from), rpcFail(&HistoryWidget::messagesFailed));
+		return;
+	}
+	_firstLoadRequest = MTP::send(request, rpcDone(&HistoryWidget::messagesReceived, from), rpcFail(&HistoryWidget::messagesFailed));
+}
+
+bool HistoryWidget::showCachedHistory() {
+	auto cached = Local::readHistoryCache(_peer->id);
+	if (!cached) {
+		return false;
+	}
+
+	auto chatPeerId = [](const MTPChat &chat) {
+		switch (chat.type()) {
+		case mtpc_chat: return peerFromChat(chat.c_chat().vid);
+		case mtpc_chatForbidden: return peerFromChat(chat.c_chatForbidden().vid);
+		case mtpc_channel: return peerFromChannel(chat.c_channel().vid);
+		case mtpc_channelForbidden: return peerFromChannel(chat.c_channelForbidden().vid);
+		}
+		return peerFromChat(chat.c_chatEmpty().vid);
+	};
+
+	// Users and chats from the cache may be outdated, feed only unknown ones.
+	auto feedUnknown = [&chatPeerId](const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats) {
+		auto unknownUsers = QVector<MTPUser>();
+		for_const (auto &user, users.v) {
+			auto id = (user.type() == mtpc_user) ? user.c_user().vid.v : user.c_userEmpty().vid.v;
+			if (!App::userLoaded(id)) {
+				unknownUsers.push_back(user);
+			}
+		}
+		auto unknownChats = QVector<MTPChat>();
+		for_const (auto &chat, chats.v) {
+			if (!App::peerLoaded(chatPeerId(chat))) {
+				unknownChats.push_back(chat);
+			}
+		}
+		App::feedUsers(MTP_vector<MTPUser>(unknownUsers));
+		App::feedChats(MTP_vector<MTPChat>(unknownChats));
+	};
+
+	const QVector<MTPMessage> *list = nullptr;
+	switch (cached->type()) {
+	case mtpc_messages_messages: {
+		auto &d = cached->c_messages_messages();
+		feedUnknown(d.vusers, d.vchats);
+		list = &d.vmessages.v;
+	} break;
+	case mtpc_messages_messagesSlice: {
+		auto &d = cached->c_messages_messagesSlice();
+		feedUnknown(d.vusers, d.vchats);
+		list = &d.vmessages.v;
+	} break;
+	case mtpc_messages_channelMessages: {
+		// The cached pts is outdated, it is not applied to the channel.
+		auto &d = cached->c_messages_channelMessages();
+		feedUnknown(d.vusers, d.vchats);
+		list = &d.vmessages.v;
+	} break;
+	}
+	if (!list || list->isEmpty()) {
+		return false;
+	}
+
+	addMessagesToFront(_peer, *list);
+	if (_history->isEmpty()) {
+		return false;
+	}
+	countHistoryShowFrom();
+	destroyUnreadBar();
+	return true;
 }
 
 void HistoryWidget::loadMessages() {
@@ -2586,9 +2739,11 @@ void HistoryWidget::loadMessages() {
 
 	auto offset_id = from->minMsgId();
 	auto offset = 0;
-	auto loadCount = offset_id ? kMessagesPerPage : kMessagesPerPageFirst;
+	auto loadCount = offset_id
+		? countMessagesPerPage(kMessagesPerPage, kPreloadHeightsCount)
+		: countMessagesPerPage(kMessagesPerPageFirst, 1);
 
-	_preloadRequest = MTP::send(MTPmessages_GetHistory(from->peer->input, MTP_int(offset_id), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from->peer), rpcFail(&HistoryWidget::messagesFailed));
+	_preloadRequest = MTP::send(MTPmessages_GetHistory(from->peer->input, MTP_int(offset_id), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from->peer), rpcFail(&HistoryWidget::messagesFailed), MTP::backgroundDcId(0));
 }
 
 void HistoryWidget::loadMessagesDown() {
@@ -2604,7 +2759,7 @@ void HistoryWidget::loadMessagesDown() {
 		return;
 	}
 
-	auto loadCount = kMessagesPerPage;
+	auto loadCount = countMessagesPerPage(kMessagesPerPage, kPreloadHeightsCount);
 	auto offset = -loadCount;
 	auto offset_id = from->maxMsgId();
 	if (!offset_id) {
@@ -2613,7 +2768,7 @@ void HistoryWidget::loadMessagesDown() {
 		++offset;
 	}
 
-	_preloadDownRequest = MTP::send(MTPmessages_GetHistory(from->peer->input, MTP_int(offset_id + 1), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from->peer), rpcFail(&HistoryWidget::messagesFailed));
+	_preloadDownRequest = MTP::send(MTPmessages_GetHistory(from->peer->input, MTP_int(offset_id + 1), MTP_int(0), MTP_int(offset), MTP_int(loadCount), MTP_int(0), MTP_int(0)), rpcDone(&HistoryWidget::messagesReceived, from->peer), rpcFail(&HistoryWidget::messagesFailed), MTP::backgroundDcId(0));
 }
 
 void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
@@ -2625,7 +2780,7 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 	auto from = _peer;
 	auto offset_id = 0;
 	auto offset = 0;
-	auto loadCount = kMessagesPerPage;
+	auto loadCount = countMessagesPerPage(kMessagesPerPage, kPreloadHeightsCount);
 	if (_delayedShowAtMsgId == ShowAtUnreadMsgId) {
 		if (_migrated && _migrated->unreadCount()) {
 			from = _migrated->peer;
@@ -2635,10 +2790,10 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 			offset = -loadCount / 2;
 			offset_id = _history->inboxReadBefore;
 		} else {
-			loadCount = kMessagesPerPageFirst;
+			loadCount = countMessagesPerPage(kMessagesPerPageFirst, 1);
 		}
 	} else if (_delayedShowAtMsgId == ShowAtTheEndMsgId) {
-		loadCount = kMessagesPerPageFirst;
+		loadCount = countMessagesPerPage(kMessagesPerPageFirst, 1);
 	} else if (_delayedShowAtMsgId > 0) {
 		offset = -loadCount / 2;
 		offset_id = _delayedShowAtMsgId;
@@ -2654,8 +2809,15 @@ void HistoryWidget::delayedShowAt(MsgId showAtMsgId) {
 }
 
 void HistoryWidget::onScroll() {
+	if (_list && _list->hasStaleBlocks()) {
+		// Blocks with the old layout may become visible now.
+		resizeStaleBlocks();
+	}
 	App::checkImageCacheSize();
 	preloadHistoryIfNeeded();
+
+	// Automatic media loads started before the scroll wait for the visible ones.
+	Auth().downloader().clearAutomaticPriorities();
 	visibleAreaUpdated();
 	if (!_synteticScrollEvent) {
 		_lastUserScrolled = getms();
@@ -2691,8 +2853,60 @@ void HistoryWidget::visibleAreaUpdated() {
 	}
 }
 
+void HistoryWidget::startScrollBenchmark() {
+	if (!_list || _scroll->isHidden() || _scrollBenchmarkTimer.isActive()) {
+		return;
+	}
+	_scrollBenchmarkFrames.clear();
+	_scroll->scrollToY(_scroll->scrollTopMax());
+	_scrollBenchmarkTimer.callEach(kScrollBenchmarkFrameDuration);
+}
+
+void HistoryWidget::scrollBenchmarkStep() {
+	if (!_list || _scroll->isHidden() || int(_scrollBenchmarkFrames.size()) >= kScrollBenchmarkFramesMax) {
+		finishScrollBenchmark();
+		return;
+	}
+	auto scrollTop = _scroll->scrollTop();
+	if (scrollTop <= 0) {
+		if (!_preloadRequest) {
+			finishScrollBenchmark();
+		}
+		return; // Wait for the older messages.
+	}
+	QElapsedTimer timer;
+	timer.start();
+	_scroll->scrollToY(qMax(scrollTop - kScrollBenchmarkStep, 0));
+	_list->repaint();
+	_scrollBenchmarkFrames.push_back(timer.nsecsElapsed() / 1000);
+}
+
+void HistoryWidget::finishScrollBenchmark() {
+	_scrollBenchmarkTimer.cancel();
+	auto frames = base::take(_scrollBenchmarkFrames);
+	if (frames.empty()) {
+		return;
+	}
+	std::sort(frames.begin(), frames.end());
+	auto sum = int64(0);
+	for (auto frame : frames) {
+		sum += frame;
+	}
+	auto ms = [](int64 microseconds) {
+		return QString::number(microseconds / 1000., 'f', 2);
+	};
+	auto text = qsl("Scroll benchmark: %1 frames, average %2 ms, median %3 ms, 95% %4 ms, max %5 ms"
+		).arg(int(frames.size())
+		).arg(ms(sum / int64(frames.size()))
+		).arg(ms(frames[frames.size() / 2])
+		).arg(ms(frames[(frames.size() * 95) / 100])
+		).arg(ms(frames.back()));
+	LOG((text));
+	Ui::show(Box<InformBox>(text));
+}
+
 void HistoryWidget::preloadHistoryIfNeeded() {
-	if (_firstLoadRequest || _scroll->isHidden() || !_peer) {
+	if (_firstLoadRequest || _cachedHistoryRefreshRequest || _scroll->isHidden() || !_peer) {
 		return;
 	}
 
@@ -2710,7 +2924,7 @@ void HistoryWidget::preloadHistoryIfNeeded() {
 }
 
 void HistoryWidget::preloadHistoryByScroll() {
-	if (_firstLoadRequest || _scroll->isHidden() || !_peer) {
+	if (_firstLoadRequest || _cachedHistoryRefreshRequest || _scroll->isHidden() || !_peer) {
 		return;
 	}
 
@@ -2726,7 +2940,7 @@ void HistoryWidget::preloadHistoryByScroll() {
 }
 
 void HistoryWidget::checkReplyReturns() {
-	if (_firstLoadRequest || _scroll->isHidden() || !_peer) {
+	if (_firstLoadRequest || _cachedHistoryRefreshRequest || _scroll->isHidden() || !_peer) {
 		return;
 	}
 	auto scrollTop = _scroll->scrollTop();
@@ -3075,7 +3289,10 @@ void HistoryWidget::showAnimated(Window::SlideDirection direction, const Window:
 	historyDownAnimationFinish();
 	unreadMentionsAnimationFinish();
 	_topShadow->setVisible(params.withTopBarShadow ? false : true);
-	_cacheOver = App::main()->grabForShowAnimation(params);
+	_cacheOver = takeContentSnapshot(params);
+	if (_cacheOver.isNull()) {
+		_cacheOver = App::main()->grabForShowAnimation(params);
+	}
 
 	if (_tabbedSection && !_tabbedSection->isHidden()) {
 		_tabbedSection->beforeHiding();
@@ -3129,6 +3346,49 @@ void HistoryWidget::doneShow() {
 	}
 }
 
+void HistoryWidget::rememberContentSnapshot(const Window::SectionSlideParams &params) {
+	if (!_history || !_historyInited || isHidden() || _a_show.animating()) {
+		_contentSnapshot = ContentSnapshot();
+		return;
+	}
+	_contentSnapshot.content = params.oldContentCache;
+	_contentSnapshot.history = _history;
+	_contentSnapshot.scrollTop = _scroll->scrollTop();
+	_contentSnapshot.size = size();
+	_contentSnapshot.oneColumn = Adaptive::OneColumn();
+	_contentSnapshot.withTopBarShadow = params.withTopBarShadow;
+	_contentSnapshot.withTabbedSection = params.withTabbedSection;
+	_contentSnapshot.time = getms();
+}
+
+QPixmap HistoryWidget::takeContentSnapshot(const Window::SectionSlideParams &params) {
+	auto snapshot = base::take(_contentSnapshot);
+	if (snapshot.content.isNull()
+		|| snapshot.history != _history
+		|| (_history && _history->hasPendingResizedItems())
+		|| (_migrated && _migrated->hasPendingResizedItems())
+		|| snapshot.time + kContentSnapshotTimeout < getms()) {
+		return QPixmap();
+	}
+	myEnsureResized(this);
+	if (snapshot.scrollTop != _scroll->scrollTop()
+		|| snapshot.size != size()
+		|| snapshot.oneColumn != Adaptive::OneColumn()
+		|| snapshot.withTopBarShadow != params.withTopBarShadow
+		|| snapshot.withTabbedSection != params.withTabbedSection) {
+		return QPixmap();
+	}
+	return std::move(snapshot.content);
+}
+
+void HistoryWidget::invalidateContentSnapshot(PeerData *peer) {
+	if (auto history = _contentSnapshot.history) {
+		if (!peer || history->peer == peer || history->peer->migrateFrom() == peer) {
+			_contentSnapshot = ContentSnapshot();
+		}
+	}
+}
+
 void HistoryWidget::finishAnimation() {
 	if (!_a_show.animating()) return;
 	_a_show.finish();
@@ -3272,8 +3532,9 @@ void HistoryWidget::recordStartCallback() {
 		}
 	}
 
-	emit Media::Capture::instance()->start();
-
+	Auth().uploader().cancelStreamed(base::take(_recordingUploadId));
+	_recordingUploadId = Auth().uploader().startStreamed();
+	emit Media::Capture::instance()->start(_recordingUploadId);
 	_recording = _inField = true;
 	updateControlsVisibility();
 	activate();
@@ -3307,6 +3568,12 @@ void HistoryWidget::mouseReleaseEvent(QMouseEvent *e) {
 
 void HistoryWidget::stopRecording(bool send) {
 	emit Media::Capture::instance()->stop(send);
+	if (send) {
+		// The parts belong to the result now, it comes with the same id.
+		_recordingUploadId = 0;
+	} else {
+		Auth().uploader().cancelStreamed(base::take(_recordingUploadId));
+	}
 
 	a_recordingLevel = anim::value();
 	_a_recording.stop();
@@ -4737,6 +5004,7 @@ void HistoryWidget::grabFinish() {
 }
 
 void HistoryWidget::ui_repaintHistoryItem(not_null<const HistoryItem*> item) {
+	invalidateContentSnapshot(item->history()->peer);
 	if (_peer && _list && (item->history() == _history || (_migrated && item->history() == _migrated))) {
 		auto ms = getms();
 		if (_lastScrolled + kSkipRepaintWhileScrollMs <= ms) {
@@ -4747,6 +5015,18 @@ void HistoryWidget::ui_repaintHistoryItem(not_null<const HistoryItem*> item) {
 	}
 }
 
+void HistoryWidget::ui_repaintHistoryItemMedia(not_null<const HistoryItem*> item) {
+	invalidateContentSnapshot(item->history()->peer);
+	if (_peer && _list && (item->history() == _history || (_migrated && item->history() == _migrated))) {
+		auto ms = getms();
+		if (_lastScrolled + kSkipRepaintWhileScrollMs <= ms) {
+			_list->repaintItemMedia(item);
+		} else {
+			_updateHistoryItems.start(_lastScrolled + kSkipRepaintWhileScrollMs - ms);
+		}
+	}
+}
+
 void HistoryWidget::onUpdateHistoryItems() {
 	if (!_list) return;
 
@@ -4780,6 +5060,7 @@ void HistoryWidget::handlePendingHistoryUpdate() {
 }
 
 void HistoryWidget::resizeEvent(QResizeEvent *e) {
+	invalidateContentSnapshot(nullptr);
 	updateTabbedSelectorSectionShown();
 	recountChatWidth();
 	updateControlsGeometry();
@@ -5022,6 +5303,9 @@ void HistoryWidget::updateHistoryGeometry(bool initial, bool loadedDown, const S
 
 void HistoryWidget::updateListSize() {
 	_list->recountHeight();
+	if (_list->hasStaleBlocks()) {
+		_resizeStaleBlocksTimer.callOnce(kResizeStaleBlocksDelay);
+	}
 	auto washidden = _scroll->isHidden();
 	if (washidden) {
 		_scroll->show();
@@ -5033,6 +5317,13 @@ void HistoryWidget::updateListSize() {
 	_updateHistoryGeometryRequired = true;
 }
 
+void HistoryWidget::resizeStaleBlocks() {
+	_resizeStaleBlocksTimer.cancel();
+	if (_list && _list->hasStaleBlocks()) {
+		updateHistoryGeometry();
+	}
+}
+
 int HistoryWidget::unreadBarTop() const {
 	auto getUnreadBar = [this]() -> HistoryItem* {
 		if (_migrated && _migrated->unreadBar) {
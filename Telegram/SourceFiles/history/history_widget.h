@@ -197,6 +197,12 @@ public:
 	void loadMessages();
 	void loadMessagesDown();
 	void firstLoadMessages();
+	bool showCachedHistory();
+
+	// Scrolls the shown history up step by step and reports the times
+	// of the synchronous repaints, so that changes can be compared on
+	// the same loaded chat.
+	void startScrollBenchmark();
 	void delayedShowAt(MsgId showAtMsgId);
 	void peerMessagesUpdated(PeerId peer);
 	void peerMessagesUpdated();
@@ -254,6 +260,10 @@ public:
 	void showAnimated(Window::SlideDirection direction, const Window::SectionSlideParams &params);
 	void finishAnimation();
 
+	// The grab of this widget when leaving it, reused if it is shown
+	// again soon while nothing has changed in it.
+	void rememberContentSnapshot(const Window::SectionSlideParams &params);
+
 	void doneShow();
 
 	QPoint clampMousePosition(QPoint point);
@@ -353,6 +363,7 @@ public:
 	void app_sendBotCallback(const HistoryMessageReplyMarkup::Button *button, not_null<const HistoryItem*> msg, int row, int col);
 
 	void ui_repaintHistoryItem(not_null<const HistoryItem*> item);
+	void ui_repaintHistoryItemMedia(not_null<const HistoryItem*> item);
 	PeerData *ui_getPeerForMouseAction();
 
 	void notify_historyItemLayoutChanged(const HistoryItem *item);
@@ -451,8 +462,9 @@ public slots:
 	void onCloudDraftSave();
 
 	void onRecordError();
-	void onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples);
+	void onRecordDone(QByteArray result, VoiceWaveform waveform, qint32 samples, quint64 streamedId);
 	void onRecordUpdate(quint16 level, qint32 samples);
+	void onRecordPart(quint64 streamedId, QByteArray part);
 
 	void onUpdateHistoryItems();
 
@@ -480,6 +492,7 @@ private:
 		bool allFilesForCompress = true;
 	};
 
+	int countMessagesPerPage(int minimal, int screens) const;
 	void handlePendingHistoryUpdate();
 	void fullPeerUpdated(PeerData *peer);
 	void topBarClick();
@@ -659,6 +672,7 @@ private:
 	};
 	void updateHistoryGeometry(bool initial = false, bool loadedDown = false, const ScrollChange &change = { ScrollChangeNone, 0 });
 	void updateListSize();
+	void resizeStaleBlocks();
 
 	// Does any of the shown histories has this flag set.
 	bool hasPendingResizedItems() const {
@@ -729,6 +743,7 @@ private:
 	MsgId _showAtMsgId = ShowAtUnreadMsgId;
 
 	mtpRequestId _firstLoadRequest = 0;
+	mtpRequestId _cachedHistoryRefreshRequest = 0; // cached messages are shown
 	mtpRequestId _preloadRequest = 0;
 	mtpRequestId _preloadDownRequest = 0;
 
@@ -799,6 +814,7 @@ private:
 	bool _cmdStartShown = false;
 	object_ptr<MessageField> _field;
 	bool _recording = false;
+	uint64 _recordingUploadId = 0;
 	bool _inField = false;
 	bool _inReplyEditForward = false;
 	bool _inPinnedMsg = false;
@@ -847,6 +863,20 @@ private:
 	Window::SlideDirection _showDirection;
 	QPixmap _cacheUnder, _cacheOver;
 
+	struct ContentSnapshot {
+		QPixmap content;
+		History *history = nullptr;
+		int scrollTop = 0;
+		QSize size;
+		bool oneColumn = false;
+		bool withTopBarShadow = false;
+		bool withTabbedSection = false;
+		TimeMs time = 0;
+	};
+	QPixmap takeContentSnapshot(const Window::SectionSlideParams &params);
+	void invalidateContentSnapshot(PeerData *peer);
+	ContentSnapshot _contentSnapshot;
+
 	QTimer _scrollTimer;
 	int32 _scrollDelta = 0;
 
@@ -855,6 +885,13 @@ private:
 	base::Timer _highlightTimer;
 	TimeMs _highlightStart = 0;
 
+	base::Timer _resizeStaleBlocksTimer;
+
+	void scrollBenchmarkStep();
+	void finishScrollBenchmark();
+	base::Timer _scrollBenchmarkTimer;
+	std::vector<int64> _scrollBenchmarkFrames; // In microseconds.
+
 	QMap<QPair<History*, SendAction::Type>, mtpRequestId> _sendActionRequests;
 	QTimer _sendActionStopTimer;
 
@@ -121,6 +121,19 @@ void Gif::setPosition(int32 position) {
 	}
 }
 
+void Gif::unloadHeavyPart() {
+	if (!_gif) {
+		return;
+	}
+	if (_gif->started()) {
+		// Show the last frame instead of the thumbnail until the clip is started again.
+		auto frame = countFrameSize();
+		_thumb = _gif->current(frame.width(), frame.height(), _width, st::inlineMediaHeight, ImageRoundRadius::None, ImageRoundCorner::None, 0);
+	}
+	_gif.reset();
+	getShownDocument()->forget();
+}
+
 void DeleteSavedGifClickHandler::onClickImpl() const {
 	auto index = cSavedGifs().indexOf(_data);
 	if (index >= 0) {
@@ -1178,6 +1191,19 @@ void Game::setPosition(int32 position) {
 	}
 }
 
+void Game::unloadHeavyPart() {
+	if (!_gif) {
+		return;
+	}
+	if (_gif->started()) {
+		_thumb = _gif->current(_frameSize.width(), _frameSize.height(), st::inlineThumbSize, st::inlineThumbSize, ImageRoundRadius::None, ImageRoundCorner::None, 0);
+	}
+	_gif.reset();
+	if (auto document = getResultDocument()) {
+		document->forget();
+	}
+}
+
 void Game::paint(Painter &p, const QRect &clip, const PaintContext *context) const {
 	int32 left = st::emojiPanHeaderLeft - st::inlineResultsLeft;
 
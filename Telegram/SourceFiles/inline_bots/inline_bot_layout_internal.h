@@ -63,6 +63,7 @@ public:
 	Gif(not_null<Context*> context, DocumentData *doc, bool hasDeleteButton);
 
 	void setPosition(int32 position) override;
+	void unloadHeavyPart() override;
 	void initDimensions() override;
 
 	bool isFullLine() const override {
@@ -332,6 +333,7 @@ public:
 	Game(not_null<Context*> context, Result *result);
 
 	void setPosition(int32 position) override;
+	void unloadHeavyPart() override;
 	void initDimensions() override;
 
 	void paint(Painter &p, const QRect &clip, const PaintContext *context) const override;
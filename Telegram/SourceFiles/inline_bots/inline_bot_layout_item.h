@@ -87,6 +87,10 @@ public:
 
 	virtual void preload() const;
 
+	// Stops the playback and frees the decoded frames of a scrolled away item.
+	virtual void unloadHeavyPart() {
+	}
+
 	void update();
 	void layoutChanged();
 
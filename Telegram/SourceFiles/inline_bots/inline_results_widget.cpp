@@ -1003,6 +1003,7 @@ void Widget::inlineBotChanged() {
 	_inlineQuery = _inlineNextQuery = _inlineNextOffset = QString();
 	_inlineBot = nullptr;
 	_inlineCache.clear();
+	_inlineShownEntry = nullptr;
 	_inner->inlineBotChanged();
 	_inner->hideInlineRowsPanel();
 
@@ -1022,6 +1023,7 @@ void Widget::inlineResultsDone(const MTPmessages_BotResults &result) {
 
 		if (it == _inlineCache.cend()) {
 			it = _inlineCache.emplace(_inlineQuery, std::make_unique<internal::CacheEntry>()).first;
+			it->second->expiresAt = getms() + qMax(d.vcache_time.v, 0) * 1000LL;
 		}
 		auto entry = it->second.get();
 		entry->nextOffset = qs(d.vnext_offset);
@@ -1071,6 +1073,7 @@ void Widget::queryInlineBot(UserData *bot, PeerData *peer, QString query) {
 	//}
 
 	if (_inlineQuery != query || force) {
+		clearExpiredCache();
 		if (_inlineRequestId) {
 			MTP::cancel(_inlineRequestId);
 			_inlineRequestId = 0;
@@ -1087,6 +1090,23 @@ void Widget::queryInlineBot(UserData *bot, PeerData *peer, QString query) {
 	}
 }
 
+void Widget::clearExpiredCache() {
+	auto now = getms();
+	auto removed = false;
+	for (auto i = _inlineCache.begin(); i != _inlineCache.end();) {
+		// The shown results are kept, their layouts are still used.
+		if (i->second.get() != _inlineShownEntry && i->second->expiresAt <= now) {
+			i = _inlineCache.erase(i);
+			removed = true;
+		} else {
+			++i;
+		}
+	}
+	if (removed) {
+		_inner->deleteUnusedInlineLayouts();
+	}
+}
+
 void Widget::onInlineRequest() {
 	if (_inlineRequestId || !_inlineBot || !_inlineQueryPeer) return;
 	_inlineQuery = _inlineNextQuery;
@@ -1121,7 +1141,11 @@ bool Widget::refreshInlineRows(int *added) {
 		}
 		_inlineNextOffset = it->second->nextOffset;
 	}
-	if (!entry) prepareCache();
+	if (entry) {
+		_inlineShownEntry = entry;
+	} else {
+		prepareCache();
+	}
 	auto result = _inner->refreshInlineRows(_inlineQueryPeer, _inlineBot, entry, false);
 	if (added) *added = result;
 	return (entry != nullptr);
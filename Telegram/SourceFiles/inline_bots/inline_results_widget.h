@@ -57,6 +57,9 @@ struct CacheEntry {
 	QString nextOffset;
 	QString switchPmText, switchPmStartToken;
 	Results results;
+
+	// The bot tells for how long the results of the query can be cached.
+	TimeMs expiresAt = 0;
 };
 
 class Inner : public TWidget, public Context, private base::Subscriber {
@@ -77,6 +80,9 @@ public:
 	void setVisibleTopBottom(int visibleTop, int visibleBottom) override;
 	void preloadImages();
 
+	// Must be called after the cached results that are not shown were destroyed.
+	void deleteUnusedInlineLayouts();
+
 	void inlineItemLayoutChanged(const ItemBase *layout) override;
 	void inlineItemRepaint(const ItemBase *layout) override;
 	bool inlineItemVisible(const ItemBase *layout) override;
@@ -148,7 +154,6 @@ private:
 	bool inlineRowFinalize(Row &row, int32 &sumWidth, bool force = false);
 
 	Row &layoutInlineRow(Row &row, int32 sumWidth = 0);
-	void deleteUnusedInlineLayouts();
 
 	int validateExistingInlineRows(const Results &results);
 	void selectInlineResult(int row, int column);
@@ -239,6 +244,7 @@ private:
 	void recountContentMaxHeight();
 	bool refreshInlineRows(int *added = nullptr);
 	void inlineResultsDone(const MTPmessages_BotResults &result);
+	void clearExpiredCache();
 
 	not_null<Window::Controller*> _controller;
 
@@ -262,6 +268,7 @@ private:
 	QPointer<internal::Inner> _inner;
 
 	std::map<QString, std::unique_ptr<internal::CacheEntry>> _inlineCache;
+	const internal::CacheEntry *_inlineShownEntry = nullptr; // Its results are used by _inner.
 	QTimer _inlineRequestTimer;
 
 	UserData *_inlineBot = nullptr;
@@ -250,6 +250,14 @@ QByteArray Instance::serialize() const {
 	for (auto &nonDefault : _nonDefaultValues) {
 		size += Serialize::bytearraySize(nonDefault.first) + Serialize::bytearraySize(nonDefault.second);
 	}
+	auto compiledCount = 0;
+	size += sizeof(qint32) + sizeof(qint32); // AppVersion, compiledCount
+	for (auto i = 0; i != kLangKeysCount; ++i) {
+		if (_nonDefaultSet[i]) {
+			size += sizeof(qint32) + Serialize::stringSize(_values[i]);
+			++compiledCount;
+		}
+	}
 
 	auto result = QByteArray();
 	result.reserve(size);
@@ -262,6 +270,15 @@ QByteArray Instance::serialize() const {
 		for (auto &nonDefault : _nonDefaultValues) {
 			stream << nonDefault.first << nonDefault.second;
 		}
+
+		// Already parsed values by key index, valid only for the same
+		// AppVersion, because the keys and tags indices are generated.
+		stream << qint32(AppVersion) << qint32(compiledCount);
+		for (auto i = 0; i != kLangKeysCount; ++i) {
+			if (_nonDefaultSet[i]) {
+				stream << qint32(i) << _values[i];
+			}
+		}
 	}
 	return result;
 }
@@ -309,16 +326,51 @@ void Instance::fillFromSerialized(const QByteArray &data) {
 		nonDefaultStrings.push_back(value);
 	}
 
+	// Older versions didn't write the compiled values at all.
+	qint32 compiledVersion = 0, compiledCount = 0;
+	stream >> compiledVersion >> compiledCount;
+	auto compiled = std::vector<std::pair<LangKey, QString>>();
+	auto useCompiled = (stream.status() == QDataStream::Ok)
+		&& (compiledVersion == AppVersion)
+		&& (compiledCount >= 0 && compiledCount <= kLangKeysCount);
+	if (useCompiled) {
+		compiled.reserve(compiledCount);
+		for (auto i = 0; i != compiledCount; ++i) {
+			qint32 index = 0;
+			QString value;
+			stream >> index >> value;
+			if (stream.status() != QDataStream::Ok || index < 0 || index >= kLangKeysCount) {
+				useCompiled = false;
+				break;
+			}
+			compiled.emplace_back(LangKey(index), std::move(value));
+		}
+	}
+
 	_id = id;
 	_version = version;
 	_customFilePathAbsolute = customFilePathAbsolute;
 	_customFilePathRelative = customFilePathRelative;
 	_customFileContent = customFileContent;
-	LOG(("Lang Info: Loaded cached, keys: %1").arg(nonDefaultValuesCount));
-	for (auto i = 0, count = nonDefaultValuesCount * 2; i != count; i += 2) {
-		applyValue(nonDefaultStrings[i], nonDefaultStrings[i + 1]);
+	LOG(("Lang Info: Loaded cached, keys: %1, compiled: %2").arg(nonDefaultValuesCount).arg(Logs::b(useCompiled)));
+	if (useCompiled) {
+		// Keys were written from std::map, so they go in the sorted order.
+		for (auto i = 0, count = nonDefaultValuesCount * 2; i != count; i += 2) {
+			_nonDefaultValues.emplace_hint(_nonDefaultValues.end(), std::move(nonDefaultStrings[i]), std::move(nonDefaultStrings[i + 1]));
+		}
+		for (auto &value : compiled) {
+			_values[value.first] = std::move(value.second);
+			_nonDefaultSet[value.first] = 1;
+		}
+	} else {
+		for (auto i = 0, count = nonDefaultValuesCount * 2; i != count; i += 2) {
+			applyValue(nonDefaultStrings[i], nonDefaultStrings[i + 1]);
+		}
 	}
 	updatePluralRules();
+	if (!useCompiled && nonDefaultValuesCount > 0) {
+		Local::writeLangPack();
+	}
 }
 
 void Instance::loadFromContent(const QByteArray &content) {
@@ -192,4 +192,60 @@ QString ReplaceTag<QString>::Replace(QString &&original, const QString &replacem
 	return result;
 }
 
+QString ReplaceTags<QString>::Replace(QString &&original, const ushort *tags, const QString **replacements, int count) {
+	Expects(count <= kMaxReplaceTags);
+
+	// Only the first occurrence of each tag is replaced, as in ReplaceTag.
+	int positions[kMaxReplaceTags];
+	std::fill(positions, positions + count, -1);
+	auto found = 0;
+	auto size = original.size();
+	for (auto s = original.constData(), ch = s, e = ch + size; ch != e && found != count;) {
+		if (*ch == TextCommand) {
+			if (ch + kTagReplacementSize <= e && (ch + 1)->unicode() == TextCommandLangTag && *(ch + 3) == TextCommand) {
+				auto tag = (ch + 2)->unicode() - 0x0020;
+				for (auto i = 0; i != count; ++i) {
+					if (tags[i] == tag && positions[i] < 0) {
+						positions[i] = ch - s;
+						size += replacements[i]->size() - kTagReplacementSize;
+						++found;
+						break;
+					}
+				}
+				ch += kTagReplacementSize;
+			} else {
+				auto next = textSkipCommand(ch, e);
+				ch = (next == ch) ? (ch + 1) : next;
+			}
+		} else {
+			++ch;
+		}
+	}
+	if (!found) {
+		return std::move(original);
+	}
+
+	auto result = QString();
+	result.reserve(size);
+	auto from = 0;
+	while (true) {
+		auto index = -1;
+		for (auto i = 0; i != count; ++i) {
+			if (positions[i] >= from && (index < 0 || positions[i] < positions[index])) {
+				index = i;
+			}
+		}
+		if (index < 0) {
+			break;
+		}
+		result.append(original.midRef(from, positions[index] - from));
+		result.append(*replacements[index]);
+		from = positions[index] + kTagReplacementSize;
+	}
+	if (from < original.size()) {
+		result.append(original.midRef(from));
+	}
+	return result;
+}
+
 } // namespace Lang
@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace Lang {
 
 constexpr auto kTagReplacementSize = 4;
+constexpr auto kMaxReplaceTags = 8;
 
 int FindTagReplacementPosition(const QString &original, ushort tag);
 
@@ -59,4 +60,31 @@ struct ReplaceTag<QString> {
 
 };
 
+// Replaces several tags at once, each one by its replacement with the same index.
+template <typename ResultString>
+struct ReplaceTags {
+	template <size_t Count>
+	static ResultString Call(ResultString &&original, const ushort (&tags)[Count], const ResultString *(&replacements)[Count]) {
+		auto result = std::move(original);
+		for (auto i = size_t(0); i != Count; ++i) {
+			result = ReplaceTag<ResultString>::Call(std::move(result), tags[i], *replacements[i]);
+		}
+		return result;
+	}
+
+};
+
+template <>
+struct ReplaceTags<QString> {
+	template <size_t Count>
+	static QString Call(QString &&original, const ushort (&tags)[Count], const QString *(&replacements)[Count]) {
+		static_assert(Count <= kMaxReplaceTags, "Too many tags in a lang string.");
+		return Replace(std::move(original), tags, replacements, Count);
+	}
+
+	// Finds all the tags in one pass and builds the result in one allocation.
+	static QString Replace(QString &&original, const ushort *tags, const QString **replacements, int count);
+
+};
+
 } // namespace Lang
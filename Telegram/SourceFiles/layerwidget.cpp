@@ -735,6 +735,7 @@ MediaPreviewWidget::MediaPreviewWidget(QWidget *parent, not_null<Window::Control
 , _emojiSize(Ui::Emoji::Size(Ui::Emoji::Index() + 1) / cIntRetinaFactor()) {
 	setAttribute(Qt::WA_TransparentForMouseEvents);
 	subscribe(Auth().downloaderTaskFinished(), [this] { update(); });
+	subscribe(Global::RefEmojiLargeLoaded(), [this] { update(); });
 }
 
 void MediaPreviewWidget::paintEvent(QPaintEvent *e) {
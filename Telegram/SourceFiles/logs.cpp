@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include <signal.h>
 #include <new>
+#include <thread>
 
 #include "platform/platform_specific.h"
 #include "mtproto/connection.h"
@@ -51,6 +52,14 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #endif // !TDESKTOP_DISABLE_CRASH_REPORTS
 
+namespace {
+
+// Debug entries waiting for the writer thread, in QChars.
+// If the disk can't keep up the new entries are dropped and counted.
+constexpr auto kMaxQueuedDebugSize = 4 * 1024 * 1024;
+
+} // namespace
+
 enum LogDataType {
 	LogDataMain,
 	LogDataDebug,
@@ -102,6 +111,10 @@ public:
 		}
 	}
 
+	~LogsDataFields() {
+		stopWriter();
+	}
+
 	bool openMain() {
 		return reopen(LogDataMain, 0, qsl("start"));
 	}
@@ -131,8 +144,12 @@ public:
 	}
 
 	void write(LogDataType type, const QString &msg) {
+		if (type != LogDataMain) {
+			// Debug logs are written by the writer thread, so that
+			// the connection threads never wait for the disk.
+			return queue(type, msg);
+		}
 		QMutexLocker lock(_logsMutex(type));
-		if (type != LogDataMain) reopenDebug();
 		if (!streams[type].device()) return;
 
 		streams[type] << msg;
@@ -140,12 +157,94 @@ public:
 	}
 
 private:
+	struct QueuedEntry {
+		LogDataType type;
+		QString msg;
+	};
+
+	void queue(LogDataType type, const QString &msg) {
+		QMutexLocker lock(&_queueMutex);
+		if (_writerFinished) {
+			return;
+		} else if (_queuedSize + msg.size() > kMaxQueuedDebugSize) {
+			++_dropped;
+			return;
+		}
+		_queuedSize += msg.size();
+		_queue.push_back({ type, msg });
+		if (!_writer.joinable()) {
+			_writer = std::thread([this] { writerLoop(); });
+		} else {
+			_queueCondition.wakeOne();
+		}
+	}
+
+	void writerLoop() {
+		auto batch = std::vector<QueuedEntry>();
+		while (true) {
+			auto dropped = 0;
+			{
+				QMutexLocker lock(&_queueMutex);
+				while (_queue.empty() && !_dropped && !_writerFinished) {
+					_queueCondition.wait(&_queueMutex);
+				}
+				if (_queue.empty() && !_dropped) {
+					return;
+				}
+				std::swap(batch, _queue);
+				_queuedSize = 0;
+				dropped = base::take(_dropped);
+			}
+			writeBatch(batch, dropped);
+			batch.clear();
+		}
+	}
+
+	void writeBatch(const std::vector<QueuedEntry> &batch, int dropped) {
+		reopenDebug();
+
+		bool written[LogDataCount] = { false };
+		if (dropped && streams[LogDataDebug].device()) {
+			streams[LogDataDebug] << qsl("%1 (debug log overflow, %2 entries dropped)\n").arg(_logsEntryStart()).arg(dropped);
+			written[LogDataDebug] = true;
+		}
+		for (auto &entry : batch) {
+			if (streams[entry.type].device()) {
+				streams[entry.type] << entry.msg;
+				written[entry.type] = true;
+			}
+		}
+		for (auto i = 0; i != LogDataCount; ++i) {
+			if (written[i]) {
+				streams[i].flush();
+			}
+		}
+	}
+
+	void stopWriter() {
+		{
+			QMutexLocker lock(&_queueMutex);
+			_writerFinished = true;
+			_queueCondition.wakeOne();
+		}
+		if (_writer.joinable()) {
+			_writer.join();
+		}
+	}
 
 	QSharedPointer<QFile> files[LogDataCount];
 	QTextStream streams[LogDataCount];
 
 	int32 part = -1;
 
+	QMutex _queueMutex;
+	QWaitCondition _queueCondition;
+	std::vector<QueuedEntry> _queue;
+	int _queuedSize = 0;
+	int _dropped = 0;
+	bool _writerFinished = false;
+	std::thread _writer;
+
 	bool reopen(LogDataType type, int32 dayIndex, const QString &postfix) {
 		if (streams[type].device()) {
 			if (type == LogDataMain) {
@@ -270,6 +369,11 @@ private:
 
 LogsDataFields *LogsData = 0;
 
+void _logsSetData(LogsDataFields *data) {
+	LogsData = data;
+	Logs::internal::Started = (data != nullptr);
+}
+
 typedef QList<QPair<LogDataType, QString> > LogsInMemoryList;
 LogsInMemoryList *LogsInMemory = 0;
 LogsInMemoryList *DeletedLogsInMemory = SharedMemoryLocation<LogsInMemoryList, 0>();
@@ -299,6 +403,11 @@ namespace SignalHandlers {
 }
 
 namespace Logs {
+namespace internal {
+
+bool Started = false;
+
+} // namespace internal
 
 	void start() {
 		Assert(LogsData == 0);
@@ -339,7 +448,7 @@ namespace Logs {
 #endif // OS_WIN_STORE
 		}
 
-		LogsData = new LogsDataFields();
+		_logsSetData(new LogsDataFields());
 		if (!workingDirChosen) {
 			cForceWorkingDir(cWorkingDir());
 			if (!LogsData->openMain()) {
@@ -362,7 +471,7 @@ namespace Logs {
 
 		if (!LogsData->openMain()) {
 			delete LogsData;
-			LogsData = 0;
+			_logsSetData(nullptr);
 		}
 
 		LOG(("Launched version: %1, alpha: %2, beta: %3, debug mode: %4, test dc: %5").arg(AppVersion).arg(Logs::b(cAlphaVersion())).arg(cBetaVersion()).arg(Logs::b(cDebug())).arg(Logs::b(cTestMode())));
@@ -400,7 +509,7 @@ namespace Logs {
 
 	void finish() {
 		delete LogsData;
-		LogsData = 0;
+		_logsSetData(nullptr);
 
 		if (LogsInMemory && LogsInMemory != DeletedLogsInMemory) {
 			delete LogsInMemory;
@@ -412,10 +521,6 @@ namespace Logs {
 		SignalHandlers::FinishCrashHandler();
 	}
 
-	bool started() {
-		return LogsData != 0;
-	}
-
 	bool instanceChecked() {
 		if (!LogsData) return false;
 
@@ -423,7 +528,7 @@ namespace Logs {
 			LogsBeforeSingleInstanceChecked = Logs::full();
 
 			delete LogsData;
-			LogsData = 0;
+			_logsSetData(nullptr);
 			LOG(("FATAL: Could not move logging to '%1'!").arg(_logsFilePath(LogDataMain)));
 			return false;
 		}
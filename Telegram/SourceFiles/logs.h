@@ -23,8 +23,16 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 class MTPlong;
 namespace Logs {
 
+namespace internal {
+
+	extern bool Started;
+
+} // namespace internal
+
 	void start();
-	bool started();
+	inline bool started() {
+		return internal::Started;
+	}
 	void finish();
 
 	bool instanceChecked();
@@ -72,6 +80,23 @@ namespace Logs {
 	QString vector(const QVector<MTPlong> &ids);
 	QString vector(const QVector<uint64> &ids);
 
+	// Trace categories of the hot paths, TRACE_LOG() of a category
+	// not listed in TDESKTOP_TRACE_CATEGORIES is compiled out.
+	enum TraceCategory : uint32 {
+		TraceTcp = 0x01U,
+		TraceMtp = 0x02U,
+		TraceMessage = 0x04U,
+		TraceSession = 0x08U,
+	};
+
+#ifndef TDESKTOP_TRACE_CATEGORIES
+#define TDESKTOP_TRACE_CATEGORIES 0xFFFFFFFFU
+#endif // !TDESKTOP_TRACE_CATEGORIES
+
+	constexpr bool TraceCompiled(uint32 category) {
+		return (uint32(TDESKTOP_TRACE_CATEGORIES) & category) != 0;
+	}
+
 }
 
 #define LOG(msg) (Logs::writeMain(QString msg))
@@ -80,12 +105,16 @@ namespace Logs {
 #define DEBUG_LOG(msg) { if (cDebug() || !Logs::started()) Logs::writeDebug(__FILE__, __LINE__, QString msg); }
 //usage DEBUG_LOG(("log: %1 %2").arg(1).arg(2))
 
-#define TCP_LOG(msg) { if (cDebug() || !Logs::started()) Logs::writeTcp(QString msg); }
+#define TCP_LOG(msg) { if (Logs::TraceCompiled(Logs::TraceTcp) && (cDebug() || !Logs::started())) Logs::writeTcp(QString msg); }
 //usage TCP_LOG(("log: %1 %2").arg(1).arg(2))
 
-#define MTP_LOG(dc, msg) { if (cDebug() || !Logs::started()) Logs::writeMtp(dc, QString msg); }
+#define MTP_LOG(dc, msg) { if (Logs::TraceCompiled(Logs::TraceMtp) && (cDebug() || !Logs::started())) Logs::writeMtp(dc, QString msg); }
 //usage MTP_LOG(dc, ("log: %1 %2").arg(1).arg(2))
 
+// The message is formatted only if the category is compiled in and debug logs are enabled.
+#define TRACE_LOG(category, msg) { if (Logs::TraceCompiled(category) && (cDebug() || !Logs::started())) Logs::writeDebug(__FILE__, __LINE__, QString msg); }
+//usage TRACE_LOG(Logs::TraceMessage, ("log: %1 %2").arg(1).arg(2))
+
 namespace SignalHandlers {
 
 	struct dump {
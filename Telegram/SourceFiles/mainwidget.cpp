@@ -78,6 +78,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 namespace {
 
 constexpr auto kSaveFloatPlayerPositionTimeoutMs = TimeMs(1000);
+constexpr auto kDifferenceChunkDuration = TimeMs(20);
+constexpr auto kDifferenceChunkMessages = 10;
+
+// The server does not accept more message ids in one delete request.
+constexpr auto kDeleteMessagesChunk = 100;
 
 MTPMessagesFilter TypeToMediaFilter(MediaOverviewType &type) {
 	switch (type) {
@@ -96,6 +101,13 @@ MTPMessagesFilter TypeToMediaFilter(MediaOverviewType &type) {
 
 } // namespace
 
+struct MainWidget::DifferenceFeed {
+	QVector<MTPMessage> messages;
+	MTPVector<MTPUpdate> other;
+	base::lambda<void()> done;
+	int fed = 0;
+};
+
 StackItemSection::StackItemSection(std::unique_ptr<Window::SectionMemento> &&memento) : StackItem(nullptr)
 , _memento(std::move(memento)) {
 }
@@ -812,6 +824,22 @@ void MainWidget::ui_repaintHistoryItem(not_null<const HistoryItem*> item) {
 	}
 }
 
+void MainWidget::ui_repaintHistoryItemMedia(not_null<const HistoryItem*> item) {
+	if (item->isLogEntry()) {
+		ui_repaintHistoryItem(item);
+		return;
+	}
+
+	// Media frames and progress don't change the chats list entry.
+	_history->ui_repaintHistoryItemMedia(item);
+	_playerPlaylist->ui_repaintHistoryItem(item);
+	_playerPanel->ui_repaintHistoryItem(item);
+	if (_overview) _overview->ui_repaintHistoryItem(item);
+	if (auto last = currentFloatPlayer()) {
+		last->widget->ui_repaintHistoryItem(item);
+	}
+}
+
 void MainWidget::notify_historyItemLayoutChanged(const HistoryItem *item) {
 	_history->notify_historyItemLayoutChanged(item);
 	if (_overview) _overview->notify_historyItemLayoutChanged(item);
@@ -1062,6 +1090,12 @@ void MainWidget::deleteHistoryPart(DeleteHistoryRequest request, const MTPmessag
 }
 
 void MainWidget::deleteMessages(PeerData *peer, const QVector<MTPint> &ids, bool forEveryone) {
+	if (ids.size() > kDeleteMessagesChunk) {
+		for (auto from = 0, count = ids.size(); from < count; from += kDeleteMessagesChunk) {
+			deleteMessages(peer, ids.mid(from, kDeleteMessagesChunk), forEveryone);
+		}
+		return;
+	}
 	if (peer->isChannel()) {
 		MTP::send(MTPchannels_DeleteMessages(peer->asChannel()->inputChannel, MTP_vector<MTPint>(ids)), rpcDone(&MainWidget::messagesAffected, peer));
 	} else {
@@ -1103,6 +1137,7 @@ void MainWidget::deleteConversation(PeerData *peer, bool deleteHistory) {
 		history->newLoaded = true;
 		history->oldLoaded = deleteHistory;
 	}
+	Local::clearHistoryCache(peer->id);
 	if (peer->isChannel()) {
 		peer->asChannel()->ptsWaitingForShortPoll(-1);
 	}
@@ -1160,6 +1195,7 @@ void MainWidget::clearHistory(PeerData *peer) {
 		h->clear();
 		h->newLoaded = h->oldLoaded = true;
 	}
+	Local::clearHistoryCache(peer->id);
 	auto flags = MTPmessages_DeleteHistory::Flag::f_just_clear;
 	DeleteHistoryRequest request = { peer, true };
 	MTP::send(MTPmessages_DeleteHistory(MTP_flags(flags), peer->input, MTP_int(0)), rpcDone(&MainWidget::deleteHistoryPart, request));
@@ -1320,43 +1356,7 @@ bool MainWidget::sendMessageFail(const RPCError &error) {
 }
 
 void MainWidget::onCacheBackground() {
-	if (Window::Theme::Background()->tile()) {
-		auto &bg = Window::Theme::Background()->pixmapForTiled();
-
-		auto result = QImage(_willCacheFor.width() * cIntRetinaFactor(), _willCacheFor.height() * cIntRetinaFactor(), QImage::Format_RGB32);
-        result.setDevicePixelRatio(cRetinaFactor());
-		{
-			QPainter p(&result);
-			auto left = 0;
-			auto top = 0;
-			auto right = _willCacheFor.width();
-			auto bottom = _willCacheFor.height();
-			auto w = bg.width() / cRetinaFactor();
-			auto h = bg.height() / cRetinaFactor();
-			auto sx = 0;
-			auto sy = 0;
-			auto cx = qCeil(_willCacheFor.width() / w);
-			auto cy = qCeil(_willCacheFor.height() / h);
-			for (int i = sx; i < cx; ++i) {
-				for (int j = sy; j < cy; ++j) {
-					p.drawPixmap(QPointF(i * w, j * h), bg);
-				}
-			}
-		}
-		_cachedX = 0;
-		_cachedY = 0;
-		_cachedBackground = App::pixmapFromImageInPlace(std::move(result));
-	} else {
-		auto &bg = Window::Theme::Background()->pixmap();
-
-		QRect to, from;
-		Window::Theme::ComputeBackgroundRects(_willCacheFor, bg.size(), to, from);
-		_cachedX = to.x();
-		_cachedY = to.y();
-		_cachedBackground = App::pixmapFromImageInPlace(bg.toImage().copy(from).scaled(to.width() * cIntRetinaFactor(), to.height() * cIntRetinaFactor(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
-		_cachedBackground.setDevicePixelRatio(cRetinaFactor());
-	}
-	_cachedFor = _willCacheFor;
+	Window::Theme::Background()->prepareFor(_willCacheFor.size());
 }
 
 void MainWidget::forwardSelectedItems() {
@@ -1527,6 +1527,9 @@ void MainWidget::readServerHistory(History *history, ReadServerHistoryChecks che
 
 void MainWidget::unreadCountChanged(History *history) {
 	_history->unreadCountChanged(history);
+	if (history->inChatList(Dialogs::Mode::All)) {
+		Local::writeDialogsSnapshot();
+	}
 }
 
 TimeMs MainWidget::highlightStartTime(not_null<const HistoryItem*> item) const {
@@ -2085,16 +2088,14 @@ bool MainWidget::isIdle() const {
 }
 
 void MainWidget::clearCachedBackground() {
-	_cachedBackground = QPixmap();
 	_cacheBackgroundTimer.stop();
 	update();
 }
 
 QPixmap MainWidget::cachedBackground(const QRect &forRect, int &x, int &y) {
-	if (!_cachedBackground.isNull() && forRect == _cachedFor) {
-		x = _cachedX;
-		y = _cachedY;
-		return _cachedBackground;
+	auto result = Window::Theme::Background()->preparedFor(forRect.size(), x, y);
+	if (!result.isNull()) {
+		return result;
 	}
 	if (_willCacheFor != forRect || !_cacheBackgroundTimer.isActive()) {
 		_willCacheFor = forRect;
@@ -2275,6 +2276,15 @@ void MainWidget::fillPeerMenu(PeerData *peer, base::lambda<QAction*(const QStrin
 		App::main()->searchInPeer(peer);
 	});
 
+	callback(lang(lng_profile_export_history), [peer] {
+		auto filter = qsl("JSON Lines (*.jsonl);;") + FileDialog::AllFilesFilter();
+		FileDialog::GetWritePath(lang(lng_profile_export_history), filter, filedialogDefaultName(qsl("history"), qsl(".jsonl")), [peer](const QString &result) {
+			if (!result.isEmpty() && AuthSession::Exists()) {
+				Auth().api().exportHistory(peer, result);
+			}
+		});
+	});
+
 	auto clearHistoryHandler = [peer] {
 		auto text = peer->isUser() ? lng_sure_delete_history(lt_contact, peer->name) : lng_sure_delete_group_history(lt_group, peer->name);
 		Ui::show(Box<ConfirmBox>(text, lang(lng_box_delete), st::attentionBoxButton, [peer] {
@@ -2766,6 +2776,9 @@ Window::SectionSlideParams MainWidget::prepareShowAnimation(bool willHaveTopBarS
 		}
 		if (_overview) _overview->grabFinish();
 		_history->grabFinish();
+		if (!_overview) {
+			_history->rememberContentSnapshot(result);
+		}
 	}
 
 	if (playerVolumeVisible) {
@@ -3564,6 +3577,7 @@ void MainWidget::gotChannelDifference(ChannelData *channel, const MTPupdates_Cha
 		App::feedChats(d.vchats);
 
 		_handlingChannelDifference = true;
+		_dialogs->startUpdatesBatch();
 		feedMessageIds(d.vother_updates);
 
 		// feed messages and groups, copy from App::feedMsgs
@@ -3597,6 +3611,7 @@ void MainWidget::gotChannelDifference(ChannelData *channel, const MTPupdates_Cha
 		}
 
 		feedUpdateVector(d.vother_updates, true);
+		_dialogs->finishUpdatesBatch();
 		_handlingChannelDifference = false;
 
 		if (d.has_timeout()) timeout = d.vtimeout.v;
@@ -3642,9 +3657,11 @@ void MainWidget::gotRangeDifference(ChannelData *channel, const MTPupdates_Chann
 		App::feedChats(d.vchats);
 
 		_handlingChannelDifference = true;
+		_dialogs->startUpdatesBatch();
 		feedMessageIds(d.vother_updates);
 		App::feedMsgs(d.vnew_messages, NewMessageUnread);
 		feedUpdateVector(d.vother_updates, true);
+		_dialogs->finishUpdatesBatch();
 		_handlingChannelDifference = false;
 
 		nextRequestPts = d.vpts.v;
@@ -3695,21 +3712,21 @@ void MainWidget::gotDifference(const MTPupdates_Difference &difference) {
 	} break;
 	case mtpc_updates_differenceSlice: {
 		auto &d = difference.c_updates_differenceSlice();
-		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates);
+		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates, [this, state = d.vintermediate_state] {
+			auto &s = state.c_updates_state();
+			updSetState(s.vpts.v, s.vdate.v, s.vqts.v, s.vseq.v);
 
-		auto &s = d.vintermediate_state.c_updates_state();
-		updSetState(s.vpts.v, s.vdate.v, s.vqts.v, s.vseq.v);
-
-		_ptsWaiter.setRequesting(false);
+			_ptsWaiter.setRequesting(false);
 
-		MTP_LOG(0, ("getDifference { good - after a slice of difference was received }%1").arg(cTestMode() ? " TESTMODE" : ""));
-		getDifference();
+			MTP_LOG(0, ("getDifference { good - after a slice of difference was received }%1").arg(cTestMode() ? " TESTMODE" : ""));
+			getDifference();
+		});
 	} break;
 	case mtpc_updates_difference: {
 		auto &d = difference.c_updates_difference();
-		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates);
-
-		gotState(d.vstate);
+		feedDifference(d.vusers, d.vchats, d.vnew_messages, d.vother_updates, [this, state = d.vstate] {
+			gotState(state);
+		});
 	} break;
 	case mtpc_updates_differenceTooLong: {
 		auto &d = difference.c_updates_differenceTooLong();
@@ -3799,14 +3816,68 @@ bool MainWidget::ptsUpdateAndApply(int32 pts, int32 ptsCount) {
 	return _ptsWaiter.updateAndApply(nullptr, pts, ptsCount);
 }
 
-void MainWidget::feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other) {
+void MainWidget::feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other, base::lambda<void()> done) {
+	Expects(_differenceFeed == nullptr);
+
 	Auth().checkAutoLock();
 	App::feedUsers(users);
 	App::feedChats(chats);
 	feedMessageIds(other);
-	App::feedMsgs(msgs, NewMessageUnread);
-	feedUpdateVector(other, true);
+
+	// Chunks are fed in the order App::feedMsgs() would use for the whole vector.
+	_differenceFeed = std::make_unique<DifferenceFeed>();
+	_differenceFeed->messages = msgs.v;
+	_differenceFeed->other = other;
+	_differenceFeed->done = std::move(done);
+	std::stable_sort(_differenceFeed->messages.begin(), _differenceFeed->messages.end(), [](const MTPMessage &a, const MTPMessage &b) {
+		return (uint32(idFromMessage(a)) < uint32(idFromMessage(b)));
+	});
+	feedDifferenceChunk();
+}
+
+void MainWidget::feedDifferenceChunk() {
+	Expects(_differenceFeed != nullptr);
+
+	auto &feed = *_differenceFeed;
+	auto &messages = feed.messages;
+	auto till = getms() + kDifferenceChunkDuration;
+
+	// Apply each chunk with a single chats list resort.
+	_dialogs->startUpdatesBatch();
+	while (feed.fed < messages.size()) {
+		auto count = qMin(kDifferenceChunkMessages, messages.size() - feed.fed);
+		App::feedMsgs(messages.mid(feed.fed, count), NewMessageUnread);
+		feed.fed += count;
+		if (getms() >= till) {
+			break;
+		}
+	}
+	auto finished = (feed.fed == messages.size());
+	if (finished) {
+		feedUpdateVector(feed.other, true);
+	}
+	_dialogs->finishUpdatesBatch();
 	_history->peerMessagesUpdated();
+
+	if (!finished) {
+		App::wnd()->updateConnectingStatus();
+		InvokeQueued(this, [this] { feedDifferenceChunk(); });
+		return;
+	}
+	auto done = std::move(_differenceFeed->done);
+	_differenceFeed = nullptr;
+	App::wnd()->updateConnectingStatus();
+	if (done) {
+		done();
+	}
+}
+
+int MainWidget::differenceFedCount() const {
+	return _differenceFeed ? _differenceFeed->fed : 0;
+}
+
+int MainWidget::differenceFullCount() const {
+	return _differenceFeed ? _differenceFeed->messages.size() : 0;
 }
 
 bool MainWidget::failDifference(const RPCError &error) {
@@ -3869,12 +3940,16 @@ void MainWidget::onGetDifferenceTimeAfterFail() {
 	}
 }
 
+void MainWidget::startScrollBenchmark() {
+	_history->startScrollBenchmark();
+}
+
 void MainWidget::getDifference() {
 	if (this != App::main()) return;
 
 	_getDifferenceTimeByPts = 0;
 
-	if (requestingDifference()) return;
+	if (requestingDifference() || feedingDifference()) return;
 
 	_bySeqUpdates.clear();
 	_bySeqTimer.stop();
@@ -3926,6 +4001,7 @@ void MainWidget::start(const MTPUser *self) {
 	}
 
 	Local::readSavedPeers();
+	_dialogs->dialogsSnapshotRead(Local::readDialogsSnapshot());
 	cSetOtherOnline(0);
 	if (auto user = App::feedUsers(MTP_vector<MTPUser>(1, *self))) {
 		user->loadUserpic();
@@ -3938,10 +4014,10 @@ void MainWidget::start(const MTPUser *self) {
 	App::wnd()->sendServiceHistoryRequest();
 	Local::readInstalledStickers();
 	Local::readFeaturedStickers();
-	Local::readRecentStickers();
-	Local::readFavedStickers();
-	Local::readSavedGifs();
+	Local::scheduleDeferredStickersRead();
+	InvokeQueued(this, [] { Local::readDeferredStickers(); });
 	_history->start();
+	Messenger::Instance().mtp()->prepareMediaDcs();
 
 	Messenger::Instance().checkStartUrl();
 }
@@ -4514,6 +4590,7 @@ void MainWidget::updateReceived(const mtpPrime *from, const mtpPrime *end) {
 		return getDifference();
 	} else {
 		try {
+			MTP::internal::TypeDataArenaScope arena;
 			MTPUpdates updates;
 			updates.read(from, end);
 
@@ -5072,6 +5149,7 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 		if (auto user = App::userLoaded(d.vuser_id.v)) {
 			user->setPhoto(d.vphoto);
 			user->loadUserpic();
+			user->invalidateFull();
 			if (mtpIsTrue(d.vprevious)) {
 				user->photosCount = -1;
 				user->photos.clear();
@@ -5214,6 +5292,7 @@ void MainWidget::feedUpdate(const MTPUpdate &update) {
 		auto &d = update.c_updateChannel();
 		if (auto channel = App::channelLoaded(d.vchannel_id.v)) {
 			channel->inviter = 0;
+			channel->invalidateFull();
 			if (!channel->amIn()) {
 				deleteConversation(channel, false);
 			} else if (!channel->amCreator() && App::history(channel->id)) { // create history
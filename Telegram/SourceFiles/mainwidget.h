@@ -378,6 +378,16 @@ public:
 		return _ptsWaiter.requesting();
 	}
 
+	// Large differences are applied in chunks between the event loop
+	// iterations, the progress is shown in the connecting widget.
+	bool feedingDifference() const {
+		return (_differenceFeed != nullptr);
+	}
+	int differenceFedCount() const;
+	int differenceFullCount() const;
+
+	void startScrollBenchmark();
+
 	bool contentOverlapped(const QRect &globalRect);
 
 	void documentLoadProgress(DocumentData *document);
@@ -385,6 +395,7 @@ public:
 	void app_sendBotCallback(const HistoryMessageReplyMarkup::Button *button, const HistoryItem *msg, int row, int col);
 
 	void ui_repaintHistoryItem(not_null<const HistoryItem*> item);
+	void ui_repaintHistoryItemMedia(not_null<const HistoryItem*> item);
 	void ui_showPeerHistory(quint64 peer, qint32 msgId, Ui::ShowWay way);
 	PeerData *ui_getPeerForMouseAction();
 
@@ -534,7 +545,8 @@ private:
 	void getChannelDifference(ChannelData *channel, ChannelDifferenceRequest from = ChannelDifferenceRequest::Unknown);
 	void gotDifference(const MTPupdates_Difference &diff);
 	bool failDifference(const RPCError &e);
-	void feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other);
+	void feedDifference(const MTPVector<MTPUser> &users, const MTPVector<MTPChat> &chats, const MTPVector<MTPMessage> &msgs, const MTPVector<MTPUpdate> &other, base::lambda<void()> done);
+	void feedDifferenceChunk();
 	void gotState(const MTPupdates_State &state);
 	void updSetState(int32 pts, int32 date, int32 qts, int32 seq);
 	void gotChannelDifference(ChannelData *channel, const MTPupdates_ChannelDifference &diff);
@@ -676,13 +688,13 @@ private:
 	ChannelFailDifferenceTimeout _channelFailDifferenceTimeout; // growing timeout for getChannelDifference calls, if it fails
 	SingleTimer _failDifferenceTimer;
 
+	struct DifferenceFeed;
+	std::unique_ptr<DifferenceFeed> _differenceFeed;
+
 	TimeMs _lastUpdateTime = 0;
 	bool _handlingChannelDifference = false;
 
-	QPixmap _cachedBackground;
-	QRect _cachedFor, _willCacheFor;
-	int _cachedX = 0;
-	int _cachedY = 0;
+	QRect _willCacheFor;
 	SingleTimer _cacheBackgroundTimer;
 
 	typedef QMap<ChannelData*, bool> UpdatedChannels;
@@ -58,6 +58,17 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+// Enough for the tray, taskbar and overlay icons of a couple of counters.
+constexpr auto kMaxCachedCounterIcons = 32;
+
+// Counters that are painted the same way share the cached icon.
+int CounterIconBucket(int count, bool smallIcon) {
+	if (smallIcon) {
+		return (count < 100) ? count : (100 + (count % 10));
+	}
+	return (count < 1000) ? count : (1000 + (count % 100));
+}
+
 // Code for testing languages is F7-F6-F7-F8
 void FeedLangTestingKey(int key) {
 	static auto codeState = 0;
@@ -383,6 +394,8 @@ void MainWindow::updateConnectingStatus() {
 	} else if (state < 0) {
 		showConnecting(lng_reconnecting(lt_count, ((-state) / 1000) + 1), lang(throughProxy ? lng_connecting_settings : lng_reconnecting_try_now));
 		QTimer::singleShot((-state) % 1000, this, SLOT(updateConnectingStatus()));
+	} else if (_main && _main->feedingDifference()) {
+		showConnecting(lng_updating_messages(lt_ready, QString::number(_main->differenceFedCount()), lt_total, QString::number(_main->differenceFullCount())));
 	} else {
 		hideConnecting();
 	}
@@ -888,6 +901,26 @@ void MainWindow::placeSmallCounter(QImage &img, int size, int count, style::colo
 }
 
 QImage MainWindow::iconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon) {
+	auto key = CounterIconKey {
+		size,
+		smallIcon,
+		CounterIconBucket(count, smallIcon),
+		bg->c.rgba(),
+		fg->c.rgba()
+	};
+	auto i = _counterIcons.find(key);
+	if (i != _counterIcons.cend()) {
+		return i->second;
+	}
+	if (int(_counterIcons.size()) >= kMaxCachedCounterIcons) {
+		_counterIcons.clear();
+	}
+	auto result = prepareIconWithCounter(size, count, bg, fg, smallIcon);
+	_counterIcons.emplace(key, result);
+	return result;
+}
+
+QImage MainWindow::prepareIconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon) {
 	bool layer = false;
 	if (size < 0) {
 		size = -size;
@@ -185,8 +185,13 @@ private:
 	QPixmap grabInner();
 
 	void placeSmallCounter(QImage &img, int size, int count, style::color bg, const QPoint &shift, style::color color) override;
+	QImage prepareIconWithCounter(int size, int count, style::color bg, style::color fg, bool smallIcon);
 	QImage icon16, icon32, icon64, iconbig16, iconbig32, iconbig64;
 
+	// Size, smallIcon, counter bucket, bg and fg colors.
+	using CounterIconKey = std::tuple<int, bool, int, QRgb, QRgb>;
+	std::map<CounterIconKey, QImage> _counterIcons;
+
 	struct DelayedServiceMsg {
 		DelayedServiceMsg(const TextWithEntities &message, const MTPMessageMedia &media, int32 date) : message(message), media(media), date(date) {
 		}
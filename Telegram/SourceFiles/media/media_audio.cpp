@@ -24,8 +24,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_child_ffmpeg_loader.h"
 #include "media/media_audio_loaders.h"
 #include "media/media_audio_track.h"
+#include "media/media_audio_peak_avx2.h"
 #include "platform/platform_audio.h"
+#include "storage/streamed_file.h"
 #include "base/task_queue.h"
+#include "base/cpu_features.h"
 
 #include <AL/al.h>
 #include <AL/alc.h>
@@ -33,6 +36,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include <numeric>
 
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define MEDIA_AUDIO_PEAK_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+
 Q_DECLARE_METATYPE(AudioMsgId);
 Q_DECLARE_METATYPE(VoiceWaveform);
 
@@ -249,6 +257,68 @@ void StopDetachIfNotUsedSafe() {
 	});
 }
 
+uint16 MaxSamplePeak(const uchar *samples, int count) {
+	// Unsigned 8 bit samples are centered at 0x80.
+	auto maximum = uchar(0x80), minimum = uchar(0x80);
+	auto i = 0;
+#ifdef MEDIA_AUDIO_PEAK_SSE2
+	if (count >= 16) {
+		auto maximums = _mm_set1_epi8(char(0x80));
+		auto minimums = maximums;
+		for (; i + 16 <= count; i += 16) {
+			auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+			maximums = _mm_max_epu8(maximums, values);
+			minimums = _mm_min_epu8(minimums, values);
+		}
+		uchar lanes[32];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), maximums);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 16), minimums);
+		for (auto j = 0; j != 16; ++j) {
+			accumulate_max(maximum, lanes[j]);
+			accumulate_min(minimum, lanes[16 + j]);
+		}
+	}
+#endif // MEDIA_AUDIO_PEAK_SSE2
+	for (; i != count; ++i) {
+		accumulate_max(maximum, samples[i]);
+		accumulate_min(minimum, samples[i]);
+	}
+	return qMax(ReadOneSample(maximum), ReadOneSample(minimum));
+}
+
+uint16 MaxSamplePeak(const int16 *samples, int count) {
+	auto maximum = int16(0), minimum = int16(0);
+	static const auto UseAVX2 = base::CpuHas(base::CpuFeature::AVX2);
+	if (UseAVX2) {
+		internal::SamplePeakAVX2(samples, count, &maximum, &minimum);
+		return qMax(ReadOneSample(maximum), ReadOneSample(minimum));
+	}
+	auto i = 0;
+#ifdef MEDIA_AUDIO_PEAK_SSE2
+	if (count >= 8) {
+		auto maximums = _mm_setzero_si128();
+		auto minimums = maximums;
+		for (; i + 8 <= count; i += 8) {
+			auto values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+			maximums = _mm_max_epi16(maximums, values);
+			minimums = _mm_min_epi16(minimums, values);
+		}
+		int16 lanes[16];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), maximums);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 8), minimums);
+		for (auto j = 0; j != 8; ++j) {
+			accumulate_max(maximum, lanes[j]);
+			accumulate_min(minimum, lanes[8 + j]);
+		}
+	}
+#endif // MEDIA_AUDIO_PEAK_SSE2
+	for (; i != count; ++i) {
+		accumulate_max(maximum, samples[i]);
+		accumulate_min(minimum, samples[i]);
+	}
+	return qMax(ReadOneSample(maximum), ReadOneSample(minimum));
+}
+
 } // namespace Audio
 
 namespace Player {
@@ -341,6 +411,10 @@ void Mixer::Track::clear() {
 	state = TrackState();
 	file = FileLocation();
 	data = QByteArray();
+	if (streamed) {
+		streamed->interruptReads();
+		streamed = nullptr;
+	}
 	bufferedPosition = 0;
 	bufferedLength = 0;
 	loading = false;
@@ -353,6 +427,7 @@ void Mixer::Track::clear() {
 		samplesCount[i] = 0;
 		bufferSamples[i] = QByteArray();
 	}
+	bufferSize = kStartBufferSize;
 
 	videoData = nullptr;
 	lastUpdateWhen = 0;
@@ -373,6 +448,7 @@ void Mixer::Track::started() {
 		samplesCount[i] = 0;
 		bufferSamples[i] = QByteArray();
 	}
+	bufferSize = kStartBufferSize;
 }
 
 bool Mixer::Track::isStreamCreated() const {
@@ -458,6 +534,7 @@ Mixer::Mixer()
 	});
 	connect(this, SIGNAL(loaderOnStart(const AudioMsgId&, qint64)), _loader, SLOT(onStart(const AudioMsgId&, qint64)));
 	connect(this, SIGNAL(loaderOnCancel(const AudioMsgId&)), _loader, SLOT(onCancel(const AudioMsgId&)));
+	connect(this, SIGNAL(loaderOnStreamedPart(const AudioMsgId&)), _loader, SLOT(onStreamedPart(const AudioMsgId&)));
 	connect(_loader, SIGNAL(needToCheck()), _fader, SLOT(onTimer()));
 	connect(_loader, SIGNAL(error(const AudioMsgId&)), this, SLOT(onError(const AudioMsgId&)));
 	connect(_fader, SIGNAL(needToPreload(const AudioMsgId&)), _loader, SLOT(onLoad(const AudioMsgId&)));
@@ -502,7 +579,7 @@ void Mixer::onUpdated(const AudioMsgId &audio) {
 void Mixer::onError(const AudioMsgId &audio) {
 	emit stoppedOnError(audio);
 
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 	auto type = audio.type();
 	if (type == AudioMsgId::Type::Voice) {
 		if (auto current = trackForType(type)) {
@@ -516,7 +593,7 @@ void Mixer::onError(const AudioMsgId &audio) {
 void Mixer::onStopped(const AudioMsgId &audio) {
 	emit updated(audio);
 
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 	auto type = audio.type();
 	if (type == AudioMsgId::Type::Voice) {
 		if (auto current = trackForType(type)) {
@@ -614,6 +691,10 @@ bool Mixer::fadedStop(AudioMsgId::Type type, bool *fadedStart) {
 	return false;
 }
 
+void Mixer::streamedPartReceived(const AudioMsgId &audio) {
+	emit loaderOnStreamedPart(audio);
+}
+
 void Mixer::play(const AudioMsgId &audio, int64 position) {
 	setSongVolume(Global::SongVolume());
 	play(audio, nullptr, position);
@@ -626,7 +707,7 @@ void Mixer::play(const AudioMsgId &audio, std::unique_ptr<VideoSoundData> videoD
 	AudioMsgId stopped;
 	auto notLoadedYet = false;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		Audio::AttachToDevice();
 		if (!AudioDevice) return;
 
@@ -660,6 +741,10 @@ void Mixer::play(const AudioMsgId &audio, std::unique_ptr<VideoSoundData> videoD
 				stopped = current->state.id;
 			}
 			if (current->state.id) {
+				if (current->streamed) {
+					// Don't leave the loader thread waiting for the old file parts.
+					current->streamed->interruptReads();
+				}
 				emit loaderOnCancel(current->state.id);
 				emit faderOnTimer();
 			}
@@ -689,7 +774,17 @@ void Mixer::play(const AudioMsgId &audio, std::unique_ptr<VideoSoundData> videoD
 		} else {
 			current->file = audio.audio()->location(true);
 			current->data = audio.audio()->data();
-			notLoadedYet = (current->file.isEmpty() && current->data.isEmpty());
+			current->streamed = (current->file.isEmpty() && current->data.isEmpty())
+				? audio.audio()->streamedFile()
+				: nullptr;
+			if (current->streamed) {
+				current->streamed->setPartReceivedCallback([audio] {
+					if (auto player = mixer()) {
+						player->streamedPartReceived(audio);
+					}
+				});
+			}
+			notLoadedYet = (current->file.isEmpty() && current->data.isEmpty() && !current->streamed);
 		}
 		if (notLoadedYet) {
 			auto newState = (type == AudioMsgId::Type::Song) ? State::Stopped : State::StoppedAtError;
@@ -723,7 +818,7 @@ void Mixer::feedFromVideo(VideoSoundPart &&part) {
 TimeMs Mixer::getVideoCorrectedTime(const AudioMsgId &audio, TimeMs frameMs, TimeMs systemMs) {
 	auto result = frameMs;
 
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 	auto type = audio.type();
 	auto track = trackForType(type);
 	if (track && track->state.id == audio && track->lastUpdateWhen > 0) {
@@ -739,7 +834,7 @@ TimeMs Mixer::getVideoCorrectedTime(const AudioMsgId &audio, TimeMs frameMs, Tim
 void Mixer::videoSoundProgress(const AudioMsgId &audio) {
 	auto type = audio.type();
 
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 
 	auto current = trackForType(type);
 	if (current && current->state.length && current->state.frequency) {
@@ -764,7 +859,7 @@ bool Mixer::checkCurrentALError(AudioMsgId::Type type) {
 void Mixer::pause(const AudioMsgId &audio, bool fast) {
 	AudioMsgId current;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		auto type = audio.type();
 		auto track = trackForType(type);
 		if (!track || track->state.id != audio) {
@@ -811,7 +906,7 @@ void Mixer::pause(const AudioMsgId &audio, bool fast) {
 void Mixer::resume(const AudioMsgId &audio, bool fast) {
 	AudioMsgId current;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		auto type = audio.type();
 		auto track = trackForType(type);
 		if (!track || track->state.id != audio) {
@@ -867,7 +962,7 @@ void Mixer::resume(const AudioMsgId &audio, bool fast) {
 }
 
 void Mixer::seek(AudioMsgId::Type type, int64 position) {
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 
 	auto current = trackForType(type);
 	auto audio = current->state.id;
@@ -924,7 +1019,7 @@ void Mixer::seek(AudioMsgId::Type type, int64 position) {
 void Mixer::stop(const AudioMsgId &audio) {
 	AudioMsgId current;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		auto type = audio.type();
 		auto track = trackForType(type);
 		if (!track || track->state.id != audio) {
@@ -947,7 +1042,7 @@ void Mixer::stop(const AudioMsgId &audio, State state) {
 
 	AudioMsgId current;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		auto type = audio.type();
 		auto track = trackForType(type);
 		if (!track || track->state.id != audio || IsStopped(track->state.state)) {
@@ -968,7 +1063,7 @@ void Mixer::stop(const AudioMsgId &audio, State state) {
 void Mixer::stopAndClear() {
 	Track *current_audio = nullptr, *current_song = nullptr;
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		if ((current_audio = trackForType(AudioMsgId::Type::Voice))) {
 			setStoppedState(current_audio);
 		}
@@ -983,7 +1078,7 @@ void Mixer::stopAndClear() {
 		emit updated(current_audio->state.id);
 	}
 	{
-		QMutexLocker lock(&AudioMutex);
+		internal::TrackStateLocker lock;
 		auto clearAndCancel = [this](AudioMsgId::Type type, int index) {
 			auto track = trackForType(type, index);
 			if (track->state.id) {
@@ -1000,12 +1095,24 @@ void Mixer::stopAndClear() {
 }
 
 TrackState Mixer::currentState(AudioMsgId::Type type) {
-	QMutexLocker lock(&AudioMutex);
-	auto current = trackForType(type);
-	if (!current) {
-		return TrackState();
+	QMutexLocker lock(&_publishedMutex);
+	switch (type) {
+	case AudioMsgId::Type::Voice: return _publishedVoice;
+	case AudioMsgId::Type::Song: return _publishedSong;
+	case AudioMsgId::Type::Video: return _publishedVideo;
 	}
-	return current->state;
+	return TrackState();
+}
+
+void Mixer::publishTrackStates() {
+	const auto voice = trackForType(AudioMsgId::Type::Voice)->state;
+	const auto song = trackForType(AudioMsgId::Type::Song)->state;
+	const auto video = _videoTrack.state;
+
+	QMutexLocker lock(&_publishedMutex);
+	_publishedVoice = voice;
+	_publishedSong = song;
+	_publishedVideo = video;
 }
 
 void Mixer::setStoppedState(Track *current, State state) {
@@ -1018,7 +1125,7 @@ void Mixer::setStoppedState(Track *current, State state) {
 }
 
 void Mixer::clearStoppedAtStart(const AudioMsgId &audio) {
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 	auto track = trackForType(audio.type());
 	if (track && track->state.id == audio && track->state.state == State::StoppedAtStart) {
 		setStoppedState(track);
@@ -1099,7 +1206,7 @@ void Fader::onInit() {
 }
 
 void Fader::onTimer() {
-	QMutexLocker lock(&AudioMutex);
+	internal::TrackStateLocker lock;
 	if (!mixer()) return;
 
 	auto volumeChangedAll = false;
@@ -1140,12 +1247,13 @@ void Fader::onTimer() {
 	}
 	auto hasFading = (_suppressAll || _suppressSongAnim);
 	auto hasPlaying = false;
+	auto checkPlaybackTimeout = kCheckPlaybackPositionTimeout;
 
-	auto updatePlayback = [this, &hasPlaying, &hasFading](AudioMsgId::Type type, int index, float64 volumeMultiplier, bool suppressGainChanged) {
+	auto updatePlayback = [this, &hasPlaying, &hasFading, &checkPlaybackTimeout](AudioMsgId::Type type, int index, float64 volumeMultiplier, bool suppressGainChanged) {
 		auto track = mixer()->trackForType(type, index);
 		if (IsStopped(track->state.state) || track->state.state == State::Paused || !track->isStreamCreated()) return;
 
-		auto emitSignals = updateOnePlayback(track, hasPlaying, hasFading, volumeMultiplier, suppressGainChanged);
+		auto emitSignals = updateOnePlayback(track, hasPlaying, hasFading, checkPlaybackTimeout, volumeMultiplier, suppressGainChanged);
 		if (emitSignals & EmitError) emit error(track->state.id);
 		if (emitSignals & EmitStopped) emit audioStopped(track->state.id);
 		if (emitSignals & EmitPositionUpdated) emit playPositionUpdated(track->state.id);
@@ -1167,14 +1275,14 @@ void Fader::onTimer() {
 		_timer.start(kCheckFadingTimeout);
 		Audio::StopDetachIfNotUsedSafe();
 	} else if (hasPlaying) {
-		_timer.start(kCheckPlaybackPositionTimeout);
+		_timer.start(checkPlaybackTimeout);
 		Audio::StopDetachIfNotUsedSafe();
 	} else {
 		Audio::ScheduleDetachIfNotUsedSafe();
 	}
 }
 
-int32 Fader::updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasFading, float64 volumeMultiplier, bool volumeChanged) {
+int32 Fader::updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasFading, TimeMs &checkPlaybackTimeout, float64 volumeMultiplier, bool volumeChanged) {
 	auto playing = false;
 	auto fading = false;
 
@@ -1211,7 +1319,11 @@ int32 Fader::updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasF
 	}
 
 	auto fullPosition = track->bufferedPosition + positionInBuffered;
-	if (state != AL_PLAYING && !track->loading) {
+	if (state != AL_PLAYING && !track->loading && !track->loaded && (fading || playing)) {
+		// The queued buffers ran out before the refill, load more and restart.
+		track->loading = true;
+		emitSignals |= EmitNeedToPreload;
+	} else if (state != AL_PLAYING && !track->loading) {
 		if (fading || playing) {
 			fading = false;
 			playing = false;
@@ -1269,12 +1381,37 @@ int32 Fader::updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasF
 	}
 	if (playing || track->state.state == State::Starting || track->state.state == State::Resuming) {
 		if (!track->loaded && !track->loading) {
-			auto needPreload = (track->state.position + kPreloadSamples > track->bufferedPosition + track->bufferedLength);
+			// Refill as soon as some buffer is processed, or while less than
+			// kPreloadSamples are queued and there is a free buffer left.
+			ALint processed = 0;
+			alGetSourcei(track->stream.source, AL_BUFFERS_PROCESSED, &processed);
+			if (errorHappened()) return EmitError;
+
+			auto hasFreeBuffer = !track->samplesCount[Mixer::Track::kBuffersCount - 1];
+			auto needPreload = (processed > 0)
+				|| (hasFreeBuffer && track->state.position + kPreloadSamples > track->bufferedPosition + track->bufferedLength);
 			if (needPreload) {
 				track->loading = true;
 				emitSignals |= EmitNeedToPreload;
 			}
 		}
+		if (!track->loaded && state == AL_PLAYING && track->state.frequency > 0) {
+			// Check right after the playing buffer is processed to refill it.
+			auto left = track->samplesCount[0] - positionInBuffered;
+			if (left > 0) {
+				auto leftMs = TimeMs(1000) * left / track->state.frequency + 1;
+				accumulate_min(checkPlaybackTimeout, qMax(leftMs, kCheckFadingTimeout));
+			}
+		}
+	}
+	if (playing && track->loaded && state == AL_PLAYING) {
+		// Check right after the last buffer is played, so that the player
+		// switches to the next track without waiting for the regular check.
+		auto remaining = track->bufferedPosition + track->bufferedLength - fullPosition;
+		if (remaining >= 0 && track->state.frequency > 0) {
+			auto remainingMs = TimeMs(1000) * remaining / track->state.frequency + 1;
+			accumulate_min(checkPlaybackTimeout, qMax(remainingMs, kCheckFadingTimeout));
+		}
 	}
 	if (playing) hasPlaying = true;
 	if (fading) hasFading = true;
@@ -1334,6 +1471,25 @@ QMutex *audioPlayerMutex() {
 	return &AudioMutex;
 }
 
+TrackStateLocker::TrackStateLocker() {
+	AudioMutex.lock();
+}
+
+void TrackStateLocker::unlock() {
+	if (!_locked) {
+		return;
+	}
+	_locked = false;
+	if (Audio::MixerInstance) {
+		Audio::MixerInstance->publishTrackStates();
+	}
+	AudioMutex.unlock();
+}
+
+TrackStateLocker::~TrackStateLocker() {
+	unlock();
+}
+
 // Thread: Any.
 bool audioCheckError() {
 	return !Audio::PlaybackErrorHappened();
@@ -1363,7 +1519,7 @@ bool CheckAudioDeviceConnected() {
 
 // Thread: Main. Locks: AudioMutex.
 void DetachFromDevice() {
-	QMutexLocker lock(&AudioMutex);
+	TrackStateLocker lock;
 	Audio::ClosePlaybackDevice();
 	if (mixer()) {
 		mixer()->reattachIfNeeded();
@@ -1517,13 +1673,23 @@ public:
 
 		auto fmt = format();
 		auto peak = uint16(0);
-		auto callback = [&peak, &sumbytes, &peaks, countbytes](uint16 sample) {
-			accumulate_max(peak, sample);
-			sumbytes += Media::Player::kWaveformSamplesCount;
-			if (sumbytes >= countbytes) {
-				sumbytes -= countbytes;
-				peaks.push_back(peak);
-				peak = 0;
+
+		// Each sample adds kWaveformSamplesCount to sumbytes, a peak is taken
+		// when it reaches countbytes. Reduce whole runs between those points.
+		auto reduce = [&peak, &sumbytes, &peaks, countbytes](auto samples, int count) {
+			constexpr auto kStep = int64(Media::Player::kWaveformSamplesCount);
+			while (count > 0) {
+				auto till = int((countbytes - sumbytes + kStep - 1) / kStep);
+				auto take = qMin(count, till);
+				accumulate_max(peak, Media::Audio::MaxSamplePeak(samples, take));
+				sumbytes += take * kStep;
+				samples += take;
+				count -= take;
+				if (sumbytes >= countbytes) {
+					sumbytes -= countbytes;
+					peaks.push_back(peak);
+					peak = 0;
+				}
 			}
 		};
 		while (processed < countbytes) {
@@ -1538,11 +1704,10 @@ public:
 				continue;
 			}
 
-			auto sampleBytes = gsl::as_bytes(gsl::make_span(buffer));
 			if (fmt == AL_FORMAT_MONO8 || fmt == AL_FORMAT_STEREO8) {
-				Media::Audio::IterateSamples<uchar>(sampleBytes, callback);
+				reduce(reinterpret_cast<const uchar*>(buffer.constData()), buffer.size());
 			} else if (fmt == AL_FORMAT_MONO16 || fmt == AL_FORMAT_STEREO16) {
-				Media::Audio::IterateSamples<int16>(sampleBytes, callback);
+				reduce(reinterpret_cast<const int16*>(buffer.constData()), buffer.size() / int(sizeof(int16)));
 			}
 			processed += sampleSize * samples;
 		}
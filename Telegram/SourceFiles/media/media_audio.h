@@ -25,6 +25,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 struct VideoSoundData;
 struct VideoSoundPart;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Audio {
 
@@ -129,14 +133,21 @@ public:
 	void stop(const AudioMsgId &audio);
 	void stop(const AudioMsgId &audio, State state);
 
+	// Thread: Main. A part of the streamed file of this audio was received.
+	void streamedPartReceived(const AudioMsgId &audio);
+
 	// Video player audio stream interface.
 	void feedFromVideo(VideoSoundPart &&part);
 	int64 getVideoCorrectedTime(const AudioMsgId &id, TimeMs frameMs, TimeMs systemMs);
 
 	void stopAndClear();
 
+	// Thread: Any. Doesn't lock AudioMutex, returns the last published state.
 	TrackState currentState(AudioMsgId::Type type);
 
+	// Thread: Any. Must be locked: AudioMutex.
+	void publishTrackStates();
+
 	void clearStoppedAtStart(const AudioMsgId &audio);
 
 	// Thread: Main. Must be locked: AudioMutex.
@@ -167,6 +178,7 @@ signals:
 	void stoppedOnError(const AudioMsgId &audio);
 	void loaderOnStart(const AudioMsgId &audio, qint64 position);
 	void loaderOnCancel(const AudioMsgId &audio);
+	void loaderOnStreamedPart(const AudioMsgId &audio);
 
 	void faderOnTimer();
 
@@ -185,6 +197,10 @@ private:
 	public:
 		static constexpr int kBuffersCount = 3;
 
+		// The first buffer is small for a fast start, next ones grow up to the full size.
+		static constexpr int kStartBufferSize = 32 * 1024;
+		static constexpr int kMaxBufferSize = AudioVoiceMsgBufferSize;
+
 		// Thread: Any. Must be locked: AudioMutex.
 		void reattach(AudioMsgId::Type type);
 
@@ -203,6 +219,7 @@ private:
 
 		FileLocation file;
 		QByteArray data;
+		std::shared_ptr<Storage::StreamedFile> streamed;
 		int64 bufferedPosition = 0;
 		int64 bufferedLength = 0;
 		bool loading = false;
@@ -213,6 +230,7 @@ private:
 		int32 frequency = kDefaultFrequency;
 		int samplesCount[kBuffersCount] = { 0 };
 		QByteArray bufferSamples[kBuffersCount];
+		int bufferSize = kStartBufferSize;
 
 		struct Stream {
 			uint32 source = 0;
@@ -247,6 +265,13 @@ private:
 
 	Track _videoTrack;
 
+	// Copies of the current tracks states, updated on each AudioMutex
+	// release, so that readers don't wait for the audio threads.
+	QMutex _publishedMutex;
+	TrackState _publishedVoice;
+	TrackState _publishedSong;
+	TrackState _publishedVideo;
+
 	QAtomicInt _volumeVideo;
 	QAtomicInt _volumeSong;
 
@@ -290,7 +315,7 @@ private:
 		EmitPositionUpdated = 0x04,
 		EmitNeedToPreload = 0x08,
 	};
-	int32 updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasFading, float64 volumeMultiplier, bool volumeChanged);
+	int32 updateOnePlayback(Mixer::Track *track, bool &hasPlaying, bool &hasFading, TimeMs &checkPlaybackTimeout, float64 volumeMultiplier, bool volumeChanged);
 	void setStoppedState(Mixer::Track *track, State state = State::Stopped);
 
 	QTimer _timer;
@@ -323,6 +348,22 @@ void DetachFromDevice();
 // Thread: Any.
 QMutex *audioPlayerMutex();
 
+// Thread: Any. Locks AudioMutex and publishes the tracks states on unlock.
+class TrackStateLocker {
+public:
+	TrackStateLocker();
+	TrackStateLocker(const TrackStateLocker &other) = delete;
+	TrackStateLocker &operator=(const TrackStateLocker &other) = delete;
+
+	void unlock();
+
+	~TrackStateLocker();
+
+private:
+	bool _locked = true;
+
+};
+
 // Thread: Any.
 bool audioCheckError();
 
@@ -344,6 +385,10 @@ FORCE_INLINE uint16 ReadOneSample(int16 data) {
 	return qAbs(data);
 }
 
+// Maximum of ReadOneSample() values, uses SSE2 where it is available.
+uint16 MaxSamplePeak(const uchar *samples, int count);
+uint16 MaxSamplePeak(const int16 *samples, int count);
+
 template <typename SampleType, typename Callback>
 void IterateSamples(base::const_byte_span bytes, Callback &&callback) {
 	auto samplesPointer = reinterpret_cast<const SampleType*>(bytes.data());
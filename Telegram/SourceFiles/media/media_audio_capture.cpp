@@ -61,10 +61,11 @@ void Finish() {
 
 Instance::Instance() : _inner(new Inner(&_thread)) {
 	CaptureInstance = this;
-	connect(this, SIGNAL(start()), _inner, SLOT(onStart()));
+	connect(this, SIGNAL(start(quint64)), _inner, SLOT(onStart(quint64)));
 	connect(this, SIGNAL(stop(bool)), _inner, SLOT(onStop(bool)));
-	connect(_inner, SIGNAL(done(QByteArray, VoiceWaveform, qint32)), this, SIGNAL(done(QByteArray, VoiceWaveform, qint32)));
+	connect(_inner, SIGNAL(done(QByteArray, VoiceWaveform, qint32, quint64)), this, SIGNAL(done(QByteArray, VoiceWaveform, qint32, quint64)));
 	connect(_inner, SIGNAL(updated(quint16, qint32)), this, SIGNAL(updated(quint16, qint32)));
+	connect(_inner, SIGNAL(partReady(quint64, QByteArray)), this, SIGNAL(partReady(quint64, QByteArray)));
 	connect(_inner, SIGNAL(error()), this, SIGNAL(error()));
 	connect(&_thread, SIGNAL(started()), _inner, SLOT(onInit()));
 	connect(&_thread, SIGNAL(finished()), _inner, SLOT(deleteLater()));
@@ -117,6 +118,7 @@ struct Instance::Inner::Private {
 
 	QByteArray data;
 	int32 dataPos = 0;
+	int32 dataPartsSent = 0;
 
 	int64 waveformMod = 0;
 	int64 waveformEach = (kCaptureFrequency / 100);
@@ -181,7 +183,8 @@ Instance::Inner::~Inner() {
 void Instance::Inner::onInit() {
 }
 
-void Instance::Inner::onStart() {
+void Instance::Inner::onStart(quint64 streamedId) {
+	_streamedId = streamedId;
 
 	// Start OpenAL Capture
 	const ALCchar *dName = alcGetString(0, ALC_CAPTURE_DEFAULT_DEVICE_SPECIFIER);
@@ -473,13 +476,14 @@ void Instance::Inner::onStop(bool needResult) {
 		d->levelMax = 0;
 
 		d->dataPos = 0;
+		d->dataPartsSent = 0;
 		d->data.clear();
 
 		d->waveformMod = 0;
 		d->waveformPeak = 0;
 		d->waveform.clear();
 	}
-	if (needResult) emit done(result, waveform, samples);
+	if (needResult) emit done(result, waveform, samples, _streamedId);
 }
 
 void Instance::Inner::onTimeout() {
@@ -543,6 +547,13 @@ void Instance::Inner::onTimeout() {
 			memmove(_captured.data(), _captured.constData() + encoded, goodSize);
 			_captured.resize(goodSize);
 		}
+
+		// Give away the encoded parts for uploading while still recording.
+		auto written = qMin(d->dataPos, d->data.size());
+		while (written - d->dataPartsSent * DocumentUploadPartSize0 >= DocumentUploadPartSize0) {
+			emit partReady(_streamedId, d->data.mid(d->dataPartsSent * DocumentUploadPartSize0, DocumentUploadPartSize0));
+			++d->dataPartsSent;
+		}
 	} else {
 		DEBUG_LOG(("Audio Capture: no samples to capture."));
 	}
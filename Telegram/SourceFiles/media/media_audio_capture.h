@@ -42,11 +42,14 @@ public:
 	~Instance();
 
 signals:
-	void start();
+	// The streamed upload id is passed back with the parts and the result
+	// of this recording, so they can't be mixed with another recording.
+	void start(quint64 streamedId);
 	void stop(bool needResult);
 
-	void done(QByteArray data, VoiceWaveform waveform, qint32 samples);
+	void done(QByteArray data, VoiceWaveform waveform, qint32 samples, quint64 streamedId);
 	void updated(quint16 level, qint32 samples);
+	void partReady(quint64 streamedId, QByteArray part);
 	void error();
 
 private:
@@ -71,11 +74,12 @@ public:
 signals:
 	void error();
 	void updated(quint16 level, qint32 samples);
-	void done(QByteArray data, VoiceWaveform waveform, qint32 samples);
+	void done(QByteArray data, VoiceWaveform waveform, qint32 samples, quint64 streamedId);
+	void partReady(quint64 streamedId, QByteArray part);
 
 public slots:
 	void onInit();
-	void onStart();
+	void onStart(quint64 streamedId);
 	void onStop(bool needResult);
 
 	void onTimeout();
@@ -93,6 +97,7 @@ private:
 	Private *d;
 	QTimer _timer;
 	QByteArray _captured;
+	quint64 _streamedId = 0;
 
 };
 
@@ -20,6 +20,64 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "media/media_audio_ffmpeg_loader.h"
 
+#include "storage/streamed_file.h"
+
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define MEDIA_AUDIO_CONVERT_SSE2
+#include <emmintrin.h>
+#endif // __SSE2__ || _M_X64 || _M_IX86_FP >= 2
+
+namespace {
+
+constexpr auto kStreamedReadAhead = 64 * 1024; // Don't start reading a packet of a streamed file without 64 KB ready.
+
+inline int16 FloatToSample(float value) {
+	auto scaled = value * 32768.f;
+	return int16(std::lrint(qBound(-32768.f, scaled, 32767.f)));
+}
+
+#ifdef MEDIA_AUDIO_CONVERT_SSE2
+inline __m128i FloatsToSamples(const float *from) {
+	auto scaled = _mm_mul_ps(_mm_loadu_ps(from), _mm_set1_ps(32768.f));
+	auto clamped = _mm_max_ps(_mm_min_ps(scaled, _mm_set1_ps(32767.f)), _mm_set1_ps(-32768.f));
+	return _mm_cvtps_epi32(clamped);
+}
+#endif // MEDIA_AUDIO_CONVERT_SSE2
+
+// Packed float samples to int16, the same as swr does without resampling.
+void ConvertFloatSamples(int16 *to, const float *from, int count) {
+	auto i = 0;
+#ifdef MEDIA_AUDIO_CONVERT_SSE2
+	for (; i + 8 <= count; i += 8) {
+		auto low = FloatsToSamples(from + i);
+		auto high = FloatsToSamples(from + i + 4);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(to + i), _mm_packs_epi32(low, high));
+	}
+#endif // MEDIA_AUDIO_CONVERT_SSE2
+	for (; i != count; ++i) {
+		to[i] = FloatToSample(from[i]);
+	}
+}
+
+// Planar stereo float samples to interleaved int16.
+void InterleaveFloatSamples(int16 *to, const float *left, const float *right, int count) {
+	auto i = 0;
+#ifdef MEDIA_AUDIO_CONVERT_SSE2
+	for (; i + 8 <= count; i += 8) {
+		auto l = _mm_packs_epi32(FloatsToSamples(left + i), FloatsToSamples(left + i + 4));
+		auto r = _mm_packs_epi32(FloatsToSamples(right + i), FloatsToSamples(right + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(to + 2 * i), _mm_unpacklo_epi16(l, r));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(to + 2 * i + 8), _mm_unpackhi_epi16(l, r));
+	}
+#endif // MEDIA_AUDIO_CONVERT_SSE2
+	for (; i != count; ++i) {
+		to[2 * i] = FloatToSample(left[i]);
+		to[2 * i + 1] = FloatToSample(right[i]);
+	}
+}
+
+} // namespace
+
 constexpr AVSampleFormat AudioToFormat = AV_SAMPLE_FMT_S16;
 constexpr int64_t AudioToChannelLayout = AV_CH_LAYOUT_STEREO;
 constexpr int32 AudioToChannels = 2;
@@ -33,7 +91,9 @@ bool AbstractFFMpegLoader::open(qint64 &position) {
 	char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
 
 	ioBuffer = (uchar*)av_malloc(AVBlockSize);
-	if (!_data.isEmpty()) {
+	if (_streamed) {
+		ioContext = avio_alloc_context(ioBuffer, AVBlockSize, 0, reinterpret_cast<void*>(this), &AbstractFFMpegLoader::_read_streamed, 0, &AbstractFFMpegLoader::_seek_streamed);
+	} else if (!_data.isEmpty()) {
 		ioContext = avio_alloc_context(ioBuffer, AVBlockSize, 0, reinterpret_cast<void*>(this), &AbstractFFMpegLoader::_read_data, 0, &AbstractFFMpegLoader::_seek_data);
 	} else if (!_bytes.empty()) {
 		ioContext = avio_alloc_context(ioBuffer, AVBlockSize, 0, reinterpret_cast<void*>(this), &AbstractFFMpegLoader::_read_bytes, 0, &AbstractFFMpegLoader::_seek_bytes);
@@ -175,6 +235,37 @@ int64_t AbstractFFMpegLoader::_seek_file(void *opaque, int64_t offset, int whenc
 	return -1;
 }
 
+int AbstractFFMpegLoader::_read_streamed(void *opaque, uint8_t *buf, int buf_size) {
+	auto l = reinterpret_cast<AbstractFFMpegLoader*>(opaque);
+
+	auto nbytes = l->_streamed->read(l->_dataPos, reinterpret_cast<char*>(buf), buf_size);
+	if (nbytes <= 0) {
+		return (nbytes < 0) ? AVERROR(EIO) : 0;
+	}
+	l->_dataPos += nbytes;
+	return nbytes;
+}
+
+int64_t AbstractFFMpegLoader::_seek_streamed(void *opaque, int64_t offset, int whence) {
+	auto l = reinterpret_cast<AbstractFFMpegLoader*>(opaque);
+
+	int32 newPos = -1;
+	switch (whence) {
+	case SEEK_SET: newPos = offset; break;
+	case SEEK_CUR: newPos = l->_dataPos + offset; break;
+	case SEEK_END: newPos = l->_streamed->size() + offset; break;
+	case AVSEEK_SIZE: {
+		// Special whence for determining filesize without any seek.
+		return l->_streamed->size();
+	} break;
+	}
+	if (newPos < 0 || newPos > l->_streamed->size()) {
+		return -1;
+	}
+	l->_dataPos = newPos;
+	return l->_dataPos;
+}
+
 FFMpegLoader::FFMpegLoader(const FileLocation &file, const QByteArray &data, base::byte_vector &&bytes) : AbstractFFMpegLoader(file, data, std::move(bytes)) {
 	frame = av_frame_alloc();
 }
@@ -223,6 +314,8 @@ bool FFMpegLoader::open(qint64 &position) {
 		case AV_SAMPLE_FMT_U8P: fmt = AL_FORMAT_MONO8; sampleSize = 1; break;
 		case AV_SAMPLE_FMT_S16:
 		case AV_SAMPLE_FMT_S16P: fmt = AL_FORMAT_MONO16; sampleSize = sizeof(uint16); break;
+		case AV_SAMPLE_FMT_FLT:
+		case AV_SAMPLE_FMT_FLTP: fmt = AL_FORMAT_MONO16; sampleSize = sizeof(uint16); floatInput = true; break;
 		default:
 			sampleSize = -1; // convert needed
 		break;
@@ -232,6 +325,8 @@ bool FFMpegLoader::open(qint64 &position) {
 		switch (inputFormat) {
 		case AV_SAMPLE_FMT_U8: fmt = AL_FORMAT_STEREO8; sampleSize = 2; break;
 		case AV_SAMPLE_FMT_S16: fmt = AL_FORMAT_STEREO16; sampleSize = 2 * sizeof(uint16); break;
+		case AV_SAMPLE_FMT_FLT:
+		case AV_SAMPLE_FMT_FLTP: fmt = AL_FORMAT_STEREO16; sampleSize = 2 * sizeof(uint16); floatInput = true; break;
 		default:
 			sampleSize = -1; // convert needed
 		break;
@@ -246,6 +341,7 @@ bool FFMpegLoader::open(qint64 &position) {
 	}
 
 	if (sampleSize < 0) {
+		floatInput = false;
 		swrContext = swr_alloc();
 		if (!swrContext) {
 			LOG(("Audio Error: Unable to swr_alloc for file '%1', data size '%2'").arg(_file.name()).arg(_data.size()));
@@ -308,6 +404,9 @@ AudioPlayerLoader::ReadResult FFMpegLoader::readMore(QByteArray &result, int64 &
 		return ReadResult::Error;
 	}
 
+	if (_streamed && !_streamed->ready(_dataPos, kStreamedReadAhead)) {
+		return ReadResult::Wait;
+	}
 	if ((res = av_read_frame(fmtContext, &avpkt)) < 0) {
 		if (res != AVERROR_EOF) {
 			char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
@@ -359,6 +458,18 @@ AudioPlayerLoader::ReadResult FFMpegLoader::readFromReadyFrame(QByteArray &resul
 		int32 resultLen = av_samples_get_buffer_size(0, AudioToChannels, res, AudioToFormat, 1);
 		result.append((const char*)dstSamplesData[0], resultLen);
 		samplesAdded += resultLen / sampleSize;
+	} else if (floatInput) { // float to int16 without resampling
+		auto count = frame->nb_samples;
+		auto offset = result.size();
+		result.resize(offset + count * sampleSize);
+		auto to = reinterpret_cast<int16*>(result.data() + offset);
+		auto from = reinterpret_cast<const float*>(frame->extended_data[0]);
+		if (fmt == AL_FORMAT_STEREO16 && inputFormat == AV_SAMPLE_FMT_FLTP) {
+			InterleaveFloatSamples(to, from, reinterpret_cast<const float*>(frame->extended_data[1]), count);
+		} else {
+			ConvertFloatSamples(to, from, count * (sampleSize / int32(sizeof(uint16))));
+		}
+		samplesAdded += count;
 	} else {
 		result.append((const char*)frame->extended_data[0], frame->nb_samples * sampleSize);
 		samplesAdded += frame->nb_samples;
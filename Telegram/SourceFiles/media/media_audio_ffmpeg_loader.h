@@ -68,6 +68,8 @@ private:
 	static int64_t _seek_bytes(void *opaque, int64_t offset, int whence);
 	static int _read_file(void *opaque, uint8_t *buf, int buf_size);
 	static int64_t _seek_file(void *opaque, int64_t offset, int whence);
+	static int _read_streamed(void *opaque, uint8_t *buf, int buf_size);
+	static int64_t _seek_streamed(void *opaque, int64_t offset, int whence);
 
 };
 
@@ -96,6 +98,7 @@ private:
 	int32 dstRate = Media::Player::kDefaultFrequency;
 	int32 maxResampleSamples = 1024;
 	uint8_t **dstSamplesData = nullptr;
+	bool floatInput = false; // converted to int16 by us, no resampling needed
 
 	AVCodecContext *codecContext = nullptr;
 	AVPacket avpkt;
@@ -20,6 +20,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "media/media_audio_loader.h"
 
+#include "storage/streamed_file.h"
+
 AudioPlayerLoader::AudioPlayerLoader(const FileLocation &file, const QByteArray &data, base::byte_vector &&bytes)
 : _file(file)
 , _data(data)
@@ -37,6 +39,10 @@ bool AudioPlayerLoader::check(const FileLocation &file, const QByteArray &data)
 	return this->_file == file && this->_data.size() == data.size();
 }
 
+void AudioPlayerLoader::setStreamedFile(std::shared_ptr<Storage::StreamedFile> streamed) {
+	_streamed = std::move(streamed);
+}
+
 void AudioPlayerLoader::saveDecodedSamples(QByteArray *samples, int64 *samplesCount) {
 	Assert(_savedSamplesCount == 0);
 	Assert(_savedSamples.isEmpty());
@@ -60,7 +66,7 @@ bool AudioPlayerLoader::holdsSavedDecodedSamples() const {
 }
 
 bool AudioPlayerLoader::openFile() {
-	if (_data.isEmpty() && _bytes.empty()) {
+	if (_data.isEmpty() && _bytes.empty() && !_streamed) {
 		if (_f.isOpen()) _f.close();
 		if (!_access) {
 			if (!_file.accessEnable()) {
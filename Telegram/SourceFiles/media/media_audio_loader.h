@@ -24,6 +24,10 @@ namespace FFMpeg {
 struct AVPacketDataWrap;
 } // namespace FFMpeg
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 class AudioPlayerLoader {
 public:
 	AudioPlayerLoader(const FileLocation &file, const QByteArray &data, base::byte_vector &&bytes);
@@ -31,6 +35,9 @@ public:
 
 	virtual bool check(const FileLocation &file, const QByteArray &data);
 
+	// Read the file while it is still being downloaded.
+	void setStreamedFile(std::shared_ptr<Storage::StreamedFile> streamed);
+
 	virtual bool open(qint64 &position) = 0;
 	virtual int64 samplesCount() = 0;
 	virtual int32 samplesFrequency() = 0;
@@ -57,6 +64,7 @@ protected:
 	bool _access = false;
 	QByteArray _data;
 	base::byte_vector _bytes;
+	std::shared_ptr<Storage::StreamedFile> _streamed;
 
 	QFile _f;
 	int _dataPos = 0;
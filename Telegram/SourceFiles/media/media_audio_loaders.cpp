@@ -34,16 +34,16 @@ Loaders::Loaders(QThread *thread) : _fromVideoNotify([this] { videoSoundAdded();
 	connect(thread, SIGNAL(finished()), this, SLOT(deleteLater()));
 }
 
+// Only the AVPacket struct is moved here, the packet buffer itself is
+// reference counted and is handed to the loader without copying. The
+// lock is held just for the enqueue and wakeups are coalesced by
+// _fromVideoNotify, so the clip thread doesn't wait for the decoder.
 void Loaders::feedFromVideo(VideoSoundPart &&part) {
-	auto invoke = false;
 	{
 		QMutexLocker lock(&_fromVideoMutex);
 		_fromVideoQueues[part.audio].enqueue(FFMpeg::dataWrapFromPacket(*part.packet));
-		invoke = true;
-	}
-	if (invoke) {
-		_fromVideoNotify.call();
 	}
+	_fromVideoNotify.call();
 }
 
 void Loaders::videoSoundAdded() {
@@ -102,7 +102,7 @@ void Loaders::onStart(const AudioMsgId &audio, qint64 position) {
 	auto type = audio.type();
 	clear(type);
 	{
-		QMutexLocker lock(internal::audioPlayerMutex());
+		internal::TrackStateLocker lock;
 		if (!mixer()) return;
 
 		auto track = mixer()->trackForType(type);
@@ -121,6 +121,7 @@ AudioMsgId Loaders::clear(AudioMsgId::Type type) {
 	case AudioMsgId::Type::Song: std::swap(result, _song); _songLoader = nullptr; break;
 	case AudioMsgId::Type::Video: std::swap(result, _video); _videoLoader = nullptr; break;
 	}
+	_waitingForStream.remove(result);
 	return result;
 }
 
@@ -136,6 +137,12 @@ void Loaders::onLoad(const AudioMsgId &audio) {
 	loadData(audio, 0);
 }
 
+void Loaders::onStreamedPart(const AudioMsgId &audio) {
+	if (_waitingForStream.remove(audio)) {
+		loadData(audio, 0);
+	}
+}
+
 void Loaders::loadData(AudioMsgId audio, qint64 position) {
 	auto err = SetupNoErrorStarted;
 	auto type = audio.type();
@@ -152,18 +159,26 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 	auto waiting = false;
 	auto errAtStart = started;
 
+	auto bufferSize = int(Mixer::Track::kStartBufferSize);
+	if (!started) {
+		internal::TrackStateLocker lock;
+		if (auto track = checkLoader(type)) {
+			bufferSize = track->bufferSize;
+		}
+	}
+
 	QByteArray samples;
 	int64 samplesCount = 0;
 	if (l->holdsSavedDecodedSamples()) {
 		l->takeSavedDecodedSamples(&samples, &samplesCount);
 	}
-	while (samples.size() < AudioVoiceMsgBufferSize) {
+	while (samples.size() < bufferSize) {
 		auto res = l->readMore(samples, samplesCount);
 		using Result = AudioPlayerLoader::ReadResult;
 		if (res == Result::Error) {
 			if (errAtStart) {
 				{
-					QMutexLocker lock(internal::audioPlayerMutex());
+					internal::TrackStateLocker lock;
 					if (auto track = checkLoader(type)) {
 						track->state.state = State::StoppedAtStart;
 					}
@@ -179,21 +194,21 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 		} else if (res == Result::Ok) {
 			errAtStart = false;
 		} else if (res == Result::Wait) {
-			waiting = (samples.size() < AudioVoiceMsgBufferSize);
+			waiting = (samples.size() < bufferSize);
 			if (waiting) {
 				l->saveDecodedSamples(&samples, &samplesCount);
 			}
 			break;
 		}
 
-		QMutexLocker lock(internal::audioPlayerMutex());
+		internal::TrackStateLocker lock;
 		if (!checkLoader(type)) {
 			clear(type);
 			return;
 		}
 	}
 
-	QMutexLocker lock(internal::audioPlayerMutex());
+	internal::TrackStateLocker lock;
 	auto track = checkLoader(type);
 	if (!track) {
 		clear(type);
@@ -230,6 +245,9 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 
 		if (bufferIndex < 0) { // No free buffers, wait.
 			l->saveDecodedSamples(&samples, &samplesCount);
+
+			// Fader will request the load again when some buffer is processed.
+			track->loading = false;
 			return;
 		}
 
@@ -245,8 +263,12 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 			emitError(type);
 			return;
 		}
+		track->bufferSize = qMin(track->bufferSize * 2, int(Mixer::Track::kMaxBufferSize));
 	} else {
 		if (waiting) {
+			if (track->streamed) {
+				_waitingForStream.insert(audio);
+			}
 			return;
 		}
 		finished = true;
@@ -259,6 +281,10 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 	}
 
 	track->loading = false;
+	if (!finished) {
+		// Let the fader queue the next buffer without waiting for its timer.
+		emit needToCheck();
+	}
 	if (track->state.state == State::Resuming || track->state.state == State::Playing || track->state.state == State::Starting) {
 		ALint state = AL_INITIAL;
 		alGetSourcei(track->stream.source, AL_SOURCE_STATE, &state);
@@ -267,6 +293,11 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 				if (state == AL_STOPPED && !internal::CheckAudioDeviceConnected()) {
 					return;
 				}
+				if (state == AL_STOPPED && !started) {
+					// The queued buffers ran out before this refill, queue more audio ahead.
+					DEBUG_LOG(("Audio Info: Playback underrun, using %1 bytes buffers.").arg(Mixer::Track::kMaxBufferSize));
+					track->bufferSize = Mixer::Track::kMaxBufferSize;
+				}
 
 				alSourcef(track->stream.source, AL_GAIN, ComputeVolume(type));
 				if (!internal::audioCheckError()) {
@@ -293,7 +324,7 @@ void Loaders::loadData(AudioMsgId audio, qint64 position) {
 
 AudioPlayerLoader *Loaders::setupLoader(const AudioMsgId &audio, SetupError &err, qint64 &position) {
 	err = SetupErrorAtStart;
-	QMutexLocker lock(internal::audioPlayerMutex());
+	internal::TrackStateLocker lock;
 	if (!mixer()) return nullptr;
 
 	auto track = mixer()->trackForType(audio.type());
@@ -336,10 +367,21 @@ AudioPlayerLoader *Loaders::setupLoader(const AudioMsgId &audio, SetupError &err
 			*loader = std::make_unique<ChildFFMpegLoader>(std::move(track->videoData));
 		} else {
 			*loader = std::make_unique<FFMpegLoader>(track->file, track->data, base::byte_vector());
+			(*loader)->setStreamedFile(track->streamed);
 		}
 		l = loader->get();
 
-		if (!l->open(position)) {
+		// Opening a streamed file may wait for its header to be downloaded,
+		// so the track state is checked again after it.
+		lock.unlock();
+		auto opened = l->open(position);
+		internal::TrackStateLocker relock;
+		track = checkLoader(audio.type());
+		if (!track) {
+			err = SetupErrorNotPlaying;
+			return nullptr;
+		}
+		if (!opened) {
 			track->state.state = State::StoppedAtStart;
 			return nullptr;
 		}
@@ -388,7 +430,7 @@ void Loaders::onCancel(const AudioMsgId &audio) {
 	case AudioMsgId::Type::Video: if (_video == audio) clear(audio.type()); break;
 	}
 
-	QMutexLocker lock(internal::audioPlayerMutex());
+	internal::TrackStateLocker lock;
 	if (!mixer()) return;
 
 	for (auto i = 0; i != kTogetherLimit; ++i) {
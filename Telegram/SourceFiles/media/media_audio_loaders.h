@@ -23,6 +23,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_child_ffmpeg_loader.h"
 #include "media/media_audio.h"
 #include "media/media_child_ffmpeg_loader.h"
+#include "base/flat_set.h"
 
 class AudioPlayerLoader;
 class ChildFFMpegLoader;
@@ -48,6 +49,7 @@ signals:
 	void onStart(const AudioMsgId &audio, qint64 position);
 	void onLoad(const AudioMsgId &audio);
 	void onCancel(const AudioMsgId &audio);
+	void onStreamedPart(const AudioMsgId &audio);
 
 private:
 	void videoSoundAdded();
@@ -58,6 +60,9 @@ private:
 	std::unique_ptr<AudioPlayerLoader> _songLoader;
 	std::unique_ptr<AudioPlayerLoader> _videoLoader;
 
+	// Loading stopped until more parts of the streamed file are received.
+	base::flat_set<AudioMsgId> _waitingForStream;
+
 	QMutex _fromVideoMutex;
 	QMap<AudioMsgId, QQueue<FFMpeg::AVPacketDataWrap>> _fromVideoQueues;
 	SingleQueuedInvokation _fromVideoNotify;
@@ -0,0 +1,57 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "media/media_audio_peak_avx2.h"
+
+#include <immintrin.h>
+
+namespace Media {
+namespace Audio {
+namespace internal {
+
+void SamplePeakAVX2(const int16_t *samples, int count, int16_t *maximum, int16_t *minimum) {
+	auto i = 0;
+	if (count >= 16) {
+		auto maximums = _mm256_set1_epi16(*maximum);
+		auto minimums = _mm256_set1_epi16(*minimum);
+		for (; i + 16 <= count; i += 16) {
+			auto values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+			maximums = _mm256_max_epi16(maximums, values);
+			minimums = _mm256_min_epi16(minimums, values);
+		}
+		int16_t lanes[32];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), maximums);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes + 16), minimums);
+		for (auto j = 0; j != 16; ++j) {
+			if (*maximum < lanes[j]) *maximum = lanes[j];
+			if (*minimum > lanes[16 + j]) *minimum = lanes[16 + j];
+		}
+	}
+	for (; i != count; ++i) {
+		if (*maximum < samples[i]) *maximum = samples[i];
+		if (*minimum > samples[i]) *minimum = samples[i];
+	}
+	// Leave the ymm registers clean for the SSE code that follows.
+	_mm256_zeroupper();
+}
+
+} // namespace internal
+} // namespace Audio
+} // namespace Media
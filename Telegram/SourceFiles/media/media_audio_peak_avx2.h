@@ -20,48 +20,16 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #pragma once
 
-#include "media/media_clip_implementation.h"
+#include <stdint.h>
 
 namespace Media {
-namespace Clip {
+namespace Audio {
 namespace internal {
 
-class QtGifReaderImplementation : public ReaderImplementation {
-public:
-
-	QtGifReaderImplementation(FileLocation *location, QByteArray *data);
-
-	ReadResult readFramesTill(TimeMs frameMs, TimeMs systemMs) override;
-
-	TimeMs frameRealTime() const override;
-	TimeMs framePresentationTime() const override;
-
-	bool renderFrame(QImage &to, bool &hasAlpha, const QSize &size) override;
-
-	TimeMs durationMs() const override;
-	bool hasAudio() const override {
-		return false;
-	}
-
-	bool start(Mode mode, TimeMs &positionMs) override;
-
-	~QtGifReaderImplementation();
-
-private:
-	bool jumpToStart();
-	ReadResult readNextFrame();
-
-	Mode _mode = Mode::Normal;
-
-	std::unique_ptr<QImageReader> _reader;
-	int _framesLeft = 0;
-	TimeMs _frameRealTime = 0;
-	TimeMs _frameTime = 0;
-	int _frameDelay = 0;
-	QImage _frame;
-
-};
+// Compiled with AVX2 enabled in gyp/simd.gyp, call only if the CPU has it.
+// Accumulates the minimum and maximum of count samples.
+void SamplePeakAVX2(const int16_t *samples, int count, int16_t *maximum, int16_t *minimum);
 
 } // namespace internal
-} // namespace Clip
+} // namespace Audio
 } // namespace Media
@@ -196,8 +196,13 @@ AudioPlayerLoader::ReadResult ChildFFMpegLoader::readFromReadyFrame(QByteArray &
 }
 
 void ChildFFMpegLoader::enqueuePackets(QQueue<FFMpeg::AVPacketDataWrap> &packets) {
-	_queue += std::move(packets);
-	packets.clear();
+	// Usually the previous batch is already decoded, take the new one as is.
+	if (_queue.isEmpty()) {
+		_queue = base::take(packets);
+	} else {
+		_queue += packets;
+		packets.clear();
+	}
 }
 
 ChildFFMpegLoader::~ChildFFMpegLoader() {
@@ -23,6 +23,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_audio.h"
 #include "media/media_child_ffmpeg_loader.h"
 #include "storage/file_download.h"
+#include "storage/streamed_file.h"
+#include "core/memory_stats.h"
 
 namespace Media {
 namespace Clip {
@@ -31,6 +33,12 @@ namespace {
 
 constexpr int kSkipInvalidDataPackets = 10;
 constexpr int kAlignImageBy = 16;
+constexpr auto kStreamedReadAhead = 256 * 1024; // Don't start reading a packet of a streamed file without 256 KB ready.
+constexpr auto kFramesCacheLimit = 16 * 1024 * 1024; // 16 MB of rendered frames of a looping clip.
+constexpr auto kFramesCacheTotalLimit = int64(64 * 1024 * 1024); // 64 MB of rendered frames of all clips.
+
+// Readers run in several threads, all of their frame caches share one budget.
+std::atomic<int64> FramesCacheTotalBytes = { 0 };
 
 void alignedImageBufferCleanupHandler(void *data) {
 	auto buffer = static_cast<uchar*>(data);
@@ -67,9 +75,21 @@ FFMpegReaderImplementation::FFMpegReaderImplementation(FileLocation *location, Q
 
 ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 	if (_frameRead) {
+		if (_cacheState == CacheState::Filling) {
+			// A frame was skipped, so the cached loop would be incomplete.
+			clearFramesCache(CacheState::Waiting);
+		}
 		av_frame_unref(_frame);
 		_frameRead = false;
 	}
+	if (_cacheState == CacheState::Ready) {
+		return readCachedFrame();
+	} else if (_restartDecoding) {
+		_restartDecoding = false;
+		if (!jumpToStart()) {
+			return ReadResult::Error;
+		}
+	}
 
 	do {
 		int res = avcodec_receive_frame(_codecContext, _frame);
@@ -88,23 +108,15 @@ ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 				return ReadResult::Error;
 			}
 
-			if ((res = avformat_seek_file(_fmtContext, _streamId, std::numeric_limits<int64_t>::min(), 0, std::numeric_limits<int64_t>::max(), 0)) < 0) {
-				if ((res = av_seek_frame(_fmtContext, _streamId, 0, AVSEEK_FLAG_BYTE)) < 0) {
-					if ((res = av_seek_frame(_fmtContext, _streamId, 0, AVSEEK_FLAG_FRAME)) < 0) {
-						if ((res = av_seek_frame(_fmtContext, _streamId, 0, 0)) < 0) {
-							char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
-							LOG(("Gif Error: Unable to av_seek_frame() to the start %1, error %2, %3").arg(logData()).arg(res).arg(av_make_error_string(err, sizeof(err), res)));
-							return ReadResult::Error;
-						}
-					}
-				}
+			if (_cacheState == CacheState::Filling && !_cachedFrames.empty()) {
+				// The whole loop is cached, next loops are played from memory.
+				_cacheState = CacheState::Ready;
+				_cachedFrameIndex = -1;
+				return readCachedFrame();
+			}
+			if (!jumpToStart()) {
+				return ReadResult::Error;
 			}
-			avcodec_flush_buffers(_codecContext);
-			_hadFrame = false;
-			_frameMs = 0;
-			_lastReadVideoMs = _lastReadAudioMs = 0;
-			_skippedInvalidDataPackets = 0;
-
 			continue;
 		} else if (res != AVERROR(EAGAIN)) {
 			char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
@@ -113,6 +125,9 @@ ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 		}
 
 		while (_packetQueue.isEmpty()) {
+			if (_streamed && !_streamed->ready(int(_device->pos()), kStreamedReadAhead)) {
+				return ReadResult::Wait;
+			}
 			auto packetResult = readAndProcessPacket();
 			if (packetResult == PacketResult::Error) {
 				return ReadResult::Error;
@@ -148,22 +163,52 @@ ReaderImplementation::ReadResult FFMpegReaderImplementation::readNextFrame() {
 	return ReadResult::Error;
 }
 
+bool FFMpegReaderImplementation::jumpToStart() {
+	auto res = 0;
+	if ((res = avformat_seek_file(_fmtContext, _streamId, std::numeric_limits<int64_t>::min(), 0, std::numeric_limits<int64_t>::max(), 0)) < 0) {
+		if ((res = av_seek_frame(_fmtContext, _streamId, 0, AVSEEK_FLAG_BYTE)) < 0) {
+			if ((res = av_seek_frame(_fmtContext, _streamId, 0, AVSEEK_FLAG_FRAME)) < 0) {
+				if ((res = av_seek_frame(_fmtContext, _streamId, 0, 0)) < 0) {
+					char err[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+					LOG(("Gif Error: Unable to av_seek_frame() to the start %1, error %2, %3").arg(logData()).arg(res).arg(av_make_error_string(err, sizeof(err), res)));
+					return false;
+				}
+			}
+		}
+	}
+	avcodec_flush_buffers(_codecContext);
+	_hadFrame = false;
+	_frameMs = 0;
+	_lastReadVideoMs = _lastReadAudioMs = 0;
+	_skippedInvalidDataPackets = 0;
+
+	// Silent looping clips try to cache the rendered frames of the next loop.
+	if (_cacheState == CacheState::Waiting && _mode == Mode::Silent && _audioStreamId < 0) {
+		_cacheState = CacheState::Filling;
+	}
+	return true;
+}
+
 void FFMpegReaderImplementation::processReadFrame() {
 	int64 duration = av_frame_get_pkt_duration(_frame);
 	int64 framePts = _frame->pts;
-	TimeMs frameMs = (framePts * 1000LL * _fmtContext->streams[_streamId]->time_base.num) / _fmtContext->streams[_streamId]->time_base.den;
+	_readFrameMs = (framePts * 1000LL * _fmtContext->streams[_streamId]->time_base.num) / _fmtContext->streams[_streamId]->time_base.den;
+	if (duration == AV_NOPTS_VALUE) {
+		_readNextFrameDelay = 0;
+	} else {
+		_readNextFrameDelay = (duration * 1000LL * _fmtContext->streams[_streamId]->time_base.num) / _fmtContext->streams[_streamId]->time_base.den;
+	}
+	processFrameTiming(_readFrameMs, _readNextFrameDelay);
+}
+
+void FFMpegReaderImplementation::processFrameTiming(TimeMs frameMs, int nextFrameDelay) {
 	_currentFrameDelay = _nextFrameDelay;
 	if (_frameMs + _currentFrameDelay < frameMs) {
 		_currentFrameDelay = int32(frameMs - _frameMs);
 	} else if (frameMs < _frameMs + _currentFrameDelay) {
 		frameMs = _frameMs + _currentFrameDelay;
 	}
-
-	if (duration == AV_NOPTS_VALUE) {
-		_nextFrameDelay = 0;
-	} else {
-		_nextFrameDelay = (duration * 1000LL * _fmtContext->streams[_streamId]->time_base.num) / _fmtContext->streams[_streamId]->time_base.den;
-	}
+	_nextFrameDelay = nextFrameDelay;
 	_frameMs = frameMs;
 
 	_hadFrame = _frameRead = true;
@@ -219,10 +264,76 @@ TimeMs FFMpegReaderImplementation::durationMs() const {
 	return (_fmtContext->streams[_streamId]->duration * 1000LL * _fmtContext->streams[_streamId]->time_base.num) / _fmtContext->streams[_streamId]->time_base.den;
 }
 
+ReaderImplementation::ReadResult FFMpegReaderImplementation::readCachedFrame() {
+	if (++_cachedFrameIndex == int(_cachedFrames.size())) {
+		_cachedFrameIndex = 0;
+	}
+	if (!_cachedFrameIndex) {
+		_frameMs = 0; // Looped, as after jumpToStart().
+	}
+	auto &frame = _cachedFrames[_cachedFrameIndex];
+	processFrameTiming(frame.frameMs, frame.nextFrameDelay);
+	return ReadResult::Success;
+}
+
+bool FFMpegReaderImplementation::renderCachedFrame(QImage &to, bool &hasAlpha, const QSize &size) {
+	auto &frame = _cachedFrames[_cachedFrameIndex];
+	hasAlpha = frame.hasAlpha;
+	if (size.isEmpty() || frame.image.size() == size) {
+		to = frame.image;
+		return true;
+	}
+
+	// The frame size has changed, show this frame scaled and decode again.
+	to = frame.image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	clearFramesCache(CacheState::Waiting);
+	_restartDecoding = true;
+	return true;
+}
+
+void FFMpegReaderImplementation::cacheRenderedFrame(const QImage &image, bool hasAlpha) {
+	if (!_cachedFrames.empty() && _cachedFrames.front().image.size() != image.size()) {
+		clearFramesCache(CacheState::Waiting);
+		return;
+	}
+	auto bytes = int64(image.byteCount());
+	if (_cachedFramesBytes + bytes > kFramesCacheLimit) {
+		clearFramesCache(CacheState::Disabled);
+		return;
+	}
+	if (FramesCacheTotalBytes.fetch_add(bytes) + bytes > kFramesCacheTotalLimit) {
+		FramesCacheTotalBytes -= bytes;
+		clearFramesCache(CacheState::Disabled);
+		return;
+	}
+	_cachedFramesBytes += bytes;
+	Core::MemoryStats::Add(Core::MemoryStats::Category::ClipReaders, 0, bytes);
+
+	// The decoder renders the next frames to the same image, don't share it.
+	auto frame = CachedFrame();
+	frame.image = image.copy();
+	frame.hasAlpha = hasAlpha;
+	frame.frameMs = _readFrameMs;
+	frame.nextFrameDelay = _readNextFrameDelay;
+	_cachedFrames.push_back(std::move(frame));
+}
+
+void FFMpegReaderImplementation::clearFramesCache(CacheState state) {
+	Core::MemoryStats::Add(Core::MemoryStats::Category::ClipReaders, 0, -_cachedFramesBytes);
+	FramesCacheTotalBytes -= _cachedFramesBytes;
+	_cachedFramesBytes = 0;
+	_cachedFrames.clear();
+	_cacheState = state;
+}
+
 bool FFMpegReaderImplementation::renderFrame(QImage &to, bool &hasAlpha, const QSize &size) {
 	Expects(_frameRead);
 	_frameRead = false;
 
+	if (_cacheState == CacheState::Ready) {
+		return renderCachedFrame(to, hasAlpha, size);
+	}
+
 	if (!_width || !_height) {
 		_width = _frame->width;
 		_height = _frame->height;
@@ -268,6 +379,9 @@ bool FFMpegReaderImplementation::renderFrame(QImage &to, bool &hasAlpha, const Q
 		}
 		to = to.transformed(rotationTransform);
 	}
+	if (_cacheState == CacheState::Filling) {
+		cacheRenderedFrame(to, hasAlpha);
+	}
 
 	// Read some future packets for audio stream.
 	if (_audioStreamId >= 0) {
@@ -470,6 +584,7 @@ QString FFMpegReaderImplementation::logData() const {
 
 FFMpegReaderImplementation::~FFMpegReaderImplementation() {
 	clearPacketQueue();
+	clearFramesCache(CacheState::Disabled);
 
 	if (_frameRead) {
 		av_frame_unref(_frame);
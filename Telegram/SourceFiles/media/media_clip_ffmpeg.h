@@ -61,6 +61,26 @@ public:
 private:
 	ReadResult readNextFrame();
 	void processReadFrame();
+	void processFrameTiming(TimeMs frameMs, int nextFrameDelay);
+	bool jumpToStart();
+
+	// Rendered frames of a silent looping clip, so that next loops only show them.
+	enum class CacheState {
+		Waiting,
+		Filling,
+		Ready,
+		Disabled,
+	};
+	struct CachedFrame {
+		QImage image;
+		bool hasAlpha = false;
+		TimeMs frameMs = 0;
+		int nextFrameDelay = 0;
+	};
+	ReadResult readCachedFrame();
+	bool renderCachedFrame(QImage &to, bool &hasAlpha, const QSize &size);
+	void cacheRenderedFrame(const QImage &image, bool hasAlpha);
+	void clearFramesCache(CacheState state);
 
 	enum class PacketResult {
 		Ok,
@@ -130,6 +150,14 @@ private:
 	TimeMs _frameTime = 0;
 	TimeMs _frameTimeCorrection = 0;
 
+	TimeMs _readFrameMs = 0;
+	int _readNextFrameDelay = 0;
+	CacheState _cacheState = CacheState::Waiting;
+	std::vector<CachedFrame> _cachedFrames;
+	int64 _cachedFramesBytes = 0;
+	int _cachedFrameIndex = 0;
+	bool _restartDecoding = false;
+
 };
 
 } // namespace internal
@@ -20,11 +20,64 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "media/media_clip_implementation.h"
 
+#include "storage/streamed_file.h"
+
 namespace Media {
 namespace Clip {
 namespace internal {
+namespace {
+
+// Random access device over a file that is still being downloaded.
+// The reader checks that the next part is received before reading
+// packets, so reads block only if the demuxer jumps somewhere else.
+class StreamedDevice : public QIODevice {
+public:
+	StreamedDevice(std::shared_ptr<Storage::StreamedFile> streamed) : _streamed(std::move(streamed)) {
+	}
+
+	bool open(OpenMode mode) override {
+		return QIODevice::open(mode | QIODevice::Unbuffered);
+	}
+	bool isSequential() const override {
+		return false;
+	}
+	qint64 size() const override {
+		return _streamed->size();
+	}
+
+protected:
+	qint64 readData(char *data, qint64 maxSize) override {
+		auto length = int(qMin(maxSize, qint64(_streamed->size())));
+		return _streamed->read(int(pos()), data, length);
+	}
+	qint64 writeData(const char *data, qint64 maxSize) override {
+		return -1;
+	}
+
+private:
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+
+};
+
+} // namespace
+
+void ReaderImplementation::setStreamedFile(std::shared_ptr<Storage::StreamedFile> streamed) {
+	_streamed = std::move(streamed);
+}
+
+ReaderImplementation::~ReaderImplementation() = default;
 
 void ReaderImplementation::initDevice() {
+	if (_streamed) {
+		if (!_streamedDevice) {
+			_streamedDevice = std::make_unique<StreamedDevice>(_streamed);
+		} else if (_streamedDevice->isOpen()) {
+			_streamedDevice->close();
+		}
+		_dataSize = _streamed->size();
+		_device = _streamedDevice.get();
+		return;
+	}
 	if (_data->isEmpty()) {
 		if (_file.isOpen()) _file.close();
 		_file.setFileName(_location->name());
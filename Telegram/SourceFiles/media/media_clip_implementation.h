@@ -22,6 +22,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 namespace internal {
@@ -42,6 +46,7 @@ public:
 		Success,
 		Error,
 		EndOfFile,
+		Wait, // The streamed file part is not received yet.
 	};
 	// Read frames till current frame will have presentation time > frameMs, systemMs = getms().
 	virtual ReadResult readFramesTill(TimeMs frameMs, TimeMs systemMs) = 0;
@@ -58,8 +63,10 @@ public:
 
 	virtual bool start(Mode mode, TimeMs &positionMs) = 0;
 
-	virtual ~ReaderImplementation() {
-	}
+	// Read the file while it is still being downloaded.
+	void setStreamedFile(std::shared_ptr<Storage::StreamedFile> streamed);
+
+	virtual ~ReaderImplementation();
 	int64 dataSize() const {
 		return _dataSize;
 	}
@@ -69,6 +76,8 @@ protected:
 	QByteArray *_data;
 	QFile _file;
 	QBuffer _buffer;
+	std::shared_ptr<Storage::StreamedFile> _streamed;
+	std::unique_ptr<QIODevice> _streamedDevice;
 	QIODevice *_device = nullptr;
 	int64 _dataSize = 0;
 
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/media_clip_reader.h"
 
 #include "storage/file_download.h"
+#include "storage/streamed_file.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -30,17 +31,70 @@ extern "C" {
 }
 
 #include "media/media_clip_ffmpeg.h"
-#include "media/media_clip_qtgif.h"
 #include "mainwidget.h"
 #include "mainwindow.h"
+#include "core/memory_stats.h"
+
+#include <chrono>
 
 namespace Media {
 namespace Clip {
 namespace {
 
+constexpr auto kFramesPoolLimit = 32 * 1024 * 1024; // 32 MB of decoded frames kept for reuse.
+
+// Thread load is measured in microseconds of decoding per second.
+constexpr auto kLoadMeasurePeriod = TimeMs(1000);
+constexpr auto kDefaultReaderLoad = 20000; // Until the first measurement.
+constexpr auto kStreamedWaitDelay = TimeMs(50); // Check if the streamed file part is received.
+
 QVector<QThread*> threads;
 QVector<Manager*> managers;
 
+// Frame buffers released by paused or destroyed readers, shared by all clip threads.
+class FramesPool {
+public:
+	QImage take(QSize size) {
+		QMutexLocker lock(&_mutex);
+		for (auto i = _frames.begin(), e = _frames.end(); i != e; ++i) {
+			if (i->size() == size) {
+				auto result = std::move(*i);
+				_frames.erase(i);
+				_size -= result.byteCount();
+				return result;
+			}
+		}
+		return QImage();
+	}
+
+	void give(QImage &&image) {
+		auto frame = std::move(image);
+		if (frame.isNull() || !frame.isDetached() || frame.byteCount() > kFramesPoolLimit) {
+			return;
+		}
+		QMutexLocker lock(&_mutex);
+		_size += frame.byteCount();
+		_frames.push_back(std::move(frame));
+		while (_size > kFramesPoolLimit) {
+			_size -= _frames.front().byteCount();
+			_frames.erase(_frames.begin());
+		}
+	}
+
+	int64 size() {
+		QMutexLocker lock(&_mutex);
+		return _size;
+	}
+
+private:
+	QMutex _mutex;
+	std::vector<QImage> _frames;
+	int64 _size = 0;
+
+};
+
+FramesPool framesPool;
+
 QImage PrepareFrameImage(const FrameRequest &request, const QImage &original, bool hasAlpha, QImage &cache) {
 	auto needResize = (original.width() != request.framew) || (original.height() != request.frameh);
 	auto needOuterFill = (request.outerw != request.framew) || (request.outerh != request.frameh);
@@ -105,10 +159,16 @@ Reader::Reader(not_null<DocumentData*> document, FullMsgId msgId, Callback &&cal
 , _mode(mode)
 , _audioMsgId(document, msgId, (mode == Mode::Video) ? rand_value<uint32>() : 0)
 , _seekPositionMs(seekMs) {
-	init(document->location(), document->data());
+	auto &location = document->location();
+	auto data = document->data();
+	if (mode == Mode::Video && location.isEmpty() && data.isEmpty()) {
+		_streamed = document->streamedFile();
+	}
+	init(location, data);
 }
 
 void Reader::init(const FileLocation &location, const QByteArray &data) {
+	Core::MemoryStats::Add(Core::MemoryStats::Category::ClipReaders, 1);
 	if (threads.size() < ClipThreadsCount) {
 		_threadIndex = threads.size();
 		threads.push_back(new QThread());
@@ -125,7 +185,7 @@ void Reader::init(const FileLocation &location, const QByteArray &data) {
 			}
 		}
 	}
-	managers.at(_threadIndex)->append(this, location, data);
+	managers.at(_threadIndex)->append(this, location, data, _streamed);
 }
 
 Reader::Frame *Reader::frameToShow(int32 *index) const { // 0 means not ready
@@ -219,6 +279,13 @@ void Reader::start(int32 framew, int32 frameh, int32 outerw, int32 outerh, Image
 		request.radius = radius;
 		request.corners = corners;
 		_frames[0].request = _frames[1].request = _frames[2].request = request;
+
+		// Each of the three frames holds an original and a prepared pixmap here
+		// and a prepared cache in ReaderPrivate, only an estimate for the stats.
+		auto framesBytes = 3 * 4 * (int64(request.framew) * request.frameh + 2 * int64(request.outerw) * request.outerh);
+		Core::MemoryStats::Add(Core::MemoryStats::Category::ClipReaders, 0, framesBytes - _framesBytes);
+		_framesBytes = framesBytes;
+
 		moveToNextShow();
 		managers.at(_threadIndex)->start(this);
 	}
@@ -340,6 +407,10 @@ State Reader::state() const {
 }
 
 void Reader::stop() {
+	if (_streamed) {
+		// Don't leave the reader thread waiting for the file parts.
+		_streamed->interruptReads();
+	}
 	if (managers.size() <= _threadIndex) error();
 	if (_state != State::Error) {
 		managers.at(_threadIndex)->stop(this);
@@ -359,16 +430,18 @@ void Reader::finished() {
 
 Reader::~Reader() {
 	stop();
+	Core::MemoryStats::Add(Core::MemoryStats::Category::ClipReaders, -1, -_framesBytes);
 }
 
 class ReaderPrivate {
 public:
-	ReaderPrivate(Reader *reader, const FileLocation &location, const QByteArray &data) : _interface(reader)
+	ReaderPrivate(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed) : _interface(reader)
 	, _mode(reader->mode())
 	, _audioMsgId(reader->audioMsgId())
 	, _seekPositionMs(reader->seekPositionMs())
-	, _data(data) {
-		if (_data.isEmpty()) {
+	, _data(data)
+	, _streamed(std::move(streamed)) {
+		if (_data.isEmpty() && !_streamed) {
 			_location = std::make_unique<FileLocation>(location);
 			if (!_location->accessEnable()) {
 				error();
@@ -384,12 +457,16 @@ public:
 		}
 		if (frame() && frame()->original.isNull()) {
 			auto readResult = _implementation->readFramesTill(-1, ms);
-			if (readResult == internal::ReaderImplementation::ReadResult::EndOfFile && _seekPositionMs > 0) {
+			if (readResult == internal::ReaderImplementation::ReadResult::Wait) {
+				waitForStreamed(ms, false);
+				return ProcessResult::Wait;
+			} else if (readResult == internal::ReaderImplementation::ReadResult::EndOfFile && _seekPositionMs > 0) {
 				// If seek was done to the end: try to read the first frame,
 				// get the frame size and return a black frame with that size.
 
 				auto firstFramePositionMs = TimeMs(0);
 				auto reader = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, AudioMsgId());
+				reader->setStreamedFile(_streamed);
 				if (reader->start(internal::ReaderImplementation::Mode::Normal, firstFramePositionMs)) {
 					auto firstFrameReadResult = reader->readFramesTill(-1, ms);
 					if (firstFrameReadResult == internal::ReaderImplementation::ReadResult::Success) {
@@ -432,6 +509,20 @@ public:
 			return ProcessResult::Finished;
 		}
 
+		if (_streamedWaitTill) {
+			if (ms < _streamedWaitTill) {
+				return ProcessResult::Wait;
+			}
+			_streamedWaitTill = 0;
+			if (_streamedWaitFrame) {
+				_streamedWaitFrame = false;
+				if (!_hasAudio) {
+					// Continue from the frame we stopped at, audio is synced by the mixer.
+					_animationStarted += ms - _streamedWaitStarted;
+				}
+				return finishProcess(ms);
+			}
+		}
 		if (!_request.valid()) {
 			return start(ms);
 		}
@@ -451,7 +542,10 @@ public:
 	ProcessResult finishProcess(TimeMs ms) {
 		auto frameMs = _seekPositionMs + ms - _animationStarted;
 		auto readResult = _implementation->readFramesTill(frameMs, ms);
-		if (readResult == internal::ReaderImplementation::ReadResult::EndOfFile) {
+		if (readResult == internal::ReaderImplementation::ReadResult::Wait) {
+			waitForStreamed(ms, true);
+			return ProcessResult::Wait;
+		} else if (readResult == internal::ReaderImplementation::ReadResult::EndOfFile) {
 			stop(Player::State::StoppedAtEnd);
 			_state = State::Finished;
 			return ProcessResult::Finished;
@@ -472,8 +566,18 @@ public:
 		return ProcessResult::CopyFrame;
 	}
 
+	// The manager thread is not blocked, the read is retried a bit later.
+	void waitForStreamed(TimeMs ms, bool frame) {
+		_streamedWaitStarted = ms;
+		_streamedWaitTill = ms + kStreamedWaitDelay;
+		_streamedWaitFrame = frame;
+	}
+
 	bool renderFrame() {
 		Assert(frame() != 0 && _request.valid());
+		if (frame()->original.isNull()) {
+			frame()->original = framesPool.take(QSize(_request.framew, _request.frameh));
+		}
 		if (!_implementation->renderFrame(frame()->original, frame()->alpha, QSize(_request.framew, _request.frameh))) {
 			return false;
 		}
@@ -486,7 +590,7 @@ public:
 	}
 
 	bool init() {
-		if (_data.isEmpty() && QFileInfo(_location->name()).size() <= Storage::kMaxAnimationInMemory) {
+		if (_data.isEmpty() && !_streamed && QFileInfo(_location->name()).size() <= Storage::kMaxAnimationInMemory) {
 			QFile f(_location->name());
 			if (f.open(QIODevice::ReadOnly)) {
 				_data = f.readAll();
@@ -497,7 +601,7 @@ public:
 		}
 
 		_implementation = std::make_unique<internal::FFMpegReaderImplementation>(_location.get(), &_data, _audioMsgId);
-//		_implementation = new QtGifReaderImplementation(_location, &_data);
+		_implementation->setStreamedFile(_streamed);
 
 		auto implementationMode = [this]() {
 			using ImplementationMode = internal::ReaderImplementation::Mode;
@@ -556,8 +660,23 @@ public:
 		_accessed = false;
 	}
 
+	// The interface keeps the last shown frame, so the buffers can be reused.
+	// The prepared frame cache keeps the outer fill, so it is just dropped.
+	void releaseFrames() {
+		for (auto &frame : _frames) {
+			frame.pix = QPixmap();
+			frame.cache = QImage();
+			framesPool.give(base::take(frame.original));
+		}
+	}
+
+	void addDecodeTime(std::chrono::steady_clock::time_point started) {
+		_decodeTimeUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+	}
+
 	~ReaderPrivate() {
 		stop(Player::State::Stopped);
+		releaseFrames();
 		_data.clear();
 	}
 
@@ -569,6 +688,7 @@ private:
 	TimeMs _seekPositionMs = 0;
 
 	QByteArray _data;
+	std::shared_ptr<Storage::StreamedFile> _streamed;
 	std::unique_ptr<FileLocation> _location;
 	bool _accessed = false;
 
@@ -604,6 +724,14 @@ private:
 	bool _started = false;
 	TimeMs _videoPausedAtMs = 0;
 
+	TimeMs _streamedWaitStarted = 0;
+	TimeMs _streamedWaitTill = 0;
+	bool _streamedWaitFrame = false; // Retry finishProcess() after the wait.
+
+	// Decode time in the current measure period and the last measured load.
+	int64 _decodeTimeUs = 0;
+	int _load = kDefaultReaderLoad;
+
 	friend class Manager;
 
 };
@@ -621,9 +749,9 @@ Manager::Manager(QThread *thread) : _processingInThread(0), _needReProcess(false
 	anim::registerClipManager(this);
 }
 
-void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data) {
-	reader->_private = new ReaderPrivate(reader, location, data);
-	_loadLevel.fetchAndAddRelaxed(AverageGifSize);
+void Manager::append(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed) {
+	reader->_private = new ReaderPrivate(reader, location, data, std::move(streamed));
+	_loadLevel.fetchAndAddRelaxed(kDefaultReaderLoad);
 	update(reader);
 }
 
@@ -691,7 +819,6 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 	}
 
 	if (result == ProcessResult::Started) {
-		_loadLevel.fetchAndAddRelaxed(reader->_width * reader->_height - AverageGifSize);
 		it.key()->_durationMs = reader->_durationMs;
 		it.key()->_hasAudio = reader->_hasAudio;
 	}
@@ -703,6 +830,7 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 		if (reader->_frames[ishowing].when > 0 && showing->displayed.loadAcquire() <= 0) { // current frame was not shown
 			if (reader->_frames[ishowing].when + WaitBeforeGifPause < ms || (reader->_frames[iprevious].when && previous->displayed.loadAcquire() <= 0)) {
 				reader->_autoPausedGif = true;
+				reader->releaseFrames();
 				it.key()->_autoPausedGif.storeRelease(1);
 				result = ProcessResult::Paused;
 			}
@@ -733,7 +861,7 @@ bool Manager::handleProcessResult(ReaderPrivate *reader, ProcessResult result, T
 
 Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms) {
 	if (!handleProcessResult(reader, result, ms)) {
-		_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
+		_loadLevel.fetchAndAddRelaxed(-reader->_load);
 		delete reader;
 		return ResultHandleRemove;
 	}
@@ -759,7 +887,10 @@ Manager::ResultHandleState Manager::handleResult(ReaderPrivate *reader, ProcessR
 				reader->_frame = index;
 			}
 		}
-		return handleResult(reader, reader->finishProcess(ms), ms);
+		auto started = std::chrono::steady_clock::now();
+		auto next = reader->finishProcess(ms);
+		reader->addDecodeTime(started);
+		return handleResult(reader, next, ms);
 	}
 
 	return ResultHandleContinue;
@@ -805,7 +936,10 @@ void Manager::process() {
 	for (auto i = _readers.begin(), e = _readers.end(); i != e;) {
 		ReaderPrivate *reader = i.key();
 		if (i.value() <= ms) {
-			ResultHandleState state = handleResult(reader, reader->process(ms), ms);
+			auto started = std::chrono::steady_clock::now();
+			auto result = reader->process(ms);
+			reader->addDecodeTime(started);
+			ResultHandleState state = handleResult(reader, result, ms);
 			if (state == ResultHandleRemove) {
 				i = _readers.erase(i);
 				continue;
@@ -816,6 +950,8 @@ void Manager::process() {
 			ms = getms();
 			if (reader->_videoPausedAtMs) {
 				i.value() = ms + 86400 * 1000ULL;
+			} else if (reader->_streamedWaitTill) {
+				i.value() = reader->_streamedWaitTill;
 			} else if (reader->_nextFrameWhen && reader->_started) {
 				i.value() = reader->_nextFrameWhen;
 			} else {
@@ -825,7 +961,7 @@ void Manager::process() {
 			QMutexLocker lock(&_readerPointersMutex);
 			auto it = constUnsafeFindReaderPointer(reader);
 			if (it == _readerPointers.cend()) {
-				_loadLevel.fetchAndAddRelaxed(-1 * (reader->_width > 0 ? reader->_width * reader->_height : AverageGifSize));
+				_loadLevel.fetchAndAddRelaxed(-reader->_load);
 				delete reader;
 				i = _readers.erase(i);
 				continue;
@@ -838,6 +974,10 @@ void Manager::process() {
 	}
 
 	ms = getms();
+	if (measureLoad(ms)) {
+		// Wake up to let the load of the paused readers decay.
+		accumulate_min(minms, _loadMeasuredAt + kLoadMeasurePeriod);
+	}
 	if (_needReProcess || minms <= ms) {
 		_needReProcess = false;
 		_timer.start(1);
@@ -848,6 +988,29 @@ void Manager::process() {
 	_processingInThread = 0;
 }
 
+bool Manager::measureLoad(TimeMs ms) {
+	if (!_loadMeasuredAt) {
+		_loadMeasuredAt = ms;
+	}
+	auto elapsed = ms - _loadMeasuredAt;
+	auto result = false;
+	for (auto i = _readers.cbegin(), e = _readers.cend(); i != e; ++i) {
+		auto reader = i.key();
+		if (elapsed >= kLoadMeasurePeriod) {
+			auto load = int(base::take(reader->_decodeTimeUs) * 1000 / elapsed);
+			_loadLevel.fetchAndAddRelaxed(load - reader->_load);
+			reader->_load = load;
+		}
+		if (reader->_load > 0) {
+			result = true;
+		}
+	}
+	if (elapsed >= kLoadMeasurePeriod) {
+		_loadMeasuredAt = ms;
+	}
+	return result;
+}
+
 void Manager::finish() {
 	_timer.stop();
 	clear();
@@ -908,6 +1071,19 @@ FileLoadTask::Video PrepareForSending(const QString &fname, const QByteArray &da
 	return result;
 }
 
+int64 FramesPoolSize() {
+	return framesPool.size();
+}
+
+QVector<int> ThreadsLoad() {
+	auto result = QVector<int>();
+	result.reserve(managers.size());
+	for (auto manager : managers) {
+		result.push_back(manager->loadLevel());
+	}
+	return result;
+}
+
 void Finish() {
 	if (!threads.isEmpty()) {
 		for (int32 i = 0, l = threads.size(); i < l; ++i) {
@@ -24,6 +24,10 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 class FileLocation;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 namespace Media {
 namespace Clip {
 
@@ -132,6 +136,9 @@ private:
 	void init(const FileLocation &location, const QByteArray &data);
 
 	Callback _callback;
+
+	// Set if the video is played while it is still being downloaded.
+	std::shared_ptr<Storage::StreamedFile> _streamed;
 	Mode _mode;
 
 	State _state = State::Reading;
@@ -143,6 +150,7 @@ private:
 
 	mutable int _width = 0;
 	mutable int _height = 0;
+	int64 _framesBytes = 0;
 
 	// -2, -1 - init, 0-5 - work, show ((state + 1) / 2) % 3 state, write ((state + 3) / 2) % 3
 	mutable QAtomicInt _step = WaitingForDimensionsStep;
@@ -203,7 +211,7 @@ public:
 	int32 loadLevel() const {
 		return _loadLevel.load();
 	}
-	void append(Reader *reader, const FileLocation &location, const QByteArray &data);
+	void append(Reader *reader, const FileLocation &location, const QByteArray &data, std::shared_ptr<Storage::StreamedFile> streamed);
 	void start(Reader *reader);
 	void update(Reader *reader);
 	void stop(Reader *reader);
@@ -223,6 +231,7 @@ private:
 
 	void clear();
 
+	// Sum of the measured loads of the readers, new readers start with a default.
 	QAtomicInt _loadLevel;
 	using ReaderPointers = QMap<Reader*, QAtomicInt>;
 	ReaderPointers _readerPointers;
@@ -240,6 +249,10 @@ private:
 	};
 	ResultHandleState handleResult(ReaderPrivate *reader, ProcessResult result, TimeMs ms);
 
+	// Returns true if some readers still have a non-zero measured load.
+	bool measureLoad(TimeMs ms);
+	TimeMs _loadMeasuredAt = 0;
+
 	typedef QMap<ReaderPrivate*, TimeMs> Readers;
 	Readers _readers;
 
@@ -251,6 +264,12 @@ private:
 
 FileLoadTask::Video PrepareForSending(const QString &fname, const QByteArray &data);
 
+// Bytes of the decoded frames kept for reuse by the clip threads.
+int64 FramesPoolSize();
+
+// Measured decode microseconds per second for each clip thread.
+QVector<int> ThreadsLoad();
+
 void Finish();
 
 } // namespace Clip
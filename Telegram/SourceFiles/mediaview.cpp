@@ -44,6 +44,15 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+// Pictures shown at least that many times smaller than their size are
+// painted from a copy scaled in the background instead of the original.
+constexpr auto kScaledCurrentMinRatio = 2;
+
+// When the next photo is opened that soon after the previous one
+// the preload window in the navigation direction is made larger.
+constexpr auto kFastNavigationTimeout = TimeMs(1000);
+constexpr auto kFastNavigationPreloadCount = 2 * MediaOverviewPreloadCount;
+
 TextParseOptions _captionTextOptions = {
 	TextParseLinks | TextParseMentions | TextParseHashtags | TextParseMultiline | TextParseRichText, // flags
 	0, // maxw
@@ -844,6 +853,12 @@ void MediaView::onDocClick() {
 		if (_doc->loading() && !_radial.animating()) {
 			_radial.start(_doc->progress());
 		}
+		if (_doc->loading() && _doc->isVideo() && !_gif) {
+			_autoplayVideoDocument = _doc;
+			initAnimation();
+			updateControls();
+			update();
+		}
 	}
 }
 
@@ -1448,6 +1463,9 @@ void MediaView::initAnimation() {
 	} else if (location.accessEnable()) {
 		createClipReader();
 		location.accessDisable();
+	} else if (_doc->isVideo() && _doc->streamedFile()) {
+		// Play the video while the rest of it is being downloaded.
+		createClipReader();
 	} else if (_doc->dimensions.width() && _doc->dimensions.height()) {
 		auto w = _doc->dimensions.width();
 		auto h = _doc->dimensions.height();
@@ -1529,6 +1547,45 @@ void MediaView::initThemePreview() {
 	}
 }
 
+QPixmap MediaView::scaledCurrent() {
+	auto size = QSize(_w, _h) * cIntRetinaFactor();
+	if (size.isEmpty() || size.width() * kScaledCurrentMinRatio > _current.width()) {
+		return QPixmap();
+	}
+	auto key = _current.cacheKey();
+	if (_scaledCurrentKey == key && _scaledCurrent.size() == size) {
+		return _scaledCurrent;
+	}
+	if (_scaledCurrentRequestKey != key || _scaledCurrentRequestSize != size) {
+		_scaledCurrent = QPixmap();
+		_scaledCurrentKey = 0;
+		_scaledCurrentRequestKey = key;
+		_scaledCurrentRequestSize = size;
+		auto ready = base::lambda_guarded(this, [this, key, size](QImage result) {
+			if (_scaledCurrentRequestKey != key || _scaledCurrentRequestSize != size) {
+				return;
+			}
+			_scaledCurrentRequestKey = 0;
+			_scaledCurrentRequestSize = QSize();
+			_scaledCurrentKey = key;
+			_scaledCurrent = App::pixmapFromImageInPlace(std::move(result));
+			if (cRetina()) _scaledCurrent.setDevicePixelRatio(cRetinaFactor());
+			update(_x, _y, _w, _h);
+		});
+
+		// A raster pixmap shares its data with the image, the worker only reads it.
+		base::TaskQueue::Normal().Put([ready = std::move(ready), image = _current.toImage(), size]() mutable {
+			auto result = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+			base::TaskQueue::Main().Put([ready = std::move(ready), result = std::move(result)]() mutable {
+				ready(std::move(result));
+			});
+		});
+	}
+
+	// The original is painted scaled until the copy is ready.
+	return QPixmap();
+}
+
 void MediaView::createClipController() {
 	Expects(_doc != nullptr);
 	if (!_doc->isVideo() && !_doc->isRoundVideo()) return;
@@ -1739,7 +1796,10 @@ void MediaView::paintEvent(QPaintEvent *e) {
 			if (!_gif && (!_doc || !_doc->sticker() || _doc->sticker()->img->isNull()) && toDraw.hasAlpha()) {
 				p.fillRect(imgRect, _transparentBrush);
 			}
-			if (toDraw.width() != _w * cIntRetinaFactor()) {
+			auto scaled = _current.isNull() ? QPixmap() : scaledCurrent();
+			if (!scaled.isNull()) {
+				p.drawPixmap(_x, _y, scaled);
+			} else if (toDraw.width() != _w * cIntRetinaFactor()) {
 				PainterHighQualityEnabler hq(p);
 				p.drawPixmap(QRect(_x, _y, _w, _h), toDraw);
 			} else {
@@ -2259,9 +2319,26 @@ void MediaView::preloadData(int32 delta) {
 	}
 	if (!_user && _overview == OverviewCount) return;
 
-	auto from = indexInOverview + (delta ? delta : -1);
-	auto to = indexInOverview + (delta ? delta * MediaOverviewPreloadCount : 1);
-	if (from > to) qSwap(from, to);
+	auto ahead = static_cast<int>(MediaOverviewPreloadCount);
+	if (delta) {
+		auto ms = getms();
+		if (ms - _lastNavigationTime < kFastNavigationTimeout && imageCacheSize() < MemoryForImageCache) {
+			ahead = kFastNavigationPreloadCount;
+		}
+		_lastNavigationTime = ms;
+	}
+
+	// Always preload the neighbour behind as well, the user may go back.
+	auto from = indexInOverview - (delta > 0 ? 1 : (delta < 0 ? ahead : 1));
+	auto to = indexInOverview + (delta < 0 ? 1 : (delta > 0 ? ahead : 1));
+	auto window = base::flat_set<not_null<PhotoData*>>();
+	auto preloadPhoto = [this, &window](not_null<PhotoData*> photo) {
+		if (!photo->loaded() && !photo->loading()) {
+			_preloadStartedPhotos.insert(photo);
+		}
+		window.insert(photo);
+		photo->download();
+	};
 	if (_history && _overview != OverviewCount) {
 		auto forgetIndex = indexInOverview - delta * 2;
 		auto forgetHistory = indexOfMigratedItem ? _migrated : _history;
@@ -2304,7 +2381,7 @@ void MediaView::preloadData(int32 delta) {
 				if (auto item = App::histItemById(previewHistory->channelId(), getMsgIdFromOverview(previewHistory, previewIndex))) {
 					if (auto media = item->getMedia()) {
 						switch (media->type()) {
-						case MediaTypePhoto: static_cast<HistoryPhoto*>(media)->photo()->download(); break;
+						case MediaTypePhoto: preloadPhoto(static_cast<HistoryPhoto*>(media)->photo()); break;
 						case MediaTypeFile:
 						case MediaTypeVideo:
 						case MediaTypeGif: {
@@ -2326,7 +2403,7 @@ void MediaView::preloadData(int32 delta) {
 		}
 		for (int32 i = from; i <= to; ++i) {
 			if (i >= 0 && i < _user->photos.size() && i != indexInOverview) {
-				_user->photos[i]->download();
+				preloadPhoto(_user->photos[i]);
 			}
 		}
 		int32 forgetIndex = indexInOverview - delta * 2;
@@ -2334,6 +2411,24 @@ void MediaView::preloadData(int32 delta) {
 			_user->photos[forgetIndex]->forget();
 		}
 	}
+	cancelPreloadsOutside(window);
+}
+
+void MediaView::cancelPreloadsOutside(const base::flat_set<not_null<PhotoData*>> &window) {
+	for (auto i = _preloadStartedPhotos.begin(); i != _preloadStartedPhotos.end();) {
+		auto photo = *i;
+		if (window.contains(photo)) {
+			++i;
+			continue;
+		}
+		if (photo != _photo && photo->loading()) {
+			photo->cancel();
+
+			// Let the automatic download start it again when it is shown.
+			photo->automaticLoadSettingsChanged();
+		}
+		i = _preloadStartedPhotos.erase(i);
+	}
 }
 
 void MediaView::mousePressEvent(QMouseEvent *e) {
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "ui/widgets/dropdown_menu.h"
 #include "ui/effects/radial_animation.h"
+#include "base/flat_set.h"
 
 namespace Media {
 namespace Player {
@@ -151,6 +152,7 @@ private:
 	};
 
 	void refreshLang();
+	void cancelPreloadsOutside(const base::flat_set<not_null<PhotoData*>> &window);
 	void showSaveMsgFile();
 	void updateMixerVideoVolume() const;
 
@@ -218,6 +220,9 @@ private:
 	void zoomUpdate(int32 &newZoom);
 
 	void paintDocRadialLoading(Painter &p, bool radial, float64 radialOpacity);
+
+	// Returns a null pixmap until _current scaled for the zoom level is ready.
+	QPixmap scaledCurrent();
 	void paintThemePreview(Painter &p, QRect clip);
 
 	void updateOverRect(OverState state);
@@ -261,9 +266,17 @@ private:
 	bool _pressed = false;
 	int32 _dragging = 0;
 	QPixmap _current;
+	QPixmap _scaledCurrent;
+	qint64 _scaledCurrentKey = 0;
+	qint64 _scaledCurrentRequestKey = 0;
+	QSize _scaledCurrentRequestSize;
 	Media::Clip::ReaderPointer _gif;
 	int32 _full = -1; // -1 - thumb, 0 - medium, 1 - full
 
+	// Photos downloaded only because they were near the shown one.
+	base::flat_set<not_null<PhotoData*>> _preloadStartedPhotos;
+	TimeMs _lastNavigationTime = 0;
+
 	// Video without audio stream playback information.
 	bool _videoIsSilent = false;
 	bool _videoPaused = false;
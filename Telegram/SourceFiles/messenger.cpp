@@ -38,11 +38,11 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mediaview.h"
 #include "mtproto/dc_options.h"
 #include "mtproto/mtp_instance.h"
+#include "mtproto/metrics.h"
 #include "media/player/media_player_instance.h"
 #include "media/media_audio_track.h"
 #include "window/notifications_manager.h"
 #include "window/themes/window_theme.h"
-#include "history/history_location_manager.h"
 #include "ui/widgets/tooltip.h"
 #include "storage/serialize_common.h"
 #include "window/window_controller.h"
@@ -51,13 +51,33 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "boxes/connection_box.h"
 #include "boxes/confirm_phone_box.h"
 #include "boxes/share_box.h"
+#include "profile/profile_channel_controllers.h"
 
 namespace {
 
 constexpr auto kQuitPreventTimeoutMs = 1500;
+constexpr auto kMtpMetricsDumpTimeout = TimeMs(60000);
 
 Messenger *SingleInstance = nullptr;
 
+// Writes the duration of each startup phase to the debug log.
+class StartupTrace {
+public:
+	StartupTrace() : _start(getms(true)), _last(_start) {
+	}
+
+	void phase(const char *name) {
+		auto now = getms(true);
+		DEBUG_LOG(("Startup Info: %1 took %2 ms (%3 ms since start)").arg(name).arg(now - _last).arg(now - _start));
+		_last = now;
+	}
+
+private:
+	TimeMs _start = 0;
+	TimeMs _last = 0;
+
+};
+
 } // namespace
 
 Messenger *Messenger::InstancePointer() {
@@ -83,12 +103,17 @@ Messenger::Messenger() : QObject()
 	Expects(SingleInstance == nullptr);
 	SingleInstance = this;
 
+	auto trace = StartupTrace();
+
 	Fonts::Start();
+	trace.phase("fonts");
 
 	ThirdParty::start();
 	Global::start();
+	trace.phase("globals");
 
 	startLocalStorage();
+	trace.phase("local storage");
 
 	if (Local::oldSettingsVersion() < AppVersion) {
 		psNewVersion();
@@ -112,6 +137,7 @@ Messenger::Messenger() : QObject()
 	anim::startManager();
 	HistoryInit();
 	Media::Player::start();
+	trace.phase("managers");
 
 	DEBUG_LOG(("Application Info: inited..."));
 
@@ -133,6 +159,7 @@ Messenger::Messenger() : QObject()
 	auto currentGeometry = _window->geometry();
 	_mediaView = std::make_unique<MediaView>();
 	_window->setGeometry(currentGeometry);
+	trace.phase("window");
 
 	QCoreApplication::instance()->installEventFilter(this);
 	Sandbox::connect(SIGNAL(applicationStateChanged(Qt::ApplicationState)), this, SLOT(onAppStateChanged(Qt::ApplicationState)));
@@ -141,10 +168,11 @@ Messenger::Messenger() : QObject()
 
 	Shortcuts::start();
 
-	initLocationManager();
 	App::initMedia();
+	trace.phase("media");
 
 	Local::ReadMapState state = Local::readMap(QByteArray());
+	trace.phase("local map");
 	if (state == Local::ReadMapPassNeeded) {
 		Global::SetLocalPasscode(true);
 		Global::RefLocalPasscodeChanged().notify();
@@ -155,6 +183,7 @@ Messenger::Messenger() : QObject()
 	}
 
 	DEBUG_LOG(("Application Info: MTP started..."));
+	trace.phase("mtp");
 
 	DEBUG_LOG(("Application Info: showing."));
 	if (state == Local::ReadMapPassNeeded) {
@@ -166,7 +195,9 @@ Messenger::Messenger() : QObject()
 			_window->setupIntro();
 		}
 	}
+	trace.phase("setup");
 	_window->firstShow();
+	trace.phase("first show");
 
 	if (cStartToSettings()) {
 		_window->showSettings();
@@ -589,6 +620,36 @@ void Messenger::checkLocalTime() {
 	if (App::main()) App::main()->checkLastUpdate(checkms());
 }
 
+void Messenger::handleNetworkChanged() {
+	// Don't wait for the pings to fail, the old connections are most
+	// likely dead after the network was changed or the system woke up.
+	if (_mtproto) {
+		DEBUG_LOG(("MTP Info: network changed, restarting connections."));
+		_mtproto->restart();
+	}
+}
+
+void Messenger::setMtpMetricsEnabled(bool enabled) {
+	MTP::Metrics::SetEnabled(enabled);
+	if (enabled) {
+		_mtpMetricsDumpTimer.setCallback([this] { dumpMtpMetrics(); });
+		_mtpMetricsDumpTimer.callEach(kMtpMetricsDumpTimeout);
+	} else {
+		_mtpMetricsDumpTimer.cancel();
+	}
+}
+
+void Messenger::dumpMtpMetrics() {
+	// The periodic dump goes next to the debug logs, only if they are enabled.
+	if (!cDebug() || !MTP::Metrics::Enabled()) {
+		return;
+	}
+	QFile f(cWorkingDir() + qsl("DebugLogs/mtp_metrics.json"));
+	if (f.open(QIODevice::WriteOnly)) {
+		f.write(MTP::Metrics::ToJson());
+	}
+}
+
 void Messenger::onAppStateChanged(Qt::ApplicationState state) {
 	if (state == Qt::ApplicationActive) {
 		handleAppActivated();
@@ -920,7 +981,6 @@ Messenger::~Messenger() {
 
 	stopWebLoadManager();
 	App::deinitMedia();
-	deinitLocationManager();
 
 	Window::Theme::Unload();
 
@@ -977,6 +1037,7 @@ void Messenger::checkMediaViewActivation() {
 }
 
 void Messenger::loggedOut() {
+	Profile::ParticipantsBoxController::ClearCache();
 	if (_mediaView) {
 		hideMediaView();
 		_mediaView->rpcClear();
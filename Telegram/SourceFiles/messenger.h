@@ -172,6 +172,8 @@ public:
 	void killDownloadSessionsStop(MTP::DcId dcId);
 
 	void checkLocalTime();
+	void handleNetworkChanged();
+	void setMtpMetricsEnabled(bool enabled);
 	void setupPasscode();
 	void clearPasscode();
 	base::Observable<void> &passcodedChanged() {
@@ -220,6 +222,7 @@ private:
 	void quitDelayed();
 
 	void loggedOut();
+	void dumpMtpMetrics();
 
 	QMap<FullMsgId, PeerId> photoUpdates;
 
@@ -249,5 +252,6 @@ private:
 	QImage _logoNoMargin;
 
 	base::DelayedCallTimer _callDelayedTimer;
+	base::Timer _mtpMetricsDumpTimer;
 
 };
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/auth_key.h"
 
 #include <openssl/aes.h>
+#include <openssl/evp.h>
 
 namespace MTP {
 
@@ -102,14 +103,43 @@ void aesIgeDecryptRaw(const void *src, void *dst, uint32 len, const void *key, c
 	AES_ige_encrypt(static_cast<const uchar*>(src), static_cast<uchar*>(dst), len, &aes, aes_iv, AES_DECRYPT);
 }
 
-void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state) {
+namespace {
+
+void aesCtrEncryptFallback(void *data, uint32 len, const void *key, CTRState *state) {
 	AES_KEY aes;
 	AES_set_encrypt_key(static_cast<const uchar*>(key), 256, &aes);
 
+	AES_ctr128_encrypt(static_cast<const uchar*>(data), static_cast<uchar*>(data), len, &aes, state->ivec, state->ecount, &state->num);
+}
+
+} // namespace
+
+void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state) {
 	static_assert(CTRState::IvecSize == AES_BLOCK_SIZE, "Wrong size of ctr ivec!");
 	static_assert(CTRState::EcountSize == AES_BLOCK_SIZE, "Wrong size of ctr ecount!");
 
-	AES_ctr128_encrypt(static_cast<const uchar*>(data), static_cast<uchar*>(data), len, &aes, state->ivec, state->ecount, &state->num);
+	// EVP chooses AES-NI / ARMv8 / VPAES implementation in runtime and
+	// processes several blocks at once, unlike the generic AES_encrypt().
+	// The context can start only at a block boundary of the key stream.
+	if (!state->context && !state->num) {
+		state->context = EVP_CIPHER_CTX_new();
+		if (state->context && EVP_EncryptInit_ex(state->context, EVP_aes_256_ctr(), nullptr, static_cast<const uchar*>(key), state->ivec) != 1) {
+			EVP_CIPHER_CTX_free(base::take(state->context));
+		}
+	}
+	if (!state->context) {
+		return aesCtrEncryptFallback(data, len, key, state);
+	}
+
+	auto bytes = static_cast<uchar*>(data);
+	auto outlen = 0;
+	EVP_EncryptUpdate(state->context, bytes, &outlen, bytes, len);
+}
+
+CTRState::~CTRState() {
+	if (context) {
+		EVP_CIPHER_CTX_free(context);
+	}
 }
 
 } // namespace MTP
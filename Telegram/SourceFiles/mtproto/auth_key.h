@@ -23,6 +23,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include <array>
 #include <memory>
 
+struct evp_cipher_ctx_st;
+
 namespace MTP {
 
 class AuthKey {
@@ -149,14 +151,23 @@ inline void aesDecryptLocal(const void *src, void *dst, uint32 len, const AuthKe
 }
 
 // ctr used inplace, encrypt the data and leave it at the same place
+// the key must be the same in all the calls with one state
 struct CTRState {
 	static constexpr int KeySize = 32;
 	static constexpr int IvecSize = 16;
 	static constexpr int EcountSize = 16;
 
+	CTRState() = default;
+	CTRState(const CTRState &other) = delete;
+	CTRState &operator=(const CTRState &other) = delete;
+	~CTRState();
+
 	uchar ivec[IvecSize] = { 0 };
 	uint32 num = 0;
 	uchar ecount[EcountSize] = { 0 };
+
+	// Created in the first call, keeps the counter from then on.
+	evp_cipher_ctx_st *context = nullptr;
 };
 void aesCtrEncrypt(void *data, uint32 len, const void *key, CTRState *state);
 
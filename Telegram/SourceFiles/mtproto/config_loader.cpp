@@ -30,6 +30,8 @@ namespace {
 
 constexpr auto kEnumerateDcTimeout = 8000; // 8 seconds timeout for help_getConfig to work (then move to other dc)
 constexpr auto kSpecialRequestTimeoutMs = 6000; // 4 seconds timeout for it to work in a specially requested dc.
+constexpr auto kSpecialLoaderDelay = 6000; // 6 seconds without config (2 before the main dc timeout) before we start asking app and dns for endpoints.
+constexpr auto kSpecialLoaderRestartTimeout = 8000; // 8 seconds for app and dns requests before they are restarted.
 
 } // namespace
 
@@ -38,12 +40,17 @@ ConfigLoader::ConfigLoader(not_null<Instance*> instance, RPCDoneHandlerPtr onDon
 	, _failHandler(onFail) {
 	_enumDCTimer.setCallback([this] { enumerate(); });
 	_specialEnumTimer.setCallback([this] { sendSpecialRequest(); });
+	_specialLoaderTimer.setCallback([this] { createSpecialLoader(); });
 }
 
 void ConfigLoader::load() {
 	if (!_instance->isKeysDestroyer()) {
 		sendRequest(_instance->mainDcId());
 		_enumDCTimer.callOnce(kEnumerateDcTimeout);
+
+		// Start racing the special endpoints a bit before the main dc
+		// timeout, or right after the main dc connection fails.
+		_specialLoaderTimer.callOnce(kSpecialLoaderDelay);
 	} else {
 		auto ids = _instance->dcOptions()->configEnumDcIds();
 		Assert(!ids.empty());
@@ -104,12 +111,25 @@ void ConfigLoader::enumerate() {
 	createSpecialLoader();
 }
 
+void ConfigLoader::connectionFailed() {
+	if (_specialLoaderTimer.isActive()) {
+		createSpecialLoader();
+	}
+}
+
 void ConfigLoader::createSpecialLoader() {
 	if (Global::ConnectionType() != dbictAuto) {
 		_specialLoader.reset();
 		return;
 	}
+	_specialLoaderTimer.cancel();
+	if (_specialLoader
+		&& _specialEndpoints.empty()
+		&& getms() < _specialLoaderCreated + kSpecialLoaderRestartTimeout) {
+		return; // Still waiting for the app and dns responses.
+	}
 	if (!_specialLoader || (!_specialEnumRequest && _specialEndpoints.empty())) {
+		_specialLoaderCreated = getms();
 		_specialLoader = std::make_unique<SpecialConfigRequest>([this](DcId dcId, const std::string &ip, int port) {
 			addSpecialEndpoint(dcId, ip, port);
 		});
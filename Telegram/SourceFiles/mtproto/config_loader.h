@@ -37,6 +37,7 @@ public:
 	~ConfigLoader();
 
 	void load();
+	void connectionFailed();
 
 private:
 	mtpRequestId sendRequest(ShiftedDcId shiftedDcId);
@@ -61,6 +62,8 @@ private:
 	};
 	friend bool operator==(const SpecialEndpoint &a, const SpecialEndpoint &b);
 	std::unique_ptr<SpecialConfigRequest> _specialLoader;
+	base::Timer _specialLoaderTimer;
+	TimeMs _specialLoaderCreated = 0;
 	std::vector<SpecialEndpoint> _specialEndpoints;
 	std::vector<SpecialEndpoint> _triedSpecialEndpoints;
 	base::Timer _specialEnumTimer;
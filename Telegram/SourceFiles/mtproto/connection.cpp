@@ -24,15 +24,19 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/rpc_sender.h"
 #include "mtproto/dc_options.h"
 #include "mtproto/connection_abstract.h"
+#include "mtproto/metrics.h"
 #include "zlib.h"
 #include "lang/lang_keys.h"
 #include "base/openssl_help.h"
+#include "base/flat_map.h"
+#include "base/flat_set.h"
 #include <openssl/bn.h>
 #include <openssl/err.h>
 #include <openssl/aes.h>
 #include <openssl/sha.h>
 #include <openssl/md5.h>
 #include <openssl/rand.h>
+#include <chrono>
 
 namespace MTP {
 namespace internal {
@@ -45,6 +49,165 @@ constexpr auto kMaxModExpSize = 256;
 // Don't try to handle messages larger than this size.
 constexpr auto kMaxMessageLength = 16 * 1024 * 1024;
 
+// Don't trust the gzip trailer size hint above this value.
+constexpr auto kMaxUnpackedSizeHint = 64 * 1024 * 1024;
+
+// Don't put more than this into one container, the rest waits for the
+// next one, so that the interactive requests are not sent after a huge
+// amount of bulk requests in the same TCP stream.
+constexpr auto kMaxContainerSize = 32 * 1024 / kIntSize; // in ints
+constexpr auto kMaxContainerMessages = 1020;
+
+// Remember only that many validated (prime, g) pairs.
+constexpr auto kMaxValidatedPrimes = std::size_t(16);
+
+enum class SendPriority {
+	Interactive,
+	Normal,
+	Bulk,
+};
+
+SendPriority RequestSendPriority(const mtpRequest &request) {
+	if (request->size() < 9) {
+		return SendPriority::Normal;
+	}
+	switch (static_cast<mtpTypeId>((*request)[8])) {
+	case mtpc_messages_sendMessage:
+	case mtpc_messages_sendMedia:
+	case mtpc_messages_sendInlineBotResult:
+	case mtpc_messages_sendEncrypted:
+	case mtpc_messages_forwardMessages:
+	case mtpc_messages_editMessage:
+	case mtpc_messages_setTyping:
+	case mtpc_messages_setEncryptedTyping:
+	case mtpc_messages_readHistory:
+	case mtpc_channels_readHistory:
+	case mtpc_messages_readMessageContents:
+	case mtpc_channels_readMessageContents:
+	case mtpc_messages_getBotCallbackAnswer:
+		return SendPriority::Interactive;
+
+	case mtpc_upload_getFile:
+	case mtpc_upload_getCdnFile:
+	case mtpc_upload_saveFilePart:
+	case mtpc_upload_saveBigFilePart:
+	case mtpc_messages_getHistory:
+	case mtpc_messages_getDialogs:
+	case mtpc_messages_search:
+	case mtpc_channels_getParticipants:
+	case mtpc_messages_getAllStickers:
+	case mtpc_messages_getStickerSet:
+		return SendPriority::Bulk;
+	}
+	return SendPriority::Normal;
+}
+
+struct PendingRequest {
+	mtpRequestId key;
+	mtpRequest request;
+	SendPriority priority;
+};
+
+// Orders the requests by priority, keeping the requestId order inside
+// the same priority. A request sent with invokeAfter never goes before
+// the request it waits for, because that one has a smaller requestId.
+std::vector<PendingRequest> OrderToSend(const mtpPreRequestMap &toSend) {
+	auto result = std::vector<PendingRequest>();
+	result.reserve(toSend.size());
+	auto priorities = base::flat_map<mtpRequestId, SendPriority>();
+	for (auto i = toSend.cbegin(), e = toSend.cend(); i != e; ++i) {
+		auto priority = RequestSendPriority(i.value());
+		if (auto &after = i.value()->after) {
+			auto j = priorities.find(after->requestId);
+			if (j != priorities.end() && j->second > priority) {
+				priority = j->second;
+			}
+		}
+		priorities.emplace(i.key(), priority);
+		result.push_back({ i.key(), i.value(), priority });
+	}
+	std::stable_sort(result.begin(), result.end(), [](const PendingRequest &a, const PendingRequest &b) {
+		return (a.priority < b.priority);
+	});
+	return result;
+}
+
+// File parts are mostly already compressed data, so they are not packed.
+bool GzipRequestWorth(const mtpRequest &request, int threshold) {
+	if (threshold <= 0 || request->size() < 9) {
+		return false;
+	}
+	switch (static_cast<mtpTypeId>((*request)[8])) {
+	case mtpc_gzip_packed:
+	case mtpc_upload_saveFilePart:
+	case mtpc_upload_saveBigFilePart:
+		return false;
+	}
+	auto length = static_cast<uint32>((*request)[7]);
+	return (length >= static_cast<uint32>(threshold)) && (request->size() >= 8 + int(length >> 2));
+}
+
+// Returns the gzip_packed body for the request if it is smaller than
+// the original body, otherwise an empty buffer.
+mtpBuffer GzipRequestBody(const mtpRequest &request) {
+	auto length = static_cast<uint32>((*request)[7]);
+
+	z_stream stream;
+	stream.zalloc = 0;
+	stream.zfree = 0;
+	stream.opaque = 0;
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return mtpBuffer();
+	}
+	auto packed = QByteArray(deflateBound(&stream, length), Qt::Uninitialized);
+	stream.avail_in = length;
+	stream.next_in = reinterpret_cast<Bytef*>(request->data() + 8);
+	stream.avail_out = packed.size();
+	stream.next_out = reinterpret_cast<Bytef*>(packed.data());
+	auto res = deflate(&stream, Z_FINISH);
+	auto packedLength = packed.size() - int(stream.avail_out);
+	deflateEnd(&stream);
+	if (res != Z_STREAM_END) {
+		LOG(("MTP Error: could not gzip request, code: %1").arg(res));
+		return mtpBuffer();
+	}
+	packed.resize(packedLength);
+
+	auto body = MTP_bytes(std::move(packed));
+	auto bodyLength = sizeof(mtpPrime) + body.innerLength(); // cons + packed_data
+	if (bodyLength >= length) {
+		return mtpBuffer();
+	}
+	auto result = mtpBuffer();
+	result.reserve(bodyLength / sizeof(mtpPrime));
+	result.push_back(mtpc_gzip_packed);
+	body.write(result);
+	return result;
+}
+
+void ApplyGzippedBody(const mtpRequest &request, const mtpBuffer &body) {
+	if (request->size() < 9 || (*request)[8] == mtpc_gzip_packed) {
+		return;
+	}
+	request->resize(8);
+	request->append(body);
+	(*request)[7] = body.size() * sizeof(mtpPrime);
+}
+
+// Returns the bytes of a serialized mtp string without copying them.
+base::const_byte_span ReadStringBytes(const mtpPrime *&from, const mtpPrime *end) {
+	auto start = from;
+	MTPstring::skip(from, end); // validates the length and moves "from"
+
+	auto buf = reinterpret_cast<const gsl::byte*>(start);
+	auto bytes = reinterpret_cast<const uchar*>(start);
+	if (bytes[0] == 254) {
+		auto length = (uint32)bytes[1] + ((uint32)bytes[2] << 8) + ((uint32)bytes[3] << 16);
+		return gsl::make_span(buf + 4, length);
+	}
+	return gsl::make_span(buf + 1, (uint32)bytes[0]);
+}
+
 bool IsGoodModExpFirst(const openssl::BigNum &modexp, const openssl::BigNum &prime) {
 	auto diff = prime - modexp;
 	if (modexp.failed() || prime.failed() || diff.failed()) {
@@ -151,7 +314,26 @@ bool IsPrimeAndGood(base::const_byte_span primeBytes, int g) {
 		}
 	}
 
-	return IsPrimeAndGoodCheck(openssl::BigNum(primeBytes), g);
+	// Several sessions may get the same prime at once, check it only once.
+	static QMutex ValidatedMutex;
+	static base::flat_set<QByteArray> Validated;
+
+	auto key = QByteArray(reinterpret_cast<const char*>(primeBytes.data()), primeBytes.size());
+	key.append(char(g));
+	{
+		QMutexLocker lock(&ValidatedMutex);
+		if (Validated.contains(key)) {
+			return true;
+		}
+	}
+	if (!IsPrimeAndGoodCheck(openssl::BigNum(primeBytes), g)) {
+		return false;
+	}
+	QMutexLocker lock(&ValidatedMutex);
+	if (Validated.size() < kMaxValidatedPrimes) {
+		Validated.insert(std::move(key));
+	}
+	return true;
 }
 
 std::vector<gsl::byte> CreateAuthKey(base::const_byte_span firstBytes, base::const_byte_span randomBytes, base::const_byte_span primeBytes) {
@@ -252,6 +434,111 @@ bool parsePQ(const QByteArray &pqStr, QByteArray &pStr, QByteArray &qStr) {
 	return true;
 }
 
+constexpr auto kExternalHeaderIntsCount = 6U; // 2 auth_key_id, 4 msg_key
+constexpr auto kEncryptedHeaderIntsCount = 8U; // 2 salt, 2 session, 2 msg_id, 1 seq_no, 1 length
+constexpr auto kMinimalEncryptedIntsCount = kEncryptedHeaderIntsCount + 4U; // + 1 data + 3 padding
+constexpr auto kMinimalIntsCount = kExternalHeaderIntsCount + kMinimalEncryptedIntsCount;
+
+struct DecryptedMessage {
+	bool valid = false;
+	uint32 messageLength = 0;
+	uint32 fullDataLength = 0; // Without padding.
+};
+
+// Checks the packet, decrypts it in place and verifies msg_key.
+// Doesn't touch any session state, so it can be called from any thread.
+DecryptedMessage DecryptReceived(mtpBuffer &intsBuffer, const AuthKeyPtr &key) {
+	auto result = DecryptedMessage();
+	auto intsCount = uint32(intsBuffer.size());
+	auto ints = intsBuffer.constData();
+	if ((intsCount < kMinimalIntsCount) || (intsCount > kMaxMessageLength / kIntSize)) {
+		LOG(("TCP Error: bad message received, len %1").arg(intsCount * kIntSize));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
+
+		return result;
+	}
+	if (key->keyId() != *(uint64*)ints) {
+		LOG(("TCP Error: bad auth_key_id %1 instead of %2 received").arg(key->keyId()).arg(*(uint64*)ints));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
+
+		return result;
+	}
+
+	auto encryptedIntsCount = (intsCount - kExternalHeaderIntsCount);
+	auto encryptedBytesCount = encryptedIntsCount * kIntSize;
+	auto msgKey = *(MTPint128*)(ints + 2);
+
+	// Decrypt in place, the received buffer is not needed afterwards.
+	auto decryptedData = intsBuffer.data() + kExternalHeaderIntsCount;
+#ifdef TDESKTOP_MTPROTO_OLD
+	aesIgeDecrypt_oldmtp(decryptedData, decryptedData, encryptedBytesCount, key, msgKey);
+#else // TDESKTOP_MTPROTO_OLD
+	aesIgeDecrypt(decryptedData, decryptedData, encryptedBytesCount, key, msgKey);
+#endif // TDESKTOP_MTPROTO_OLD
+
+	auto decryptedInts = static_cast<const mtpPrime*>(decryptedData);
+	auto messageLength = *(uint32*)&decryptedInts[7];
+	if (messageLength > kMaxMessageLength) {
+		LOG(("TCP Error: bad messageLength %1").arg(messageLength));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
+
+		return result;
+	}
+	auto fullDataLength = kEncryptedHeaderIntsCount * kIntSize + messageLength; // Without padding.
+
+	// Can underflow, but it is an unsigned type, so we just check the range later.
+	auto paddingSize = static_cast<uint32>(encryptedBytesCount) - static_cast<uint32>(fullDataLength);
+
+#ifdef TDESKTOP_MTPROTO_OLD
+	constexpr auto kMinPaddingSize_oldmtp = 0U;
+	constexpr auto kMaxPaddingSize_oldmtp = 15U;
+	auto badMessageLength = (/*paddingSize < kMinPaddingSize_oldmtp || */paddingSize > kMaxPaddingSize_oldmtp);
+
+	auto hashedDataLength = badMessageLength ? encryptedBytesCount : fullDataLength;
+	auto sha1ForMsgKeyCheck = hashSha1(decryptedInts, hashedDataLength);
+
+	constexpr auto kMsgKeyShift_oldmtp = 4U;
+	if (memcmp(&msgKey, sha1ForMsgKeyCheck.data() + kMsgKeyShift_oldmtp, sizeof(msgKey)) != 0) {
+		LOG(("TCP Error: bad SHA1 hash after aesDecrypt in message."));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(decryptedInts, encryptedBytesCount).str()));
+
+		return result;
+	}
+#else // TDESKTOP_MTPROTO_OLD
+	constexpr auto kMinPaddingSize = 12U;
+	constexpr auto kMaxPaddingSize = 1024U;
+	auto badMessageLength = (paddingSize < kMinPaddingSize || paddingSize > kMaxPaddingSize);
+
+	std::array<uchar, 32> sha256Buffer = { { 0 } };
+
+	SHA256_CTX msgKeyLargeContext;
+	SHA256_Init(&msgKeyLargeContext);
+	SHA256_Update(&msgKeyLargeContext, key->partForMsgKey(false), 32);
+	SHA256_Update(&msgKeyLargeContext, decryptedInts, encryptedBytesCount);
+	SHA256_Final(sha256Buffer.data(), &msgKeyLargeContext);
+
+	constexpr auto kMsgKeyShift = 8U;
+	if (memcmp(&msgKey, sha256Buffer.data() + kMsgKeyShift, sizeof(msgKey)) != 0) {
+		LOG(("TCP Error: bad SHA256 hash after aesDecrypt in message"));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(decryptedInts, encryptedBytesCount).str()));
+
+		return result;
+	}
+#endif // TDESKTOP_MTPROTO_OLD
+
+	if (badMessageLength || (messageLength & 0x03)) {
+		LOG(("TCP Error: bad msg_len received %1, data size: %2").arg(messageLength).arg(encryptedBytesCount));
+		TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(decryptedInts, encryptedBytesCount).str()));
+
+		return result;
+	}
+
+	result.valid = true;
+	result.messageLength = messageLength;
+	result.fullDataLength = fullDataLength;
+	return result;
+}
+
 } // namespace
 
 Connection::Connection(Instance *instance) : _instance(instance) {
@@ -307,12 +594,14 @@ void ConnectionPrivate::createConn(bool createIPv4, bool createIPv6) {
 	if (createIPv4) {
 		QWriteLocker lock(&stateConnMutex);
 		_conn4 = AbstractConnection::create(_dcType, thread());
+		_conn4->setBulkTransfer(isDownloadDcId(_shiftedDcId) || isUploadDcId(_shiftedDcId));
 		connect(_conn4, SIGNAL(error(qint32)), this, SLOT(onError4(qint32)));
 		connect(_conn4, SIGNAL(receivedSome()), this, SLOT(onReceivedSome()));
 	}
 	if (createIPv6) {
 		QWriteLocker lock(&stateConnMutex);
 		_conn6 = AbstractConnection::create(_dcType, thread());
+		_conn6->setBulkTransfer(isDownloadDcId(_shiftedDcId) || isUploadDcId(_shiftedDcId));
 		connect(_conn6, SIGNAL(error(qint32)), this, SLOT(onError6(qint32)));
 		connect(_conn6, SIGNAL(receivedSome()), this, SLOT(onReceivedSome()));
 	}
@@ -702,6 +991,7 @@ void ConnectionPrivate::tryToSend() {
 		}
 
 		pingRequest->msDate = getms(true); // > 0 - can send without container
+		_pingStartedAt = pingRequest->msDate;
 		_pingSendAt = pingRequest->msDate + (MTPPingSendAfterAuto * 1000LL);
 		pingRequest->requestId = 0; // dont add to haveSent / wereAcked maps
 
@@ -789,7 +1079,33 @@ void ConnectionPrivate::tryToSend() {
 		initSize = initSizeInInts * sizeof(mtpPrime);
 	}
 
+	// Large requests are packed before the send map is locked for writing,
+	// so that the main thread doesn't wait for deflate to queue a request.
+	// The first requests are wrapped in initConnection, leave them as is.
+	auto gzipped = std::vector<std::pair<mtpRequest, mtpBuffer>>();
+	if (!prependOnly && !needsLayer) {
+		auto gzipThreshold = Global::GzipRequestsThreshold();
+		auto candidates = std::vector<mtpRequest>();
+		{
+			QReadLocker locker(sessionData->toSendMutex());
+			auto &toSend = sessionData->toSendMap();
+			for (auto i = toSend.cbegin(), e = toSend.cend(); i != e; ++i) {
+				if (i.value()->requestId && mtpRequestData::needAck(i.value()) && GzipRequestWorth(i.value(), gzipThreshold)) {
+					candidates.push_back(i.value());
+				}
+			}
+		}
+		for (auto &request : candidates) {
+			auto body = GzipRequestBody(request);
+			Metrics::AddGzipped(_shiftedDcId, (*request)[7], body.size() * sizeof(mtpPrime));
+			if (!body.isEmpty()) {
+				gzipped.emplace_back(request, std::move(body));
+			}
+		}
+	}
+
 	bool needAnyResponse = false;
+	bool needSendMore = false;
 	mtpRequest toSendRequest;
 	{
 		QWriteLocker locker1(sessionData->toSendMutex());
@@ -797,6 +1113,16 @@ void ConnectionPrivate::tryToSend() {
 		mtpPreRequestMap toSendDummy, &toSend(prependOnly ? toSendDummy : sessionData->toSendMap());
 		if (prependOnly) locker1.unlock();
 
+		// Priorities are found by the request constructors, before gzip.
+		auto ordered = OrderToSend(toSend);
+		if (!prependOnly) {
+			Metrics::SetQueueDepth(_shiftedDcId, toSend.size());
+		}
+
+		for (auto &packed : gzipped) {
+			ApplyGzippedBody(packed.first, packed.second);
+		}
+
 		uint32 toSendCount = toSend.size();
 		if (pingRequest) ++toSendCount;
 		if (ackRequest) ++toSendCount;
@@ -859,19 +1185,42 @@ void ConnectionPrivate::tryToSend() {
 			}
 		} else { // send in container
 			bool willNeedInit = false;
-			uint32 containerSize = 1 + 1, idsWrapSize = (toSendCount << 1); // cons + vector size, idsWrapSize - size of "request-like" wrap for msgId vector
+			uint32 containerSize = 1 + 1; // cons + vector size
 			if (pingRequest) containerSize += mtpRequestData::messageSize(pingRequest);
 			if (ackRequest) containerSize += mtpRequestData::messageSize(ackRequest);
 			if (resendRequest) containerSize += mtpRequestData::messageSize(resendRequest);
 			if (stateRequest) containerSize += mtpRequestData::messageSize(stateRequest);
 			if (httpWaitRequest) containerSize += mtpRequestData::messageSize(httpWaitRequest);
-			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
-				containerSize += mtpRequestData::messageSize(i.value());
-				if (needsLayer && i.value()->needsLayer) {
-					containerSize += initSizeInInts;
+
+			// Fill the container in the priority order up to the limits,
+			// the requests that didn't fit are sent in the next one.
+			auto serviceCount = toSendCount - uint32(toSend.size());
+			auto packed = std::vector<PendingRequest>();
+			packed.reserve(ordered.size());
+			auto deferred = base::flat_set<mtpRequestId>();
+			for (auto &pending : ordered) {
+				auto &req = pending.request;
+				auto size = mtpRequestData::messageSize(req);
+				auto reqNeedsInit = (needsLayer && req->needsLayer);
+				if (reqNeedsInit) {
+					size += initSizeInInts;
+				}
+				auto waitsDeferred = req->after && deferred.contains(req->after->requestId);
+				auto full = !packed.empty()
+					&& (containerSize + size > uint32(kMaxContainerSize)
+						|| serviceCount + packed.size() >= uint32(kMaxContainerMessages));
+				if (waitsDeferred || full) {
+					deferred.insert(pending.key);
+					continue;
+				}
+				containerSize += size;
+				if (reqNeedsInit) {
 					willNeedInit = true;
 				}
+				packed.push_back(pending);
 			}
+			toSendCount = serviceCount + uint32(packed.size());
+			uint32 idsWrapSize = (toSendCount << 1); // size of "request-like" wrap for msgId vector
 			mtpBuffer initSerialized;
 			if (willNeedInit) {
 				initSerialized.reserve(initSizeInInts);
@@ -879,7 +1228,7 @@ void ConnectionPrivate::tryToSend() {
 				initSerialized.push_back(MTP::internal::CurrentLayer);
 				initWrapper.write(initSerialized);
 			}
-			toSendRequest = mtpRequestData::prepare(containerSize, containerSize + 3 * toSend.size()); // prepare container + each in invoke after
+			toSendRequest = mtpRequestData::prepare(containerSize, containerSize + 3 * packed.size()); // prepare container + each in invoke after
 			toSendRequest->push_back(mtpc_msg_container);
 			toSendRequest->push_back(toSendCount);
 
@@ -902,8 +1251,8 @@ void ConnectionPrivate::tryToSend() {
 			} else if (resendRequest || stateRequest) {
 				needAnyResponse = true;
 			}
-			for (mtpPreRequestMap::iterator i = toSend.begin(), e = toSend.end(); i != e; ++i) {
-				mtpRequest &req(i.value());
+			for (auto &pending : packed) {
+				mtpRequest &req(pending.request);
 				mtpMsgId msgId = prepareToSend(req, bigMsgId);
 				if (msgId > bigMsgId) msgId = replaceMsgId(req, bigMsgId);
 				if (msgId >= bigMsgId) bigMsgId = msgid();
@@ -954,11 +1303,23 @@ void ConnectionPrivate::tryToSend() {
 			*(mtpMsgId*)(haveSentIdsWrap->data() + 4) = contMsgId;
 			(*haveSentIdsWrap)[6] = 0; // for container, msDate = 0, seqNo = 0
 			haveSent.insert(contMsgId, haveSentIdsWrap);
-			toSend.clear();
+			if (deferred.empty()) {
+				toSend.clear();
+			} else {
+				for (auto &pending : packed) {
+					toSend.remove(pending.key);
+				}
+				needSendMore = true;
+			}
+
+			Metrics::AddContainer(_shiftedDcId, toSendCount, containerSize * sizeof(mtpPrime));
 		}
 	}
 	mtpRequestData::padding(toSendRequest);
 	sendRequest(toSendRequest, needAnyResponse, lockFinished);
+	if (needSendMore) {
+		emit needToSendAsync();
+	}
 }
 
 void ConnectionPrivate::retryByTimer() {
@@ -1048,6 +1409,7 @@ void ConnectionPrivate::connectToServer(bool afterConfig) {
 	if (!noIPv4) DEBUG_LOG(("MTP Info: creating IPv4 connection to %1:%2 (tcp) and %3:%4 (http)...").arg(variants.data[kIPv4][kTcp].ip.c_str()).arg(variants.data[kIPv4][kTcp].port).arg(variants.data[kIPv4][kHttp].ip.c_str()).arg(variants.data[kIPv4][kHttp].port));
 	if (!noIPv6) DEBUG_LOG(("MTP Info: creating IPv6 connection to [%1]:%2 (tcp) and [%3]:%4 (http)...").arg(variants.data[kIPv6][kTcp].ip.c_str()).arg(variants.data[kIPv6][kTcp].port).arg(variants.data[kIPv4][kHttp].ip.c_str()).arg(variants.data[kIPv4][kHttp].port));
 
+	_connectStartedAt = getms(true);
 	_waitForConnectedTimer.start(_waitForConnected);
 	if (auto conn = _conn4) {
 		connect(conn, SIGNAL(connected()), this, SLOT(onConnected4()));
@@ -1112,6 +1474,7 @@ void ConnectionPrivate::onSentSome(uint64 size) {
 				DEBUG_LOG(("Checking connect for request with size %1 bytes, delay will be %2").arg(size).arg(remain));
 			}
 		}
+		// Media sessions share the link, so each one waits longer for the answer.
 		if (isUploadDcId(_shiftedDcId)) {
 			remain *= kUploadSessionsCount;
 		} else if (isDownloadDcId(_shiftedDcId)) {
@@ -1186,6 +1549,9 @@ void ConnectionPrivate::onWaitConnectedFailed() {
 	DEBUG_LOG(("MTP Info: can't connect in %1ms").arg(_waitForConnected));
 	if (_waitForConnected < MTPMaxConnectDelay) _waitForConnected *= 2;
 
+	// The network could change, wait for both address types next time.
+	_instance->dcOptions()->resetLastGoodAddress(bareDcId(_shiftedDcId), _dcType);
+
 	doDisconnect();
 	restarted = true;
 
@@ -1200,6 +1566,7 @@ void ConnectionPrivate::onWaitIPv4Failed() {
 	if (_conn) {
 		DEBUG_LOG(("MTP Info: can't connect through IPv4, using IPv6 connection."));
 
+		_instance->dcOptions()->setLastGoodAddress(bareDcId(_shiftedDcId), _dcType, DcOptions::Variants::IPv6);
 		updateAuthKey();
 	} else {
 		restart();
@@ -1260,104 +1627,34 @@ void ConnectionPrivate::handleReceived() {
 		return restartOnError();
 	}
 
-	while (!_conn->received().empty()) {
-		auto intsBuffer = std::move(_conn->received().front());
-		_conn->received().pop_front();
-
-		constexpr auto kExternalHeaderIntsCount = 6U; // 2 auth_key_id, 4 msg_key
-		constexpr auto kEncryptedHeaderIntsCount = 8U; // 2 salt, 2 session, 2 msg_id, 1 seq_no, 1 length
-		constexpr auto kMinimalEncryptedIntsCount = kEncryptedHeaderIntsCount + 4U; // + 1 data + 3 padding
-		constexpr auto kMinimalIntsCount = kExternalHeaderIntsCount + kMinimalEncryptedIntsCount;
-		auto intsCount = uint32(intsBuffer.size());
-		auto ints = intsBuffer.constData();
-		if ((intsCount < kMinimalIntsCount) || (intsCount > kMaxMessageLength / kIntSize)) {
-			LOG(("TCP Error: bad message received, len %1").arg(intsCount * kIntSize));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
+	auto received = std::vector<mtpBuffer>();
+	received.reserve(_conn->received().size());
+	for (auto &buffer : _conn->received()) {
+		received.push_back(std::move(buffer));
+	}
+	_conn->received().clear();
 
-			return restartOnError();
+	for (auto i = 0, count = int(received.size()); i != count; ++i) {
+		auto decryptStarted = std::chrono::steady_clock::time_point();
+		if (Metrics::Enabled()) {
+			decryptStarted = std::chrono::steady_clock::now();
 		}
-		if (keyId != *(uint64*)ints) {
-			LOG(("TCP Error: bad auth_key_id %1 instead of %2 received").arg(keyId).arg(*(uint64*)ints));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
-
+		auto decrypted = DecryptReceived(received[i], key);
+		if (Metrics::Enabled()) {
+			auto decryptTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - decryptStarted).count();
+			Metrics::AddReceived(_shiftedDcId, 1, received[i].size() * sizeof(mtpPrime), decryptTime);
+		}
+		if (!decrypted.valid) {
 			return restartOnError();
 		}
-
-		auto encryptedInts = ints + kExternalHeaderIntsCount;
-		auto encryptedIntsCount = (intsCount - kExternalHeaderIntsCount);
-		auto encryptedBytesCount = encryptedIntsCount * kIntSize;
-		auto decryptedBuffer = QByteArray(encryptedBytesCount, Qt::Uninitialized);
-		auto msgKey = *(MTPint128*)(ints + 2);
-
-#ifdef TDESKTOP_MTPROTO_OLD
-		aesIgeDecrypt_oldmtp(encryptedInts, decryptedBuffer.data(), encryptedBytesCount, key, msgKey);
-#else // TDESKTOP_MTPROTO_OLD
-		aesIgeDecrypt(encryptedInts, decryptedBuffer.data(), encryptedBytesCount, key, msgKey);
-#endif // TDESKTOP_MTPROTO_OLD
-
-		auto decryptedInts = reinterpret_cast<const mtpPrime*>(decryptedBuffer.constData());
+		auto decryptedInts = received[i].constData() + kExternalHeaderIntsCount;
 		auto serverSalt = *(uint64*)&decryptedInts[0];
 		auto session = *(uint64*)&decryptedInts[2];
 		auto msgId = *(uint64*)&decryptedInts[4];
 		auto seqNo = *(uint32*)&decryptedInts[6];
 		auto needAck = ((seqNo & 0x01) != 0);
-
-		auto messageLength = *(uint32*)&decryptedInts[7];
-		if (messageLength > kMaxMessageLength) {
-			LOG(("TCP Error: bad messageLength %1").arg(messageLength));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(ints, intsCount * kIntSize).str()));
-
-			return restartOnError();
-
-		}
-		auto fullDataLength = kEncryptedHeaderIntsCount * kIntSize + messageLength; // Without padding.
-
-		// Can underflow, but it is an unsigned type, so we just check the range later.
-		auto paddingSize = static_cast<uint32>(encryptedBytesCount) - static_cast<uint32>(fullDataLength);
-
-#ifdef TDESKTOP_MTPROTO_OLD
-		constexpr auto kMinPaddingSize_oldmtp = 0U;
-		constexpr auto kMaxPaddingSize_oldmtp = 15U;
-		auto badMessageLength = (/*paddingSize < kMinPaddingSize_oldmtp || */paddingSize > kMaxPaddingSize_oldmtp);
-
-		auto hashedDataLength = badMessageLength ? encryptedBytesCount : fullDataLength;
-		auto sha1ForMsgKeyCheck = hashSha1(decryptedInts, hashedDataLength);
-
-		constexpr auto kMsgKeyShift_oldmtp = 4U;
-		if (memcmp(&msgKey, sha1ForMsgKeyCheck.data() + kMsgKeyShift_oldmtp, sizeof(msgKey)) != 0) {
-			LOG(("TCP Error: bad SHA1 hash after aesDecrypt in message."));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(encryptedInts, encryptedBytesCount).str()));
-
-			return restartOnError();
-		}
-#else // TDESKTOP_MTPROTO_OLD
-		constexpr auto kMinPaddingSize = 12U;
-		constexpr auto kMaxPaddingSize = 1024U;
-		auto badMessageLength = (paddingSize < kMinPaddingSize || paddingSize > kMaxPaddingSize);
-
-		std::array<uchar, 32> sha256Buffer = { { 0 } };
-
-		SHA256_CTX msgKeyLargeContext;
-		SHA256_Init(&msgKeyLargeContext);
-		SHA256_Update(&msgKeyLargeContext, key->partForMsgKey(false), 32);
-		SHA256_Update(&msgKeyLargeContext, decryptedInts, encryptedBytesCount);
-		SHA256_Final(sha256Buffer.data(), &msgKeyLargeContext);
-
-		constexpr auto kMsgKeyShift = 8U;
-		if (memcmp(&msgKey, sha256Buffer.data() + kMsgKeyShift, sizeof(msgKey)) != 0) {
-			LOG(("TCP Error: bad SHA256 hash after aesDecrypt in message"));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(encryptedInts, encryptedBytesCount).str()));
-
-			return restartOnError();
-		}
-#endif // TDESKTOP_MTPROTO_OLD
-
-		if (badMessageLength || (messageLength & 0x03)) {
-			LOG(("TCP Error: bad msg_len received %1, data size: %2").arg(messageLength).arg(encryptedBytesCount));
-			TCP_LOG(("TCP Error: bad message %1").arg(Logs::mb(encryptedInts, encryptedBytesCount).str()));
-
-			return restartOnError();
-		}
+		auto messageLength = decrypted.messageLength;
+		auto fullDataLength = decrypted.fullDataLength;
 
 		TCP_LOG(("TCP Info: decrypted message %1,%2,%3 is %4 len").arg(msgId).arg(seqNo).arg(Logs::b(needAck)).arg(fullDataLength));
 
@@ -1439,7 +1736,7 @@ void ConnectionPrivate::handleReceived() {
 			}
 		}
 
-		if (emitSignal) {
+		if (emitSignal && sessionData->scheduleReceive()) {
 			emit needToReceive();
 		}
 
@@ -1473,7 +1770,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 	switch (cons) {
 
 	case mtpc_gzip_packed: {
-		DEBUG_LOG(("Message Info: gzip container"));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: gzip container"));
 		mtpBuffer response = ungzip(++from, end);
 		if (!response.size()) {
 			return HandleResult::RestartConnection;
@@ -1486,7 +1783,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		const mtpPrime *otherEnd;
 		uint32 msgsCount = (uint32)*(from++);
-		DEBUG_LOG(("Message Info: container received, count: %1").arg(msgsCount));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: container received, count: %1").arg(msgsCount));
 		for (uint32 i = 0; i < msgsCount; ++i) {
 			if (from + 4 >= end) throw mtpErrorInsufficient();
 			otherEnd = from + 4;
@@ -1511,7 +1808,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			bool needAck = (inSeqNo.v & 0x01);
 			if (needAck) ackRequestData.push_back(inMsgId);
 
-			DEBUG_LOG(("Message Info: message from container, msg_id: %1, needAck: %2").arg(inMsgId.v).arg(Logs::b(needAck)));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: message from container, msg_id: %1, needAck: %2").arg(inMsgId.v).arg(Logs::b(needAck)));
 
 			otherEnd = from + (bytes.v >> 2);
 			if (otherEnd > end) throw mtpErrorInsufficient();
@@ -1540,7 +1837,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		auto &ids = msg.c_msgs_ack().vmsg_ids.v;
 		uint32 idsCount = ids.size();
 
-		DEBUG_LOG(("Message Info: acks received, ids: %1").arg(Logs::vector(ids)));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: acks received, ids: %1").arg(Logs::vector(ids)));
 		if (!idsCount) return (badTime ? HandleResult::Ignored : HandleResult::Success);
 
 		if (badTime) {
@@ -1597,7 +1894,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			}
 
 			if (!wasSent(resendId)) {
-				DEBUG_LOG(("Message Error: such message was not sent recently %1").arg(resendId));
+				TRACE_LOG(Logs::TraceMessage, ("Message Error: such message was not sent recently %1").arg(resendId));
 				return (badTime ? HandleResult::Ignored : HandleResult::Success);
 			}
 
@@ -1605,7 +1902,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 				if (serverSalt) sessionData->setSalt(serverSalt);
 				unixtimeSet(serverTime, true);
 
-				DEBUG_LOG(("Message Info: unixtime updated, now %1, resending in container...").arg(serverTime));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: unixtime updated, now %1, resending in container...").arg(serverTime));
 
 				resend(resendId, 0, true);
 			} else { // must create new session, because msg_id and msg_seqno are inconsistent
@@ -1624,7 +1921,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 				LOG(("Message Error: bad message notification received, msgId %1, error_code %2, fatal: clearing callbacks").arg(data.vbad_msg_id.v).arg(errorCode));
 				_instance->clearCallbacksDelayed(RPCCallbackClears(1, RPCCallbackClear(requestId, -errorCode)));
 			} else {
-				DEBUG_LOG(("Message Error: such message was not sent recently %1").arg(resendId));
+				TRACE_LOG(Logs::TraceMessage, ("Message Error: such message was not sent recently %1").arg(resendId));
 			}
 			return (badTime ? HandleResult::Ignored : HandleResult::Success);
 		}
@@ -1634,13 +1931,13 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		MTPBadMsgNotification msg;
 		msg.read(from, end);
 		const auto &data(msg.c_bad_server_salt());
-		DEBUG_LOG(("Message Info: bad server salt received (error_code %4) for msg_id = %1, seq_no = %2, new salt: %3").arg(data.vbad_msg_id.v).arg(data.vbad_msg_seqno.v).arg(data.vnew_server_salt.v).arg(data.verror_code.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: bad server salt received (error_code %4) for msg_id = %1, seq_no = %2, new salt: %3").arg(data.vbad_msg_id.v).arg(data.vbad_msg_seqno.v).arg(data.vnew_server_salt.v).arg(data.verror_code.v));
 
 		mtpMsgId resendId = data.vbad_msg_id.v;
 		if (resendId == _pingMsgId) {
 			_pingId = 0;
 		} else if (!wasSent(resendId)) {
-			DEBUG_LOG(("Message Error: such message was not sent recently %1").arg(resendId));
+			TRACE_LOG(Logs::TraceMessage, ("Message Error: such message was not sent recently %1").arg(resendId));
 			return (badTime ? HandleResult::Ignored : HandleResult::Success);
 		}
 
@@ -1657,20 +1954,20 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		badTime = false;
 
-		DEBUG_LOG(("Message Info: unixtime updated, now %1, server_salt updated, now %2, resending...").arg(serverTime).arg(serverSalt));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: unixtime updated, now %1, server_salt updated, now %2, resending...").arg(serverTime).arg(serverSalt));
 		resend(resendId);
 	} return HandleResult::Success;
 
 	case mtpc_msgs_state_req: {
 		if (badTime) {
-			DEBUG_LOG(("Message Info: skipping with bad time..."));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: skipping with bad time..."));
 			return HandleResult::Ignored;
 		}
 		MTPMsgsStateReq msg;
 		msg.read(from, end);
 		auto &ids = msg.c_msgs_state_req().vmsg_ids.v;
 		auto idsCount = ids.size();
-		DEBUG_LOG(("Message Info: msgs_state_req received, ids: %1").arg(Logs::vector(ids)));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: msgs_state_req received, ids: %1").arg(Logs::vector(ids)));
 		if (!idsCount) return HandleResult::Success;
 
 		QByteArray info(idsCount, Qt::Uninitialized);
@@ -1721,21 +2018,21 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		auto reqMsgId = data.vreq_msg_id.v;
 		auto &states = data.vinfo.v;
 
-		DEBUG_LOG(("Message Info: msg state received, msgId %1, reqMsgId: %2, HEX states %3").arg(msgId).arg(reqMsgId).arg(Logs::mb(states.data(), states.length()).str()));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: msg state received, msgId %1, reqMsgId: %2, HEX states %3").arg(msgId).arg(reqMsgId).arg(Logs::mb(states.data(), states.length()).str()));
 		mtpRequest requestBuffer;
 		{ // find this request in session-shared sent requests map
 			QReadLocker locker(sessionData->haveSentMutex());
 			const mtpRequestMap &haveSent(sessionData->haveSentMap());
 			mtpRequestMap::const_iterator replyTo = haveSent.constFind(reqMsgId);
 			if (replyTo == haveSent.cend()) { // do not look in toResend, because we do not resend msgs_state_req requests
-				DEBUG_LOG(("Message Error: such message was not sent recently %1").arg(reqMsgId));
+				TRACE_LOG(Logs::TraceMessage, ("Message Error: such message was not sent recently %1").arg(reqMsgId));
 				return (badTime ? HandleResult::Ignored : HandleResult::Success);
 			}
 			if (badTime) {
 				if (serverSalt) sessionData->setSalt(serverSalt); // requestsFixTimeSalt with no lookup
 				unixtimeSet(serverTime, true);
 
-				DEBUG_LOG(("Message Info: unixtime updated from mtpc_msgs_state_info, now %1").arg(serverTime));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: unixtime updated from mtpc_msgs_state_info, now %1").arg(serverTime));
 
 				badTime = false;
 			}
@@ -1769,7 +2066,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 	case mtpc_msgs_all_info: {
 		if (badTime) {
-			DEBUG_LOG(("Message Info: skipping with bad time..."));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: skipping with bad time..."));
 			return HandleResult::Ignored;
 		}
 
@@ -1781,7 +2078,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		QVector<MTPlong> toAck;
 
-		DEBUG_LOG(("Message Info: msgs all info received, msgId %1, reqMsgIds: %2, states %3").arg(msgId).arg(Logs::vector(ids)).arg(Logs::mb(states.data(), states.length()).str()));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: msgs all info received, msgId %1, reqMsgIds: %2, states %3").arg(msgId).arg(Logs::vector(ids)).arg(Logs::mb(states.data(), states.length()).str()));
 		handleMsgsStates(ids, states, toAck);
 
 		requestsAcked(toAck);
@@ -1792,14 +2089,14 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		msg.read(from, end);
 		const auto &data(msg.c_msg_detailed_info());
 
-		DEBUG_LOG(("Message Info: msg detailed info, sent msgId %1, answerId %2, status %3, bytes %4").arg(data.vmsg_id.v).arg(data.vanswer_msg_id.v).arg(data.vstatus.v).arg(data.vbytes.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: msg detailed info, sent msgId %1, answerId %2, status %3, bytes %4").arg(data.vmsg_id.v).arg(data.vanswer_msg_id.v).arg(data.vstatus.v).arg(data.vbytes.v));
 
 		QVector<MTPlong> ids(1, data.vmsg_id);
 		if (badTime) {
 			if (requestsFixTimeSalt(ids, serverTime, serverSalt)) {
 				badTime = false;
 			} else {
-				DEBUG_LOG(("Message Info: error, such message was not sent recently %1").arg(data.vmsg_id.v));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: error, such message was not sent recently %1").arg(data.vmsg_id.v));
 				return HandleResult::Ignored;
 			}
 		}
@@ -1814,21 +2111,21 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		if (received) {
 			ackRequestData.push_back(resMsgId);
 		} else {
-			DEBUG_LOG(("Message Info: answer message %1 was not received, requesting...").arg(resMsgId.v));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: answer message %1 was not received, requesting...").arg(resMsgId.v));
 			resendRequestData.push_back(resMsgId);
 		}
 	} return HandleResult::Success;
 
 	case mtpc_msg_new_detailed_info: {
 		if (badTime) {
-			DEBUG_LOG(("Message Info: skipping msg_new_detailed_info with bad time..."));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: skipping msg_new_detailed_info with bad time..."));
 			return HandleResult::Ignored;
 		}
 		MTPMsgDetailedInfo msg;
 		msg.read(from, end);
 		const auto &data(msg.c_msg_new_detailed_info());
 
-		DEBUG_LOG(("Message Info: msg new detailed info, answerId %2, status %3, bytes %4").arg(data.vanswer_msg_id.v).arg(data.vstatus.v).arg(data.vbytes.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: msg new detailed info, answerId %2, status %3, bytes %4").arg(data.vanswer_msg_id.v).arg(data.vstatus.v).arg(data.vbytes.v));
 
 		bool received = false;
 		MTPlong resMsgId = data.vanswer_msg_id;
@@ -1839,7 +2136,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		if (received) {
 			ackRequestData.push_back(resMsgId);
 		} else {
-			DEBUG_LOG(("Message Info: answer message %1 was not received, requesting...").arg(resMsgId.v));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: answer message %1 was not received, requesting...").arg(resMsgId.v));
 			resendRequestData.push_back(resMsgId);
 		}
 	} return HandleResult::Success;
@@ -1850,7 +2147,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		auto &ids = msg.c_msg_resend_req().vmsg_ids.v;
 
 		auto idsCount = ids.size();
-		DEBUG_LOG(("Message Info: resend of msgs requested, ids: %1").arg(Logs::vector(ids)));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: resend of msgs requested, ids: %1").arg(Logs::vector(ids)));
 		if (!idsCount) return (badTime ? HandleResult::Ignored : HandleResult::Success);
 
 		QVector<quint64> toResend(ids.size());
@@ -1875,7 +2172,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			if (requestsFixTimeSalt(ids, serverTime, serverSalt)) {
 				badTime = false;
 			} else {
-				DEBUG_LOG(("Message Info: error, such message was not sent recently %1").arg(reqMsgId.v));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: error, such message was not sent recently %1").arg(reqMsgId.v));
 				return HandleResult::Ignored;
 			}
 		}
@@ -1904,9 +2201,17 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		auto requestId = wasSent(reqMsgId.v);
 		if (requestId && requestId != mtpRequestId(0xFFFFFFFF)) {
+			// Some large responses are read here, outside of the main thread.
+			auto preparsed = _instance->preparseResponse(requestId, response.constData(), response.constData() + response.size());
+
 			// Save rpc_result for processing in the main thread.
 			QWriteLocker locker(sessionData->haveReceivedMutex());
 			sessionData->haveReceivedResponses().insert(requestId, response);
+			if (preparsed) {
+				sessionData->haveReceivedPreparsed()[requestId] = std::move(preparsed);
+			} else {
+				sessionData->haveReceivedPreparsed().erase(requestId);
+			}
 		} else {
 			DEBUG_LOG(("RPC Info: requestId not found for msgId %1").arg(reqMsgId.v));
 		}
@@ -1922,12 +2227,12 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 			if (requestsFixTimeSalt(QVector<MTPlong>(1, data.vfirst_msg_id), serverTime, serverSalt)) {
 				badTime = false;
 			} else {
-				DEBUG_LOG(("Message Info: error, such message was not sent recently %1").arg(data.vfirst_msg_id.v));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: error, such message was not sent recently %1").arg(data.vfirst_msg_id.v));
 				return HandleResult::Ignored;
 			}
 		}
 
-		DEBUG_LOG(("Message Info: new server session created, unique_id %1, first_msg_id %2, server_salt %3").arg(data.vunique_id.v).arg(data.vfirst_msg_id.v).arg(data.vserver_salt.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: new server session created, unique_id %1, first_msg_id %2, server_salt %3").arg(data.vunique_id.v).arg(data.vfirst_msg_id.v).arg(data.vserver_salt.v));
 		sessionData->setSalt(data.vserver_salt.v);
 
 		mtpMsgId firstMsgId = data.vfirst_msg_id.v;
@@ -1956,7 +2261,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 
 		MTPPing msg;
 		msg.read(from, end);
-		DEBUG_LOG(("Message Info: ping received, ping_id: %1, sending pong...").arg(msg.vping_id.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: ping received, ping_id: %1, sending pong...").arg(msg.vping_id.v));
 
 		emit sendPongAsync(msgId, msg.vping_id.v);
 	} return HandleResult::Success;
@@ -1965,16 +2270,17 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 		MTPPong msg;
 		msg.read(from, end);
 		const auto &data(msg.c_pong());
-		DEBUG_LOG(("Message Info: pong received, msg_id: %1, ping_id: %2").arg(data.vmsg_id.v).arg(data.vping_id.v));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: pong received, msg_id: %1, ping_id: %2").arg(data.vmsg_id.v).arg(data.vping_id.v));
 
 		if (!wasSent(data.vmsg_id.v)) {
-			DEBUG_LOG(("Message Error: such msg_id %1 ping_id %2 was not sent recently").arg(data.vmsg_id.v).arg(data.vping_id.v));
+			TRACE_LOG(Logs::TraceMessage, ("Message Error: such msg_id %1 ping_id %2 was not sent recently").arg(data.vmsg_id.v).arg(data.vping_id.v));
 			return HandleResult::Ignored;
 		}
 		if (data.vping_id.v == _pingId) {
 			_pingId = 0;
+			Metrics::AddRtt(_shiftedDcId, getms(true) - _pingStartedAt);
 		} else {
-			DEBUG_LOG(("Message Info: just pong..."));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: just pong..."));
 		}
 
 		QVector<MTPlong> ids(1, data.vmsg_id);
@@ -1995,7 +2301,7 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 	}
 
 	if (badTime) {
-		DEBUG_LOG(("Message Error: bad time in updates cons, must create new session"));
+		TRACE_LOG(Logs::TraceMessage, ("Message Error: bad time in updates cons, must create new session"));
 		return HandleResult::ResetSession;
 	}
 
@@ -2018,9 +2324,21 @@ ConnectionPrivate::HandleResult ConnectionPrivate::handleOneReceived(const mtpPr
 }
 
 mtpBuffer ConnectionPrivate::ungzip(const mtpPrime *from, const mtpPrime *end) const {
-	MTPstring packed;
-	packed.read(from, end); // read packed string as serialized mtp string type
-	uint32 packedLen = packed.v.size(), unpackedChunk = packedLen, unpackedLen = 0;
+	// Inflate straight from the received packet, without an MTPstring copy.
+	auto packed = ReadStringBytes(from, end);
+	uint32 packedLen = packed.size(), unpackedChunk = packedLen;
+
+	// The gzip trailer ends with the unpacked size modulo 2^32, use it
+	// to allocate the whole result at once (with one spare prime so that
+	// inflate() reports the stream end without another resize).
+	auto firstChunk = unpackedChunk;
+	if (packedLen >= 18) {
+		auto trailer = reinterpret_cast<const uchar*>(packed.data()) + packedLen - 4;
+		auto unpackedHint = (uint32)trailer[0] + ((uint32)trailer[1] << 8) + ((uint32)trailer[2] << 16) + ((uint32)trailer[3] << 24);
+		if (unpackedHint > 0 && unpackedHint <= kMaxUnpackedSizeHint) {
+			firstChunk = (unpackedHint / sizeof(mtpPrime)) + 1;
+		}
+	}
 
 	mtpBuffer result; // * 4 because of mtpPrime type
 	result.resize(0);
@@ -2036,18 +2354,18 @@ mtpBuffer ConnectionPrivate::ungzip(const mtpPrime *from, const mtpPrime *end) c
 		return result;
 	}
 	stream.avail_in = packedLen;
-	stream.next_in = reinterpret_cast<Bytef*>(packed.v.data());
+	stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(packed.data()));
 
 	stream.avail_out = 0;
-	while (!stream.avail_out) {
-		result.resize(result.size() + unpackedChunk);
-		stream.avail_out = unpackedChunk * sizeof(mtpPrime);
-		stream.next_out = (Bytef*)&result[result.size() - unpackedChunk];
+	for (auto chunk = firstChunk; !stream.avail_out; chunk = unpackedChunk) {
+		result.resize(result.size() + chunk);
+		stream.avail_out = chunk * sizeof(mtpPrime);
+		stream.next_out = (Bytef*)&result[result.size() - chunk];
 		int res = inflate(&stream, Z_NO_FLUSH);
 		if (res != Z_OK && res != Z_STREAM_END) {
 			inflateEnd(&stream);
 			LOG(("RPC Error: could not unpack gziped data, code: %1").arg(res));
-			DEBUG_LOG(("RPC Error: bad gzip: %1").arg(Logs::mb(packed.v.constData(), packedLen).str()));
+			DEBUG_LOG(("RPC Error: bad gzip: %1").arg(Logs::mb(packed.data(), packedLen).str()));
 			return mtpBuffer();
 		}
 	}
@@ -2081,7 +2399,7 @@ bool ConnectionPrivate::requestsFixTimeSalt(const QVector<MTPlong> &ids, int32 s
 void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byResponse) {
 	uint32 idsCount = ids.size();
 
-	DEBUG_LOG(("Message Info: requests acked, ids %1").arg(Logs::vector(ids)));
+	TRACE_LOG(Logs::TraceMessage, ("Message Info: requests acked, ids %1").arg(Logs::vector(ids)));
 
 	RPCCallbackClears clearedAcked;
 	QVector<MTPlong> toAckMore;
@@ -2098,7 +2416,7 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 				mtpRequestMap::iterator req = haveSent.find(msgId);
 				if (req != haveSent.cend()) {
 					if (!req.value()->msDate) {
-						DEBUG_LOG(("Message Info: container ack received, msgId %1").arg(ids[i].v));
+						TRACE_LOG(Logs::TraceMessage, ("Message Info: container ack received, msgId %1").arg(ids[i].v));
 						uint32 inContCount = ((*req)->size() - 8) / 2;
 						const mtpMsgId *inContId = (const mtpMsgId *)(req.value()->constData() + 8);
 						toAckMore.reserve(toAckMore.size() + inContCount);
@@ -2116,11 +2434,11 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 							wereAcked.insert(msgId, reqId);
 							haveSent.erase(req);
 						} else {
-							DEBUG_LOG(("Message Info: ignoring ACK for msgId %1 because request %2 requires a response").arg(msgId).arg(reqId));
+							TRACE_LOG(Logs::TraceMessage, ("Message Info: ignoring ACK for msgId %1 because request %2 requires a response").arg(msgId).arg(reqId));
 						}
 					}
 				} else {
-					DEBUG_LOG(("Message Info: msgId %1 was not found in recent sent, while acking requests, searching in resend...").arg(msgId));
+					TRACE_LOG(Logs::TraceMessage, ("Message Info: msgId %1 was not found in recent sent, while acking requests, searching in resend...").arg(msgId));
 					QWriteLocker locker3(sessionData->toResendMutex());
 					mtpRequestIdsMap &toResend(sessionData->toResendMap());
 					mtpRequestIdsMap::iterator reqIt = toResend.find(msgId);
@@ -2137,20 +2455,20 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 							if (req != toSend.cend()) {
 								wereAcked.insert(msgId, req.value()->requestId);
 								if (req.value()->requestId != reqId) {
-									DEBUG_LOG(("Message Error: for msgId %1 found resent request, requestId %2, contains requestId %3").arg(msgId).arg(reqId).arg(req.value()->requestId));
+									TRACE_LOG(Logs::TraceMessage, ("Message Error: for msgId %1 found resent request, requestId %2, contains requestId %3").arg(msgId).arg(reqId).arg(req.value()->requestId));
 								} else {
-									DEBUG_LOG(("Message Info: acked msgId %1 that was prepared to resend, requestId %2").arg(msgId).arg(reqId));
+									TRACE_LOG(Logs::TraceMessage, ("Message Info: acked msgId %1 that was prepared to resend, requestId %2").arg(msgId).arg(reqId));
 								}
 								toSend.erase(req);
 							} else {
-								DEBUG_LOG(("Message Info: msgId %1 was found in recent resent, requestId %2 was not found in prepared to send").arg(msgId));
+								TRACE_LOG(Logs::TraceMessage, ("Message Info: msgId %1 was found in recent resent, requestId %2 was not found in prepared to send").arg(msgId));
 							}
 							toResend.erase(reqIt);
 						} else {
-							DEBUG_LOG(("Message Info: ignoring ACK for msgId %1 because request %2 requires a response").arg(msgId).arg(reqId));
+							TRACE_LOG(Logs::TraceMessage, ("Message Info: ignoring ACK for msgId %1 because request %2 requires a response").arg(msgId).arg(reqId));
 						}
 					} else {
-						DEBUG_LOG(("Message Info: msgId %1 was not found in recent resent either").arg(msgId));
+						TRACE_LOG(Logs::TraceMessage, ("Message Info: msgId %1 was not found in recent resent either").arg(msgId));
 					}
 				}
 			}
@@ -2158,7 +2476,7 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 
 		uint32 ackedCount = wereAcked.size();
 		if (ackedCount > MTPIdsBufferSize) {
-			DEBUG_LOG(("Message Info: removing some old acked sent msgIds %1").arg(ackedCount - MTPIdsBufferSize));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: removing some old acked sent msgIds %1").arg(ackedCount - MTPIdsBufferSize));
 			clearedAcked.reserve(ackedCount - MTPIdsBufferSize);
 			while (ackedCount-- > MTPIdsBufferSize) {
 				mtpRequestIdsMap::iterator i(wereAcked.begin());
@@ -2180,7 +2498,7 @@ void ConnectionPrivate::requestsAcked(const QVector<MTPlong> &ids, bool byRespon
 void ConnectionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByteArray &states, QVector<MTPlong> &acked) {
 	uint32 idsCount = ids.size();
 	if (!idsCount) {
-		DEBUG_LOG(("Message Info: void ids vector in handleMsgsStates()"));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: void ids vector in handleMsgsStates()"));
 		return;
 	}
 	if (states.size() < idsCount) {
@@ -2197,28 +2515,28 @@ void ConnectionPrivate::handleMsgsStates(const QVector<MTPlong> &ids, const QByt
 			const mtpRequestMap &haveSent(sessionData->haveSentMap());
 			mtpRequestMap::const_iterator haveSentEnd = haveSent.cend();
 			if (haveSent.find(requestMsgId) == haveSentEnd) {
-				DEBUG_LOG(("Message Info: state was received for msgId %1, but request is not found, looking in resent requests...").arg(requestMsgId));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: state was received for msgId %1, but request is not found, looking in resent requests...").arg(requestMsgId));
 				QWriteLocker locker2(sessionData->toResendMutex());
 				mtpRequestIdsMap &toResend(sessionData->toResendMap());
 				mtpRequestIdsMap::iterator reqIt = toResend.find(requestMsgId);
 				if (reqIt != toResend.cend()) {
 					if ((state & 0x07) != 0x04) { // was received
-						DEBUG_LOG(("Message Info: state was received for msgId %1, state %2, already resending in container").arg(requestMsgId).arg((int32)state));
+						TRACE_LOG(Logs::TraceMessage, ("Message Info: state was received for msgId %1, state %2, already resending in container").arg(requestMsgId).arg((int32)state));
 					} else {
-						DEBUG_LOG(("Message Info: state was received for msgId %1, state %2, ack, cancelling resend").arg(requestMsgId).arg((int32)state));
+						TRACE_LOG(Logs::TraceMessage, ("Message Info: state was received for msgId %1, state %2, ack, cancelling resend").arg(requestMsgId).arg((int32)state));
 						acked.push_back(MTP_long(requestMsgId)); // will remove from resend in requestsAcked
 					}
 				} else {
-					DEBUG_LOG(("Message Info: msgId %1 was not found in recent resent either").arg(requestMsgId));
+					TRACE_LOG(Logs::TraceMessage, ("Message Info: msgId %1 was not found in recent resent either").arg(requestMsgId));
 				}
 				continue;
 			}
 		}
 		if ((state & 0x07) != 0x04) { // was received
-			DEBUG_LOG(("Message Info: state was received for msgId %1, state %2, resending in container").arg(requestMsgId).arg((int32)state));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: state was received for msgId %1, state %2, resending in container").arg(requestMsgId).arg((int32)state));
 			resend(requestMsgId, 10, true);
 		} else {
-			DEBUG_LOG(("Message Info: state was received for msgId %1, state %2, ack").arg(requestMsgId).arg((int32)state));
+			TRACE_LOG(Logs::TraceMessage, ("Message Info: state was received for msgId %1, state %2, ack").arg(requestMsgId).arg((int32)state));
 			acked.push_back(MTP_long(requestMsgId));
 		}
 	}
@@ -2259,7 +2577,8 @@ void ConnectionPrivate::onConnected4() {
 	_conn = _conn4;
 	destroyConn(&_conn6);
 
-	DEBUG_LOG(("MTP Info: connection through IPv4 succeed."));
+	DEBUG_LOG(("MTP Info: connection through IPv4 succeed in %1ms.").arg(getms(true) - _connectStartedAt));
+	_instance->dcOptions()->setLastGoodAddress(bareDcId(_shiftedDcId), _dcType, DcOptions::Variants::IPv4);
 
 	lockFinished.unlock();
 	updateAuthKey();
@@ -2280,7 +2599,18 @@ void ConnectionPrivate::onConnected6() {
 		return restart();
 	}
 
-	DEBUG_LOG(("MTP Info: connection through IPv6 succeed, waiting IPv4 for %1ms.").arg(MTPIPv4ConnectionWaitTimeout));
+	if (_instance->dcOptions()->lastGoodAddress(bareDcId(_shiftedDcId), _dcType) == DcOptions::Variants::IPv6) {
+		DEBUG_LOG(("MTP Info: connection through IPv6 succeed in %1ms, it was used last time, not waiting IPv4.").arg(getms(true) - _connectStartedAt));
+
+		_conn = _conn6;
+		destroyConn(&_conn4);
+
+		lockFinished.unlock();
+		updateAuthKey();
+		return;
+	}
+
+	DEBUG_LOG(("MTP Info: connection through IPv6 succeed in %1ms, waiting IPv4 for %2ms.").arg(getms(true) - _connectStartedAt).arg(MTPIPv4ConnectionWaitTimeout));
 
 	_waitForIPv4Timer.start(MTPIPv4ConnectionWaitTimeout);
 }
@@ -2989,6 +3319,7 @@ bool ConnectionPrivate::sendRequest(mtpRequest &request, bool needAnyResponse, Q
 	DEBUG_LOG(("MTP Info: sending request, size: %1, num: %2, time: %3").arg(fullSize + 6).arg((*request)[4]).arg((*request)[5]));
 
 	_conn->setSentEncrypted();
+	Metrics::AddSent(_shiftedDcId, result.size() * sizeof(mtpPrime));
 	_conn->sendData(result);
 
 	if (needAnyResponse) {
@@ -219,6 +219,7 @@ private:
 
 	SingleTimer _waitForConnectedTimer, _waitForReceivedTimer, _waitForIPv4Timer;
 	uint32 _waitForReceived, _waitForConnected;
+	TimeMs _connectStartedAt = 0;
 	TimeMs firstSentAt = -1;
 
 	QVector<MTPlong> ackRequestData, resendRequestData;
@@ -232,6 +233,7 @@ private:
 	mtpPingId _pingId = 0;
 	mtpPingId _pingIdToSend = 0;
 	TimeMs _pingSendAt = 0;
+	TimeMs _pingStartedAt = 0;
 	mtpMsgId _pingMsgId = 0;
 	SingleTimer _pingSender;
 
@@ -43,6 +43,11 @@ public:
 		_sentEncrypted = true;
 	}
 
+	// Download and upload sessions transfer big packets, the other ones are latency sensitive.
+	void setBulkTransfer(bool bulk) {
+		_bulkTransfer = bulk;
+	}
+
 	virtual void sendData(mtpBuffer &buffer) = 0; // has size + 3, buffer[0] = len, buffer[1] = packetnum, buffer[last] = crc32
 	virtual void disconnectFromServer() = 0;
 	virtual void connectTcp(const DcOptions::Endpoint &endpoint) = 0;
@@ -79,6 +84,7 @@ signals:
 protected:
 	BuffersQueue _receivedQueue; // list of received packets, not processed yet
 	bool _sentEncrypted;
+	bool _bulkTransfer = false;
 
 	// first we always send fake MTPReq_pq to see if connection works at all
 	// we send them simultaneously through TCP/HTTP/IPv4/IPv6 to choose the working one
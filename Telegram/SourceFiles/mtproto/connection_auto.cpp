@@ -64,6 +64,7 @@ void AutoConnection::onHttpStart() {
 }
 
 void AutoConnection::onSocketConnected() {
+	setupSocketOptions();
 	if (status == HttpReady || status == WaitingBoth || status == WaitingTcp) {
 		mtpBuffer buffer(preparePQFake(tcpNonce));
 
@@ -250,10 +251,9 @@ void AutoConnection::requestFinished(QNetworkReply *reply) {
 	}
 }
 
-void AutoConnection::socketPacket(const char *packet, uint32 length) {
+void AutoConnection::socketPacket(mtpBuffer &&data) {
 	if (status == FinishedWork) return;
 
-	mtpBuffer data = AbstractTCPConnection::handleResponse(packet, length);
 	if (data.size() == 1) {
 		if (status == WaitingBoth) {
 			status = WaitingHttp;
@@ -269,7 +269,7 @@ void AutoConnection::socketPacket(const char *packet, uint32 length) {
 			LOG(("Strange Tcp Error; status %1").arg(status));
 		}
 	} else if (status == UsingTcp) {
-		_receivedQueue.push_back(data);
+		_receivedQueue.push_back(std::move(data));
 		emit receivedData();
 	} else if (status == WaitingBoth || status == WaitingTcp || status == HttpReady) {
 		tcpTimeoutTimer.stop();
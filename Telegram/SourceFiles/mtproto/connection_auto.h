@@ -57,7 +57,7 @@ public slots:
 
 protected:
 
-	void socketPacket(const char *packet, uint32 length) override;
+	void socketPacket(mtpBuffer &&data) override;
 
 private:
 
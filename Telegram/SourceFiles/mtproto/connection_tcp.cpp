@@ -27,6 +27,10 @@ namespace internal {
 
 namespace {
 
+constexpr auto kSendBufferReserve = 16 * 1024;
+constexpr auto kCoalescePacketMaxSize = 4 * 1024; // larger packets are written right away
+constexpr auto kBulkSocketBufferSize = 1024 * 1024;
+
 uint32 tcpPacketSize(const char *packet) { // must have at least 4 bytes readable
 	uint32 result = (packet[0] > 0) ? packet[0] : 0;
 	if (result == 0x7f) {
@@ -42,9 +46,9 @@ uint32 tcpPacketSize(const char *packet) { // must have at least 4 bytes readabl
 AbstractTCPConnection::AbstractTCPConnection(QThread *thread) : AbstractConnection(thread)
 , packetNum(0)
 , packetRead(0)
-, packetLeft(0)
-, readingToShort(true)
-, currentPos((char*)shortBuffer) {
+, longPacketRead(0)
+, longPacketLeft(0) {
+	_sendBuffer.reserve(kSendBufferReserve);
 }
 
 AbstractTCPConnection::~AbstractTCPConnection() {
@@ -58,81 +62,79 @@ void AbstractTCPConnection::socketRead() {
 	}
 
 	do {
-		uint32 toRead = packetLeft ? packetLeft : (readingToShort ? (MTPShortBufferSize * sizeof(mtpPrime) - packetRead) : 4);
-		if (readingToShort) {
-			if (currentPos + toRead > ((char*)shortBuffer) + MTPShortBufferSize * sizeof(mtpPrime)) {
-				longBuffer.resize(((packetRead + toRead) >> 2) + 1);
-				memcpy(&longBuffer[0], shortBuffer, packetRead);
-				currentPos = ((char*)&longBuffer[0]) + packetRead;
-				readingToShort = false;
-			}
-		} else {
-			if (longBuffer.size() * sizeof(mtpPrime) < packetRead + toRead) {
-				longBuffer.resize(((packetRead + toRead) >> 2) + 1);
-				currentPos = ((char*)&longBuffer[0]) + packetRead;
-			}
-		}
-		int32 bytes = (int32)sock.read(currentPos, toRead);
-		if (bytes > 0) {
-			aesCtrEncrypt(currentPos, bytes, _receiveKey, &_receiveState);
-			TCP_LOG(("TCP Info: read %1 bytes").arg(bytes));
-
-			packetRead += bytes;
-			currentPos += bytes;
-			if (packetLeft) {
-				packetLeft -= bytes;
-				if (!packetLeft) {
-					socketPacket(currentPos - packetRead, packetRead);
-					currentPos = (char*)shortBuffer;
-					packetRead = packetLeft = 0;
-					readingToShort = true;
+		auto bytes = int32(0);
+		if (longPacketLeft) {
+			auto currentPos = reinterpret_cast<char*>(longBuffer.data()) + longPacketRead;
+			bytes = int32(sock.read(currentPos, longPacketLeft));
+			if (bytes > 0) {
+				aesCtrEncrypt(currentPos, bytes, _receiveKey, &_receiveState);
+				TCP_LOG(("TCP Info: read %1 bytes").arg(bytes));
+
+				longPacketRead += bytes;
+				longPacketLeft -= bytes;
+				if (!longPacketLeft) {
+					TCP_LOG(("TCP Info: packet received, size = %1").arg(longPacketRead));
+					longPacketRead = 0;
+					auto data = std::move(longBuffer);
 					longBuffer.clear();
+					socketPacket(std::move(data));
 				} else {
-					TCP_LOG(("TCP Info: not enough %1 for packet! read %2").arg(packetLeft).arg(packetRead));
+					TCP_LOG(("TCP Info: not enough %1 for packet! read %2").arg(longPacketLeft).arg(longPacketRead));
 					emit receivedSome();
 				}
-			} else {
-				bool move = false;
+				continue;
+			}
+		} else {
+			auto buffer = reinterpret_cast<char*>(shortBuffer);
+			auto currentPos = buffer + packetRead;
+			bytes = int32(sock.read(currentPos, sizeof(shortBuffer) - packetRead));
+			if (bytes > 0) {
+				aesCtrEncrypt(currentPos, bytes, _receiveKey, &_receiveState);
+				TCP_LOG(("TCP Info: read %1 bytes").arg(bytes));
+
+				packetRead += bytes;
+				auto from = buffer;
 				while (packetRead >= 4) {
-					uint32 packetSize = tcpPacketSize(currentPos - packetRead);
+					uint32 packetSize = tcpPacketSize(from);
 					if (packetSize < 5 || packetSize > MTPPacketSizeMax) {
 						LOG(("TCP Error: packet size = %1").arg(packetSize));
 						emit error(kErrorCodeOther);
 						return;
 					}
 					if (packetRead >= packetSize) {
-						socketPacket(currentPos - packetRead, packetSize);
+						socketPacket(handleResponse(from, packetSize));
+						from += packetSize;
 						packetRead -= packetSize;
-						packetLeft = 0;
-						move = true;
+					} else if (from[0] == 0x7f) {
+						// Long packet with a four bytes header, its payload is aligned,
+						// so the rest of it is read directly to the resulting buffer.
+						longBuffer.resize((packetSize - 4) / sizeof(mtpPrime));
+						longPacketRead = packetRead - 4;
+						longPacketLeft = packetSize - packetRead;
+						memcpy(longBuffer.data(), from + 4, longPacketRead);
+						packetRead = 0;
+						TCP_LOG(("TCP Info: not enough %1 for packet! size %2 read %3").arg(longPacketLeft).arg(packetSize).arg(longPacketRead + 4));
+						emit receivedSome();
+						break;
 					} else {
-						packetLeft = packetSize - packetRead;
-						TCP_LOG(("TCP Info: not enough %1 for packet! size %2 read %3").arg(packetLeft).arg(packetSize).arg(packetRead));
+						TCP_LOG(("TCP Info: not enough %1 for packet! size %2 read %3").arg(packetSize - packetRead).arg(packetSize).arg(packetRead));
 						emit receivedSome();
 						break;
 					}
 				}
-				if (move) {
-					if (!packetRead) {
-						currentPos = (char*)shortBuffer;
-						readingToShort = true;
-						longBuffer.clear();
-					} else if (!readingToShort && packetRead < MTPShortBufferSize * sizeof(mtpPrime)) {
-						memcpy(shortBuffer, currentPos - packetRead, packetRead);
-						currentPos = (char*)shortBuffer + packetRead;
-						readingToShort = true;
-						longBuffer.clear();
-					}
+				if (packetRead && from != buffer) {
+					memmove(buffer, from, packetRead);
 				}
+				continue;
 			}
-		} else if (bytes < 0) {
+		}
+		if (bytes < 0) {
 			LOG(("TCP Error: socket read return -1"));
 			emit error(kErrorCodeOther);
 			return;
-		} else {
-			TCP_LOG(("TCP Info: no bytes read, but bytes available was true..."));
-			break;
 		}
+		TCP_LOG(("TCP Info: no bytes read, but bytes available was true..."));
+		break;
 	} while (sock.state() == QAbstractSocket::ConnectedState && sock.bytesAvailable());
 }
 
@@ -221,6 +223,7 @@ TCPConnection::TCPConnection(QThread *thread) : AbstractTCPConnection(thread)
 }
 
 void TCPConnection::onSocketConnected() {
+	setupSocketOptions();
 	if (status == WaitingTcp) {
 		mtpBuffer buffer(preparePQFake(tcpNonce));
 
@@ -299,9 +302,9 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		// write protocol identifier
 		*reinterpret_cast<uint32*>(nonce + 56) = 0xefefefefU;
 
-		sock.write(nonce, 56);
+		_sendBuffer.append(nonce, 56);
 		aesCtrEncrypt(nonce, 64, _sendKey, &_sendState);
-		sock.write(nonce + 56, 8);
+		_sendBuffer.append(nonce + 56, 8);
 	}
 	++packetNum;
 
@@ -312,7 +315,7 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		TCP_LOG(("TCP Info: write %1 packet %2").arg(packetNum).arg(len + 1));
 
 		aesCtrEncrypt(data + 7, len + 1, _sendKey, &_sendState);
-		sock.write(data + 7, len + 1);
+		tcpWrite(data + 7, len + 1);
 	} else {
 		data[4] = 0x7f;
 		reinterpret_cast<uchar*>(data)[5] = uchar(size & 0xFF);
@@ -321,7 +324,48 @@ void AbstractTCPConnection::tcpSend(mtpBuffer &buffer) {
 		TCP_LOG(("TCP Info: write %1 packet %2").arg(packetNum).arg(len + 4));
 
 		aesCtrEncrypt(data + 4, len + 4, _sendKey, &_sendState);
-		sock.write(data + 4, len + 4);
+		tcpWrite(data + 4, len + 4);
+	}
+}
+
+void AbstractTCPConnection::tcpWrite(const char *data, int size) {
+	if (_bulkTransfer || size >= kCoalescePacketMaxSize) {
+		// The queued packets were encrypted earlier, they go first.
+		sendQueued();
+		if (sock.state() == QAbstractSocket::ConnectedState) {
+			TCP_LOG(("TCP Info: write %1 bytes").arg(size));
+			sock.write(data, size);
+		}
+		return;
+	}
+	_sendBuffer.append(data, size);
+	if (_sendBuffer.size() >= kSendBufferReserve) {
+		// Don't let the buffer grow above the reserved size.
+		sendQueued();
+	} else if (!_sendQueued) {
+		_sendQueued = true;
+		QMetaObject::invokeMethod(this, "sendQueued", Qt::QueuedConnection);
+	}
+}
+
+void AbstractTCPConnection::sendQueued() {
+	_sendQueued = false;
+	if (_sendBuffer.isEmpty()) {
+		return;
+	}
+	if (sock.state() == QAbstractSocket::ConnectedState) {
+		TCP_LOG(("TCP Info: write %1 bytes").arg(_sendBuffer.size()));
+		sock.write(_sendBuffer);
+	}
+	_sendBuffer.resize(0);
+}
+
+void AbstractTCPConnection::setupSocketOptions() {
+	if (_bulkTransfer) {
+		sock.setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, kBulkSocketBufferSize);
+		sock.setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, kBulkSocketBufferSize);
+	} else {
+		sock.setSocketOption(QAbstractSocket::LowDelayOption, 1);
 	}
 }
 
@@ -342,14 +386,13 @@ void TCPConnection::connectTcp(const DcOptions::Endpoint &endpoint) {
 	sock.connectToHost(QHostAddress(_addr), _port);
 }
 
-void TCPConnection::socketPacket(const char *packet, uint32 length) {
+void TCPConnection::socketPacket(mtpBuffer &&data) {
 	if (status == FinishedWork) return;
 
-	mtpBuffer data = handleResponse(packet, length);
 	if (data.size() == 1) {
 		emit error(data[0]);
 	} else if (status == UsingTcp) {
-		_receivedQueue.push_back(data);
+		_receivedQueue.push_back(std::move(data));
 		emit receivedData();
 	} else if (status == WaitingTcp) {
 		tcpTimeoutTimer.stop();
@@ -37,18 +37,20 @@ public:
 public slots:
 
 	void socketRead();
+	void sendQueued();
 
 protected:
 
 	QTcpSocket sock;
 	uint32 packetNum; // sent packet number
 
-	uint32 packetRead, packetLeft; // reading from socket
-	bool readingToShort;
-	char *currentPos;
+	// Small packets and packet headers are read to shortBuffer, while the
+	// payload of a long packet is read and decrypted directly in longBuffer.
+	uint32 packetRead; // bytes in shortBuffer
+	uint32 longPacketRead, longPacketLeft; // bytes of longBuffer
 	mtpBuffer longBuffer;
 	mtpPrime shortBuffer[MTPShortBufferSize];
-	virtual void socketPacket(const char *packet, uint32 length) = 0;
+	virtual void socketPacket(mtpBuffer &&data) = 0;
 
 	static mtpBuffer handleResponse(const char *packet, uint32 length);
 	static void handleError(QAbstractSocket::SocketError e, QTcpSocket &sock);
@@ -57,7 +59,14 @@ protected:
 		return *reinterpret_cast<uint32*>(ch);
 	}
 
+	// Small packets are encrypted to _sendBuffer and written together once
+	// per event loop iteration, large ones and bulk transfers are written
+	// right away.
 	void tcpSend(mtpBuffer &buffer);
+	void tcpWrite(const char *data, int size);
+	void setupSocketOptions();
+	QByteArray _sendBuffer;
+	bool _sendQueued = false;
 	uchar _sendKey[CTRState::KeySize];
 	CTRState _sendState;
 	uchar _receiveKey[CTRState::KeySize];
@@ -94,7 +103,7 @@ public slots:
 
 protected:
 
-	void socketPacket(const char *packet, uint32 length) override;
+	void socketPacket(mtpBuffer &&data) override;
 
 private:
 
@@ -22,6 +22,187 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "zlib.h"
 
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+namespace {
+
+constexpr auto kRequestPoolClassesCount = 8;
+constexpr auto kRequestPoolMinCapacity = 16; // primes, each next class is 4 times larger
+constexpr auto kRequestPoolMaxPerClass = 16;
+constexpr auto kRequestPoolMaxBytes = 8 * 1024 * 1024;
+
+struct RequestPool {
+	QMutex mutex;
+	std::vector<mtpRequestData*> free[kRequestPoolClassesCount];
+	mtpRequestData::PoolStats stats;
+};
+
+RequestPool &Pool() {
+	// Never destroyed, requests may be released after static destructors.
+	static auto result = new RequestPool();
+	return *result;
+}
+
+int RequestPoolClassCapacity(int index) {
+	return kRequestPoolMinCapacity << (2 * index);
+}
+
+// Smallest class that surely fits the capacity, or -1.
+int RequestPoolClassToTake(int capacity) {
+	for (auto i = 0; i != kRequestPoolClassesCount; ++i) {
+		if (RequestPoolClassCapacity(i) >= capacity) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// Largest class with capacity not exceeding the given one, or -1.
+int RequestPoolClassToReturn(int capacity) {
+	for (auto i = kRequestPoolClassesCount; i != 0; --i) {
+		if (RequestPoolClassCapacity(i - 1) <= capacity) {
+			return i - 1;
+		}
+	}
+	return -1;
+}
+
+constexpr auto kTypeDataArenaBlockSize = 16 * 1024;
+constexpr auto kTypeDataArenaMaxObjectSize = 1024; // larger ones use the heap
+
+// Each TypeData allocation is prefixed with the arena block it came from.
+constexpr auto kTypeDataHeaderSize = alignof(std::max_align_t) > sizeof(void*)
+	? alignof(std::max_align_t)
+	: sizeof(void*);
+
+// thread_local is not supported by the older OS X toolchain.
+struct CurrentArenaHolder {
+	MTP::internal::TypeDataArena *arena = nullptr;
+};
+QThreadStorage<CurrentArenaHolder> CurrentArena;
+
+} // namespace
+
+namespace MTP {
+namespace internal {
+
+// Freed when the arena has moved to the next block and all its data is
+// destroyed, so a long-lived object keeps only its own block alive.
+class TypeDataArenaBlock {
+public:
+	static TypeDataArenaBlock *Create() {
+		auto memory = ::operator new(kTypeDataHeaderSize + kTypeDataArenaBlockSize);
+		return new (memory) TypeDataArenaBlock();
+	}
+
+	char *data() {
+		return reinterpret_cast<char*>(this) + kTypeDataHeaderSize;
+	}
+
+	void ref() {
+		_refs.fetch_add(1, std::memory_order_relaxed);
+	}
+	void unref() {
+		if (_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			this->~TypeDataArenaBlock();
+			::operator delete(this);
+		}
+	}
+
+private:
+	TypeDataArenaBlock() = default;
+
+	// One for the arena while it allocates here and one for each data.
+	std::atomic<int> _refs = { 1 };
+
+};
+
+static_assert(sizeof(TypeDataArenaBlock) <= kTypeDataHeaderSize, "Arena block header is too large.");
+
+class TypeDataArena {
+public:
+	void *allocate(std::size_t size, TypeDataArenaBlock **block) {
+		size = (size + kTypeDataHeaderSize - 1) & ~(kTypeDataHeaderSize - 1);
+		if (!_block || _offset + size > kTypeDataArenaBlockSize) {
+			if (_block) {
+				_block->unref();
+			}
+			_block = TypeDataArenaBlock::Create();
+			_offset = 0;
+		}
+		auto result = _block->data() + _offset;
+		_offset += size;
+		_block->ref();
+		*block = _block;
+		return result;
+	}
+
+	~TypeDataArena() {
+		if (_block) {
+			_block->unref();
+		}
+	}
+
+private:
+	TypeDataArenaBlock *_block = nullptr;
+	std::size_t _offset = 0;
+
+};
+
+TypeDataArenaScope::TypeDataArenaScope() {
+	auto &current = CurrentArena.localData();
+	if (!current.arena) {
+		_arena = current.arena = new TypeDataArena();
+	}
+}
+
+TypeDataArenaScope::~TypeDataArenaScope() {
+	if (_arena) {
+		CurrentArena.localData().arena = nullptr;
+		delete _arena;
+	}
+}
+
+void *TypeData::operator new(std::size_t size) {
+	auto result = static_cast<char*>(::operator new(kTypeDataHeaderSize + size));
+	*reinterpret_cast<TypeDataArenaBlock**>(result) = nullptr;
+	return result + kTypeDataHeaderSize;
+}
+
+void *TypeData::operator new(std::size_t size, ReadAllocation) {
+	auto arena = (size <= kTypeDataArenaMaxObjectSize && CurrentArena.hasLocalData())
+		? CurrentArena.localData().arena
+		: nullptr;
+	if (!arena) {
+		return TypeData::operator new(size);
+	}
+	auto block = static_cast<TypeDataArenaBlock*>(nullptr);
+	auto result = static_cast<char*>(arena->allocate(kTypeDataHeaderSize + size, &block));
+	*reinterpret_cast<TypeDataArenaBlock**>(result) = block;
+	return result + kTypeDataHeaderSize;
+}
+
+void TypeData::operator delete(void *pointer) {
+	if (!pointer) {
+		return;
+	}
+	auto allocation = static_cast<char*>(pointer) - kTypeDataHeaderSize;
+	if (auto block = *reinterpret_cast<TypeDataArenaBlock**>(allocation)) {
+		block->unref();
+	} else {
+		::operator delete(allocation);
+	}
+}
+
+void TypeData::operator delete(void *pointer, ReadAllocation) {
+	TypeData::operator delete(pointer);
+}
+
+} // namespace internal
+} // namespace MTP
+
 uint32 MTPstring::innerLength() const {
 	uint32 l = v.length();
 	if (l < 254) {
@@ -54,6 +235,21 @@ void MTPstring::read(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons)
 	v = QByteArray(reinterpret_cast<const char*>(buf), l);
 }
 
+void MTPstring::skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons) {
+	if (from + 1 > end) throw mtpErrorInsufficient();
+	if (cons != mtpc_string) throw mtpErrorUnexpected(cons, "MTPstring");
+
+	auto buf = reinterpret_cast<const uchar*>(from);
+	if (buf[0] == 254) {
+		auto l = (uint32)buf[1] + ((uint32)buf[2] << 8) + ((uint32)buf[3] << 16);
+		from += ((l + 4) >> 2) + (((l + 4) & 0x03) ? 1 : 0);
+	} else {
+		auto l = (uint32)buf[0];
+		from += ((l + 1) >> 2) + (((l + 1) & 0x03) ? 1 : 0);
+	}
+	if (from > end) throw mtpErrorInsufficient();
+}
+
 void MTPstring::write(mtpBuffer &to) const {
 	uint32 l = v.length(), s = l + ((l < 254) ? 1 : 4), was = to.size();
 	if (s & 0x03) {
@@ -74,6 +270,10 @@ void MTPstring::write(mtpBuffer &to) const {
 	memcpy(buf, v.constData(), l);
 }
 
+mtpRequest::mtpRequest(mtpRequestData *ptr)
+: QSharedPointer<mtpRequestData>(ptr, &mtpRequestData::poolReturn) {
+}
+
 uint32 mtpRequest::innerLength() const { // for template MTP requests and MTPBoxed instanciation
 	mtpRequestData *value = data();
 	if (!value || value->size() < 9) return 0;
@@ -115,13 +315,66 @@ bool mtpRequestData::needAckByType(mtpTypeId type) {
 
 mtpRequest mtpRequestData::prepare(uint32 requestSize, uint32 maxSize) {
 	if (!maxSize) maxSize = requestSize;
-	mtpRequest result(new mtpRequestData(true));
-	result->reserve(8 + maxSize + _padding(maxSize)); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	auto capacity = 8 + maxSize + _padding(maxSize); // 2: salt, 2: session_id, 2: msg_id, 1: seq_no, 1: message_length
+	mtpRequest result(poolTake(capacity));
+	result->reserve(capacity);
 	result->resize(7);
 	result->push_back(requestSize << 2);
 	return result;
 }
 
+mtpRequestData::PoolStats mtpRequestData::poolStats() {
+	auto &pool = Pool();
+	QMutexLocker lock(&pool.mutex);
+	return pool.stats;
+}
+
+mtpRequestData *mtpRequestData::poolTake(uint32 capacity) {
+	auto index = RequestPoolClassToTake(capacity);
+	if (index >= 0) {
+		auto &pool = Pool();
+		QMutexLocker lock(&pool.mutex);
+		auto &list = pool.free[index];
+		if (!list.empty()) {
+			auto result = list.back();
+			list.pop_back();
+			pool.stats.pooledBytes -= result->capacity() * sizeof(mtpPrime);
+			++pool.stats.hits;
+			return result;
+		}
+		++pool.stats.misses;
+	}
+	return new mtpRequestData(true);
+}
+
+void mtpRequestData::poolReturn(mtpRequestData *request) {
+	auto index = RequestPoolClassToReturn(request->capacity());
+	if (index >= 0) {
+		// Release the dependency before locking, it may return to the pool too.
+		request->after = mtpRequest();
+		request->msDate = 0;
+		request->requestId = 0;
+		request->needsLayer = false;
+
+		// resize(0) keeps the allocated capacity.
+		request->resize(0);
+
+		auto bytes = uint32(request->capacity() * sizeof(mtpPrime));
+		auto &pool = Pool();
+		QMutexLocker lock(&pool.mutex);
+		auto &list = pool.free[index];
+		if (int(list.size()) < kRequestPoolMaxPerClass
+			&& pool.stats.pooledBytes + bytes <= kRequestPoolMaxBytes) {
+			list.push_back(request);
+			pool.stats.pooledBytes += bytes;
+			++pool.stats.returned;
+			return;
+		}
+		++pool.stats.dropped;
+	}
+	delete request;
+}
+
 void mtpRequestData::padding(mtpRequest &request) {
 	if (request->size() < 9) return;
 
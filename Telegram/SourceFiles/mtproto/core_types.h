@@ -44,8 +44,7 @@ class mtpRequestData;
 class mtpRequest : public QSharedPointer<mtpRequestData> {
 public:
 	mtpRequest() = default;
-    explicit mtpRequest(mtpRequestData *ptr) : QSharedPointer<mtpRequestData>(ptr) {
-	}
+	explicit mtpRequest(mtpRequestData *ptr);
 
 	uint32 innerLength() const;
 	void write(mtpBuffer &to) const;
@@ -70,6 +69,16 @@ public:
 	static mtpRequest prepare(uint32 requestSize, uint32 maxSize = 0);
 	static void padding(mtpRequest &request);
 
+	// Prepared requests are recycled through a pool of size classes.
+	struct PoolStats {
+		uint64 hits = 0;
+		uint64 misses = 0;
+		uint64 returned = 0;
+		uint64 dropped = 0;
+		uint32 pooledBytes = 0;
+	};
+	static PoolStats poolStats();
+
 	static uint32 messageSize(const mtpRequest &request) {
 		if (request->size() < 9) return 0;
 		return 4 + (request.innerLength() >> 2); // 2: msg_id, 1: seq_no, q: message_length
@@ -85,6 +94,10 @@ public:
 
 private:
 	static uint32 _padding(uint32 requestSize);
+	static mtpRequestData *poolTake(uint32 capacity);
+	static void poolReturn(mtpRequestData *request);
+
+	friend class mtpRequest;
 
 };
 
@@ -130,6 +143,26 @@ public:
 namespace MTP {
 namespace internal {
 
+// Tag for the data allocated while reading it from a received buffer.
+struct ReadAllocation {
+};
+
+class TypeDataArena;
+
+// While it is alive the data read on this thread is bump-allocated in one
+// arena, each arena block is freed when all the data in it is destroyed.
+class TypeDataArenaScope {
+public:
+	TypeDataArenaScope();
+	TypeDataArenaScope(const TypeDataArenaScope &other) = delete;
+	TypeDataArenaScope &operator=(const TypeDataArenaScope &other) = delete;
+	~TypeDataArenaScope();
+
+private:
+	TypeDataArena *_arena = nullptr;
+
+};
+
 class TypeData {
 public:
 	TypeData() = default;
@@ -141,6 +174,11 @@ public:
 	virtual ~TypeData() {
 	}
 
+	static void *operator new(std::size_t size);
+	static void *operator new(std::size_t size, ReadAllocation);
+	static void operator delete(void *pointer);
+	static void operator delete(void *pointer, ReadAllocation);
+
 private:
 	void incrementCounter() const {
 		_counter.ref();
@@ -329,6 +367,11 @@ public:
 		if (cons != mtpc_int) throw mtpErrorUnexpected(cons, "MTPint");
 		v = (int32)*(from++);
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_int) {
+		if (from + 1 > end) throw mtpErrorInsufficient();
+		if (cons != mtpc_int) throw mtpErrorUnexpected(cons, "MTPint");
+		++from;
+	}
 	void write(mtpBuffer &to) const {
 		to.push_back((mtpPrime)v);
 	}
@@ -372,6 +415,11 @@ public:
 		if (cons != mtpc_flags) throw mtpErrorUnexpected(cons, "MTPflags");
 		v = static_cast<Flags>(*(from++));
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_flags) {
+		if (from + 1 > end) throw mtpErrorInsufficient();
+		if (cons != mtpc_flags) throw mtpErrorUnexpected(cons, "MTPflags");
+		++from;
+	}
 	void write(mtpBuffer &to) const {
 		to.push_back(static_cast<mtpPrime>(v));
 	}
@@ -430,6 +478,11 @@ public:
 		v = (uint64)(((uint32*)from)[0]) | ((uint64)(((uint32*)from)[1]) << 32);
 		from += 2;
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_long) {
+		if (from + 2 > end) throw mtpErrorInsufficient();
+		if (cons != mtpc_long) throw mtpErrorUnexpected(cons, "MTPlong");
+		from += 2;
+	}
 	void write(mtpBuffer &to) const {
 		to.push_back((mtpPrime)(v & 0xFFFFFFFFL));
 		to.push_back((mtpPrime)(v >> 32));
@@ -473,6 +526,11 @@ public:
 		h = (uint64)(((uint32*)from)[2]) | ((uint64)(((uint32*)from)[3]) << 32);
 		from += 4;
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_int128) {
+		if (from + 4 > end) throw mtpErrorInsufficient();
+		if (cons != mtpc_int128) throw mtpErrorUnexpected(cons, "MTPint128");
+		from += 4;
+	}
 	void write(mtpBuffer &to) const {
 		to.push_back((mtpPrime)(l & 0xFFFFFFFFL));
 		to.push_back((mtpPrime)(l >> 32));
@@ -516,6 +574,11 @@ public:
 		l.read(from, end);
 		h.read(from, end);
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_int256) {
+		if (cons != mtpc_int256) throw mtpErrorUnexpected(cons, "MTPint256");
+		MTPint128::skip(from, end);
+		MTPint128::skip(from, end);
+	}
 	void write(mtpBuffer &to) const {
 		l.write(to);
 		h.write(to);
@@ -557,6 +620,11 @@ public:
 		*(uint64*)(&v) = (uint64)(((uint32*)from)[0]) | ((uint64)(((uint32*)from)[1]) << 32);
 		from += 2;
 	}
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_double) {
+		if (from + 2 > end) throw mtpErrorInsufficient();
+		if (cons != mtpc_double) throw mtpErrorUnexpected(cons, "MTPdouble");
+		from += 2;
+	}
 	void write(mtpBuffer &to) const {
 		uint64 iv = *(uint64*)(&v);
 		to.push_back((mtpPrime)(iv & 0xFFFFFFFFL));
@@ -593,6 +661,7 @@ public:
 		return mtpc_string;
 	}
 	void read(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_string);
+	static void skip(const mtpPrime *&from, const mtpPrime *end, mtpTypeId cons = mtpc_string);
 	void write(mtpBuffer &to) const;
 
 	QByteArray v;
@@ -732,6 +801,7 @@ inline MTPvector<T> MTP_vector(QVector<T> &&v) {
 template <typename T>
 using MTPVector = MTPBoxed<MTPvector<T>>;
 
+
 template <typename T>
 inline bool operator==(const MTPvector<T> &a, const MTPvector<T> &b) {
 	return a.c_vector().v == b.c_vector().v;
@@ -23,6 +23,13 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "storage/serialize_common.h"
 
 namespace MTP {
+namespace {
+
+// After that time both address types are raced again on reconnect,
+// so that a network change or a recovered IPv4 route is noticed.
+constexpr auto kLastGoodAddressTimeout = TimeMs(30 * 60 * 1000);
+
+} // namespace
 
 class DcOptions::WriteLocker {
 public:
@@ -359,6 +366,32 @@ DcType DcOptions::dcType(ShiftedDcId shiftedDcId) const {
 	return DcType::Regular;
 }
 
+void DcOptions::setLastGoodAddress(DcId dcId, DcType type, int address) {
+	QMutexLocker lock(&_lastGoodAddressMutex);
+	auto &good = _lastGoodAddress[std::make_pair(dcId, type)];
+	if (good.address != address) {
+		good.address = address;
+		good.checked = getms(true);
+	}
+}
+
+void DcOptions::resetLastGoodAddress(DcId dcId, DcType type) {
+	QMutexLocker lock(&_lastGoodAddressMutex);
+	_lastGoodAddress.erase(std::make_pair(dcId, type));
+}
+
+int DcOptions::lastGoodAddress(DcId dcId, DcType type) const {
+	QMutexLocker lock(&_lastGoodAddressMutex);
+	auto i = _lastGoodAddress.find(std::make_pair(dcId, type));
+	if (i == _lastGoodAddress.cend()) {
+		return -1;
+	} else if (getms(true) >= i->second.checked + kLastGoodAddressTimeout) {
+		_lastGoodAddress.erase(i);
+		return -1;
+	}
+	return i->second.address;
+}
+
 void DcOptions::setCDNConfig(const MTPDcdnConfig &config) {
 	WriteLocker lock(this);
 	_cdnPublicKeys.clear();
@@ -73,6 +73,13 @@ public:
 	Variants lookup(DcId dcId, DcType type) const;
 	DcType dcType(ShiftedDcId shiftedDcId) const;
 
+	// Address type (Variants::IPv4 or Variants::IPv6) that connected
+	// to this dc last time, so that we don't wait for the other one.
+	// It expires in half an hour and both types are probed again.
+	void setLastGoodAddress(DcId dcId, DcType type, int address);
+	void resetLastGoodAddress(DcId dcId, DcType type);
+	int lastGoodAddress(DcId dcId, DcType type) const; // -1 if unknown
+
 	void setCDNConfig(const MTPDcdnConfig &config);
 	bool hasCDNKeysForDc(DcId dcId) const;
 	bool getDcRSAKey(DcId dcId, const QVector<MTPlong> &fingerprints, internal::RSAPublicKey *result) const;
@@ -110,6 +117,13 @@ private:
 	std::map<DcId, std::map<uint64, internal::RSAPublicKey>> _cdnPublicKeys;
 	mutable QReadWriteLock _useThroughLockers;
 
+	struct GoodAddress {
+		int address = -1;
+		TimeMs checked = 0;
+	};
+	mutable std::map<std::pair<DcId, DcType>, GoodAddress> _lastGoodAddress;
+	mutable QMutex _lastGoodAddressMutex;
+
 	mutable base::Observable<Ids> _changed;
 
 	// True when we have overriden options from a .tdesktop-endpoints file.
@@ -35,6 +35,7 @@ void unpause();
 constexpr auto kDcShift = ShiftedDcId(10000);
 constexpr auto kConfigDcShift = 0x01;
 constexpr auto kLogoutDcShift = 0x02;
+constexpr auto kBackgroundDcShift = 0x03;
 constexpr auto kMaxMediaDcCount = 0x10;
 constexpr auto kBaseDownloadDcShift = 0x10;
 constexpr auto kBaseUploadDcShift = 0x20;
@@ -86,8 +87,19 @@ constexpr ShiftedDcId logoutDcId(DcId dcId) {
 	return shiftDcId(dcId, internal::kLogoutDcShift);
 }
 
-constexpr auto kDownloadSessionsCount = 2;
-constexpr auto kUploadSessionsCount = 2;
+// send(req, callbacks, MTP::backgroundDcId(dc)) - for bulk requests, like
+// history preloading, so that they don't hold the interactive ones
+// in the same connection, dc == 0 means the main dc
+constexpr ShiftedDcId backgroundDcId(DcId dcId) {
+	return shiftDcId(dcId, internal::kBackgroundDcShift);
+}
+
+constexpr bool isBackgroundDcId(ShiftedDcId shiftedDcId) {
+	return (getDcIdShift(shiftedDcId) == internal::kBackgroundDcShift);
+}
+
+constexpr auto kDownloadSessionsCount = 4;
+constexpr auto kUploadSessionsCount = 4;
 
 namespace internal {
 
@@ -0,0 +1,164 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "mtproto/metrics.h"
+
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+
+namespace MTP {
+namespace Metrics {
+namespace {
+
+QMutex DataMutex;
+std::map<ShiftedDcId, Dc> Data;
+
+template <typename Method>
+void Update(ShiftedDcId shiftedDcId, Method method) {
+	QMutexLocker lock(&DataMutex);
+	method(Data[shiftedDcId]);
+}
+
+} // namespace
+
+namespace internal {
+
+std::atomic<bool> EnabledFlag = { false };
+
+void AddSent(ShiftedDcId shiftedDcId, int bytes) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		dc.bytesSent += bytes;
+	});
+}
+
+void AddReceived(ShiftedDcId shiftedDcId, int count, int bytes, int64 decryptTime) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		dc.bytesReceived += bytes;
+		dc.decrypted += count;
+		dc.decryptTime += decryptTime;
+	});
+}
+
+void AddRtt(ShiftedDcId shiftedDcId, TimeMs rtt) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		// The same smoothing as the TCP one, new sample weights 1/8.
+		dc.smoothedRtt = dc.smoothedRtt ? ((7 * dc.smoothedRtt + rtt) / 8) : rtt;
+	});
+}
+
+void AddResent(ShiftedDcId shiftedDcId) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		++dc.resent;
+	});
+}
+
+void AddContainer(ShiftedDcId shiftedDcId, int messages, int bytes) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		++dc.containers;
+		dc.containerMessages += messages;
+		dc.containerBytes += bytes;
+	});
+}
+
+void SetQueueDepth(ShiftedDcId shiftedDcId, int depth) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		dc.queueDepth = depth;
+	});
+}
+
+void AddReceiveBatch(ShiftedDcId shiftedDcId, TimeMs latency) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		++dc.receiveBatches;
+		dc.receiveLatency = dc.receiveLatency ? ((7 * dc.receiveLatency + latency) / 8) : latency;
+		accumulate_max(dc.receiveLatencyMax, latency);
+	});
+}
+
+void AddGzipped(ShiftedDcId shiftedDcId, int bytesBefore, int bytesAfter) {
+	Update(shiftedDcId, [&](Dc &dc) {
+		if (!bytesAfter) {
+			++dc.gzipNotSmaller;
+			return;
+		}
+		++dc.gzipPacked;
+		dc.gzipBytesBefore += bytesBefore;
+		dc.gzipBytesAfter += bytesAfter;
+	});
+}
+
+} // namespace internal
+
+void SetEnabled(bool enabled) {
+	internal::EnabledFlag.store(enabled, std::memory_order_relaxed);
+	if (!enabled) {
+		QMutexLocker lock(&DataMutex);
+		Data.clear();
+	}
+}
+
+std::map<ShiftedDcId, Dc> Snapshot() {
+	QMutexLocker lock(&DataMutex);
+	return Data;
+}
+
+QString ToText() {
+	auto data = Snapshot();
+	if (data.empty()) {
+		return qsl("No MTProto metrics collected yet.");
+	}
+	auto result = QStringList();
+	for (auto &item : data) {
+		auto &dc = item.second;
+		result.push_back(qsl("DC %1: rtt %2 ms, sent %3 KB, received %4 KB, resent %5, containers %6 (%7 messages, %8 KB), decrypted %9 in %10 mcs, queue %11").arg(item.first).arg(dc.smoothedRtt).arg(dc.bytesSent / 1024).arg(dc.bytesReceived / 1024).arg(dc.resent).arg(dc.containers).arg(dc.containerMessages).arg(dc.containerBytes / 1024).arg(dc.decrypted).arg(dc.decryptTime).arg(dc.queueDepth)
+			+ qsl(", receive batches %1 (latency %2 ms, max %3 ms)").arg(dc.receiveBatches).arg(dc.receiveLatency).arg(dc.receiveLatencyMax)
+			+ qsl(", gzipped %1 (%2 KB to %3 KB, %4 not smaller)").arg(dc.gzipPacked).arg(dc.gzipBytesBefore / 1024).arg(dc.gzipBytesAfter / 1024).arg(dc.gzipNotSmaller));
+	}
+	return result.join('\n');
+}
+
+QByteArray ToJson() {
+	auto result = QJsonObject();
+	for (auto &item : Snapshot()) {
+		auto &dc = item.second;
+		auto object = QJsonObject();
+		object.insert(qsl("rtt"), double(dc.smoothedRtt));
+		object.insert(qsl("bytes_sent"), double(dc.bytesSent));
+		object.insert(qsl("bytes_received"), double(dc.bytesReceived));
+		object.insert(qsl("resent"), double(dc.resent));
+		object.insert(qsl("containers"), double(dc.containers));
+		object.insert(qsl("container_messages"), double(dc.containerMessages));
+		object.insert(qsl("container_bytes"), double(dc.containerBytes));
+		object.insert(qsl("decrypted"), double(dc.decrypted));
+		object.insert(qsl("decrypt_time"), double(dc.decryptTime));
+		object.insert(qsl("queue_depth"), dc.queueDepth);
+		object.insert(qsl("receive_batches"), double(dc.receiveBatches));
+		object.insert(qsl("receive_latency"), double(dc.receiveLatency));
+		object.insert(qsl("receive_latency_max"), double(dc.receiveLatencyMax));
+		object.insert(qsl("gzip_packed"), double(dc.gzipPacked));
+		object.insert(qsl("gzip_not_smaller"), double(dc.gzipNotSmaller));
+		object.insert(qsl("gzip_bytes_before"), double(dc.gzipBytesBefore));
+		object.insert(qsl("gzip_bytes_after"), double(dc.gzipBytesAfter));
+		result.insert(QString::number(item.first), object);
+	}
+	return QJsonDocument(result).toJson(QJsonDocument::Indented);
+}
+
+} // namespace Metrics
+} // namespace MTP
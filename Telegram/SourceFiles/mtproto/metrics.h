@@ -0,0 +1,102 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+#include <atomic>
+
+namespace MTP {
+namespace Metrics {
+
+// Transport counters of one session, collected only while enabled.
+struct Dc {
+	TimeMs smoothedRtt = 0; // ping round trip in ms, zero if unknown
+	uint64 bytesSent = 0;
+	uint64 bytesReceived = 0;
+	uint64 resent = 0;
+	uint64 containers = 0;
+	uint64 containerMessages = 0;
+	uint64 containerBytes = 0;
+	uint64 decrypted = 0;
+	uint64 decryptTime = 0; // in microseconds, sum for all the decrypted messages
+	int queueDepth = 0; // requests waiting in toSend at the last send
+	uint64 receiveBatches = 0; // main thread wakeups for received messages
+	TimeMs receiveLatency = 0; // smoothed wait until the main thread wakeup
+	TimeMs receiveLatencyMax = 0;
+	uint64 gzipPacked = 0; // requests sent as gzip_packed
+	uint64 gzipNotSmaller = 0; // tried, but packed data was not smaller
+	uint64 gzipBytesBefore = 0;
+	uint64 gzipBytesAfter = 0;
+};
+
+namespace internal {
+
+extern std::atomic<bool> EnabledFlag;
+
+void AddSent(ShiftedDcId shiftedDcId, int bytes);
+void AddReceived(ShiftedDcId shiftedDcId, int count, int bytes, int64 decryptTime);
+void AddRtt(ShiftedDcId shiftedDcId, TimeMs rtt);
+void AddResent(ShiftedDcId shiftedDcId);
+void AddContainer(ShiftedDcId shiftedDcId, int messages, int bytes);
+void SetQueueDepth(ShiftedDcId shiftedDcId, int depth);
+void AddReceiveBatch(ShiftedDcId shiftedDcId, TimeMs latency);
+void AddGzipped(ShiftedDcId shiftedDcId, int bytesBefore, int bytesAfter);
+
+} // namespace internal
+
+inline bool Enabled() {
+	return internal::EnabledFlag.load(std::memory_order_relaxed);
+}
+void SetEnabled(bool enabled);
+
+// All the Add* methods are a single check while disabled.
+inline void AddSent(ShiftedDcId shiftedDcId, int bytes) {
+	if (Enabled()) internal::AddSent(shiftedDcId, bytes);
+}
+inline void AddReceived(ShiftedDcId shiftedDcId, int count, int bytes, int64 decryptTime) {
+	if (Enabled()) internal::AddReceived(shiftedDcId, count, bytes, decryptTime);
+}
+inline void AddRtt(ShiftedDcId shiftedDcId, TimeMs rtt) {
+	if (Enabled()) internal::AddRtt(shiftedDcId, rtt);
+}
+inline void AddResent(ShiftedDcId shiftedDcId) {
+	if (Enabled()) internal::AddResent(shiftedDcId);
+}
+inline void AddContainer(ShiftedDcId shiftedDcId, int messages, int bytes) {
+	if (Enabled()) internal::AddContainer(shiftedDcId, messages, bytes);
+}
+inline void SetQueueDepth(ShiftedDcId shiftedDcId, int depth) {
+	if (Enabled()) internal::SetQueueDepth(shiftedDcId, depth);
+}
+inline void AddReceiveBatch(ShiftedDcId shiftedDcId, TimeMs latency) {
+	if (Enabled()) internal::AddReceiveBatch(shiftedDcId, latency);
+}
+
+// Zero bytesAfter means the packed request was not smaller and was sent as is.
+inline void AddGzipped(ShiftedDcId shiftedDcId, int bytesBefore, int bytesAfter) {
+	if (Enabled()) internal::AddGzipped(shiftedDcId, bytesBefore, bytesAfter);
+}
+
+std::map<ShiftedDcId, Dc> Snapshot();
+QString ToText();
+QByteArray ToJson();
+
+} // namespace Metrics
+} // namespace MTP
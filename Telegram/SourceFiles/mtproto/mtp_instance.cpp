@@ -33,6 +33,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "lang/lang_instance.h"
 #include "lang/lang_cloud_manager.h"
 #include "base/timer.h"
+#include "base/sequence_map.h"
 
 namespace MTP {
 
@@ -67,6 +68,7 @@ public:
 	void stopSession(ShiftedDcId shiftedDcId);
 	void reInitConnection(DcId dcId);
 	void logout(RPCDoneHandlerPtr onDone, RPCFailHandlerPtr onFail);
+	void prepareMediaDcs();
 
 	std::shared_ptr<internal::Dcenter> getDcById(ShiftedDcId shiftedDcId);
 	void unpaused();
@@ -81,7 +83,8 @@ public:
 	void clearCallbacks(mtpRequestId requestId, int32 errorCode = RPCError::NoError); // 0 - do not toggle onError callback
 	void clearCallbacksDelayed(const RPCCallbackClears &requestIds);
 	void performDelayedClear();
-	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	RPCPreparsedResponsePtr preparseResponse(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end, RPCPreparsedResponsePtr preparsed);
 	bool hasCallbacks(mtpRequestId requestId);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
@@ -121,6 +124,7 @@ public:
 
 private:
 	bool hasAuthorization();
+	void exportAuthorization(DcId dcId, ShiftedDcId dcWithShift);
 	void importDone(const MTPauth_Authorization &result, mtpRequestId requestId);
 	bool importFail(const RPCError &error, mtpRequestId requestId);
 	void exportDone(const MTPauth_ExportedAuthorization &result, mtpRequestId requestId);
@@ -160,26 +164,31 @@ private:
 	std::map<ShiftedDcId, mtpRequestId> _logoutGuestRequestIds;
 
 	// holds dcWithShift for request to this dc or -dc for request to main dc
-	std::map<mtpRequestId, ShiftedDcId> _requestsByDc;
+	base::sequence_map<mtpRequestId, ShiftedDcId> _requestsByDc;
 	QMutex _requestByDcLock;
 
 	// holds target dcWithShift for auth export request
 	std::map<mtpRequestId, ShiftedDcId> _authExportRequests;
 
-	std::map<mtpRequestId, RPCResponseHandler> _parserMap;
+	base::sequence_map<mtpRequestId, RPCResponseHandler> _parserMap;
+	base::sequence_map<mtpRequestId, RPCResponsePreparser> _preparserMap; // under _parserMapLock
 	QMutex _parserMapLock;
 
-	std::map<mtpRequestId, mtpRequest> _requestMap;
+	base::sequence_map<mtpRequestId, mtpRequest> _requestMap;
 	QReadWriteLock _requestMapLock;
 
 	std::deque<std::pair<mtpRequestId, TimeMs>> _delayedRequests;
 
-	std::map<mtpRequestId, int> _requestsDelays;
+	base::sequence_map<mtpRequestId, int> _requestsDelays;
 
 	std::set<mtpRequestId> _badGuestDcRequests;
 
 	std::map<DcId, std::vector<mtpRequestId>> _authWaiters;
 
+	// Dcs with auth export or import in progress, one for all sessions.
+	std::set<DcId> _authExportingDcs;
+	std::set<DcId> _preparingMediaDcs; // Their download sessions are killed after the import.
+
 	QMutex _toClearLock;
 	RPCCallbackClears _toClear;
 
@@ -372,20 +381,18 @@ void Instance::Private::cancel(mtpRequestId requestId) {
 	_requestsDelays.erase(requestId);
 	{
 		QWriteLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.end()) {
-			msgId = *(mtpMsgId*)(it->second->constData() + 4);
-			_requestMap.erase(it);
+		if (auto request = _requestMap.find(requestId)) {
+			msgId = *(mtpMsgId*)((*request)->constData() + 4);
+			_requestMap.erase(requestId);
 		}
 	}
 	{
 		QMutexLocker locker(&_requestByDcLock);
-		auto it = _requestsByDc.find(requestId);
-		if (it != _requestsByDc.end()) {
-			if (auto session = getSession(qAbs(it->second))) {
+		if (auto dcWithShift = _requestsByDc.find(requestId)) {
+			if (auto session = getSession(qAbs(*dcWithShift))) {
 				session->cancel(requestId, msgId);
 			}
-			_requestsByDc.erase(it);
+			_requestsByDc.erase(requestId);
 		}
 	}
 	clearCallbacks(requestId);
@@ -394,9 +401,8 @@ void Instance::Private::cancel(mtpRequestId requestId) {
 int32 Instance::Private::state(mtpRequestId requestId) { // < 0 means waiting for such count of ms
 	if (requestId > 0) {
 		QMutexLocker locker(&_requestByDcLock);
-		auto i = _requestsByDc.find(requestId);
-		if (i != _requestsByDc.end()) {
-			if (auto session = getSession(qAbs(i->second))) {
+		if (auto dcWithShift = _requestsByDc.find(requestId)) {
+			if (auto session = getSession(qAbs(*dcWithShift))) {
 				return session->requestState(requestId);
 			}
 			return MTP::RequestConnecting;
@@ -452,6 +458,30 @@ void Instance::Private::reInitConnection(DcId dcId) {
 	getSession(dcId)->notifyLayerInited(false);
 }
 
+void Instance::Private::prepareMediaDcs() {
+	if (!isNormal() || !hasAuthorization()) {
+		return;
+	}
+	const auto mainDc = mainDcId();
+	for (const auto dcId : _dcOptions->configEnumDcIds()) {
+		if (dcId == mainDc) {
+			continue;
+		}
+		{
+			QReadLocker lock(&_keysForWriteLock);
+			if (_keysForWrite.find(dcId) != _keysForWrite.cend()) {
+				continue;
+			}
+		}
+		DEBUG_LOG(("MTP Info: preparing auth in media dc %1").arg(dcId));
+
+		// The key is created by the first download session right away
+		// and shared with all the other sessions of this dc.
+		_preparingMediaDcs.emplace(dcId);
+		exportAuthorization(dcId, internal::downloadDcId(dcId, 0));
+	}
+}
+
 void Instance::Private::logout(RPCDoneHandlerPtr onDone, RPCFailHandlerPtr onFail) {
 	_instance->send(MTPauth_LogOut(), onDone, onFail);
 
@@ -640,9 +670,8 @@ void Instance::Private::checkDelayedRequests() {
 		auto dcWithShift = ShiftedDcId(0);
 		{
 			QMutexLocker locker(&_requestByDcLock);
-			auto it = _requestsByDc.find(requestId);
-			if (it != _requestsByDc.cend()) {
-				dcWithShift = it->second;
+			if (auto found = _requestsByDc.find(requestId)) {
+				dcWithShift = *found;
 			} else {
 				LOG(("MTP Error: could not find request dc for delayed resend, requestId %1").arg(requestId));
 				continue;
@@ -652,12 +681,12 @@ void Instance::Private::checkDelayedRequests() {
 		auto request = mtpRequest();
 		{
 			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
+			auto found = _requestMap.find(requestId);
+			if (!found) {
 				DEBUG_LOG(("MTP Error: could not find request %1").arg(requestId));
 				continue;
 			}
-			request = it->second;
+			request = *found;
 		}
 		if (auto session = getSession(qAbs(dcWithShift))) {
 			session->sendPrepared(request);
@@ -672,7 +701,7 @@ void Instance::Private::checkDelayedRequests() {
 void Instance::Private::registerRequest(mtpRequestId requestId, int32 dcWithShift) {
 	{
 		QMutexLocker locker(&_requestByDcLock);
-		_requestsByDc.emplace(requestId, dcWithShift);
+		_requestsByDc.insert(requestId, dcWithShift);
 	}
 	performDelayedClear(); // need to do it somewhere...
 }
@@ -685,6 +714,11 @@ void Instance::Private::unregisterRequest(mtpRequestId requestId) {
 		_requestMap.erase(requestId);
 	}
 
+	{
+		QMutexLocker locker(&_parserMapLock);
+		_preparserMap.erase(requestId);
+	}
+
 	QMutexLocker locker(&_requestByDcLock);
 	_requestsByDc.erase(requestId);
 }
@@ -694,11 +728,16 @@ mtpRequestId Instance::Private::storeRequest(mtpRequest &request, const RPCRespo
 	request->requestId = res;
 	if (parser.onDone || parser.onFail) {
 		QMutexLocker locker(&_parserMapLock);
-		_parserMap.emplace(res, parser);
+		_parserMap.insert(res, parser);
+		if (parser.onDone) {
+			if (auto preparser = parser.onDone->preparser()) {
+				_preparserMap.insert(res, preparser);
+			}
+		}
 	}
 	{
 		QWriteLocker locker(&_requestMapLock);
-		_requestMap.emplace(res, request);
+		_requestMap.insert(res, request);
 	}
 	return res;
 }
@@ -707,9 +746,8 @@ mtpRequest Instance::Private::getRequest(mtpRequestId requestId) {
 	auto result = mtpRequest();
 	{
 		QReadLocker locker(&_requestMapLock);
-		auto it = _requestMap.find(requestId);
-		if (it != _requestMap.cend()) {
-			result = it->second;
+		if (auto found = _requestMap.find(requestId)) {
+			result = *found;
 		}
 	}
 	return result;
@@ -721,12 +759,11 @@ void Instance::Private::clearCallbacks(mtpRequestId requestId, int32 errorCode)
 	bool found = false;
 	{
 		QMutexLocker locker(&_parserMapLock);
-		auto it = _parserMap.find(requestId);
-		if (it != _parserMap.end()) {
-			h = it->second;
+		if (auto parser = _parserMap.find(requestId)) {
+			h = *parser;
 			found = true;
 
-			_parserMap.erase(it);
+			_parserMap.erase(requestId);
 		}
 	}
 	if (errorCode && found) {
@@ -762,7 +799,7 @@ void Instance::Private::performDelayedClear() {
 		for (auto &clearRequest : _toClear) {
 			if (cDebug()) {
 				QMutexLocker locker(&_parserMapLock);
-				if (_parserMap.find(clearRequest.requestId) != _parserMap.end()) {
+				if (_parserMap.contains(clearRequest.requestId)) {
 					DEBUG_LOG(("RPC Info: clearing delayed callback %1, error code %2").arg(clearRequest.requestId).arg(clearRequest.errorCode));
 				}
 			}
@@ -773,14 +810,35 @@ void Instance::Private::performDelayedClear() {
 	}
 }
 
-void Instance::Private::execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
+RPCPreparsedResponsePtr Instance::Private::preparseResponse(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
+	if (from >= end || *from == mtpc_rpc_error) {
+		return nullptr;
+	}
+	auto preparser = RPCResponsePreparser(nullptr);
+	{
+		QMutexLocker locker(&_parserMapLock);
+		if (auto found = _preparserMap.find(requestId)) {
+			preparser = *found;
+		}
+	}
+	if (!preparser) {
+		return nullptr;
+	}
+	try {
+		return preparser(from, end);
+	} catch (Exception &) {
+		// The main thread will read it once again and report the error.
+	}
+	return nullptr;
+}
+
+void Instance::Private::execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end, RPCPreparsedResponsePtr preparsed) {
 	RPCResponseHandler h;
 	{
 		QMutexLocker locker(&_parserMapLock);
-		auto it = _parserMap.find(requestId);
-		if (it != _parserMap.cend()) {
-			h = it->second;
-			_parserMap.erase(it);
+		if (auto parser = _parserMap.find(requestId)) {
+			h = *parser;
+			_parserMap.erase(requestId);
 
 			DEBUG_LOG(("RPC Info: found parser for request %1, trying to parse response...").arg(requestId));
 		}
@@ -796,18 +854,19 @@ void Instance::Private::execCallback(mtpRequestId requestId, const mtpPrime *fro
 				DEBUG_LOG(("RPC Info: error received, code %1, type %2, description: %3").arg(error.code()).arg(error.type()).arg(error.description()));
 				if (!rpcErrorOccured(requestId, h, error)) {
 					QMutexLocker locker(&_parserMapLock);
-					_parserMap.emplace(requestId, h);
+					_parserMap.insert(requestId, h);
 					return;
 				}
 			} else {
 				if (h.onDone) {
+					internal::PreparsedResponseScope scope(preparsed.get());
 					(*h.onDone)(requestId, from, end);
 				}
 			}
 		} catch (Exception &e) {
 			if (!rpcErrorOccured(requestId, h, internal::rpcClientError("RESPONSE_PARSE_FAILED", QString("exception text: ") + e.what()))) {
 				QMutexLocker locker(&_parserMapLock);
-				_parserMap.emplace(requestId, h);
+				_parserMap.insert(requestId, h);
 				return;
 			}
 		}
@@ -819,8 +878,7 @@ void Instance::Private::execCallback(mtpRequestId requestId, const mtpPrime *fro
 
 bool Instance::Private::hasCallbacks(mtpRequestId requestId) {
 	QMutexLocker locker(&_parserMapLock);
-	auto it = _parserMap.find(requestId);
-	return (it != _parserMap.cend());
+	return _parserMap.contains(requestId);
 }
 
 void Instance::Private::globalCallback(const mtpPrime *from, const mtpPrime *end) {
@@ -830,6 +888,11 @@ void Instance::Private::globalCallback(const mtpPrime *from, const mtpPrime *end
 }
 
 void Instance::Private::onStateChange(int32 dcWithShift, int32 state) {
+	if (_configLoader
+		&& (state == DisconnectedState || state < 0)
+		&& bareDcId(dcWithShift) == _mainDcId) {
+		_configLoader->connectionFailed();
+	}
 	if (_stateChangedHandler) {
 		_stateChangedHandler(dcWithShift, state);
 	}
@@ -858,11 +921,23 @@ bool Instance::Private::hasAuthorization() {
 	return AuthSession::Exists();
 }
 
+void Instance::Private::exportAuthorization(DcId dcId, ShiftedDcId dcWithShift) {
+	if (!_authExportingDcs.emplace(dcId).second) {
+		return;
+	}
+	auto exportRequestId = _instance->send(MTPauth_ExportAuthorization(MTP_int(dcId)), rpcDone([this](const MTPauth_ExportedAuthorization &result, mtpRequestId requestId) {
+		exportDone(result, requestId);
+	}), rpcFail([this](const RPCError &error, mtpRequestId requestId) {
+		return exportFail(error, requestId);
+	}));
+	_authExportRequests.emplace(exportRequestId, dcWithShift);
+}
+
 void Instance::Private::importDone(const MTPauth_Authorization &result, mtpRequestId requestId) {
 	QMutexLocker locker1(&_requestByDcLock);
 
 	auto it = _requestsByDc.find(requestId);
-	if (it == _requestsByDc.end()) {
+	if (!it) {
 		LOG(("MTP Error: auth import request not found in requestsByDC, requestId: %1").arg(requestId));
 		RPCError error(internal::rpcClientError("AUTH_IMPORT_FAIL", QString("did not find import request in requestsByDC, request %1").arg(requestId)));
 		if (_globalHandler.onFail && hasAuthorization()) {
@@ -870,37 +945,42 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 		}
 		return;
 	}
-	auto newdc = bareDcId(it->second);
+	auto newdc = bareDcId(*it);
+	_authExportingDcs.erase(newdc);
 
 	DEBUG_LOG(("MTP Info: auth import to dc %1 succeeded").arg(newdc));
 
 	auto &waiters = _authWaiters[newdc];
+	if (_preparingMediaDcs.erase(newdc) && waiters.empty()) {
+		// Nothing is downloaded there yet, the key is kept for later.
+		Messenger::Instance().killDownloadSessionsStart(newdc);
+	}
 	if (waiters.size()) {
 		QReadLocker locker(&_requestMapLock);
 		for (auto waitedRequestId : waiters) {
 			auto it = _requestMap.find(waitedRequestId);
-			if (it == _requestMap.cend()) {
+			if (!it) {
 				LOG(("MTP Error: could not find request %1 for resending").arg(waitedRequestId));
 				continue;
 			}
 			auto dcWithShift = ShiftedDcId(newdc);
 			{
 				auto k = _requestsByDc.find(waitedRequestId);
-				if (k == _requestsByDc.cend()) {
+				if (!k) {
 					LOG(("MTP Error: could not find request %1 by dc for resending").arg(waitedRequestId));
 					continue;
 				}
-				if (k->second < 0) {
+				if (*k < 0) {
 					_instance->setMainDcId(newdc);
-					k->second = -newdc;
+					*k = -newdc;
 				} else {
-					dcWithShift = shiftDcId(newdc, getDcIdShift(k->second));
-					k->second = dcWithShift;
+					dcWithShift = shiftDcId(newdc, getDcIdShift(*k));
+					*k = dcWithShift;
 				}
-				DEBUG_LOG(("MTP Info: resending request %1 to dc %2 after import auth").arg(waitedRequestId).arg(k->second));
+				DEBUG_LOG(("MTP Info: resending request %1 to dc %2 after import auth").arg(waitedRequestId).arg(*k));
 			}
 			if (auto session = getSession(dcWithShift)) {
-				session->sendPrepared(it->second);
+				session->sendPrepared(*it);
 			}
 		}
 		waiters.clear();
@@ -910,6 +990,13 @@ void Instance::Private::importDone(const MTPauth_Authorization &result, mtpReque
 bool Instance::Private::importFail(const RPCError &error, mtpRequestId requestId) {
 	if (isDefaultHandledError(error)) return false;
 
+	{
+		QMutexLocker locker(&_requestByDcLock);
+		if (auto found = _requestsByDc.find(requestId)) {
+			_authExportingDcs.erase(bareDcId(*found));
+		}
+	}
+
 	if (_globalHandler.onFail && hasAuthorization()) {
 		(*_globalHandler.onFail)(requestId, error); // auth import failed
 	}
@@ -942,6 +1029,7 @@ bool Instance::Private::exportFail(const RPCError &error, mtpRequestId requestId
 	auto it = _authExportRequests.find(requestId);
 	if (it != _authExportRequests.cend()) {
 		_authWaiters[bareDcId(it->second)].clear();
+		_authExportingDcs.erase(bareDcId(it->second));
 	}
 	if (_globalHandler.onFail && hasAuthorization()) {
 		(*_globalHandler.onFail)(requestId, error); // auth failed in main dc
@@ -963,11 +1051,10 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		ShiftedDcId dcWithShift = 0, newdcWithShift = m.captured(2).toInt();
 		{
 			QMutexLocker locker(&_requestByDcLock);
-			auto it = _requestsByDc.find(requestId);
-			if (it == _requestsByDc.end()) {
-				LOG(("MTP Error: could not find request %1 for migrating to %2").arg(requestId).arg(newdcWithShift));
+			if (auto found = _requestsByDc.find(requestId)) {
+				dcWithShift = *found;
 			} else {
-				dcWithShift = it->second;
+				LOG(("MTP Error: could not find request %1 for migrating to %2").arg(requestId).arg(newdcWithShift));
 			}
 		}
 		if (!dcWithShift || !newdcWithShift) return false;
@@ -1001,12 +1088,12 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		auto request = mtpRequest();
 		{
 			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
+			auto found = _requestMap.find(requestId);
+			if (!found) {
 				LOG(("MTP Error: could not find request %1").arg(requestId));
 				return false;
 			}
-			request = it->second;
+			request = *found;
 		}
 		if (auto session = getSession(newdcWithShift)) {
 			registerRequest(requestId, (dcWithShift < 0) ? -newdcWithShift : newdcWithShift);
@@ -1018,11 +1105,10 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 
 		int32 secs = 1;
 		if (code < 0 || code >= 500) {
-			auto it = _requestsDelays.find(requestId);
-			if (it != _requestsDelays.cend()) {
-				secs = (it->second > 60) ? it->second : (it->second *= 2);
+			if (auto delay = _requestsDelays.find(requestId)) {
+				secs = (*delay > 60) ? *delay : (*delay *= 2);
 			} else {
-				_requestsDelays.emplace(requestId, secs);
+				_requestsDelays.insert(requestId, secs);
 			}
 		} else {
 			secs = m.captured(1).toInt();
@@ -1043,9 +1129,8 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		auto dcWithShift = ShiftedDcId(0);
 		{
 			QMutexLocker locker(&_requestByDcLock);
-			auto it = _requestsByDc.find(requestId);
-			if (it != _requestsByDc.end()) {
-				dcWithShift = it->second;
+			if (auto found = _requestsByDc.find(requestId)) {
+				dcWithShift = *found;
 			} else {
 				LOG(("MTP Error: unauthorized request without dc info, requestId %1").arg(requestId));
 			}
@@ -1059,37 +1144,28 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		}
 
 		DEBUG_LOG(("MTP Info: importing auth to dcWithShift %1").arg(dcWithShift));
-		auto &waiters(_authWaiters[newdc]);
-		if (!waiters.size()) {
-			auto exportRequestId = _instance->send(MTPauth_ExportAuthorization(MTP_int(newdc)), rpcDone([this](const MTPauth_ExportedAuthorization &result, mtpRequestId requestId) {
-				exportDone(result, requestId);
-			}), rpcFail([this](const RPCError &error, mtpRequestId requestId) {
-				return exportFail(error, requestId);
-			}));
-			_authExportRequests.emplace(exportRequestId, abs(dcWithShift));
-		}
-		waiters.push_back(requestId);
+		exportAuthorization(newdc, abs(dcWithShift));
+		_authWaiters[newdc].push_back(requestId);
 		if (badGuestDc) _badGuestDcRequests.insert(requestId);
 		return true;
 	} else if (err == qstr("CONNECTION_NOT_INITED") || err == qstr("CONNECTION_LAYER_INVALID")) {
 		mtpRequest request;
 		{
 			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
+			auto found = _requestMap.find(requestId);
+			if (!found) {
 				LOG(("MTP Error: could not find request %1").arg(requestId));
 				return false;
 			}
-			request = it->second;
+			request = *found;
 		}
 		auto dcWithShift = ShiftedDcId(0);
 		{
 			QMutexLocker locker(&_requestByDcLock);
-			auto it = _requestsByDc.find(requestId);
-			if (it == _requestsByDc.end()) {
-				LOG(("MTP Error: could not find request %1 for resending with init connection").arg(requestId));
+			if (auto found = _requestsByDc.find(requestId)) {
+				dcWithShift = *found;
 			} else {
-				dcWithShift = it->second;
+				LOG(("MTP Error: could not find request %1 for resending with init connection").arg(requestId));
 			}
 		}
 		if (!dcWithShift) return false;
@@ -1105,12 +1181,12 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 		mtpRequest request;
 		{
 			QReadLocker locker(&_requestMapLock);
-			auto it = _requestMap.find(requestId);
-			if (it == _requestMap.cend()) {
+			auto found = _requestMap.find(requestId);
+			if (!found) {
 				LOG(("MTP Error: could not find request %1").arg(requestId));
 				return false;
 			}
-			request = it->second;
+			request = *found;
 		}
 		if (!request->after) {
 			LOG(("MTP Error: wait failed for not dependent request %1").arg(requestId));
@@ -1121,13 +1197,13 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 			QMutexLocker locker(&_requestByDcLock);
 			auto it = _requestsByDc.find(requestId);
 			auto afterIt = _requestsByDc.find(request->after->requestId);
-			if (it == _requestsByDc.end()) {
+			if (!it) {
 				LOG(("MTP Error: could not find request %1 by dc").arg(requestId));
-			} else if (afterIt == _requestsByDc.end()) {
+			} else if (!afterIt) {
 				LOG(("MTP Error: could not find dependent request %1 by dc").arg(request->after->requestId));
 			} else {
-				dcWithShift = it->second;
-				if (it->second != afterIt->second) {
+				dcWithShift = *it;
+				if (*it != *afterIt) {
 					request->after = mtpRequest();
 				}
 			}
@@ -1171,6 +1247,9 @@ bool Instance::Private::onErrorDefault(mtpRequestId requestId, const RPCError &e
 }
 
 internal::Session *Instance::Private::getSession(ShiftedDcId shiftedDcId) {
+	if (isBackgroundDcId(shiftedDcId) && !Global::BackgroundSessions()) {
+		shiftedDcId = bareDcId(shiftedDcId);
+	}
 	if (!shiftedDcId) {
 		Assert(_mainSession != nullptr);
 		return _mainSession;
@@ -1353,6 +1432,10 @@ void Instance::logout(RPCDoneHandlerPtr onDone, RPCFailHandlerPtr onFail) {
 	_private->logout(onDone, onFail);
 }
 
+void Instance::prepareMediaDcs() {
+	_private->prepareMediaDcs();
+}
+
 std::shared_ptr<internal::Dcenter> Instance::getDcById(ShiftedDcId shiftedDcId) {
 	return _private->getDcById(shiftedDcId);
 }
@@ -1425,8 +1508,12 @@ void Instance::clearCallbacksDelayed(const RPCCallbackClears &requestIds) {
 	_private->clearCallbacksDelayed(requestIds);
 }
 
-void Instance::execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
-	_private->execCallback(requestId, from, end);
+RPCPreparsedResponsePtr Instance::preparseResponse(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) {
+	return _private->preparseResponse(requestId, from, end);
+}
+
+void Instance::execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end, RPCPreparsedResponsePtr preparsed) {
+	_private->execCallback(requestId, from, end, std::move(preparsed));
 }
 
 bool Instance::hasCallbacks(mtpRequestId requestId) {
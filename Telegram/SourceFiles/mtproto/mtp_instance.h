@@ -100,6 +100,9 @@ public:
 	void reInitConnection(DcId dcId);
 	void logout(RPCDoneHandlerPtr onDone, RPCFailHandlerPtr onFail);
 
+	// Export authorization in advance to the dcs we don't have keys for.
+	void prepareMediaDcs();
+
 	std::shared_ptr<internal::Dcenter> getDcById(ShiftedDcId shiftedDcId);
 	void unpaused();
 
@@ -119,7 +122,9 @@ public:
 	mtpRequest getRequest(mtpRequestId requestId);
 	void clearCallbacksDelayed(const RPCCallbackClears &requestIds);
 
-	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	// Called in the connection thread for the responses that can be preparsed.
+	RPCPreparsedResponsePtr preparseResponse(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end);
+	void execCallback(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end, RPCPreparsedResponsePtr preparsed = nullptr);
 	bool hasCallbacks(mtpRequestId requestId);
 	void globalCallback(const mtpPrime *from, const mtpPrime *end);
 
@@ -20,6 +20,17 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "mtproto/rpc_sender.h"
 
+namespace MTP {
+namespace internal {
+
+RPCPreparsedResponse *&CurrentPreparsedResponse() {
+	static auto result = (RPCPreparsedResponse*)nullptr;
+	return result;
+}
+
+} // namespace internal
+} // namespace MTP
+
 RPCOwnedDoneHandler::RPCOwnedDoneHandler(RPCSender *owner) : _owner(owner) {
 	_owner->_rpcRegHandler(this);
 }
@@ -78,15 +78,115 @@ inline bool isDefaultHandledError(const RPCError &error) {
 
 } // namespace MTP
 
+class RPCPreparsedResponse;
+using RPCPreparsedResponsePtr = std::unique_ptr<RPCPreparsedResponse>;
+using RPCResponsePreparser = RPCPreparsedResponsePtr (*)(const mtpPrime *from, const mtpPrime *end);
+
+// Response read in the connection thread, see MTP::internal::ReadResponse.
+class RPCPreparsedResponse {
+public:
+	RPCPreparsedResponse(RPCResponsePreparser preparser) : preparser(preparser) {
+	}
+	virtual ~RPCPreparsedResponse() = default;
+
+	const RPCResponsePreparser preparser;
+
+};
+
 class RPCAbstractDoneHandler { // abstract done
 public:
 	virtual void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) = 0;
+
+	// Not null if the response should be read in the connection thread.
+	virtual RPCResponsePreparser preparser() const {
+		return nullptr;
+	}
+
 	virtual ~RPCAbstractDoneHandler() {
 	}
 
 };
 using RPCDoneHandlerPtr = QSharedPointer<RPCAbstractDoneHandler>;
 
+namespace MTP {
+namespace internal {
+
+// Large responses that are read in the connection thread, so that only
+// the ready object graph is passed to the handler in the main thread.
+template <typename TResponse>
+struct ReadInConnectionThread : std::false_type {
+};
+template <>
+struct ReadInConnectionThread<MTPmessages_Messages> : std::true_type {
+};
+template <>
+struct ReadInConnectionThread<MTPmessages_Dialogs> : std::true_type {
+};
+template <>
+struct ReadInConnectionThread<MTPupdates_Difference> : std::true_type {
+};
+template <>
+struct ReadInConnectionThread<MTPupdates_ChannelDifference> : std::true_type {
+};
+
+template <typename TResponse>
+class PreparsedResponse : public RPCPreparsedResponse {
+public:
+	using RPCPreparsedResponse::RPCPreparsedResponse;
+
+	TResponse value;
+
+};
+
+template <typename TResponse>
+RPCPreparsedResponsePtr PreparseResponse(const mtpPrime *from, const mtpPrime *end) {
+	// The data is allocated in the arena of the connection thread, its
+	// blocks are freed when the data is destroyed in the main thread.
+	TypeDataArenaScope arena;
+	auto result = std::make_unique<PreparsedResponse<TResponse>>(&PreparseResponse<TResponse>);
+	result->value.read(from, end);
+	return std::move(result);
+}
+
+template <typename TResponse>
+inline RPCResponsePreparser ResponsePreparser() {
+	return ReadInConnectionThread<TResponse>::value ? &PreparseResponse<TResponse> : nullptr;
+}
+
+// Main thread only, set while a done handler is called with a preparsed response.
+RPCPreparsedResponse *&CurrentPreparsedResponse();
+
+class PreparsedResponseScope {
+public:
+	PreparsedResponseScope(RPCPreparsedResponse *response)
+	: _previous(std::exchange(CurrentPreparsedResponse(), response)) {
+	}
+	PreparsedResponseScope(const PreparsedResponseScope &other) = delete;
+	PreparsedResponseScope &operator=(const PreparsedResponseScope &other) = delete;
+	~PreparsedResponseScope() {
+		CurrentPreparsedResponse() = _previous;
+	}
+
+private:
+	RPCPreparsedResponse *_previous = nullptr;
+
+};
+
+template <typename TResponse>
+TResponse ReadResponse(const mtpPrime *from, const mtpPrime *end) {
+	auto &current = CurrentPreparsedResponse();
+	if (current && current->preparser == ResponsePreparser<TResponse>()) {
+		auto result = std::move(static_cast<PreparsedResponse<TResponse>*>(base::take(current))->value);
+		return result;
+	}
+	auto result = TResponse();
+	result.read(from, end);
+	return result;
+}
+
+} // namespace internal
+} // namespace MTP
+
 class RPCAbstractFailHandler { // abstract fail
 public:
 	virtual bool operator()(mtpRequestId requestId, const RPCError &e) = 0;
@@ -150,10 +250,13 @@ public:
     RPCDoneHandlerPlain(CallbackType onDone) : _onDone(onDone) {
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
-		auto response = TResponse();
-		response.read(from, end);
+		MTP::internal::TypeDataArenaScope arena;
+		auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 		(*_onDone)(std::move(response));
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -168,10 +271,13 @@ public:
     RPCDoneHandlerReq(CallbackType onDone) : _onDone(onDone) {
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
-		auto response = TResponse();
-		response.read(from, end);
+		MTP::internal::TypeDataArenaScope arena;
+		auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 		(*_onDone)(std::move(response), requestId);
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -396,11 +502,14 @@ public:
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (_owner) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			(static_cast<TReceiver*>(_owner)->*_onDone)(std::move(response));
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -416,11 +525,14 @@ public:
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (_owner) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			(static_cast<TReceiver*>(_owner)->*_onDone)(std::move(response), requestId);
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -502,11 +614,14 @@ public:
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (_owner) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, std::move(response));
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -523,11 +638,14 @@ public:
 	}
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (_owner) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			(static_cast<TReceiver*>(_owner)->*_onDone)(_b, std::move(response), requestId);
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 private:
 	CallbackType _onDone;
@@ -894,11 +1012,14 @@ public:
 	using RPCDoneHandlerImplementation<R(const TResponse&)>::Parent::Parent;
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (this->_handler) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			this->_handler(std::move(response));
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 };
 
@@ -908,11 +1029,14 @@ public:
 	using RPCDoneHandlerImplementation<R(const TResponse&, mtpRequestId)>::Parent::Parent;
 	void operator()(mtpRequestId requestId, const mtpPrime *from, const mtpPrime *end) override {
 		if (this->_handler) {
-			auto response = TResponse();
-			response.read(from, end);
+			MTP::internal::TypeDataArenaScope arena;
+			auto response = MTP::internal::ReadResponse<TResponse>(from, end);
 			this->_handler(std::move(response), requestId);
 		}
 	}
+	RPCResponsePreparser preparser() const override {
+		return MTP::internal::ResponsePreparser<TResponse>();
+	}
 
 };
 
@@ -72,11 +72,14 @@ class Sender {
 				_sender->senderRequestHandled(requestId);
 
 				if (handler) {
-					auto result = Response();
-					result.read(from, end);
+					MTP::internal::TypeDataArenaScope arena;
+					auto result = MTP::internal::ReadResponse<Response>(from, end);
 					Policy::handle(std::move(handler), requestId, std::move(result));
 				}
 			}
+			RPCResponsePreparser preparser() const override {
+				return MTP::internal::ResponsePreparser<Response>();
+			}
 
 		private:
 			not_null<Sender*> _sender;
@@ -161,8 +164,14 @@ class Sender {
 		void setAfter(mtpRequestId requestId) noexcept {
 			_afterRequestId = requestId;
 		}
+		void setInBackground() noexcept {
+			_inBackground = true;
+		}
 
 		ShiftedDcId takeDcId() const noexcept {
+			if (_inBackground && !getDcIdShift(_dcId)) {
+				return backgroundDcId(bareDcId(_dcId));
+			}
 			return _dcId;
 		}
 		TimeMs takeCanWait() const noexcept {
@@ -198,6 +207,7 @@ class Sender {
 		base::variant<FailPlainHandler, FailRequestIdHandler> _fail;
 		FailSkipPolicy _failSkipPolicy = FailSkipPolicy::Simple;
 		mtpRequestId _afterRequestId = 0;
+		bool _inBackground = false;
 
 	};
 
@@ -250,6 +260,11 @@ public:
 			setAfter(requestId);
 			return *this;
 		}
+		// Bulk requests are sent in a separate session of the same dc.
+		SpecificRequestBuilder &inBackground() noexcept WARN_UNUSED_RESULT {
+			setInBackground();
+			return *this;
+		}
 
 		mtpRequestId send() {
 			auto id = MainInstance()->send(_request, takeOnDone(), takeOnFail(), takeDcId(), takeCanWait(), takeAfter());
@@ -23,9 +23,21 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mtproto/connection.h"
 #include "mtproto/dcenter.h"
 #include "mtproto/auth_key.h"
+#include "mtproto/metrics.h"
 
 namespace MTP {
 namespace internal {
+namespace {
+
+// After the connection was restarted we ask the server if it got the
+// large sent requests, instead of sending them once again right away.
+constexpr auto kResendAllCheckStateSize = 256; // in ints
+
+// Received messages are processed in batches of that duration,
+// so that painting and input are not delayed by heavy traffic.
+constexpr auto kReceiveBatchDuration = TimeMs(8);
+
+} // namespace
 
 void SessionData::setKey(const AuthKeyPtr &key) {
 	if (_authKey != key) {
@@ -142,7 +154,7 @@ bool Session::rpcErrorOccured(mtpRequestId requestId, const RPCFailHandlerPtr &o
 
 void Session::restart() {
 	if (_killed) {
-		DEBUG_LOG(("Session Error: can't restart a killed session"));
+		TRACE_LOG(Logs::TraceSession, ("Session Error: can't restart a killed session"));
 		return;
 	}
 	data.setSystemLangCode(_instance->systemLangCode());
@@ -152,10 +164,10 @@ void Session::restart() {
 
 void Session::stop() {
 	if (_killed) {
-		DEBUG_LOG(("Session Error: can't kill a killed session"));
+		TRACE_LOG(Logs::TraceSession, ("Session Error: can't kill a killed session"));
 		return;
 	}
-	DEBUG_LOG(("Session Info: stopping session dcWithShift %1").arg(dcWithShift));
+	TRACE_LOG(Logs::TraceSession, ("Session Info: stopping session dcWithShift %1").arg(dcWithShift));
 	if (_connection) {
 		_connection->kill();
 		_instance->queueQuittingConnection(std::move(_connection));
@@ -165,7 +177,7 @@ void Session::stop() {
 void Session::kill() {
 	stop();
 	_killed = true;
-	DEBUG_LOG(("Session Info: marked session dcWithShift %1 as killed").arg(dcWithShift));
+	TRACE_LOG(Logs::TraceSession, ("Session Info: marked session dcWithShift %1 as killed").arg(dcWithShift));
 }
 
 void Session::unpaused() {
@@ -177,7 +189,7 @@ void Session::unpaused() {
 
 void Session::sendAnything(qint64 msCanWait) {
 	if (_killed) {
-		DEBUG_LOG(("Session Error: can't send anything in a killed session"));
+		TRACE_LOG(Logs::TraceSession, ("Session Error: can't send anything in a killed session"));
 		return;
 	}
 	auto ms = getms(true);
@@ -207,11 +219,11 @@ void Session::sendAnything(qint64 msCanWait) {
 
 void Session::needToResumeAndSend() {
 	if (_killed) {
-		DEBUG_LOG(("Session Info: can't resume a killed session"));
+		TRACE_LOG(Logs::TraceSession, ("Session Info: can't resume a killed session"));
 		return;
 	}
 	if (!_connection) {
-		DEBUG_LOG(("Session Info: resuming session dcWithShift %1").arg(dcWithShift));
+		TRACE_LOG(Logs::TraceSession, ("Session Info: resuming session dcWithShift %1").arg(dcWithShift));
 		createDcData();
 		_connection = std::make_unique<Connection>(_instance);
 		_connection->start(&data, dcWithShift);
@@ -399,7 +411,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 		if (i == haveSent.end()) {
 			if (sendMsgStateInfo) {
 				char cantResend[2] = {1, 0};
-				DEBUG_LOG(("Message Info: cant resend %1, request not found").arg(msgId));
+				TRACE_LOG(Logs::TraceMessage, ("Message Info: cant resend %1, request not found").arg(msgId));
 
 				return send(MTP_msgs_state_info(MTP_long(msgId), MTP_string(std::string(cantResend, cantResend + 1))));
 			}
@@ -410,7 +422,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 		haveSent.erase(i);
 	}
 	if (mtpRequestData::isSentContainer(request)) { // for container just resend all messages we can
-		DEBUG_LOG(("Message Info: resending container from haveSent, msgId %1").arg(msgId));
+		TRACE_LOG(Logs::TraceMessage, ("Message Info: resending container from haveSent, msgId %1").arg(msgId));
 		const mtpMsgId *ids = (const mtpMsgId *)(request->constData() + 8);
 		for (uint32 i = 0, l = (request->size() - 8) >> 1; i < l; ++i) {
 			resend(ids[i], 10, true);
@@ -418,6 +430,7 @@ mtpRequestId Session::resend(quint64 msgId, qint64 msCanWait, bool forceContaine
 		return 0xFFFFFFFF;
 	} else if (!mtpRequestData::isStateRequest(request)) {
 		request->msDate = forceContainer ? 0 : getms(true);
+		Metrics::AddResent(dcWithShift);
 		sendPrepared(request, msCanWait, false);
 		{
 			QWriteLocker locker(data.toResendMutex());
@@ -437,13 +450,33 @@ void Session::resendMany(QVector<quint64> msgIds, qint64 msCanWait, bool forceCo
 
 void Session::resendAll() {
 	QVector<mtpMsgId> toResend;
+	QVector<mtpMsgId> stateRequestIds;
 	{
 		QReadLocker locker(data.haveSentMutex());
 		const mtpRequestMap &haveSent(data.haveSentMap());
 		toResend.reserve(haveSent.size());
+		auto ms = getms(true);
 		for (mtpRequestMap::const_iterator i = haveSent.cbegin(), e = haveSent.cend(); i != e; ++i) {
-			if (i.value()->requestId) toResend.push_back(i.key());
+			auto &request = i.value();
+			if (!request->requestId) {
+				continue;
+			} else if (request->msDate > 0 && mtpRequestData::messageSize(request) >= uint32(kResendAllCheckStateSize)) {
+				request->msDate = ms;
+				stateRequestIds.push_back(i.key());
+			} else {
+				toResend.push_back(i.key());
+			}
+		}
+	}
+	if (!stateRequestIds.isEmpty()) {
+		DEBUG_LOG(("MTP Info: requesting state of msgs after restart: %1").arg(Logs::vector(stateRequestIds)));
+		{
+			QWriteLocker locker(data.stateRequestMutex());
+			for (auto msgId : stateRequestIds) {
+				data.stateRequestMap().insert(msgId, true);
+			}
 		}
+		sendAnything(10);
 	}
 	for (uint32 i = 0, l = toResend.size(); i < l; ++i) {
 		resend(toResend[i], 10, true);
@@ -510,17 +543,27 @@ int32 Session::getDcWithShift() const {
 
 void Session::tryToReceive() {
 	if (_killed) {
-		DEBUG_LOG(("Session Error: can't receive in a killed session"));
+		TRACE_LOG(Logs::TraceSession, ("Session Error: can't receive in a killed session"));
 		return;
 	}
 	if (paused()) {
 		_needToReceive = true;
 		return;
 	}
-	while (true) {
+	auto scheduledAt = data.receiveStarted();
+	auto started = getms(true);
+	if (scheduledAt) {
+		Metrics::AddReceiveBatch(dcWithShift, started - scheduledAt);
+	}
+	for (auto processed = 0; true; ++processed) {
+		if (processed > 0 && getms(true) - started >= kReceiveBatchDuration) {
+			QTimer::singleShot(0, this, SLOT(tryToReceive()));
+			return;
+		}
 		auto requestId = mtpRequestId(0);
 		auto isUpdate = false;
 		auto message = SerializedMessage();
+		auto preparsed = RPCPreparsedResponsePtr();
 		{
 			QWriteLocker locker(data.haveReceivedMutex());
 			auto &responses = data.haveReceivedResponses();
@@ -539,6 +582,13 @@ void Session::tryToReceive() {
 				requestId = response.key();
 				message = std::move(response.value());
 				responses.erase(response);
+
+				auto &allPreparsed = data.haveReceivedPreparsed();
+				auto i = allPreparsed.find(requestId);
+				if (i != allPreparsed.end()) {
+					preparsed = std::move(i->second);
+					allPreparsed.erase(i);
+				}
 			}
 		}
 		if (isUpdate) {
@@ -546,7 +596,7 @@ void Session::tryToReceive() {
 				_instance->globalCallback(message.constData(), message.constData() + message.size());
 			}
 		} else {
-			_instance->execCallback(requestId, message.constData(), message.constData() + message.size());
+			_instance->execCallback(requestId, message.constData(), message.constData() + message.size(), std::move(preparsed));
 		}
 	}
 }
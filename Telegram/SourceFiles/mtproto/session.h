@@ -22,6 +22,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "core/single_timer.h"
 #include "mtproto/rpc_sender.h"
+#include "base/ring_map.h"
+
+#include <atomic>
 
 namespace MTP {
 
@@ -37,9 +40,8 @@ class Connection;
 class ReceivedMsgIds {
 public:
 	bool registerMsgId(mtpMsgId msgId, bool needAck) {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
-			if (_idsNeedAck.size() < MTPIdsBufferSize || msgId > min()) {
+		if (!_idsNeedAck.contains(msgId)) {
+			if (int(_idsNeedAck.size()) < MTPIdsBufferSize || msgId > min()) {
 				_idsNeedAck.insert(msgId, needAck);
 				return true;
 			}
@@ -51,18 +53,16 @@ public:
 	}
 
 	mtpMsgId min() const {
-		return _idsNeedAck.isEmpty() ? 0 : _idsNeedAck.cbegin().key();
+		return _idsNeedAck.empty() ? 0 : _idsNeedAck.front().first;
 	}
 
 	mtpMsgId max() const {
-		auto end = _idsNeedAck.cend();
-		return _idsNeedAck.isEmpty() ? 0 : (--end).key();
+		return _idsNeedAck.empty() ? 0 : _idsNeedAck.back().first;
 	}
 
 	void shrink() {
-		auto size = _idsNeedAck.size();
-		while (size-- > MTPIdsBufferSize) {
-			_idsNeedAck.erase(_idsNeedAck.begin());
+		while (int(_idsNeedAck.size()) > MTPIdsBufferSize) {
+			_idsNeedAck.pop_front();
 		}
 	}
 
@@ -72,11 +72,11 @@ public:
 		NoAckNeeded,
 	};
 	State lookup(mtpMsgId msgId) const {
-		auto i = _idsNeedAck.constFind(msgId);
-		if (i == _idsNeedAck.cend()) {
+		auto needAck = _idsNeedAck.find(msgId);
+		if (!needAck) {
 			return State::NotFound;
 		}
-		return i.value() ? State::NeedsAck : State::NoAckNeeded;
+		return *needAck ? State::NeedsAck : State::NoAckNeeded;
 	}
 
 	void clear() {
@@ -84,7 +84,7 @@ public:
 	}
 
 private:
-	QMap<mtpMsgId, bool> _idsNeedAck;
+	base::ring_map<mtpMsgId, bool> _idsNeedAck;
 
 };
 
@@ -226,6 +226,9 @@ public:
 	const QMap<mtpRequestId, SerializedMessage> &haveReceivedResponses() const {
 		return _receivedResponses;
 	}
+	std::map<mtpRequestId, RPCPreparsedResponsePtr> &haveReceivedPreparsed() {
+		return _receivedPreparsed;
+	}
 	QList<SerializedMessage> &haveReceivedUpdates() {
 		return _receivedUpdates;
 	}
@@ -253,6 +256,16 @@ public:
 		return result * 2 + (needAck ? 1 : 0);
 	}
 
+	// The connection wakes up the owner session once for all the messages
+	// received until the session starts processing them.
+	bool scheduleReceive() {
+		auto expected = TimeMs(0);
+		return _receiveScheduledAt.compare_exchange_strong(expected, qMax(getms(true), TimeMs(1)));
+	}
+	TimeMs receiveStarted() {
+		return _receiveScheduledAt.exchange(0);
+	}
+
 	void clear(Instance *instance);
 
 private:
@@ -277,6 +290,7 @@ private:
 	mtpMsgIdsSet _stateRequest; // set of msg_id's, whose state should be requested
 
 	QMap<mtpRequestId, SerializedMessage> _receivedResponses; // map of request_id -> response that should be processed in the main thread
+	std::map<mtpRequestId, RPCPreparsedResponsePtr> _receivedPreparsed; // map of request_id -> response read in the connection thread
 	QList<SerializedMessage> _receivedUpdates; // list of updates that should be processed in the main thread
 
 	// mutexes
@@ -289,6 +303,8 @@ private:
 	mutable QReadWriteLock _haveReceivedLock;
 	mutable QReadWriteLock _stateRequestLock;
 
+	std::atomic<TimeMs> _receiveScheduledAt = { 0 };
+
 };
 
 class Session : public QObject {
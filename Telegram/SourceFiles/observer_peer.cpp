@@ -27,7 +27,7 @@ namespace {
 
 using SmallUpdatesList = QVector<PeerUpdate>;
 NeverFreedPointer<SmallUpdatesList> SmallUpdates;
-using AllUpdatesList = QMap<PeerData*, PeerUpdate>;
+using AllUpdatesList = QHash<PeerData*, PeerUpdate>;
 NeverFreedPointer<AllUpdatesList> AllUpdates;
 
 void StartCallback() {
@@ -840,7 +840,7 @@ void OverviewInner::paintEvent(QPaintEvent *e) {
 	} else {
 		p.translate(_rowsLeft, _marginTop);
 		int32 y = 0, w = _rowWidth;
-		for (int32 j = 0, l = _items.size(); j < l; ++j) {
+		for (int32 j = findListItemByTop(r.top() - _marginTop), l = _items.size(); j < l; ++j) {
 			int32 i = _reversed ? (l - j - 1) : j, nexti = _reversed ? (i - 1) : (i + 1);
 			int32 nextItemTop = (j + 1 == l) ? (_reversed ? 0 : _height) : _items.at(nexti)->Get<Overview::Layout::Info>()->top;
 			if (_reversed) nextItemTop = _height - nextItemTop;
@@ -906,7 +906,8 @@ void OverviewInner::onUpdateSelected() {
 			}
 		}
 	} else {
-		for (int32 j = 0, l = _items.size(); j < l; ++j) {
+		auto first = qMax(qMin(findListItemByTop(m.y() - _marginTop), _items.size() - 1), 0);
+		for (int32 j = first, l = _items.size(); j < l; ++j) {
 			bool lastItem = (j + 1 == l);
 			int32 i = _reversed ? (l - j - 1) : j, nexti = _reversed ? (i - 1) : (i + 1);
 			int32 nextItemTop = lastItem ? (_reversed ? 0 : _height) : _items.at(nexti)->Get<Overview::Layout::Info>()->top;
@@ -1361,6 +1362,30 @@ void OverviewInner::resizeAndRepositionItems() {
 	}
 }
 
+int OverviewInner::listItemTop(int position) const {
+	auto count = _items.size();
+	if (position >= count) {
+		return _height;
+	}
+	auto index = _reversed ? (count - position - 1) : position;
+	auto top = _items.at(index)->Get<Overview::Layout::Info>()->top;
+	return _reversed ? (_height - top) : top;
+}
+
+int OverviewInner::findListItemByTop(int top) const {
+	// Binary search for the first item which bottom is below the passed top.
+	auto from = 0, till = _items.size();
+	while (from < till) {
+		auto middle = (from + till) / 2;
+		if (listItemTop(middle + 1) > top) {
+			till = middle;
+		} else {
+			from = middle + 1;
+		}
+	}
+	return from;
+}
+
 void OverviewInner::dropResizeIndex() {
 	_resizeIndex = -1;
 }
@@ -139,6 +139,10 @@ private:
 	void invalidateCache();
 	void resizeItems();
 	void resizeAndRepositionItems();
+
+	// For the list overview types, items are counted in the displayed order, from the top.
+	int listItemTop(int position) const;
+	int findListItemByTop(int top) const;
 	void performDrag();
 
 	void itemRemoved(HistoryItem *item);
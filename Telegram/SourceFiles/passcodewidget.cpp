@@ -46,7 +46,9 @@ PasscodeWidget::PasscodeWidget(QWidget *parent) : TWidget(parent)
 }
 
 void PasscodeWidget::onSubmit() {
-	if (_passcode->text().isEmpty()) {
+	if (_checking) {
+		return;
+	} else if (_passcode->text().isEmpty()) {
 		_passcode->showError();
 		return;
 	}
@@ -57,35 +59,44 @@ void PasscodeWidget::onSubmit() {
 		return;
 	}
 
+	// The key derivation takes noticeable time, so it is done in a worker
+	// thread and further submits are ignored until it finishes.
+	_checking = true;
+	auto passcode = _passcode->text().toUtf8();
 	if (App::main()) {
-		if (Local::checkPasscode(_passcode->text().toUtf8())) {
-			Messenger::Instance().clearPasscode(); // Destroys this widget.
-			return;
-		} else {
-			cSetPasscodeBadTries(cPasscodeBadTries() + 1);
-			cSetPasscodeLastTry(getms(true));
-			onError();
-			return;
-		}
+		Local::checkPasscodeAsync(passcode, base::lambda_guarded(this, [this](bool correct) {
+			_checking = false;
+			if (correct) {
+				Messenger::Instance().clearPasscode(); // Destroys this widget.
+			} else {
+				onWrongPasscode();
+			}
+		}));
 	} else {
-		if (Local::readMap(_passcode->text().toUtf8()) != Local::ReadMapPassNeeded) {
-			cSetPasscodeBadTries(0);
-
-			Messenger::Instance().startMtp();
-			if (AuthSession::Exists()) {
-				App::wnd()->setupMain();
+		Local::createMapPassKeyAsync(passcode, base::lambda_guarded(this, [this, passcode](MTP::AuthKeyPtr passKey) {
+			_checking = false;
+			if (Local::readMap(passcode, passKey) != Local::ReadMapPassNeeded) {
+				cSetPasscodeBadTries(0);
+
+				Messenger::Instance().startMtp();
+				if (AuthSession::Exists()) {
+					App::wnd()->setupMain();
+				} else {
+					App::wnd()->setupIntro();
+				}
 			} else {
-				App::wnd()->setupIntro();
+				onWrongPasscode();
 			}
-		} else {
-			cSetPasscodeBadTries(cPasscodeBadTries() + 1);
-			cSetPasscodeLastTry(getms(true));
-			onError();
-			return;
-		}
+		}));
 	}
 }
 
+void PasscodeWidget::onWrongPasscode() {
+	cSetPasscodeBadTries(cPasscodeBadTries() + 1);
+	cSetPasscodeLastTry(getms(true));
+	onError();
+}
+
 void PasscodeWidget::onError() {
 	_error = lang(lng_passcode_wrong);
 	_passcode->selectAll();
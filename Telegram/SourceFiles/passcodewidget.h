@@ -47,6 +47,7 @@ public slots:
 
 private:
 	void animationCallback();
+	void onWrongPasscode();
 
 	void showAll();
 	void hideAll();
@@ -59,5 +60,6 @@ private:
 	object_ptr<Ui::RoundButton> _submit;
 	object_ptr<Ui::LinkButton> _logout;
 	QString _error;
+	bool _checking = false;
 
 };
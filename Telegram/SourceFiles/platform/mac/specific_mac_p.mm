@@ -150,6 +150,7 @@ ApplicationDelegate *_sharedDelegate = nil;
 - (void) receiveWakeNote:(NSNotification*)aNotification {
 	if (auto messenger = Messenger::InstancePointer()) {
 		messenger->checkLocalTime();
+		messenger->handleNetworkChanged();
 	}
 
 	LOG(("Audio Info: -receiveWakeNote: received, scheduling detach from audio device"));
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "platform/win/windows_event_filter.h"
 
 #include "mainwindow.h"
+#include "messenger.h"
 #include "auth_session.h"
 
 namespace Platform {
@@ -79,6 +80,14 @@ bool EventFilter::mainWindowEvent(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPa
 		}
 	} return false;
 
+	case WM_POWERBROADCAST: {
+		if (wParam == PBT_APMRESUMEAUTOMATIC) {
+			if (auto messenger = Messenger::InstancePointer()) {
+				messenger->handleNetworkChanged();
+			}
+		}
+	} return false;
+
 	case WM_WTSSESSION_CHANGE: {
 		if (wParam == WTS_SESSION_LOGOFF || wParam == WTS_SESSION_LOCK) {
 			setSessionLoggedOff(true);
@@ -35,6 +35,47 @@ namespace {
 
 constexpr auto kParticipantsFirstPageCount = 16;
 constexpr auto kParticipantsPerPage = 200;
+constexpr auto kParticipantsCacheTimeout = TimeMs(60000);
+constexpr auto kParticipantsCacheLists = 16;
+constexpr auto kParticipantsCacheRows = 1000;
+
+// The same lists are reopened often while managing a big group,
+// so the pages received recently are shown again without requests.
+struct ParticipantsPages {
+	UserId self = 0;
+	TimeMs received = 0;
+	int offset = 0;
+	bool allLoaded = false;
+	std::vector<MTPchannels_ChannelParticipants> pages;
+};
+std::map<std::pair<ChannelId, int>, ParticipantsPages> ParticipantsCache;
+
+// Called before a new list is added, so at most kParticipantsCacheLists are kept.
+void ShrinkParticipantsCache() {
+	auto now = getms(true);
+	for (auto i = ParticipantsCache.begin(); i != ParticipantsCache.end();) {
+		if (i->second.received + kParticipantsCacheTimeout <= now) {
+			i = ParticipantsCache.erase(i);
+		} else {
+			++i;
+		}
+	}
+	while (int(ParticipantsCache.size()) >= kParticipantsCacheLists) {
+		ParticipantsCache.erase(std::min_element(ParticipantsCache.begin(), ParticipantsCache.end(), [](auto &a, auto &b) {
+			return (a.second.received < b.second.received);
+		}));
+	}
+}
+
+void InvalidateParticipantsCache(not_null<ChannelData*> channel) {
+	for (auto i = ParticipantsCache.begin(); i != ParticipantsCache.end();) {
+		if (i->first.first == channel->bareId()) {
+			i = ParticipantsCache.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
 
 } // namespace
 
@@ -210,7 +251,7 @@ void ParticipantsBoxController::loadMoreRows() {
 		return;
 	}
 
-	if (feedMegagroupLastParticipants()) {
+	if (feedMegagroupLastParticipants() || feedCachedParticipants()) {
 		return;
 	}
 
@@ -227,35 +268,85 @@ void ParticipantsBoxController::loadMoreRows() {
 
 	// First query is small and fast, next loads a lot of rows.
 	auto perPage = (_offset > 0) ? kParticipantsPerPage : kParticipantsFirstPageCount;
-	_loadRequestId = request(MTPchannels_GetParticipants(_channel->inputChannel, filter(), MTP_int(_offset), MTP_int(perPage))).done([this](const MTPchannels_ChannelParticipants &result) {
+	_loadRequestId = request(MTPchannels_GetParticipants(_channel->inputChannel, filter(), MTP_int(_offset), MTP_int(perPage))).done([this, offset = _offset](const MTPchannels_ChannelParticipants &result) {
 		Expects(result.type() == mtpc_channels_channelParticipants);
 
 		_loadRequestId = 0;
 
-		if (!_offset) {
-			setDescriptionText((_role == Role::Restricted) ? lang(lng_group_blocked_list_about) : QString());
-		}
-		auto &participants = result.c_channels_channelParticipants();
-		App::feedUsers(participants.vusers);
+		App::feedUsers(result.c_channels_channelParticipants().vusers);
+		feedParticipants(result);
+		delegate()->peerListRefreshRows();
 
-		auto &list = participants.vparticipants.v;
-		if (list.isEmpty()) {
-			// To be sure - wait for a whole empty result list.
-			_allLoaded = true;
-		} else {
-			for_const (auto &participant, list) {
-				++_offset;
-				HandleParticipant(participant, _role, &_additional, [this](not_null<UserData*> user) {
-					appendRow(user);
-				});
-			}
+		auto key = std::make_pair(_channel->bareId(), int(_role));
+		if (!offset) {
+			ParticipantsCache.erase(key);
+			ShrinkParticipantsCache();
+			auto &cache = ParticipantsCache[key];
+			cache.self = Auth().userId();
+		}
+		auto it = ParticipantsCache.find(key);
+		if (it == ParticipantsCache.end()) {
+			return;
+		}
+		auto &cache = it->second;
+
+		// Only the first pages are kept, the rest is requested again.
+		if (cache.offset == offset && cache.offset < kParticipantsCacheRows && cache.self == Auth().userId()) {
+			cache.received = getms(true);
+			cache.offset = _offset;
+			cache.allLoaded = _allLoaded;
+			cache.pages.push_back(result);
 		}
-		delegate()->peerListRefreshRows();
 	}).fail([this](const RPCError &error) {
 		_loadRequestId = 0;
 	}).send();
 }
 
+void ParticipantsBoxController::feedParticipants(const MTPchannels_ChannelParticipants &result) {
+	if (!_offset) {
+		setDescriptionText((_role == Role::Restricted) ? lang(lng_group_blocked_list_about) : QString());
+	}
+	auto &list = result.c_channels_channelParticipants().vparticipants.v;
+	if (list.isEmpty()) {
+		// To be sure - wait for a whole empty result list.
+		_allLoaded = true;
+	} else {
+		for_const (auto &participant, list) {
+			++_offset;
+			HandleParticipant(participant, _role, &_additional, [this](not_null<UserData*> user) {
+				appendRow(user);
+			});
+		}
+	}
+}
+
+void ParticipantsBoxController::ClearCache() {
+	ParticipantsCache.clear();
+}
+
+bool ParticipantsBoxController::feedCachedParticipants() {
+	if (_offset > 0) {
+		return false;
+	}
+	auto it = ParticipantsCache.find(std::make_pair(_channel->bareId(), int(_role)));
+	if (it == ParticipantsCache.cend()) {
+		return false;
+	}
+	auto &cache = it->second;
+	if (cache.self != Auth().userId() || cache.received + kParticipantsCacheTimeout <= getms(true)) {
+		ParticipantsCache.erase(it);
+		return false;
+	}
+
+	// The users were fed when the pages were received, don't overwrite them with older data.
+	for_const (auto &page, cache.pages) {
+		feedParticipants(page);
+	}
+	_allLoaded = cache.allLoaded;
+	delegate()->peerListRefreshRows();
+	return true;
+}
+
 bool ParticipantsBoxController::feedMegagroupLastParticipants() {
 	if (_role != Role::Members || _offset > 0) {
 		return false;
@@ -355,6 +446,7 @@ void ParticipantsBoxController::showAdmin(not_null<UserData*> user) {
 }
 
 void ParticipantsBoxController::editAdminDone(not_null<UserData*> user, const MTPChannelAdminRights &rights) {
+	InvalidateParticipantsCache(_channel);
 	if (_editBox) {
 		_editBox->closeBox();
 	}
@@ -409,6 +501,7 @@ void ParticipantsBoxController::showRestricted(not_null<UserData*> user) {
 }
 
 void ParticipantsBoxController::editRestrictedDone(not_null<UserData*> user, const MTPChannelBannedRights &rights) {
+	InvalidateParticipantsCache(_channel);
 	if (_editBox) {
 		_editBox->closeBox();
 	}
@@ -461,6 +554,7 @@ void ParticipantsBoxController::kickMember(not_null<UserData*> user) {
 }
 
 void ParticipantsBoxController::kickMemberSure(not_null<UserData*> user) {
+	InvalidateParticipantsCache(_channel);
 	if (_editBox) {
 		_editBox->closeBox();
 	}
@@ -475,6 +569,7 @@ void ParticipantsBoxController::kickMemberSure(not_null<UserData*> user) {
 }
 
 void ParticipantsBoxController::removeKicked(not_null<PeerListRow*> row, not_null<UserData*> user) {
+	InvalidateParticipantsCache(_channel);
 	delegate()->peerListRemoveRow(row);
 	delegate()->peerListRefreshRows();
 
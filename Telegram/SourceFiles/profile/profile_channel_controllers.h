@@ -65,6 +65,9 @@ public:
 	template <typename Callback>
 	static void HandleParticipant(const MTPChannelParticipant &participant, Role role, not_null<Additional*> additional, Callback callback);
 
+	// Drops the recently loaded participants pages, for example on logout.
+	static void ClearCache();
+
 protected:
 	virtual std::unique_ptr<PeerListRow> createRow(not_null<UserData*> user) const;
 
@@ -83,6 +86,8 @@ private:
 	bool removeRow(not_null<UserData*> user);
 	void refreshCustomStatus(not_null<PeerListRow*> row) const;
 	bool feedMegagroupLastParticipants();
+	bool feedCachedParticipants();
+	void feedParticipants(const MTPchannels_ChannelParticipants &result);
 
 	not_null<ChannelData*> _channel;
 	Role _role = Role::Admins;
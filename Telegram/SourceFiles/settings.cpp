@@ -119,6 +119,11 @@ int32 gAutoDownloadAudio = 0;
 int32 gAutoDownloadGif = 0;
 bool gAutoPlayGif = true;
 
+int64 gCacheImagesLimit = 2048 * 1024 * 1024LL;
+int64 gCacheStickersLimit = 512 * 1024 * 1024LL;
+int64 gCacheAudiosLimit = 1024 * 1024 * 1024LL;
+int64 gCacheWebFilesLimit = 256 * 1024 * 1024LL;
+
 void ParseCommandLineArguments(const QStringList &arguments) {
 	enum class KeyFormat {
 		NoValues,
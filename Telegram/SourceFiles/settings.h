@@ -273,4 +273,10 @@ DeclareSetting(int32, AutoDownloadAudio);
 DeclareSetting(int32, AutoDownloadGif);
 DeclareSetting(bool, AutoPlayGif);
 
+// Byte budgets of the local media cache, zero means no limit.
+DeclareSetting(int64, CacheImagesLimit);
+DeclareSetting(int64, CacheStickersLimit);
+DeclareSetting(int64, CacheAudiosLimit);
+DeclareSetting(int64, CacheWebFilesLimit);
+
 void settingsParseArgs(int argc, char *argv[]);
@@ -37,6 +37,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "messenger.h"
 #include "mtproto/mtp_instance.h"
 #include "mtproto/dc_options.h"
+#include "mtproto/metrics.h"
+#include "core/memory_stats.h"
 #include "core/file_utilities.h"
 #include "window/themes/window_theme.h"
 #include "window/themes/window_theme_editor.h"
@@ -122,6 +124,32 @@ void fillCodes() {
 			}
 		});
 	});
+	Codes.insert(qsl("scrollbenchmark"), [] {
+		if (auto main = App::main()) {
+			Ui::hideSettingsAndLayer();
+			main->startScrollBenchmark();
+		}
+	});
+	Codes.insert(qsl("peersmemory"), [] {
+		Ui::show(Box<InformBox>(App::peersMemoryReport()));
+	});
+	Codes.insert(qsl("memorystats"), [] {
+		Core::MemoryStats::LogReport();
+		Ui::show(Box<InformBox>(Core::MemoryStats::Report()));
+	});
+	Codes.insert(qsl("mtpmetrics"), [] {
+		if (!MTP::Metrics::Enabled()) {
+			Ui::show(Box<ConfirmBox>(qsl("Do you want to collect network metrics?\n\nWith DEBUG logs enabled they will be also saved to DebugLogs each minute."), [] {
+				Messenger::Instance().setMtpMetricsEnabled(true);
+				Ui::hideLayer();
+			}));
+		} else {
+			Ui::show(Box<ConfirmBox>(MTP::Metrics::ToText(), qsl("Stop"), lang(lng_close), [] {
+				Messenger::Instance().setMtpMetricsEnabled(false);
+				Ui::hideLayer();
+			}));
+		}
+	});
 
 	auto audioFilters = qsl("Audio files (*.wav *.mp3);;") + FileDialog::AllFilesFilter();
 	auto audioKeys = {
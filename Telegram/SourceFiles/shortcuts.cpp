@@ -27,6 +27,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "media/player/media_player_instance.h"
 #include "platform/platform_specific.h"
 #include "base/parse_helper.h"
+#include "core/paint_profiler.h"
 
 namespace ShortcutCommands {
 
@@ -112,6 +113,11 @@ bool next_chat() {
 	return false;
 }
 
+bool toggle_paint_profiler() {
+	Core::PaintProfiler::Toggle();
+	return true;
+}
+
 // other commands here
 
 } // namespace ShortcutCommands
@@ -192,6 +198,10 @@ struct DataStruct {
 			DeclareAlias("ctrl+backtab", previous_chat);
 		}
 
+		if (cDebug()) {
+			DeclareCommand("ctrl+alt+shift+p", toggle_paint_profiler);
+		}
+
 		// other commands here
 
 #undef DeclareCommand
@@ -0,0 +1,368 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/cache_pack.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kSegmentSizeLimit = qint64(64 * 1024 * 1024); // Start a new segment after 64 MB.
+constexpr auto kCompactRemovedPercent = 50; // Compact a segment with more than half removed.
+constexpr auto kRecordHeaderSize = qint64(sizeof(quint64) + sizeof(qint32));
+constexpr auto kSegmentMagicSize = qint64(4);
+const char kSegmentMagic[kSegmentMagicSize] = { 'T', 'D', 'P', 'K' };
+
+} // namespace
+
+struct CachePack::Segment {
+	QFile file;
+	uchar *mapped = nullptr;
+	qint64 mappedSize = 0;
+	qint64 size = 0;
+	qint64 liveSize = 0; // Bytes of the records that are not removed.
+	int entries = 0;
+};
+
+CachePack::CachePack(const QString &path) : _path(path) {
+}
+
+QString CachePack::segmentPath(int index) const {
+	return _path + qsl("pack") + QString::number(index);
+}
+
+void CachePack::open() {
+	if (_opened) {
+		return;
+	}
+	_opened = true;
+
+	if (!QDir().exists(_path)) {
+		QDir().mkpath(_path);
+		return;
+	}
+	// Segments are loaded from the oldest, so that newer records win.
+	auto indices = std::vector<int>();
+	auto names = QDir(_path).entryList(QStringList(qsl("pack*")), QDir::Files);
+	for (auto &name : names) {
+		auto ok = false;
+		auto index = name.mid(4).toInt(&ok);
+		if (ok && index >= 0) {
+			indices.push_back(index);
+		}
+	}
+	std::sort(indices.begin(), indices.end());
+	for (auto index : indices) {
+		loadSegment(index);
+	}
+
+	// Mostly removed segments are dropped, the last one is kept for writing.
+	auto loaded = std::vector<int>();
+	for (auto &segment : _segments) {
+		loaded.push_back(segment.first);
+	}
+	for (auto index : loaded) {
+		checkCompact(index);
+	}
+}
+
+void CachePack::loadSegment(int index) {
+	auto segment = std::make_unique<Segment>();
+	segment->file.setFileName(segmentPath(index));
+	if (!segment->file.open(QIODevice::ReadWrite)) {
+		LOG(("Cache Error: could not open pack segment %1").arg(index));
+		return;
+	}
+	auto size = segment->file.size();
+	char magic[kSegmentMagicSize] = { 0 };
+	if (size < kSegmentMagicSize
+		|| segment->file.read(magic, kSegmentMagicSize) != kSegmentMagicSize
+		|| memcmp(magic, kSegmentMagic, kSegmentMagicSize)) {
+		LOG(("Cache Error: bad pack segment %1, removing").arg(index));
+		segment->file.close();
+		QFile::remove(segmentPath(index));
+		return;
+	}
+	if (!mapSegment(segment.get(), size)) {
+		return;
+	}
+
+	auto offset = kSegmentMagicSize;
+	while (offset + kRecordHeaderSize <= size) {
+		auto key = quint64(0);
+		auto length = qint32(0);
+		memcpy(&key, segment->mapped + offset, sizeof(key));
+		memcpy(&length, segment->mapped + offset + sizeof(key), sizeof(length));
+		if (length < 0 || offset + kRecordHeaderSize + length > size) {
+			break;
+		}
+		if (key) {
+			auto i = _entries.find(key);
+			if (i != _entries.end()) {
+				// Crashed while overwriting, the newer record wins.
+				markRemoved(i->second, (i->second.segment == index) ? segment.get() : nullptr);
+			}
+			auto &entry = _entries[key];
+			entry.segment = index;
+			entry.offset = offset;
+			entry.size = length;
+			++segment->entries;
+			segment->liveSize += kRecordHeaderSize + length;
+		}
+		offset += kRecordHeaderSize + length;
+	}
+	if (offset < size) {
+		LOG(("Cache Error: pack segment %1 truncated from %2 to %3").arg(index).arg(size).arg(offset));
+		truncateSegment(segment.get(), offset);
+	}
+	segment->size = offset;
+	_segments.emplace(index, std::move(segment));
+}
+
+bool CachePack::mapSegment(Segment *segment, qint64 size) {
+	if (segment->mapped) {
+		segment->file.unmap(segment->mapped);
+		segment->mapped = nullptr;
+		segment->mappedSize = 0;
+	}
+	segment->mapped = segment->file.map(0, size);
+	if (!segment->mapped) {
+		LOG(("Cache Error: could not map pack segment '%1'").arg(segment->file.fileName()));
+		return false;
+	}
+	segment->mappedSize = size;
+	return true;
+}
+
+void CachePack::truncateSegment(Segment *segment, qint64 size) {
+	// A mapped file can't be made smaller on some systems.
+	if (segment->mapped) {
+		segment->file.unmap(segment->mapped);
+		segment->mapped = nullptr;
+		segment->mappedSize = 0;
+	}
+	segment->file.resize(size);
+}
+
+CachePack::Segment *CachePack::segmentForWrite(qint64 size) {
+	if (!_segments.empty()) {
+		auto segment = _segments.rbegin()->second.get();
+		if (segment->size == kSegmentMagicSize || segment->size + size <= kSegmentSizeLimit) {
+			return segment;
+		}
+	}
+	auto index = _segments.empty() ? 0 : (_segments.rbegin()->first + 1);
+	if (!QDir().exists(_path)) {
+		QDir().mkpath(_path);
+	}
+	auto segment = std::make_unique<Segment>();
+	segment->file.setFileName(segmentPath(index));
+	if (!segment->file.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+		LOG(("Cache Error: could not create pack segment %1").arg(index));
+		return nullptr;
+	}
+	if (segment->file.write(kSegmentMagic, kSegmentMagicSize) != kSegmentMagicSize) {
+		LOG(("Cache Error: could not write pack segment %1").arg(index));
+		segment->file.close();
+		QFile::remove(segmentPath(index));
+		return nullptr;
+	}
+	segment->size = kSegmentMagicSize;
+	return _segments.emplace(index, std::move(segment)).first->second.get();
+}
+
+bool CachePack::contains(uint64 key) {
+	QMutexLocker lock(&_mutex);
+	open();
+	return (_entries.find(key) != _entries.end());
+}
+
+bool CachePack::put(uint64 key, const QByteArray &data) {
+	Expects(key != 0);
+
+	QMutexLocker lock(&_mutex);
+	open();
+
+	// The old record is removed only after the new one is written.
+	auto written = Entry();
+	if (!appendRecord(key, data.constData(), qint32(data.size()), written)) {
+		return false;
+	}
+	auto i = _entries.find(key);
+	if (i != _entries.end()) {
+		auto index = i->second.segment;
+		markRemoved(i->second);
+		i->second = written;
+		checkCompact(index);
+	} else {
+		_entries.emplace(key, written);
+	}
+	return true;
+}
+
+bool CachePack::appendRecord(uint64 key, const char *data, qint32 length, Entry &result) {
+	auto segment = segmentForWrite(kRecordHeaderSize + length);
+	if (!segment) {
+		return false;
+	}
+	auto offset = segment->size;
+	auto keyValue = quint64(key);
+	char header[kRecordHeaderSize];
+	memcpy(header, &keyValue, sizeof(keyValue));
+	memcpy(header + sizeof(keyValue), &length, sizeof(length));
+	if (!segment->file.seek(offset)
+		|| segment->file.write(header, kRecordHeaderSize) != kRecordHeaderSize
+		|| segment->file.write(data, length) != length
+		|| !segment->file.flush()) {
+		LOG(("Cache Error: could not write to pack segment '%1'").arg(segment->file.fileName()));
+		truncateSegment(segment, offset);
+		return false;
+	}
+	segment->size = offset + kRecordHeaderSize + length;
+	segment->liveSize += kRecordHeaderSize + length;
+	++segment->entries;
+
+	result.segment = _segments.rbegin()->first;
+	result.offset = offset;
+	result.size = length;
+	return true;
+}
+
+QByteArray CachePack::get(uint64 key) {
+	QMutexLocker lock(&_mutex);
+	open();
+
+	auto i = _entries.find(key);
+	if (i == _entries.end()) {
+		return QByteArray();
+	}
+	auto j = _segments.find(i->second.segment);
+	Assert(j != _segments.end());
+
+	auto segment = j->second.get();
+	auto end = i->second.offset + kRecordHeaderSize + i->second.size;
+	if (end > segment->mappedSize && !mapSegment(segment, segment->size)) {
+		return QByteArray();
+	}
+	auto data = reinterpret_cast<const char*>(segment->mapped + i->second.offset + kRecordHeaderSize);
+	return QByteArray(data, i->second.size);
+}
+
+void CachePack::remove(uint64 key) {
+	QMutexLocker lock(&_mutex);
+	open();
+
+	auto i = _entries.find(key);
+	if (i == _entries.end()) {
+		return;
+	}
+	auto index = i->second.segment;
+	markRemoved(i->second);
+	_entries.erase(i);
+	checkCompact(index);
+}
+
+void CachePack::markRemoved(const Entry &entry, Segment *segment) {
+	if (!segment) {
+		auto i = _segments.find(entry.segment);
+		if (i == _segments.end()) {
+			return;
+		}
+		segment = i->second.get();
+	}
+
+	// Zero key marks the record as removed for the next index rebuild.
+	auto zero = quint64(0);
+	if (!segment->file.seek(entry.offset)
+		|| segment->file.write(reinterpret_cast<const char*>(&zero), sizeof(zero)) != sizeof(zero)
+		|| !segment->file.flush()) {
+		LOG(("Cache Error: could not remove a record from pack segment '%1'").arg(segment->file.fileName()));
+	}
+	--segment->entries;
+	segment->liveSize -= kRecordHeaderSize + entry.size;
+}
+
+void CachePack::checkCompact(int index) {
+	auto i = _segments.find(index);
+	if (i == _segments.end() || index == _segments.rbegin()->first) {
+		return;
+	}
+	auto segment = i->second.get();
+	if (!segment->entries) {
+		removeSegment(index);
+	} else if (segment->liveSize * 100 < segment->size * (100 - kCompactRemovedPercent)) {
+		compactSegment(index);
+	}
+}
+
+void CachePack::compactSegment(int index) {
+	auto segment = _segments.find(index)->second.get();
+	if (segment->mappedSize < segment->size && !mapSegment(segment, segment->size)) {
+		return;
+	}
+
+	// Live records are appended to the last segment, then the old one is dropped.
+	for (auto &entry : _entries) {
+		if (entry.second.segment != index) {
+			continue;
+		}
+		auto data = reinterpret_cast<const char*>(segment->mapped + entry.second.offset + kRecordHeaderSize);
+		auto moved = Entry();
+		if (!appendRecord(entry.first, data, entry.second.size, moved)) {
+			return;
+		}
+		markRemoved(entry.second, segment);
+		entry.second = moved;
+	}
+	removeSegment(index);
+}
+
+void CachePack::removeSegment(int index) {
+	auto i = _segments.find(index);
+	if (i == _segments.end()) {
+		return;
+	}
+	auto segment = std::move(i->second);
+	_segments.erase(i);
+	if (segment->mapped) {
+		segment->file.unmap(segment->mapped);
+	}
+	segment->file.close();
+	QFile::remove(segmentPath(index));
+}
+
+void CachePack::clear() {
+	QMutexLocker lock(&_mutex);
+	open();
+
+	_entries.clear();
+	while (!_segments.empty()) {
+		removeSegment(_segments.begin()->first);
+	}
+}
+
+CachePack::~CachePack() {
+	for (auto &segment : _segments) {
+		if (segment.second->mapped) {
+			segment.second->file.unmap(segment.second->mapped);
+		}
+	}
+}
+
+} // namespace Storage
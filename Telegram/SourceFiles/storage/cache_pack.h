@@ -0,0 +1,70 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+// Keeps many small cache entries in a few large append-only segment files
+// instead of one file per entry. The index is rebuilt from the record
+// headers when the pack is first used, records are read through mmap.
+// A segment that is mostly removed records is compacted into the last one.
+// All the methods are thread-safe.
+class CachePack {
+public:
+	CachePack(const QString &path);
+
+	bool contains(uint64 key);
+	bool put(uint64 key, const QByteArray &data);
+	QByteArray get(uint64 key);
+	void remove(uint64 key);
+	void clear();
+
+	~CachePack();
+
+private:
+	struct Entry {
+		int segment = 0;
+		qint64 offset = 0;
+		qint32 size = 0;
+	};
+	struct Segment;
+
+	void open();
+	void loadSegment(int index);
+	Segment *segmentForWrite(qint64 size);
+	bool mapSegment(Segment *segment, qint64 size);
+	void truncateSegment(Segment *segment, qint64 size);
+	bool appendRecord(uint64 key, const char *data, qint32 length, Entry &result);
+	void markRemoved(const Entry &entry, Segment *segment = nullptr);
+	void checkCompact(int index);
+	void compactSegment(int index);
+	void removeSegment(int index);
+	QString segmentPath(int index) const;
+
+	QString _path;
+	bool _opened = false;
+	QMutex _mutex;
+	std::map<uint64, Entry> _entries;
+	std::map<int, std::unique_ptr<Segment>> _segments;
+
+};
+
+} // namespace Storage
@@ -24,6 +24,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "mainwindow.h"
 #include "messenger.h"
 #include "storage/localstorage.h"
+#include "storage/streamed_file.h"
+#include "storage/file_writer.h"
+#include "base/task_queue.h"
 #include "platform/platform_file_utilities.h"
 #include "auth_session.h"
 
@@ -42,6 +45,11 @@ void Downloader::clearPriorities() {
 	++_priority;
 }
 
+void Downloader::clearAutomaticPriorities() {
+	clearPriorities();
+	FileLoader::RaiseRequestedToCurrentPriority();
+}
+
 void Downloader::requestedAmountIncrement(MTP::DcId dcId, int index, int amount) {
 	Expects(index >= 0 && index < MTP::kDownloadSessionsCount);
 	auto it = _requestedBytesAmount.find(dcId);
@@ -69,6 +77,71 @@ int Downloader::chooseDcIndexForRequest(MTP::DcId dcId) const {
 	return result;
 }
 
+not_null<base::TaskQueue*> Downloader::fileWritesQueue() {
+	if (!_fileWritesQueue) {
+		_fileWritesQueue = std::make_unique<base::TaskQueue>(base::TaskQueue::Priority::Normal);
+	}
+	return _fileWritesQueue.get();
+}
+
+bool Downloader::joinSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> loader) {
+	auto i = _sharedLoadings.find(key);
+	if (i == _sharedLoadings.cend()) {
+		_sharedLoadings.emplace(key, SharedLoading { loader });
+		return true;
+	}
+	auto &shared = i->second;
+	if (shared.leader == loader) {
+		return true;
+	}
+	auto &followers = shared.followers;
+	followers.erase(std::remove(followers.begin(), followers.end(), loader), followers.end());
+	if (!shared.leader->loading()) {
+		// A paused leader waits for the loader that is being started.
+		followers.push_back(shared.leader);
+		shared.leader = loader;
+		return true;
+	}
+	followers.push_back(loader);
+	return false;
+}
+
+mtpFileLoader *Downloader::leaveSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> loader) {
+	auto i = _sharedLoadings.find(key);
+	if (i == _sharedLoadings.cend()) {
+		return nullptr;
+	}
+	auto &shared = i->second;
+	auto &followers = shared.followers;
+	if (shared.leader != loader) {
+		followers.erase(std::remove(followers.begin(), followers.end(), loader), followers.end());
+		return nullptr;
+	} else if (followers.empty()) {
+		_sharedLoadings.erase(i);
+		return nullptr;
+	}
+	shared.leader = followers.front();
+	followers.erase(followers.begin());
+	return shared.leader;
+}
+
+void Downloader::finishSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> leader, const QByteArray &data) {
+	auto i = _sharedLoadings.find(key);
+	if (i == _sharedLoadings.cend() || i->second.leader != leader) {
+		return;
+	}
+	auto followers = std::vector<QPointer<mtpFileLoader>>();
+	for (auto follower : i->second.followers) {
+		followers.push_back(follower.get());
+	}
+	_sharedLoadings.erase(i);
+	for (auto follower : followers) {
+		if (follower) {
+			follower->sharedLoaded(data);
+		}
+	}
+}
+
 Downloader::~Downloader() {
 	// The file loaders have pointer to downloader and they cancel
 	// requests in destructor where they use that pointer, so all
@@ -82,10 +155,22 @@ namespace {
 
 constexpr auto kDownloadPhotoPartSize = 64 * 1024; // 64kb for photo
 constexpr auto kDownloadDocumentPartSize = 128 * 1024; // 128kb for document
-constexpr auto kMaxFileQueries = 16; // max 16 file parts downloaded at the same time
+constexpr auto kMaxFileQueries = 8 * MTP::kDownloadSessionsCount; // max 8 file parts downloaded at the same time in each session
 constexpr auto kMaxWebFileQueries = 8; // max 8 http[s] files downloaded at the same time
 constexpr auto kDownloadCdnPartSize = 128 * 1024; // 128kb for cdn requests
 
+// Parts requested at the same time for a single file, adjusted by request durations.
+constexpr auto kDownloadWindowInitial = 4;
+constexpr auto kDownloadWindowMin = 2;
+constexpr auto kDownloadWindowMax = kMaxFileQueries;
+
+// Large documents downloaded to a file save their progress each 4 MB to be resumed later.
+constexpr auto kPartialDownloadSaveBytes = 4 * 1024 * 1024;
+constexpr auto kPartialDownloadMinSize = 2 * kPartialDownloadSaveBytes;
+
+// No more parts are requested while this amount of bytes waits to be written.
+constexpr auto kMaxWritingBytes = 2 * 1024 * 1024;
+
 } // namespace
 
 struct FileLoaderQueue {
@@ -208,6 +293,31 @@ void FileLoader::removeFromQueue() {
 	_inQueue = false;
 }
 
+void FileLoader::raiseToCurrentPriority() {
+	if (_inQueue && !_paused && _priority < _downloader->currentPriority()) {
+		start(false, true);
+	}
+}
+
+void FileLoader::RaiseRequestedToCurrentPriority() {
+	// Collected first, raising a loader moves it inside its queue.
+	auto requested = std::vector<FileLoader*>();
+	auto collect = [&requested](const FileLoaderQueue &queue) {
+		for (auto loader = queue.start; loader; loader = loader->_next) {
+			if (!loader->_autoLoading) {
+				requested.push_back(loader);
+			}
+		}
+	};
+	for_const (auto &queue, queues) {
+		collect(queue);
+	}
+	collect(_webQueue);
+	for (auto loader : requested) {
+		loader->raiseToCurrentPriority();
+	}
+}
+
 void FileLoader::pause() {
 	removeFromQueue();
 	_paused = true;
@@ -270,7 +380,7 @@ void FileLoader::start(bool loadFirst, bool prior) {
 	}
 
 	if (!_filename.isEmpty() && _toCache == LoadToFileOnly && !_fileIsOpen) {
-		_fileIsOpen = _file.open(QIODevice::WriteOnly);
+		_fileIsOpen = tryResumeFile() || _file.open(QIODevice::WriteOnly);
 		if (!_fileIsOpen) {
 			return cancel(true);
 		}
@@ -377,7 +487,7 @@ void FileLoader::cancel(bool fail) {
 	if (_fileIsOpen) {
 		_file.close();
 		_fileIsOpen = false;
-		_file.remove();
+		removeFile();
 	}
 	_data = QByteArray();
 
@@ -404,6 +514,11 @@ mtpFileLoader::mtpFileLoader(const StorageImageLocation *location, int32 size, L
 : FileLoader(QString(), size, UnknownFileLocation, LoadToCacheAsWell, fromCloud, autoLoading)
 , _dcId(location->dc())
 , _location(location) {
+	init();
+}
+
+void mtpFileLoader::init() {
+	_requestsWindow = Storage::RequestsWindow(kDownloadWindowInitial, kDownloadWindowMin, kDownloadWindowMax);
 	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
 	auto i = queues.find(shiftedDcId);
 	if (i == queues.cend()) {
@@ -418,34 +533,51 @@ mtpFileLoader::mtpFileLoader(int32 dc, uint64 id, uint64 accessHash, int32 versi
 , _id(id)
 , _accessHash(accessHash)
 , _version(version) {
-	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
-	auto i = queues.find(shiftedDcId);
-	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
-	}
-	_queue = &i.value();
+	init();
 }
 
 mtpFileLoader::mtpFileLoader(const WebFileImageLocation *location, int32 size, LoadFromCloudSetting fromCloud, bool autoLoading)
 : FileLoader(QString(), size, UnknownFileLocation, LoadToCacheAsWell, fromCloud, autoLoading)
 , _dcId(location->dc())
 , _urlLocation(location) {
-	auto shiftedDcId = MTP::downloadDcId(_dcId, 0);
-	auto i = queues.find(shiftedDcId);
-	if (i == queues.cend()) {
-		i = queues.insert(shiftedDcId, FileLoaderQueue(kMaxFileQueries));
-	}
-	_queue = &i.value();
+	init();
 }
 
 int32 mtpFileLoader::currentOffset(bool includeSkipped) const {
-	return (_fileIsOpen ? _file.size() : _data.size()) - (includeSkipped ? 0 : _skippedBytes);
+	if (_fileIsOpen) {
+		return _fileLoadedBytes;
+	}
+	return _data.size() - (includeSkipped ? 0 : _skippedBytes);
 }
 
 bool mtpFileLoader::loadPart() {
 	if (_finished || _lastComplete || (!_sentRequests.empty() && !_size)) {
 		return false;
-	} else if (_size && _nextRequestOffset >= _size) {
+	} else if (!shareLoading()) {
+		return false;
+	}
+	if (_stream) {
+		auto wanted = _stream->takeWantedOffset();
+		if (wanted >= 0 && wanted < _size) {
+			_nextRequestOffset = wanted - (wanted % partSize());
+		}
+	}
+	while (_size && _nextRequestOffset < _size && partRequested(_nextRequestOffset)) {
+		_nextRequestOffset += partSize();
+	}
+	if (_stream && _nextRequestOffset >= _size) {
+		// Request the parts skipped when jumping to the wanted offset.
+		_nextRequestOffset = 0;
+		while (_nextRequestOffset < _size && partRequested(_nextRequestOffset)) {
+			_nextRequestOffset += partSize();
+		}
+	}
+	if (_size && _nextRequestOffset >= _size) {
+		return false;
+	} else if (int(_sentRequests.size()) >= _requestsWindow.size()) {
+		return false;
+	} else if (_writingBytes >= kMaxWritingBytes) {
+		// The disk is slower than the network, wait for the writes.
 		return false;
 	}
 
@@ -470,11 +602,46 @@ int mtpFileLoader::partSize() const {
 	//return kDownloadDocumentPartSize;
 }
 
+Storage::Downloader::SharedLoadingKey mtpFileLoader::sharedLoadingKey() const {
+	if (_urlLocation) {
+		return { UnknownFileLocation, storageKey(*_urlLocation) };
+	} else if (_location) {
+		return { UnknownFileLocation, storageKey(*_location) };
+	}
+	return { _locationType, mediaKey(_locationType, _dcId, _id, _version) };
+}
+
+bool mtpFileLoader::shareLoading() {
+	// Only the loaders to memory get the same bytes in the end.
+	if (_toCache != LoadToCacheAsWell) {
+		return true;
+	}
+	return _downloader->joinSharedLoading(sharedLoadingKey(), this);
+}
+
+void mtpFileLoader::leaveSharedLoading() {
+	if (_toCache != LoadToCacheAsWell) {
+		return;
+	}
+	if (auto leader = _downloader->leaveSharedLoading(sharedLoadingKey(), this)) {
+		InvokeQueued(leader, [leader] { leader->loadNext(); });
+	}
+}
+
+void mtpFileLoader::sharedLoaded(const QByteArray &data) {
+	if (_finished) {
+		return;
+	}
+	removeFromQueue();
+	localLoaded(StorageImageSaved(data));
+}
+
 mtpFileLoader::RequestData mtpFileLoader::prepareRequest(int offset) const {
 	auto result = RequestData();
 	result.dcId = _cdnDcId ? _cdnDcId : _dcId;
 	result.dcIndex = _size ? _downloader->chooseDcIndexForRequest(result.dcId) : 0;
 	result.offset = offset;
+	result.sent = getms();
 	return result;
 }
 
@@ -559,53 +726,78 @@ void mtpFileLoader::cdnPartLoaded(const MTPupload_CdnFile &result, mtpRequestId
 	}
 	Expects(result.type() == mtpc_upload_cdnFile);
 
-	auto key = gsl::as_bytes(gsl::make_span(_cdnEncryptionKey));
-	auto iv = gsl::as_bytes(gsl::make_span(_cdnEncryptionIV));
-	Expects(key.size() == MTP::CTRState::KeySize);
-	Expects(iv.size() == MTP::CTRState::IvecSize);
-
-	auto state = MTP::CTRState();
-	auto ivec = gsl::as_writeable_bytes(gsl::make_span(state.ivec));
-	std::copy(iv.begin(), iv.end(), ivec.begin());
+	auto bytes = result.c_upload_cdnFile().vbytes.v;
+	verifyCdnPart(offset, std::move(bytes), true);
+}
 
-	auto counterOffset = static_cast<uint32>(offset) >> 4;
-	state.ivec[15] = static_cast<uchar>(counterOffset & 0xFF);
-	state.ivec[14] = static_cast<uchar>((counterOffset >> 8) & 0xFF);
-	state.ivec[13] = static_cast<uchar>((counterOffset >> 16) & 0xFF);
-	state.ivec[12] = static_cast<uchar>((counterOffset >> 24) & 0xFF);
+void mtpFileLoader::verifyCdnPart(int offset, QByteArray &&bytes, bool encrypted) {
+	Expects(!encrypted || _cdnEncryptionKey.size() == MTP::CTRState::KeySize);
+	Expects(!encrypted || _cdnEncryptionIV.size() == MTP::CTRState::IvecSize);
 
-	auto decryptInPlace = result.c_upload_cdnFile().vbytes.v;
-	MTP::aesCtrEncrypt(decryptInPlace.data(), decryptInPlace.size(), key.data(), &state);
-	auto bytes = gsl::as_bytes(gsl::make_span(decryptInPlace));
+	auto cdnFileHashIt = _cdnFileHashes.find(offset);
+	auto hash = (cdnFileHashIt == _cdnFileHashes.cend())
+		? QByteArray()
+		: cdnFileHashIt->second.hash;
+	auto key = encrypted ? _cdnEncryptionKey : QByteArray();
+	auto iv = encrypted ? _cdnEncryptionIV : QByteArray();
+	auto done = base::lambda_guarded(this, [this, offset](QByteArray &&bytes, CheckCdnHashResult result) {
+		cdnPartVerified(offset, std::move(bytes), result);
+	});
+	_cdnPartsVerifying.emplace(offset);
+	base::TaskQueue::Normal().Put([=, bytes = std::move(bytes), done = std::move(done)]() mutable {
+		if (!key.isEmpty()) {
+			MTP::CTRState state;
+			auto ivec = gsl::as_writeable_bytes(gsl::make_span(state.ivec));
+			auto source = gsl::as_bytes(gsl::make_span(iv));
+			std::copy(source.begin(), source.end(), ivec.begin());
+
+			auto counterOffset = static_cast<uint32>(offset) >> 4;
+			state.ivec[15] = static_cast<uchar>(counterOffset & 0xFF);
+			state.ivec[14] = static_cast<uchar>((counterOffset >> 8) & 0xFF);
+			state.ivec[13] = static_cast<uchar>((counterOffset >> 16) & 0xFF);
+			state.ivec[12] = static_cast<uchar>((counterOffset >> 24) & 0xFF);
+
+			MTP::aesCtrEncrypt(bytes.data(), bytes.size(), key.constData(), &state);
+		}
+		auto result = CheckCdnHashResult::NoHash;
+		if (!hash.isEmpty()) {
+			auto realHash = hashSha256(bytes.constData(), bytes.size());
+			result = base::compare_bytes(gsl::as_bytes(gsl::make_span(realHash)), gsl::as_bytes(gsl::make_span(hash)))
+				? CheckCdnHashResult::Invalid
+				: CheckCdnHashResult::Good;
+		}
+		base::TaskQueue::Main().Put([done = std::move(done), bytes = std::move(bytes), result]() mutable {
+			done(std::move(bytes), result);
+		});
+	});
+}
 
-	switch (checkCdnFileHash(offset, bytes)) {
+void mtpFileLoader::cdnPartVerified(int offset, QByteArray &&bytes, CheckCdnHashResult result) {
+	if (!_cdnPartsVerifying.remove(offset)) {
+		return; // Cancelled while the part was verified.
+	}
+	switch (result) {
 	case CheckCdnHashResult::NoHash: {
-		_cdnUncheckedParts.emplace(offset, decryptInPlace);
+		if (_cdnFileHashes.find(offset) != _cdnFileHashes.cend()) {
+			// The hash was received while the part was decrypted.
+			verifyCdnPart(offset, std::move(bytes), false);
+			return;
+		}
+		_cdnUncheckedParts.emplace(offset, std::move(bytes));
 		requestMoreCdnFileHashes();
 	} return;
 
 	case CheckCdnHashResult::Invalid: {
-		LOG(("API Error: Wrong cdnFileHash for offset %1.").arg(offset));
+		_downloader->cdnHashFailed();
+		LOG(("API Error: Wrong cdnFileHash for offset %1, failures in session: %2.").arg(offset).arg(_downloader->cdnHashFailures()));
 		cancel(true);
 	} return;
 
 	case CheckCdnHashResult::Good: {
-		partLoaded(offset, bytes);
+		partLoaded(offset, gsl::as_bytes(gsl::make_span(bytes)));
 	} return;
 	}
-	Unexpected("Result of checkCdnFileHash()");
-}
-
-mtpFileLoader::CheckCdnHashResult mtpFileLoader::checkCdnFileHash(int offset, base::const_byte_span bytes) {
-	auto cdnFileHashIt = _cdnFileHashes.find(offset);
-	if (cdnFileHashIt == _cdnFileHashes.cend()) {
-		return CheckCdnHashResult::NoHash;
-	}
-	auto realHash = hashSha256(bytes.data(), bytes.size());
-	if (base::compare_bytes(gsl::as_bytes(gsl::make_span(realHash)), gsl::as_bytes(gsl::make_span(cdnFileHashIt->second.hash)))) {
-		return CheckCdnHashResult::Invalid;
-	}
-	return CheckCdnHashResult::Good;
+	Unexpected("Result in mtpFileLoader::cdnPartVerified()");
 }
 
 void mtpFileLoader::reuploadDone(const MTPVector<MTPCdnFileHash> &result, mtpRequestId requestId) {
@@ -623,34 +815,14 @@ void mtpFileLoader::getCdnFileHashesDone(const MTPVector<MTPCdnFileHash> &result
 	auto someMoreChecked = false;
 	for (auto i = _cdnUncheckedParts.begin(); i != _cdnUncheckedParts.cend();) {
 		auto uncheckedOffset = i->first;
-		auto uncheckedBytes = gsl::as_bytes(gsl::make_span(i->second));
-
-		switch (checkCdnFileHash(uncheckedOffset, uncheckedBytes)) {
-		case CheckCdnHashResult::NoHash: {
+		if (_cdnFileHashes.find(uncheckedOffset) == _cdnFileHashes.cend()) {
 			++i;
-		} break;
-
-		case CheckCdnHashResult::Invalid: {
-			LOG(("API Error: Wrong cdnFileHash for offset %1.").arg(offset));
-			cancel(true);
-			return;
-		} break;
-
-		case CheckCdnHashResult::Good: {
-			someMoreChecked = true;
-			auto goodOffset = uncheckedOffset;
-			auto goodBytes = std::move(i->second);
-			i = _cdnUncheckedParts.erase(i);
-			auto guarded = QPointer<mtpFileLoader>(this);
-			partLoaded(goodOffset, gsl::as_bytes(gsl::make_span(goodBytes)));
-			if (!guarded) {
-				// Perhaps we were destroyed already?..
-				return;
-			}
-		} break;
-
-		default: Unexpected("Result of checkCdnFileHash()");
+			continue;
 		}
+		someMoreChecked = true;
+		auto uncheckedBytes = std::move(i->second);
+		i = _cdnUncheckedParts.erase(i);
+		verifyCdnPart(uncheckedOffset, std::move(uncheckedBytes), false);
 	}
 	if (!someMoreChecked) {
 		LOG(("API Error: Could not find cdnFileHash for offset %1 after getCdnFileHashes request.").arg(offset));
@@ -676,22 +848,31 @@ int mtpFileLoader::finishSentRequestGetOffset(mtpRequestId requestId) {
 	--_queue->queriesCount;
 	_sentRequests.erase(it);
 
+	if (requestData.sent) {
+		_requestsWindow.requestDone(getms() - requestData.sent);
+	}
 	return requestData.offset;
 }
 
 void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
+	if (_stream && offset + bytes.size() < _size && (!bytes.size() || (bytes.size() % 1024))) {
+		return cancel(true);
+	}
 	if (bytes.size()) {
 		if (_fileIsOpen) {
-			auto fsize = _file.size();
-			if (offset < fsize) {
-				_skippedBytes -= bytes.size();
-			} else if (offset > fsize) {
-				_skippedBytes += offset - fsize;
-			}
-			_file.seek(offset);
-			if (_file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size()) != qint64(bytes.size())) {
-				return cancel(true);
+			if (!_writer) {
+				// From now on the file is written only in the writes queue.
+				_file.close();
+				auto preallocateSize = _filePreallocated ? 0 : _size;
+				_writer = std::make_unique<Storage::FileWriter>(_downloader->fileWritesQueue(), _filename, preallocateSize);
+				_filePreallocated = true;
 			}
+			auto size = int(bytes.size());
+			_partsWriting.emplace(offset);
+			_writingBytes += size;
+			_writer->write(offset, QByteArray(reinterpret_cast<const char*>(bytes.data()), size), base::lambda_guarded(this, [this, offset, size](bool success) {
+				partWriteFinished(offset, size, success);
+			}));
 		} else {
 			if (offset > 100 * 1024 * 1024) {
 				// Debugging weird out of memory crashes.
@@ -721,10 +902,41 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 			}
 		}
 	}
-	if (!bytes.size() || (bytes.size() % 1024)) { // bad next offset
+	if (_stream) {
+		if (!_writer || !bytes.size()) {
+			_stream->feed(offset, bytes);
+		}
+	} else if (!bytes.size() || (bytes.size() % 1024)) { // bad next offset
 		_lastComplete = true;
 	}
-	if (_sentRequests.empty() && _cdnUncheckedParts.empty() && (_lastComplete || (_size && _nextRequestOffset >= _size))) {
+	partProcessed();
+}
+
+void mtpFileLoader::partWriteFinished(int offset, int size, bool success) {
+	if (!_writer) {
+		return; // Cancelled while the part was written.
+	}
+	_partsWriting.remove(offset);
+	_writingBytes -= size;
+	if (!success) {
+		return cancel(true);
+	}
+	_fileLoadedBytes += size;
+	if (resumable()) {
+		markPartWritten(offset);
+		if (_fileLoadedBytes - _savedLoadedBytes >= kPartialDownloadSaveBytes) {
+			savePartialDownload();
+		}
+	}
+	if (_stream) {
+		_stream->feed(offset, base::const_byte_span());
+	}
+	partProcessed();
+}
+
+void mtpFileLoader::partProcessed() {
+	auto allRequested = _stream ? _stream->complete() : (_size && _nextRequestOffset >= _size);
+	if (_sentRequests.empty() && _cdnUncheckedParts.empty() && _cdnPartsVerifying.empty() && _partsWriting.empty() && (_lastComplete || allRequested)) {
 		if (!_filename.isEmpty() && (_toCache == LoadToCacheAsWell)) {
 			if (!_fileIsOpen) _fileIsOpen = _file.open(QIODevice::WriteOnly);
 			if (!_fileIsOpen) {
@@ -736,12 +948,29 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 		}
 		_finished = true;
 		if (_fileIsOpen) {
-			_file.close();
 			_fileIsOpen = false;
-			Platform::File::PostprocessDownloaded(QFileInfo(_file).absoluteFilePath());
+			if (_writer) {
+				auto path = QFileInfo(_filename).absoluteFilePath();
+				base::take(_writer)->close([path](bool success) {
+					if (success) {
+						Platform::File::PostprocessDownloaded(path);
+					}
+				});
+			} else {
+				_file.close();
+				Platform::File::PostprocessDownloaded(QFileInfo(_file).absoluteFilePath());
+			}
 		}
 		removeFromQueue();
 
+		if (_savedLoadedBytes) {
+			Local::clearPartialDownload(mediaKey(_locationType, _dcId, _id, _version));
+		}
+
+		if (_toCache == LoadToCacheAsWell) {
+			_downloader->finishSharedLoading(sharedLoadingKey(), this, _data);
+		}
+
 		if (_localStatus == LocalNotFound || _localStatus == LocalFailed) {
 			if (_urlLocation) {
 				Local::writeImage(storageKey(*_urlLocation), StorageImageSaved(_data));
@@ -771,6 +1000,100 @@ void mtpFileLoader::partLoaded(int offset, base::const_byte_span bytes) {
 	loadNext();
 }
 
+bool mtpFileLoader::resumable() const {
+	return (_toCache == LoadToFileOnly)
+		&& (_locationType != UnknownFileLocation)
+		&& !_urlLocation
+		&& (_size >= kPartialDownloadMinSize);
+}
+
+bool mtpFileLoader::partWritten(int offset) const {
+	auto index = offset / partSize();
+	return (index / 8 < _writtenParts.size()) && (_writtenParts[index / 8] & (1 << (index % 8)));
+}
+
+bool mtpFileLoader::partRequested(int offset) const {
+	if (partWritten(offset) || (_stream && _stream->partReceived(offset))) {
+		return true;
+	} else if (_cdnUncheckedParts.find(offset) != _cdnUncheckedParts.end()) {
+		return true;
+	} else if (_partsWriting.contains(offset) || _cdnPartsVerifying.contains(offset)) {
+		return true;
+	}
+	for (auto &sent : _sentRequests) {
+		if (sent.second.offset == offset) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void mtpFileLoader::markPartWritten(int offset) {
+	auto index = offset / partSize();
+	if (index / 8 >= _writtenParts.size()) {
+		_writtenParts.append(QByteArray(index / 8 + 1 - _writtenParts.size(), 0));
+	}
+	_writtenParts[index / 8] = _writtenParts[index / 8] | char(1 << (index % 8));
+}
+
+void mtpFileLoader::savePartialDownload() {
+	// The writer reports only the parts that are already flushed.
+	if (!_writer && !_file.flush()) {
+		return;
+	}
+	auto download = Local::PartialDownload();
+	download.filename = _filename;
+	download.size = _size;
+	download.partSize = partSize();
+	download.parts = _writtenParts;
+	Local::writePartialDownload(mediaKey(_locationType, _dcId, _id, _version), download);
+	_savedLoadedBytes = _fileLoadedBytes;
+}
+
+bool mtpFileLoader::tryResumeFile() {
+	if (!resumable()) {
+		return false;
+	}
+	auto mkey = mediaKey(_locationType, _dcId, _id, _version);
+	auto download = Local::readPartialDownload(mkey);
+	if (download.filename.isEmpty()) {
+		return false;
+	}
+	auto valid = (download.filename == _filename)
+		&& (download.size == _size)
+		&& (download.partSize == partSize())
+		&& (QFileInfo(_filename).size() == _size)
+		&& _file.open(QIODevice::ReadWrite);
+	if (!valid) {
+		Local::clearPartialDownload(mkey);
+		return false;
+	}
+
+	_writtenParts = download.parts;
+	_filePreallocated = true;
+	_fileLoadedBytes = 0;
+	auto missing = false;
+	for (auto offset = 0; offset < _size; offset += partSize()) {
+		if (partWritten(offset)) {
+			_fileLoadedBytes += qMin(partSize(), _size - offset);
+		} else {
+			missing = true;
+		}
+	}
+	if (!missing) {
+		// We don't know if the last parts were written completely.
+		_file.close();
+		_writtenParts = QByteArray();
+		_filePreallocated = false;
+		_fileLoadedBytes = 0;
+		Local::clearPartialDownload(mkey);
+		return false;
+	}
+	_savedLoadedBytes = _fileLoadedBytes;
+	LOG(("App Info: Resuming download of '%1' from %2 of %3 bytes.").arg(_filename).arg(_fileLoadedBytes).arg(_size));
+	return true;
+}
+
 bool mtpFileLoader::partFailed(const RPCError &error) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
@@ -798,6 +1121,55 @@ void mtpFileLoader::cancelRequests() {
 		MTP::cancel(requestId);
 		finishSentRequestGetOffset(requestId);
 	}
+	_cdnPartsVerifying.clear();
+	leaveSharedLoading();
+	if (_stream) {
+		_stream->fail();
+	}
+}
+
+void mtpFileLoader::removeFile() {
+	if (_writer) {
+		base::take(_writer)->remove();
+		_partsWriting.clear();
+		_writingBytes = 0;
+	} else {
+		_file.remove();
+	}
+}
+
+std::shared_ptr<Storage::StreamedFile> mtpFileLoader::stream() {
+	if (_stream || _finished || _size <= 0 || _urlLocation || _locationType == UnknownFileLocation) {
+		return _stream;
+	} else if (!shareLoading()) {
+		return nullptr; // The parts are requested by another loader.
+	}
+	// Files downloaded to disk are read back from it, others from memory.
+	if (_fileIsOpen && !_writer && !_file.flush()) {
+		return nullptr;
+	}
+	auto stream = _fileIsOpen
+		? std::make_shared<Storage::StreamedFile>(_size, partSize(), _filename)
+		: std::make_shared<Storage::StreamedFile>(_size, partSize());
+
+	// Put the parts that are already received before any out of order
+	// request could be sent, they are all below the next request offset.
+	for (auto offset = 0; offset < _nextRequestOffset && offset < _size; offset += partSize()) {
+		if (!partWritten(offset) && partRequested(offset)) {
+			continue; // The request is not finished yet.
+		}
+		auto length = qMin(partSize(), _size - offset);
+		if (_fileIsOpen) {
+			stream->feed(offset, base::const_byte_span());
+		} else if (offset + length <= _data.size()) {
+			auto bytes = gsl::make_span(_data).subspan(offset, length);
+			stream->feed(offset, gsl::as_bytes(bytes));
+		} else {
+			return nullptr;
+		}
+	}
+	_stream = std::move(stream);
+	return _stream;
 }
 
 void mtpFileLoader::switchToCDN(int offset, const MTPDupload_fileCdnRedirect &redirect) {
@@ -1003,6 +1375,11 @@ public:
 		QNetworkRequest req(_url);
 		QByteArray rangeHeaderValue = "bytes=" + QByteArray::number(_already) + "-";
 		req.setRawHeader("Range", rangeHeaderValue);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+		// Many inline results and previews come from the same host,
+		// over HTTP/2 they share one connection instead of six.
+		req.setAttribute(QNetworkRequest::HTTP2AllowedAttribute, true);
+#endif // QT_VERSION >= 5.8.0
 		_reply = manager.get(req);
 		return _reply;
 	}
@@ -1230,22 +1607,22 @@ void WebLoadManager::onMeta() {
 	}
 	webFileLoaderPrivate *loader = j.value();
 
-	typedef QList<QNetworkReply::RawHeaderPair> Pairs;
-	Pairs pairs = reply->rawHeaderPairs();
-	for (Pairs::iterator i = pairs.begin(), e = pairs.end(); i != e; ++i) {
-		if (QString::fromUtf8(i->first).toLower() == "content-range") {
-			QRegularExpressionMatch m = QRegularExpression(qsl("/(\\d+)([^\\d]|$)")).match(QString::fromUtf8(i->second));
-			if (m.hasMatch()) {
-				loader->setProgress(qMax(qint64(loader->data().size()), loader->already()), m.captured(1).toLongLong());
-				if (!handleReplyResult(loader, WebReplyProcessProgress)) {
-					_replies.erase(j);
-					_loaders.remove(loader);
-					delete loader;
-
-					reply->abort();
-					reply->deleteLater();
-				}
-			}
+	// Header names are compared case insensitive by rawHeader().
+	auto contentRange = reply->rawHeader("Content-Range");
+	if (contentRange.isEmpty()) {
+		return;
+	}
+	static const auto ContentRangeSize = QRegularExpression(qsl("/(\\d+)([^\\d]|$)"));
+	auto m = ContentRangeSize.match(QString::fromUtf8(contentRange));
+	if (m.hasMatch()) {
+		loader->setProgress(qMax(qint64(loader->data().size()), loader->already()), m.captured(1).toLongLong());
+		if (!handleReplyResult(loader, WebReplyProcessProgress)) {
+			_replies.erase(j);
+			_loaders.remove(loader);
+			delete loader;
+
+			reply->abort();
+			reply->deleteLater();
 		}
 	}
 }
@@ -21,10 +21,21 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "base/observer.h"
+#include "base/flat_set.h"
 #include "storage/localimageloader.h" // for TaskId
+#include "storage/requests_window.h"
+
+class mtpFileLoader;
+
+namespace base {
+class TaskQueue;
+} // namespace base
 
 namespace Storage {
 
+class StreamedFile;
+class FileWriter;
+
 constexpr auto kMaxFileInMemory = 10 * 1024 * 1024; // 10 MB max file could be hold in memory
 constexpr auto kMaxVoiceInMemory = 2 * 1024 * 1024; // 2 MB audio is hold in memory and auto loaded
 constexpr auto kMaxStickerInMemory = 2 * 1024 * 1024; // 2 MB stickers hold in memory, auto loaded and displayed inline
@@ -39,19 +50,45 @@ public:
 	}
 	void clearPriorities();
 
+	// Like clearPriorities(), but the loads requested by the user are kept
+	// before the automatic ones started or raised after it.
+	void clearAutomaticPriorities();
+
 	void delayedDestroyLoader(std::unique_ptr<FileLoader> loader);
 
-	base::Observable<void> &taskFinished() {
+	base::BatchedObservable<void> &taskFinished() {
 		return _taskFinishedObservable;
 	}
 
 	void requestedAmountIncrement(MTP::DcId dcId, int index, int amount);
 	int chooseDcIndexForRequest(MTP::DcId dcId) const;
 
+	// Count of the cdn file parts with a wrong hash in this session.
+	int cdnHashFailures() const {
+		return _cdnHashFailures;
+	}
+	void cdnHashFailed() {
+		++_cdnHashFailures;
+	}
+
+	// Serial queue for the file parts writes of all the loaders.
+	not_null<base::TaskQueue*> fileWritesQueue();
+
+	// Loaders of the same location to memory share one download: the
+	// first one (the leader) requests the parts, the others wait for it.
+	using SharedLoadingKey = std::pair<LocationType, StorageKey>;
+
+	// Returns true if the loader should request the parts itself.
+	bool joinSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> loader);
+
+	// Returns the new leader if the leaving loader was the leader.
+	mtpFileLoader *leaveSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> loader);
+	void finishSharedLoading(const SharedLoadingKey &key, not_null<mtpFileLoader*> leader, const QByteArray &data);
+
 	~Downloader();
 
 private:
-	base::Observable<void> _taskFinishedObservable;
+	base::BatchedObservable<void> _taskFinishedObservable;
 	int _priority = 1;
 
 	SingleQueuedInvokation _delayedLoadersDestroyer;
@@ -60,6 +97,15 @@ private:
 	using RequestedInDc = std::array<int64, MTP::kDownloadSessionsCount>;
 	std::map<MTP::DcId, RequestedInDc> _requestedBytesAmount;
 
+	std::unique_ptr<base::TaskQueue> _fileWritesQueue;
+
+	struct SharedLoading {
+		not_null<mtpFileLoader*> leader;
+		std::vector<not_null<mtpFileLoader*>> followers;
+	};
+	std::map<SharedLoadingKey, SharedLoading> _sharedLoadings;
+	int _cdnHashFailures = 0;
+
 };
 
 } // namespace Storage
@@ -118,6 +164,11 @@ public:
 	void start(bool loadFirst = false, bool prior = true);
 	void cancel();
 
+	// Moves a queued loader before the ones not shown since the last
+	// clearPriorities(), does nothing if it has the current priority.
+	void raiseToCurrentPriority();
+	static void RaiseRequestedToCurrentPriority();
+
 	bool loading() const {
 		return _inQueue;
 	}
@@ -136,6 +187,12 @@ public:
 
 	virtual void stop() {
 	}
+
+	// Bytes of the file available while it is still being downloaded.
+	virtual std::shared_ptr<Storage::StreamedFile> stream() {
+		return nullptr;
+	}
+
 	virtual ~FileLoader();
 
 	void localLoaded(const StorageImageSaved &result, const QByteArray &imageFormat = QByteArray(), const QPixmap &imagePixmap = QPixmap());
@@ -161,7 +218,13 @@ protected:
 	mutable LocalLoadStatus _localStatus = LocalNotTried;
 
 	virtual bool tryLoadLocal() = 0;
+	virtual bool tryResumeFile() {
+		return false;
+	}
 	virtual void cancelRequests() = 0;
+	virtual void removeFile() {
+		_file.remove();
+	}
 
 	void startLoading(bool loadFirst, bool prior);
 	void removeFromQueue();
@@ -208,6 +271,11 @@ public:
 		rpcInvalidate();
 	}
 
+	std::shared_ptr<Storage::StreamedFile> stream() override;
+
+	// Finishes a loader that waited for the leader of a shared loading.
+	void sharedLoaded(const QByteArray &data);
+
 	~mtpFileLoader();
 
 private:
@@ -215,6 +283,7 @@ private:
 		MTP::DcId dcId = 0;
 		int dcIndex = 0;
 		int offset = 0;
+		TimeMs sent = 0;
 	};
 	struct CdnFileHash {
 		CdnFileHash(int limit, QByteArray hash) : limit(limit), hash(hash) {
@@ -224,12 +293,18 @@ private:
 	};
 
 	bool tryLoadLocal() override;
+	bool tryResumeFile() override;
 	void cancelRequests() override;
+	void removeFile() override;
 
 	int partSize() const;
+	Storage::Downloader::SharedLoadingKey sharedLoadingKey() const;
+	bool shareLoading();
+	void leaveSharedLoading();
 	RequestData prepareRequest(int offset) const;
 	void makeRequest(int offset);
 
+	void init();
 	bool loadPart() override;
 	void normalPartLoaded(const MTPupload_File &result, mtpRequestId requestId);
 	void webPartLoaded(const MTPupload_WebFile &result, mtpRequestId requestId);
@@ -239,6 +314,13 @@ private:
 	void getCdnFileHashesDone(const MTPVector<MTPCdnFileHash> &result, mtpRequestId requestId);
 
 	void partLoaded(int offset, base::const_byte_span bytes);
+	void partWriteFinished(int offset, int size, bool success);
+	void partProcessed();
+	bool resumable() const;
+	bool partWritten(int offset) const;
+	bool partRequested(int offset) const;
+	void markPartWritten(int offset);
+	void savePartialDownload();
 	bool partFailed(const RPCError &error);
 	bool cdnPartFailed(const RPCError &error, mtpRequestId requestId);
 
@@ -253,14 +335,39 @@ private:
 		Invalid,
 		Good,
 	};
-	CheckCdnHashResult checkCdnFileHash(int offset, base::const_byte_span bytes);
+
+	// Decrypts (if encrypted) and checks the hash of a cdn file part in the
+	// thread pool, the part is passed to cdnPartVerified() after that.
+	void verifyCdnPart(int offset, QByteArray &&bytes, bool encrypted);
+	void cdnPartVerified(int offset, QByteArray &&bytes, CheckCdnHashResult result);
 
 	std::map<mtpRequestId, RequestData> _sentRequests;
 
+	// Adaptive amount of parts requested at the same time for this file.
+	Storage::RequestsWindow _requestsWindow;
+
 	bool _lastComplete = false;
 	int32 _skippedBytes = 0;
 	int32 _nextRequestOffset = 0;
 
+	// Parts are written out of order to a file preallocated to the full size.
+	bool _filePreallocated = false;
+	int32 _fileLoadedBytes = 0;
+
+	// Parts are written in the downloader file writes queue, no more
+	// parts are requested while too many bytes wait to be written.
+	std::unique_ptr<Storage::FileWriter> _writer;
+	base::flat_set<int> _partsWriting;
+	int _writingBytes = 0;
+
+	// Bitmap of the parts written to the file, persisted to resume the download.
+	QByteArray _writtenParts;
+	int32 _savedLoadedBytes = 0;
+
+	// Created when the file is played before it is fully downloaded,
+	// parts wanted by the player are requested out of order.
+	std::shared_ptr<Storage::StreamedFile> _stream;
+
 	MTP::DcId _dcId = 0; // for photo locations
 	const StorageImageLocation *_location = nullptr;
 
@@ -276,6 +383,7 @@ private:
 	QByteArray _cdnEncryptionIV;
 	std::map<int, CdnFileHash> _cdnFileHashes;
 	std::map<int, QByteArray> _cdnUncheckedParts;
+	base::flat_set<int> _cdnPartsVerifying;
 	mtpRequestId _cdnHashesRequestId = 0;
 
 };
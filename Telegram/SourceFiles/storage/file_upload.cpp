@@ -20,14 +20,22 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "storage/file_upload.h"
 
+#include "base/task_queue.h"
+
 namespace Storage {
 namespace {
 
-constexpr auto kMaxUploadFileParallelSize = MTP::kUploadSessionsCount * 512 * 1024; // max 512kb uploaded at the same time in each session
+constexpr auto kMaxUploadFilesParallel = 4; // max 4 files from the queue start are uploaded at the same time
+
+// Bytes uploaded at the same time in steps, adjusted by the part request durations.
+constexpr auto kUploadParallelSizeStep = uint32(512 * 1024);
+constexpr auto kUploadParallelStepsMin = 1;
+constexpr auto kUploadParallelStepsInitial = MTP::kUploadSessionsCount; // 512kb in each session
+constexpr auto kUploadParallelStepsMax = 4 * kUploadParallelStepsInitial;
 
 } // namespace
 
-Uploader::Uploader() {
+Uploader::Uploader() : _parallelWindow(kUploadParallelStepsInitial, kUploadParallelStepsMin, kUploadParallelStepsMax) {
 	nextTimer.setSingleShot(true);
 	connect(&nextTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
 	killSessionsTimer.setSingleShot(true);
@@ -70,12 +78,107 @@ void Uploader::upload(const FullMsgId &msgId, const FileLoadResultPtr &file) {
 			document->setLocation(FileLocation(file->filepath));
 		}
 	}
-	queue.insert(msgId, File(file));
+	applyStreamed(queue.insert(msgId, File(file)));
 	sendNext();
 }
 
-void Uploader::currentFailed() {
-	Queue::iterator j = queue.find(uploading);
+uint64 Uploader::startStreamed() {
+	auto id = rand_value<uint64>();
+	_streamed.emplace(id, std::vector<StreamedPart>());
+	return id;
+}
+
+void Uploader::feedStreamed(uint64 id, const QByteArray &part) {
+	auto i = _streamed.find(id);
+	if (i == _streamed.end()) {
+		return;
+	}
+	auto index = int(i->second.size());
+	i->second.push_back(StreamedPart());
+	i->second.back().bytes = part;
+
+	killSessionsTimer.stop();
+	auto requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(id), MTP_int(index), MTP_bytes(part)), rpcDone(&Uploader::streamedPartLoaded), rpcFail(&Uploader::streamedPartFailed), MTP::uploadDcId(0));
+	_streamedRequests.insert(requestId, qMakePair(id, index));
+}
+
+void Uploader::cancelStreamed(uint64 id) {
+	if (!id) {
+		return;
+	}
+	_streamed.erase(id);
+	for (auto i = _streamedRequests.begin(); i != _streamedRequests.end();) {
+		if (i.value().first == id) {
+			MTP::cancel(i.key());
+			i = _streamedRequests.erase(i);
+		} else {
+			++i;
+		}
+	}
+	streamedRequestFinished(id);
+}
+
+void Uploader::applyStreamed(Queue::iterator i) {
+	auto id = i->id();
+	auto streamed = _streamed.find(id);
+	i->waitingStreamed = false;
+	if (streamed == _streamed.end()) {
+		return;
+	}
+
+	// Wait for the parts still in flight, they may be confirmed soon.
+	for (auto &request : _streamedRequests) {
+		if (request.first == id) {
+			i->waitingStreamed = true;
+			return;
+		}
+	}
+	auto parts = std::move(streamed->second);
+	_streamed.erase(streamed);
+
+	// Opus in ogg is written sequentially, but check the parts anyway:
+	// only the confirmed prefix that matches the final content is used.
+	auto &content = i->file->content;
+	if (i->type() != SendMediaType::Audio || content.isEmpty() || i->docSize > UseBigFilesFrom) {
+		return;
+	}
+	if (!i->setPartSize(DocumentUploadPartSize0)) {
+		i->setDocSize(i->docSize);
+		return;
+	}
+	auto ready = 0;
+	for (auto &part : parts) {
+		if (!part.confirmed || content.mid(ready * DocumentUploadPartSize0, DocumentUploadPartSize0) != part.bytes) {
+			break;
+		}
+		++ready;
+	}
+	if (!ready) {
+		i->setDocSize(i->docSize);
+		return;
+	}
+	for (auto index = 0; index != ready; ++index) {
+		i->md5Hash.feed(parts[index].bytes.constData(), parts[index].bytes.size());
+	}
+	i->docSentParts = ready;
+}
+
+void Uploader::fileFailed(const FullMsgId &msgId) {
+	for (auto i = requestsInfo.begin(); i != requestsInfo.end();) {
+		if (i.value().msgId == msgId) {
+			auto requestId = i.key();
+			MTP::cancel(requestId);
+			sentSize -= i.value().size;
+			sentSizes[i.value().dc] -= i.value().size;
+			requestsSent.remove(requestId);
+			docRequestsSent.remove(requestId);
+			i = requestsInfo.erase(i);
+		} else {
+			++i;
+		}
+	}
+
+	auto j = queue.find(msgId);
 	if (j != queue.end()) {
 		if (j->type() == SendMediaType::Photo) {
 			emit photoFailed(j.key());
@@ -89,15 +192,6 @@ void Uploader::currentFailed() {
 		queue.erase(j);
 	}
 
-	requestsSent.clear();
-	docRequestsSent.clear();
-	dcMap.clear();
-	uploading = FullMsgId();
-	sentSize = 0;
-	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
-		sentSizes[i] = 0;
-	}
-
 	sendNext();
 }
 
@@ -107,12 +201,33 @@ void Uploader::killSessions() {
 	}
 }
 
+Uploader::Queue::iterator Uploader::chooseFileToSend() {
+	// Several files from the queue start are uploaded at the same time,
+	// so that small photos don't wait behind a large video.
+	auto result = queue.end();
+	auto filesCount = 0;
+	for (auto i = queue.begin(), e = queue.end(); i != e && filesCount < kMaxUploadFilesParallel; ++i, ++filesCount) {
+		if (i->waitingStreamed || i->waitingRead()) {
+			continue;
+		} else if (!i->hasPartsToSend()) {
+			if (!i->requestsInFlight) {
+				return i;
+			}
+			continue;
+		}
+		if (result == e || i->sizeInFlight < result->sizeInFlight) {
+			result = i;
+		}
+	}
+	return result;
+}
+
 void Uploader::sendNext() {
-	if (sentSize >= kMaxUploadFileParallelSize || _paused.msg) return;
+	if (sentSize >= uint32(_parallelWindow.size()) * kUploadParallelSizeStep || _paused.msg) return;
 
 	bool killing = killSessionsTimer.isActive();
 	if (queue.isEmpty()) {
-		if (!killing) {
+		if (!killing && _streamedRequests.isEmpty()) {
 			killSessionsTimer.start(MTPAckSendWaiting + MTPKillFileSessionTimeout);
 		}
 		return;
@@ -121,13 +236,46 @@ void Uploader::sendNext() {
 	if (killing) {
 		killSessionsTimer.stop();
 	}
-	Queue::iterator i = uploading.msg ? queue.find(uploading) : queue.begin();
-	if (!uploading.msg) {
-		uploading = i.key();
-	} else if (i == queue.end()) {
-		i = queue.begin();
-		uploading = i.key();
+	auto i = chooseFileToSend();
+	if (i == queue.end()) {
+		return;
+	} else if (!i->hasPartsToSend()) {
+		fileReady(i);
+		sendNext();
+		return;
+	}
+	if (sendPart(i)) {
+		nextTimer.start(UploadRequestInterval);
 	}
+}
+
+void Uploader::fileReady(Queue::iterator i) {
+	auto msgId = i.key();
+	bool silent = i->file && i->file->to.silent;
+	if (i->type() == SendMediaType::Photo) {
+		auto photoFilename = i->filename();
+		if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
+			// Server has some extensions checking for inputMediaUploadedPhoto,
+			// so force the extension to be .jpg anyway. It doesn't matter,
+			// because the filename from inputFile is not used anywhere.
+			photoFilename += qstr(".jpg");
+		}
+		emit photoReady(msgId, silent, MTP_inputFile(MTP_long(i->id()), MTP_int(i->partsCount), MTP_string(photoFilename), MTP_bytes(i->file ? i->file->filemd5 : i->media.jpeg_md5)));
+	} else if (i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) {
+		QByteArray docMd5(32, Qt::Uninitialized);
+		hashMd5Hex(i->md5Hash.result(), docMd5.data());
+
+		MTPInputFile doc = (i->docSize > UseBigFilesFrom) ? MTP_inputFileBig(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename())) : MTP_inputFile(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename()), MTP_bytes(docMd5));
+		if (i->partsCount) {
+			emit thumbDocumentReady(msgId, silent, doc, MTP_inputFile(MTP_long(i->thumbId()), MTP_int(i->partsCount), MTP_string(i->file ? i->file->thumbname : (qsl("thumb.") + i->media.thumbExt)), MTP_bytes(i->file ? i->file->thumbmd5 : i->media.jpeg_md5)));
+		} else {
+			emit documentReady(msgId, silent, doc);
+		}
+	}
+	queue.remove(msgId);
+}
+
+bool Uploader::sendPart(Queue::iterator i) {
 	int todc = 0;
 	for (int dc = 1; dc < MTP::kUploadSessionsCount; ++dc) {
 		if (sentSizes[dc] < sentSizes[todc]) {
@@ -135,50 +283,23 @@ void Uploader::sendNext() {
 		}
 	}
 
-	UploadFileParts &parts(i->file ? (i->type() == SendMediaType::Photo ? i->file->fileparts : i->file->thumbparts) : i->media.parts);
-	uint64 partsOfId(i->file ? (i->type() == SendMediaType::Photo ? i->file->id : i->file->thumbId) : i->media.thumbId);
+	i->started = true;
+	auto &parts = i->parts();
 	if (parts.isEmpty()) {
-		if (i->docSentParts >= i->docPartsCount) {
-			if (requestsSent.isEmpty() && docRequestsSent.isEmpty()) {
-				bool silent = i->file && i->file->to.silent;
-				if (i->type() == SendMediaType::Photo) {
-					auto photoFilename = i->filename();
-					if (!photoFilename.endsWith(qstr(".jpg"), Qt::CaseInsensitive)) {
-						// Server has some extensions checking for inputMediaUploadedPhoto,
-						// so force the extension to be .jpg anyway. It doesn't matter,
-						// because the filename from inputFile is not used anywhere.
-						photoFilename += qstr(".jpg");
-					}
-					emit photoReady(uploading, silent, MTP_inputFile(MTP_long(i->id()), MTP_int(i->partsCount), MTP_string(photoFilename), MTP_bytes(i->file ? i->file->filemd5 : i->media.jpeg_md5)));
-				} else if (i->type() == SendMediaType::File || i->type() == SendMediaType::Audio) {
-					QByteArray docMd5(32, Qt::Uninitialized);
-					hashMd5Hex(i->md5Hash.result(), docMd5.data());
-
-					MTPInputFile doc = (i->docSize > UseBigFilesFrom) ? MTP_inputFileBig(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename())) : MTP_inputFile(MTP_long(i->id()), MTP_int(i->docPartsCount), MTP_string(i->filename()), MTP_bytes(docMd5));
-					if (i->partsCount) {
-						emit thumbDocumentReady(uploading, silent, doc, MTP_inputFile(MTP_long(i->thumbId()), MTP_int(i->partsCount), MTP_string(i->file ? i->file->thumbname : (qsl("thumb.") + i->media.thumbExt)), MTP_bytes(i->file ? i->file->thumbmd5 : i->media.jpeg_md5)));
-					} else {
-						emit documentReady(uploading, silent, doc);
-					}
-				}
-				queue.remove(uploading);
-				uploading = FullMsgId();
-				sendNext();
-			}
-			return;
-		}
-
 		QByteArray &content(i->file ? i->file->content : i->media.data);
 		QByteArray toSend;
 		if (content.isEmpty()) {
-			if (!i->docFile) {
-				i->docFile.reset(new QFile(i->file ? i->file->filepath : i->media.file));
-				if (!i->docFile->open(QIODevice::ReadOnly)) {
-					currentFailed();
-					return;
+			if (!i->docReader) {
+				i->docReader = std::make_shared<DocumentReader>(i->file ? i->file->filepath : i->media.file);
+				if (!i->docReader->file.open(QIODevice::ReadOnly)) {
+					fileFailed(i.key());
+					return false;
 				}
+				readNextPart(*i);
+				return false;
 			}
-			toSend = i->docFile->read(i->docPartSize);
+			toSend = base::take(i->docReader->part);
+			readNextPart(*i);
 			if (i->docSize <= UseBigFilesFrom) {
 				i->md5Hash.feed(toSend.constData(), toSend.size());
 			}
@@ -189,8 +310,8 @@ void Uploader::sendNext() {
 			}
 		}
 		if (toSend.size() > i->docPartSize || (toSend.size() < i->docPartSize && i->docSentParts + 1 != i->docPartsCount)) {
-			currentFailed();
-			return;
+			fileFailed(i.key());
+			return false;
 		}
 		mtpRequestId requestId;
 		if (i->docSize > UseBigFilesFrom) {
@@ -199,31 +320,85 @@ void Uploader::sendNext() {
 			requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(i->id()), MTP_int(i->docSentParts), MTP_bytes(toSend)), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
 		}
 		docRequestsSent.insert(requestId, i->docSentParts);
-		dcMap.insert(requestId, todc);
-		sentSize += i->docPartSize;
-		sentSizes[todc] += i->docPartSize;
+		placeSentRequest(requestId, i, todc, i->docPartSize);
 
 		i->docSentParts++;
 	} else {
 		UploadFileParts::iterator part = parts.begin();
 
-		mtpRequestId requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(partsOfId), MTP_int(part.key()), MTP_bytes(part.value())), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
+		mtpRequestId requestId = MTP::send(MTPupload_SaveFilePart(MTP_long(i->partsOfId()), MTP_int(part.key()), MTP_bytes(part.value())), rpcDone(&Uploader::partLoaded), rpcFail(&Uploader::partFailed), MTP::uploadDcId(todc));
 		requestsSent.insert(requestId, part.value());
-		dcMap.insert(requestId, todc);
-		sentSize += part.value().size();
-		sentSizes[todc] += part.value().size();
+		placeSentRequest(requestId, i, todc, part.value().size());
 
 		parts.erase(part);
 	}
-	nextTimer.start(UploadRequestInterval);
+	return true;
+}
+
+void Uploader::readNextPart(File &file) {
+	auto reader = file.docReader;
+	if (reader->reading || reader->partsRead >= file.docPartsCount) {
+		return;
+	}
+	reader->reading = true;
+	++reader->partsRead;
+	auto ready = base::lambda_guarded(this, [this, weak = std::weak_ptr<DocumentReader>(reader)](QByteArray part) {
+		if (auto strong = weak.lock()) {
+			strong->part = std::move(part);
+			strong->reading = false;
+			sendNext();
+		}
+	});
+
+	// Only one read is in flight for each file, so the reads are sequential.
+	base::TaskQueue::Normal().Put([ready = std::move(ready), reader, size = file.docPartSize]() mutable {
+		auto part = reader->file.read(size);
+		base::TaskQueue::Main().Put([ready = std::move(ready), part = std::move(part)]() mutable {
+			ready(std::move(part));
+		});
+	});
+}
+
+void Uploader::placeSentRequest(mtpRequestId requestId, Queue::iterator i, int dc, uint32 size) {
+	auto info = SentRequest();
+	info.msgId = i.key();
+	info.dc = dc;
+	info.size = size;
+	info.sent = getms();
+	requestsInfo.insert(requestId, info);
+
+	sentSize += size;
+	sentSizes[dc] += size;
+	++i->requestsInFlight;
+	i->sizeInFlight += size;
+}
+
+Uploader::SentRequest Uploader::finishSentRequest(mtpRequestId requestId) {
+	auto result = requestsInfo.take(requestId);
+	requestsSent.remove(requestId);
+	docRequestsSent.remove(requestId);
+	sentSize -= result.size;
+	sentSizes[result.dc] -= result.size;
+
+	auto i = queue.find(result.msgId);
+	if (i != queue.end()) {
+		--i->requestsInFlight;
+		i->sizeInFlight -= result.size;
+	}
+	return result;
 }
 
 void Uploader::cancel(const FullMsgId &msgId) {
 	uploaded.remove(msgId);
-	if (uploading == msgId) {
-		currentFailed();
+	auto i = queue.find(msgId);
+	if (i == queue.end()) {
+		return;
+	} else if (i->started) {
+		fileFailed(msgId);
 	} else {
-		queue.remove(msgId);
+		auto waitingId = i->waitingStreamed ? i->id() : 0;
+		queue.erase(i);
+		cancelStreamed(waitingId);
 	}
 }
 
@@ -242,15 +417,17 @@ void Uploader::confirm(const FullMsgId &msgId) {
 void Uploader::clear() {
 	uploaded.clear();
 	queue.clear();
-	for (QMap<mtpRequestId, QByteArray>::const_iterator i = requestsSent.cbegin(), e = requestsSent.cend(); i != e; ++i) {
+	for (auto i = requestsInfo.cbegin(), e = requestsInfo.cend(); i != e; ++i) {
 		MTP::cancel(i.key());
 	}
 	requestsSent.clear();
-	for (QMap<mtpRequestId, int32>::const_iterator i = docRequestsSent.cbegin(), e = docRequestsSent.cend(); i != e; ++i) {
+	docRequestsSent.clear();
+	requestsInfo.clear();
+	for (auto i = _streamedRequests.cbegin(), e = _streamedRequests.cend(); i != e; ++i) {
 		MTP::cancel(i.key());
 	}
-	docRequestsSent.clear();
-	dcMap.clear();
+	_streamedRequests.clear();
+	_streamed.clear();
 	sentSize = 0;
 	for (int i = 0; i < MTP::kUploadSessionsCount; ++i) {
 		MTP::stopSession(MTP::uploadDcId(i));
@@ -260,53 +437,36 @@ void Uploader::clear() {
 }
 
 void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
-	QMap<mtpRequestId, int32>::iterator j = docRequestsSent.end();
-	QMap<mtpRequestId, QByteArray>::iterator i = requestsSent.find(requestId);
-	if (i == requestsSent.cend()) {
-		j = docRequestsSent.find(requestId);
-	}
-	if (i != requestsSent.cend() || j != docRequestsSent.cend()) {
-		if (mtpIsFalse(result)) { // failed to upload current file
-			currentFailed();
-			return;
-		} else {
-			QMap<mtpRequestId, int32>::iterator dcIt = dcMap.find(requestId);
-			if (dcIt == dcMap.cend()) { // must not happen
-				currentFailed();
-				return;
-			}
-			int32 dc = dcIt.value();
-			dcMap.erase(dcIt);
-
-			int32 sentPartSize = 0;
-			Queue::const_iterator k = queue.constFind(uploading);
-			if (i != requestsSent.cend()) {
-				sentPartSize = i.value().size();
-				requestsSent.erase(i);
-			} else {
-				sentPartSize = k->docPartSize;
-				docRequestsSent.erase(j);
+	if (!requestsInfo.contains(requestId)) {
+		sendNext();
+		return;
+	}
+	auto info = finishSentRequest(requestId);
+	if (mtpIsFalse(result)) { // failed to upload current file
+		fileFailed(info.msgId);
+		return;
+	}
+	_parallelWindow.requestDone(getms() - info.sent);
+
+	auto k = queue.find(info.msgId);
+	if (k != queue.end()) {
+		if (k->type() == SendMediaType::Photo) {
+			k->fileSentSize += info.size;
+			PhotoData *photo = App::photo(k->id());
+			if (photo->uploading() && k->file) {
+				photo->uploadingData->size = k->file->partssize;
+				photo->uploadingData->offset = k->fileSentSize;
 			}
-			sentSize -= sentPartSize;
-			sentSizes[dc] -= sentPartSize;
-			if (k->type() == SendMediaType::Photo) {
-				k->fileSentSize += sentPartSize;
-				PhotoData *photo = App::photo(k->id());
-				if (photo->uploading() && k->file) {
-					photo->uploadingData->size = k->file->partssize;
-					photo->uploadingData->offset = k->fileSentSize;
-				}
-				emit photoProgress(k.key());
-			} else if (k->type() == SendMediaType::File || k->type() == SendMediaType::Audio) {
-				DocumentData *doc = App::document(k->id());
-				if (doc->uploading()) {
-					doc->uploadOffset = (k->docSentParts - docRequestsSent.size()) * k->docPartSize;
-					if (doc->uploadOffset > doc->size) {
-						doc->uploadOffset = doc->size;
-					}
+			emit photoProgress(k.key());
+		} else if (k->type() == SendMediaType::File || k->type() == SendMediaType::Audio) {
+			DocumentData *doc = App::document(k->id());
+			if (doc->uploading()) {
+				doc->uploadOffset = (k->docSentParts - k->requestsInFlight) * k->docPartSize;
+				if (doc->uploadOffset > doc->size) {
+					doc->uploadOffset = doc->size;
 				}
-				emit documentProgress(k.key());
 			}
+			emit documentProgress(k.key());
 		}
 	}
 
@@ -316,13 +476,58 @@ void Uploader::partLoaded(const MTPBool &result, mtpRequestId requestId) {
 bool Uploader::partFailed(const RPCError &error, mtpRequestId requestId) {
 	if (MTP::isDefaultHandledError(error)) return false;
 
-	if (requestsSent.constFind(requestId) != requestsSent.cend() || docRequestsSent.constFind(requestId) != docRequestsSent.cend()) { // failed to upload current file
-		currentFailed();
+	if (requestsInfo.contains(requestId)) { // failed to upload current file
+		auto info = finishSentRequest(requestId);
+		fileFailed(info.msgId);
 	}
 	sendNext();
 	return true;
 }
 
+void Uploader::streamedPartLoaded(const MTPBool &result, mtpRequestId requestId) {
+	auto request = _streamedRequests.find(requestId);
+	if (request == _streamedRequests.end()) {
+		return;
+	}
+	auto id = request.value().first;
+	auto index = request.value().second;
+	_streamedRequests.erase(request);
+
+	auto i = _streamed.find(id);
+	if (i != _streamed.end() && index < int(i->second.size())) {
+		i->second[index].confirmed = mtpIsTrue(result);
+	}
+	streamedRequestFinished(id);
+}
+
+bool Uploader::streamedPartFailed(const RPCError &error, mtpRequestId requestId) {
+	if (MTP::isDefaultHandledError(error)) return false;
+
+	// The part stays not confirmed and will be uploaded with the ready file.
+	auto request = _streamedRequests.find(requestId);
+	if (request != _streamedRequests.end()) {
+		auto id = request.value().first;
+		_streamedRequests.erase(request);
+		streamedRequestFinished(id);
+	}
+	return true;
+}
+
+void Uploader::streamedRequestFinished(uint64 id) {
+	for (auto &request : _streamedRequests) {
+		if (request.first == id) {
+			return;
+		}
+	}
+	for (auto i = queue.begin(), e = queue.end(); i != e; ++i) {
+		if (i->waitingStreamed && i->id() == id) {
+			applyStreamed(i);
+			break;
+		}
+	}
+	sendNext();
+}
+
 Uploader::~Uploader() {
 	clear();
 }
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "storage/localimageloader.h"
+#include "storage/requests_window.h"
 
 namespace Storage {
 
@@ -39,6 +40,13 @@ public:
 	void pause(const FullMsgId &msgId);
 	void confirm(const FullMsgId &msgId);
 
+	// Parts of a file that is still being created (a voice message while
+	// recording) are uploaded before the file is ready. When the file
+	// with this id is passed to upload() the matching parts are skipped.
+	uint64 startStreamed();
+	void feedStreamed(uint64 id, const QByteArray &part);
+	void cancelStreamed(uint64 id);
+
 	void clear();
 
 	~Uploader();
@@ -60,6 +68,17 @@ signals:
 	void documentFailed(const FullMsgId &msgId);
 
 private:
+	// Document parts are read from disk on the task queue one part ahead.
+	struct DocumentReader {
+		DocumentReader(const QString &path) : file(path) {
+		}
+
+		QFile file;
+		QByteArray part;
+		int32 partsRead = 0;
+		bool reading = false;
+	};
+
 	struct File {
 		File(const SendMediaReady &media) : media(media), docSentParts(0) {
 			partsCount = media.parts.size();
@@ -114,29 +133,74 @@ private:
 		const QString &filename() const {
 			return file ? file->filename : media.filename;
 		}
+		UploadFileParts &parts() {
+			return file ? (type() == SendMediaType::Photo ? file->fileparts : file->thumbparts) : media.parts;
+		}
+		uint64 partsOfId() const {
+			return file ? (type() == SendMediaType::Photo ? file->id : file->thumbId) : media.thumbId;
+		}
+		bool hasPartsToSend() {
+			return !parts().isEmpty() || (docSentParts < docPartsCount);
+		}
+		bool waitingRead() const {
+			return docReader && docReader->reading;
+		}
 
 		HashMd5 md5Hash;
 
-		QSharedPointer<QFile> docFile;
+		std::shared_ptr<DocumentReader> docReader;
 		int32 docSentParts;
 		int32 docSize;
 		int32 docPartSize;
 		int32 docPartsCount;
+
+		bool started = false;
+		bool waitingStreamed = false;
+		int32 requestsInFlight = 0;
+		uint32 sizeInFlight = 0;
 	};
 	typedef QMap<FullMsgId, File> Queue;
 
+	struct SentRequest {
+		FullMsgId msgId;
+		int dc = 0;
+		uint32 size = 0;
+		TimeMs sent = 0;
+	};
+
+	struct StreamedPart {
+		QByteArray bytes;
+		bool confirmed = false;
+	};
+
 	void partLoaded(const MTPBool &result, mtpRequestId requestId);
 	bool partFailed(const RPCError &err, mtpRequestId requestId);
-
-	void currentFailed();
+	void streamedPartLoaded(const MTPBool &result, mtpRequestId requestId);
+	bool streamedPartFailed(const RPCError &err, mtpRequestId requestId);
+	void applyStreamed(Queue::iterator i);
+	void streamedRequestFinished(uint64 id);
+
+	Queue::iterator chooseFileToSend();
+	bool sendPart(Queue::iterator i);
+	void readNextPart(File &file);
+	void fileReady(Queue::iterator i);
+	void fileFailed(const FullMsgId &msgId);
+	void placeSentRequest(mtpRequestId requestId, Queue::iterator i, int dc, uint32 size);
+	SentRequest finishSentRequest(mtpRequestId requestId);
 
 	QMap<mtpRequestId, QByteArray> requestsSent;
 	QMap<mtpRequestId, int32> docRequestsSent;
-	QMap<mtpRequestId, int32> dcMap;
+	QMap<mtpRequestId, SentRequest> requestsInfo;
 	uint32 sentSize = 0;
 	uint32 sentSizes[MTP::kUploadSessionsCount] = { 0 };
 
-	FullMsgId uploading, _paused;
+	// Steps of bytes allowed in flight, adjusted by the part request durations.
+	RequestsWindow _parallelWindow;
+
+	std::map<uint64, std::vector<StreamedPart>> _streamed;
+	QMap<mtpRequestId, QPair<uint64, int>> _streamedRequests;
+
+	FullMsgId _paused;
 	Queue queue;
 	Queue uploaded;
 	QTimer nextTimer, killSessionsTimer;
@@ -0,0 +1,116 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/file_writer.h"
+
+#include "base/task_queue.h"
+
+#include <atomic>
+
+namespace Storage {
+namespace {
+
+void Notify(FileWriter::Callback &&done, bool success) {
+	if (done) {
+		base::TaskQueue::Main().Put([done = std::move(done), success]() mutable {
+			done(success);
+		});
+	}
+}
+
+} // namespace
+
+// Used only in the background queue after the construction.
+struct FileWriter::Data {
+	Data(const QString &path, int preallocateSize)
+	: path(path)
+	, preallocateSize(preallocateSize) {
+	}
+
+	bool ensureOpened();
+
+	const QString path;
+	const int preallocateSize = 0;
+	std::unique_ptr<QFile> file;
+	bool failed = false;
+	std::atomic<bool> removed = { false };
+
+};
+
+bool FileWriter::Data::ensureOpened() {
+	if (file) {
+		return file->isOpen();
+	}
+	file = std::make_unique<QFile>(path);
+	if (!file->open(QIODevice::ReadWrite)) {
+		return false;
+	}
+	if (preallocateSize > 0 && file->size() < preallocateSize) {
+		// Parts are written out of order, not being able to
+		// preallocate the whole file is not an error.
+		file->resize(preallocateSize);
+	}
+	return true;
+}
+
+FileWriter::FileWriter(not_null<base::TaskQueue*> queue, const QString &path, int preallocateSize)
+: _queue(queue)
+, _data(std::make_shared<Data>(path, preallocateSize)) {
+}
+
+void FileWriter::write(int offset, QByteArray &&bytes, Callback done) {
+	_queue->Put([data = _data, offset, bytes = std::move(bytes), done = std::move(done)]() mutable {
+		if (data->removed) {
+			return;
+		}
+		if (!data->failed) {
+			data->failed = !data->ensureOpened()
+				|| !data->file->seek(offset)
+				|| data->file->write(bytes) != qint64(bytes.size())
+				|| !data->file->flush();
+		}
+		Notify(std::move(done), !data->failed);
+	});
+}
+
+void FileWriter::close(Callback done) {
+	_queue->Put([data = _data, done = std::move(done)]() mutable {
+		if (data->file) {
+			data->file->close();
+		}
+		Notify(std::move(done), !data->failed && !data->removed);
+	});
+}
+
+void FileWriter::remove() {
+	_data->removed = true;
+	_queue->Put([data = _data] {
+		if (data->file) {
+			data->file->close();
+		}
+		QFile::remove(data->path);
+	});
+}
+
+FileWriter::~FileWriter() {
+	// The file is closed when the last queued task releases the data.
+}
+
+} // namespace Storage
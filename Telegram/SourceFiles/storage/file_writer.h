@@ -0,0 +1,63 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace base {
+class TaskQueue;
+} // namespace base
+
+namespace Storage {
+
+// Writes the parts of a file that is being downloaded in a serial
+// background queue, so that a slow disk doesn't block the main thread.
+// All the methods are called from the main thread, the callbacks are
+// called there too.
+class FileWriter {
+public:
+	using Callback = base::lambda_once<void(bool success)>;
+
+	// The file is opened for read and write and resized to at least
+	// preallocateSize bytes before the first part is written to it.
+	FileWriter(not_null<base::TaskQueue*> queue, const QString &path, int preallocateSize);
+
+	FileWriter(const FileWriter &other) = delete;
+	FileWriter &operator=(const FileWriter &other) = delete;
+
+	// The part is flushed to the file before done() is called.
+	void write(int offset, QByteArray &&bytes, Callback done);
+
+	// Closes the file after all the written parts.
+	void close(Callback done);
+
+	// Closes and removes the file, the parts not yet written are skipped.
+	void remove();
+
+	~FileWriter();
+
+private:
+	struct Data;
+
+	const not_null<base::TaskQueue*> _queue;
+	std::shared_ptr<Data> _data;
+
+};
+
+} // namespace Storage
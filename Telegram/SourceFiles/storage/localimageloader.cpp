@@ -36,9 +36,17 @@ bool ValidateThumbDimensions(int width, int height) {
 	return (width > 0) && (height > 0) && (width < 20 * height) && (height < 20 * width);
 }
 
+QImage ScaleToBox(const QImage &image, int box) {
+	return (image.width() > box || image.height() > box)
+		? image.scaled(box, box, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+		: image;
+}
+
 } // namespace
 
-TaskQueue::TaskQueue(QObject *parent, int32 stopTimeoutMs) : QObject(parent), _thread(0), _worker(0), _stopTimer(0) {
+TaskQueue::TaskQueue(QObject *parent, int32 stopTimeoutMs, int workersCount) : QObject(parent)
+, _workersCount(std::max(workersCount, 1))
+, _stopTimer(0) {
 	if (stopTimeoutMs > 0) {
 		_stopTimer = new QTimer(this);
 		connect(_stopTimer, SIGNAL(timeout()), this, SLOT(stop()));
@@ -51,6 +59,7 @@ TaskId TaskQueue::addTask(TaskPtr task) {
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
 		_tasksToProcess.push_back(task);
+		_tasksInOrder.push_back(task);
 	}
 
 	wakeThread();
@@ -62,44 +71,86 @@ void TaskQueue::addTasks(const TasksList &tasks) {
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
 		_tasksToProcess.append(tasks);
+		_tasksInOrder.append(tasks);
 	}
 
 	wakeThread();
 }
 
 void TaskQueue::wakeThread() {
-	if (!_thread) {
-		_thread = new QThread();
-
-		_worker = new TaskQueueWorker(this);
-		_worker->moveToThread(_thread);
-
-		connect(this, SIGNAL(taskAdded()), _worker, SLOT(onTaskAdded()));
-		connect(_worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
-
-		_thread->start();
+	if (_threads.empty()) {
+		for (auto i = 0; i != _workersCount; ++i) {
+			auto thread = new QThread();
+			auto worker = new TaskQueueWorker(this);
+			worker->moveToThread(thread);
+
+			connect(this, SIGNAL(taskAdded()), worker, SLOT(onTaskAdded()));
+			connect(worker, SIGNAL(taskProcessed()), this, SLOT(onTaskProcessed()));
+
+			thread->start();
+			_threads.push_back(thread);
+			_workers.push_back(worker);
+		}
 	}
 	if (_stopTimer) _stopTimer->stop();
 	emit taskAdded();
 }
 
 void TaskQueue::cancelTask(TaskId id) {
+	auto removeFrom = [id](TasksList &list) {
+		for (int32 i = 0, l = list.size(); i != l; ++i) {
+			if (list.at(i)->id() == id) {
+				list.removeAt(i);
+				return true;
+			}
+		}
+		return false;
+	};
 	{
 		QMutexLocker lock(&_tasksToProcessMutex);
-		for (int32 i = 0, l = _tasksToProcess.size(); i != l; ++i) {
-			if (_tasksToProcess.at(i)->id() == id) {
-				_tasksToProcess.removeAt(i);
-				return;
+		removeFrom(_tasksToProcess);
+		if (removeFrom(_tasksInOrder)) {
+			// The tasks after the cancelled one could be waiting for it.
+			_tasksProcessed.remove(id);
+			if (moveProcessedToFinish()) {
+				QMetaObject::invokeMethod(this, "onTaskProcessed", Qt::QueuedConnection);
 			}
+			return;
 		}
 	}
 	QMutexLocker lock(&_tasksToFinishMutex);
-	for (int32 i = 0, l = _tasksToFinish.size(); i != l; ++i) {
-		if (_tasksToFinish.at(i)->id() == id) {
-			_tasksToFinish.removeAt(i);
-			return;
+	removeFrom(_tasksToFinish);
+}
+
+TaskPtr TaskQueue::takeTaskToProcess() {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	return _tasksToProcess.isEmpty() ? TaskPtr() : _tasksToProcess.takeFirst();
+}
+
+bool TaskQueue::taskProcessed(const TaskPtr &task) {
+	QMutexLocker lock(&_tasksToProcessMutex);
+	if (!_tasksInOrder.contains(task)) {
+		return false; // Cancelled while processing.
+	}
+	_tasksProcessed.insert(task->id());
+	return moveProcessedToFinish();
+}
+
+// Must be called with _tasksToProcessMutex locked.
+// Returns true if taskProcessed() should be emitted.
+bool TaskQueue::moveProcessedToFinish() {
+	auto result = false;
+	while (!_tasksInOrder.isEmpty() && _tasksProcessed.contains(_tasksInOrder.front()->id())) {
+		auto task = _tasksInOrder.takeFirst();
+		_tasksProcessed.remove(task->id());
+
+		QMutexLocker lock(&_tasksToFinishMutex);
+		if (_tasksToFinish.isEmpty()) {
+			result = true;
 		}
+		_tasksToFinish.push_back(task);
 	}
+	return result;
 }
 
 void TaskQueue::onTaskProcessed() {
@@ -116,24 +167,32 @@ void TaskQueue::onTaskProcessed() {
 
 	if (_stopTimer) {
 		QMutexLocker lock(&_tasksToProcessMutex);
-		if (_tasksToProcess.isEmpty()) {
+		if (_tasksInOrder.isEmpty()) {
 			_stopTimer->start();
 		}
 	}
 }
 
 void TaskQueue::stop() {
-	if (_thread) {
-		_thread->requestInterruption();
-		_thread->quit();
+	if (!_threads.empty()) {
+		for (auto thread : _threads) {
+			thread->requestInterruption();
+			thread->quit();
+		}
 		DEBUG_LOG(("Waiting for taskThread to finish"));
-		_thread->wait();
-		delete _worker;
-		delete _thread;
-		_worker = 0;
-		_thread = 0;
+		for (auto thread : _threads) {
+			thread->wait();
+		}
+		for (auto worker : base::take(_workers)) {
+			delete worker;
+		}
+		for (auto thread : base::take(_threads)) {
+			delete thread;
+		}
 	}
 	_tasksToProcess.clear();
+	_tasksInOrder.clear();
+	_tasksProcessed.clear();
 	_tasksToFinish.clear();
 }
 
@@ -146,36 +205,17 @@ void TaskQueueWorker::onTaskAdded() {
 	if (_inTaskAdded) return;
 	_inTaskAdded = true;
 
-	bool someTasksLeft = false;
-	do {
-		TaskPtr task;
-		{
-			QMutexLocker lock(&_queue->_tasksToProcessMutex);
-			if (!_queue->_tasksToProcess.isEmpty()) {
-				task = _queue->_tasksToProcess.front();
-			}
+	while (!thread()->isInterruptionRequested()) {
+		auto task = _queue->takeTaskToProcess();
+		if (!task) {
+			break;
 		}
-
-		if (task) {
-			task->process();
-			bool emitTaskProcessed = false;
-			{
-				QMutexLocker lockToProcess(&_queue->_tasksToProcessMutex);
-				if (!_queue->_tasksToProcess.isEmpty() && _queue->_tasksToProcess.front() == task) {
-					_queue->_tasksToProcess.pop_front();
-					someTasksLeft = !_queue->_tasksToProcess.isEmpty();
-
-					QMutexLocker lockToFinish(&_queue->_tasksToFinishMutex);
-					emitTaskProcessed = _queue->_tasksToFinish.isEmpty();
-					_queue->_tasksToFinish.push_back(task);
-				}
-			}
-			if (emitTaskProcessed) {
-				emit taskProcessed();
-			}
+		task->process();
+		if (_queue->taskProcessed(task)) {
+			emit taskProcessed();
 		}
 		QCoreApplication::processEvents();
-	} while (someTasksLeft && !thread()->isInterruptionRequested());
+	}
 
 	_inTaskAdded = false;
 }
@@ -196,7 +236,7 @@ FileLoadTask::FileLoadTask(const QByteArray &content, const QImage &image, SendM
 , _caption(caption) {
 }
 
-FileLoadTask::FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption) : _id(rand_value<uint64>())
+FileLoadTask::FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption, uint64 streamedId) : _id(streamedId ? streamedId : rand_value<uint64>())
 , _to(to)
 , _content(voice)
 , _duration(duration)
@@ -299,6 +339,11 @@ bool FileLoadTask::CheckForImage(const QString &filepath, const QByteArray &cont
 		if (!content.isEmpty()) {
 			return App::readImage(content, nullptr, false, &animated);
 		} else if (!filepath.isEmpty()) {
+			// Check the header before reading the whole file in memory,
+			// most of the files sent as documents are not images at all.
+			if (!QImageReader(filepath).canRead()) {
+				return QImage();
+			}
 			return App::readImage(filepath, nullptr, false, &animated);
 		}
 		return QImage();
@@ -485,26 +530,34 @@ void FileLoadTask::process() {
 		attributes.push_back(MTP_documentAttributeImageSize(MTP_int(w), MTP_int(h)));
 
 		if (ValidateThumbDimensions(w, h)) {
+			// Each smaller size is scaled from the previous one, so the
+			// original image is resampled only once even for huge photos.
+			auto thumbSource = fullimage;
 			if (isAnimation) {
 				attributes.push_back(MTP_documentAttributeAnimated());
 			} else if (_type != SendMediaType::File) {
-				auto thumb = (w > 100 || h > 100) ? App::pixmapFromImageInPlace(fullimage.scaled(100, 100, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
+				auto fullScaled = ScaleToBox(fullimage, 1280);
+				auto mediumScaled = ScaleToBox(fullScaled, 320);
+				auto thumbScaled = ScaleToBox(mediumScaled, 100);
+				thumbSource = mediumScaled;
+
+				auto thumb = QPixmap::fromImage(thumbScaled);
 				photoThumbs.insert('s', thumb);
 				photoSizes.push_back(MTP_photoSize(MTP_string("s"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(thumb.width()), MTP_int(thumb.height()), MTP_int(0)));
 
-				auto medium = (w > 320 || h > 320) ? App::pixmapFromImageInPlace(fullimage.scaled(320, 320, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
+				auto medium = QPixmap::fromImage(mediumScaled);
 				photoThumbs.insert('m', medium);
 				photoSizes.push_back(MTP_photoSize(MTP_string("m"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(medium.width()), MTP_int(medium.height()), MTP_int(0)));
 
-				auto full = (w > 1280 || h > 1280) ? App::pixmapFromImageInPlace(fullimage.scaled(1280, 1280, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage);
-				photoThumbs.insert('y', full);
-				photoSizes.push_back(MTP_photoSize(MTP_string("y"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(full.width()), MTP_int(full.height()), MTP_int(0)));
-
 				{
 					QBuffer buffer(&filedata);
-					full.save(&buffer, "JPG", 87);
+					fullScaled.save(&buffer, "JPG", 87);
 				}
 
+				auto full = QPixmap::fromImage(fullScaled);
+				photoThumbs.insert('y', full);
+				photoSizes.push_back(MTP_photoSize(MTP_string("y"), MTP_fileLocationUnavailable(MTP_long(0), MTP_int(0), MTP_long(0)), MTP_int(full.width()), MTP_int(full.height()), MTP_int(0)));
+
 				photo = MTP_photo(MTP_flags(0), MTP_long(_id), MTP_long(0), MTP_int(unixtime()), MTP_vector<MTPPhotoSize>(photoSizes));
 
 				if (filesize < 0) {
@@ -526,7 +579,7 @@ void FileLoadTask::process() {
 				thumbname = qsl("thumb.webp");
 			}
 
-			QPixmap full = (w > 90 || h > 90) ? App::pixmapFromImageInPlace(fullimage.scaled(90, 90, Qt::KeepAspectRatio, Qt::SmoothTransformation)) : QPixmap::fromImage(fullimage, Qt::ColorOnly);
+			QPixmap full = QPixmap::fromImage(ScaleToBox(thumbSource, 90), Qt::ColorOnly);
 
 			{
 				QBuffer buffer(&thumbdata);
@@ -122,7 +122,10 @@ class TaskQueue : public QObject {
 	Q_OBJECT
 
 public:
-	TaskQueue(QObject *parent, int32 stopTimeoutMs = 0); // <= 0 - never stop worker
+	// stopTimeoutMs <= 0 - never stop workers.
+	// Tasks are processed by workersCount threads in parallel,
+	// but their finish() is always called in the order they were added.
+	TaskQueue(QObject *parent, int32 stopTimeoutMs = 0, int workersCount = 1);
 
 	TaskId addTask(TaskPtr task);
 	void addTasks(const TasksList &tasks);
@@ -141,11 +144,16 @@ private:
 	friend class TaskQueueWorker;
 
 	void wakeThread();
+	TaskPtr takeTaskToProcess();
+	bool taskProcessed(const TaskPtr &task);
+	bool moveProcessedToFinish();
 
-	TasksList _tasksToProcess, _tasksToFinish;
+	TasksList _tasksToProcess, _tasksInOrder, _tasksToFinish;
+	QSet<TaskId> _tasksProcessed;
 	QMutex _tasksToProcessMutex, _tasksToFinishMutex;
-	QThread *_thread;
-	TaskQueueWorker *_worker;
+	int _workersCount = 1;
+	std::vector<QThread*> _threads;
+	std::vector<TaskQueueWorker*> _workers;
 	QTimer *_stopTimer;
 
 };
@@ -262,7 +270,7 @@ public:
 
 	FileLoadTask(const QString &filepath, std::unique_ptr<MediaInformation> information, SendMediaType type, const FileLoadTo &to, const QString &caption);
 	FileLoadTask(const QByteArray &content, const QImage &image, SendMediaType type, const FileLoadTo &to, const QString &caption);
-	FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption);
+	FileLoadTask(const QByteArray &voice, int32 duration, const VoiceWaveform &waveform, const FileLoadTo &to, const QString &caption, uint64 streamedId = 0);
 
 	uint64 fileid() const {
 		return _id;
@@ -22,6 +22,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 #include "storage/serialize_document.h"
 #include "storage/serialize_common.h"
+#include "storage/cache_pack.h"
 #include "data/data_drafts.h"
 #include "window/themes/window_theme.h"
 #include "observer_peer.h"
@@ -36,7 +37,9 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "apiwrap.h"
 #include "auth_session.h"
 #include "window/window_controller.h"
+#include "dialogs/dialogs_indexed_list.h"
 #include "base/flags.h"
+#include "base/task_queue.h"
 
 #include <openssl/evp.h>
 
@@ -44,6 +47,16 @@ namespace Local {
 namespace {
 
 constexpr int kThemeFileSizeLimit = 5 * 1024 * 1024;
+constexpr auto kCacheLimitsCheckTimeout = 10 * 1000; // 10 seconds
+constexpr auto kCacheEvictTargetPercent = 90; // evict down to 90% of the limit
+constexpr auto kMediaAccessPrecision = 3600; // 1 hour
+constexpr auto kDialogsSnapshotLimit = 100; // top chats list rows kept locally
+constexpr auto kDialogsSnapshotSchema = 1; // increment on any format change
+constexpr auto kHistoryCacheLimit = 32; // recently opened chats with cached messages
+constexpr auto kHistoryCacheSchema = 1; // increment on any format change
+constexpr auto kVoiceWaveformsLimit = 1000; // counted waveforms of the latest voice messages
+constexpr auto kPreparedUserpicsLimit = 32; // chats list userpics kept prepared locally
+constexpr auto kLocationsLogLimit = 1024; // appended file locations before the full rewrite
 
 using FileKey = quint64;
 
@@ -112,12 +125,128 @@ FileKey genKey(FileOptions options = FileOption::User | FileOption::Safe) {
 	return result;
 }
 
+// Startup files are read and decrypted on the thread pool ahead of time,
+// so that the main thread only has to parse the ready data.
+class FilesPrefetch {
+public:
+	struct File {
+		bool success = false;
+		int32 version = 0;
+		QByteArray data;
+		qint64 position = 0;
+	};
+
+	// Returns false if this file is already prefetched.
+	bool add(const QString &name, FileOptions options, const MTP::AuthKeyPtr &key) {
+		QMutexLocker lock(&_mutex);
+		if (_entries.contains(name)) {
+			return false;
+		}
+		auto &entry = _entries[name];
+		entry.options = options;
+		entry.key = key;
+		return true;
+	}
+
+	// Returns false if the prefetch was cancelled before it was started.
+	bool start(const QString &name) {
+		QMutexLocker lock(&_mutex);
+		auto i = _entries.find(name);
+		if (i == _entries.end()) {
+			return false;
+		}
+		i->started = true;
+		return true;
+	}
+	void finish(const QString &name, File &&file) {
+		QMutexLocker lock(&_mutex);
+		auto i = _entries.find(name);
+		if (i != _entries.end()) {
+			i->file = std::move(file);
+			i->ready = true;
+			_finished.wakeAll();
+		}
+	}
+
+	// Takes the result of a prefetch of this file, waits for it if it is
+	// being read right now. A prefetch that was not started yet is cancelled.
+	// Returns false if the file was not prefetched with the same options,
+	// then the caller reads it by itself.
+	bool take(const QString &name, FileOptions options, const MTP::AuthKeyPtr &key, File *result) {
+		QMutexLocker lock(&_mutex);
+		auto i = waitStarted(name);
+		if (i == _entries.end()) {
+			return false;
+		}
+		auto matches = (i->options == options) && (i->key == key);
+		if (matches) {
+			*result = std::move(i->file);
+		}
+		_entries.erase(i);
+		return matches;
+	}
+
+	// The file is going to be changed, the prefetched data is outdated.
+	// Waits for the prefetch that is being read, because reading removes
+	// the older of the two safe file copies, that one may be written next.
+	void drop(const QString &name) {
+		QMutexLocker lock(&_mutex);
+		auto i = waitStarted(name);
+		if (i != _entries.end()) {
+			_entries.erase(i);
+		}
+	}
+	void clear() {
+		QMutexLocker lock(&_mutex);
+		for (auto i = _entries.begin(); i != _entries.end();) {
+			if (i->ready || !i->started) {
+				i = _entries.erase(i);
+			} else {
+				_finished.wait(&_mutex);
+				i = _entries.begin();
+			}
+		}
+	}
+
+private:
+	struct Entry {
+		FileOptions options;
+		MTP::AuthKeyPtr key;
+		bool started = false;
+		bool ready = false;
+		File file;
+	};
+
+	// Must be called with the mutex locked. Cancels the prefetch if it
+	// was not started yet, otherwise waits until it is finished.
+	QMap<QString, Entry>::iterator waitStarted(const QString &name) {
+		auto i = _entries.find(name);
+		while (i != _entries.end() && !i->ready) {
+			if (!i->started) {
+				_entries.erase(i);
+				return _entries.end();
+			}
+			_finished.wait(&_mutex);
+			i = _entries.find(name);
+		}
+		return i;
+	}
+	QMutex _mutex;
+	QWaitCondition _finished;
+	QMap<QString, Entry> _entries;
+
+};
+
+// Shared with the thread pool tasks that may outlive the storage.
+auto Prefetch = std::make_shared<FilesPrefetch>();
+
 void clearKey(const FileKey &key, FileOptions options = FileOption::User | FileOption::Safe) {
 	if (options & FileOption::User) {
 		if (!_userWorking()) return;
 	} else {
 		if (!_working()) return;
 	}
+	Prefetch->drop(toFilePart(key));
 
 	QString base = (options & FileOption::User) ? _userBasePath : _basePath, name;
 	name.reserve(base.size() + 0x11);
@@ -214,18 +343,26 @@ struct FileWriteDescriptor {
 	FileWriteDescriptor(const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
 		init(name, options);
 	}
+
+	// For the writes in a background thread, the base path is taken in the main one.
+	FileWriteDescriptor(const QString &basePath, const QString &name, FileOptions options) {
+		open(basePath + name, options);
+	}
 	void init(const QString &name, FileOptions options) {
 		if (options & FileOption::User) {
 			if (!_userWorking()) return;
 		} else {
 			if (!_working()) return;
 		}
-
+		Prefetch->drop(name);
+		open(((options & FileOption::User) ? _userBasePath : _basePath) + name, options);
+	}
+	void open(const QString &path, FileOptions options) {
 		// detect order of read attempts and file version
 		QString toTry[2];
-		toTry[0] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '0';
+		toTry[0] = path + '0';
 		if (options & FileOption::Safe) {
-			toTry[1] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '1';
+			toTry[1] = path + '1';
 			QFileInfo toTry0(toTry[0]);
 			QFileInfo toTry1(toTry[1]);
 			if (toTry0.exists()) {
@@ -317,20 +454,26 @@ struct FileWriteDescriptor {
 	}
 };
 
+bool readFileAt(FileReadDescriptor &result, const QString &basePath, const QString &name, FileOptions options);
+
 bool readFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe) {
 	if (options & FileOption::User) {
 		if (!_userWorking()) return false;
 	} else {
 		if (!_working()) return false;
 	}
+	return readFileAt(result, (options & FileOption::User) ? _userBasePath : _basePath, name, options);
+}
 
+// Doesn't use the global base paths, so it can be called from any thread.
+bool readFileAt(FileReadDescriptor &result, const QString &basePath, const QString &name, FileOptions options) {
 	// detect order of read attempts
 	QString toTry[2];
-	toTry[0] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '0';
+	toTry[0] = basePath + name + '0';
 	if (options & FileOption::Safe) {
 		QFileInfo toTry0(toTry[0]);
 		if (toTry0.exists()) {
-			toTry[1] = ((options & FileOption::User) ? _userBasePath : _basePath) + name + '1';
+			toTry[1] = basePath + name + '1';
 			QFileInfo toTry1(toTry[1]);
 			if (toTry1.exists()) {
 				QDateTime mod0 = toTry0.lastModified(), mod1 = toTry1.lastModified();
@@ -450,10 +593,36 @@ bool decryptLocal(EncryptedDescriptor &result, const QByteArray &encrypted, cons
 	return true;
 }
 
+void setPrefetchedFile(FileReadDescriptor &result, FilesPrefetch::File &&file) {
+	result.version = file.version;
+	result.data = std::move(file.data);
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(file.position);
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+}
+
+bool readEncryptedFileNow(FileReadDescriptor &result, const QString &name, FileOptions options, const MTP::AuthKeyPtr &key);
+bool decryptReadFile(FileReadDescriptor &result, const MTP::AuthKeyPtr &key);
+
 bool readEncryptedFile(FileReadDescriptor &result, const QString &name, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
-	if (!readFile(result, name, options)) {
-		return false;
+	auto prefetched = FilesPrefetch::File();
+	if (Prefetch->take(name, options, key, &prefetched)) {
+		if (!prefetched.success) {
+			return false;
+		}
+		setPrefetchedFile(result, std::move(prefetched));
+		return true;
 	}
+	return readEncryptedFileNow(result, name, options, key);
+}
+
+bool readEncryptedFileNow(FileReadDescriptor &result, const QString &name, FileOptions options, const MTP::AuthKeyPtr &key) {
+	return readFile(result, name, options) && decryptReadFile(result, key);
+}
+
+bool decryptReadFile(FileReadDescriptor &result, const MTP::AuthKeyPtr &key) {
 	QByteArray encrypted;
 	result.stream >> encrypted;
 
@@ -484,8 +653,111 @@ bool readEncryptedFile(FileReadDescriptor &result, const FileKey &fkey, FileOpti
 	return readEncryptedFile(result, toFilePart(fkey), options, key);
 }
 
+// The base path and the key are taken here, in the main thread.
+void prefetchEncryptedFile(const QString &name, FileOptions options = FileOption::User | FileOption::Safe, const MTP::AuthKeyPtr &key = LocalKey) {
+	if (options & FileOption::User) {
+		if (!_userWorking()) return;
+	} else {
+		if (!_working()) return;
+	}
+	if (!Prefetch->add(name, options, key)) {
+		return;
+	}
+	auto basePath = (options & FileOption::User) ? _userBasePath : _basePath;
+	base::TaskQueue::Normal().Put([prefetch = Prefetch, basePath, name, options, key] {
+		if (!prefetch->start(name)) {
+			return;
+		}
+		auto file = FilesPrefetch::File();
+		auto read = FileReadDescriptor();
+		if (readFileAt(read, basePath, name, options) && decryptReadFile(read, key)) {
+			file.success = true;
+			file.version = read.version;
+			file.position = read.buffer.pos();
+			read.stream.setDevice(0);
+			read.buffer.close();
+			read.buffer.setBuffer(0);
+			file.data = std::move(read.data);
+		}
+		prefetch->finish(name, std::move(file));
+	});
+}
+
+void prefetchEncryptedFile(const FileKey &fkey) {
+	if (fkey) {
+		prefetchEncryptedFile(toFilePart(fkey));
+	}
+}
+
 FileKey _dataNameKey = 0;
 
+// Media cache entries are written to the pack, the older ones may still be separate files.
+std::unique_ptr<Storage::CachePack> _mediaPack;
+
+FileKey genMediaKey() {
+	auto result = genKey(FileOption::User);
+	while (result && _mediaPack && _mediaPack->contains(result)) {
+		result = genKey(FileOption::User);
+	}
+	return result;
+}
+
+void writeMediaEncrypted(const FileKey &key, EncryptedDescriptor &data, bool fresh) {
+	if (_mediaPack) {
+		auto encrypted = FileWriteDescriptor::prepareEncrypted(data);
+		auto record = QByteArray(sizeof(qint32) + encrypted.size(), Qt::Uninitialized);
+		auto version = qint32(AppVersion);
+		memcpy(record.data(), &version, sizeof(version));
+		memcpy(record.data() + sizeof(version), encrypted.constData(), encrypted.size());
+		if (_mediaPack->put(key, record)) {
+			if (!fresh) {
+				clearKey(key, FileOption::User);
+			}
+			return;
+		}
+	}
+	FileWriteDescriptor file(key, FileOption::User);
+	file.writeEncrypted(data);
+}
+
+bool readMediaEncrypted(FileReadDescriptor &result, const FileKey &key) {
+	auto record = _mediaPack ? _mediaPack->get(key) : QByteArray();
+	if (record.isEmpty()) {
+		return readEncryptedFile(result, key, FileOption::User);
+	}
+	auto version = qint32(0);
+	if (record.size() <= int(sizeof(version))) {
+		return false;
+	}
+	memcpy(&version, record.constData(), sizeof(version));
+	if (version <= 0 || version > AppVersion) {
+		DEBUG_LOG(("App Info: bad version %1 in media pack record, my version %2").arg(version).arg(AppVersion));
+		return false;
+	}
+
+	EncryptedDescriptor data;
+	if (!decryptLocal(data, record.mid(sizeof(version)))) {
+		return false;
+	}
+	result.version = version;
+	result.data = data.data;
+	result.buffer.setBuffer(&result.data);
+	result.buffer.open(QIODevice::ReadOnly);
+	result.buffer.seek(data.buffer.pos());
+	result.stream.setDevice(&result.buffer);
+	result.stream.setVersion(QDataStream::Qt_5_1);
+	return true;
+}
+
+void clearMediaKey(const FileKey &key) {
+	if (_mediaPack && _mediaPack->contains(key)) {
+		_mediaPack->remove(key);
+	} else {
+		clearKey(key, FileOption::User);
+	}
+}
+
+
 enum { // Local Storage Keys
 	lskUserMap = 0x00,
 	lskDraft = 0x01, // data: PeerId peer
@@ -506,6 +778,13 @@ enum { // Local Storage Keys
 	lskStickersKeys = 0x10, // no data
 	lskTrustedBots = 0x11, // no data
 	lskFavedStickers = 0x12, // no data
+	lskPartialDownloads = 0x13, // no data
+	lskMediaAccess = 0x14, // no data
+	lskDialogsSnapshot = 0x15, // no data
+	lskHistoryCache = 0x16, // no data
+	lskVoiceWaveforms = 0x17, // no data
+	lskInstalledStickerSets = 0x18, // data: quint64 setId
+	lskPreparedUserpics = 0x19, // no data
 };
 
 enum {
@@ -580,6 +859,7 @@ enum {
 	dbiLangPackKey = 0x4e,
 	dbiConnectionType = 0x4f,
 	dbiStickersFavedLimit = 0x50,
+	dbiCacheLimits = 0x51,
 
 	dbiEncryptedWithSalt = 333,
 	dbiEncrypted = 444,
@@ -595,6 +875,19 @@ DraftsMap _draftsMap, _draftCursorsMap;
 typedef QMap<PeerId, bool> DraftsNotReadMap;
 DraftsNotReadMap _draftsNotReadMap;
 
+// The most recently opened chat is the last one, the first one is evicted.
+using HistoryCacheKeys = QVector<QPair<PeerId, FileKey>>;
+HistoryCacheKeys _historyCacheKeys;
+
+// Opening a chat only moves its entry to the end, that order is saved
+// with the next map write instead of writing the map on each chat open.
+bool _historyCacheOrderChanged = false;
+
+// Draft and cursor files are written by the Manager timer, so that
+// fast typing or switching between chats results in one write per file.
+QMap<PeerId, QPair<MessageDraft, MessageDraft>> _draftsToWrite;
+QMap<PeerId, QPair<MessageCursor, MessageCursor>> _draftCursorsToWrite;
+
 typedef QPair<FileKey, qint32> FileDesc; // file, size
 
 typedef QMultiMap<MediaKey, FileLocation> FileLocations;
@@ -606,21 +899,45 @@ typedef QMap<MediaKey, MediaKey> FileLocationAliases;
 FileLocationAliases _fileLocationAliases;
 typedef QMap<QString, FileDesc> WebFilesMap;
 WebFilesMap _webFilesMap;
-uint64 _storageWebFilesSize = 0;
+qint64 _storageWebFilesSize = 0;
 FileKey _locationsKey = 0, _reportSpamStatusesKey = 0, _trustedBotsKey = 0;
 
+// New file locations are appended to a log next to the locations file,
+// so that each download doesn't rewrite all the known locations.
+enum {
+	lllLocation = 0x01, // data: MediaKey location, FileLocation local
+	lllAlias = 0x02, // data: MediaKey alias, MediaKey location
+};
+int _locationsLogCount = 0;
+
 using TrustedBots = OrderedSet<uint64>;
 TrustedBots _trustedBots;
 bool _trustedBotsRead = false;
 
+// Each download keeps its parts bitmap in a separate file, so that saving
+// the progress rewrites only that file and not the list of all downloads.
+using PartialDownloads = QMap<MediaKey, PartialDownload>;
+PartialDownloads _partialDownloads;
+QMap<MediaKey, FileKey> _partialDownloadKeys;
+bool _partialDownloadsRead = false;
+FileKey _partialDownloadsKey = 0;
+
 FileKey _recentStickersKeyOld = 0;
 FileKey _installedStickersKey = 0, _featuredStickersKey = 0, _recentStickersKey = 0, _favedStickersKey = 0, _archivedStickersKey = 0;
 FileKey _savedGifsKey = 0;
 
+// Regular installed sets are stored one per file, the installed stickers
+// file keeps only the special sets and the order of installed sets.
+typedef QMap<uint64, FileKey> StickerSetsMap;
+StickerSetsMap _installedStickerSetsMap;
+QMap<uint64, quint64> _installedStickerSetsWritten;
+
 FileKey _backgroundKey = 0;
 bool _backgroundWasRead = false;
 bool _backgroundCanWrite = true;
 
+bool _deferredStickersReadPending = false;
+
 FileKey _themeKey = 0;
 QString _themeAbsolutePath;
 QString _themePaletteAbsolutePath;
@@ -635,7 +952,35 @@ FileKey _langPackKey = 0;
 
 typedef QMap<StorageKey, FileDesc> StorageMap;
 StorageMap _imagesMap, _stickerImagesMap, _audiosMap;
-int32 _storageImagesSize = 0, _storageStickersSize = 0, _storageAudiosSize = 0;
+qint64 _storageImagesSize = 0, _storageStickersSize = 0, _storageAudiosSize = 0;
+
+// Last access unixtime of the media cache entries, used for the eviction.
+// It is updated not more often than once in kMediaAccessPrecision for each
+// entry and the file is written in a background thread.
+using MediaAccess = QHash<FileKey, qint32>;
+MediaAccess _mediaAccess;
+bool _mediaAccessRead = false;
+bool _mediaAccessChanged = false;
+FileKey _mediaAccessKey = 0;
+std::unique_ptr<base::TaskQueue> _mediaAccessWrites;
+
+FileKey _dialogsSnapshotKey = 0;
+
+// Waveforms counted for the voice messages that were received without one.
+using VoiceWaveforms = QMap<DocumentId, VoiceWaveform>;
+VoiceWaveforms _voiceWaveforms;
+bool _voiceWaveformsRead = false;
+FileKey _voiceWaveformsKey = 0;
+
+// Chats list userpics, circled at the displayed size, in the drawn order.
+using PreparedUserpicKey = QPair<StorageKey, int>;
+QMap<PreparedUserpicKey, QPixmap> _preparedUserpics;
+QVector<PreparedUserpicKey> _preparedUserpicsUsed;
+bool _preparedUserpicsRead = false;
+FileKey _preparedUserpicsKey = 0;
+
+bool _cacheEvicting = false;
+int _cacheEvictionGeneration = 0;
 
 bool _mapChanged = false;
 int32 _oldMapVersion = 0, _oldSettingsVersion = 0;
@@ -656,6 +1001,17 @@ StoredAuthSession &GetStoredAuthSessionCache() {
 
 void _writeMap(WriteMapWhen when = WriteMapWhen::Soon);
 
+QString _locationsLogPath() {
+	return _userBasePath + toFilePart(_locationsKey) + 'l';
+}
+
+void _clearLocationsLog() {
+	if (_locationsKey) {
+		QFile::remove(_locationsLogPath());
+	}
+	_locationsLogCount = 0;
+}
+
 void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 	if (when != WriteMapWhen::Now) {
 		_manager->writeLocations(when == WriteMapWhen::Fast);
@@ -666,6 +1022,7 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 	_manager->writingLocations();
 	if (_fileLocations.isEmpty() && _webFilesMap.isEmpty()) {
 		if (_locationsKey) {
+			_clearLocationsLog();
 			clearKey(_locationsKey);
 			_locationsKey = 0;
 			_mapChanged = true;
@@ -736,12 +1093,142 @@ void _writeLocations(WriteMapWhen when = WriteMapWhen::Soon) {
 
 		FileWriteDescriptor file(_locationsKey);
 		file.writeEncrypted(data);
+		file.finish();
+
+		// Everything from the log is in the full file now.
+		_clearLocationsLog();
+	}
+}
+
+enum class FileLocationChange {
+	None,
+	Alias,
+	Location,
+};
+
+FileLocationChange _applyFileLocation(const MediaKey &location, const FileLocation &local) {
+	auto i = _fileLocationPairs.find(local.fname);
+	if (i != _fileLocationPairs.cend()) {
+		if (i.value().second == local) {
+			if (i.value().first != location) {
+				_fileLocationAliases.insert(location, i.value().first);
+				return FileLocationChange::Alias;
+			}
+			return FileLocationChange::None;
+		}
+		if (i.value().first != location) {
+			for (auto j = _fileLocations.find(i.value().first), e = _fileLocations.end(); (j != e) && (j.key() == i.value().first); ++j) {
+				if (j.value() == i.value().second) {
+					_fileLocations.erase(j);
+					break;
+				}
+			}
+			_fileLocationPairs.erase(i);
+		}
+	}
+	_fileLocations.insert(location, local);
+	_fileLocationPairs.insert(local.fname, FileLocationPair(location, local));
+	return FileLocationChange::Location;
+}
+
+bool _appendLocationsLog(EncryptedDescriptor &data) {
+	if (!_working() || !_locationsKey || _locationsLogCount >= kLocationsLogLimit) {
+		return false;
+	}
+	QFile file(_locationsLogPath());
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		return false;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	stream << FileWriteDescriptor::prepareEncrypted(data);
+	if (stream.status() != QDataStream::Ok) {
+		return false;
+	}
+	++_locationsLogCount;
+	return true;
+}
+
+void _writeLocationToLog(const MediaKey &location, const FileLocation &local) {
+	// type + location + name + bookmark + date + size
+	auto size = sizeof(quint32) + sizeof(quint64) * 2 + Serialize::stringSize(local.name()) + Serialize::bytearraySize(local.bookmark()) + Serialize::dateTimeSize() + sizeof(quint32);
+
+	EncryptedDescriptor data(size);
+	data.stream << quint32(lllLocation) << quint64(location.first) << quint64(location.second) << local.name() << local.bookmark();
+	data.stream << local.modified << quint32(local.size);
+	if (!_appendLocationsLog(data)) {
+		_writeLocations(WriteMapWhen::Fast);
+	}
+}
+
+void _writeLocationAliasToLog(const MediaKey &alias, const MediaKey &location) {
+	// type + alias + location
+	auto size = sizeof(quint32) + sizeof(quint64) * 2 + sizeof(quint64) * 2;
+
+	EncryptedDescriptor data(size);
+	data.stream << quint32(lllAlias) << quint64(alias.first) << quint64(alias.second) << quint64(location.first) << quint64(location.second);
+	if (!_appendLocationsLog(data)) {
+		_writeLocations(WriteMapWhen::Fast);
+	}
+}
+
+void _readLocationsLog() {
+	_locationsLogCount = 0;
+
+	QFile file(_locationsLogPath());
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+	QDataStream stream(&file);
+	stream.setVersion(QDataStream::Qt_5_1);
+	auto broken = false;
+	while (!stream.atEnd()) {
+		QByteArray encrypted;
+		stream >> encrypted;
+		EncryptedDescriptor data;
+		if (stream.status() != QDataStream::Ok || !decryptLocal(data, encrypted)) {
+			broken = true;
+			break;
+		}
+
+		quint32 type = 0;
+		quint64 first = 0, second = 0;
+		data.stream >> type >> first >> second;
+		if (type == lllLocation) {
+			QByteArray bookmark;
+			FileLocation loc;
+			data.stream >> loc.fname >> bookmark >> loc.modified >> loc.size;
+			if (!_checkStreamStatus(data.stream)) {
+				broken = true;
+				break;
+			}
+			loc.setBookmark(bookmark);
+			_applyFileLocation(MediaKey(first, second), loc);
+		} else if (type == lllAlias) {
+			quint64 vfirst = 0, vsecond = 0;
+			data.stream >> vfirst >> vsecond;
+			if (!_checkStreamStatus(data.stream)) {
+				broken = true;
+				break;
+			}
+			_fileLocationAliases.insert(MediaKey(first, second), MediaKey(vfirst, vsecond));
+		} else {
+			broken = true;
+			break;
+		}
+		++_locationsLogCount;
+	}
+
+	// Records appended after a broken one would be lost, compact right away.
+	if (broken || _locationsLogCount >= kLocationsLogLimit) {
+		_writeLocations();
 	}
 }
 
 void _readLocations() {
 	FileReadDescriptor locations;
 	if (!readEncryptedFile(locations, _locationsKey)) {
+		_clearLocationsLog();
 		clearKey(_locationsKey);
 		_locationsKey = 0;
 		_writeMap();
@@ -797,6 +1284,8 @@ void _readLocations() {
 			}
 		}
 	}
+
+	_readLocationsLog();
 }
 
 void _writeReportSpamStatuses() {
@@ -1025,6 +1514,17 @@ bool _readSetting(quint32 blockId, QDataStream &stream, int version, ReadSetting
 		cSetAutoPlayGif(gif == 1);
 	} break;
 
+	case dbiCacheLimits: {
+		qint64 images, stickers, audios, webFiles;
+		stream >> images >> stickers >> audios >> webFiles;
+		if (!_checkStreamStatus(stream)) return false;
+
+		cSetCacheImagesLimit(qMax(images, qint64(0)));
+		cSetCacheStickersLimit(qMax(stickers, qint64(0)));
+		cSetCacheAudiosLimit(qMax(audios, qint64(0)));
+		cSetCacheWebFilesLimit(qMax(webFiles, qint64(0)));
+	} break;
+
 	case dbiDialogsMode: {
 		qint32 enabled, modeInt;
 		stream >> enabled >> modeInt;
@@ -1751,6 +2251,9 @@ void _writeUserSettings() {
 		LOG(("App Error: attempt to write settings while reading them!"));
 		return;
 	}
+	if (_manager) {
+		_manager->writingUserSettings();
+	}
 	LOG(("App Info: writing encrypted user settings..."));
 
 	if (!_userSettingsKey) {
@@ -1792,6 +2295,7 @@ void _writeUserSettings() {
 	size += sizeof(quint32) + Serialize::stringSize(cDialogLastPath());
 	size += sizeof(quint32) + 3 * sizeof(qint32);
 	size += sizeof(quint32) + 2 * sizeof(qint32);
+	size += sizeof(quint32) + 4 * sizeof(qint64);
 	if (!Global::HiddenPinnedMessages().isEmpty()) {
 		size += sizeof(quint32) + sizeof(qint32) + Global::HiddenPinnedMessages().size() * (sizeof(PeerId) + sizeof(MsgId));
 	}
@@ -1824,6 +2328,7 @@ void _writeUserSettings() {
 	data.stream << quint32(dbiAutoPlay) << qint32(cAutoPlayGif() ? 1 : 0);
 	data.stream << quint32(dbiDialogsWidthRatio) << qint32(snap(qRound(dialogsWidthRatio() * 1000000), 0, 1000000));
 	data.stream << quint32(dbiUseExternalVideoPlayer) << qint32(cUseExternalVideoPlayer());
+	data.stream << quint32(dbiCacheLimits) << qint64(cCacheImagesLimit()) << qint64(cCacheStickersLimit()) << qint64(cCacheAudiosLimit()) << qint64(cCacheWebFilesLimit());
 	if (!userData.isEmpty()) {
 		data.stream << quint32(dbiAuthSessionData) << userData;
 	}
@@ -1927,13 +2432,35 @@ void _readMtpData() {
 	applyReadContext(std::move(context));
 }
 
-ReadMapState _readMap(const QByteArray &pass) {
-	auto ms = getms();
+void _prepareUserBasePath() {
 	QByteArray dataNameUtf8 = (cDataFile() + (cTestMode() ? qsl(":/test/") : QString())).toUtf8();
 	FileKey dataNameHash[2];
 	hashMd5(dataNameUtf8.constData(), dataNameUtf8.size(), dataNameHash);
 	_dataNameKey = dataNameHash[0];
 	_userBasePath = _basePath + toFilePart(_dataNameKey) + QChar('/');
+	if (!_mediaPack) {
+		_mediaPack = std::make_unique<Storage::CachePack>(_userBasePath + qsl("media/"));
+	}
+}
+
+QByteArray _readMapSalt() {
+	_prepareUserBasePath();
+
+	FileReadDescriptor mapData;
+	if (!readFile(mapData, qsl("map"))) {
+		return QByteArray();
+	}
+	QByteArray salt;
+	mapData.stream >> salt;
+	if (mapData.stream.status() != QDataStream::Ok || salt.size() != LocalEncryptSaltSize) {
+		return QByteArray();
+	}
+	return salt;
+}
+
+ReadMapState _readMap(const QByteArray &pass, const MTP::AuthKeyPtr &passKey) {
+	auto ms = getms();
+	_prepareUserBasePath();
 
 	FileReadDescriptor mapData;
 	if (!readFile(mapData, qsl("map"))) {
@@ -1951,7 +2478,11 @@ ReadMapState _readMap(const QByteArray &pass) {
 		LOG(("App Error: bad salt in map file, size: %1").arg(salt.size()));
 		return ReadMapFailed;
 	}
-	createLocalKey(pass, &salt, &PassKey);
+	if (passKey) {
+		PassKey = passKey;
+	} else {
+		createLocalKey(pass, &salt, &PassKey);
+	}
 
 	EncryptedDescriptor keyData, map;
 	if (!decryptLocal(keyData, keyEncrypted, PassKey)) {
@@ -1976,13 +2507,16 @@ ReadMapState _readMap(const QByteArray &pass) {
 
 	DraftsMap draftsMap, draftCursorsMap;
 	DraftsNotReadMap draftsNotReadMap;
+	HistoryCacheKeys historyCacheKeys;
 	StorageMap imagesMap, stickerImagesMap, audiosMap;
 	qint64 storageImagesSize = 0, storageStickersSize = 0, storageAudiosSize = 0;
-	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0;
+	quint64 locationsKey = 0, reportSpamStatusesKey = 0, trustedBotsKey = 0, partialDownloadsKey = 0, mediaAccessKey = 0;
+	quint64 dialogsSnapshotKey = 0, voiceWaveformsKey = 0, preparedUserpicsKey = 0;
 	quint64 recentStickersKeyOld = 0;
 	quint64 installedStickersKey = 0, featuredStickersKey = 0, recentStickersKey = 0, favedStickersKey = 0, archivedStickersKey = 0;
 	quint64 savedGifsKey = 0;
 	quint64 backgroundKey = 0, userSettingsKey = 0, recentHashtagsAndBotsKey = 0, savedPeersKey = 0;
+	StickerSetsMap installedStickerSetsMap;
 	while (!map.stream.atEnd()) {
 		quint32 keyType;
 		map.stream >> keyType;
@@ -2053,6 +2587,41 @@ ReadMapState _readMap(const QByteArray &pass) {
 		case lskTrustedBots: {
 			map.stream >> trustedBotsKey;
 		} break;
+		case lskPartialDownloads: {
+			map.stream >> partialDownloadsKey;
+		} break;
+		case lskMediaAccess: {
+			map.stream >> mediaAccessKey;
+		} break;
+		case lskDialogsSnapshot: {
+			map.stream >> dialogsSnapshotKey;
+		} break;
+		case lskHistoryCache: {
+			quint32 count = 0;
+			map.stream >> count;
+			for (quint32 i = 0; i < count; ++i) {
+				FileKey key;
+				quint64 p;
+				map.stream >> key >> p;
+				historyCacheKeys.push_back(qMakePair(PeerId(p), key));
+			}
+		} break;
+		case lskVoiceWaveforms: {
+			map.stream >> voiceWaveformsKey;
+		} break;
+		case lskPreparedUserpics: {
+			map.stream >> preparedUserpicsKey;
+		} break;
+		case lskInstalledStickerSets: {
+			quint32 count = 0;
+			map.stream >> count;
+			for (quint32 i = 0; i < count; ++i) {
+				FileKey key;
+				quint64 setId;
+				map.stream >> key >> setId;
+				installedStickerSetsMap.insert(setId, key);
+			}
+		} break;
 		case lskRecentStickersOld: {
 			map.stream >> recentStickersKeyOld;
 		} break;
@@ -2096,6 +2665,7 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_draftsMap = draftsMap;
 	_draftCursorsMap = draftCursorsMap;
 	_draftsNotReadMap = draftsNotReadMap;
+	_historyCacheKeys = historyCacheKeys;
 
 	_imagesMap = imagesMap;
 	_storageImagesSize = storageImagesSize;
@@ -2107,8 +2677,15 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_locationsKey = locationsKey;
 	_reportSpamStatusesKey = reportSpamStatusesKey;
 	_trustedBotsKey = trustedBotsKey;
+	_partialDownloadsKey = partialDownloadsKey;
+	_mediaAccessKey = mediaAccessKey;
+	_dialogsSnapshotKey = dialogsSnapshotKey;
+	_voiceWaveformsKey = voiceWaveformsKey;
+	_preparedUserpicsKey = preparedUserpicsKey;
 	_recentStickersKeyOld = recentStickersKeyOld;
 	_installedStickersKey = installedStickersKey;
+	_installedStickerSetsMap = installedStickerSetsMap;
+	_installedStickerSetsWritten.clear();
 	_featuredStickersKey = featuredStickersKey;
 	_recentStickersKey = recentStickersKey;
 	_favedStickersKey = favedStickersKey;
@@ -2119,6 +2696,23 @@ ReadMapState _readMap(const QByteArray &pass) {
 	_userSettingsKey = userSettingsKey;
 	_recentHashtagsAndBotsKey = recentHashtagsAndBotsKey;
 	_oldMapVersion = mapData.version;
+
+	// Decrypt the files read right after the map in parallel.
+	prefetchEncryptedFile(toFilePart(_dataNameKey), FileOption::Safe);
+	prefetchEncryptedFile(_locationsKey);
+	prefetchEncryptedFile(_reportSpamStatusesKey);
+	prefetchEncryptedFile(_userSettingsKey);
+	prefetchEncryptedFile(_installedStickersKey);
+	for_const (auto key, _installedStickerSetsMap) {
+		prefetchEncryptedFile(key);
+	}
+	prefetchEncryptedFile(_featuredStickersKey);
+	prefetchEncryptedFile(_recentStickersKey);
+	prefetchEncryptedFile(_favedStickersKey);
+	prefetchEncryptedFile(_savedGifsKey);
+	prefetchEncryptedFile(_savedPeersKey);
+	prefetchEncryptedFile(_dialogsSnapshotKey);
+	prefetchEncryptedFile(_preparedUserpicsKey);
 	if (_oldMapVersion < AppVersion) {
 		_mapChanged = true;
 		_writeMap();
@@ -2186,10 +2780,17 @@ void _writeMap(WriteMapWhen when) {
 	if (_locationsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_reportSpamStatusesKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_trustedBotsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_partialDownloadsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_mediaAccessKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_dialogsSnapshotKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (!_historyCacheKeys.isEmpty()) mapSize += sizeof(quint32) * 2 + _historyCacheKeys.size() * sizeof(quint64) * 2;
+	if (_voiceWaveformsKey) mapSize += sizeof(quint32) + sizeof(quint64);
+	if (_preparedUserpicsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_recentStickersKeyOld) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_installedStickersKey || _featuredStickersKey || _recentStickersKey || _archivedStickersKey) {
 		mapSize += sizeof(quint32) + 4 * sizeof(quint64);
 	}
+	if (!_installedStickerSetsMap.isEmpty()) mapSize += sizeof(quint32) * 2 + _installedStickerSetsMap.size() * sizeof(quint64) * 2;
 	if (_favedStickersKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_savedGifsKey) mapSize += sizeof(quint32) + sizeof(quint64);
 	if (_savedPeersKey) mapSize += sizeof(quint32) + sizeof(quint64);
@@ -2236,6 +2837,27 @@ void _writeMap(WriteMapWhen when) {
 	if (_trustedBotsKey) {
 		mapData.stream << quint32(lskTrustedBots) << quint64(_trustedBotsKey);
 	}
+	if (_partialDownloadsKey) {
+		mapData.stream << quint32(lskPartialDownloads) << quint64(_partialDownloadsKey);
+	}
+	if (_mediaAccessKey) {
+		mapData.stream << quint32(lskMediaAccess) << quint64(_mediaAccessKey);
+	}
+	if (_dialogsSnapshotKey) {
+		mapData.stream << quint32(lskDialogsSnapshot) << quint64(_dialogsSnapshotKey);
+	}
+	if (!_historyCacheKeys.isEmpty()) {
+		mapData.stream << quint32(lskHistoryCache) << quint32(_historyCacheKeys.size());
+		for_const (auto &entry, _historyCacheKeys) {
+			mapData.stream << quint64(entry.second) << quint64(entry.first);
+		}
+	}
+	if (_voiceWaveformsKey) {
+		mapData.stream << quint32(lskVoiceWaveforms) << quint64(_voiceWaveformsKey);
+	}
+	if (_preparedUserpicsKey) {
+		mapData.stream << quint32(lskPreparedUserpics) << quint64(_preparedUserpicsKey);
+	}
 	if (_recentStickersKeyOld) {
 		mapData.stream << quint32(lskRecentStickersOld) << quint64(_recentStickersKeyOld);
 	}
@@ -2243,6 +2865,12 @@ void _writeMap(WriteMapWhen when) {
 		mapData.stream << quint32(lskStickersKeys);
 		mapData.stream << quint64(_installedStickersKey) << quint64(_featuredStickersKey) << quint64(_recentStickersKey) << quint64(_archivedStickersKey);
 	}
+	if (!_installedStickerSetsMap.isEmpty()) {
+		mapData.stream << quint32(lskInstalledStickerSets) << quint32(_installedStickerSetsMap.size());
+		for (auto i = _installedStickerSetsMap.cbegin(), e = _installedStickerSetsMap.cend(); i != e; ++i) {
+			mapData.stream << quint64(i.value()) << quint64(i.key());
+		}
+	}
 	if (_favedStickersKey) {
 		mapData.stream << quint32(lskFavedStickers) << quint64(_favedStickersKey);
 	}
@@ -2264,21 +2892,275 @@ void _writeMap(WriteMapWhen when) {
 	map.writeEncrypted(mapData);
 
 	_mapChanged = false;
+	_historyCacheOrderChanged = false;
 }
 
-} // namespace
+void _writeMediaAccess(bool now = false) {
+	if (!_working() || !_mediaAccessChanged) return;
+	_mediaAccessChanged = false;
 
-void finish() {
-	if (_manager) {
-		_writeMap(WriteMapWhen::Now);
-		_manager->finish();
-		_manager->deleteLater();
-		_manager = 0;
-		delete base::take(_localLoader);
-	}
-}
+	if (_mediaAccess.isEmpty()) {
+		if (_mediaAccessKey) {
+			if (_mediaAccessWrites) {
+				// The file could be written again by a pending background write.
+				_mediaAccessWrites->Put([path = _userBasePath + toFilePart(_mediaAccessKey)] {
+					QFile::remove(path + '0');
+					QFile::remove(path + '1');
+				});
+			}
+			clearKey(_mediaAccessKey);
+			_mediaAccessKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+	} else {
+		if (!_mediaAccessKey) {
+			_mediaAccessKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		auto name = toFilePart(_mediaAccessKey);
+		Prefetch->drop(name);
+		auto write = [basePath = _userBasePath, name, access = _mediaAccess, key = LocalKey] {
+			quint32 size = sizeof(quint32) + access.size() * (sizeof(quint64) + sizeof(qint32));
 
-void readTheme();
+			EncryptedDescriptor data(size);
+			data.stream << quint32(access.size());
+			for (auto i = access.cbegin(), e = access.cend(); i != e; ++i) {
+				data.stream << quint64(i.key()) << qint32(i.value());
+			}
+
+			FileWriteDescriptor file(basePath, name, FileOption::User | FileOption::Safe);
+			file.writeEncrypted(data, key);
+		};
+		if (now) {
+			write();
+		} else {
+			if (!_mediaAccessWrites) {
+				_mediaAccessWrites = std::make_unique<base::TaskQueue>(base::TaskQueue::Priority::Background);
+			}
+			_mediaAccessWrites->Put(std::move(write));
+		}
+	}
+}
+
+void _readMediaAccess() {
+	if (_mediaAccessRead) return;
+	_mediaAccessRead = true;
+	if (!_mediaAccessKey) return;
+
+	FileReadDescriptor access;
+	if (!readEncryptedFile(access, _mediaAccessKey)) {
+		clearKey(_mediaAccessKey);
+		_mediaAccessKey = 0;
+		_mapChanged = true;
+		_writeMap();
+		return;
+	}
+
+	quint32 count = 0;
+	access.stream >> count;
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 key = 0;
+		qint32 time = 0;
+		access.stream >> key >> time;
+		if (!_checkStreamStatus(access.stream)) {
+			break;
+		}
+		_mediaAccess.insert(key, time);
+	}
+}
+
+void _touchMedia(const FileKey &key) {
+	_readMediaAccess();
+	auto now = unixtime();
+	auto &time = _mediaAccess[key];
+	if (time > now || time <= now - kMediaAccessPrecision) {
+		time = now;
+		_mediaAccessChanged = true;
+	}
+	if (_manager) {
+		_manager->checkCacheLimits();
+	}
+}
+
+void _forgetMedia(const FileKey &key) {
+	_readMediaAccess();
+	if (_mediaAccess.remove(key)) {
+		_mediaAccessChanged = true;
+	}
+}
+
+template <typename Map>
+using EvictedEntries = std::vector<std::pair<typename Map::key_type, FileKey>>;
+
+template <typename Map>
+struct CacheCategory {
+	Map map;
+	qint64 size = 0;
+	qint64 limit = 0;
+	EvictedEntries<Map> evicted;
+
+	// Chooses the least recently used entries to bring the size under the limit.
+	void select(const MediaAccess &access) {
+		if (limit <= 0 || size <= limit) {
+			return;
+		}
+		struct Candidate {
+			qint32 time;
+			qint32 size;
+			typename Map::const_iterator i;
+		};
+		auto candidates = std::vector<Candidate>();
+		candidates.reserve(map.size());
+		for (auto i = map.cbegin(), e = map.cend(); i != e; ++i) {
+			candidates.push_back({ access.value(i.value().first), i.value().second, i });
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+			return a.time < b.time;
+		});
+		auto target = limit / 100 * kCacheEvictTargetPercent;
+		for (auto &candidate : candidates) {
+			if (size <= target) {
+				break;
+			}
+			evicted.push_back({ candidate.i.key(), candidate.i.value().first });
+			size -= candidate.size;
+		}
+		map = Map();
+	}
+
+};
+
+struct CacheEviction {
+	int generation = 0;
+	MediaAccess access;
+	CacheCategory<StorageMap> images, stickers, audios;
+	CacheCategory<WebFilesMap> webFiles;
+};
+
+template <typename Map>
+void _fillCacheCategory(CacheCategory<Map> &category, const Map &map, qint64 size, qint64 limit) {
+	category.map = map;
+	category.size = size;
+	category.limit = limit;
+}
+
+template <typename Map, typename Size>
+bool _evictEntries(Map &map, Size &size, const EvictedEntries<Map> &evicted, std::vector<FileKey> &keys) {
+	auto result = false;
+	for (auto &entry : evicted) {
+		auto i = map.find(entry.first);
+		if (i == map.end() || i.value().first != entry.second) {
+			continue;
+		}
+		size -= i.value().second;
+		keys.push_back(entry.second);
+		_forgetMedia(entry.second);
+		map.erase(i);
+		result = true;
+	}
+	return result;
+}
+
+void _applyCacheEviction(const CacheEviction &eviction) {
+	if (eviction.generation != _cacheEvictionGeneration) return;
+	_cacheEvicting = false;
+	if (!_working()) return;
+
+	auto keys = std::vector<FileKey>();
+	auto mapChanged = _evictEntries(_imagesMap, _storageImagesSize, eviction.images.evicted, keys);
+	mapChanged = _evictEntries(_stickerImagesMap, _storageStickersSize, eviction.stickers.evicted, keys) || mapChanged;
+	mapChanged = _evictEntries(_audiosMap, _storageAudiosSize, eviction.audios.evicted, keys) || mapChanged;
+	if (mapChanged) {
+		_mapChanged = true;
+		_writeMap();
+	}
+	if (_evictEntries(_webFilesMap, _storageWebFilesSize, eviction.webFiles.evicted, keys)) {
+		_writeLocations();
+	}
+	_writeMediaAccess();
+
+	if (!keys.empty() && _userWorking()) {
+		LOG(("App Info: evicting %1 media cache entries.").arg(keys.size()));
+
+		// Only the file removal is done in the background, the storage
+		// state is not touched outside of the main thread.
+		auto paths = QStringList();
+		for (auto key : keys) {
+			if (_mediaPack && _mediaPack->contains(key)) {
+				_mediaPack->remove(key);
+			} else {
+				Prefetch->drop(toFilePart(key));
+				paths.push_back(_userBasePath + toFilePart(key) + '0');
+			}
+		}
+		if (!paths.isEmpty()) {
+			base::TaskQueue::Normal().Put([paths = std::move(paths)] {
+				for_const (auto &path, paths) {
+					QFile::remove(path);
+				}
+			});
+		}
+	}
+}
+
+// The entries are chosen on a background thread from the snapshots
+// of the maps, then they are removed from the maps on the main thread
+// if they were not changed meanwhile and their data is deleted.
+void _checkCacheLimits() {
+	if (!_working() || _cacheEvicting) return;
+
+	_readMediaAccess();
+	auto exceeds = [](qint64 size, qint64 limit) {
+		return (limit > 0) && (size > limit);
+	};
+	if (!exceeds(_storageImagesSize, cCacheImagesLimit())
+		&& !exceeds(_storageStickersSize, cCacheStickersLimit())
+		&& !exceeds(_storageAudiosSize, cCacheAudiosLimit())
+		&& !exceeds(_storageWebFilesSize, cCacheWebFilesLimit())) {
+		_writeMediaAccess();
+		return;
+	}
+
+	_cacheEvicting = true;
+	auto eviction = std::make_shared<CacheEviction>();
+	eviction->generation = _cacheEvictionGeneration;
+	eviction->access = _mediaAccess;
+	_fillCacheCategory(eviction->images, _imagesMap, _storageImagesSize, cCacheImagesLimit());
+	_fillCacheCategory(eviction->stickers, _stickerImagesMap, _storageStickersSize, cCacheStickersLimit());
+	_fillCacheCategory(eviction->audios, _audiosMap, _storageAudiosSize, cCacheAudiosLimit());
+	_fillCacheCategory(eviction->webFiles, _webFilesMap, _storageWebFilesSize, cCacheWebFilesLimit());
+	base::TaskQueue::Normal().Put([eviction] {
+		eviction->images.select(eviction->access);
+		eviction->stickers.select(eviction->access);
+		eviction->audios.select(eviction->access);
+		eviction->webFiles.select(eviction->access);
+		eviction->access = MediaAccess();
+		base::TaskQueue::Main().Put([eviction] {
+			_applyCacheEviction(*eviction);
+		});
+	});
+}
+
+} // namespace
+
+void finish() {
+	if (_manager) {
+		// Pending settings writes may add keys to the map, so flush them first.
+		_manager->finish();
+		_writeMediaAccess(true);
+		if (_historyCacheOrderChanged) {
+			_mapChanged = true;
+		}
+		_writeMap(WriteMapWhen::Now);
+		_manager->deleteLater();
+		_manager = 0;
+		delete base::take(_localLoader);
+	}
+}
+
+void readTheme();
 void readLangPack();
 
 void start() {
@@ -2412,7 +3294,12 @@ void writeSettings() {
 }
 
 void writeUserSettings() {
-	_writeUserSettings();
+	// Settings are often changed a few times in a row, write them once.
+	if (_manager) {
+		_manager->writeUserSettings();
+	} else {
+		_writeUserSettings();
+	}
 }
 
 void writeMtpData() {
@@ -2424,26 +3311,58 @@ void reset() {
 		_localLoader->stop();
 	}
 
+	Prefetch->clear();
 	_passKeySalt.clear(); // reset passcode, local key
+	_deferredStickersReadPending = false;
 	_draftsMap.clear();
 	_draftCursorsMap.clear();
+	_historyCacheKeys.clear();
+	_historyCacheOrderChanged = false;
 	_fileLocations.clear();
 	_fileLocationPairs.clear();
 	_fileLocationAliases.clear();
 	_imagesMap.clear();
 	_draftsNotReadMap.clear();
+	_draftsToWrite.clear();
+	_draftCursorsToWrite.clear();
 	_stickerImagesMap.clear();
 	_audiosMap.clear();
 	_storageImagesSize = _storageStickersSize = _storageAudiosSize = 0;
 	_webFilesMap.clear();
 	_storageWebFilesSize = 0;
-	_locationsKey = _reportSpamStatusesKey = _trustedBotsKey = 0;
+	_locationsKey = _reportSpamStatusesKey = _trustedBotsKey = _partialDownloadsKey = 0;
+	_locationsLogCount = 0;
+	_partialDownloads.clear();
+	_partialDownloadKeys.clear();
+	_partialDownloadsRead = false;
+	_mediaAccessKey = 0;
+	_mediaAccess.clear();
+	_mediaAccessRead = _mediaAccessChanged = false;
+	_dialogsSnapshotKey = 0;
+	_voiceWaveformsKey = 0;
+	_voiceWaveforms.clear();
+	_voiceWaveformsRead = false;
+	_preparedUserpicsKey = 0;
+	_preparedUserpics.clear();
+	_preparedUserpicsUsed.clear();
+	_preparedUserpicsRead = false;
+	_cacheEvicting = false;
+	++_cacheEvictionGeneration;
 	_recentStickersKeyOld = 0;
 	_installedStickersKey = _featuredStickersKey = _recentStickersKey = _favedStickersKey = _archivedStickersKey = 0;
+	_installedStickerSetsMap.clear();
+	_installedStickerSetsWritten.clear();
 	_savedGifsKey = 0;
 	_backgroundKey = _userSettingsKey = _recentHashtagsAndBotsKey = _savedPeersKey = 0;
 	_oldMapVersion = _oldSettingsVersion = 0;
 	StoredAuthSessionCache.reset();
+	if (_manager) {
+		_manager->writingUserSettings();
+		_manager->writingInstalledStickers();
+		_manager->writingDialogsSnapshot();
+		_manager->writingVoiceWaveforms();
+		_manager->writingPreparedUserpics();
+	}
 	_mapChanged = true;
 	_writeMap(WriteMapWhen::Now);
 
@@ -2470,8 +3389,35 @@ void setPasscode(const QByteArray &passcode) {
 	Global::RefLocalPasscodeChanged().notify();
 }
 
-ReadMapState readMap(const QByteArray &pass) {
-	ReadMapState result = _readMap(pass);
+void createLocalKeyAsync(const QByteArray &pass, const QByteArray &salt, base::lambda_once<void(MTP::AuthKeyPtr key)> callback) {
+	base::TaskQueue::Normal().Put([pass, salt, callback = std::move(callback)]() mutable {
+		// With the salt provided createLocalKey() doesn't touch any global state.
+		auto key = MTP::AuthKeyPtr();
+		createLocalKey(pass, &salt, &key);
+		base::TaskQueue::Main().Put([callback = std::move(callback), key = std::move(key)]() mutable {
+			callback(std::move(key));
+		});
+	});
+}
+
+void checkPasscodeAsync(const QByteArray &passcode, base::lambda_once<void(bool correct)> callback) {
+	createLocalKeyAsync(passcode, _passKeySalt, [callback = std::move(callback)](MTP::AuthKeyPtr key) mutable {
+		callback(PassKey && key->equals(PassKey));
+	});
+}
+
+void createMapPassKeyAsync(const QByteArray &pass, base::lambda_once<void(MTP::AuthKeyPtr passKey)> callback) {
+	auto salt = _readMapSalt();
+	if (salt.isEmpty()) {
+		// readMap() will fail without deriving the key at all.
+		callback(nullptr);
+		return;
+	}
+	createLocalKeyAsync(pass, salt, std::move(callback));
+}
+
+ReadMapState readMap(const QByteArray &pass, const MTP::AuthKeyPtr &passKey) {
+	ReadMapState result = _readMap(pass, passKey);
 	if (result == ReadMapFailed) {
 		_mapChanged = true;
 		_writeMap(WriteMapWhen::Now);
@@ -2500,6 +3446,7 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 		}
 
 		_draftsNotReadMap.remove(peer);
+		_draftsToWrite.remove(peer);
 	} else {
 		auto i = _draftsMap.constFind(peer);
 		if (i == _draftsMap.cend()) {
@@ -2508,6 +3455,27 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 			_writeMap(WriteMapWhen::Fast);
 		}
 
+		_draftsToWrite[peer] = qMakePair(localDraft, editDraft);
+		_draftsNotReadMap.remove(peer);
+		_manager->writeDrafts();
+	}
+}
+
+void _writeDrafts() {
+	if (_manager) {
+		_manager->writingDrafts();
+	}
+	if (!_working()) return;
+
+	for (auto j = _draftsToWrite.cbegin(), e = _draftsToWrite.cend(); j != e; ++j) {
+		auto peer = j.key();
+		auto &localDraft = j.value().first;
+		auto &editDraft = j.value().second;
+		auto i = _draftsMap.constFind(peer);
+		if (i == _draftsMap.cend()) {
+			continue;
+		}
+
 		auto msgTags = Ui::FlatTextarea::serializeTagsList(localDraft.textWithTags.tags);
 		auto editTags = Ui::FlatTextarea::serializeTagsList(editDraft.textWithTags.tags);
 
@@ -2524,12 +3492,30 @@ void writeDrafts(const PeerId &peer, const MessageDraft &localDraft, const Messa
 
 		FileWriteDescriptor file(i.value());
 		file.writeEncrypted(data);
+	}
+	_draftsToWrite.clear();
 
-		_draftsNotReadMap.remove(peer);
+	for (auto j = _draftCursorsToWrite.cbegin(), e = _draftCursorsToWrite.cend(); j != e; ++j) {
+		auto peer = j.key();
+		auto &msgCursor = j.value().first;
+		auto &editCursor = j.value().second;
+		auto i = _draftCursorsMap.constFind(peer);
+		if (i == _draftCursorsMap.cend()) {
+			continue;
+		}
+
+		EncryptedDescriptor data(sizeof(quint64) + sizeof(qint32) * 3);
+		data.stream << quint64(peer) << qint32(msgCursor.position) << qint32(msgCursor.anchor) << qint32(msgCursor.scroll);
+		data.stream << qint32(editCursor.position) << qint32(editCursor.anchor) << qint32(editCursor.scroll);
+
+		FileWriteDescriptor file(i.value());
+		file.writeEncrypted(data);
 	}
+	_draftCursorsToWrite.clear();
 }
 
 void clearDraftCursors(const PeerId &peer) {
+	_draftCursorsToWrite.remove(peer);
 	DraftsMap::iterator i = _draftCursorsMap.find(peer);
 	if (i != _draftCursorsMap.cend()) {
 		clearKey(i.value());
@@ -2648,12 +3634,8 @@ void writeDraftCursors(const PeerId &peer, const MessageCursor &msgCursor, const
 			_writeMap(WriteMapWhen::Fast);
 		}
 
-		EncryptedDescriptor data(sizeof(quint64) + sizeof(qint32) * 3);
-		data.stream << quint64(peer) << qint32(msgCursor.position) << qint32(msgCursor.anchor) << qint32(msgCursor.scroll);
-		data.stream << qint32(editCursor.position) << qint32(editCursor.anchor) << qint32(editCursor.scroll);
-
-		FileWriteDescriptor file(i.value());
-		file.writeEncrypted(data);
+		_draftCursorsToWrite[peer] = qMakePair(msgCursor, editCursor);
+		_manager->writeDrafts();
 	}
 }
 
@@ -2673,28 +3655,16 @@ void writeFileLocation(MediaKey location, const FileLocation &local) {
 		location = aliasIt.value();
 	}
 
-	FileLocationPairs::iterator i = _fileLocationPairs.find(local.fname);
-	if (i != _fileLocationPairs.cend()) {
-		if (i.value().second == local) {
-			if (i.value().first != location) {
-				_fileLocationAliases.insert(location, i.value().first);
-				_writeLocations(WriteMapWhen::Fast);
-			}
-			return;
-		}
-		if (i.value().first != location) {
-			for (FileLocations::iterator j = _fileLocations.find(i.value().first), e = _fileLocations.end(); (j != e) && (j.key() == i.value().first);) {
-				if (j.value() == i.value().second) {
-					_fileLocations.erase(j);
-					break;
-				}
-			}
-			_fileLocationPairs.erase(i);
-		}
+	switch (_applyFileLocation(location, local)) {
+	case FileLocationChange::Alias:
+		_writeLocationAliasToLog(location, _fileLocationAliases.value(location));
+		break;
+	case FileLocationChange::Location:
+		_writeLocationToLog(location, local);
+		break;
+	case FileLocationChange::None:
+		break;
 	}
-	_fileLocations.insert(location, local);
-	_fileLocationPairs.insert(local.fname, FileLocationPair(location, local));
-	_writeLocations(WriteMapWhen::Fast);
 }
 
 FileLocation readFileLocation(MediaKey location, bool check) {
@@ -2718,6 +3688,120 @@ FileLocation readFileLocation(MediaKey location, bool check) {
 	return FileLocation();
 }
 
+void _writePartialDownloads() {
+	if (!_working()) return;
+
+	if (_partialDownloadKeys.isEmpty()) {
+		if (_partialDownloadsKey) {
+			clearKey(_partialDownloadsKey);
+			_partialDownloadsKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+	} else {
+		if (!_partialDownloadsKey) {
+			_partialDownloadsKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(quint32) + _partialDownloadKeys.size() * sizeof(quint64) * 3;
+
+		EncryptedDescriptor data(size);
+		data.stream << quint32(_partialDownloadKeys.size());
+		for (auto i = _partialDownloadKeys.cbegin(), e = _partialDownloadKeys.cend(); i != e; ++i) {
+			data.stream << quint64(i.key().first) << quint64(i.key().second) << quint64(i.value());
+		}
+
+		FileWriteDescriptor file(_partialDownloadsKey);
+		file.writeEncrypted(data);
+	}
+}
+
+void _readPartialDownloads() {
+	if (_partialDownloadsRead) return;
+	_partialDownloadsRead = true;
+	if (!_partialDownloadsKey) return;
+
+	FileReadDescriptor downloads;
+	if (!readEncryptedFile(downloads, _partialDownloadsKey)) {
+		clearKey(_partialDownloadsKey);
+		_partialDownloadsKey = 0;
+		_writeMap();
+		return;
+	}
+
+	quint32 count = 0;
+	downloads.stream >> count;
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 first = 0, second = 0, key = 0;
+		downloads.stream >> first >> second >> key;
+		if (!_checkStreamStatus(downloads.stream)) {
+			break;
+		}
+		_partialDownloadKeys.insert(MediaKey(first, second), key);
+	}
+}
+
+void writePartialDownload(MediaKey location, const PartialDownload &download) {
+	if (!_working()) return;
+
+	_readPartialDownloads();
+	auto i = _partialDownloadKeys.constFind(location);
+	if (i == _partialDownloadKeys.cend()) {
+		i = _partialDownloadKeys.insert(location, genKey());
+		_writePartialDownloads();
+	}
+	_partialDownloads.insert(location, download);
+
+	// filename + size + part size + parts bitmap
+	quint32 size = Serialize::stringSize(download.filename) + sizeof(qint32) * 2 + Serialize::bytearraySize(download.parts);
+	EncryptedDescriptor data(size);
+	data.stream << download.filename << qint32(download.size) << qint32(download.partSize) << download.parts;
+
+	FileWriteDescriptor file(i.value());
+	file.writeEncrypted(data);
+}
+
+PartialDownload readPartialDownload(MediaKey location) {
+	_readPartialDownloads();
+	auto cached = _partialDownloads.constFind(location);
+	if (cached != _partialDownloads.cend()) {
+		return cached.value();
+	}
+	auto i = _partialDownloadKeys.constFind(location);
+	if (i == _partialDownloadKeys.cend()) {
+		return PartialDownload();
+	}
+
+	FileReadDescriptor file;
+	if (!readEncryptedFile(file, i.value())) {
+		clearPartialDownload(location);
+		return PartialDownload();
+	}
+
+	auto result = PartialDownload();
+	qint32 size = 0, partSize = 0;
+	file.stream >> result.filename >> size >> partSize >> result.parts;
+	if (!_checkStreamStatus(file.stream)) {
+		return PartialDownload();
+	}
+	result.size = size;
+	result.partSize = partSize;
+	_partialDownloads.insert(location, result);
+	return result;
+}
+
+void clearPartialDownload(MediaKey location) {
+	_readPartialDownloads();
+	_partialDownloads.remove(location);
+	auto i = _partialDownloadKeys.find(location);
+	if (i != _partialDownloadKeys.end()) {
+		clearKey(i.value());
+		_partialDownloadKeys.erase(i);
+		_writePartialDownloads();
+	}
+}
+
 qint32 _storageImageSize(qint32 rawlen) {
 	// fulllen + storagekey + type + len + data
 	qint32 result = sizeof(uint32) + sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + rawlen;
@@ -2755,8 +3839,9 @@ void writeImage(const StorageKey &location, const StorageImageSaved &image, bool
 
 	qint32 size = _storageImageSize(image.data.size());
 	StorageMap::const_iterator i = _imagesMap.constFind(location);
-	if (i == _imagesMap.cend()) {
-		i = _imagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
+	auto fresh = (i == _imagesMap.cend());
+	if (fresh) {
+		i = _imagesMap.insert(location, FileDesc(genMediaKey(), size));
 		_storageImagesSize += size;
 		_mapChanged = true;
 		_writeMap();
@@ -2769,8 +3854,8 @@ void writeImage(const StorageKey &location, const StorageImageSaved &image, bool
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + image.data.size());
 	data.stream << quint64(location.first) << quint64(location.second) << quint32(legacyTypeField) << image.data;
 
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	writeMediaEncrypted(i.value().first, data, fresh);
+	_touchMedia(i.value().first);
 	if (i.value().second != size) {
 		_storageImagesSize += size;
 		_storageImagesSize -= i.value().second;
@@ -2786,7 +3871,7 @@ public:
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		if (!readMediaEncrypted(image, _key)) {
 			return;
 		}
 
@@ -2852,7 +3937,8 @@ public:
 	void clearInMap() override {
 		StorageMap::iterator j = _imagesMap.find(_location);
 		if (j != _imagesMap.cend() && j->first == _key) {
-			clearKey(_key, FileOption::User);
+			_forgetMedia(_key);
+			clearMediaKey(_key);
 			_storageImagesSize -= j->second;
 			_imagesMap.erase(j);
 		}
@@ -2864,6 +3950,7 @@ TaskId startImageLoad(const StorageKey &location, mtpFileLoader *loader) {
 	if (j == _imagesMap.cend() || !_localLoader) {
 		return 0;
 	}
+	_touchMedia(j->first);
 	return _localLoader->addTask(MakeShared<ImageLoadTask>(j->first, location, loader));
 }
 
@@ -2880,8 +3967,9 @@ void writeStickerImage(const StorageKey &location, const QByteArray &sticker, bo
 
 	qint32 size = _storageStickerSize(sticker.size());
 	StorageMap::const_iterator i = _stickerImagesMap.constFind(location);
-	if (i == _stickerImagesMap.cend()) {
-		i = _stickerImagesMap.insert(location, FileDesc(genKey(FileOption::User), size));
+	auto fresh = (i == _stickerImagesMap.cend());
+	if (fresh) {
+		i = _stickerImagesMap.insert(location, FileDesc(genMediaKey(), size));
 		_storageStickersSize += size;
 		_mapChanged = true;
 		_writeMap();
@@ -2890,8 +3978,8 @@ void writeStickerImage(const StorageKey &location, const QByteArray &sticker, bo
 	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + sticker.size());
 	data.stream << quint64(location.first) << quint64(location.second) << sticker;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	writeMediaEncrypted(i.value().first, data, fresh);
+	_touchMedia(i.value().first);
 	if (i.value().second != size) {
 		_storageStickersSize += size;
 		_storageStickersSize -= i.value().second;
@@ -2910,7 +3998,8 @@ public:
 	void clearInMap() {
 		auto j = _stickerImagesMap.find(_location);
 		if (j != _stickerImagesMap.cend() && j->first == _key) {
-			clearKey(j.value().first, FileOption::User);
+			_forgetMedia(j.value().first);
+			clearMediaKey(j.value().first);
 			_storageStickersSize -= j.value().second;
 			_stickerImagesMap.erase(j);
 		}
@@ -2922,6 +4011,7 @@ TaskId startStickerImageLoad(const StorageKey &location, mtpFileLoader *loader)
 	if (j == _stickerImagesMap.cend() || !_localLoader) {
 		return 0;
 	}
+	_touchMedia(j->first);
 	return _localLoader->addTask(MakeShared<StickerImageLoadTask>(j->first, location, loader));
 }
 
@@ -2953,8 +4043,9 @@ void writeAudio(const StorageKey &location, const QByteArray &audio, bool overwr
 
 	qint32 size = _storageAudioSize(audio.size());
 	StorageMap::const_iterator i = _audiosMap.constFind(location);
-	if (i == _audiosMap.cend()) {
-		i = _audiosMap.insert(location, FileDesc(genKey(FileOption::User), size));
+	auto fresh = (i == _audiosMap.cend());
+	if (fresh) {
+		i = _audiosMap.insert(location, FileDesc(genMediaKey(), size));
 		_storageAudiosSize += size;
 		_mapChanged = true;
 		_writeMap();
@@ -2963,8 +4054,8 @@ void writeAudio(const StorageKey &location, const QByteArray &audio, bool overwr
 	}
 	EncryptedDescriptor data(sizeof(quint64) * 2 + sizeof(quint32) + sizeof(quint32) + audio.size());
 	data.stream << quint64(location.first) << quint64(location.second) << audio;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	writeMediaEncrypted(i.value().first, data, fresh);
+	_touchMedia(i.value().first);
 	if (i.value().second != size) {
 		_storageAudiosSize += size;
 		_storageAudiosSize -= i.value().second;
@@ -2983,7 +4074,8 @@ public:
 	void clearInMap() {
 		auto j = _audiosMap.find(_location);
 		if (j != _audiosMap.cend() && j->first == _key) {
-			clearKey(j.value().first, FileOption::User);
+			_forgetMedia(j.value().first);
+			clearMediaKey(j.value().first);
 			_storageAudiosSize -= j.value().second;
 			_audiosMap.erase(j);
 		}
@@ -2995,6 +4087,7 @@ TaskId startAudioLoad(const StorageKey &location, mtpFileLoader *loader) {
 	if (j == _audiosMap.cend() || !_localLoader) {
 		return 0;
 	}
+	_touchMedia(j->first);
 	return _localLoader->addTask(MakeShared<AudioLoadTask>(j->first, location, loader));
 }
 
@@ -3030,8 +4123,9 @@ void writeWebFile(const QString &url, const QByteArray &content, bool overwrite)
 
 	qint32 size = _storageWebFileSize(url, content.size());
 	WebFilesMap::const_iterator i = _webFilesMap.constFind(url);
-	if (i == _webFilesMap.cend()) {
-		i = _webFilesMap.insert(url, FileDesc(genKey(FileOption::User), size));
+	auto fresh = (i == _webFilesMap.cend());
+	if (fresh) {
+		i = _webFilesMap.insert(url, FileDesc(genMediaKey(), size));
 		_storageWebFilesSize += size;
 		_writeLocations();
 	} else if (!overwrite) {
@@ -3039,8 +4133,8 @@ void writeWebFile(const QString &url, const QByteArray &content, bool overwrite)
 	}
 	EncryptedDescriptor data(Serialize::stringSize(url) + sizeof(quint32) + sizeof(quint32) + content.size());
 	data.stream << url << content;
-	FileWriteDescriptor file(i.value().first, FileOption::User);
-	file.writeEncrypted(data);
+	writeMediaEncrypted(i.value().first, data, fresh);
+	_touchMedia(i.value().first);
 	if (i.value().second != size) {
 		_storageWebFilesSize += size;
 		_storageWebFilesSize -= i.value().second;
@@ -3058,7 +4152,7 @@ public:
 	}
 	void process() {
 		FileReadDescriptor image;
-		if (!readEncryptedFile(image, _key, FileOption::User)) {
+		if (!readMediaEncrypted(image, _key)) {
 			return;
 		}
 
@@ -3074,7 +4168,8 @@ public:
 		} else {
 			WebFilesMap::iterator j = _webFilesMap.find(_url);
 			if (j != _webFilesMap.cend() && j->first == _key) {
-				clearKey(j.value().first, FileOption::User);
+				_forgetMedia(j.value().first);
+				clearMediaKey(j.value().first);
 				_storageWebFilesSize -= j.value().second;
 				_webFilesMap.erase(j);
 			}
@@ -3111,6 +4206,7 @@ TaskId startWebFileLoad(const QString &url, webFileLoader *loader) {
 	if (j == _webFilesMap.cend() || !_localLoader) {
 		return 0;
 	}
+	_touchMedia(j->first);
 	return _localLoader->addTask(MakeShared<WebFileLoadTask>(j->first, url, loader));
 }
 
@@ -3122,6 +4218,92 @@ qint64 storageWebFilesSize() {
 	return _storageWebFilesSize;
 }
 
+void _writeVoiceWaveforms() {
+	if (_manager) {
+		_manager->writingVoiceWaveforms();
+	}
+	if (!_working()) return;
+
+	if (_voiceWaveforms.isEmpty()) {
+		if (_voiceWaveformsKey) {
+			clearKey(_voiceWaveformsKey);
+			_voiceWaveformsKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+	} else {
+		if (!_voiceWaveformsKey) {
+			_voiceWaveformsKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(quint32);
+		for (auto i = _voiceWaveforms.cbegin(), e = _voiceWaveforms.cend(); i != e; ++i) {
+			// id + count + samples
+			size += sizeof(quint64) + sizeof(quint32) + i.value().size() * sizeof(qint8);
+		}
+
+		EncryptedDescriptor data(size);
+		data.stream << quint32(_voiceWaveforms.size());
+		for (auto i = _voiceWaveforms.cbegin(), e = _voiceWaveforms.cend(); i != e; ++i) {
+			data.stream << quint64(i.key()) << i.value();
+		}
+
+		FileWriteDescriptor file(_voiceWaveformsKey);
+		file.writeEncrypted(data);
+	}
+}
+
+void _readVoiceWaveforms() {
+	if (_voiceWaveformsRead) return;
+	_voiceWaveformsRead = true;
+	if (!_voiceWaveformsKey) return;
+
+	FileReadDescriptor waveforms;
+	if (!readEncryptedFile(waveforms, _voiceWaveformsKey)) {
+		clearKey(_voiceWaveformsKey);
+		_voiceWaveformsKey = 0;
+		_writeMap();
+		return;
+	}
+
+	quint32 count = 0;
+	waveforms.stream >> count;
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 id = 0;
+		auto waveform = VoiceWaveform();
+		waveforms.stream >> id >> waveform;
+		if (!_checkStreamStatus(waveforms.stream)) {
+			break;
+		}
+		_voiceWaveforms.insert(id, waveform);
+	}
+}
+
+void _saveVoiceWaveform(DocumentId id, const VoiceWaveform &waveform) {
+	_readVoiceWaveforms();
+	_voiceWaveforms.insert(id, waveform);
+
+	// Document ids grow with time, forget the waveforms of the oldest ones.
+	while (_voiceWaveforms.size() > kVoiceWaveformsLimit) {
+		_voiceWaveforms.erase(_voiceWaveforms.begin());
+	}
+	if (_manager) {
+		_manager->writeVoiceWaveforms();
+	} else {
+		_writeVoiceWaveforms();
+	}
+}
+
+char _waveformMax(const VoiceWaveform &waveform) {
+	uchar wavemax = 0;
+	for (int32 i = 0, l = waveform.size(); i < l; ++i) {
+		uchar waveat = waveform.at(i);
+		if (wavemax < waveat) wavemax = waveat;
+	}
+	return wavemax;
+}
+
 class CountWaveformTask : public Task {
 public:
 	CountWaveformTask(DocumentData *doc)
@@ -3137,18 +4319,14 @@ public:
 		if (!_doc) return;
 
 		_waveform = audioCountWaveform(_loc, _data);
-		uchar wavemax = 0;
-		for (int32 i = 0, l = _waveform.size(); i < l; ++i) {
-			uchar waveat = _waveform.at(i);
-			if (wavemax < waveat) wavemax = waveat;
-		}
-		_wavemax = wavemax;
+		_wavemax = _waveformMax(_waveform);
 	}
 	void finish() {
 		if (VoiceData *voice = _doc ? _doc->voice() : 0) {
 			if (!_waveform.isEmpty()) {
 				voice->waveform = _waveform;
 				voice->wavemax = _wavemax;
+				_saveVoiceWaveform(_doc->id, _waveform);
 			}
 			if (voice->waveform.isEmpty()) {
 				voice->waveform.resize(1);
@@ -3184,6 +4362,13 @@ protected:
 
 void countVoiceWaveform(DocumentData *document) {
 	if (VoiceData *voice = document->voice()) {
+		_readVoiceWaveforms();
+		auto i = _voiceWaveforms.constFind(document->id);
+		if (i != _voiceWaveforms.cend()) {
+			voice->waveform = i.value();
+			voice->wavemax = _waveformMax(voice->waveform);
+			return;
+		}
 		if (_localLoader) {
 			voice->waveform.resize(1 + sizeof(TaskId));
 			voice->waveform[0] = -1; // counting
@@ -3224,6 +4409,20 @@ void _writeStickerSet(QDataStream &stream, const Stickers::Set &set) {
 	}
 }
 
+quint32 _stickerSetSize(const Stickers::Set &set) {
+	// id + access + title + shortName + stickersCount + hash + flags
+	auto result = quint32(sizeof(quint64) * 2 + Serialize::stringSize(set.title) + Serialize::stringSize(set.shortName) + sizeof(quint32) + sizeof(qint32) * 2);
+	for_const (auto &sticker, set.stickers) {
+		result += Serialize::Document::sizeInStream(sticker);
+	}
+
+	result += sizeof(qint32); // emojiCount
+	for (auto j = set.emoji.cbegin(), e = set.emoji.cend(); j != e; ++j) {
+		result += Serialize::stringSize(j.key()->id()) + sizeof(qint32) + (j->size() * sizeof(quint64));
+	}
+	return result;
+}
+
 // In generic method _writeStickerSets() we look through all the sets and call a
 // callback on each set to see, if we write it, skip it or abort the whole write.
 enum class StickerSetCheckResult {
@@ -3258,17 +4457,7 @@ void _writeStickerSets(FileKey &stickersKey, CheckSet checkSet, const Stickers::
 			continue;
 		}
 
-		// id + access + title + shortName + stickersCount + hash + flags
-		size += sizeof(quint64) * 2 + Serialize::stringSize(set.title) + Serialize::stringSize(set.shortName) + sizeof(quint32) + sizeof(qint32) * 2;
-		for_const (auto &sticker, set.stickers) {
-			size += Serialize::Document::sizeInStream(sticker);
-		}
-
-		size += sizeof(qint32); // emojiCount
-		for (auto j = set.emoji.cbegin(), e = set.emoji.cend(); j != e; ++j) {
-			size += Serialize::stringSize(j.key()->id()) + sizeof(qint32) + (j->size() * sizeof(quint64));
-		}
-
+		size += _stickerSetSize(set);
 		++setsCount;
 	}
 	if (!setsCount && order.isEmpty()) {
@@ -3304,6 +4493,34 @@ void _writeStickerSets(FileKey &stickersKey, CheckSet checkSet, const Stickers::
 	file.writeEncrypted(data);
 }
 
+// Cheap fingerprint of the set contents, so that unchanged sets are not
+// serialized and encrypted again each time the installed sets are written.
+quint64 _stickerSetSignature(const Stickers::Set &set) {
+	auto result = (quint64(uint32(set.hash)) << 32) | quint64(uint32(set.flags));
+	for_const (auto sticker, set.stickers) {
+		result = (result * 20261) + sticker->id;
+	}
+	result = (result * 20261) + quint64(set.emoji.size());
+	return result;
+}
+
+// Writes a file in the _readStickerSets() format with just one set and an empty order.
+void _writeSingleStickerSet(FileKey &stickersKey, const Stickers::Set &set) {
+	if (!stickersKey) {
+		stickersKey = genKey();
+		_mapChanged = true;
+	}
+	QByteArray hashToWrite;
+	quint32 size = sizeof(quint32) + Serialize::bytearraySize(hashToWrite) + _stickerSetSize(set) + sizeof(qint32);
+	EncryptedDescriptor data(size);
+	data.stream << quint32(1) << hashToWrite;
+	_writeStickerSet(data.stream, set);
+	data.stream << Stickers::Order();
+
+	FileWriteDescriptor file(stickersKey);
+	file.writeEncrypted(data);
+}
+
 void _readStickerSets(FileKey &stickersKey, Stickers::Order *outOrder = nullptr, MTPDstickerSet::Flags readingFlags = 0) {
 	FileReadDescriptor stickers;
 	if (!readEncryptedFile(stickers, stickersKey)) {
@@ -3453,10 +4670,13 @@ void _readStickerSets(FileKey &stickersKey, Stickers::Order *outOrder = nullptr,
 	}
 }
 
-void writeInstalledStickers() {
-	if (!Global::started()) return;
+void _writeInstalledStickers() {
+	if (_manager) {
+		_manager->writingInstalledStickers();
+	}
+	if (!Global::started() || !_working()) return;
 
-	_writeStickerSets(_installedStickersKey, [](const Stickers::Set &set) {
+	auto checkSet = [](const Stickers::Set &set) {
 		if (set.id == Stickers::CloudRecentSetId || set.id == Stickers::FavedSetId) { // separate files for them
 			return StickerSetCheckResult::Skip;
 		} else if (set.flags & MTPDstickerSet_ClientFlag::f_special) {
@@ -3470,10 +4690,68 @@ void writeInstalledStickers() {
 		} else if (set.stickers.isEmpty()) {
 			return StickerSetCheckResult::Skip;
 		}
-		return StickerSetCheckResult::Write;
+		return StickerSetCheckResult::Write;
+	};
+
+	auto &sets = Global::StickerSets();
+	auto separate = QVector<const Stickers::Set*>();
+	for_const (auto &set, sets) {
+		if (set.flags & MTPDstickerSet_ClientFlag::f_special) {
+			continue;
+		}
+		auto result = checkSet(set);
+		if (result == StickerSetCheckResult::Abort) {
+			return;
+		} else if (result == StickerSetCheckResult::Write) {
+			separate.push_back(&set);
+		}
+	}
+
+	auto mapChanged = false;
+	for (auto i = _installedStickerSetsMap.begin(); i != _installedStickerSetsMap.end();) {
+		auto it = sets.constFind(i.key());
+		if (it == sets.cend() || !separate.contains(&it.value())) {
+			clearKey(i.value());
+			_installedStickerSetsWritten.remove(i.key());
+			i = _installedStickerSetsMap.erase(i);
+			mapChanged = true;
+		} else {
+			++i;
+		}
+	}
+	for_const (auto set, separate) {
+		auto signature = _stickerSetSignature(*set);
+		auto &key = _installedStickerSetsMap[set->id];
+		if (!key) {
+			mapChanged = true;
+		} else if (_installedStickerSetsWritten.value(set->id) == signature) {
+			continue;
+		}
+		_writeSingleStickerSet(key, *set);
+		_installedStickerSetsWritten.insert(set->id, signature);
+	}
+	if (mapChanged) {
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+
+	_writeStickerSets(_installedStickersKey, [&checkSet](const Stickers::Set &set) {
+		if (!(set.flags & MTPDstickerSet_ClientFlag::f_special)) {
+			return StickerSetCheckResult::Skip;
+		}
+		return checkSet(set);
 	}, Global::StickerSetsOrder());
 }
 
+void writeInstalledStickers() {
+	// Installed sets are updated in bursts while syncing, write them once.
+	if (_manager) {
+		_manager->writeInstalledStickers();
+	} else {
+		_writeInstalledStickers();
+	}
+}
+
 void writeFeaturedStickers() {
 	if (!Global::started()) return;
 
@@ -3608,7 +4886,32 @@ void readInstalledStickers() {
 	}
 
 	Global::RefStickerSets().clear();
+
+	// Read the separate set files first, the installed flags are set from the order.
+	auto mapChanged = false;
+	for (auto i = _installedStickerSetsMap.begin(); i != _installedStickerSetsMap.end();) {
+		auto key = i.value();
+		_readStickerSets(key);
+		if (!key) {
+			i = _installedStickerSetsMap.erase(i);
+			mapChanged = true;
+		} else {
+			++i;
+		}
+	}
+	if (mapChanged) {
+		_mapChanged = true;
+		_writeMap();
+	}
 	_readStickerSets(_installedStickersKey, &Global::RefStickerSetsOrder(), MTPDstickerSet::Flag::f_installed);
+
+	auto &sets = Global::StickerSets();
+	for (auto i = _installedStickerSetsMap.cbegin(), e = _installedStickerSetsMap.cend(); i != e; ++i) {
+		auto it = sets.constFind(i.key());
+		if (it != sets.cend()) {
+			_installedStickerSetsWritten.insert(i.key(), _stickerSetSignature(it.value()));
+		}
+	}
 }
 
 void readFeaturedStickers() {
@@ -3663,6 +4966,9 @@ int32 countSpecialStickerSetHash(uint64 setId) {
 	return 0;
 }
 
+// These are recounted on each sync request instead of being kept up to
+// date incrementally: sticker sets are modified in many places and a
+// stale hash would silently stop the server from sending updates.
 int32 countStickersHash(bool checkOutdatedInfo) {
 	uint32 acc = 0;
 	bool foundOutdated = false;
@@ -3771,6 +5077,26 @@ void readSavedGifs() {
 	}
 }
 
+void scheduleDeferredStickersRead() {
+	_deferredStickersReadPending = true;
+}
+
+void readDeferredStickers() {
+	if (!base::take(_deferredStickersReadPending)) {
+		return;
+	}
+	auto ms = getms();
+	readRecentStickers();
+	readFavedStickers();
+	readSavedGifs();
+	DEBUG_LOG(("Startup Info: deferred stickers read in %1 ms").arg(getms() - ms));
+
+	if (AuthSession::Exists()) {
+		Auth().data().stickersUpdated().notify(true);
+		Auth().data().savedGifsUpdated().notify();
+	}
+}
+
 void writeBackground(int32 id, const QImage &img) {
 	if (!_working() || !_backgroundCanWrite) return;
 
@@ -4338,6 +5664,327 @@ void readSavedPeers() {
 	Auth().api().requestPeers(peers);
 }
 
+void _writeDialogsSnapshot() {
+	if (_manager) {
+		_manager->writingDialogsSnapshot();
+	}
+	if (!_working() || !App::main()) return;
+
+	auto histories = QVector<History*>();
+	auto list = App::main()->dialogsList();
+	histories.reserve(qMin(list->size(), kDialogsSnapshotLimit));
+	for_const (auto row, list->all()) {
+		histories.push_back(row->history());
+		if (histories.size() == kDialogsSnapshotLimit) {
+			break;
+		}
+	}
+
+	if (histories.isEmpty()) {
+		if (_dialogsSnapshotKey) {
+			clearKey(_dialogsSnapshotKey);
+			_dialogsSnapshotKey = 0;
+			_mapChanged = true;
+		}
+		_writeMap();
+	} else {
+		if (!_dialogsSnapshotKey) {
+			_dialogsSnapshotKey = genKey();
+			_mapChanged = true;
+			_writeMap(WriteMapWhen::Fast);
+		}
+		quint32 size = sizeof(quint32) * 2;
+		for_const (auto history, histories) {
+			size += _peerSize(history->peer) + Serialize::dateTimeSize() + sizeof(qint32) * 5;
+		}
+
+		EncryptedDescriptor data(size);
+		data.stream << quint32(kDialogsSnapshotSchema) << quint32(histories.size());
+		for_const (auto history, histories) {
+			_writePeer(data.stream, history->peer);
+			data.stream << history->lastMsgDate;
+			data.stream << qint32(history->unreadCount()) << qint32(history->inboxReadBefore - 1) << qint32(history->outboxReadBefore - 1);
+			data.stream << qint32(history->isPinnedDialog() ? 1 : 0) << qint32(history->mute() ? 1 : 0);
+		}
+
+		FileWriteDescriptor file(_dialogsSnapshotKey);
+		file.writeEncrypted(data);
+	}
+}
+
+void writeDialogsSnapshot() {
+	// The list is reordered on each new message, write it once in a while.
+	if (_manager) {
+		_manager->writeDialogsSnapshot();
+	} else {
+		_writeDialogsSnapshot();
+	}
+}
+
+void _writePreparedUserpics() {
+	if (_manager) {
+		_manager->writingPreparedUserpics();
+	}
+	if (!_working()) return;
+
+	// Only the userpics drawn in this session are kept.
+	if (_preparedUserpicsUsed.isEmpty()) {
+		if (_preparedUserpicsKey) {
+			clearKey(_preparedUserpicsKey);
+			_preparedUserpicsKey = 0;
+			_mapChanged = true;
+			_writeMap();
+		}
+		return;
+	}
+	if (!_preparedUserpicsKey) {
+		_preparedUserpicsKey = genKey();
+		_mapChanged = true;
+		_writeMap(WriteMapWhen::Fast);
+	}
+	auto images = QVector<QImage>();
+	images.reserve(_preparedUserpicsUsed.size());
+	quint32 size = sizeof(quint32) * 2;
+	for_const (auto &key, _preparedUserpicsUsed) {
+		auto image = _preparedUserpics.value(key).toImage();
+		if (image.format() != QImage::Format_ARGB32_Premultiplied) {
+			image = std::move(image).convertToFormat(QImage::Format_ARGB32_Premultiplied);
+		}
+		// location + size + width + height + pixels
+		size += sizeof(quint64) * 2 + sizeof(qint32) * 3 + sizeof(quint32) + image.byteCount();
+		images.push_back(std::move(image));
+	}
+
+	EncryptedDescriptor data(size);
+	data.stream << quint32(cIntRetinaFactor()) << quint32(images.size());
+	for (auto i = 0, count = images.size(); i != count; ++i) {
+		auto &key = _preparedUserpicsUsed[i];
+		auto &image = images[i];
+		data.stream << quint64(key.first.first) << quint64(key.first.second) << qint32(key.second);
+		data.stream << qint32(image.width()) << qint32(image.height());
+		data.stream.writeBytes(reinterpret_cast<const char*>(image.constBits()), image.byteCount());
+	}
+
+	FileWriteDescriptor file(_preparedUserpicsKey);
+	file.writeEncrypted(data);
+}
+
+void _readPreparedUserpics() {
+	if (_preparedUserpicsRead) return;
+	_preparedUserpicsRead = true;
+	if (!_preparedUserpicsKey) return;
+
+	FileReadDescriptor userpics;
+	if (!readEncryptedFile(userpics, _preparedUserpicsKey)) {
+		clearKey(_preparedUserpicsKey);
+		_preparedUserpicsKey = 0;
+		_mapChanged = true;
+		_writeMap();
+		return;
+	}
+
+	quint32 factor = 0, count = 0;
+	userpics.stream >> factor >> count;
+	if (!_checkStreamStatus(userpics.stream) || factor != quint32(cIntRetinaFactor())) {
+		return;
+	}
+	for (quint32 i = 0; i < count; ++i) {
+		quint64 first = 0, second = 0;
+		qint32 size = 0, width = 0, height = 0;
+		QByteArray pixels;
+		userpics.stream >> first >> second >> size >> width >> height >> pixels;
+		if (!_checkStreamStatus(userpics.stream)) {
+			break;
+		} else if (width <= 0 || height <= 0 || pixels.size() != width * height * 4) {
+			continue;
+		}
+		auto image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+		memcpy(image.bits(), pixels.constData(), pixels.size());
+		image.setDevicePixelRatio(cRetinaFactor());
+		_preparedUserpics.insert(qMakePair(StorageKey(first, second), int(size)), App::pixmapFromImageInPlace(std::move(image)));
+	}
+}
+
+void _usePreparedUserpic(const PreparedUserpicKey &key) {
+	if (_preparedUserpicsUsed.contains(key)) return;
+	_preparedUserpicsUsed.push_back(key);
+	if (_manager) {
+		_manager->writePreparedUserpics();
+	}
+}
+
+void writePreparedUserpic(const StorageKey &location, int size, const QPixmap &prepared) {
+	if (!_working() || prepared.isNull()) return;
+	_readPreparedUserpics();
+
+	auto key = qMakePair(location, size);
+	if (_preparedUserpicsUsed.contains(key) && _preparedUserpics.contains(key)) {
+		return;
+	} else if (_preparedUserpicsUsed.size() >= kPreparedUserpicsLimit && !_preparedUserpicsUsed.contains(key)) {
+		return;
+	}
+	_preparedUserpics.insert(key, prepared);
+	_usePreparedUserpic(key);
+}
+
+QPixmap readPreparedUserpic(const StorageKey &location, int size) {
+	if (!_working()) return QPixmap();
+	_readPreparedUserpics();
+
+	auto key = qMakePair(location, size);
+	auto i = _preparedUserpics.constFind(key);
+	if (i == _preparedUserpics.cend()) {
+		return QPixmap();
+	}
+	if (_preparedUserpicsUsed.size() < kPreparedUserpicsLimit) {
+		_usePreparedUserpic(key);
+	}
+	return i.value();
+}
+
+QVector<History*> readDialogsSnapshot() {
+	auto result = QVector<History*>();
+	if (!_dialogsSnapshotKey) return result;
+
+	FileReadDescriptor snapshot;
+	if (!readEncryptedFile(snapshot, _dialogsSnapshotKey)) {
+		clearKey(_dialogsSnapshotKey);
+		_dialogsSnapshotKey = 0;
+		_mapChanged = true;
+		_writeMap();
+		return result;
+	}
+
+	quint32 schema = 0, count = 0;
+	snapshot.stream >> schema >> count;
+	if (!_checkStreamStatus(snapshot.stream)) {
+		return result;
+	}
+	if (schema != kDialogsSnapshotSchema) {
+		LOG(("App Info: skipping dialogs snapshot with schema %1").arg(schema));
+		return result;
+	}
+
+	auto pinned = QVector<History*>();
+	result.reserve(count);
+	for (quint32 i = 0; i < count; ++i) {
+		auto peer = _readPeer(snapshot);
+		if (!peer) break;
+
+		QDateTime date;
+		qint32 unreadCount = 0, maxInboxRead = 0, maxOutboxRead = 0, isPinned = 0, isMuted = 0;
+		snapshot.stream >> date >> unreadCount >> maxInboxRead >> maxOutboxRead >> isPinned >> isMuted;
+		if (!_checkStreamStatus(snapshot.stream)) {
+			break;
+		}
+
+		auto history = App::historyFromDialog(peer->id, unreadCount, maxInboxRead, maxOutboxRead);
+		if (history->inChatList(Dialogs::Mode::All)) {
+			continue;
+		}
+		history->setMute(isMuted != 0);
+		if (isPinned) {
+			pinned.push_back(history);
+		}
+		history->setChatsListDate(date);
+		result.push_back(history);
+	}
+
+	// Pinned dialogs are written in the chats list order, top first.
+	for (auto i = pinned.size(); i != 0;) {
+		pinned[--i]->setPinnedDialog(true);
+	}
+	Notify::unreadCounterUpdated();
+
+	return result;
+}
+
+void writeHistoryCache(PeerId peer, const MTPmessages_Messages &messages) {
+	if (!_working()) return;
+
+	auto key = FileKey(0);
+	for (auto i = _historyCacheKeys.begin(), e = _historyCacheKeys.end(); i != e; ++i) {
+		if (i->first == peer) {
+			key = i->second;
+			_historyCacheKeys.erase(i);
+			break;
+		}
+	}
+	if (key) {
+		_historyCacheOrderChanged = true;
+	} else {
+		key = genKey();
+		while (_historyCacheKeys.size() >= kHistoryCacheLimit) {
+			clearKey(_historyCacheKeys.front().second);
+			_historyCacheKeys.pop_front();
+		}
+		_mapChanged = true;
+		_writeMap();
+	}
+	_historyCacheKeys.push_back(qMakePair(peer, key));
+
+	auto buffer = mtpBuffer();
+	messages.write(buffer);
+	auto bytes = QByteArray(reinterpret_cast<const char*>(buffer.constData()), buffer.size() * sizeof(mtpPrime));
+
+	EncryptedDescriptor data(sizeof(quint32) * 2 + Serialize::bytearraySize(bytes));
+	data.stream << quint32(kHistoryCacheSchema) << quint32(MTP::internal::CurrentLayer) << bytes;
+
+	FileWriteDescriptor file(key);
+	file.writeEncrypted(data);
+}
+
+base::optional<MTPmessages_Messages> readHistoryCache(PeerId peer) {
+	auto i = std::find_if(_historyCacheKeys.begin(), _historyCacheKeys.end(), [peer](auto &entry) {
+		return (entry.first == peer);
+	});
+	if (i == _historyCacheKeys.end()) {
+		return base::none;
+	}
+
+	FileReadDescriptor cache;
+	if (!readEncryptedFile(cache, i->second)) {
+		clearHistoryCache(peer);
+		return base::none;
+	}
+
+	quint32 schema = 0, layer = 0;
+	QByteArray bytes;
+	cache.stream >> schema >> layer >> bytes;
+	if (!_checkStreamStatus(cache.stream)) {
+		return base::none;
+	}
+	if (schema != kHistoryCacheSchema || layer != quint32(MTP::internal::CurrentLayer)) {
+		// Written with another format or an older api layer, drop it.
+		clearHistoryCache(peer);
+		return base::none;
+	}
+
+	auto from = reinterpret_cast<const mtpPrime*>(bytes.constData());
+	auto end = from + bytes.size() / sizeof(mtpPrime);
+	auto result = MTPmessages_Messages();
+	try {
+		result.read(from, end);
+	} catch (Exception &e) {
+		LOG(("App Error: could not read history cache: %1").arg(e.what()));
+		clearHistoryCache(peer);
+		return base::none;
+	}
+	return result;
+}
+
+void clearHistoryCache(PeerId peer) {
+	for (auto i = _historyCacheKeys.begin(), e = _historyCacheKeys.end(); i != e; ++i) {
+		if (i->first == peer) {
+			clearKey(i->second);
+			_historyCacheKeys.erase(i);
+			_mapChanged = true;
+			_writeMap();
+			return;
+		}
+	}
+}
+
 void addSavedPeer(PeerData *peer, const QDateTime &position) {
 	auto &savedPeers = cRefSavedPeers();
 	auto i = savedPeers.find(peer);
@@ -4447,6 +6094,33 @@ bool decrypt(const void *src, void *dst, uint32 len, const void *key128) {
 	return true;
 }
 
+// The directory is renamed first, so that it can be created and filled
+// again right away while the old contents are still being removed.
+bool _removeDirectoryDetached(QString path) {
+	while (path.endsWith('/')) {
+		path.chop(1);
+	}
+	auto info = QFileInfo(path);
+	auto parent = info.dir();
+	auto prefix = info.fileName() + qsl("_removed_");
+	auto result = true;
+	if (info.exists()) {
+		auto detached = prefix + QString::number(rand_value<uint32>(), 16);
+		if (!parent.rename(info.fileName(), detached)) {
+			return QDir(path).removeRecursively();
+		}
+	}
+
+	// Remove the directories left by the interrupted removals as well.
+	auto filters = QStringList(prefix + '*');
+	for_const (auto &name, parent.entryList(filters, QDir::Dirs | QDir::Hidden | QDir::NoDotAndDotDot)) {
+		if (!QDir(parent.filePath(name)).removeRecursively()) {
+			result = false;
+		}
+	}
+	return result;
+}
+
 struct ClearManagerData {
 	QThread *thread;
 	StorageMap images, stickers, audios;
@@ -4503,6 +6177,37 @@ bool ClearManager::addTask(int task) {
 			_trustedBotsKey = 0;
 			_mapChanged = true;
 		}
+		if (_partialDownloadsKey) {
+			_partialDownloadsKey = 0;
+			_partialDownloads.clear();
+			_partialDownloadKeys.clear();
+			_mapChanged = true;
+		}
+		if (_mediaAccessKey) {
+			_mediaAccessKey = 0;
+			_mapChanged = true;
+		}
+		_mediaAccess.clear();
+		_mediaAccessChanged = false;
+		if (_dialogsSnapshotKey) {
+			_dialogsSnapshotKey = 0;
+			_mapChanged = true;
+		}
+		if (!_historyCacheKeys.isEmpty()) {
+			_historyCacheKeys.clear();
+			_mapChanged = true;
+		}
+		if (_voiceWaveformsKey) {
+			_voiceWaveformsKey = 0;
+			_voiceWaveforms.clear();
+			_mapChanged = true;
+		}
+		if (_preparedUserpicsKey) {
+			_preparedUserpicsKey = 0;
+			_preparedUserpics.clear();
+			_preparedUserpicsUsed.clear();
+			_mapChanged = true;
+		}
 		if (_recentStickersKeyOld) {
 			_recentStickersKeyOld = 0;
 			_mapChanged = true;
@@ -4511,6 +6216,11 @@ bool ClearManager::addTask(int task) {
 			_installedStickersKey = _featuredStickersKey = _recentStickersKey = _archivedStickersKey = 0;
 			_mapChanged = true;
 		}
+		if (!_installedStickerSetsMap.isEmpty()) {
+			_installedStickerSetsMap.clear();
+			_installedStickerSetsWritten.clear();
+			_mapChanged = true;
+		}
 		if (_recentHashtagsAndBotsKey) {
 			_recentHashtagsAndBotsKey = 0;
 			_mapChanged = true;
@@ -4586,6 +6296,12 @@ bool ClearManager::addTask(int task) {
 				_storageAudiosSize = 0;
 				_mapChanged = true;
 			}
+			_readMediaAccess();
+			if (!_mediaAccess.isEmpty()) {
+				_mediaAccess.clear();
+				_mediaAccessChanged = true;
+				_writeMediaAccess();
+			}
 			_writeMap();
 		}
 		for (int32 i = 0, l = data->tasks.size(); i < l; ++i) {
@@ -4648,7 +6364,10 @@ void ClearManager::onStart() {
 		}
 		switch (task) {
 		case ClearManagerAll: {
-			result = QDir(cTempDir()).removeRecursively();
+			if (_mediaPack) {
+				_mediaPack->clear();
+			}
+			result = _removeDirectoryDetached(cTempDir());
 			QDirIterator di(_userBasePath, QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
 			while (di.hasNext()) {
 				di.next();
@@ -4664,23 +6383,32 @@ void ClearManager::onStart() {
 			}
 		} break;
 		case ClearManagerDownloads:
-			result = QDir(cTempDir()).removeRecursively();
+			result = _removeDirectoryDetached(cTempDir());
 		break;
-		case ClearManagerStorage:
+		case ClearManagerStorage: {
+			// Packed entries are removed all at once with the pack segments.
+			auto clearFile = [](const FileKey &key) {
+				if (!_mediaPack || !_mediaPack->contains(key)) {
+					clearKey(key, FileOption::User);
+				}
+			};
 			for (StorageMap::const_iterator i = images.cbegin(), e = images.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				clearFile(i.value().first);
 			}
 			for (StorageMap::const_iterator i = stickers.cbegin(), e = stickers.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				clearFile(i.value().first);
 			}
 			for (StorageMap::const_iterator i = audios.cbegin(), e = audios.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				clearFile(i.value().first);
 			}
 			for (WebFilesMap::const_iterator i = webFiles.cbegin(), e = webFiles.cend(); i != e; ++i) {
-				clearKey(i.value().first, FileOption::User);
+				clearFile(i.value().first);
+			}
+			if (_mediaPack) {
+				_mediaPack->clear();
 			}
 			result = true;
-		break;
+		} break;
 		}
 		{
 			QMutexLocker lock(&data->mutex);
@@ -4707,6 +6435,20 @@ Manager::Manager() {
 	connect(&_mapWriteTimer, SIGNAL(timeout()), this, SLOT(mapWriteTimeout()));
 	_locationsWriteTimer.setSingleShot(true);
 	connect(&_locationsWriteTimer, SIGNAL(timeout()), this, SLOT(locationsWriteTimeout()));
+	_userSettingsWriteTimer.setSingleShot(true);
+	connect(&_userSettingsWriteTimer, SIGNAL(timeout()), this, SLOT(userSettingsWriteTimeout()));
+	_installedStickersWriteTimer.setSingleShot(true);
+	connect(&_installedStickersWriteTimer, SIGNAL(timeout()), this, SLOT(installedStickersWriteTimeout()));
+	_dialogsSnapshotWriteTimer.setSingleShot(true);
+	connect(&_dialogsSnapshotWriteTimer, SIGNAL(timeout()), this, SLOT(dialogsSnapshotWriteTimeout()));
+	_voiceWaveformsWriteTimer.setSingleShot(true);
+	connect(&_voiceWaveformsWriteTimer, SIGNAL(timeout()), this, SLOT(voiceWaveformsWriteTimeout()));
+	_preparedUserpicsWriteTimer.setSingleShot(true);
+	connect(&_preparedUserpicsWriteTimer, SIGNAL(timeout()), this, SLOT(preparedUserpicsWriteTimeout()));
+	_draftsWriteTimer.setSingleShot(true);
+	connect(&_draftsWriteTimer, SIGNAL(timeout()), this, SLOT(draftsWriteTimeout()));
+	_cacheLimitsCheckTimer.setSingleShot(true);
+	connect(&_cacheLimitsCheckTimer, SIGNAL(timeout()), this, SLOT(cacheLimitsCheckTimeout()));
 }
 
 void Manager::writeMap(bool fast) {
@@ -4733,6 +6475,72 @@ void Manager::writingLocations() {
 	_locationsWriteTimer.stop();
 }
 
+void Manager::writeUserSettings() {
+	if (!_userSettingsWriteTimer.isActive()) {
+		_userSettingsWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingUserSettings() {
+	_userSettingsWriteTimer.stop();
+}
+
+void Manager::writeInstalledStickers() {
+	if (!_installedStickersWriteTimer.isActive()) {
+		_installedStickersWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingInstalledStickers() {
+	_installedStickersWriteTimer.stop();
+}
+
+void Manager::writeDialogsSnapshot() {
+	if (!_dialogsSnapshotWriteTimer.isActive()) {
+		_dialogsSnapshotWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingDialogsSnapshot() {
+	_dialogsSnapshotWriteTimer.stop();
+}
+
+void Manager::writeVoiceWaveforms() {
+	if (!_voiceWaveformsWriteTimer.isActive()) {
+		_voiceWaveformsWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingVoiceWaveforms() {
+	_voiceWaveformsWriteTimer.stop();
+}
+
+void Manager::writePreparedUserpics() {
+	if (!_preparedUserpicsWriteTimer.isActive()) {
+		_preparedUserpicsWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingPreparedUserpics() {
+	_preparedUserpicsWriteTimer.stop();
+}
+
+void Manager::writeDrafts() {
+	if (!_draftsWriteTimer.isActive()) {
+		_draftsWriteTimer.start(WriteMapTimeout);
+	}
+}
+
+void Manager::writingDrafts() {
+	_draftsWriteTimer.stop();
+}
+
+void Manager::checkCacheLimits() {
+	if (!_cacheLimitsCheckTimer.isActive()) {
+		_cacheLimitsCheckTimer.start(kCacheLimitsCheckTimeout);
+	}
+}
+
 void Manager::mapWriteTimeout() {
 	_writeMap(WriteMapWhen::Now);
 }
@@ -4741,6 +6549,34 @@ void Manager::locationsWriteTimeout() {
 	_writeLocations(WriteMapWhen::Now);
 }
 
+void Manager::userSettingsWriteTimeout() {
+	_writeUserSettings();
+}
+
+void Manager::installedStickersWriteTimeout() {
+	_writeInstalledStickers();
+}
+
+void Manager::dialogsSnapshotWriteTimeout() {
+	_writeDialogsSnapshot();
+}
+
+void Manager::voiceWaveformsWriteTimeout() {
+	_writeVoiceWaveforms();
+}
+
+void Manager::preparedUserpicsWriteTimeout() {
+	_writePreparedUserpics();
+}
+
+void Manager::draftsWriteTimeout() {
+	_writeDrafts();
+}
+
+void Manager::cacheLimitsCheckTimeout() {
+	_checkCacheLimits();
+}
+
 void Manager::finish() {
 	if (_mapWriteTimer.isActive()) {
 		mapWriteTimeout();
@@ -4748,6 +6584,25 @@ void Manager::finish() {
 	if (_locationsWriteTimer.isActive()) {
 		locationsWriteTimeout();
 	}
+	if (_userSettingsWriteTimer.isActive()) {
+		userSettingsWriteTimeout();
+	}
+	if (_installedStickersWriteTimer.isActive()) {
+		installedStickersWriteTimeout();
+	}
+	if (_dialogsSnapshotWriteTimer.isActive()) {
+		dialogsSnapshotWriteTimeout();
+	}
+	if (_voiceWaveformsWriteTimer.isActive()) {
+		voiceWaveformsWriteTimeout();
+	}
+	if (_draftsWriteTimer.isActive()) {
+		draftsWriteTimeout();
+	}
+	if (_preparedUserpicsWriteTimer.isActive()) {
+		preparedUserpicsWriteTimeout();
+	}
+	_cacheLimitsCheckTimer.stop();
 }
 
 } // namespace internal
@@ -24,6 +24,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "storage/file_download.h"
 #include "auth_session.h"
 
+class History;
+
 namespace Window {
 namespace Theme {
 struct Cached;
@@ -50,6 +52,11 @@ void reset();
 bool checkPasscode(const QByteArray &passcode);
 void setPasscode(const QByteArray &passcode);
 
+// The passcode keys are derived in a worker thread so that the window
+// doesn't freeze meanwhile, the callbacks are called in the main thread.
+void checkPasscodeAsync(const QByteArray &passcode, base::lambda_once<void(bool correct)> callback);
+void createMapPassKeyAsync(const QByteArray &pass, base::lambda_once<void(MTP::AuthKeyPtr passKey)> callback);
+
 enum ClearManagerTask {
 	ClearManagerAll = 0xFFFF,
 	ClearManagerDownloads = 0x01,
@@ -86,7 +93,8 @@ enum ReadMapState {
 	ReadMapDone = 1,
 	ReadMapPassNeeded = 2,
 };
-ReadMapState readMap(const QByteArray &pass);
+// If passKey is not null it should be prepared by createMapPassKeyAsync().
+ReadMapState readMap(const QByteArray &pass, const MTP::AuthKeyPtr &passKey = nullptr);
 int32 oldMapVersion();
 
 int32 oldSettingsVersion();
@@ -110,6 +118,16 @@ bool hasDraft(const PeerId &peer);
 void writeFileLocation(MediaKey location, const FileLocation &local);
 FileLocation readFileLocation(MediaKey location, bool check = true);
 
+struct PartialDownload {
+	QString filename;
+	int32 size = 0;
+	int32 partSize = 0;
+	QByteArray parts; // bitmap of the parts already written to the file
+};
+void writePartialDownload(MediaKey location, const PartialDownload &download);
+PartialDownload readPartialDownload(MediaKey location);
+void clearPartialDownload(MediaKey location);
+
 void writeImage(const StorageKey &location, const ImagePtr &img);
 void writeImage(const StorageKey &location, const StorageImageSaved &jpeg, bool overwrite = true);
 TaskId startImageLoad(const StorageKey &location, mtpFileLoader *loader);
@@ -157,6 +175,11 @@ void writeSavedGifs();
 void readSavedGifs();
 int32 countSavedGifsHash();
 
+// Recent and faved stickers and saved gifs are not needed for the first
+// frame, so they are read after it or before the stickers are requested.
+void scheduleDeferredStickersRead();
+void readDeferredStickers();
+
 void writeBackground(int32 id, const QImage &img);
 bool readBackground();
 
@@ -176,6 +199,20 @@ void addSavedPeer(PeerData *peer, const QDateTime &position);
 void removeSavedPeer(PeerData *peer);
 void readSavedPeers();
 
+// Top of the chats list, shown until the list is received from the server.
+void writeDialogsSnapshot();
+QVector<History*> readDialogsSnapshot();
+
+// Newest messages of recently opened chats, shown until the server answers.
+void writeHistoryCache(PeerId peer, const MTPmessages_Messages &messages);
+base::optional<MTPmessages_Messages> readHistoryCache(PeerId peer);
+void clearHistoryCache(PeerId peer);
+
+// Chats list userpics prepared at the displayed size, painted at startup
+// until the userpic images are loaded and decoded.
+void writePreparedUserpic(const StorageKey &location, int size, const QPixmap &prepared);
+QPixmap readPreparedUserpic(const StorageKey &location, int size);
+
 void writeReportSpamStatuses();
 
 void makeBotTrusted(UserData *bot);
@@ -196,15 +233,42 @@ public:
 	void writingMap();
 	void writeLocations(bool fast);
 	void writingLocations();
+	void writeUserSettings();
+	void writingUserSettings();
+	void writeInstalledStickers();
+	void writingInstalledStickers();
+	void writeDialogsSnapshot();
+	void writingDialogsSnapshot();
+	void writeVoiceWaveforms();
+	void writingVoiceWaveforms();
+	void writePreparedUserpics();
+	void writingPreparedUserpics();
+	void writeDrafts();
+	void writingDrafts();
+	void checkCacheLimits();
 	void finish();
 
 public slots:
 	void mapWriteTimeout();
 	void locationsWriteTimeout();
+	void userSettingsWriteTimeout();
+	void installedStickersWriteTimeout();
+	void dialogsSnapshotWriteTimeout();
+	void voiceWaveformsWriteTimeout();
+	void preparedUserpicsWriteTimeout();
+	void draftsWriteTimeout();
+	void cacheLimitsCheckTimeout();
 
 private:
 	QTimer _mapWriteTimer;
 	QTimer _locationsWriteTimer;
+	QTimer _userSettingsWriteTimer;
+	QTimer _installedStickersWriteTimer;
+	QTimer _dialogsSnapshotWriteTimer;
+	QTimer _voiceWaveformsWriteTimer;
+	QTimer _preparedUserpicsWriteTimer;
+	QTimer _draftsWriteTimer;
+	QTimer _cacheLimitsCheckTimer;
 
 };
 
@@ -0,0 +1,53 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/requests_window.h"
+
+namespace Storage {
+namespace {
+
+// If a request takes that many times longer than the fastest one the link is considered saturated.
+constexpr auto kSlowdownRatio = 3;
+
+} // namespace
+
+RequestsWindow::RequestsWindow(int initial, int min, int max)
+: _size(initial)
+, _min(min)
+, _max(max) {
+}
+
+void RequestsWindow::requestDone(TimeMs duration) {
+	duration = std::max(duration, TimeMs(1));
+	if (!_minDuration || duration < _minDuration) {
+		_minDuration = duration;
+	}
+	if (duration > _minDuration * kSlowdownRatio) {
+		// Requests wait in the queues already, sending more won't help.
+		_size = std::max(_size - 1, _min);
+		_received = 0;
+	} else if (++_received >= _size) {
+		// The whole window was answered without slowing down, try a larger one.
+		_size = std::min(_size + 1, _max);
+		_received = 0;
+	}
+}
+
+} // namespace Storage
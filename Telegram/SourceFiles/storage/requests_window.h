@@ -0,0 +1,47 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+// Amount of requests sent at the same time, adjusted by their durations.
+// It grows by one step after a whole window is answered as fast as the
+// fastest request observed and shrinks when a request is much slower.
+class RequestsWindow {
+public:
+	RequestsWindow() = default;
+	RequestsWindow(int initial, int min, int max);
+
+	int size() const {
+		return _size;
+	}
+	void requestDone(TimeMs duration);
+
+private:
+	int _size = 0;
+	int _min = 0;
+	int _max = 0;
+	int _received = 0;
+	TimeMs _minDuration = 0;
+
+};
+
+} // namespace Storage
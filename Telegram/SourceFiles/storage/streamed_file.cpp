@@ -0,0 +1,200 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#include "storage/streamed_file.h"
+
+namespace Storage {
+namespace {
+
+constexpr auto kReadTimeout = 30000; // Give up reading if no part arrived for 30 seconds.
+
+} // namespace
+
+StreamedFile::StreamedFile(int size, int partSize)
+: _size(size)
+, _partSize(partSize)
+, _data(size, Qt::Uninitialized)
+, _parts((size + partSize - 1) / partSize, false) {
+	Expects(size > 0);
+	Expects(partSize > 0);
+}
+
+StreamedFile::StreamedFile(int size, int partSize, const QString &path)
+: _size(size)
+, _partSize(partSize)
+, _path(path)
+, _parts((size + partSize - 1) / partSize, false) {
+	Expects(size > 0);
+	Expects(partSize > 0);
+	Expects(!path.isEmpty());
+}
+
+void StreamedFile::feed(int offset, base::const_byte_span bytes) {
+	Expects(offset % _partSize == 0);
+
+	auto callback = base::lambda<void()>();
+	{
+		QMutexLocker lock(&_mutex);
+		auto index = offset / _partSize;
+		if (index >= int(_parts.size()) || _parts[index]) {
+			return;
+		}
+		if (_path.isEmpty()) {
+			auto length = std::min(int(bytes.size()), _size - offset);
+			if (length < std::min(_partSize, _size - offset)) {
+				LOG(("Streamed Error: bad part size %1 at offset %2, file size %3").arg(bytes.size()).arg(offset).arg(_size));
+				return;
+			}
+			memcpy(_data.data() + offset, bytes.data(), length);
+		}
+		_parts[index] = true;
+		++_partsReceived;
+		if (_wantedOffset >= 0 && partReceivedLocked(_wantedOffset)) {
+			_wantedOffset = -1;
+		}
+		callback = _partReceivedCallback;
+	}
+	_received.wakeAll();
+	if (callback) {
+		callback();
+	}
+}
+
+void StreamedFile::fail() {
+	{
+		QMutexLocker lock(&_mutex);
+		_failed = true;
+		_file.close();
+	}
+	_received.wakeAll();
+}
+
+void StreamedFile::setPartReceivedCallback(base::lambda<void()> callback) {
+	QMutexLocker lock(&_mutex);
+	_partReceivedCallback = std::move(callback);
+}
+
+int StreamedFile::takeWantedOffset() {
+	QMutexLocker lock(&_mutex);
+	return std::exchange(_wantedOffset, -1);
+}
+
+bool StreamedFile::partReceived(int offset) const {
+	QMutexLocker lock(&_mutex);
+	return partReceivedLocked(offset);
+}
+
+bool StreamedFile::complete() const {
+	QMutexLocker lock(&_mutex);
+	return (_partsReceived == int(_parts.size()));
+}
+
+int StreamedFile::firstMissingOffset() const {
+	QMutexLocker lock(&_mutex);
+	for (auto i = 0, count = int(_parts.size()); i != count; ++i) {
+		if (!_parts[i]) {
+			return i * _partSize;
+		}
+	}
+	return -1;
+}
+
+bool StreamedFile::ready(int offset, int length) {
+	QMutexLocker lock(&_mutex);
+	if (readyLocked(offset, length)) {
+		return true;
+	}
+	auto till = std::min(offset + length, _size);
+	while (offset < till && partReceivedLocked(offset)) {
+		offset = (offset / _partSize + 1) * _partSize;
+	}
+	_wantedOffset = offset;
+	return false;
+}
+
+int StreamedFile::read(int offset, char *buffer, int length) {
+	if (offset < 0 || length < 0) {
+		return -1;
+	} else if (offset >= _size) {
+		return 0;
+	}
+	length = std::min(length, _size - offset);
+
+	QMutexLocker lock(&_mutex);
+	auto generation = _interruptGeneration;
+	while (!partReceivedLocked(offset)) {
+		if (_failed || generation != _interruptGeneration) {
+			return -1;
+		}
+		_wantedOffset = offset;
+		if (!_received.wait(&_mutex, kReadTimeout)) {
+			LOG(("Streamed Error: timeout waiting for offset %1, file size %2").arg(offset).arg(_size));
+			return -1;
+		}
+	}
+
+	// Read only the received bytes, the caller will ask for the rest.
+	auto till = offset + length;
+	auto available = offset;
+	while (available < till && partReceivedLocked(available)) {
+		available = (available / _partSize + 1) * _partSize;
+	}
+	auto result = std::min(available, till) - offset;
+	if (_path.isEmpty()) {
+		memcpy(buffer, _data.constData() + offset, result);
+		return result;
+	}
+	if (!_file.isOpen()) {
+		_file.setFileName(_path);
+		if (!_file.open(QIODevice::ReadOnly)) {
+			LOG(("Streamed Error: could not open '%1' for reading.").arg(_path));
+			return -1;
+		}
+	}
+	if (!_file.seek(offset)) {
+		return -1;
+	}
+	return int(_file.read(buffer, result));
+}
+
+void StreamedFile::interruptReads() {
+	{
+		QMutexLocker lock(&_mutex);
+		++_interruptGeneration;
+	}
+	_received.wakeAll();
+}
+
+bool StreamedFile::partReceivedLocked(int offset) const {
+	auto index = offset / _partSize;
+	return (offset >= 0) && (index < int(_parts.size())) && _parts[index];
+}
+
+bool StreamedFile::readyLocked(int offset, int length) const {
+	auto till = std::min(offset + length, _size);
+	for (; offset < till; offset = (offset / _partSize + 1) * _partSize) {
+		if (!partReceivedLocked(offset)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace Storage
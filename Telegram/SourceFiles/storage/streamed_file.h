@@ -0,0 +1,86 @@
+/*
+This file is part of Telegram Desktop,
+the official desktop version of Telegram messaging app, see https://telegram.org
+
+Telegram Desktop is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+It is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+In addition, as a special exception, the copyright holders give permission
+to link the code of portions of this program with the OpenSSL library.
+
+Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
+*/
+#pragma once
+
+namespace Storage {
+
+// Bytes of a file that is still being downloaded, so that a media loader
+// can start reading it before the download is finished. The download side
+// feeds parts as they arrive, the reading side may block until the part
+// it needs is received and tells the download side which offset it wants.
+// The bytes are kept in memory or, if a path is passed, read back from the
+// file the download side writes to, so that large videos are not held in
+// memory. All the methods are thread-safe.
+class StreamedFile {
+public:
+	StreamedFile(int size, int partSize);
+	StreamedFile(int size, int partSize, const QString &path);
+
+	int size() const {
+		return _size;
+	}
+
+	// Thread: Main. If the file is read back from the path, the part bytes
+	// must be already written to it and flushed.
+	void feed(int offset, base::const_byte_span bytes);
+	void fail();
+	void setPartReceivedCallback(base::lambda<void()> callback);
+
+	// Thread: Main. Returns -1 if no part is waited for.
+	int takeWantedOffset();
+	bool partReceived(int offset) const;
+	bool complete() const;
+	int firstMissingOffset() const;
+
+	// Thread: Any. Returns true if the range is already received, otherwise
+	// remembers its start as the wanted offset for the download side.
+	bool ready(int offset, int length);
+
+	// Thread: Any. Blocks until the bytes at offset are received.
+	// Returns the count of bytes read, zero at the end of the file, -1 if
+	// the download has failed or the read was interrupted.
+	int read(int offset, char *buffer, int length);
+
+	// Thread: Any. Makes the reads that are waiting right now return -1.
+	void interruptReads();
+
+private:
+	bool partReceivedLocked(int offset) const;
+	bool readyLocked(int offset, int length) const;
+
+	const int _size = 0;
+	const int _partSize = 0;
+
+	mutable QMutex _mutex;
+	QWaitCondition _received;
+	QByteArray _data;
+	QString _path;
+	QFile _file;
+	std::vector<bool> _parts;
+	int _partsReceived = 0;
+	int _wantedOffset = -1;
+	int _interruptGeneration = 0;
+	bool _failed = false;
+	base::lambda<void()> _partReceivedCallback;
+
+};
+
+} // namespace Storage
@@ -38,10 +38,37 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "auth_session.h"
 #include "messenger.h"
 #include "storage/file_download.h"
+#include "calls/calls_instance.h"
 
 namespace {
 
-constexpr auto kUpdateFullPeerTimeout = TimeMs(5000); // Not more than once in 5 seconds.
+constexpr auto kUpdateFullPeerTimeout = TimeMs(60000); // Full info is fresh for a minute unless invalidated.
+
+// Empty userpics with the same letters and color share the prepared pixmaps.
+constexpr auto kPreparedEmptyUserpicsBytesLimit = 8 * 1024 * 1024;
+
+using PreparedEmptyUserpicKey = std::tuple<QRgb, QRgb, QString, int, int>;
+struct PreparedEmptyUserpic {
+	QPixmap pixmap;
+	uint64 lastUsed = 0;
+};
+struct PreparedEmptyUserpics {
+	std::map<PreparedEmptyUserpicKey, PreparedEmptyUserpic> map;
+	uint64 lastUsed = 0;
+	int64 bytes = 0;
+};
+NeverFreedPointer<PreparedEmptyUserpics> PreparedEmptyUserpicsCache;
+
+// Same as [а-яА-ЯёЁ] without running a regular expression for each peer.
+bool HasRussianLetters(const QString &text) {
+	for (auto ch : text) {
+		auto code = ch.unicode();
+		if ((code >= 0x0410 && code <= 0x044F) || code == 0x0401 || code == 0x0451) {
+			return true;
+		}
+	}
+	return false;
+}
 
 int peerColorIndex(const PeerId &peer) {
 	auto myId = Auth().userId();
@@ -90,6 +117,13 @@ public:
 	StorageKey uniqueKey() const;
 
 private:
+	enum class Shape {
+		Circle,
+		Rounded,
+		Square,
+	};
+	QPixmap prepared(Shape shape, int size);
+
 	template <typename PaintBackground>
 	void paint(Painter &p, int x, int y, int size, PaintBackground paintBackground);
 
@@ -118,21 +152,72 @@ void EmptyUserpic::Impl::paint(Painter &p, int x, int y, int size, PaintBackgrou
 }
 
 void EmptyUserpic::Impl::paint(Painter &p, int x, int y, int size) {
-	paint(p, x, y, size, [&p, x, y, size] {
-		p.drawEllipse(x, y, size, size);
-	});
+	p.drawPixmap(x, y, prepared(Shape::Circle, size));
 }
 
 void EmptyUserpic::Impl::paintRounded(Painter &p, int x, int y, int size) {
-	paint(p, x, y, size, [&p, x, y, size] {
-		p.drawRoundedRect(x, y, size, size, st::buttonRadius, st::buttonRadius);
-	});
+	p.drawPixmap(x, y, prepared(Shape::Rounded, size));
 }
 
 void EmptyUserpic::Impl::paintSquare(Painter &p, int x, int y, int size) {
-	paint(p, x, y, size, [&p, x, y, size] {
-		p.fillRect(x, y, size, size, p.brush());
-	});
+	p.drawPixmap(x, y, prepared(Shape::Square, size));
+}
+
+QPixmap EmptyUserpic::Impl::prepared(Shape shape, int size) {
+	// Letters are painted with antialiasing once for each shape and size,
+	// the colors are in the key, so that the palette change is handled.
+	PreparedEmptyUserpicsCache.createIfNull();
+	auto &cache = *PreparedEmptyUserpicsCache;
+	auto key = PreparedEmptyUserpicKey(_color->c.rgba(), st::historyPeerUserpicFg->c.rgba(), _string, int(shape), size);
+	auto i = cache.map.find(key);
+	if (i != cache.map.end()) {
+		i->second.lastUsed = ++cache.lastUsed;
+		return i->second.pixmap;
+	}
+
+	auto result = QImage(QSize(size, size) * cIntRetinaFactor(), QImage::Format_ARGB32_Premultiplied);
+	result.setDevicePixelRatio(cRetinaFactor());
+	result.fill(Qt::transparent);
+	{
+		Painter p(&result);
+		switch (shape) {
+		case Shape::Circle: {
+			paint(p, 0, 0, size, [&p, size] {
+				p.drawEllipse(0, 0, size, size);
+			});
+		} break;
+
+		case Shape::Rounded: {
+			paint(p, 0, 0, size, [&p, size] {
+				p.drawRoundedRect(0, 0, size, size, st::buttonRadius, st::buttonRadius);
+			});
+		} break;
+
+		case Shape::Square: {
+			paint(p, 0, 0, size, [&p, size] {
+				p.fillRect(0, 0, size, size, p.brush());
+			});
+		} break;
+
+		default: Unexpected("Shape in EmptyUserpic::Impl::prepared()");
+		}
+	}
+
+	// The least recently used ones are dropped, they're cheap to paint again.
+	auto bytes = int64(result.byteCount());
+	while (!cache.map.empty() && cache.bytes + bytes > kPreparedEmptyUserpicsBytesLimit) {
+		auto oldest = std::min_element(cache.map.begin(), cache.map.end(), [](auto &a, auto &b) {
+			return (a.second.lastUsed < b.second.lastUsed);
+		});
+		auto &pixmap = oldest->second.pixmap;
+		cache.bytes -= int64(pixmap.width()) * pixmap.height() * 4;
+		cache.map.erase(oldest);
+	}
+	auto &entry = cache.map[key];
+	entry.pixmap = App::pixmapFromImageInPlace(std::move(result));
+	entry.lastUsed = ++cache.lastUsed;
+	cache.bytes += bytes;
+	return entry.pixmap;
 }
 
 StorageKey EmptyUserpic::Impl::uniqueKey() const {
@@ -268,7 +353,6 @@ void PeerClickHandler::onClick(Qt::MouseButton button) const {
 }
 
 PeerData::PeerData(const PeerId &id) : id(id), _colorIndex(peerColorIndex(id)) {
-	nameText.setText(st::msgNameStyle, QString(), _textNameOptions);
 	_userpicEmpty.set(_colorIndex, QString());
 }
 
@@ -289,7 +373,6 @@ void PeerData::updateNameDelayed(const QString &newName, const QString &newNameO
 
 	++nameVersion;
 	name = newName;
-	nameText.setText(st::msgNameStyle, name, _textNameOptions);
 	if (!_userpic) {
 		_userpicEmpty.set(_colorIndex, name);
 	}
@@ -324,6 +407,14 @@ ClickHandlerPtr PeerData::createOpenLink() {
 	return MakeShared<PeerClickHandler>(this);
 }
 
+const Text &PeerData::nameText() const {
+	if (!nameTextBuilt()) {
+		_nameText.setText(st::msgNameStyle, name, _textNameOptions);
+		_nameTextVersion = nameVersion;
+	}
+	return _nameText;
+}
+
 void PeerData::setUserpic(ImagePtr userpic) {
 	_userpic = userpic;
 	if (!_userpic || !_userpic->loaded()) {
@@ -352,6 +443,29 @@ void PeerData::paintUserpic(Painter &p, int x, int y, int size) const {
 	}
 }
 
+void PeerData::paintDialogUserpicLeft(Painter &p, int x, int y, int w, int size) const {
+	if (rtl()) {
+		x = w - x - size;
+	}
+	if (photoLoc.isNull()) {
+		paintUserpic(p, x, y, size);
+		return;
+	}
+	auto location = storageKey(photoLoc);
+	if (auto userpic = currentUserpic()) {
+		auto &pixmap = userpic->pixCircled(size, size);
+		Local::writePreparedUserpic(location, size, pixmap);
+		p.drawPixmap(x, y, pixmap);
+		return;
+	}
+	auto prepared = Local::readPreparedUserpic(location, size);
+	if (!prepared.isNull()) {
+		p.drawPixmap(x, y, prepared);
+	} else {
+		_userpicEmpty.paint(p, x, y, x + size + x, size);
+	}
+}
+
 void PeerData::paintUserpicRounded(Painter &p, int x, int y, int size) const {
 	if (auto userpic = currentUserpic()) {
 		p.drawPixmap(x, y, userpic->pixRounded(size, size, ImageRoundRadius::Small));
@@ -458,7 +572,7 @@ void PeerData::fillNames() {
 	names.clear();
 	chars.clear();
 	auto toIndex = TextUtilities::RemoveAccents(name);
-	if (cRussianLetters().match(toIndex).hasMatch()) {
+	if (HasRussianLetters(toIndex)) {
 		toIndex += ' ' + translitRusEng(toIndex);
 	}
 	if (isUser()) {
@@ -597,10 +711,19 @@ void UserData::setBotInfo(const MTPBotInfo &info) {
 void UserData::setNameOrPhone(const QString &newNameOrPhone) {
 	if (nameOrPhone != newNameOrPhone) {
 		nameOrPhone = newNameOrPhone;
-		phoneText.setText(st::msgNameStyle, nameOrPhone, _textNameOptions);
+		_phoneText = Text();
+		_phoneTextBuilt = false;
 	}
 }
 
+const Text &UserData::phoneText() const {
+	if (!_phoneTextBuilt) {
+		_phoneText.setText(st::msgNameStyle, nameOrPhone, _textNameOptions);
+		_phoneTextBuilt = true;
+	}
+	return _phoneText;
+}
+
 void UserData::madeAction(TimeId when) {
 	if (botInfo || isServiceUser(id) || when <= 0) return;
 
@@ -718,7 +841,7 @@ void ChannelData::setName(const QString &newName, const QString &newUsername) {
 }
 
 void PeerData::updateFull() {
-	if (!_lastFullUpdate || getms(true) > _lastFullUpdate + kUpdateFullPeerTimeout) {
+	if (_fullOutdated || !_lastFullUpdate || getms(true) > _lastFullUpdate + kUpdateFullPeerTimeout) {
 		updateFullForced();
 	}
 }
@@ -734,6 +857,7 @@ void PeerData::updateFullForced() {
 
 void PeerData::fullUpdated() {
 	_lastFullUpdate = getms(true);
+	_fullOutdated = false;
 }
 
 bool ChannelData::setAbout(const QString &newAbout) {
@@ -1144,8 +1268,8 @@ PhotoData::PhotoData(const PhotoId &id, const uint64 &access, int32 date, const
 , full(full) {
 }
 
-void PhotoData::automaticLoad(const HistoryItem *item) {
-	full->automaticLoad(item);
+void PhotoData::automaticLoad(const HistoryItem *item, bool prior) {
+	full->automaticLoad(item, prior);
 }
 
 void PhotoData::automaticLoadSettingsChanged() {
@@ -1527,6 +1651,19 @@ void DocumentOpenClickHandler::doOpen(DocumentData *data, HistoryItem *context,
 		if (filename.isEmpty()) return;
 	}
 
+	if (playVoice || playMusic) {
+		// Start playing while the rest of the file is being downloaded.
+		data->save(filename, ActionOnLoadNone, msgId);
+		if (data->streamedFile()) {
+			auto audio = AudioMsgId(data, msgId);
+			Media::Player::mixer()->play(audio);
+			Media::Player::Updated().notify(audio);
+			if (playVoice && App::main()) {
+				App::main()->mediaMarkRead(data);
+			}
+			return;
+		}
+	}
 	data->save(filename, action, msgId);
 }
 
@@ -1700,12 +1837,15 @@ void DocumentData::forget() {
 	_data.clear();
 }
 
-void DocumentData::automaticLoad(const HistoryItem *item) {
+void DocumentData::automaticLoad(const HistoryItem *item, bool prior) {
 	if (loaded() || status != FileReady) return;
 
+	// No new automatic downloads except stickers during a call.
+	if (!_loader && type != StickerDocument && Calls::Current().performanceMode()) return;
+
 	if (saveToCache() && _loader != CancelledMtpFileLoader) {
 		if (type == StickerDocument) {
-			save(QString(), _actionOnLoad, _actionOnLoadMsgId);
+			save(QString(), _actionOnLoad, _actionOnLoadMsgId, LoadFromCloudOrLocal, false, prior);
 		} else if (isAnimation()) {
 			bool loadFromCloud = false;
 			if (item) {
@@ -1717,7 +1857,7 @@ void DocumentData::automaticLoad(const HistoryItem *item) {
 			} else { // if load at least anywhere
 				loadFromCloud = !(cAutoDownloadGif() & dbiadNoPrivate) || !(cAutoDownloadGif() & dbiadNoGroups);
 			}
-			save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
+			save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true, prior);
 		} else if (voice()) {
 			if (item) {
 				bool loadFromCloud = false;
@@ -1726,7 +1866,7 @@ void DocumentData::automaticLoad(const HistoryItem *item) {
 				} else {
 					loadFromCloud = !(cAutoDownloadAudio() & dbiadNoGroups);
 				}
-				save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
+				save(QString(), _actionOnLoad, _actionOnLoadMsgId, loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true, prior);
 			}
 		}
 	}
@@ -1832,8 +1972,8 @@ bool DocumentData::loaded(FilePathResolveType type) const {
 			auto that = const_cast<DocumentData*>(this);
 			that->_location = FileLocation(_loader->fileName());
 			that->_data = _loader->bytes();
-			if (that->sticker() && !_loader->imagePixmap().isNull()) {
-				that->sticker()->img = ImagePtr(_data, _loader->imageFormat(), _loader->imagePixmap());
+			if (that->sticker() && !_data.isEmpty()) {
+				that->sticker()->img = ImagePtr(_data, QByteArray(), QPixmap());
 			}
 			destroyLoaderDelayed();
 		}
@@ -1875,7 +2015,7 @@ bool DocumentData::uploading() const {
 	return status == FileUploading;
 }
 
-void DocumentData::save(const QString &toFile, ActionOnLoad action, const FullMsgId &actionMsgId, LoadFromCloudSetting fromCloud, bool autoLoading) {
+void DocumentData::save(const QString &toFile, ActionOnLoad action, const FullMsgId &actionMsgId, LoadFromCloudSetting fromCloud, bool autoLoading, bool prior) {
 	if (loaded(FilePathResolveChecked)) {
 		auto &l = location(true);
 		if (!toFile.isEmpty()) {
@@ -1923,7 +2063,7 @@ void DocumentData::save(const QString &toFile, ActionOnLoad action, const FullMs
 		}
 		_loader->connect(_loader, SIGNAL(progress(FileLoader*)), App::main(), SLOT(documentLoadProgress(FileLoader*)));
 		_loader->connect(_loader, SIGNAL(failed(FileLoader*,bool)), App::main(), SLOT(documentLoadFailed(FileLoader*,bool)));
-		_loader->start();
+		_loader->start(false, prior);
 	}
 	notifyLayoutChanged();
 }
@@ -2013,6 +2153,10 @@ QByteArray DocumentData::data() const {
 	return _data;
 }
 
+std::shared_ptr<Storage::StreamedFile> DocumentData::streamedFile() const {
+	return (loading() && !_loader->finished()) ? _loader->stream() : nullptr;
+}
+
 const FileLocation &DocumentData::location(bool check) const {
 	if (check && !_location.check()) {
 		const_cast<DocumentData*>(this)->_location = Local::readFileLocation(mediaKey());
@@ -333,6 +333,11 @@ public:
 	void updateFull();
 	void updateFullForced();
 	void fullUpdated();
+
+	// The next updateFull() will request the full info even if it is fresh.
+	void invalidateFull() {
+		_fullOutdated = true;
+	}
 	bool wasFullUpdated() const {
 		return (_lastFullUpdate != 0);
 	}
@@ -347,7 +352,14 @@ public:
 	}
 
 	QString name;
-	Text nameText;
+
+	// The name layout is built on the first use, most of the known
+	// peers (members of large groups) never have their name painted.
+	const Text &nameText() const;
+	bool nameTextBuilt() const {
+		return (_nameTextVersion == nameVersion);
+	}
+
 	using Names = OrderedSet<QString>;
 	Names names; // for filtering
 	using NameFirstChars = OrderedSet<QChar>;
@@ -369,6 +381,9 @@ public:
 	void paintUserpicLeft(Painter &p, int x, int y, int w, int size) const {
 		paintUserpic(p, rtl() ? (w - x - size) : x, y, size);
 	}
+	// Same as paintUserpicLeft(), but keeps the circled userpic on disk,
+	// so that it is painted right away after the next launch.
+	void paintDialogUserpicLeft(Painter &p, int x, int y, int w, int size) const;
 	void paintUserpicRounded(Painter &p, int x, int y, int size) const;
 	void paintUserpicSquare(Painter &p, int x, int y, int size) const;
 	void loadUserpic(bool loadFirst = false, bool prior = true) {
@@ -417,8 +432,12 @@ private:
 
 	ClickHandlerPtr _openLink;
 
+	mutable Text _nameText;
+	mutable int _nameTextVersion = 0;
+
 	int _colorIndex = 0;
 	TimeMs _lastFullUpdate = 0;
+	bool _fullOutdated = false;
 
 };
 
@@ -519,7 +538,7 @@ public:
 		return _phone;
 	}
 	QString nameOrPhone;
-	Text phoneText;
+	const Text &phoneText() const;
 	TimeId onlineTill = 0;
 	int32 contact = -1; // -1 - not contact, cant add (self, empty, deleted, foreign), 0 - not contact, can add (request), 1 - contact
 
@@ -573,6 +592,8 @@ private:
 	QString _restrictionReason;
 	QString _about;
 	QString _phone;
+	mutable Text _phoneText;
+	mutable bool _phoneTextBuilt = false;
 	BlockStatus _blockStatus = BlockStatus::Unknown;
 	CallsStatus _callsStatus = CallsStatus::Unknown;
 	int _commonChatsCount = 0;
@@ -1073,7 +1094,7 @@ inline ChannelData *PeerData::migrateTo() const {
 	return (isChat() && asChat()->migrateToPtr && asChat()->migrateToPtr->amIn()) ? asChat()->migrateToPtr : nullptr;
 }
 inline const Text &PeerData::dialogName() const {
-	return migrateTo() ? migrateTo()->dialogName() : ((isUser() && !asUser()->phoneText.isEmpty()) ? asUser()->phoneText : nameText);
+	return migrateTo() ? migrateTo()->dialogName() : ((isUser() && !asUser()->nameOrPhone.isEmpty()) ? asUser()->phoneText() : nameText());
 }
 inline const QString &PeerData::shortName() const {
 	return isUser() ? asUser()->firstName : name;
@@ -1103,7 +1124,7 @@ class PhotoData {
 public:
 	PhotoData(const PhotoId &id, const uint64 &access = 0, int32 date = 0, const ImagePtr &thumb = ImagePtr(), const ImagePtr &medium = ImagePtr(), const ImagePtr &full = ImagePtr());
 
-	void automaticLoad(const HistoryItem *item);
+	void automaticLoad(const HistoryItem *item, bool prior = true);
 	void automaticLoadSettingsChanged();
 
 	void download();
@@ -1234,6 +1255,10 @@ namespace Serialize {
 class Document;
 } // namespace Serialize;
 
+namespace Storage {
+class StreamedFile;
+} // namespace Storage
+
 class DocumentData {
 public:
 	static DocumentData *create(DocumentId id);
@@ -1242,7 +1267,7 @@ public:
 
 	void setattributes(const QVector<MTPDocumentAttribute> &attributes);
 
-	void automaticLoad(const HistoryItem *item); // auto load sticker or video
+	void automaticLoad(const HistoryItem *item, bool prior = true); // auto load sticker or video
 	void automaticLoadSettingsChanged();
 
 	enum FilePathResolveType {
@@ -1255,7 +1280,7 @@ public:
 	bool loading() const;
 	QString loadingFilePath() const;
 	bool displayLoading() const;
-	void save(const QString &toFile, ActionOnLoad action = ActionOnLoadNone, const FullMsgId &actionMsgId = FullMsgId(), LoadFromCloudSetting fromCloud = LoadFromCloudOrLocal, bool autoLoading = false);
+	void save(const QString &toFile, ActionOnLoad action = ActionOnLoadNone, const FullMsgId &actionMsgId = FullMsgId(), LoadFromCloudSetting fromCloud = LoadFromCloudOrLocal, bool autoLoading = false, bool prior = true);
 	void cancel();
 	float64 progress() const;
 	int32 loadOffset() const;
@@ -1263,6 +1288,9 @@ public:
 
 	QByteArray data() const;
 	const FileLocation &location(bool check = false) const;
+
+	// Available while the document is being downloaded to be played.
+	std::shared_ptr<Storage::StreamedFile> streamedFile() const;
 	void setLocation(const FileLocation &loc);
 
 	QString filepath(FilePathResolveType type = FilePathResolveCached, bool forceSavingAs = false) const;
@@ -1283,14 +1311,19 @@ public:
 
 		automaticLoad(nullptr);
 		if (s->img->isNull() && loaded()) {
+			// The sticker image is decoded when it is painted, so that
+			// the messages can decode it in the background at their size.
 			if (_data.isEmpty()) {
 				const FileLocation &loc(location(true));
 				if (loc.accessEnable()) {
-					s->img = ImagePtr(loc.name());
+					QFile f(loc.name());
+					if (f.open(QIODevice::ReadOnly)) {
+						s->img = ImagePtr(f.readAll(), QByteArray(), QPixmap());
+					}
 					loc.accessDisable();
 				}
 			} else {
-				s->img = ImagePtr(_data);
+				s->img = ImagePtr(_data, QByteArray(), QPixmap());
 			}
 		}
 	}
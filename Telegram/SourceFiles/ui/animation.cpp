@@ -39,8 +39,11 @@ ReaderPointer::~ReaderPointer() {
 
 namespace {
 
+constexpr auto kReducedFrameDuration = 1000 / 30;
+
 AnimationManager *_manager = nullptr;
 bool AnimationsDisabled = false;
+bool AnimationsReducedFrameRate = false;
 
 } // namespace
 
@@ -118,6 +121,19 @@ void SetDisabled(bool disabled) {
 	AnimationsDisabled = disabled;
 }
 
+bool ReducedFrameRate() {
+	return AnimationsReducedFrameRate;
+}
+
+void SetReducedFrameRate(bool reduced) {
+	if (AnimationsReducedFrameRate != reduced) {
+		AnimationsReducedFrameRate = reduced;
+		if (_manager) {
+			_manager->frameRateChanged();
+		}
+	}
+}
+
 } // anim
 
 void BasicAnimation::start() {
@@ -136,7 +152,8 @@ void BasicAnimation::stop() {
 }
 
 AnimationManager::AnimationManager() : _timer(this), _iterating(false) {
-	_timer.setSingleShot(false);
+	_timer.setSingleShot(true);
+	_timer.setTimerType(Qt::PreciseTimer);
 	connect(&_timer, SIGNAL(timeout()), this, SLOT(timeout()));
 }
 
@@ -148,7 +165,7 @@ void AnimationManager::start(BasicAnimation *obj) {
 		}
 	} else {
 		if (_objects.isEmpty()) {
-			_timer.start(AnimationTimerDelta);
+			startFrames();
 		}
 		_objects.insert(obj);
 	}
@@ -171,6 +188,53 @@ void AnimationManager::stop(BasicAnimation *obj) {
 	}
 }
 
+void AnimationManager::startFrames() {
+	countFrameDuration();
+	_framesStart = getms();
+	_timer.start(_frameDuration);
+}
+
+void AnimationManager::countFrameDuration() {
+	// All animations are stepped together once a display frame, there is
+	// no sense to repaint faster than the screen refreshes.
+	_frameDuration = AnimationTimerDelta;
+	if (auto screen = QGuiApplication::primaryScreen()) {
+		auto rate = screen->refreshRate();
+		if (rate > 1.) {
+			_frameDuration = qMax(int(AnimationTimerDelta), int(1000. / rate));
+		}
+	}
+	if (anim::ReducedFrameRate()) {
+		_frameDuration = qMax(_frameDuration, kReducedFrameDuration);
+	}
+}
+
+void AnimationManager::frameRateChanged() {
+	if (!anim::ReducedFrameRate()) {
+		logFramesStats();
+	}
+	countFrameDuration();
+	if (_timer.isActive()) {
+		_framesStart = getms();
+		_timer.start(_frameDuration);
+	}
+}
+
+void AnimationManager::logFramesStats() {
+	if (_framesCount > 0) {
+		DEBUG_LOG(("Animations: %1 frames with reduced rate, %2 ms average step time.").arg(_framesCount).arg(_framesTime / float64(_framesCount)));
+	}
+	_framesCount = 0;
+	_framesTime = 0;
+}
+
+void AnimationManager::scheduleNextFrame() {
+	// Keep the ticks on the frame grid instead of accumulating the delays.
+	auto now = getms();
+	auto next = _framesStart + ((now - _framesStart) / _frameDuration + 1) * _frameDuration;
+	_timer.start(int(next - now));
+}
+
 void AnimationManager::timeout() {
 	_iterating = true;
 	auto ms = getms();
@@ -180,6 +244,10 @@ void AnimationManager::timeout() {
 		}
 	}
 	_iterating = false;
+	if (anim::ReducedFrameRate()) {
+		++_framesCount;
+		_framesTime += getms() - ms;
+	}
 
 	if (!_starting.isEmpty()) {
 		for_const (auto object, _starting) {
@@ -195,6 +263,8 @@ void AnimationManager::timeout() {
 	}
 	if (_objects.empty()) {
 		_timer.stop();
+	} else {
+		scheduleNextFrame();
 	}
 }
 
@@ -420,6 +420,11 @@ QPainterPath path(QPointF (&from)[N]) {
 bool Disabled();
 void SetDisabled(bool disabled);
 
+// Steps all animations at most 30 times a second, used during calls
+// to leave more CPU time for the audio processing.
+bool ReducedFrameRate();
+void SetReducedFrameRate(bool reduced);
+
 };
 
 class BasicAnimation;
@@ -702,15 +707,28 @@ public:
 	void start(BasicAnimation *obj);
 	void stop(BasicAnimation *obj);
 
+	void frameRateChanged();
+
 public slots:
 	void timeout();
 
 	void clipCallback(Media::Clip::Reader *reader, qint32 threadIndex, qint32 notification);
 
 private:
+	void startFrames();
+	void countFrameDuration();
+	void scheduleNextFrame();
+	void logFramesStats();
+
 	using AnimatingObjects = OrderedSet<BasicAnimation*>;
 	AnimatingObjects _objects, _starting, _stopping;
 	QTimer _timer;
+	TimeMs _framesStart = 0;
+	int _frameDuration = AnimationTimerDelta;
 	bool _iterating;
 
+	// Time spent in animation steps while the frame rate is reduced.
+	int _framesCount = 0;
+	TimeMs _framesTime = 0;
+
 };
@@ -20,7 +20,67 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "ui/effects/ripple_animation.h"
 
+#include "base/flat_map.h"
+
 namespace Ui {
+namespace {
+
+constexpr auto kMaxCachedMasks = std::size_t(64);
+
+enum class MaskShape {
+	Rect,
+	RoundRect,
+	Ellipse,
+};
+
+// shape, width, height, radius, retina factor
+using MaskKey = std::tuple<MaskShape, int, int, int, int>;
+
+// Rows of one list have the same masks, so they are shared by all the
+// ripples and converted to a pixmap only once.
+struct MaskCache {
+	base::flat_map<MaskKey, QImage> images;
+	base::flat_map<qint64, QPixmap> pixmaps; // by QImage::cacheKey()
+};
+
+MaskCache &Masks() {
+	static MaskCache result;
+	return result;
+}
+
+QImage CachedMask(MaskKey key, base::lambda<QImage()> create) {
+	auto &masks = Masks();
+	auto i = masks.images.find(key);
+	if (i != masks.images.end()) {
+		return i->second;
+	}
+	if (masks.images.size() >= kMaxCachedMasks) {
+		masks.images.clear();
+		masks.pixmaps.clear();
+	}
+	auto result = create();
+	masks.images.emplace(key, result);
+	return result;
+}
+
+QPixmap MaskPixmap(QImage &&mask) {
+	auto &masks = Masks();
+	auto cacheKey = mask.cacheKey();
+	auto i = masks.pixmaps.find(cacheKey);
+	if (i != masks.pixmaps.end()) {
+		return i->second;
+	}
+	for (auto &image : masks.images) {
+		if (image.second.cacheKey() == cacheKey) {
+			auto result = App::pixmapFromImageInPlace(std::move(mask));
+			masks.pixmaps.emplace(cacheKey, result);
+			return result;
+		}
+	}
+	return App::pixmapFromImageInPlace(std::move(mask));
+}
+
+} // namespace
 
 class RippleAnimation::Ripple {
 public:
@@ -147,7 +207,7 @@ void RippleAnimation::Ripple::finish() {
 
 RippleAnimation::RippleAnimation(const style::RippleAnimation &st, QImage mask, const UpdateCallback &callback)
 : _st(st)
-, _mask(App::pixmapFromImageInPlace(std::move(mask)))
+, _mask(MaskPixmap(std::move(mask)))
 , _update(callback) {
 }
 
@@ -210,18 +270,27 @@ QImage RippleAnimation::maskByDrawer(QSize size, bool filled, base::lambda<void(
 }
 
 QImage RippleAnimation::rectMask(QSize size) {
-	return maskByDrawer(size, true, base::lambda<void(QPainter&)>());
+	auto key = MaskKey(MaskShape::Rect, size.width(), size.height(), 0, cIntRetinaFactor());
+	return CachedMask(key, [size] {
+		return maskByDrawer(size, true, base::lambda<void(QPainter&)>());
+	});
 }
 
 QImage RippleAnimation::roundRectMask(QSize size, int radius) {
-	return maskByDrawer(size, false, [size, radius](QPainter &p) {
-		p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+	auto key = MaskKey(MaskShape::RoundRect, size.width(), size.height(), radius, cIntRetinaFactor());
+	return CachedMask(key, [size, radius] {
+		return maskByDrawer(size, false, [size, radius](QPainter &p) {
+			p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+		});
 	});
 }
 
 QImage RippleAnimation::ellipseMask(QSize size) {
-	return maskByDrawer(size, false, [size](QPainter &p) {
-		p.drawEllipse(0, 0, size.width(), size.height());
+	auto key = MaskKey(MaskShape::Ellipse, size.width(), size.height(), 0, cIntRetinaFactor());
+	return CachedMask(key, [size] {
+		return maskByDrawer(size, false, [size](QPainter &p) {
+			p.drawEllipse(0, 0, size.width(), size.height());
+		});
 	});
 }
 
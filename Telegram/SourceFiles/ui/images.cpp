@@ -24,6 +24,8 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #include "storage/localstorage.h"
 #include "platform/platform_specific.h"
 #include "auth_session.h"
+#include "base/task_queue.h"
+#include "calls/calls_instance.h"
 
 namespace Images {
 namespace {
@@ -32,7 +34,7 @@ FORCE_INLINE uint64 blurGetColors(const uchar *p) {
 	return (uint64)p[0] + ((uint64)p[1] << 16) + ((uint64)p[2] << 32) + ((uint64)p[3] << 48);
 }
 
-const QPixmap &circleMask(int width, int height) {
+const QImage &circleMask(int width, int height) {
 	Assert(Global::started());
 
 	uint64 key = uint64(uint32(width)) << 32 | uint64(uint32(height));
@@ -52,11 +54,41 @@ const QPixmap &circleMask(int width, int height) {
 			p.drawEllipse(0, 0, width, height);
 		}
 		mask.setDevicePixelRatio(cRetinaFactor());
-		i = masks.insert(key, App::pixmapFromImageInPlace(std::move(mask)));
+		i = masks.insert(key, std::move(mask));
 	}
 	return i.value();
 }
 
+// Multiplies the image pixels by the first byte of the mask pixels.
+// Masks are mostly fully opaque or fully transparent, so those are cheap.
+void applyAlphaMask(uint32 *imageInts, int imageIntsPerLine, const QImage &mask) {
+	auto maskWidth = mask.width();
+	auto maskHeight = mask.height();
+	auto maskBytesPerPixel = (mask.depth() >> 3);
+	auto maskBytesPerLine = mask.bytesPerLine();
+	auto maskBytesAdded = maskBytesPerLine - maskWidth * maskBytesPerPixel;
+	auto maskBytes = mask.constBits();
+	Assert(maskBytesAdded >= 0);
+	Assert(mask.depth() == (maskBytesPerPixel << 3));
+	auto imageIntsAdded = imageIntsPerLine - maskWidth;
+	Assert(imageIntsAdded >= 0);
+	for (auto y = 0; y != maskHeight; ++y) {
+		for (auto x = 0; x != maskWidth; ++x) {
+			auto alpha = *maskBytes;
+			if (!alpha) {
+				*imageInts = 0;
+			} else if (alpha != 0xFF) {
+				auto opacity = static_cast<anim::ShiftedMultiplier>(alpha) + 1;
+				*imageInts = anim::unshifted(anim::shifted(*imageInts) * opacity);
+			}
+			maskBytes += maskBytesPerPixel;
+			++imageInts;
+		}
+		maskBytes += maskBytesAdded;
+		imageInts += imageIntsAdded;
+	}
+}
+
 } // namespace
 
 QImage prepareBlur(QImage img) {
@@ -136,42 +168,42 @@ x++;
 				yw += stride;
 			}
 
+			// Vertical pass goes row by row with per column sums,
+			// so that both rgb[] and pix[] are read sequentially.
 			const int he = h - r1;
+			uint64 *rgballsums = new uint64[w];
+			uint64 *rgbsums = new uint64[w];
 			for (x = 0; x < w; x++) {
-				uint64 rgballsum = -radius * rgb[x];
-				uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
-				for (i = 1; i <= radius; i++) {
-					rgbsum += rgb[i * w + x] * (r1 - i);
-					rgballsum += rgb[i * w + x];
+				rgballsums[x] = -radius * rgb[x];
+				rgbsums[x] = rgb[x] * ((r1 * (r1 + 1)) >> 1);
+			}
+			for (i = 1; i <= radius; i++) {
+				const uint64 *row = rgb + i * w;
+				for (x = 0; x < w; x++) {
+					rgbsums[x] += row[x] * (r1 - i);
+					rgballsums[x] += row[x];
 				}
+			}
 
-				y = 0;
-				int yi = x * 4;
-
-#define update(start, middle, end) \
-uint64 res = rgbsum >> 4; \
-pix[yi] = res & 0xFF; \
-pix[yi + 1] = (res >> 16) & 0xFF; \
-pix[yi + 2] = (res >> 32) & 0xFF; \
-pix[yi + 3] = (res >> 48) & 0xFF; \
-rgballsum += rgb[x + (start) * w] - 2 * rgb[x + (middle) * w] + rgb[x + (end) * w]; \
-rgbsum += rgballsum; \
-y++; \
-yi += stride;
-
-				while (y < r1) {
-					update(0, y, y + r1);
-				}
-				while (y < he) {
-					update(y - r1, y, y + r1);
-				}
-				while (y < h) {
-					update(y - r1, y, h - 1);
+			for (y = 0; y < h; y++) {
+				const uint64 *start = rgb + ((y < r1) ? 0 : (y - r1)) * w;
+				const uint64 *middle = rgb + y * w;
+				const uint64 *end = rgb + ((y < he) ? (y + r1) : (h - 1)) * w;
+				uchar *line = pix + y * stride;
+				for (x = 0; x < w; x++) {
+					uint64 res = rgbsums[x] >> 4;
+					line[0] = res & 0xFF;
+					line[1] = (res >> 16) & 0xFF;
+					line[2] = (res >> 32) & 0xFF;
+					line[3] = (res >> 48) & 0xFF;
+					rgballsums[x] += start[x] - 2 * middle[x] + end[x];
+					rgbsums[x] += rgballsums[x];
+					line += 4;
 				}
-
-#undef update
 			}
 
+			delete[] rgbsums;
+			delete[] rgballsums;
 			delete[] rgb;
 		}
 	}
@@ -185,10 +217,9 @@ void prepareCircle(QImage &img) {
 	img = img.convertToFormat(QImage::Format_ARGB32_Premultiplied);
 	Assert(!img.isNull());
 
-	QPixmap mask = circleMask(img.width(), img.height());
-	Painter p(&img);
-	p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-	p.drawPixmap(0, 0, mask);
+	auto imageIntsPerLine = (img.bytesPerLine() >> 2);
+	auto ints = reinterpret_cast<uint32*>(img.bits());
+	applyAlphaMask(ints, imageIntsPerLine, circleMask(img.width(), img.height()));
 }
 
 void prepareRound(QImage &image, ImageRoundRadius radius, ImageRoundCorners corners) {
@@ -224,34 +255,12 @@ void prepareRound(QImage &image, QImage *cornerMasks, ImageRoundCorners corners)
 	auto ints = reinterpret_cast<uint32*>(image.bits());
 	auto intsTopLeft = ints;
 	auto intsTopRight = ints + imageWidth - cornerWidth;
-	auto intsBottomLeft = ints + (imageHeight - cornerHeight) * imageWidth;
-	auto intsBottomRight = ints + (imageHeight - cornerHeight + 1) * imageWidth - cornerWidth;
-	auto maskCorner = [imageWidth, imageHeight, imageIntsPerPixel, imageIntsPerLine](uint32 *imageInts, const QImage &mask) {
-		auto maskWidth = mask.width();
-		auto maskHeight = mask.height();
-		auto maskBytesPerPixel = (mask.depth() >> 3);
-		auto maskBytesPerLine = mask.bytesPerLine();
-		auto maskBytesAdded = maskBytesPerLine - maskWidth * maskBytesPerPixel;
-		auto maskBytes = mask.constBits();
-		Assert(maskBytesAdded >= 0);
-		Assert(mask.depth() == (maskBytesPerPixel << 3));
-		auto imageIntsAdded = imageIntsPerLine - maskWidth * imageIntsPerPixel;
-		Assert(imageIntsAdded >= 0);
-		for (auto y = 0; y != maskHeight; ++y) {
-			for (auto x = 0; x != maskWidth; ++x) {
-				auto opacity = static_cast<anim::ShiftedMultiplier>(*maskBytes) + 1;
-				*imageInts = anim::unshifted(anim::shifted(*imageInts) * opacity);
-				maskBytes += maskBytesPerPixel;
-				imageInts += imageIntsPerPixel;
-			}
-			maskBytes += maskBytesAdded;
-			imageInts += imageIntsAdded;
-		}
-	};
-	if (corners & ImageRoundCorner::TopLeft) maskCorner(intsTopLeft, cornerMasks[0]);
-	if (corners & ImageRoundCorner::TopRight) maskCorner(intsTopRight, cornerMasks[1]);
-	if (corners & ImageRoundCorner::BottomLeft) maskCorner(intsBottomLeft, cornerMasks[2]);
-	if (corners & ImageRoundCorner::BottomRight) maskCorner(intsBottomRight, cornerMasks[3]);
+	auto intsBottomLeft = ints + (imageHeight - cornerHeight) * imageIntsPerLine;
+	auto intsBottomRight = intsBottomLeft + imageWidth - cornerWidth;
+	if (corners & ImageRoundCorner::TopLeft) applyAlphaMask(intsTopLeft, imageIntsPerLine, cornerMasks[0]);
+	if (corners & ImageRoundCorner::TopRight) applyAlphaMask(intsTopRight, imageIntsPerLine, cornerMasks[1]);
+	if (corners & ImageRoundCorner::BottomLeft) applyAlphaMask(intsBottomLeft, imageIntsPerLine, cornerMasks[2]);
+	if (corners & ImageRoundCorner::BottomRight) applyAlphaMask(intsBottomRight, imageIntsPerLine, cornerMasks[3]);
 }
 
 QImage prepareColored(style::color add, QImage image) {
@@ -382,6 +391,45 @@ WebFileImages webFileImages;
 
 int64 globalAcquiredSize = 0;
 
+// Images holding decoded data, from the most to the least recently used.
+const Image *cacheMostRecent = nullptr;
+const Image *cacheLeastRecent = nullptr;
+ImageCacheStats cacheStats;
+
+// A forgotten jpeg image is decoded right at the requested size if it is
+// at least that many times smaller, libjpeg scales it while decoding then.
+constexpr auto kScaledDecodeFactor = 2;
+
+QImage ReadScaledJpeg(const QByteArray &data, const QByteArray &format, int w, int h, bool smooth) {
+#ifndef OS_MAC_OLD
+	const auto lower = format.toLower();
+	if (lower != "jpg" && lower != "jpeg") {
+		return QImage();
+	}
+	auto bytes = data;
+	QBuffer buffer(&bytes);
+	QImageReader reader(&buffer, format);
+	if (reader.transformation() != QImageIOHandler::TransformationNone) {
+		return QImage();
+	}
+	const auto full = reader.size();
+	if (full.isEmpty()) {
+		return QImage();
+	}
+	if (h <= 0) {
+		h = qMax(qRound(full.height() * w / float64(full.width())), 1);
+	}
+	if (w * kScaledDecodeFactor > full.width() || h * kScaledDecodeFactor > full.height()) {
+		return QImage();
+	}
+	reader.setQuality(smooth ? 100 : 0);
+	reader.setScaledSize(QSize(w, h));
+	return reader.read();
+#else // OS_MAC_OLD
+	return QImage();
+#endif // OS_MAC_OLD
+}
+
 uint64 PixKey(int width, int height, Images::Options options) {
 	return static_cast<uint64>(width) | (static_cast<uint64>(height) << 24) | (static_cast<uint64>(options) << 48);
 }
@@ -390,6 +438,23 @@ uint64 SinglePixKey(Images::Options options) {
 	return PixKey(0, 0, options);
 }
 
+Images::Options RoundOptions(ImageRoundRadius radius, ImageRoundCorners corners) {
+	auto cornerOptions = [](ImageRoundCorners corners) {
+		return (corners & ImageRoundCorner::TopLeft ? Images::Option::RoundedTopLeft : Images::Option::None)
+			| (corners & ImageRoundCorner::TopRight ? Images::Option::RoundedTopRight : Images::Option::None)
+			| (corners & ImageRoundCorner::BottomLeft ? Images::Option::RoundedBottomLeft : Images::Option::None)
+			| (corners & ImageRoundCorner::BottomRight ? Images::Option::RoundedBottomRight : Images::Option::None);
+	};
+	if (radius == ImageRoundRadius::Large) {
+		return Images::Option::RoundedLarge | cornerOptions(corners);
+	} else if (radius == ImageRoundRadius::Small) {
+		return Images::Option::RoundedSmall | cornerOptions(corners);
+	} else if (radius == ImageRoundRadius::Ellipse) {
+		return Images::Option::Circled | cornerOptions(corners);
+	}
+	return Images::Options(Images::Option::None);
+}
+
 } // namespace
 
 StorageImageLocation StorageImageLocation::Null;
@@ -433,7 +498,10 @@ Image::Image(const QByteArray &filecontent, QByteArray fmt, const QPixmap &pixma
 	_data = pixmap;
 	_format = fmt;
 	_saved = filecontent;
-	if (!_data.isNull()) {
+	if (_data.isNull()) {
+		// Start as a forgotten image, restore() decodes it when required.
+		_forgot = !_saved.isEmpty();
+	} else {
 		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
 	}
 }
@@ -458,6 +526,7 @@ const QPixmap &Image::pix(int32 w, int32 h) const {
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -470,20 +539,7 @@ const QPixmap &Image::pixRounded(int32 w, int32 h, ImageRoundRadius radius, Imag
 		w *= cIntRetinaFactor();
 		h *= cIntRetinaFactor();
 	}
-	auto options = Images::Option::Smooth | Images::Option::None;
-	auto cornerOptions = [](ImageRoundCorners corners) {
-		return (corners & ImageRoundCorner::TopLeft ? Images::Option::RoundedTopLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::TopRight ? Images::Option::RoundedTopRight : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomLeft ? Images::Option::RoundedBottomLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomRight ? Images::Option::RoundedBottomRight : Images::Option::None);
-	};
-	if (radius == ImageRoundRadius::Large) {
-		options |= Images::Option::RoundedLarge | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Small) {
-		options |= Images::Option::RoundedSmall | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Ellipse) {
-		options |= Images::Option::Circled | cornerOptions(corners);
-	}
+	auto options = Images::Option::Smooth | RoundOptions(radius, corners);
 	auto k = PixKey(w, h, options);
 	auto i = _sizesCache.constFind(k);
 	if (i == _sizesCache.cend()) {
@@ -494,6 +550,7 @@ const QPixmap &Image::pixRounded(int32 w, int32 h, ImageRoundRadius radius, Imag
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -517,6 +574,7 @@ const QPixmap &Image::pixCircled(int32 w, int32 h) const {
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -540,6 +598,7 @@ const QPixmap &Image::pixBlurredCircled(int32 w, int32 h) const {
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -563,6 +622,7 @@ const QPixmap &Image::pixBlurred(int32 w, int32 h) const {
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -586,6 +646,7 @@ const QPixmap &Image::pixColored(style::color add, int32 w, int32 h) const {
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -609,6 +670,7 @@ const QPixmap &Image::pixBlurredColored(style::color add, int32 w, int32 h) cons
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -622,20 +684,7 @@ const QPixmap &Image::pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, Im
 		h *= cIntRetinaFactor();
 	}
 
-	auto options = Images::Option::Smooth | Images::Option::None;
-	auto cornerOptions = [](ImageRoundCorners corners) {
-		return (corners & ImageRoundCorner::TopLeft ? Images::Option::RoundedTopLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::TopRight ? Images::Option::RoundedTopRight : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomLeft ? Images::Option::RoundedBottomLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomRight ? Images::Option::RoundedBottomRight : Images::Option::None);
-	};
-	if (radius == ImageRoundRadius::Large) {
-		options |= Images::Option::RoundedLarge | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Small) {
-		options |= Images::Option::RoundedSmall | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Ellipse) {
-		options |= Images::Option::Circled | cornerOptions(corners);
-	}
+	auto options = Images::Option::Smooth | RoundOptions(radius, corners);
 	if (colored) {
 		options |= Images::Option::Colored;
 	}
@@ -653,6 +702,7 @@ const QPixmap &Image::pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, Im
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
@@ -666,20 +716,7 @@ const QPixmap &Image::pixBlurredSingle(int w, int h, int32 outerw, int32 outerh,
 		h *= cIntRetinaFactor();
 	}
 
-	auto options = Images::Option::Smooth | Images::Option::Blurred;
-	auto cornerOptions = [](ImageRoundCorners corners) {
-		return (corners & ImageRoundCorner::TopLeft ? Images::Option::RoundedTopLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::TopRight ? Images::Option::RoundedTopRight : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomLeft ? Images::Option::RoundedBottomLeft : Images::Option::None)
-			| (corners & ImageRoundCorner::BottomRight ? Images::Option::RoundedBottomRight : Images::Option::None);
-	};
-	if (radius == ImageRoundRadius::Large) {
-		options |= Images::Option::RoundedLarge | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Small) {
-		options |= Images::Option::RoundedSmall | cornerOptions(corners);
-	} else if (radius == ImageRoundRadius::Ellipse) {
-		options |= Images::Option::Circled | cornerOptions(corners);
-	}
+	auto options = Images::Option::Smooth | Images::Option::Blurred | RoundOptions(radius, corners);
 
 	auto k = SinglePixKey(options);
 	auto i = _sizesCache.constFind(k);
@@ -694,11 +731,147 @@ const QPixmap &Image::pixBlurredSingle(int w, int h, int32 outerw, int32 outerh,
 			globalAcquiredSize += int64(p.width()) * p.height() * 4;
 		}
 	}
+	touchCache();
 	return i.value();
 }
 
+struct Image::AsyncPixRequests {
+	struct Request {
+		uint64 id = 0;
+		int outerw = 0;
+		int outerh = 0;
+		std::vector<FullMsgId> items;
+	};
+
+	AsyncPixRequests(not_null<const Image*> image) : image(image) {
+	}
+
+	not_null<const Image*> image;
+	QMap<uint64, Request> requests;
+	uint64 requestId = 0;
+
+	// Bytes that could not be decoded, not retried until they are changed.
+	QByteArray failed;
+
+};
+
+QPixmap Image::pixSingleAsync(not_null<const HistoryItem*> item, int32 w, int32 h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners) const {
+	checkload();
+
+	// Circle masks are cached on the main thread, so circles are prepared in place.
+	// Images without data are painted with a blank, which is cheap as well.
+	if (radius == ImageRoundRadius::Ellipse || isNull() || !loaded() || (_data.isNull() && (!_forgot || _saved.isEmpty()))) {
+		return pixSingle(w, h, outerw, outerh, radius, corners);
+	}
+
+	auto options = Images::Option::Smooth | RoundOptions(radius, corners);
+	auto k = SinglePixKey(options);
+	auto i = _sizesCache.constFind(k);
+	if (i != _sizesCache.cend() && i->width() == (outerw * cIntRetinaFactor()) && i->height() == (outerh * cIntRetinaFactor())) {
+		touchCache();
+		return i.value();
+	}
+
+	if (!_asyncPixRequests) {
+		_asyncPixRequests = std::make_shared<AsyncPixRequests>(this);
+	} else if (_data.isNull() && !_asyncPixRequests->failed.isNull()) {
+		if (_asyncPixRequests->failed.constData() == _saved.constData()) {
+			return QPixmap();
+		}
+		_asyncPixRequests->failed = QByteArray();
+	}
+	auto &request = _asyncPixRequests->requests[k];
+	if (request.id && request.outerw == outerw && request.outerh == outerh) {
+		auto id = item->fullId();
+		if (std::find(request.items.begin(), request.items.end(), id) == request.items.end()) {
+			request.items.push_back(id);
+		}
+		return QPixmap();
+	}
+
+	// A pending request for another outer size is superseded, its result is dropped.
+	request.id = ++_asyncPixRequests->requestId;
+	request.outerw = outerw;
+	request.outerh = outerh;
+	request.items = { item->fullId() };
+
+	// Don't ask width() of a forgotten image unless required, it restores the image.
+	if (w <= 0 || (!_forgot && (!width() || !height()))) {
+		w = width() * cIntRetinaFactor();
+	} else if (cRetina()) {
+		w *= cIntRetinaFactor();
+		h *= cIntRetinaFactor();
+	}
+
+	// QPixmap can't be used outside of the main thread, pass QImage and bytes only.
+	auto data = _data.isNull() ? QImage() : _data.toImage();
+	auto saved = _data.isNull() ? _saved : QByteArray();
+	auto weak = std::weak_ptr<AsyncPixRequests>(_asyncPixRequests);
+	base::TaskQueue::Normal().Put([weak, key = k, id = request.id, data = std::move(data), saved = std::move(saved), format = _format, w, h, options, outerw, outerh]() mutable {
+		auto failed = QByteArray();
+		if (data.isNull()) {
+			QBuffer buffer(&saved);
+			QImageReader reader(&buffer, format);
+#ifndef OS_MAC_OLD
+			reader.setAutoTransform(true);
+#endif // OS_MAC_OLD
+			data = reader.read();
+			if (data.isNull()) {
+				failed = saved;
+			}
+		}
+		auto result = data.isNull() ? QImage() : Images::prepare(std::move(data), w, h, options, outerw, outerh);
+		base::TaskQueue::Main().Put([weak, key, id, result = std::move(result), failed = std::move(failed)]() mutable {
+			auto strong = weak.lock();
+			if (!strong) {
+				return;
+			}
+			auto i = strong->requests.find(key);
+			if (i == strong->requests.end() || i->id != id) {
+				return;
+			}
+			auto items = std::move(i->items);
+			strong->requests.erase(i);
+			if (!failed.isNull()) {
+				strong->failed = std::move(failed);
+				return;
+			}
+
+			strong->image->asyncPixReady(key, std::move(result));
+			for (auto &itemId : items) {
+				if (auto item = App::histItemById(itemId)) {
+					Ui::repaintHistoryItem(item);
+				}
+			}
+		});
+	});
+	return QPixmap();
+}
+
+void Image::asyncPixReady(uint64 key, QImage &&image) const {
+	if (image.isNull()) {
+		return;
+	}
+	auto i = _sizesCache.constFind(key);
+	if (i != _sizesCache.cend() && !i->isNull()) {
+		globalAcquiredSize -= int64(i->width()) * i->height() * 4;
+	}
+	auto p = App::pixmapFromImageInPlace(std::move(image));
+	if (cRetina()) p.setDevicePixelRatio(cRetinaFactor());
+	_sizesCache.insert(key, p);
+	globalAcquiredSize += int64(p.width()) * p.height() * 4;
+	touchCache();
+}
+
 QPixmap Image::pixNoCache(int w, int h, Images::Options options, int outerw, int outerh, const style::color *colored) const {
 	if (!loading()) const_cast<Image*>(this)->load();
+	if (_forgot && w > 0 && !(options & Images::Option::Blurred)) {
+		// Don't restore the full image only to scale it down right away.
+		auto scaled = ReadScaledJpeg(_saved, _format, w, h, (options & Images::Option::Smooth));
+		if (!scaled.isNull()) {
+			return Images::pixmap(std::move(scaled), w, h, options, outerw, outerh, colored);
+		}
+	}
 	restore();
 
 	if (_data.isNull()) {
@@ -800,6 +973,48 @@ void Image::forget() const {
 	globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
 	_data = QPixmap();
 	_forgot = true;
+	removeFromCache();
+}
+
+void Image::touchCache() const {
+	if (isNull()) {
+		return;
+	}
+	if (_cacheUsed) {
+		if (cacheMostRecent == this) {
+			return;
+		}
+		removeFromCache();
+	}
+	_cacheUsed = true;
+	_cacheNewer = nullptr;
+	_cacheOlder = cacheMostRecent;
+	if (cacheMostRecent) {
+		cacheMostRecent->_cacheNewer = this;
+	} else {
+		cacheLeastRecent = this;
+	}
+	cacheMostRecent = this;
+	++cacheStats.images;
+}
+
+void Image::removeFromCache() const {
+	if (!_cacheUsed) {
+		return;
+	}
+	if (_cacheNewer) {
+		_cacheNewer->_cacheOlder = _cacheOlder;
+	} else {
+		cacheMostRecent = _cacheOlder;
+	}
+	if (_cacheOlder) {
+		_cacheOlder->_cacheNewer = _cacheNewer;
+	} else {
+		cacheLeastRecent = _cacheNewer;
+	}
+	_cacheNewer = _cacheOlder = nullptr;
+	_cacheUsed = false;
+	--cacheStats.images;
 }
 
 void Image::restore() const {
@@ -814,11 +1029,15 @@ void Image::restore() const {
 
 	if (!_data.isNull()) {
 		globalAcquiredSize += int64(_data.width()) * _data.height() * 4;
+		touchCache();
 	}
 	_forgot = false;
 }
 
 void Image::invalidateSizeCache() const {
+	if (_asyncPixRequests) {
+		_asyncPixRequests->requests.clear();
+	}
 	for (auto &pix : _sizesCache) {
 		if (!pix.isNull()) {
 			globalAcquiredSize -= int64(pix.width()) * pix.height() * 4;
@@ -828,6 +1047,7 @@ void Image::invalidateSizeCache() const {
 }
 
 Image::~Image() {
+	removeFromCache();
 	invalidateSizeCache();
 	if (!_data.isNull()) {
 		globalAcquiredSize -= int64(_data.width()) * _data.height() * 4;
@@ -857,6 +1077,30 @@ int64 imageCacheSize() {
 	return globalAcquiredSize;
 }
 
+ImageCacheStats imageCacheStats() {
+	auto result = cacheStats;
+	result.bytes = globalAcquiredSize;
+	return result;
+}
+
+bool forgetImagesUntil(int64 limit) {
+	while (globalAcquiredSize > limit && cacheLeastRecent) {
+		auto image = cacheLeastRecent;
+		auto was = globalAcquiredSize;
+		image->forget();
+		if (image->_cacheUsed) {
+			// Nothing to forget except scaled pixmaps, or saving failed.
+			image->invalidateSizeCache();
+			image->removeFromCache();
+		}
+		if (globalAcquiredSize < was) {
+			++cacheStats.evictedImages;
+			cacheStats.evictedBytes += (was - globalAcquiredSize);
+		}
+	}
+	return (globalAcquiredSize <= limit);
+}
+
 void RemoteImage::doCheckload() const {
 	if (!amLoading() || !_loader->finished()) return;
 
@@ -881,6 +1125,7 @@ void RemoteImage::doCheckload() const {
 	destroyLoaderDelayed();
 
 	_forgot = false;
+	touchCache();
 }
 
 void RemoteImage::destroyLoaderDelayed(FileLoader *newValue) const {
@@ -916,15 +1161,19 @@ void RemoteImage::setData(QByteArray &bytes, const QByteArray &bytesFormat) {
 	_saved = bytes;
 	_format = fmt;
 	_forgot = false;
+	touchCache();
 }
 
 bool RemoteImage::amLoading() const {
 	return _loader && _loader != CancelledFileLoader;
 }
 
-void RemoteImage::automaticLoad(const HistoryItem *item) {
+void RemoteImage::automaticLoad(const HistoryItem *item, bool prior) {
 	if (loaded()) return;
 
+	// No new automatic downloads during a call.
+	if (!_loader && Calls::Current().performanceMode()) return;
+
 	if (_loader != CancelledFileLoader && item) {
 		bool loadFromCloud = false;
 		if (item->history()->peer->isUser()) {
@@ -935,9 +1184,12 @@ void RemoteImage::automaticLoad(const HistoryItem *item) {
 
 		if (_loader) {
 			if (loadFromCloud) _loader->permitLoadFromCloud();
+
+			// Painted again, so it goes before the ones scrolled away.
+			if (prior) _loader->raiseToCurrentPriority();
 		} else {
 			_loader = createLoader(loadFromCloud ? LoadFromCloudOrLocal : LoadFromLocalOnly, true);
-			if (_loader) _loader->start();
+			if (_loader) _loader->start(false, prior);
 		}
 	}
 }
@@ -1085,7 +1337,7 @@ void DelayedStorageImage::setStorageLocation(const StorageImageLocation location
 	}
 }
 
-void DelayedStorageImage::automaticLoad(const HistoryItem *item) {
+void DelayedStorageImage::automaticLoad(const HistoryItem *item, bool prior) {
 	if (_location.isNull()) {
 		if (!_loadCancelled && item) {
 			bool loadFromCloud = false;
@@ -1103,7 +1355,7 @@ void DelayedStorageImage::automaticLoad(const HistoryItem *item) {
 			}
 		}
 	} else {
-		StorageImage::automaticLoad(item);
+		StorageImage::automaticLoad(item, prior);
 	}
 }
 
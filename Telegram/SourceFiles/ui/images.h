@@ -220,9 +220,13 @@ public:
 	Image(const QString &file, QByteArray format = QByteArray());
 	Image(const QByteArray &filecontent, QByteArray format = QByteArray());
 	Image(const QPixmap &pixmap, QByteArray format = QByteArray());
+	// With a null pixmap the image is not decoded until it is painted,
+	// pixSingleAsync() decodes it in the background then.
 	Image(const QByteArray &filecontent, QByteArray format, const QPixmap &pixmap);
 
-	virtual void automaticLoad(const HistoryItem *item) { // auto load photo
+	// With prior = false the load is queued behind all the others,
+	// it is used to prefetch the photos that are not visible yet.
+	virtual void automaticLoad(const HistoryItem *item, bool prior = true) { // auto load photo
 	}
 	virtual void automaticLoadSettingsChanged() {
 	}
@@ -252,6 +256,10 @@ public:
 	const QPixmap &pixBlurredColored(style::color add, int32 w = 0, int32 h = 0) const;
 	const QPixmap &pixSingle(int32 w, int32 h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners = ImageRoundCorner::All, const style::color *colored = nullptr) const;
 	const QPixmap &pixBlurredSingle(int32 w, int32 h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners = ImageRoundCorner::All) const;
+
+	// Same as pixSingle(), but the image is decoded and scaled in the background.
+	// Returns a null pixmap until it is ready, then repaints the requesting item.
+	QPixmap pixSingleAsync(not_null<const HistoryItem*> item, int32 w, int32 h, int32 outerw, int32 outerh, ImageRoundRadius radius, ImageRoundCorners corners = ImageRoundCorner::All) const;
 	const QPixmap &pixCircled(int32 w = 0, int32 h = 0) const;
 	const QPixmap &pixBlurredCircled(int32 w = 0, int32 h = 0) const;
 	QPixmap pixNoCache(int w = 0, int h = 0, Images::Options options = 0, int outerw = -1, int outerh = -1, const style::color *colored = nullptr) const;
@@ -305,6 +313,9 @@ protected:
 	}
 	void invalidateSizeCache() const;
 
+	// Least recently used images are forgotten by forgetImagesUntil().
+	void touchCache() const;
+
 	virtual int32 countWidth() const {
 		restore();
 		return _data.width();
@@ -320,9 +331,20 @@ protected:
 	mutable QPixmap _data;
 
 private:
+	void removeFromCache() const;
+	friend bool forgetImagesUntil(int64 limit);
+
 	using Sizes = QMap<uint64, QPixmap>;
 	mutable Sizes _sizesCache;
 
+	struct AsyncPixRequests;
+	void asyncPixReady(uint64 key, QImage &&image) const;
+	mutable std::shared_ptr<AsyncPixRequests> _asyncPixRequests;
+
+	mutable const Image *_cacheNewer = nullptr;
+	mutable const Image *_cacheOlder = nullptr;
+	mutable bool _cacheUsed = false;
+
 };
 
 typedef QPair<uint64, uint64> StorageKey;
@@ -346,7 +368,7 @@ inline StorageKey storageKey(const WebFileImageLocation &location) {
 
 class RemoteImage : public Image {
 public:
-	void automaticLoad(const HistoryItem *item); // auto load photo
+	void automaticLoad(const HistoryItem *item, bool prior = true); // auto load photo
 	void automaticLoadSettingsChanged();
 
 	bool loaded() const;
@@ -441,7 +463,7 @@ public:
 		return this;
 	}
 
-	void automaticLoad(const HistoryItem *item); // auto load photo
+	void automaticLoad(const HistoryItem *item, bool prior = true); // auto load photo
 	void automaticLoadSettingsChanged();
 
 	bool loading() const {
@@ -545,6 +567,18 @@ void clearStorageImages();
 void clearAllImages();
 int64 imageCacheSize();
 
+struct ImageCacheStats {
+	int64 bytes = 0;
+	int images = 0; // Holding decoded data or scaled pixmaps.
+	int64 evictedImages = 0;
+	int64 evictedBytes = 0;
+};
+ImageCacheStats imageCacheStats();
+
+// Forgets the least recently used images until the cache fits the limit.
+// Returns false if what is left can't be forgotten and is still larger.
+bool forgetImagesUntil(int64 limit);
+
 class PsFileBookmark;
 class ReadAccessEnabler {
 public:
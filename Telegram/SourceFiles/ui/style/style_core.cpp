@@ -66,6 +66,7 @@ void startManager() {
 
 	internal::registerFontFamily(qsl("Open Sans"));
 	internal::startModules();
+	internal::startPreparingIconMasks();
 }
 
 void stopManager() {
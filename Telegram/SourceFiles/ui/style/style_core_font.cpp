@@ -24,6 +24,8 @@ namespace style {
 namespace internal {
 namespace {
 
+constexpr auto kMaxCachedStringWidths = 4096;
+
 typedef QMap<QString, int> FontFamilyMap;
 FontFamilyMap fontFamilyMap;
 
@@ -83,6 +85,32 @@ FontData::FontData(int size, uint32 flags, int family, Font *other)
 	elidew = width(qsl("..."));
 }
 
+int32 FontData::width(const QString &str) const {
+	auto i = _stringWidths.constFind(str);
+	if (i != _stringWidths.cend()) {
+		return i.value();
+	}
+	if (_stringWidths.size() >= kMaxCachedStringWidths) {
+		_stringWidths.clear();
+	}
+	auto result = m.width(str);
+	_stringWidths.insert(str, result);
+	return result;
+}
+
+int32 FontData::width(QChar ch) const {
+	auto &page = _charWidths[ch.row()];
+	if (!page) {
+		page = std::make_unique<CharWidthsPage>();
+		page->fill(-1);
+	}
+	auto &result = (*page)[ch.cell()];
+	if (result < 0) {
+		result = m.width(ch);
+	}
+	return result;
+}
+
 Font FontData::bold(bool set) const {
 	return otherFlagsFont(FontBold, set);
 }
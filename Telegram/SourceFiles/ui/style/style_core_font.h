@@ -76,15 +76,12 @@ enum FontFlags {
 class FontData {
 public:
 
-	int32 width(const QString &str) const {
-		return m.width(str);
-	}
+	// Measured widths are cached, the font of FontData never changes.
+	int32 width(const QString &str) const;
 	int32 width(const QString &str, int32 from, int32 to) const {
 		return width(str.mid(from, to));
 	}
-	int32 width(QChar ch) const {
-		return m.width(ch);
-	}
+	int32 width(QChar ch) const;
 	QString elided(const QString &str, int32 width, Qt::TextElideMode mode = Qt::ElideRight) const {
 		return m.elidedText(str, mode, width);
 	}
@@ -112,6 +109,11 @@ private:
 	uint32 _flags;
 	int _family;
 
+	// Advances of the BMP chars by 256 chars pages, -1 if not known.
+	using CharWidthsPage = std::array<int16, 256>;
+	mutable std::array<std::unique_ptr<CharWidthsPage>, 256> _charWidths;
+	mutable QHash<QString, int32> _stringWidths;
+
 };
 
 inline bool operator==(const Font &a, const Font &b) {
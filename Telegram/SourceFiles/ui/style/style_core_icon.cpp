@@ -20,10 +20,16 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 */
 #include "ui/style/style_core_icon.h"
 
+#include "base/task_queue.h"
+#include "base/timer.h"
+
 namespace style {
 namespace internal {
 namespace {
 
+constexpr auto kPreparedMasksBytesLimit = 32 * 1024 * 1024;
+constexpr auto kPreparedMasksKeepTimeout = TimeMs(60000); // Masks not painted by then are dropped.
+
 uint32 colorKey(QColor c) {
 	return (((((uint32(c.red()) << 8) | uint32(c.green())) << 8) | uint32(c.blue())) << 8) | uint32(c.alpha());
 }
@@ -34,6 +40,19 @@ using IconDatas = OrderedSet<IconData*>;
 NeverFreedPointer<IconMasks> iconMasks;
 NeverFreedPointer<IconPixmaps> iconPixmaps;
 NeverFreedPointer<IconDatas> iconData;
+NeverFreedPointer<std::vector<const IconMask*>> registeredMasks;
+
+// Shared with the background task, which may outlive destroyIcons().
+struct PreparedMasks {
+	QMutex mutex;
+	DBIScale scale = dbisAuto;
+	QMap<const IconMask*, QImage> ready;
+	OrderedSet<const IconMask*> taken;
+	int64 readyBytes = 0;
+	bool stopped = false;
+};
+std::shared_ptr<PreparedMasks> preparedMasks;
+NeverFreedPointer<base::Timer> preparedMasksTimer;
 
 inline int pxAdjust(int value, int scale) {
 	if (value < 0) {
@@ -104,6 +123,46 @@ QSize readGeneratedSize(const IconMask *mask, DBIScale scale) {
 	return QSize();
 }
 
+void prepareIconMasks(std::shared_ptr<PreparedMasks> prepared, std::vector<const IconMask*> masks) {
+	for (auto mask : masks) {
+		{
+			QMutexLocker lock(&prepared->mutex);
+			if (prepared->stopped || prepared->readyBytes >= kPreparedMasksBytesLimit) {
+				return;
+			} else if (prepared->taken.contains(mask)) {
+				continue;
+			}
+		}
+		if (!readGeneratedSize(mask, prepared->scale).isEmpty()) {
+			continue;
+		}
+		auto image = createIconMask(mask, prepared->scale);
+
+		QMutexLocker lock(&prepared->mutex);
+		if (!prepared->taken.contains(mask)) {
+			prepared->readyBytes += image.byteCount();
+			prepared->ready.insert(mask, std::move(image));
+		}
+	}
+}
+
+QImage takeIconMask(const IconMask *mask) {
+	if (preparedMasks) {
+		QMutexLocker lock(&preparedMasks->mutex);
+		preparedMasks->taken.insert(mask);
+		auto i = preparedMasks->ready.find(mask);
+		if (i != preparedMasks->ready.end()) {
+			auto result = std::move(i.value());
+			preparedMasks->ready.erase(i);
+			preparedMasks->readyBytes -= result.byteCount();
+			if (preparedMasks->scale == cScale()) {
+				return result;
+			}
+		}
+	}
+	return createIconMask(mask, cScale());
+}
+
 } // namespace
 
 MonoIcon::MonoIcon(const IconMask *mask, Color color, QPoint offset)
@@ -117,6 +176,20 @@ void MonoIcon::reset() const {
 	_size = QSize();
 }
 
+void MonoIcon::resetIfColorChanged() const {
+	if (_pixmap.isNull()) {
+		// Rects are filled with the current color on each paint.
+		return;
+	}
+	auto key = qMakePair(_mask, _pixmapColorKey);
+	if (key.second != colorKey(_color->c)) {
+		reset();
+	} else {
+		iconPixmaps.createIfNull();
+		iconPixmaps->insert(key, _pixmap);
+	}
+}
+
 int MonoIcon::width() const {
 	ensureLoaded();
 	return _size.width();
@@ -249,7 +322,7 @@ void MonoIcon::ensureLoaded() const {
 		iconMasks.createIfNull();
 		auto i = iconMasks->constFind(_mask);
 		if (i == iconMasks->cend()) {
-			i = iconMasks->insert(_mask, createIconMask(_mask, cScale()));
+			i = iconMasks->insert(_mask, takeIconMask(_mask));
 		}
 		_maskImage = i.value();
 
@@ -271,6 +344,7 @@ void MonoIcon::createCachedPixmap() const {
 		j = iconPixmaps->insert(key, App::pixmapFromImageInPlace(std::move(image)));
 	}
 	_pixmap = j.value();
+	_pixmapColorKey = key.second;
 	_size = _pixmap.size() / cIntRetinaFactor();
 }
 
@@ -328,16 +402,51 @@ int IconData::height() const {
 	return _height;
 }
 
+void registerIconMasks(const IconMask * const *masks, int count) {
+	registeredMasks.createIfNull();
+	registeredMasks->insert(registeredMasks->end(), masks, masks + count);
+}
+
+void startPreparingIconMasks() {
+	if (!registeredMasks || preparedMasks) {
+		return;
+	}
+	preparedMasks = std::make_shared<PreparedMasks>();
+	preparedMasks->scale = cScale();
+	base::TaskQueue::Normal().Put([prepared = preparedMasks, masks = std::move(*registeredMasks)]() mutable {
+		prepareIconMasks(std::move(prepared), std::move(masks));
+	});
+	registeredMasks.clear();
+
+	preparedMasksTimer.createIfNull([] { stopPreparingIconMasks(); });
+	preparedMasksTimer->callOnce(kPreparedMasksKeepTimeout);
+}
+
+void stopPreparingIconMasks() {
+	if (preparedMasks) {
+		QMutexLocker lock(&preparedMasks->mutex);
+		preparedMasks->stopped = true;
+		preparedMasks->ready.clear();
+		preparedMasks->readyBytes = 0;
+	}
+}
+
 void resetIcons() {
+	// Only the icons with changed colors are colorized again, the pixmaps
+	// of all the others are put back to the cache by resetIfColorChanged().
 	iconPixmaps.clear();
 	if (iconData) {
 		for (auto data : *iconData) {
-			data->reset();
+			data->resetIfColorChanged();
 		}
 	}
 }
 
 void destroyIcons() {
+	stopPreparingIconMasks();
+	preparedMasksTimer.clear();
+	preparedMasks = nullptr;
+	registeredMasks.clear();
 	iconData.clear();
 	iconPixmaps.clear();
 	iconMasks.clear();
@@ -56,6 +56,10 @@ public:
 	MonoIcon(const IconMask *mask, Color color, QPoint offset);
 
 	void reset() const;
+
+	// Keeps the cached pixmap if it was colorized with the current color.
+	void resetIfColorChanged() const;
+
 	int width() const;
 	int height() const;
 	QSize size() const;
@@ -86,6 +90,7 @@ private:
 	QPoint _offset = { 0, 0 };
 	mutable QImage _maskImage, _colorizedImage;
 	mutable QPixmap _pixmap; // for pixmaps
+	mutable uint32 _pixmapColorKey = 0;
 	mutable QSize _size; // for rects
 
 };
@@ -104,6 +109,11 @@ public:
 			part.reset();
 		}
 	}
+	void resetIfColorChanged() {
+		for_const (auto &part, _parts) {
+			part.resetIfColorChanged();
+		}
+	}
 	bool empty() const {
 		return _parts.empty();
 	}
@@ -284,6 +294,13 @@ private:
 
 };
 
+// Masks are decoded in the background after startPreparingIconMasks(),
+// icons painted before that decode their masks on the first paint.
+// The masks that were not painted soon after the start are dropped.
+void registerIconMasks(const IconMask * const *masks, int count);
+void startPreparingIconMasks();
+void stopPreparingIconMasks();
+
 void resetIcons();
 void destroyIcons();
 
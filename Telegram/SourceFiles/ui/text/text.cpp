@@ -31,12 +31,31 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 
 namespace {
 
+// Paragraph starts are remembered only for texts long enough to make
+// the layout of the lines above the visible region noticeable.
+constexpr auto kParagraphsIndexMinLength = 1024;
+
+using TextBlocks = std::vector<TextBlockHolder, Core::MemoryStats::Allocator<TextBlockHolder, Core::MemoryStats::Category::TextLayouts>>;
+
 inline int32 countBlockHeight(const ITextBlock *b, const style::TextStyle *st) {
 	return (b->type() == TextBlockTSkip) ? static_cast<const SkipBlock*>(b)->height() : (st->lineHeight > st->font->height) ? st->lineHeight : st->font->height;
 }
 
+inline uint16 CountBlockEnd(const QString &text, const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) {
+	return (i + 1 == e) ? text.size() : (*(i + 1))->from();
+}
+
+inline uint16 CountBlockLength(const QString &text, const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) {
+	return CountBlockEnd(text, i, e) - (*i)->from();
+}
+
 } // namespace
 
+struct Text::Layout {
+	TextBlocks blocks;
+	TextWords words;
+};
+
 QString textcmdSkipBlock(ushort w, ushort h) {
 	static QString cmd(5, TextCommand);
 	cmd[1] = QChar(TextCommandSkipBlock);
@@ -158,7 +177,7 @@ public:
 	}
 
 	void blockCreated() {
-		sumWidth += _t->_blocks.back()->f_width();
+		sumWidth += _t->mutableLayout().blocks.back()->f_width();
 		if (sumWidth.floor().toInt() > stopAfterWidth) {
 			sumFinished = true;
 		}
@@ -178,13 +197,13 @@ public:
 			}
 			lastSkipped = false;
 			if (emoji) {
-				_t->_blocks.push_back(std::make_unique<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
+				_t->mutableLayout().blocks.push_back(TextBlockHolder::New<EmojiBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex, emoji));
 				emoji = 0;
 				lastSkipped = true;
 			} else if (newline) {
-				_t->_blocks.push_back(std::make_unique<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
+				_t->mutableLayout().blocks.push_back(TextBlockHolder::New<NewlineBlock>(_t->_st->font, _t->_text, blockStart, len, flags, lnkIndex));
 			} else {
-				_t->_blocks.push_back(std::make_unique<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex));
+				_t->mutableLayout().blocks.push_back(TextBlockHolder::New<TextBlock>(_t->_st->font, _t->_text, _t->_minResizeWidth, blockStart, len, flags, lnkIndex, _t->mutableLayout().words));
 			}
 			blockStart += len;
 			blockCreated();
@@ -194,7 +213,7 @@ public:
 	void createSkipBlock(int32 w, int32 h) {
 		createBlock();
 		_t->_text.push_back('_');
-		_t->_blocks.push_back(std::make_unique<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
+		_t->mutableLayout().blocks.push_back(TextBlockHolder::New<SkipBlock>(_t->_st->font, _t->_text, blockStart++, w, h, lnkIndex));
 		blockCreated();
 	}
 
@@ -251,7 +270,7 @@ public:
 		} else if (type == EntityInTextPre) {
 			startFlags = TextBlockFPre;
 			createBlock();
-			if (!_t->_blocks.empty() && _t->_blocks.back()->type() != TextBlockTNewline) {
+			if (!_t->mutableLayout().blocks.empty() && _t->mutableLayout().blocks.back()->type() != TextBlockTNewline) {
 				createNewlineBlock();
 			}
 		} else if (type == EntityInTextUrl
@@ -586,7 +605,7 @@ public:
 		removeFlags.clear();
 
 		_t->_links.resize(maxLnkIndex);
-		for (auto i = _t->_blocks.cbegin(), e = _t->_blocks.cend(); i != e; ++i) {
+		for (auto i = _t->mutableLayout().blocks.begin(), e = _t->mutableLayout().blocks.end(); i != e; ++i) {
 			auto b = i->get();
 			if (b->lnkIndex() > 0x8000) {
 				lnkIndex = maxLnkIndex + (b->lnkIndex() - 0x8000);
@@ -635,7 +654,8 @@ public:
 			}
 		}
 		_t->_links.squeeze();
-		_t->_blocks.shrink_to_fit();
+		_t->mutableLayout().blocks.shrink_to_fit();
+		_t->mutableLayout().words.shrink_to_fit();
 		_t->_text.squeeze();
 	}
 
@@ -806,7 +826,7 @@ public:
 	void draw(int32 left, int32 top, int32 w, style::align align, int32 yFrom, int32 yTo, TextSelection selection = { 0, 0 }, bool fullWidthSelection = true) {
 		if (_t->isEmpty()) return;
 
-		_blocksSize = _t->_blocks.size();
+		_blocksSize = _t->layout().blocks.size();
 		if (_p) {
 			_p->setFont(_t->_st->font);
 			_textPalette = &_p->textPalette();
@@ -823,8 +843,8 @@ public:
 		_wLeft = _w = w;
 		if (_elideLast) {
 			_yToElide = _yTo;
-			if (_elideRemoveFromEnd > 0 && !_t->_blocks.empty()) {
-				int firstBlockHeight = countBlockHeight(_t->_blocks.front().get(), _t->_st);
+			if (_elideRemoveFromEnd > 0 && !_t->layout().blocks.empty()) {
+				int firstBlockHeight = countBlockHeight(_t->layout().blocks.front().get(), _t->_st);
 				if (_y + firstBlockHeight >= _yToElide) {
 					_wLeft -= _elideRemoveFromEnd;
 				}
@@ -844,8 +864,8 @@ public:
 
 		_parDirection = _t->_startDir;
 		if (_parDirection == Qt::LayoutDirectionAuto) _parDirection = cLangDir();
-		if ((*_t->_blocks.cbegin())->type() != TextBlockTNewline) {
-			initNextParagraph(_t->_blocks.cbegin());
+		if ((*_t->layout().blocks.cbegin())->type() != TextBlockTNewline) {
+			initNextParagraph(_t->layout().blocks.cbegin());
 		}
 
 		_lineStart = 0;
@@ -858,8 +878,49 @@ public:
 
 		auto blockIndex = 0;
 		bool longWordLine = true;
-		auto e = _t->_blocks.cend();
-		for (auto i = _t->_blocks.cbegin(); i != e; ++i, ++blockIndex) {
+		auto e = _t->layout().blocks.cend();
+		auto i = _t->layout().blocks.cbegin();
+
+		// Line breaking starts over after each newline, so we can jump
+		// right to the last paragraph starting above the visible region.
+		auto indexParagraphs = !_elideLast
+			&& !_breakEverywhere
+			&& (_t->_text.size() >= kParagraphsIndexMinLength);
+		if (indexParagraphs) {
+			if (_t->_paragraphsWidth != w) {
+				_t->_paragraphsWidth = w;
+				_t->_paragraphs.clear();
+			}
+			auto &paragraphs = _t->_paragraphs;
+			auto skipTill = _yFrom - top - _fontHeight;
+			auto after = std::upper_bound(paragraphs.cbegin(), paragraphs.cend(), skipTill, [](int value, const Text::ParagraphStart &paragraph) {
+				return (value < paragraph.top);
+			});
+			if (after != paragraphs.cbegin()) {
+				auto &paragraph = *(after - 1);
+				blockIndex = paragraph.block;
+				i = _t->layout().blocks.cbegin() + blockIndex;
+
+				auto b = (i - 1)->get();
+				_y = top + paragraph.top;
+				_lineStart = CountBlockEnd(_t->_text, i - 1, e);
+				_lineStartBlock = blockIndex;
+				last_rBearing = b->f_rbearing();
+				_last_rPadding = b->f_rpadding();
+				_wLeft = _w - (b->f_width() - last_rBearing);
+
+				_parDirection = static_cast<const NewlineBlock*>(b)->nextDirection();
+				if (_parDirection == Qt::LayoutDirectionAuto) _parDirection = cLangDir();
+				initNextParagraph(i);
+
+				if (_lookupSymbol) {
+					_lookupResult.symbol = paragraph.lookupSymbol;
+					_lookupResult.afterSymbol = paragraph.lookupAfterSymbol;
+				}
+			}
+		}
+
+		for (; i != e; ++i, ++blockIndex) {
 			auto b = i->get();
 			auto _btype = b->type();
 			auto blockHeight = countBlockHeight(b, _t->_st);
@@ -871,8 +932,11 @@ public:
 				}
 
 				_y += _lineHeight;
+				if (indexParagraphs) {
+					rememberParagraph(blockIndex + 1, _y - top, (*i)->from());
+				}
 				_lineHeight = 0;
-				_lineStart = _t->countBlockEnd(i, e);
+				_lineStart = CountBlockEnd(_t->_text, i, e);
 				_lineStartBlock = blockIndex + 1;
 
 				last_rBearing = b->f_rbearing();
@@ -882,7 +946,7 @@ public:
 					_wLeft -= _elideRemoveFromEnd;
 				}
 
-				_parDirection = static_cast<NewlineBlock*>(b)->nextDirection();
+				_parDirection = static_cast<const NewlineBlock*>(b)->nextDirection();
 				if (_parDirection == Qt::LayoutDirectionAuto) _parDirection = cLangDir();
 				initNextParagraph(i + 1);
 
@@ -904,8 +968,8 @@ public:
 			}
 
 			if (_btype == TextBlockTText) {
-				auto t = static_cast<TextBlock*>(b);
-				if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+				auto t = static_cast<const TextBlock*>(b);
+				if (!t->wordsCount()) { // no words in this block, spaces only => layout this block in the same line
 					_last_rPadding += b->f_rpadding();
 
 					_lineHeight = qMax(_lineHeight, blockHeight);
@@ -915,8 +979,9 @@ public:
 				}
 
 				auto f_wLeft = _wLeft; // vars for saving state of the last word start
-				auto f_lineHeight = _lineHeight; // f points to the last word-start element of t->_words
-				for (auto j = t->_words.cbegin(), en = t->_words.cend(), f = j; j != en; ++j) {
+				auto f_lineHeight = _lineHeight; // f points to the last word-start element of the block words
+				auto words = _t->layout().words.cbegin() + t->wordsFrom();
+				for (auto j = words, en = words + t->wordsCount(), f = j; j != en; ++j) {
 					auto wordEndsHere = (j->f_width() >= 0);
 					auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
@@ -950,7 +1015,7 @@ public:
 						_lineHeight = f_lineHeight;
 						j_width = (j->f_width() >= 0) ? j->f_width() : -j->f_width();
 					}
-					if (!drawLine(elidedLine ? ((j + 1 == en) ? _t->countBlockEnd(i, e) : (j + 1)->from()) : j->from(), i, e)) {
+					if (!drawLine(elidedLine ? ((j + 1 == en) ? CountBlockEnd(_t->_text, i, e) : (j + 1)->from()) : j->from(), i, e)) {
 						return;
 					}
 					_y += _lineHeight;
@@ -978,7 +1043,7 @@ public:
 			if (elidedLine) {
 				_lineHeight = elidedLineHeight;
 			}
-			if (!drawLine(elidedLine ? _t->countBlockEnd(i, e) : b->from(), i, e)) {
+			if (!drawLine(elidedLine ? CountBlockEnd(_t->_text, i, e) : b->from(), i, e)) {
 				return;
 			}
 			_y += _lineHeight;
@@ -1056,9 +1121,24 @@ public:
 	}
 
 private:
-	void initNextParagraph(Text::TextBlocks::const_iterator i) {
+	void rememberParagraph(int block, int top, int lineEnd) {
+		auto &paragraphs = _t->_paragraphs;
+		if (!paragraphs.empty() && paragraphs.back().block >= block) {
+			return;
+		}
+		auto paragraph = Text::ParagraphStart();
+		paragraph.block = block;
+		paragraph.top = top;
+
+		// The same symbol drawLine() finds in the skipped newline line.
+		paragraph.lookupAfterSymbol = (lineEnd > _lineStart);
+		paragraph.lookupSymbol = paragraph.lookupAfterSymbol ? (lineEnd - 1) : _lineStart;
+		paragraphs.push_back(paragraph);
+	}
+
+	void initNextParagraph(TextBlocks::const_iterator i) {
 		_parStartBlock = i;
-		Text::TextBlocks::const_iterator e = _t->_blocks.cend();
+		TextBlocks::const_iterator e = _t->layout().blocks.cend();
 		if (i == e) {
 			_parStart = _t->_text.size();
 			_parLength = 0;
@@ -1077,7 +1157,7 @@ private:
 	void initParagraphBidi() {
 		if (!_parLength || !_parAnalysis.isEmpty()) return;
 
-		Text::TextBlocks::const_iterator i = _parStartBlock, e = _t->_blocks.cend(), n = i + 1;
+		TextBlocks::const_iterator i = _parStartBlock, e = _t->layout().blocks.cend(), n = i + 1;
 
 		bool ignore = false;
 		bool rtl = (_parDirection == Qt::RightToLeft);
@@ -1117,7 +1197,7 @@ private:
 		}
 	}
 
-	bool drawLine(uint16 _lineEnd, const Text::TextBlocks::const_iterator &_endBlockIter, const Text::TextBlocks::const_iterator &_end) {
+	bool drawLine(uint16 _lineEnd, const TextBlocks::const_iterator &_endBlockIter, const TextBlocks::const_iterator &_end) {
 		_yDelta = (_lineHeight - _fontHeight) / 2;
 		if (_yTo >= 0 && (_y + _yDelta >= _yTo || _y >= _yTo)) return false;
 		if (_y + _yDelta + _fontHeight <= _yFrom) {
@@ -1154,12 +1234,12 @@ private:
 		}
 
 		auto blockIndex = _lineStartBlock;
-		auto currentBlock = _t->_blocks[blockIndex].get();
-		auto nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		auto currentBlock = _t->layout().blocks[blockIndex].get();
+		auto nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 
 		int32 delta = (currentBlock->from() < _lineStart ? qMin(_lineStart - currentBlock->from(), 2) : 0);
 		_localFrom = _lineStart - delta;
-		int32 lineEnd = (_endBlock && _endBlock->from() < trimmedLineEnd && !elidedLine) ? qMin(uint16(trimmedLineEnd + 2), _t->countBlockEnd(_endBlockIter, _end)) : trimmedLineEnd;
+		int32 lineEnd = (_endBlock && _endBlock->from() < trimmedLineEnd && !elidedLine) ? qMin(uint16(trimmedLineEnd + 2), CountBlockEnd(_t->_text, _endBlockIter, _end)) : trimmedLineEnd;
 
 		auto lineText = _t->_text.mid(_localFrom, lineEnd - _localFrom);
 		auto lineStart = delta;
@@ -1168,6 +1248,15 @@ private:
 		if (elidedLine) {
 			initParagraphBidi();
 			prepareElidedLine(lineText, lineStart, lineLength, _endBlock);
+
+			// The elided block was replaced in place, keep laying out the original one.
+			if (_elideSavedBlock) {
+				if (_elideSavedIndex == blockIndex - 1) {
+					currentBlock = _elideSavedBlock->get();
+				} else if (_elideSavedIndex == blockIndex) {
+					nextBlock = _elideSavedBlock->get();
+				}
+			}
 		}
 
 		auto x = _x;
@@ -1257,7 +1346,7 @@ private:
 			auto &si = engine.layoutData->items[firstItem + i];
 			while (nextBlock && nextBlock->from() <= _localFrom + si.position) {
 				currentBlock = nextBlock;
-				nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+				nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 			}
 			auto _type = currentBlock->type();
 			if (_type == TextBlockTSkip) {
@@ -1282,8 +1371,8 @@ private:
 		}
 
 		blockIndex = _lineStartBlock;
-		currentBlock = _t->_blocks[blockIndex].get();
-		nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		currentBlock = _t->layout().blocks[blockIndex].get();
+		nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 
 		int32 textY = _y + _yDelta + _t->_st->font->ascent, emojiY = (_t->_st->font->height - st::emojiSize) / 2;
 
@@ -1293,14 +1382,14 @@ private:
 			const QScriptItem &si = engine.layoutData->items.at(item);
 			bool rtl = (si.analysis.bidiLevel % 2);
 
-			while (blockIndex > _lineStartBlock + 1 && _t->_blocks[blockIndex - 1]->from() > _localFrom + si.position) {
+			while (blockIndex > _lineStartBlock + 1 && _t->layout().blocks[blockIndex - 1]->from() > _localFrom + si.position) {
 				nextBlock = currentBlock;
-				currentBlock = _t->_blocks[--blockIndex - 1].get();
+				currentBlock = _t->layout().blocks[--blockIndex - 1].get();
 				applyBlockProperties(currentBlock);
 			}
 			while (nextBlock && nextBlock->from() <= _localFrom + si.position) {
 				currentBlock = nextBlock;
-				nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+				nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 				applyBlockProperties(currentBlock);
 			}
 			if (si.analysis.flags >= QScriptAnalysis::TabOrObject) {
@@ -1380,9 +1469,9 @@ private:
 							}
 						}
 					}
-					emojiDraw(*_p, static_cast<EmojiBlock*>(currentBlock)->emoji, (glyphX + st::emojiPadding).toInt(), _y + _yDelta + emojiY);
+					emojiDraw(*_p, static_cast<const EmojiBlock*>(currentBlock)->emoji, (glyphX + st::emojiPadding).toInt(), _y + _yDelta + emojiY);
 //				} else if (_p && currentBlock->type() == TextBlockSkip) { // debug
-//					_p->fillRect(QRect(x.toInt(), _y, currentBlock->width(), static_cast<SkipBlock*>(currentBlock)->height()), QColor(0, 0, 0, 32));
+//					_p->fillRect(QRect(x.toInt(), _y, currentBlock->width(), static_cast<const SkipBlock*>(currentBlock)->height()), QColor(0, 0, 0, 32));
 				}
 				x += si.width;
 				continue;
@@ -1546,17 +1635,17 @@ private:
 		_p->fillRect(left, _y + _yDelta, width, _fontHeight, _textPalette->selectBg);
 	}
 
-	void elideSaveBlock(int32 blockIndex, ITextBlock *&_endBlock, int32 elideStart, int32 elideWidth) {
+	void elideSaveBlock(int32 blockIndex, const ITextBlock *&_endBlock, int32 elideStart, int32 elideWidth) {
 		if (_elideSavedBlock) {
 			restoreAfterElided();
 		}
 
 		_elideSavedIndex = blockIndex;
 		auto mutableText = const_cast<Text*>(_t);
-		_elideSavedBlock = std::move(mutableText->_blocks[blockIndex]);
-		mutableText->_blocks[blockIndex] = std::make_unique<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, _elideSavedBlock->flags(), _elideSavedBlock->lnkIndex());
+		_elideSavedBlock = mutableText->mutableLayout().blocks[blockIndex];
+		mutableText->mutableLayout().blocks[blockIndex] = TextBlockHolder::New<TextBlock>(_t->_st->font, _t->_text, QFIXED_MAX, elideStart, 0, (*_elideSavedBlock)->flags(), (*_elideSavedBlock)->lnkIndex(), mutableText->mutableLayout().words);
 		_blocksSize = blockIndex + 1;
-		_endBlock = (blockIndex + 1 < _t->_blocks.size() ? _t->_blocks[blockIndex + 1].get() : nullptr);
+		_endBlock = (blockIndex + 1 < _t->layout().blocks.size() ? _t->layout().blocks[blockIndex + 1].get() : nullptr);
 	}
 
 	void setElideBidi(int32 elideStart, int32 elideLen) {
@@ -1569,7 +1658,7 @@ private:
 		}
 	}
 
-	void prepareElidedLine(QString &lineText, int32 lineStart, int32 &lineLength, ITextBlock *&_endBlock, int repeat = 0) {
+	void prepareElidedLine(QString &lineText, int32 lineStart, int32 &lineLength, const ITextBlock *&_endBlock, int repeat = 0) {
 		static const QString _Elide = qsl("...");
 
 		_f = _t->_st->font;
@@ -1580,8 +1669,8 @@ private:
 		eItemize();
 
 		auto blockIndex = _lineStartBlock;
-		auto currentBlock = _t->_blocks[blockIndex].get();
-		auto nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		auto currentBlock = _t->layout().blocks[blockIndex].get();
+		auto nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 
 		QScriptLine line;
 		line.from = lineStart;
@@ -1598,7 +1687,7 @@ private:
 			QScriptItem &si(engine.layoutData->items[firstItem + i]);
 			while (nextBlock && nextBlock->from() <= _localFrom + si.position) {
 				currentBlock = nextBlock;
-				nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+				nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 			}
 			TextBlockType _type = currentBlock->type();
 			if (si.analysis.flags == QScriptAnalysis::Object) {
@@ -1669,7 +1758,7 @@ private:
 		lineLength += _Elide.size();
 
 		if (!repeat) {
-			for (; blockIndex < _blocksSize && _t->_blocks[blockIndex].get() != _endBlock && _t->_blocks[blockIndex]->from() < elideStart; ++blockIndex) {
+			for (; blockIndex < _blocksSize && _t->layout().blocks[blockIndex].get() != _endBlock && _t->layout().blocks[blockIndex]->from() < elideStart; ++blockIndex) {
 			}
 			if (blockIndex < _blocksSize) {
 				elideSaveBlock(blockIndex, _endBlock, elideStart, elideWidth);
@@ -1679,7 +1768,7 @@ private:
 
 	void restoreAfterElided() {
 		if (_elideSavedBlock) {
-			const_cast<Text*>(_t)->_blocks[_elideSavedIndex] = std::move(_elideSavedBlock);
+			const_cast<Text*>(_t)->mutableLayout().blocks[_elideSavedIndex] = *base::take(_elideSavedBlock);
 		}
 	}
 
@@ -1696,14 +1785,14 @@ private:
 #endif // OS_MAC_OLD
 
 		auto blockIndex = _lineStartBlock;
-		auto currentBlock = _t->_blocks[blockIndex].get();
-		auto nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		auto currentBlock = _t->layout().blocks[blockIndex].get();
+		auto nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 		eSetFont(currentBlock);
 		for (; item <= end; ++item) {
 			QScriptItem &si = _e->layoutData->items[item];
 			while (nextBlock && nextBlock->from() <= _localFrom + si.position) {
 				currentBlock = nextBlock;
-				nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+				nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 				eSetFont(currentBlock);
 			}
 			_e->shape(item);
@@ -1735,7 +1824,7 @@ private:
 		return result;
 	}
 
-	void eSetFont(ITextBlock *block) {
+	void eSetFont(const ITextBlock *block) {
 		style::font newFont = _t->_st->font;
 		int flags = block->flags();
 		if (flags) {
@@ -1774,8 +1863,8 @@ private:
 		const ushort *string = reinterpret_cast<const ushort*>(_e->layoutData->string.unicode());
 
 		auto blockIndex = _lineStartBlock;
-		auto currentBlock = _t->_blocks[blockIndex].get();
-		auto nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		auto currentBlock = _t->layout().blocks[blockIndex].get();
+		auto nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 
 		_e->layoutData->hasBidi = _parHasBidi;
 		auto analysis = _parAnalysis.data() + (_localFrom - _parStart);
@@ -1788,15 +1877,15 @@ private:
 		}
 
 		blockIndex = _lineStartBlock;
-		currentBlock = _t->_blocks[blockIndex].get();
-		nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+		currentBlock = _t->layout().blocks[blockIndex].get();
+		nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 
 		auto start = string;
 		auto end = start + length;
 		while (start < end) {
 			while (nextBlock && nextBlock->from() <= _localFrom + (start - string)) {
 				currentBlock = nextBlock;
-				nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+				nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 			}
 			auto _type = currentBlock->type();
 			if (_type == TextBlockTEmoji || _type == TextBlockTSkip) {
@@ -1816,8 +1905,8 @@ private:
 			auto i_items = &_e->layoutData->items;
 
 			blockIndex = _lineStartBlock;
-			currentBlock = _t->_blocks[blockIndex].get();
-			nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+			currentBlock = _t->layout().blocks[blockIndex].get();
+			nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 			auto startBlock = currentBlock;
 
 			if (!length) {
@@ -1828,7 +1917,7 @@ private:
 			for (int i = start + 1; i < end; ++i) {
 				while (nextBlock && nextBlock->from() <= _localFrom + i) {
 					currentBlock = nextBlock;
-					nextBlock = (++blockIndex < _blocksSize) ? _t->_blocks[blockIndex].get() : nullptr;
+					nextBlock = (++blockIndex < _blocksSize) ? _t->layout().blocks[blockIndex].get() : nullptr;
 				}
 				// According to the unicode spec we should be treating characters in the Common script
 				// (punctuation, spaces, etc) as being the same script as the surrounding text for the
@@ -1859,8 +1948,8 @@ private:
 	QChar::Direction eSkipBoundryNeutrals(QScriptAnalysis *analysis,
 											const ushort *unicode,
 											int &sor, int &eor, BidiControl &control,
-											Text::TextBlocks::const_iterator i) {
-		Text::TextBlocks::const_iterator e = _t->_blocks.cend(), n = i + 1;
+											TextBlocks::const_iterator i) {
+		TextBlocks::const_iterator e = _t->layout().blocks.cend(), n = i + 1;
 
 		QChar::Direction dir = control.basicDirection();
 		int level = sor > 0 ? analysis[sor - 1].bidiLevel : control.level;
@@ -1908,7 +1997,7 @@ private:
 		QChar::Direction dir = rightToLeft ? QChar::DirR : QChar::DirL;
 		BidiStatus status;
 
-		Text::TextBlocks::const_iterator i = _parStartBlock, e = _t->_blocks.cend(), n = i + 1;
+		TextBlocks::const_iterator i = _parStartBlock, e = _t->layout().blocks.cend(), n = i + 1;
 
 		QChar::Direction sdir;
 		TextBlockType _stype = (*_parStartBlock)->type();
@@ -2310,7 +2399,7 @@ private:
 	}
 
 private:
-	void applyBlockProperties(ITextBlock *block) {
+	void applyBlockProperties(const ITextBlock *block) {
 		eSetFont(block);
 		if (_p) {
 			if (block->lnkIndex()) {
@@ -2345,7 +2434,7 @@ private:
 	const QChar *_str = nullptr;
 
 	// current paragraph data
-	Text::TextBlocks::const_iterator _parStartBlock;
+	TextBlocks::const_iterator _parStartBlock;
 	Qt::LayoutDirection _parDirection;
 	int _parStart = 0;
 	int _parLength = 0;
@@ -2361,7 +2450,7 @@ private:
 	// elided hack support
 	int _blocksSize = 0;
 	int _elideSavedIndex = 0;
-	std::unique_ptr<ITextBlock> _elideSavedBlock;
+	base::optional<TextBlockHolder> _elideSavedBlock;
 
 	int _lineStart = 0;
 	int _localFrom = 0;
@@ -2406,23 +2495,26 @@ Text::Text(const Text &other)
 : _minResizeWidth(other._minResizeWidth)
 , _maxWidth(other._maxWidth)
 , _minHeight(other._minHeight)
+, _cachedLinesWidth(other._cachedLinesWidth)
+, _cachedLinesMaxWidth(other._cachedLinesMaxWidth)
+, _cachedLinesHeight(other._cachedLinesHeight)
 , _text(other._text)
 , _st(other._st)
+, _layout(other._layout ? std::make_unique<Layout>(*other._layout) : nullptr)
 , _links(other._links)
 , _startDir(other._startDir) {
-	_blocks.reserve(other._blocks.size());
-	for (auto &block : other._blocks) {
-		_blocks.push_back(block->clone());
-	}
 }
 
 Text::Text(Text &&other)
 : _minResizeWidth(other._minResizeWidth)
 , _maxWidth(other._maxWidth)
 , _minHeight(other._minHeight)
+, _cachedLinesWidth(other._cachedLinesWidth)
+, _cachedLinesMaxWidth(other._cachedLinesMaxWidth)
+, _cachedLinesHeight(other._cachedLinesHeight)
 , _text(other._text)
 , _st(other._st)
-, _blocks(std::move(other._blocks))
+, _layout(std::move(other._layout))
 , _links(other._links)
 , _startDir(other._startDir) {
 	other.clearFields();
@@ -2432,14 +2524,16 @@ Text &Text::operator=(const Text &other) {
 	_minResizeWidth = other._minResizeWidth;
 	_maxWidth = other._maxWidth;
 	_minHeight = other._minHeight;
+	_cachedLinesWidth = other._cachedLinesWidth;
+	_cachedLinesMaxWidth = other._cachedLinesMaxWidth;
+	_cachedLinesHeight = other._cachedLinesHeight;
 	_text = other._text;
 	_st = other._st;
-	_blocks = TextBlocks(other._blocks.size());
+	_layout = other._layout ? std::make_unique<Layout>(*other._layout) : nullptr;
 	_links = other._links;
 	_startDir = other._startDir;
-	for (int32 i = 0, l = _blocks.size(); i < l; ++i) {
-		_blocks[i] = other._blocks.at(i)->clone();
-	}
+	_paragraphsWidth = -1;
+	_paragraphs.clear();
 	return *this;
 }
 
@@ -2447,11 +2541,16 @@ Text &Text::operator=(Text &&other) {
 	_minResizeWidth = other._minResizeWidth;
 	_maxWidth = other._maxWidth;
 	_minHeight = other._minHeight;
+	_cachedLinesWidth = other._cachedLinesWidth;
+	_cachedLinesMaxWidth = other._cachedLinesMaxWidth;
+	_cachedLinesHeight = other._cachedLinesHeight;
 	_text = other._text;
 	_st = other._st;
-	_blocks = std::move(other._blocks);
+	_layout = std::move(other._layout);
 	_links = other._links;
 	_startDir = other._startDir;
+	_paragraphsWidth = -1;
+	_paragraphs.clear();
 	other.clearFields();
 	return *this;
 }
@@ -2469,10 +2568,14 @@ void Text::recountNaturalSize(bool initial, Qt::LayoutDirection optionsDir) {
 	NewlineBlock *lastNewline = 0;
 
 	_maxWidth = _minHeight = 0;
+	_cachedLinesWidth = -1;
+	_paragraphsWidth = -1;
+	_paragraphs.clear();
 	int32 lineHeight = 0;
 	int32 result = 0, lastNewlineStart = 0;
 	QFixed _width = 0, last_rBearing = 0, last_rPadding = 0;
-	for (auto i = _blocks.cbegin(), e = _blocks.cend(); i != e; ++i) {
+	auto &blocks = mutableLayout().blocks;
+	for (auto i = blocks.begin(), e = blocks.end(); i != e; ++i) {
 		auto b = i->get();
 		auto _btype = b->type();
 		auto blockHeight = countBlockHeight(b, _st);
@@ -2532,7 +2635,7 @@ void Text::recountNaturalSize(bool initial, Qt::LayoutDirection optionsDir) {
 		}
 	}
 	if (_width > 0) {
-		if (!lineHeight) lineHeight = countBlockHeight(_blocks.back().get(), _st);
+		if (!lineHeight) lineHeight = countBlockHeight(blocks.back().get(), _st);
 		_minHeight += lineHeight;
 		accumulate_max(_maxWidth, _width);
 	}
@@ -2661,25 +2764,28 @@ bool Text::hasLinks() const {
 }
 
 bool Text::hasSkipBlock() const {
-	return _blocks.empty() ? false : _blocks.back()->type() == TextBlockTSkip;
+	auto &blocks = layout().blocks;
+	return blocks.empty() ? false : blocks.back()->type() == TextBlockTSkip;
 }
 
 void Text::setSkipBlock(int32 width, int32 height) {
-	if (!_blocks.empty() && _blocks.back()->type() == TextBlockTSkip) {
-		auto block = static_cast<SkipBlock*>(_blocks.back().get());
+	auto &blocks = mutableLayout().blocks;
+	if (!blocks.empty() && blocks.back()->type() == TextBlockTSkip) {
+		auto block = static_cast<SkipBlock*>(blocks.back().get());
 		if (block->width() == width && block->height() == height) return;
 		_text.resize(block->from());
-		_blocks.pop_back();
+		blocks.pop_back();
 	}
 	_text.push_back('_');
-	_blocks.push_back(std::make_unique<SkipBlock>(_st->font, _text, _text.size() - 1, width, height, 0));
+	blocks.push_back(TextBlockHolder::New<SkipBlock>(_st->font, _text, _text.size() - 1, width, height, 0));
 	recountNaturalSize(false);
 }
 
 void Text::removeSkipBlock() {
-	if (!_blocks.empty() && _blocks.back()->type() == TextBlockTSkip) {
-		_text.resize(_blocks.back()->from());
-		_blocks.pop_back();
+	if (hasSkipBlock()) {
+		auto &blocks = mutableLayout().blocks;
+		_text.resize(blocks.back()->from());
+		blocks.pop_back();
 		recountNaturalSize(false);
 	}
 }
@@ -2689,24 +2795,33 @@ int Text::countWidth(int width) const {
 		return _maxWidth.ceil().toInt();
 	}
 
-	QFixed maxLineWidth = 0;
-	enumerateLines(width, [&maxLineWidth](QFixed lineWidth, int lineHeight) {
-		if (lineWidth > maxLineWidth) {
-			maxLineWidth = lineWidth;
-		}
-	});
-	return maxLineWidth.ceil().toInt();
+	countLinesCached(width);
+	return _cachedLinesMaxWidth;
 }
 
 int Text::countHeight(int width) const {
 	if (QFixed(width) >= _maxWidth) {
 		return _minHeight;
 	}
-	int result = 0;
-	enumerateLines(width, [&result](QFixed lineWidth, int lineHeight) {
-		result += lineHeight;
+	countLinesCached(width);
+	return _cachedLinesHeight;
+}
+
+void Text::countLinesCached(int width) const {
+	if (_cachedLinesWidth == width) {
+		return;
+	}
+	QFixed maxLineWidth = 0;
+	int height = 0;
+	enumerateLines(width, [&maxLineWidth, &height](QFixed lineWidth, int lineHeight) {
+		if (lineWidth > maxLineWidth) {
+			maxLineWidth = lineWidth;
+		}
+		height += lineHeight;
 	});
-	return result;
+	_cachedLinesWidth = width;
+	_cachedLinesMaxWidth = maxLineWidth.ceil().toInt();
+	_cachedLinesHeight = height;
 }
 
 void Text::countLineWidths(int width, QVector<int> *lineWidths) const {
@@ -2723,7 +2838,7 @@ void Text::enumerateLines(int w, Callback callback) const {
 	int lineHeight = 0;
 	QFixed widthLeft = width, last_rBearing = 0, last_rPadding = 0;
 	bool longWordLine = true;
-	for (auto &b : _blocks) {
+	for (auto &b : layout().blocks) {
 		auto _btype = b->type();
 		int blockHeight = countBlockHeight(b.get(), _st);
 
@@ -2753,8 +2868,8 @@ void Text::enumerateLines(int w, Callback callback) const {
 		}
 
 		if (_btype == TextBlockTText) {
-			auto t = static_cast<TextBlock*>(b.get());
-			if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+			auto t = static_cast<const TextBlock*>(b.get());
+			if (!t->wordsCount()) { // no words in this block, spaces only => layout this block in the same line
 				last_rPadding += b->f_rpadding();
 
 				lineHeight = qMax(lineHeight, blockHeight);
@@ -2765,7 +2880,8 @@ void Text::enumerateLines(int w, Callback callback) const {
 
 			auto f_wLeft = widthLeft;
 			int f_lineHeight = lineHeight;
-			for (auto j = t->_words.cbegin(), e = t->_words.cend(), f = j; j != e; ++j) {
+			auto words = layout().words.cbegin() + t->wordsFrom();
+			for (auto j = words, e = words + t->wordsCount(), f = j; j != e; ++j) {
 				bool wordEndsHere = (j->f_width() >= 0);
 				auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
@@ -2887,15 +3003,20 @@ TextSelection Text::adjustSelection(TextSelection selection, TextSelectType sele
 }
 
 bool Text::isEmpty() const {
-	return _blocks.empty() || _blocks[0]->type() == TextBlockTSkip;
+	auto &blocks = layout().blocks;
+	return blocks.empty() || blocks[0]->type() == TextBlockTSkip;
 }
 
-uint16 Text::countBlockEnd(const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) const {
-	return (i + 1 == e) ? _text.size() : (*(i + 1))->from();
+const Text::Layout &Text::layout() const {
+	static const auto kEmpty = Layout();
+	return _layout ? *_layout : kEmpty;
 }
 
-uint16 Text::countBlockLength(const Text::TextBlocks::const_iterator &i, const Text::TextBlocks::const_iterator &e) const {
-	return countBlockEnd(i, e) - (*i)->from();
+Text::Layout &Text::mutableLayout() {
+	if (!_layout) {
+		_layout = std::make_unique<Layout>();
+	}
+	return *_layout;
 }
 
 template <typename AppendPartCallback, typename ClickHandlerStartCallback, typename ClickHandlerFinishCallback, typename FlagsChangeCallback>
@@ -2907,7 +3028,8 @@ void Text::enumerateText(TextSelection selection, AppendPartCallback appendPartC
 	int lnkIndex = 0;
 	uint16 lnkFrom = 0;
 	int32 flags = 0;
-	for (auto i = _blocks.cbegin(), e = _blocks.cend(); true; ++i) {
+	auto &blocks = layout().blocks;
+	for (auto i = blocks.cbegin(), e = blocks.cend(); true; ++i) {
 		int blockLnkIndex = (i == e) ? 0 : (*i)->lnkIndex();
 		uint16 blockFrom = (i == e) ? _text.size() : (*i)->from();
 		int32 blockFlags = (i == e) ? 0 : (*i)->flags();
@@ -2945,7 +3067,7 @@ void Text::enumerateText(TextSelection selection, AppendPartCallback appendPartC
 
 		if (!blockLnkIndex) {
 			auto rangeFrom = qMax(selection.from, blockFrom);
-			auto rangeTo = qMin(selection.to, uint16(blockFrom + countBlockLength(i, e)));
+			auto rangeTo = qMin(selection.to, uint16(blockFrom + CountBlockLength(_text, i, e)));
 			if (rangeTo > rangeFrom) {
 				appendPartCallback(_text.midRef(rangeFrom, rangeTo - rangeFrom));
 			}
@@ -3034,9 +3156,12 @@ void Text::clear() {
 }
 
 void Text::clearFields() {
-	_blocks.clear();
+	_layout = nullptr;
 	_links.clear();
 	_maxWidth = _minHeight = 0;
+	_cachedLinesWidth = -1;
+	_paragraphsWidth = -1;
+	_paragraphs.clear();
 	_startDir = Qt::LayoutDirectionAuto;
 }
 
@@ -81,7 +81,6 @@ static constexpr TextSelection AllTextSelection = { 0, 0xFFFF };
 typedef QPair<QString, QString> TextCustomTag; // open str and close str
 typedef QMap<QChar, TextCustomTag> TextCustomTagsMap;
 
-class ITextBlock;
 class Text {
 public:
 	Text(int32 minResizeWidth = QFIXED_MAX);
@@ -204,11 +203,13 @@ public:
 	~Text();
 
 private:
-	using TextBlocks = std::vector<std::unique_ptr<ITextBlock>>;
+	// Blocks and words of the text, defined in text.cpp so that this
+	// header doesn't include text_block.h. Not created until the text is set.
+	struct Layout;
 	using TextLinks = QVector<ClickHandlerPtr>;
 
-	uint16 countBlockEnd(const TextBlocks::const_iterator &i, const TextBlocks::const_iterator &e) const;
-	uint16 countBlockLength(const Text::TextBlocks::const_iterator &i, const Text::TextBlocks::const_iterator &e) const;
+	const Layout &layout() const;
+	Layout &mutableLayout(); // Creates the layout if needed.
 
 	// Template method for originalText(), originalTextWithEntities().
 	template <typename AppendPartCallback, typename ClickHandlerStartCallback, typename ClickHandlerFinishCallback, typename FlagsChangeCallback>
@@ -220,6 +221,10 @@ private:
 	template <typename Callback>
 	void enumerateLines(int w, Callback callback) const;
 
+	// Both countWidth() and countHeight() are called for the same width
+	// many times while resizing, so the last line breaking is remembered.
+	void countLinesCached(int width) const;
+
 	void recountNaturalSize(bool initial, Qt::LayoutDirection optionsDir = Qt::LayoutDirectionAuto);
 
 	// clear() deletes all blocks and calls this method
@@ -230,10 +235,25 @@ private:
 	QFixed _maxWidth = 0;
 	int32 _minHeight = 0;
 
+	mutable int _cachedLinesWidth = -1;
+	mutable int _cachedLinesMaxWidth = 0;
+	mutable int _cachedLinesHeight = 0;
+
+	// Where each paragraph starts when drawn in the remembered width,
+	// filled while drawing so that later draws can skip to the visible part.
+	struct ParagraphStart {
+		int block = 0;
+		int top = 0;
+		uint16 lookupSymbol = 0;
+		bool lookupAfterSymbol = false;
+	};
+	mutable int _paragraphsWidth = -1;
+	mutable std::vector<ParagraphStart> _paragraphs;
+
 	QString _text;
 	const style::TextStyle *_st = nullptr;
 
-	TextBlocks _blocks;
+	std::unique_ptr<Layout> _layout;
 	TextLinks _links;
 
 	Qt::LayoutDirection _startDir = Qt::LayoutDirectionAuto;
@@ -21,6 +21,7 @@ Copyright (c) 2014-2017 John Preston, https://desktop.telegram.org
 #pragma once
 
 #include "private/qfontengine_p.h"
+#include "core/memory_stats.h"
 
 enum TextBlockType {
 	TextBlockTNewline = 0x01,
@@ -77,10 +78,6 @@ public:
 		return (_flags & 0xFF);
 	}
 
-	virtual std::unique_ptr<ITextBlock> clone() const = 0;
-	virtual ~ITextBlock() {
-	}
-
 protected:
 	uint16 _from = 0;
 
@@ -107,10 +104,6 @@ public:
 		return _nextDir;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<NewlineBlock>(*this);
-	}
-
 private:
 	Qt::LayoutDirection _nextDir;
 
@@ -153,22 +146,29 @@ private:
 
 };
 
+using TextWords = std::vector<TextWord, Core::MemoryStats::Allocator<TextWord, Core::MemoryStats::Category::TextLayouts>>;
+
 class TextBlock : public ITextBlock {
 public:
-	TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex);
+	// The words of the block are appended to the words of the whole text.
+	TextBlock(const style::font &font, const QString &str, QFixed minResizeWidth, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, TextWords &words);
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<TextBlock>(*this);
+	int wordsFrom() const {
+		return _wordsFrom;
+	}
+	int wordsCount() const {
+		return _wordsCount;
 	}
 
 private:
 	friend class ITextBlock;
 	QFixed real_f_rbearing() const {
-		return _words.isEmpty() ? 0 : _words.back().f_rbearing();
+		return QFixed::fromFixed(_rbearing);
 	}
 
-	typedef QVector<TextWord> TextWords;
-	TextWords _words;
+	int _wordsFrom = 0;
+	uint16 _wordsCount = 0;
+	int16 _rbearing = 0; // of the last word
 
 	friend class Text;
 	friend class TextParser;
@@ -182,10 +182,6 @@ class EmojiBlock : public ITextBlock {
 public:
 	EmojiBlock(const style::font &font, const QString &str, uint16 from, uint16 length, uchar flags, uint16 lnkIndex, EmojiPtr emoji);
 
-	std::unique_ptr<ITextBlock> clone() const {
-		return std::make_unique<EmojiBlock>(*this);
-	}
-
 private:
 	EmojiPtr emoji = nullptr;
 
@@ -204,10 +200,6 @@ public:
 		return _height;
 	}
 
-	std::unique_ptr<ITextBlock> clone() const override {
-		return std::make_unique<SkipBlock>(*this);
-	}
-
 private:
 	int32 _height;
 
@@ -217,3 +209,44 @@ private:
 	friend class TextPainter;
 
 };
+
+// Holds any of the blocks in place, so that all blocks of a text are
+// stored in one array instead of a separate allocation for each block.
+// The blocks are trivially copyable, the words live in the text itself.
+class TextBlockHolder {
+public:
+	template <typename FinalBlock, typename ...Args>
+	static TextBlockHolder New(Args &&...args) {
+		static_assert(std::is_base_of<ITextBlock, FinalBlock>::value, "Bad block type.");
+		static_assert(sizeof(FinalBlock) <= sizeof(Data), "Block is too big.");
+		static_assert(alignof(FinalBlock) <= alignof(Data), "Block is aligned too much.");
+		static_assert(std::is_trivially_copyable<FinalBlock>::value, "Block should be trivially copyable.");
+
+		auto result = TextBlockHolder();
+		new (&result._data) FinalBlock(std::forward<Args>(args)...);
+		return result;
+	}
+
+	ITextBlock *get() {
+		return reinterpret_cast<ITextBlock*>(&_data);
+	}
+	const ITextBlock *get() const {
+		return reinterpret_cast<const ITextBlock*>(&_data);
+	}
+	ITextBlock *operator->() {
+		return get();
+	}
+	const ITextBlock *operator->() const {
+		return get();
+	}
+
+private:
+	TextBlockHolder() = default;
+
+	static constexpr auto kMaxSize = std::max({ sizeof(NewlineBlock), sizeof(TextBlock), sizeof(EmojiBlock), sizeof(SkipBlock) });
+	static constexpr auto kMaxAlign = std::max({ alignof(NewlineBlock), alignof(TextBlock), alignof(EmojiBlock), alignof(SkipBlock) });
+	using Data = std::aligned_storage_t<kMaxSize, kMaxAlign>;
+
+	Data _data;
+
+};
@@ -1130,6 +1130,84 @@ const QRegularExpression &RegExpWordSplit() {
 	return result;
 }
 
+// Checks four characters at once, most of the names and usernames are ASCII.
+bool IsAsciiOnly(const QString &text) {
+	constexpr auto kNonAsciiMask = 0xFF80FF80FF80FF80ULL;
+	auto ch = text.constData(), e = ch + text.size();
+	for (; e - ch >= 4; ch += 4) {
+		auto word = uint64();
+		memcpy(&word, ch, sizeof(word));
+		if (word & kNonAsciiMask) {
+			return false;
+		}
+	}
+	for (; ch != e; ++ch) {
+		if (ch->unicode() >= 128) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Characters without which the entity expressions can't match.
+struct EntityTriggers {
+	bool dot = false; // domain
+	bool colon = false; // explicit domain with a protocol
+	bool hash = false; // hashtag
+	bool at = false; // mention
+	bool slash = false; // bot command
+	bool asterisk = false; // markdown bold
+	bool underscore = false; // markdown italic
+	bool backtick = false; // markdown code and pre
+};
+
+EntityTriggers FindEntityTriggers(const QString &text) {
+	auto result = EntityTriggers();
+	for (auto ch : text) {
+		switch (ch.unicode()) {
+		case '.': result.dot = true; break;
+		case ':': result.colon = true; break;
+		case '#': result.hash = true; break;
+		case '@': result.at = true; break;
+		case '/': result.slash = true; break;
+		case '*': result.asterisk = true; break;
+		case '_': result.underscore = true; break;
+		case '`': result.backtick = true; break;
+		}
+	}
+	return result;
+}
+
+// Remembers the last match of a regular expression in the same text.
+// A match found from an earlier offset is still the first one from a
+// later offset if it doesn't start before it, so it can be reused.
+class CachedMatch {
+public:
+	CachedMatch(const QRegularExpression &expression, const QString &text, bool possible)
+	: _expression(expression)
+	, _text(text)
+	, _possible(possible) {
+	}
+
+	QRegularExpressionMatch find(int offset) {
+		if (!_possible) {
+			return QRegularExpressionMatch();
+		} else if (_offset < 0 || offset < _offset || (_match.hasMatch() && _match.capturedStart() < offset)) {
+			_match = _expression.match(_text, offset);
+			_offset = offset;
+		}
+		return _match;
+	}
+
+private:
+	const QRegularExpression &_expression;
+	const QString &_text;
+	bool _possible = false;
+	int _offset = -1;
+	QRegularExpressionMatch _match;
+
+};
+
 } // namespace
 
 const QRegularExpression &RegExpDomain() {
@@ -1248,6 +1326,9 @@ QString SingleLine(const QString &text) {
 }
 
 QString RemoveAccents(const QString &text) {
+	if (IsAsciiOnly(text)) {
+		return text;
+	}
 	auto result = text;
 	auto copying = false;
 	auto i = 0;
@@ -1650,11 +1731,12 @@ void ParseMarkdown(TextWithEntities &result, bool rich) {
 	}
 	auto newResult = TextWithEntities();
 
+	auto triggers = FindEntityTriggers(result.text);
 	MarkdownPart computedParts[4] = {
-		{ EntityInTextBold },
-		{ EntityInTextItalic },
-		{ EntityInTextPre },
-		{ EntityInTextCode },
+		{ triggers.asterisk ? EntityInTextBold : EntityInTextInvalid },
+		{ triggers.underscore ? EntityInTextItalic : EntityInTextInvalid },
+		{ triggers.backtick ? EntityInTextPre : EntityInTextInvalid },
+		{ triggers.backtick ? EntityInTextCode : EntityInTextInvalid },
 	};
 
 	auto existingEntityIndex = 0;
@@ -1781,6 +1863,16 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 	int existingEntityIndex = 0, existingEntitiesCount = result.entities.size();
 	int existingEntityEnd = 0;
 
+	// Each expression is searched again only after the offset passes its
+	// last match, not for every entity found, and is not searched at all
+	// if the text has no character it needs.
+	auto triggers = FindEntityTriggers(result.text);
+	auto domains = CachedMatch(RegExpDomain(), result.text, triggers.dot);
+	auto explicitDomains = CachedMatch(RegExpDomainExplicit(), result.text, triggers.colon);
+	auto hashtags = CachedMatch(RegExpHashtag(), result.text, withHashtags && triggers.hash);
+	auto mentions = CachedMatch(RegExpMention(), result.text, withMentions && triggers.at);
+	auto botCommands = CachedMatch(RegExpBotCommand(), result.text, withBotCommands && triggers.slash);
+
 	int32 len = result.text.size(), commandOffset = rich ? 0 : len;
 	bool inLink = false, commandIsLink = false;
 	const QChar *start = result.text.constData(), *end = start + result.text.size();
@@ -1794,11 +1886,11 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 				}
 			}
 		}
-		auto mDomain = RegExpDomain().match(result.text, matchOffset);
-		auto mExplicitDomain = RegExpDomainExplicit().match(result.text, matchOffset);
-		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
-		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
-		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mDomain = domains.find(matchOffset);
+		auto mExplicitDomain = explicitDomains.find(matchOffset);
+		auto mHashtag = hashtags.find(matchOffset);
+		auto mMention = mentions.find(qMax(mentionSkip, matchOffset));
+		auto mBotCommand = botCommands.find(matchOffset);
 
 		EntityInTextType lnkType = EntityInTextUrl;
 		int32 lnkStart = 0, lnkLength = 0;
@@ -1829,7 +1921,7 @@ void ParseEntities(TextWithEntities &result, int32 flags, bool rich) {
 			}
 			if (!(start + mentionStart + 1)->isLetter() || !(start + mentionEnd - 1)->isLetterOrNumber()) {
 				mentionSkip = mentionEnd;
-				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
+				mMention = mentions.find(qMax(mentionSkip, matchOffset));
 				if (mMention.hasMatch()) {
 					mentionStart = mMention.capturedStart();
 					mentionEnd = mMention.capturedEnd();
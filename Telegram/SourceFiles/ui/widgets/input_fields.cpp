@@ -704,6 +704,65 @@ private:
 
 };
 
+// Plain text and tag ids of one block, kept until the block is changed.
+class BlockTextCache : public QTextBlockUserData {
+public:
+	QString text;
+	std::vector<std::pair<QString, int>> tags; // Tag id and its start in text.
+
+};
+
+// Appends the fragment text to result, replacing emoji images by emoji text.
+void AppendFragmentText(QString &result, const QTextFragment &fragment, QString t) {
+	QTextCharFormat f = fragment.charFormat();
+	QString emojiText;
+	QChar *ub = t.data(), *uc = ub, *ue = uc + t.size();
+	for (; uc != ue; ++uc) {
+		switch (uc->unicode()) {
+		case 0xfdd0: // QTextBeginningOfFrame
+		case 0xfdd1: // QTextEndOfFrame
+		case QChar::ParagraphSeparator:
+		case QChar::LineSeparator: {
+			*uc = QLatin1Char('\n');
+		} break;
+		case QChar::Nbsp: {
+			*uc = QLatin1Char(' ');
+		} break;
+		case QChar::ObjectReplacementCharacter: {
+			if (emojiText.isEmpty() && f.isImageFormat()) {
+				auto imageName = static_cast<QTextImageFormat*>(&f)->name();
+				if (auto emoji = Ui::Emoji::FromUrl(imageName)) {
+					emojiText = emoji->text();
+				}
+			}
+			if (uc > ub) result.append(ub, uc - ub);
+			if (!emojiText.isEmpty()) result.append(emojiText);
+			ub = uc + 1;
+		} break;
+		}
+	}
+	if (uc > ub) result.append(ub, uc - ub);
+}
+
+const BlockTextCache *GetBlockTextCache(QTextBlock block) {
+	if (auto cache = static_cast<BlockTextCache*>(block.userData())) {
+		return cache;
+	}
+	auto cache = new BlockTextCache();
+	for (auto iter = block.begin(); !iter.atEnd(); ++iter) {
+		QTextFragment fragment(iter.fragment());
+		if (!fragment.isValid()) continue;
+
+		auto tagId = fragment.charFormat().anchorName();
+		if (cache->tags.empty() || cache->tags.back().first != tagId) {
+			cache->tags.push_back({ tagId, cache->text.size() });
+		}
+		AppendFragmentText(cache->text, fragment, fragment.text());
+	}
+	block.setUserData(cache);
+	return cache;
+}
+
 } // namespace
 
 QString FlatTextarea::getTextPart(int start, int end, TagList *outTagsList, bool *outTagsChanged) const {
@@ -730,63 +789,43 @@ QString FlatTextarea::getTextPart(int start, int end, TagList *outTagsList, bool
 
 	bool tillFragmentEnd = full;
 	for (auto b = from; b != till; b = b.next()) {
+		if (full) {
+			// Only the blocks changed since the last call are processed.
+			auto cache = GetBlockTextCache(b);
+			auto blockStart = result.size();
+			for (auto &tag : cache->tags) {
+				tagAccumulator.feed(tag.first, blockStart + tag.second);
+			}
+			result.append(cache->text);
+			result.append('\n');
+			continue;
+		}
 		for (auto iter = b.begin(); !iter.atEnd(); ++iter) {
 			QTextFragment fragment(iter.fragment());
 			if (!fragment.isValid()) continue;
 
-			int32 p = full ? 0 : fragment.position(), e = full ? 0 : (p + fragment.length());
-			if (!full) {
-				tillFragmentEnd = (e <= end);
-				if (p == end) {
-					tagAccumulator.feed(fragment.charFormat().anchorName(), result.size());
-				}
-				if (p >= end) {
-					break;
-				}
-				if (e <= start) {
-					continue;
-				}
+			int32 p = fragment.position(), e = (p + fragment.length());
+			tillFragmentEnd = (e <= end);
+			if (p == end) {
+				tagAccumulator.feed(fragment.charFormat().anchorName(), result.size());
+			}
+			if (p >= end) {
+				break;
 			}
-			if (full || p >= start) {
+			if (e <= start) {
+				continue;
+			}
+			if (p >= start) {
 				tagAccumulator.feed(fragment.charFormat().anchorName(), result.size());
 			}
 
-			QTextCharFormat f = fragment.charFormat();
-			QString emojiText;
 			QString t(fragment.text());
-			if (!full) {
-				if (p < start) {
-					t = t.mid(start - p, end - start);
-				} else if (e > end) {
-					t = t.mid(0, end - p);
-				}
-			}
-			QChar *ub = t.data(), *uc = ub, *ue = uc + t.size();
-			for (; uc != ue; ++uc) {
-				switch (uc->unicode()) {
-				case 0xfdd0: // QTextBeginningOfFrame
-				case 0xfdd1: // QTextEndOfFrame
-				case QChar::ParagraphSeparator:
-				case QChar::LineSeparator: {
-					*uc = QLatin1Char('\n');
-				} break;
-				case QChar::Nbsp: {
-					*uc = QLatin1Char(' ');
-				} break;
-				case QChar::ObjectReplacementCharacter: {
-					if (emojiText.isEmpty() && f.isImageFormat()) {
-						auto imageName = static_cast<QTextImageFormat*>(&f)->name();
-						if (auto emoji = Ui::Emoji::FromUrl(imageName)) {
-							emojiText = emoji->text();
-						}
-					}
-					if (uc > ub) result.append(ub, uc - ub);
-					if (!emojiText.isEmpty()) result.append(emojiText);
-					ub = uc + 1;
-				} break;
-				}
+			if (p < start) {
+				t = t.mid(start - p, end - start);
+			} else if (e > end) {
+				t = t.mid(0, end - p);
 			}
-			if (uc > ub) result.append(ub, uc - ub);
+			AppendFragmentText(result, fragment, t);
 		}
 		result.append('\n');
 	}
@@ -1209,6 +1248,8 @@ void FlatTextarea::processFormatting(int insertPosition, int insertEnd) {
 }
 
 void FlatTextarea::onDocumentContentsChange(int position, int charsRemoved, int charsAdded) {
+	// Our own corrections change the document as well.
+	invalidateBlockTexts(position, charsAdded);
 	if (_correcting) return;
 
 	int insertPosition = (_realInsertPosition >= 0) ? _realInsertPosition : position;
@@ -1284,6 +1325,15 @@ void FlatTextarea::onDocumentContentsChange(int position, int charsRemoved, int
 	QTextCursor(document()->docHandle(), 0).endEditBlock();
 }
 
+void FlatTextarea::invalidateBlockTexts(int position, int charsAdded) {
+	auto doc = document();
+	auto from = doc->findBlock(position), till = doc->findBlock(position + charsAdded);
+	if (till.isValid()) till = till.next();
+	for (auto block = from; block != till; block = block.next()) {
+		block.setUserData(nullptr);
+	}
+}
+
 void FlatTextarea::onDocumentContentsChanged() {
 	if (_correcting) return;
 
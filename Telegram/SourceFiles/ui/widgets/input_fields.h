@@ -158,6 +158,10 @@ private:
 	// by ObjectReplacementCharacter. If "end" = -1 means get text till the end.
 	QString getTextPart(int start, int end, TagList *outTagsList, bool *outTagsChanged = nullptr) const;
 
+	// The full text is collected from per block caches, see getTextPart().
+	// They are dropped for the blocks touched by each document change.
+	void invalidateBlockTexts(int position, int charsAdded);
+
 	void getSingleEmojiFragment(QString &text, QTextFragment &fragment) const;
 
 	// After any characters added we must postprocess them. This includes:
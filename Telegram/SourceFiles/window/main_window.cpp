@@ -33,6 +33,9 @@ namespace Window {
 
 constexpr auto kInactivePressTimeout = 200;
 
+// Tray and taskbar icons are regenerated not more often than that.
+constexpr auto kUnreadCounterUpdateDelay = TimeMs(300);
+
 QImage LoadLogo() {
 	return QImage(qsl(":/gui/art/logo_256.png"));
 }
@@ -77,6 +80,7 @@ MainWindow::MainWindow() : QWidget()
 
 	_isActiveTimer.setCallback([this] { updateIsActive(0); });
 	_inactivePressTimer.setCallback([this] { setInactivePress(false); });
+	_unreadCounterTimer.setCallback([this] { updateUnreadCounter(); });
 }
 
 bool MainWindow::hideNoQuit() {
@@ -274,6 +278,16 @@ void MainWindow::updateControlsGeometry() {
 void MainWindow::updateUnreadCounter() {
 	if (!Global::started() || App::quitting()) return;
 
+	auto ms = getms(true);
+	if (_unreadCounterUpdated > 0 && ms < _unreadCounterUpdated + kUnreadCounterUpdateDelay) {
+		if (!_unreadCounterTimer.isActive()) {
+			_unreadCounterTimer.callOnce(_unreadCounterUpdated + kUnreadCounterUpdateDelay - ms);
+		}
+		return;
+	}
+	_unreadCounterTimer.cancel();
+	_unreadCounterUpdated = ms;
+
 	auto counter = App::histories().unreadBadge();
 	_titleText = (counter > 0) ? qsl("Telegram (%1)").arg(counter) : qsl("Telegram");
 
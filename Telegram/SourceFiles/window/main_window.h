@@ -183,6 +183,9 @@ private:
 	bool _wasInactivePress = false;
 	base::Timer _inactivePressTimer;
 
+	TimeMs _unreadCounterUpdated = 0;
+	base::Timer _unreadCounterTimer;
+
 	base::Observable<void> _dragFinished;
 	base::Observable<void> _widgetGrabbed;
 
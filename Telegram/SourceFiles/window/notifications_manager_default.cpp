@@ -93,6 +93,40 @@ bool Manager::hasReplyingNotification() const {
 	return false;
 }
 
+bool Manager::hasFreeNotificationSlot() const {
+	auto count = Global::NotificationsCount();
+	for_const (auto &notification, _notifications) {
+		if (!notification->isUnlinked()) {
+			--count;
+		}
+	}
+	return (count > 0);
+}
+
+bool Manager::groupWithShown(HistoryItem *item, int forwardedCount) {
+	// Messages come faster than they can be shown, so instead of
+	// creating one more widget a shown or queued notification from the
+	// same history is updated to the latest message.
+	if (_queuedNotifications.empty() && hasFreeNotificationSlot()) {
+		return false;
+	}
+	auto history = item->history();
+	for_const (auto &notification, _notifications) {
+		if (notification->canShowAnotherItem(history)) {
+			auto queued = QueuedNotification(item, forwardedCount);
+			notification->showAnotherItem(queued.author, queued.item, queued.forwardedCount);
+			return true;
+		}
+	}
+	for (auto &queued : _queuedNotifications) {
+		if (queued.history == history) {
+			queued = QueuedNotification(item, forwardedCount);
+			return true;
+		}
+	}
+	return false;
+}
+
 void Manager::settingsChanged(ChangeType change) {
 	if (change == ChangeType::Corner) {
 		auto startPosition = notificationStartPosition();
@@ -290,6 +324,9 @@ void Manager::removeWidget(internal::Widget *remove) {
 }
 
 void Manager::doShowNotification(HistoryItem *item, int forwardedCount) {
+	if (groupWithShown(item, forwardedCount)) {
+		return;
+	}
 	_queuedNotifications.push_back(QueuedNotification(item, forwardedCount));
 	showNextFromQueue();
 }
@@ -722,6 +759,22 @@ void Notification::updatePeerPhoto() {
 	update();
 }
 
+bool Notification::canShowAnotherItem(History *history) const {
+	return (_history == history) && !isReplying();
+}
+
+void Notification::showAnotherItem(PeerData *author, HistoryItem *item, int forwardedCount) {
+	_author = author;
+	_item = item;
+	_forwardedCount = forwardedCount;
+	updateNotifyDisplay();
+
+	stopHiding();
+	if (!_waitingForInput && !rect().contains(mapFromGlobal(QCursor::pos()))) {
+		_hideTimer.start(st::notifyWaitLongHide);
+	}
+}
+
 bool Notification::unlinkItem(HistoryItem *deleted) {
 	auto unlink = (_item && _item == deleted);
 	if (unlink) {
@@ -86,6 +86,8 @@ private:
 	void settingsChanged(ChangeType change);
 
 	bool hasReplyingNotification() const;
+	bool hasFreeNotificationSlot() const;
+	bool groupWithShown(HistoryItem *item, int forwardedCount);
 
 	std::vector<std::unique_ptr<Notification>> _notifications;
 
@@ -202,6 +204,8 @@ public:
 	}
 
 	// Called only by Manager.
+	bool canShowAnotherItem(History *history) const;
+	void showAnotherItem(PeerData *author, HistoryItem *item, int forwardedCount);
 	bool unlinkItem(HistoryItem *del);
 	bool unlinkHistory(History *history = nullptr);
 	bool checkLastInput(bool hasReplyingNotifications);
@@ -36,6 +36,7 @@ constexpr auto kThemeFileSizeLimit = 5 * 1024 * 1024;
 constexpr auto kThemeBackgroundSizeLimit = 4 * 1024 * 1024;
 constexpr auto kThemeSchemeSizeLimit = 1024 * 1024;
 constexpr auto kMinimumTiledSize = 512;
+constexpr auto kPreparedBackgroundsLimit = 2; // For example maximized and normal window.
 constexpr auto kNightThemeFile = str_const(":/gui/night.tdesktop-theme");
 
 struct Data {
@@ -48,6 +49,9 @@ struct Data {
 
 	ChatBackground background;
 	Applying applying;
+
+	// Compiled night theme, so that switching to it doesn't parse it again.
+	Cached nightThemeCached;
 };
 NeverFreedPointer<Data> instance;
 
@@ -208,7 +212,7 @@ void applyBackground(QImage &&background, bool tiled, Instance *out) {
 	}
 }
 
-bool loadThemeFromCache(const QByteArray &content, Cached &cache) {
+bool loadThemeFromCache(const QByteArray &content, const Cached &cache, Instance *out = nullptr) {
 	if (cache.paletteChecksum != style::palette::Checksum()) {
 		return false;
 	}
@@ -218,7 +222,8 @@ bool loadThemeFromCache(const QByteArray &content, Cached &cache) {
 
 	QImage background;
 	if (!cache.background.isEmpty()) {
-		QBuffer buffer(&cache.background);
+		auto bytes = cache.background;
+		QBuffer buffer(&bytes);
 		QImageReader reader(&buffer);
 #ifndef OS_MAC_OLD
 		reader.setAutoTransform(true);
@@ -228,11 +233,16 @@ bool loadThemeFromCache(const QByteArray &content, Cached &cache) {
 		}
 	}
 
-	if (!style::main_palette::load(cache.colors)) {
+	if (out) {
+		if (!out->palette.load(cache.colors)) {
+			return false;
+		}
+		out->cached = cache;
+	} else if (!style::main_palette::load(cache.colors)) {
 		return false;
 	}
 	if (!background.isNull()) {
-		applyBackground(std::move(background), cache.tiled, nullptr);
+		applyBackground(std::move(background), cache.tiled, out);
 	}
 
 	return true;
@@ -500,6 +510,7 @@ void ChatBackground::setPreparedImage(QImage &&image) {
 	if (!isSmallForTiled) {
 		_pixmapForTiled = _pixmap;
 	}
+	clearPrepared();
 }
 
 int32 ChatBackground::id() const {
@@ -510,6 +521,71 @@ bool ChatBackground::tile() const {
 	return _tile;
 }
 
+QPixmap ChatBackground::preparedFor(QSize size, int &x, int &y) {
+	const auto i = std::find_if(_prepared.begin(), _prepared.end(), [&](const Prepared &prepared) {
+		return (prepared.size == size);
+	});
+	if (i == _prepared.end()) {
+		return QPixmap();
+	}
+	if (i + 1 != _prepared.end()) {
+		std::rotate(i, i + 1, _prepared.end());
+	}
+	const auto &result = _prepared.back();
+	x = result.x;
+	y = result.y;
+	return result.pixmap;
+}
+
+void ChatBackground::prepareFor(QSize size) {
+	if (size.isEmpty() || _pixmap.isNull()) {
+		return;
+	}
+	auto dummyX = 0, dummyY = 0;
+	if (!preparedFor(size, dummyX, dummyY).isNull()) {
+		return;
+	}
+
+	auto prepared = Prepared();
+	prepared.size = size;
+	if (_tile) {
+		auto &bg = _pixmapForTiled;
+
+		auto result = QImage(size.width() * cIntRetinaFactor(), size.height() * cIntRetinaFactor(), QImage::Format_RGB32);
+		result.setDevicePixelRatio(cRetinaFactor());
+		{
+			QPainter p(&result);
+			auto w = bg.width() / cRetinaFactor();
+			auto h = bg.height() / cRetinaFactor();
+			auto cx = qCeil(size.width() / w);
+			auto cy = qCeil(size.height() / h);
+			for (auto i = 0; i < cx; ++i) {
+				for (auto j = 0; j < cy; ++j) {
+					p.drawPixmap(QPointF(i * w, j * h), bg);
+				}
+			}
+		}
+		prepared.pixmap = App::pixmapFromImageInPlace(std::move(result));
+	} else {
+		auto &bg = _pixmap;
+
+		QRect to, from;
+		ComputeBackgroundRects(QRect(QPoint(), size), bg.size(), to, from);
+		prepared.x = to.x();
+		prepared.y = to.y();
+		prepared.pixmap = App::pixmapFromImageInPlace(bg.toImage().copy(from).scaled(to.width() * cIntRetinaFactor(), to.height() * cIntRetinaFactor(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+		prepared.pixmap.setDevicePixelRatio(cRetinaFactor());
+	}
+	if (int(_prepared.size()) >= kPreparedBackgroundsLimit) {
+		_prepared.erase(_prepared.begin());
+	}
+	_prepared.push_back(std::move(prepared));
+}
+
+void ChatBackground::clearPrepared() {
+	_prepared.clear();
+}
+
 bool ChatBackground::tileForSave() const {
 	if (_id == internal::kTestingThemeBackground ||
 		_id == internal::kTestingDefaultBackground) {
@@ -530,6 +606,7 @@ void ChatBackground::setTile(bool tile) {
 	ensureStarted();
 	if (_tile != tile) {
 		_tile = tile;
+		clearPrepared();
 		if (_id != internal::kTestingThemeBackground && _id != internal::kTestingDefaultBackground) {
 			Local::writeUserSettings();
 		}
@@ -774,7 +851,20 @@ bool LoadFromFile(const QString &path, Instance *out, QByteArray *outContent) {
 		return false;
 	}
 
-	return loadTheme(*outContent,  out->cached, out);
+	auto isNightTheme = (path == str_const_toString(kNightThemeFile));
+	if (isNightTheme) {
+		instance.createIfNull();
+		if (loadThemeFromCache(*outContent, instance->nightThemeCached, out)) {
+			return true;
+		}
+	}
+	if (!loadTheme(*outContent, out->cached, out)) {
+		return false;
+	}
+	if (isNightTheme) {
+		instance->nightThemeCached = out->cached;
+	}
+	return true;
 }
 
 bool IsPaletteTestingPath(const QString &path) {
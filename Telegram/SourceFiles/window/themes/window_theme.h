@@ -122,16 +122,30 @@ public:
 	bool tile() const;
 	bool tileForSave() const;
 
+	// Returns the background scaled (or tiled) for the exact fill size
+	// if it was prepared by prepareFor() already, a null pixmap otherwise.
+	QPixmap preparedFor(QSize size, int &x, int &y);
+	void prepareFor(QSize size);
+
 private:
+	struct Prepared {
+		QSize size;
+		QPixmap pixmap;
+		int x = 0;
+		int y = 0;
+	};
+
 	void ensureStarted();
 	void saveForRevert();
 	void setPreparedImage(QImage &&image);
 	void writeNewBackgroundSettings();
+	void clearPrepared();
 
 	int32 _id = internal::kUninitializedBackground;
 	QPixmap _pixmap;
 	QPixmap _pixmapForTiled;
 	bool _tile = false;
+	std::vector<Prepared> _prepared; // Most recently used goes last.
 
 	QImage _themeImage;
 	bool _themeTile = false;
@@ -195,7 +195,7 @@ void MainMenu::paintEvent(QPaintEvent *e) {
 		p.setPen(st::mainMenuCoverFg);
 		p.setFont(st::semiboldFont);
 		if (auto self = App::self()) {
-			self->nameText.drawLeftElided(p, st::mainMenuCoverTextLeft, st::mainMenuCoverNameTop, width() - 2 * st::mainMenuCoverTextLeft, width());
+			self->nameText().drawLeftElided(p, st::mainMenuCoverTextLeft, st::mainMenuCoverNameTop, width() - 2 * st::mainMenuCoverTextLeft, width());
 			p.setFont(st::normalFont);
 			p.drawTextLeft(st::mainMenuCoverTextLeft, st::mainMenuCoverStatusTop, width(), _phoneText);
 		}
@@ -239,7 +239,9 @@ std::vector<Suggestion> Completer::resolve() {
 	if (!_querySize) {
 		return std::vector<Suggestion>();
 	}
-	_initialList = Ui::Emoji::internal::GetReplacements(*_queryBegin);
+	_initialList = (_querySize > 1)
+		? Ui::Emoji::internal::GetReplacements(*_queryBegin, *(_queryBegin + 1))
+		: Ui::Emoji::internal::GetReplacements(*_queryBegin);
 	if (!_initialList) {
 		return std::vector<Suggestion>();
 	}
@@ -0,0 +1,58 @@
+# This file is part of Telegram Desktop,
+# the official desktop version of Telegram messaging app, see https://telegram.org
+#
+# Telegram Desktop is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# It is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# In addition, as a special exception, the copyright holders give permission
+# to link the code of portions of this program with the OpenSSL library.
+#
+# Full license: https://github.com/telegramdesktop/tdesktop/blob/master/LICENSE
+# Copyright (c) 2014 John Preston, https://desktop.telegram.org
+
+
+# Kernels that need instruction sets above the baseline of the build.
+# Each target compiles its sources with the matching compiler flags,
+# the code is called only if base::CpuHas() reports the feature.
+{
+  'includes': [
+    'common.gypi',
+  ],
+  'variables': {
+    'src_loc': '../SourceFiles',
+  },
+  'targets': [{
+    'target_name': 'lib_simd_avx2',
+    'type': 'static_library',
+    'includes': [
+      'common.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/media/media_audio_peak_avx2.cpp',
+      '<(src_loc)/media/media_audio_peak_avx2.h',
+    ],
+    'msvs_settings': {
+      'VCCLCompilerTool': {
+        'EnableEnhancedInstructionSet': '5', # Advanced Vector Extensions 2 (/arch:AVX2)
+      },
+    },
+    'xcode_settings': {
+      'OTHER_CPLUSPLUSFLAGS': [
+        '-mavx2',
+      ],
+    },
+    'cflags_cc': [
+      '-mavx2',
+    ],
+  }],
+}
@@ -55,6 +55,15 @@
       ],
       'message': 'Running <(RULE_INPUT_ROOT)..',
     }]
+  }, {
+    'target_name': 'tests_lambda',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/lambda.h',
+      '<(src_loc)/base/lambda_tests.cpp',
+    ],
   }, {
     'target_name': 'tests_flat_map',
     'includes': [
@@ -64,6 +73,20 @@
       '<(src_loc)/base/flat_map.h',
       '<(src_loc)/base/flat_map_tests.cpp',
     ],
+  }, {
+    'target_name': 'benchmark_flat_map',
+    'includes': [
+      '../common_executable.gypi',
+      '../qt.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/base/flat_map.h',
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/flat_map_benchmark.cpp',
+    ],
   }, {
     'target_name': 'tests_flat_set',
     'includes': [
@@ -82,5 +105,109 @@
       '<(src_loc)/base/flags.h',
       '<(src_loc)/base/flags_tests.cpp',
     ],
+  }, {
+    'target_name': 'tests_observer_handlers',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/observer_handlers.h',
+      '<(src_loc)/base/observer_handlers_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_deadline_queue',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/deadline_queue.h',
+      '<(src_loc)/base/deadline_queue_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_cpu_features',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'dependencies': [
+      '../simd.gyp:lib_simd_avx2',
+    ],
+    'sources': [
+      '<(src_loc)/base/cpu_features.cpp',
+      '<(src_loc)/base/cpu_features.h',
+      '<(src_loc)/base/cpu_features_tests.cpp',
+    ],
+  }, {
+    'target_name': 'tests_ring_map',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/ring_map.h',
+      '<(src_loc)/base/ring_map_tests.cpp',
+    ],
+  }, {
+    'target_name': 'benchmark_ring_map',
+    'includes': [
+      '../common_executable.gypi',
+      '../qt.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/base/ring_map.h',
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/ring_map_benchmark.cpp',
+    ],
+  }, {
+    'target_name': 'tests_sequence_map',
+    'includes': [
+      'common_test.gypi',
+    ],
+    'sources': [
+      '<(src_loc)/base/sequence_map.h',
+      '<(src_loc)/base/sequence_map_tests.cpp',
+    ],
+  }, {
+    'target_name': 'benchmark_sequence_map',
+    'includes': [
+      '../common_executable.gypi',
+      '../qt.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/base/sequence_map.h',
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/sequence_map_benchmark.cpp',
+    ],
+  }, {
+    'target_name': 'benchmark_msgs_registry',
+    'includes': [
+      '../common_executable.gypi',
+      '../qt.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/msgs_registry_benchmark.cpp',
+    ],
+  }, {
+    'target_name': 'benchmark_observer_handlers',
+    'includes': [
+      '../common_executable.gypi',
+      '../qt.gypi',
+    ],
+    'include_dirs': [
+      '<(src_loc)',
+    ],
+    'sources': [
+      '<(src_loc)/base/observer_handlers.h',
+      '<(src_loc)/base/benchmark.h',
+      '<(src_loc)/base/observer_handlers_benchmark.cpp',
+    ],
   }],
 }
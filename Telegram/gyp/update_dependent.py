@@ -93,6 +93,19 @@ def get_direct_style_dependencies(file_path):
           eprint('File not found: ' + path)
   return dependencies
 
+# Each style file gets its own timestamp which is updated only when one of
+# the style files it uses (directly or not) is modified, so that the style
+# codegen is run only for the modules that depend on the changed one.
+def get_style_timestamp_path(file_path):
+  file_root = os.path.splitext(os.path.basename(file_path))[0]
+  output_dir = os.path.dirname(output_file).replace('\\', '/')
+  return output_dir + '/update_dependent_styles/' + file_root + '.timestamp'
+
+def list_style_timestamps(file_paths):
+  for file_path in file_paths:
+    print(get_style_timestamp_path(file_path))
+  sys.exit(0)
+
 include_dirs = []
 def handle_style_dependencies(file_path):
   global one_modified
@@ -111,15 +124,23 @@ def handle_style_dependencies(file_path):
           all_dependencies[new_dependency] = 1
         break
 
-  file_modified = os.path.getmtime(file_path)
-  latest_modified = file_modified
+  latest_modified = 0
   for path in all_dependencies:
     if path != file_path:
       dependency_modified = os.path.getmtime(path)
       if latest_modified < dependency_modified:
         latest_modified = dependency_modified
-  if file_modified < latest_modified:
-    os.utime(file_path, None);
+
+  timestamp_path = get_style_timestamp_path(file_path)
+  if not os.path.isfile(timestamp_path):
+    timestamp_dir = os.path.dirname(timestamp_path)
+    if not os.path.isdir(timestamp_dir):
+      os.makedirs(timestamp_dir)
+    with open(timestamp_path, 'w') as f:
+      f.write('1')
+    one_modified = 1
+  elif os.path.getmtime(timestamp_path) < latest_modified:
+    os.utime(timestamp_path, None);
     one_modified = 1
 
 file_paths = []
@@ -132,7 +153,7 @@ for arg in sys.argv:
   if next_self != 0:
     next_self = 0
     continue
-  if arg == '--styles' or arg == '--qrc_list' or arg == '--qrc':
+  if arg == '--styles' or arg == '--styles_timestamps' or arg == '--qrc_list' or arg == '--qrc':
     if request == '':
       request = arg[2:]
     else:
@@ -168,6 +189,8 @@ for arg in sys.argv:
 if request == 'styles':
   for file_path in file_paths:
     handle_style_dependencies(file_path)
+elif request == 'styles_timestamps':
+  list_style_timestamps(file_paths)
 elif request == 'qrc':
   for file_path in file_paths:
     handle_qrc_dependencies(file_path)